@@ -0,0 +1,200 @@
+#ifndef skjvm_assembler_hpp
+#define skjvm_assembler_hpp
+
+#include <skjvm/memory.hpp>
+
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief The general purpose registers of x86-64, numbered as in their
+  /// encoding.
+  enum class Register : uint8_t {
+    rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+    r8, r9, r10, r11, r12, r13, r14, r15,
+  };
+
+  enum class Xmm : uint8_t {
+    xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7,
+  };
+
+  /// \brief The condition codes of \c jcc, numbered as in their encoding.
+  /// \c below and \c above are the unsigned comparisons.
+  enum class Condition : uint8_t {
+    overflow, no_overflow, below, above_equal, equal, not_equal, below_equal,
+    above, sign, not_sign, parity, no_parity, less, greater_equal,
+    less_equal, greater,
+  };
+
+  /// \brief The size of a memory operand.
+  enum class Width : uint8_t {
+    byte,
+    word,
+    dword,
+    qword,
+  };
+
+  /// \brief The integer operations sharing the classic ALU encodings, by
+  /// their \c /digit.
+  enum class AluOp : uint8_t {
+    add = 0,
+    or_ = 1,
+    and_ = 4,
+    sub = 5,
+    xor_ = 6,
+    cmp = 7,
+  };
+
+  /// \brief Shifts, by their \c /digit.
+  enum class ShiftOp : uint8_t {
+    shl = 4,
+    shr = 5,
+    sar = 7,
+  };
+
+  /// \brief Scalar SSE arithmetic, by the last byte of its opcode.
+  enum class FloatOp : uint8_t {
+    add = 0x58,
+    mul = 0x59,
+    sub = 0x5c,
+    div = 0x5e,
+  };
+
+  /// \brief A memory operand: \c base plus \c displacement, plus \c index
+  /// shifted left by \c scale when \c indexed.
+  struct Address {
+    Register base;
+    int32_t displacement {0};
+    bool indexed {false};
+    Register index {Register::rax};
+    uint8_t scale {0};
+  };
+
+  /// \brief An x86-64 assembler for the \c Compiler: it encodes the
+  /// instructions the compiler uses into a growable buffer.
+  ///
+  /// \details Memory operands always take a 32-bit displacement, and jumps
+  /// a 32-bit offset, which keeps the encoding simple and the code size
+  /// predictable. Jumps to code not emitted yet return the position of
+  /// their offset, for \c bind once the target is known. The code refers to
+  /// nothing outside itself by relative addresses, so it can be copied
+  /// anywhere once complete.
+  class Assembler {
+    PodVector<uint8_t> bytes {};
+
+    auto emit(uint8_t byte) -> void {
+      bytes.push(byte);
+    }
+
+    auto emit_int32(uint32_t value) -> void;
+    auto emit_rex(bool wide, unsigned reg, unsigned index, unsigned base,
+                  bool force = false) -> void;
+    auto emit_memory(unsigned reg, Address const &address) -> void;
+    auto emit_memory_rex(bool wide, unsigned reg, Address const &address,
+                         bool force = false) -> void;
+    auto emit_sse(uint8_t prefix, uint8_t opcode, unsigned reg,
+                  Address const &address, bool wide = false) -> void;
+
+   public:
+    Assembler() noexcept = default;
+    Assembler(Assembler const&) = delete;
+    auto operator=(Assembler const&) -> Assembler & = delete;
+    ~Assembler() noexcept = default;
+
+    [[nodiscard]]
+    auto get_code() const -> uint8_t const * {
+      return bytes.get_data();
+    }
+
+    /// Size of the code so far, also the position of the next instruction.
+    [[nodiscard]]
+    auto get_size() const -> uint32_t {
+      return uint32_t(bytes.get_size());
+    }
+
+    // Moves. Loads of bytes and words zero-extend, or sign-extend with
+    // `load_signed`, to 32 bits; 32-bit results clear the upper half.
+
+    auto load(Register to, Address const &from, Width width) -> void;
+    auto load_signed(Register to, Address const &from, Width width) -> void;
+    auto store(Address const &to, Register from, Width width) -> void;
+    auto store_immediate(Address const &to, int32_t value, Width width)
+      -> void;
+    auto move(Register to, Register from) -> void;
+    auto move_immediate(Register to, uint64_t value) -> void;
+    auto lea(Register to, Address const &address) -> void;
+
+    /// \c lea of an address relative to the next instruction. Returns the
+    /// position of the displacement, for \c bind.
+    auto lea_relative(Register to) -> uint32_t;
+
+    // Integer arithmetic, on 64 bits when `wide`.
+
+    auto alu(AluOp op, Register to, Address const &from, bool wide) -> void;
+    auto alu(AluOp op, Register to, Register from, bool wide) -> void;
+    auto alu_immediate(AluOp op, Address const &to, int32_t value,
+                       Width width) -> void;
+    auto alu_immediate(AluOp op, Register to, int32_t value, bool wide)
+      -> void;
+    auto imul(Register to, Address const &from, bool wide) -> void;
+    auto imul(Register to, Register from, bool wide) -> void;
+    /// \p to = \p from times \p value.
+    auto imul_immediate(Register to, Register from, int32_t value, bool wide)
+      -> void;
+    auto negate(Register value, bool wide) -> void;
+    /// Shift \p value by \c cl.
+    auto shift(ShiftOp op, Register value, bool wide) -> void;
+    auto shift_immediate(ShiftOp op, Register value, uint8_t count, bool wide)
+      -> void;
+    auto test(Register a, Register b, bool wide) -> void;
+    auto increment(Address const &to, bool wide) -> void;
+    /// \c lock \c cmpxchg: store \p value at \p to if it holds \c rax,
+    /// setting the zero flag, or load it into \c rax otherwise.
+    auto compare_exchange(Address const &to, Register value, bool wide)
+      -> void;
+
+    /// \c cdq or \c cqo, before \c divide.
+    auto sign_extend_accumulator(bool wide) -> void;
+    auto divide(Register divisor, bool wide) -> void;
+
+    // Scalar SSE, on doubles when `is_double`.
+
+    auto load_float(Xmm to, Address const &from, bool is_double) -> void;
+    auto store_float(Address const &to, Xmm from, bool is_double) -> void;
+    auto float_op(FloatOp op, Xmm to, Address const &from, bool is_double)
+      -> void;
+    auto compare_float(Xmm a, Address const &b, bool is_double) -> void;
+
+    /// Convert the integer at \p from, a \c long when \p wide.
+    auto convert_integer(Xmm to, Address const &from, bool wide,
+                         bool is_double) -> void;
+
+    /// Convert the \c float at \p from to \c double, or back if
+    /// \p from_double.
+    auto convert_float(Xmm to, Address const &from, bool from_double)
+      -> void;
+
+    // Control flow. Jumps return the position of their offset.
+
+    auto jump(Condition condition) -> uint32_t;
+    auto jump() -> uint32_t;
+    auto jump(Register target) -> void;
+    auto call(Register target) -> void;
+    auto push(Register value) -> void;
+    auto pop(Register value) -> void;
+    auto ret() -> void;
+
+    /// Make the jump or \c lea_relative whose offset is at \p position go
+    /// to \p target.
+    auto bind(uint32_t position, uint32_t target) -> void;
+
+    /// Emit \p value as data, such as a jump table entry.
+    auto data(int32_t value) -> void {
+      emit_int32(uint32_t(value));
+    }
+
+    /// Overwrite the data at \p position.
+    auto patch(uint32_t position, int32_t value) -> void;
+  };
+} // namespace skjvm
+
+#endif /* skjvm_assembler_hpp */
@@ -0,0 +1,18 @@
+#ifndef skjvm_bootstrap_hpp
+#define skjvm_bootstrap_hpp
+
+#include <skjvm/class_file.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief The class file of a core class the VM can build itself, such as
+  /// \c java/lang/Object, so programs run without a class library on the
+  /// class path. Returns \c nullptr for other names, and otherwise a buffer
+  /// allocated with \c malloc and its size in \p size.
+  [[nodiscard]]
+  auto build_bootstrap_class(Utf8View name, size_t &size) -> uint8_t *;
+} // namespace skjvm
+
+#endif /* skjvm_bootstrap_hpp */
@@ -0,0 +1,38 @@
+#ifndef skjvm_bytes_hpp
+#define skjvm_bytes_hpp
+
+#include <stdint.h>
+#include <string.h>
+
+namespace skjvm {
+  // Class files are big-endian. These read unaligned values straight out of
+  // a mapping, `memcpy` compiles down to a plain load.
+
+  [[nodiscard]]
+  inline auto read_u1(uint8_t const *bytes) -> uint8_t {
+    return bytes[0];
+  }
+
+  [[nodiscard]]
+  inline auto read_u2(uint8_t const *bytes) -> uint16_t {
+    uint16_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return __builtin_bswap16(value);
+  }
+
+  [[nodiscard]]
+  inline auto read_u4(uint8_t const *bytes) -> uint32_t {
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return __builtin_bswap32(value);
+  }
+
+  [[nodiscard]]
+  inline auto read_u8(uint8_t const *bytes) -> uint64_t {
+    uint64_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return __builtin_bswap64(value);
+  }
+} // namespace skjvm
+
+#endif /* skjvm_bytes_hpp */
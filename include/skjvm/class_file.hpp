@@ -0,0 +1,484 @@
+#ifndef skjvm_class_file_hpp
+#define skjvm_class_file_hpp
+
+#include <skjvm/bytes.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief Tags of constant pool entries, see JVMS 4.4. Names that are C++
+  /// keywords carry a trailing underscore.
+  enum class ConstantTag : uint8_t {
+    none                 = 0,
+    utf8                 = 1,
+    integer              = 3,
+    float_               = 4,
+    long_                = 5,
+    double_              = 6,
+    class_               = 7,
+    string               = 8,
+    fieldref             = 9,
+    methodref            = 10,
+    interface_methodref  = 11,
+    name_and_type        = 12,
+    method_handle        = 15,
+    method_type          = 16,
+    dynamic              = 17,
+    invoke_dynamic       = 18,
+    module               = 19,
+    package              = 20,
+  };
+
+  /// \brief Access and property flags of classes, fields and methods.
+  namespace access {
+    constexpr uint16_t public_       = 0x0001;
+    constexpr uint16_t private_      = 0x0002;
+    constexpr uint16_t protected_    = 0x0004;
+    constexpr uint16_t static_       = 0x0008;
+    constexpr uint16_t final         = 0x0010;
+    constexpr uint16_t synchronized  = 0x0020;
+    constexpr uint16_t super         = 0x0020;
+    constexpr uint16_t volatile_     = 0x0040;
+    constexpr uint16_t bridge        = 0x0040;
+    constexpr uint16_t transient     = 0x0080;
+    constexpr uint16_t varargs       = 0x0080;
+    constexpr uint16_t native        = 0x0100;
+    constexpr uint16_t interface     = 0x0200;
+    constexpr uint16_t abstract      = 0x0400;
+    constexpr uint16_t strict        = 0x0800;
+    constexpr uint16_t synthetic     = 0x1000;
+    constexpr uint16_t annotation    = 0x2000;
+    constexpr uint16_t enum_         = 0x4000;
+  } // namespace access
+
+  /// \brief Why a class file was rejected by \c ClassFile::parse.
+  enum class ClassFileError : uint8_t {
+    none,
+    truncated,
+    bad_magic,
+    unsupported_version,
+    bad_constant_tag,
+    bad_constant_index,
+    bad_member,
+    trailing_bytes,
+    out_of_memory,
+  };
+
+  [[nodiscard]]
+  auto describe(ClassFileError error) -> char const *;
+
+  /// \brief Undecoded modified UTF-8 bytes of a \c CONSTANT_Utf8 entry,
+  /// pointing into the class file.
+  struct Utf8View {
+    uint8_t const *bytes {nullptr};
+    uint16_t length {0};
+
+    [[nodiscard]]
+    auto is_empty() const -> bool {
+      return length == 0;
+    }
+
+    /// Compare with a NUL-terminated string byte by byte.
+    [[nodiscard]]
+    auto equals(char const *string) const -> bool;
+
+    [[nodiscard]]
+    auto equals(Utf8View other) const -> bool;
+
+    /// FNV-1a over the raw bytes, stable across runs.
+    [[nodiscard]]
+    auto hash() const -> uint32_t;
+  };
+
+  /// \brief UTF-16 code units of a decoded \c CONSTANT_Utf8 entry.
+  struct Utf16View {
+    uint16_t const *chars {nullptr};
+    uint32_t length {0};
+  };
+
+  struct NameAndType {
+    Utf8View name {};
+    Utf8View descriptor {};
+  };
+
+  /// \brief A resolved \c CONSTANT_Fieldref, \c CONSTANT_Methodref or
+  /// \c CONSTANT_InterfaceMethodref, all names still symbolic.
+  struct MemberRef {
+    Utf8View class_name {};
+    Utf8View name {};
+    Utf8View descriptor {};
+
+    /// The \c CONSTANT_Class naming the class.
+    uint16_t class_index {0};
+  };
+
+  /// \brief One attribute, its payload still undecoded.
+  struct AttributeView {
+    uint16_t name_index {0};
+    uint8_t const *data {nullptr};
+    uint32_t length {0};
+
+    [[nodiscard]]
+    auto is_present() const -> bool {
+      return data != nullptr;
+    }
+  };
+
+  /// \brief The attributes of a class, field, method or \c Code attribute,
+  /// iterated in place. Bounds were checked when the class file was parsed.
+  class AttributeList {
+    uint8_t const *first {nullptr};
+    uint16_t count {0};
+
+   public:
+    class Iterator {
+      uint8_t const *position;
+      uint16_t remaining;
+
+     public:
+      Iterator(uint8_t const *position, uint16_t remaining) noexcept
+        : position(position), remaining(remaining) {}
+
+      auto operator*() const -> AttributeView {
+        return {read_u2(position), position + 6, read_u4(position + 2)};
+      }
+
+      auto operator++() -> Iterator & {
+        position += 6 + read_u4(position + 2);
+        --remaining;
+        return *this;
+      }
+
+      auto operator!=(Iterator const &other) const -> bool {
+        return remaining != other.remaining;
+      }
+    };
+
+    AttributeList() noexcept = default;
+    AttributeList(uint8_t const *first, uint16_t count) noexcept
+      : first(first), count(count) {}
+
+    [[nodiscard]]
+    auto size() const -> uint16_t {
+      return count;
+    }
+
+    auto begin() const -> Iterator {
+      return {first, count};
+    }
+
+    auto end() const -> Iterator {
+      return {nullptr, 0};
+    }
+  };
+
+  /// \brief One entry of the exception table of a \c Code attribute.
+  struct ExceptionHandler {
+    uint16_t start_pc;
+    uint16_t end_pc;
+    uint16_t handler_pc;
+    uint16_t catch_type;
+  };
+
+  /// \brief A decoded \c Code attribute. Absent for abstract and native
+  /// methods, see \c is_present.
+  struct CodeView {
+    uint16_t max_stack {0};
+    uint16_t max_locals {0};
+    uint8_t const *code {nullptr};
+    uint32_t code_length {0};
+    uint16_t exception_table_length {0};
+    uint8_t const *exception_table {nullptr};
+    AttributeList attributes {};
+
+    [[nodiscard]]
+    auto is_present() const -> bool {
+      return code != nullptr;
+    }
+
+    [[nodiscard]]
+    auto exception_handler(uint16_t index) const -> ExceptionHandler {
+      uint8_t const *entry = exception_table + size_t(index) * 8;
+      return {read_u2(entry), read_u2(entry + 2), read_u2(entry + 4),
+              read_u2(entry + 6)};
+    }
+  };
+
+  /// \brief A field or method. Names and attributes stay in the class file
+  /// until asked for.
+  struct MemberInfo {
+    uint16_t access_flags;
+    uint16_t name_index;
+    uint16_t descriptor_index;
+    uint16_t attribute_count;
+
+    /// Offset of the first attribute in the class file.
+    uint32_t attributes_offset;
+
+    /// Offset of the payload of the \c Code attribute, 0 if there is none,
+    /// or \c code_unknown until \c ClassFile::code looked for it.
+    mutable uint32_t code_offset;
+
+    static constexpr uint32_t code_unknown = UINT32_MAX;
+  };
+
+  /// \brief Fields or methods of a class, for range-based \c for.
+  struct MemberList {
+    MemberInfo const *first {nullptr};
+    uint16_t count {0};
+
+    [[nodiscard]]
+    auto size() const -> uint16_t {
+      return count;
+    }
+
+    auto operator[](uint16_t index) const -> MemberInfo const & {
+      return first[index];
+    }
+
+    auto begin() const -> MemberInfo const * {
+      return first;
+    }
+
+    auto end() const -> MemberInfo const * {
+      return first + count;
+    }
+  };
+
+  /// \brief What \c ClassFile::parse computes about a class file besides
+  /// the bytes themselves, so it can be saved and handed back to \c adopt.
+  /// Offsets are from the start of the class file.
+  struct ClassFileTables {
+    uint16_t minor_version;
+    uint16_t major_version;
+    uint16_t constant_count;
+    uint16_t access_flags;
+    uint16_t this_class;
+    uint16_t super_class;
+    uint16_t interface_count;
+    uint16_t field_count;
+    uint16_t method_count;
+    uint16_t attribute_count;
+    uint32_t interfaces_offset;
+    uint32_t attributes_offset;
+    uint32_t const *constant_offsets;
+    MemberInfo const *members;
+  };
+
+  /// \brief A class file parsed in place.
+  ///
+  /// \details \c parse walks the class file once, checks that every
+  /// structure fits in the buffer and that constant pool references point to
+  /// entries of the right kind, and records where each constant and member
+  /// starts. Nothing is copied: every accessor returns a view into the
+  /// buffer, which must outlive the \c ClassFile (usually a \c MappedFile).
+  ///
+  /// The contents of \c CONSTANT_Utf8 entries are neither validated nor
+  /// decoded until \c utf16 is called for them, and the \c Code attribute of
+  /// a method is looked up the first time \c code is called. Both results are
+  /// cached, with atomic stores, so a parsed class file may be read from
+  /// several threads.
+  class ClassFile {
+    uint8_t const *data {nullptr};
+    size_t size {0};
+
+    uint16_t minor_version {0};
+    uint16_t major_version {0};
+
+    uint16_t constant_count {0};
+
+    /// Offset of the tag of each constant, 0 for index 0 and for the unusable
+    /// slot after a \c long or \c double.
+    uint32_t *constant_offsets {nullptr};
+
+    uint16_t access_flags {0};
+    uint16_t this_class {0};
+    uint16_t super_class {0};
+
+    uint16_t interface_count {0};
+    uint32_t interfaces_offset {0};
+
+    /// Fields followed by methods, in one allocation.
+    MemberInfo *members {nullptr};
+    uint16_t field_count {0};
+    uint16_t method_count {0};
+
+    uint16_t attribute_count {0};
+    uint32_t attributes_offset {0};
+
+    /// Lazily allocated, one slot per constant: \c [length][chars...] blocks
+    /// decoded by \c utf16.
+    mutable uint16_t **decoded {nullptr};
+
+    /// Whether \c constant_offsets and \c members were allocated by
+    /// \c parse, rather than borrowed by \c adopt.
+    bool owns_tables {false};
+
+    auto release() -> void;
+
+   public:
+    /// Oldest and newest supported class file versions, Java 1.0.2 to 17.
+    static constexpr uint16_t min_major_version = 45;
+    static constexpr uint16_t max_major_version = 61;
+
+    ClassFile() noexcept = default;
+    ClassFile(ClassFile const&) = delete;
+    auto operator=(ClassFile const&) -> ClassFile & = delete;
+    ~ClassFile() noexcept;
+
+    /// Parse the \p size bytes at \p data, which must stay alive and
+    /// unchanged while this object is used. On error, the object is empty.
+    [[nodiscard]]
+    auto parse(uint8_t const *data, size_t size) -> ClassFileError;
+
+    /// Use \p data as a class file already parsed into \p tables, without
+    /// checking anything. The tables are borrowed and must outlive the
+    /// object. The code offsets of methods should be known, see \c tables.
+    auto adopt(uint8_t const *data, size_t size, ClassFileTables const &tables)
+      -> void;
+
+    /// The tables of a parsed class file, for \c adopt. Looks up the
+    /// \c Code attribute of every method first, so adopted tables never
+    /// need to be written to.
+    [[nodiscard]]
+    auto tables() const -> ClassFileTables;
+
+    [[nodiscard]]
+    auto get_data() const -> uint8_t const * {
+      return data;
+    }
+
+    [[nodiscard]]
+    auto get_size() const -> size_t {
+      return size;
+    }
+
+    [[nodiscard]]
+    auto get_major_version() const -> uint16_t {
+      return major_version;
+    }
+
+    [[nodiscard]]
+    auto get_minor_version() const -> uint16_t {
+      return minor_version;
+    }
+
+    [[nodiscard]]
+    auto get_access_flags() const -> uint16_t {
+      return access_flags;
+    }
+
+    // Constant pool. Indexes are 1-based like in the class file; a wrong
+    // index or tag yields an empty view or 0 rather than undefined behavior.
+
+    [[nodiscard]]
+    auto get_constant_count() const -> uint16_t {
+      return constant_count;
+    }
+
+    [[nodiscard]]
+    auto tag(uint16_t index) const -> ConstantTag;
+
+    [[nodiscard]]
+    auto utf8(uint16_t index) const -> Utf8View;
+
+    /// The decoded UTF-16 contents of the \c CONSTANT_Utf8 at \p index. The
+    /// view has no \c chars if it is not valid modified UTF-8.
+    [[nodiscard]]
+    auto utf16(uint16_t index) const -> Utf16View;
+
+    [[nodiscard]]
+    auto class_name(uint16_t index) const -> Utf8View;
+
+    [[nodiscard]]
+    auto string(uint16_t index) const -> Utf8View;
+
+    [[nodiscard]]
+    auto integer_value(uint16_t index) const -> int32_t;
+
+    [[nodiscard]]
+    auto float_value(uint16_t index) const -> float;
+
+    [[nodiscard]]
+    auto long_value(uint16_t index) const -> int64_t;
+
+    [[nodiscard]]
+    auto double_value(uint16_t index) const -> double;
+
+    [[nodiscard]]
+    auto name_and_type(uint16_t index) const -> NameAndType;
+
+    [[nodiscard]]
+    auto member_ref(uint16_t index) const -> MemberRef;
+
+    // Class, fields, methods and attributes.
+
+    [[nodiscard]]
+    auto this_class_name() const -> Utf8View {
+      return class_name(this_class);
+    }
+
+    /// Empty for \c java/lang/Object.
+    [[nodiscard]]
+    auto super_class_name() const -> Utf8View {
+      return class_name(super_class);
+    }
+
+    [[nodiscard]]
+    auto get_interface_count() const -> uint16_t {
+      return interface_count;
+    }
+
+    [[nodiscard]]
+    auto interface_name(uint16_t index) const -> Utf8View;
+
+    [[nodiscard]]
+    auto fields() const -> MemberList {
+      return {members, field_count};
+    }
+
+    [[nodiscard]]
+    auto methods() const -> MemberList {
+      return {members + field_count, method_count};
+    }
+
+    [[nodiscard]]
+    auto name(MemberInfo const &member) const -> Utf8View {
+      return utf8(member.name_index);
+    }
+
+    [[nodiscard]]
+    auto descriptor(MemberInfo const &member) const -> Utf8View {
+      return utf8(member.descriptor_index);
+    }
+
+    [[nodiscard]]
+    auto attributes(MemberInfo const &member) const -> AttributeList {
+      return {data + member.attributes_offset, member.attribute_count};
+    }
+
+    /// Attributes of the class itself.
+    [[nodiscard]]
+    auto attributes() const -> AttributeList {
+      return {data + attributes_offset, attribute_count};
+    }
+
+    /// The first attribute of \p list named \p name, or an absent view.
+    [[nodiscard]]
+    auto find_attribute(AttributeList list, char const *name) const
+      -> AttributeView;
+
+    /// The \c Code attribute of \p method, absent if it has none or it is
+    /// malformed.
+    [[nodiscard]]
+    auto code(MemberInfo const &method) const -> CodeView;
+
+    /// The method named \p name with \p descriptor, or \c nullptr.
+    [[nodiscard]]
+    auto find_method(char const *name, char const *descriptor) const
+      -> MemberInfo const *;
+  };
+} // namespace skjvm
+
+#endif /* skjvm_class_file_hpp */
@@ -0,0 +1,123 @@
+#ifndef skjvm_class_loader_hpp
+#define skjvm_class_loader_hpp
+
+#include <skjvm/class_file.hpp>
+#include <skjvm/class_path.hpp>
+#include <skjvm/mapped_file.hpp>
+#include <skjvm/memory.hpp>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  enum class LoadState : uint8_t {
+    queued,   ///< Waiting for a preload worker.
+    loading,  ///< Being mapped and parsed by some thread.
+    loaded,
+    failed,   ///< See \c LoadedClass::not_found and \c LoadedClass::error.
+  };
+
+  /// \brief A class known to the loader, loaded or not.
+  ///
+  /// \details The class file stays mapped for the lifetime of the loader, so
+  /// views into it may be kept anywhere in the VM. The name is stored right
+  /// after the object.
+  struct LoadedClass {
+    Utf8View name;
+    uint32_t hash;
+    LoadState state;
+    bool not_found;
+    ClassFileError error;
+    MappedFile file;
+
+    /// The bytes of a class given to \c ClassLoader::define instead of
+    /// \c file, owned by the class.
+    uint8_t *defined_data;
+    ClassFile class_file;
+  };
+
+  /// \brief Maps class files from a \c ClassPath on demand, optionally
+  /// helped by a pool of threads that load ahead.
+  ///
+  /// \details \c load maps and parses a class on the calling thread, unless
+  /// another thread is already loading it, in which case it waits. With
+  /// \c start_workers, every loaded class also queues the classes its
+  /// constant pool refers to, so \c preload of the main class makes the
+  /// workers parse its whole transitive closure in parallel, while the main
+  /// thread keeps loading what it needs first. A class queued but not yet
+  /// picked up by a worker is loaded by whoever needs it first.
+  ///
+  /// Classes are never unloaded.
+  class ClassLoader {
+    ClassPath const &class_path;
+
+    mutable pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t state_changed = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t work_available = PTHREAD_COND_INITIALIZER;
+
+    /// Open addressing table of every class ever requested.
+    LoadedClass **table {nullptr};
+    uint32_t capacity {0};
+    uint32_t count {0};
+    uint32_t loaded_count {0};
+
+    PodVector<LoadedClass *> queue {};
+    size_t queue_head {0};
+    PodVector<pthread_t> workers {};
+    uint32_t busy_workers {0};
+    bool stopping {false};
+    bool verbose {false};
+
+    auto find_locked(Utf8View name, uint32_t hash) const -> LoadedClass *;
+    auto insert_locked(Utf8View name, uint32_t hash, LoadState state)
+      -> LoadedClass *;
+    auto enqueue_locked(Utf8View name) -> void;
+    auto enqueue_references_locked(LoadedClass const &loaded) -> void;
+    auto load_now(LoadedClass &loaded) -> void;
+    auto work() -> void;
+
+    static auto worker_main(void *loader) -> void *;
+
+   public:
+    explicit ClassLoader(ClassPath const &class_path) noexcept;
+    ClassLoader(ClassLoader const&) = delete;
+    auto operator=(ClassLoader const&) -> ClassLoader & = delete;
+    ~ClassLoader() noexcept;
+
+    /// Print each class as it is loaded, like \c -verbose:class.
+    auto set_verbose(bool enabled) -> void {
+      verbose = enabled;
+    }
+
+    /// Start \p count preload workers. Has no effect once started.
+    auto start_workers(uint32_t count) -> void;
+
+    /// Load the class named \p name (like \c java/lang/Object) and return it,
+    /// loaded or failed. Never returns \c nullptr.
+    auto load(Utf8View name) -> LoadedClass &;
+
+    /// Define the class \p name from \p data, a class file allocated with
+    /// \c malloc of which the loader takes ownership, unless the class is
+    /// already loaded. Used for the classes the VM builds itself when the
+    /// class path has none.
+    auto define(Utf8View name, uint8_t *data, size_t size) -> LoadedClass &;
+
+    /// Queue \p name for the preload workers, which also load everything it
+    /// refers to. Does nothing without workers.
+    auto preload(Utf8View name) -> void;
+
+    /// Wait until the preload workers have nothing left to do.
+    auto wait_idle() -> void;
+
+    /// The class named \p name if it was loaded successfully, without loading
+    /// it.
+    [[nodiscard]]
+    auto find_loaded(Utf8View name) const -> LoadedClass const *;
+
+    [[nodiscard]]
+    auto get_loaded_count() const -> uint32_t;
+  };
+} // namespace skjvm
+
+#endif /* skjvm_class_loader_hpp */
@@ -0,0 +1,147 @@
+#ifndef skjvm_class_path_hpp
+#define skjvm_class_path_hpp
+
+#include <skjvm/class_file.hpp>
+#include <skjvm/mapped_file.hpp>
+#include <skjvm/memory.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief An index from binary class name to class path root, built by
+  /// scanning the directories of a class path once.
+  ///
+  /// \details The roots of the class path are walked recursively, and every
+  /// \c .class file becomes an entry named by its path relative to the root,
+  /// without the extension (\c java/lang/Object). Like the JDK, the first
+  /// root that has a class wins. Lookups are hashed, so finding a class never
+  /// touches the file system, and missing classes are known to be missing
+  /// without probing each root.
+  ///
+  /// The index is persisted in a cache file, laid out so it can be mapped and
+  /// used in place. The cache records the modification time of every
+  /// directory it saw. Adding, removing or renaming a file changes the
+  /// modification time of its directory, so a cache is valid when all of
+  /// them are unchanged, which costs one \c stat per directory instead of
+  /// reading them all. A stale or unreadable cache is silently rebuilt.
+  class ClassPath {
+   public:
+    struct Entry {
+      uint32_t hash;
+      uint32_t name_offset;
+      uint16_t name_length;
+      uint16_t root;
+    };
+
+    struct Directory {
+      uint32_t path_offset;
+      uint32_t reserved;
+      int64_t mtime_sec;
+      int64_t mtime_nsec;
+    };
+
+   private:
+    // Built by a scan, or empty when the index lives in `cache`.
+    PodVector<char> owned_strings {};
+    PodVector<Entry> owned_entries {};
+    PodVector<Directory> owned_directories {};
+    PodVector<uint32_t> owned_slots {};
+    PodVector<uint32_t> owned_roots {};
+
+    MappedFile cache {};
+
+    // Views of the index, into the vectors above or into `cache`.
+    char const *strings {nullptr};
+    Entry const *entries {nullptr};
+    uint32_t entry_count {0};
+    Directory const *directories {nullptr};
+    uint32_t directory_count {0};
+    uint32_t const *slots {nullptr};
+    uint32_t slot_count {0};
+    uint32_t const *roots {nullptr};
+    uint32_t root_count {0};
+
+    bool from_cache {false};
+
+    auto scan(char const *class_path) -> void;
+    auto scan_directory(char *path, size_t length, size_t root_length,
+                        uint16_t root) -> void;
+    auto add_string(char const *string, size_t length) -> uint32_t;
+    auto build_slots() -> void;
+    auto use_owned() -> void;
+
+    auto load_cache(char const *class_path, char const *cache_path) -> bool;
+    auto save_cache(char const *class_path, char const *cache_path) const
+      -> bool;
+
+   public:
+    ClassPath() noexcept = default;
+    ClassPath(ClassPath const&) = delete;
+    auto operator=(ClassPath const&) -> ClassPath & = delete;
+    ~ClassPath() noexcept = default;
+
+    /// Index \p class_path, a list of directories separated by \c ':'. If
+    /// \p cache_path is not \c nullptr, reuse the index saved there when it
+    /// is still valid, and save a fresh one otherwise.
+    auto open(char const *class_path, char const *cache_path) -> void;
+
+    /// The entry of the class named \p name, or \c nullptr.
+    [[nodiscard]]
+    auto find(Utf8View name) const -> Entry const *;
+
+    /// Write the path of the class file of \p entry into \p buffer. Returns
+    /// \c false if it does not fit.
+    [[nodiscard]]
+    auto path_of(Entry const &entry, char *buffer, size_t capacity) const
+      -> bool;
+
+    [[nodiscard]]
+    auto name_of(Entry const &entry) const -> Utf8View {
+      return {reinterpret_cast<uint8_t const *>(strings + entry.name_offset),
+              entry.name_length};
+    }
+
+    [[nodiscard]]
+    auto root_path(uint16_t root) const -> char const * {
+      return strings + roots[root];
+    }
+
+    [[nodiscard]]
+    auto get_root_count() const -> uint32_t {
+      return root_count;
+    }
+
+    [[nodiscard]]
+    auto get_class_count() const -> uint32_t {
+      return entry_count;
+    }
+
+    [[nodiscard]]
+    auto get_directory_count() const -> uint32_t {
+      return directory_count;
+    }
+
+    /// Whether the index was loaded from the cache file by \c open.
+    [[nodiscard]]
+    auto is_from_cache() const -> bool {
+      return from_cache;
+    }
+
+    /// The default path of a cache file about \p class_path, under
+    /// \c $XDG_CACHE_HOME or \c ~/.cache, named \p kind followed by a hash
+    /// of the absolute class path: \c classpath for the index, \c shared
+    /// for the \c SharedArchive. Returns \c false if there is no cache
+    /// directory.
+    [[nodiscard]]
+    static auto default_cache_path(char const *class_path, char const *kind,
+                                   char *buffer, size_t capacity) -> bool;
+
+    /// The roots of \p class_path made absolute and joined with \c ':',
+    /// which caches are keyed and validated by.
+    static auto normalize(char const *class_path, PodVector<char> &out)
+      -> void;
+  };
+} // namespace skjvm
+
+#endif /* skjvm_class_path_hpp */
@@ -0,0 +1,148 @@
+#ifndef skjvm_class_registry_hpp
+#define skjvm_class_registry_hpp
+
+#include <skjvm/class_loader.hpp>
+#include <skjvm/klass.hpp>
+#include <skjvm/memory.hpp>
+#include <skjvm/symbol_table.hpp>
+
+#include <pthread.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief Why a class could not be linked or a reference resolved, named
+  /// after the Java error that reports it.
+  enum class LinkError : uint8_t {
+    none,
+    no_class_def_found,
+    class_format,
+    class_circularity,
+    incompatible_class_change,
+    no_such_field,
+    no_such_method,
+  };
+
+  [[nodiscard]]
+  auto describe(LinkError error) -> char const *;
+
+  /// \brief The linked classes of the VM, by name.
+  ///
+  /// \details \c link loads a class through the \c ClassLoader, links its
+  /// super class and interfaces first, then lays out its fields and builds
+  /// its vtable. Symbolic references of the constant pool are resolved
+  /// lazily with the \c resolve_ functions and cached in \c Klass::resolved.
+  ///
+  /// Classes the VM needs but the class path lacks, like
+  /// \c java/lang/Object, are built in memory, see \c bootstrap.hpp.
+  /// Classes can also be restored from a \c SharedArchive with \c add.
+  ///
+  /// Every \c Klass lives in the class space, see \c allocate_klass, and
+  /// its tables in an arena, as long as the registry.
+  class ClassRegistry {
+    ClassLoader &loader;
+    SymbolTable &symbols;
+
+    mutable pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    Klass **table {nullptr};
+    uint32_t capacity {0};
+    PodVector<Klass *> classes {};
+
+    /// Classes whose supers are being linked, to detect circularity.
+    PodVector<Utf8View> linking {};
+
+    /// Class files of restored classes, owned by the registry.
+    PodVector<ClassFile *> adopted {};
+    uint32_t shared_count {0};
+    Arena arena {};
+    bool print_field_layout {false};
+
+    auto find_locked(Utf8View name, uint32_t hash) const -> Klass *;
+    auto insert_locked(Klass *klass, uint32_t hash) -> void;
+    auto link_locked(Utf8View name, LinkError &error) -> Klass *;
+    auto link_array_locked(Utf8View name, LinkError &error) -> Klass *;
+    auto build_locked(ClassFile const &class_file, Klass *super,
+                      Klass **interfaces) -> Klass *;
+    auto build_vtable(Klass &klass) -> void;
+    auto resolve_class_locked(Klass &from, uint16_t index, LinkError &error)
+      -> Klass *;
+
+   public:
+    ClassRegistry(ClassLoader &loader, SymbolTable &symbols) noexcept;
+    ClassRegistry(ClassRegistry const&) = delete;
+    auto operator=(ClassRegistry const&) -> ClassRegistry & = delete;
+    ~ClassRegistry() noexcept;
+
+    /// Load and link the class or array class named \p name, as written in
+    /// a \c CONSTANT_Class. Returns \c nullptr and sets \p error on failure.
+    [[nodiscard]]
+    auto link(Utf8View name, LinkError &error) -> Klass *;
+
+    /// The class named \p name if it is linked, without linking it.
+    [[nodiscard]]
+    auto find(Utf8View name) const -> Klass *;
+
+    // Resolution of the constant pool entry at `index` of `from`, which must
+    // have the right tag. The result is cached in `from.resolved`.
+
+    [[nodiscard]]
+    auto resolve_class(Klass &from, uint16_t index, LinkError &error)
+      -> Klass *;
+
+    /// A \c CONSTANT_Fieldref, searched in the class, its interfaces and
+    /// then its super classes.
+    [[nodiscard]]
+    auto resolve_field(Klass &from, uint16_t index, LinkError &error)
+      -> Field *;
+
+    /// A \c CONSTANT_Methodref or \c CONSTANT_InterfaceMethodref, searched
+    /// in the class and its super classes, then its interfaces.
+    [[nodiscard]]
+    auto resolve_method(Klass &from, uint16_t index, LinkError &error)
+      -> Method *;
+
+    /// A \c CONSTANT_String, interned.
+    [[nodiscard]]
+    auto resolve_string(Klass &from, uint16_t index) -> Symbol const *;
+
+    /// Resolve every class, member and string reference of \p klass that
+    /// can be, linking the classes they name. Failures are left unresolved.
+    auto resolve_all(Klass &klass) -> void;
+
+    /// Storage for the metadata of restored classes.
+    [[nodiscard]]
+    auto get_arena() -> Arena & {
+      return arena;
+    }
+
+    /// Register \p klass, restored from an archive and allocated with
+    /// \c allocate_klass, whose class file \p adopted (allocated in the
+    /// arena) the registry destroys.
+    auto add(Klass *klass, ClassFile *adopted_file) -> void;
+
+    [[nodiscard]]
+    auto get_symbols() -> SymbolTable & {
+      return symbols;
+    }
+
+    /// Every linked class, each after its super class and interfaces.
+    /// Only stable while no other thread links classes.
+    [[nodiscard]]
+    auto get_classes() const -> PodVector<Klass *> const & {
+      return classes;
+    }
+
+    [[nodiscard]]
+    auto get_shared_count() const -> uint32_t {
+      return shared_count;
+    }
+
+    /// Print the instance layout of each class as it is linked or added,
+    /// on \c stdout, see \c print_layout.
+    auto set_print_field_layout(bool enable) -> void {
+      print_field_layout = enable;
+    }
+  };
+} // namespace skjvm
+
+#endif /* skjvm_class_registry_hpp */
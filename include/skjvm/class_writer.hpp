@@ -0,0 +1,251 @@
+#ifndef skjvm_class_writer_hpp
+#define skjvm_class_writer_hpp
+
+#include <skjvm/class_file.hpp>
+#include <skjvm/memory.hpp>
+#include <skjvm/opcodes.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief A growable big-endian byte buffer. Running out of memory aborts,
+  /// it is only used to assemble class files.
+  class ByteBuffer {
+    uint8_t *bytes {nullptr};
+    size_t size {0};
+    size_t capacity {0};
+
+    auto grow(size_t extra) -> uint8_t *;
+
+   public:
+    ByteBuffer() noexcept = default;
+    ByteBuffer(ByteBuffer const&) = delete;
+    auto operator=(ByteBuffer const&) -> ByteBuffer & = delete;
+    ~ByteBuffer() noexcept;
+
+    auto put_u1(uint8_t value) -> void;
+    auto put_u2(uint16_t value) -> void;
+    auto put_u4(uint32_t value) -> void;
+    auto put_u8(uint64_t value) -> void;
+    auto put(void const *data, size_t count) -> void;
+
+    auto patch_u2(size_t at, uint16_t value) -> void;
+    auto patch_u4(size_t at, uint32_t value) -> void;
+
+    auto clear() -> void {
+      size = 0;
+    }
+
+    /// Hand the contents over to the caller, who must \c free them.
+    [[nodiscard]]
+    auto release() -> uint8_t *;
+
+    [[nodiscard]]
+    auto get_data() const -> uint8_t const * {
+      return bytes;
+    }
+
+    [[nodiscard]]
+    auto get_size() const -> size_t {
+      return size;
+    }
+  };
+
+  class ClassWriter;
+
+  /// \brief A branch target in a \c CodeWriter, bound to a position later.
+  struct Label {
+    uint16_t id;
+  };
+
+  /// \brief Assembles the \c Code attribute of one method.
+  ///
+  /// \details Instructions are appended one by one; branches to labels that
+  /// are not bound yet are patched by \c ClassWriter::add_method. Helpers pick
+  /// the shortest encoding, e.g. \c iconst emits \c iconst_<n>, \c bipush,
+  /// \c sipush or \c ldc.
+  class CodeWriter {
+    ClassWriter &owner;
+    ByteBuffer code {};
+
+    /// Bound position of each label as an \c int32_t, -1 while unbound.
+    ByteBuffer labels {};
+    uint16_t label_count {0};
+
+    /// Branch offsets to patch: \c [at][base][label][width] records.
+    ByteBuffer fixups {};
+    size_t fixup_count {0};
+
+    ByteBuffer handlers {};
+    uint16_t handler_count {0};
+
+    uint16_t max_stack {0};
+    uint16_t max_locals {0};
+
+    auto branch_offset(Label label, size_t base, uint8_t width) -> void;
+    auto label_position(uint16_t id) const -> int32_t;
+
+    friend class ClassWriter;
+
+   public:
+    explicit CodeWriter(ClassWriter &owner) noexcept : owner(owner) {}
+    CodeWriter(CodeWriter const&) = delete;
+    auto operator=(CodeWriter const&) -> CodeWriter & = delete;
+    ~CodeWriter() noexcept = default;
+
+    auto set_max(uint16_t stack, uint16_t locals) -> CodeWriter &;
+
+    [[nodiscard]]
+    auto get_position() const -> uint32_t {
+      return uint32_t(code.get_size());
+    }
+
+    auto op(Opcode opcode) -> CodeWriter &;
+    auto u1(uint8_t value) -> CodeWriter &;
+    auto u2(uint16_t value) -> CodeWriter &;
+
+    auto iconst(int32_t value) -> CodeWriter &;
+    auto lconst(int64_t value) -> CodeWriter &;
+    auto fconst(float value) -> CodeWriter &;
+    auto dconst(double value) -> CodeWriter &;
+    auto ldc_string(char const *value) -> CodeWriter &;
+
+    /// A local variable instruction with an index operand, such as \c iload
+    /// or \c astore, using \c wide when needed.
+    auto local(Opcode opcode, uint16_t index) -> CodeWriter &;
+    auto iinc(uint16_t index, int16_t delta) -> CodeWriter &;
+
+    auto field(Opcode opcode, char const *class_name, char const *name,
+               char const *descriptor) -> CodeWriter &;
+
+    /// \c invokevirtual, \c invokespecial, \c invokestatic or
+    /// \c invokeinterface, the latter referring to an interface method.
+    auto invoke(Opcode opcode, char const *class_name, char const *name,
+                char const *descriptor) -> CodeWriter &;
+
+    /// \c new, \c anewarray, \c checkcast or \c instanceof.
+    auto type(Opcode opcode, char const *class_name) -> CodeWriter &;
+    auto newarray(uint8_t element_type) -> CodeWriter &;
+
+    [[nodiscard]]
+    auto new_label() -> Label;
+    auto bind(Label label) -> CodeWriter &;
+
+    /// A conditional or unconditional branch to \p label.
+    auto jump(Opcode opcode, Label label) -> CodeWriter &;
+
+    /// \c tableswitch over \c [low, high], with \c high - \c low + 1
+    /// \p targets.
+    auto tableswitch(int32_t low, int32_t high, Label default_target,
+                     Label const *targets) -> CodeWriter &;
+
+    auto lookupswitch(Label default_target, int32_t const *keys,
+                      Label const *targets, uint32_t count) -> CodeWriter &;
+
+    /// Add an exception handler; \p catch_type is \c nullptr for \c finally.
+    auto handler(Label start, Label end, Label target, char const *catch_type)
+      -> CodeWriter &;
+  };
+
+  /// \brief Assembles a class file in memory.
+  ///
+  /// \details Constants are deduplicated, so calling \c utf8 or
+  /// \c method_ref twice with the same arguments returns the same index.
+  /// Since there is no Java compiler in the tree, this is how tests and
+  /// benchmarks produce class files.
+  ///
+  /// \code
+  /// ClassWriter writer("demo/Answer");
+  /// CodeWriter code(writer);
+  /// code.set_max(1, 0).iconst(42).op(Opcode::ireturn);
+  /// writer.add_method(access::public_ | access::static_, "answer", "()I",
+  ///                   &code);
+  /// size_t size = 0;
+  /// uint8_t *bytes = writer.finish(size);
+  /// \endcode
+  class ClassWriter {
+    ByteBuffer pool {};
+    uint16_t constant_count {1};
+
+    /// Offset in \c pool of each constant, as \c uint32_t, for deduplication.
+    ByteBuffer pool_offsets {};
+
+    ByteBuffer interfaces {};
+    uint16_t interface_count {0};
+    ByteBuffer fields {};
+    uint16_t field_count {0};
+    ByteBuffer methods {};
+    uint16_t method_count {0};
+
+    uint16_t access_flags;
+    uint16_t this_class;
+    uint16_t super_class;
+    uint16_t major_version {52};
+
+    auto add_constant(uint8_t const *entry, size_t size, uint16_t slots)
+      -> uint16_t;
+    auto reference(ConstantTag tag, uint16_t first, uint16_t second)
+      -> uint16_t;
+
+    /// Infer the \c StackMapTable of \p code, see \c add_method.
+    auto stack_map_table(uint16_t flags, char const *name,
+                         char const *descriptor, CodeView const &code,
+                         PodVector<uint8_t> &table) -> int32_t;
+
+   public:
+    /// A class named \p name, extending \p super_name unless it is
+    /// \c nullptr.
+    explicit ClassWriter(char const *name,
+                         char const *super_name = "java/lang/Object",
+                         uint16_t access_flags = access::public_ |
+                                                 access::super) noexcept;
+    ClassWriter(ClassWriter const&) = delete;
+    auto operator=(ClassWriter const&) -> ClassWriter & = delete;
+    ~ClassWriter() noexcept = default;
+
+    auto set_major_version(uint16_t version) -> void {
+      major_version = version;
+    }
+
+    auto utf8(char const *string) -> uint16_t;
+    auto utf8(uint8_t const *bytes, uint16_t length) -> uint16_t;
+    auto class_constant(char const *name) -> uint16_t;
+    auto string_constant(char const *value) -> uint16_t;
+    auto integer_constant(int32_t value) -> uint16_t;
+    auto float_constant(float value) -> uint16_t;
+    auto long_constant(int64_t value) -> uint16_t;
+    auto double_constant(double value) -> uint16_t;
+    auto name_and_type(char const *name, char const *descriptor) -> uint16_t;
+    auto field_ref(char const *class_name, char const *name,
+                   char const *descriptor) -> uint16_t;
+    auto method_ref(char const *class_name, char const *name,
+                    char const *descriptor) -> uint16_t;
+    auto interface_method_ref(char const *class_name, char const *name,
+                              char const *descriptor) -> uint16_t;
+
+    auto add_interface(char const *name) -> void;
+    auto add_field(uint16_t access_flags, char const *name,
+                   char const *descriptor) -> void;
+
+    /// Add a method, with the code of \p code unless it is \c nullptr (for
+    /// abstract and native methods). Aborts if a label used by \p code was
+    /// never bound.
+    ///
+    /// From version 50 on, code with branches or handlers gets the
+    /// \c StackMapTable the verifier needs, inferred like a compiler does,
+    /// unless it does not type check, see \c infer_stack_map_table.
+    auto add_method(uint16_t access_flags, char const *name,
+                    char const *descriptor, CodeWriter const *code) -> void;
+
+    /// The class file, allocated with \c malloc, and its size in \p size.
+    [[nodiscard]]
+    auto finish(size_t &size) const -> uint8_t *;
+
+    /// Write the class file to \p path.
+    [[nodiscard]]
+    auto write_to(char const *path) const -> bool;
+  };
+} // namespace skjvm
+
+#endif /* skjvm_class_writer_hpp */
@@ -0,0 +1,56 @@
+#ifndef skjvm_code_cache_hpp
+#define skjvm_code_cache_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief The executable memory compiled methods live in: one shared
+  /// memory object, reserved on the first installation and bump allocated.
+  ///
+  /// \details The object is mapped twice, once readable and executable
+  /// where code runs, and once readable and writable where it is copied
+  /// in, so no page is ever writable and executable at once (W^X) and code
+  /// can be added while other threads run the code already there. Code is
+  /// never freed on its own, since a thread may still be running code its
+  /// method no longer uses; it all goes with the cache. When the cache is
+  /// full, or the system refuses executable memory, \c install returns
+  /// \c nullptr.
+  class CodeCache {
+    uint8_t *executable {nullptr};
+    uint8_t *writable {nullptr};
+    size_t capacity;
+    size_t used {0};
+    bool failed {false};
+
+    auto reserve() -> bool;
+
+   public:
+    static constexpr size_t default_capacity = size_t(32) << 20;
+
+    explicit CodeCache(size_t capacity = default_capacity) noexcept
+      : capacity(capacity) {}
+    CodeCache(CodeCache const&) = delete;
+    auto operator=(CodeCache const&) -> CodeCache & = delete;
+    ~CodeCache() noexcept;
+
+    /// Copy the \p size bytes of machine code at \p code into the cache,
+    /// aligned to 16 bytes, and return where it runs, or \c nullptr. Not
+    /// thread-safe; the \c Compiler serializes calls.
+    [[nodiscard]]
+    auto install(uint8_t const *code, size_t size) -> uint8_t *;
+
+    /// Bytes allocated so far.
+    [[nodiscard]]
+    auto get_used() const -> size_t {
+      return used;
+    }
+
+    [[nodiscard]]
+    auto get_capacity() const -> size_t {
+      return capacity;
+    }
+  };
+} // namespace skjvm
+
+#endif /* skjvm_code_cache_hpp */
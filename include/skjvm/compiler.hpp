@@ -0,0 +1,163 @@
+#ifndef skjvm_compiler_hpp
+#define skjvm_compiler_hpp
+
+#include <skjvm/code_cache.hpp>
+#include <skjvm/interpreter.hpp>
+#include <skjvm/klass.hpp>
+#include <skjvm/memory.hpp>
+#include <skjvm/object.hpp>
+
+#include <pthread.h>
+#include <stdint.h>
+
+namespace skjvm {
+  class Thread;
+
+  /// \brief How compiled code gave control back to the interpreter.
+  enum class CompiledExit : uint8_t {
+    /// The method returned, with its result.
+    returned,
+    /// An exception is pending at \c Frame::ip, for the interpreter to
+    /// unwind.
+    exception,
+    /// The code met what it was not compiled for; interpretation resumes
+    /// at \c Frame::ip with \c Frame::sp.
+    deoptimized,
+    /// There was no code to run: keep interpreting.
+    not_entered,
+    /// Compiled code can never be entered at \c Frame::ip, whose stack
+    /// depth is not the one the code has there: keep interpreting, and do
+    /// not ask again from the same branch.
+    no_entry,
+  };
+
+  /// \brief The machine code of a method, and where each of its decoded
+  /// instructions starts in it.
+  ///
+  /// \details Compiled code keeps locals and operands in the same \c Value
+  /// slots as the interpreter, so that either can continue what the other
+  /// started at any instruction whose stack depth is known, see
+  /// \c DecodedMethod::depths. Unreachable instructions have no code.
+  struct CompiledMethod {
+    Method *method;
+    uint8_t *code;
+    uint32_t size;
+    uint32_t *entries;
+  };
+
+  struct CompilerStats {
+    uint64_t compiled;
+    /// Methods the compiler gave up on, which stay interpreted.
+    uint64_t failed;
+    uint64_t osr_entries;
+    uint64_t deoptimizations;
+    uint64_t code_bytes;
+  };
+
+  /// \brief The baseline compiler: it translates hot methods to x86-64
+  /// machine code, one template per instruction, and runs them.
+  ///
+  /// \details The interpreter counts invocations and taken backward
+  /// branches in each \c Method. A method is compiled when its invocation
+  /// count crosses \c compile_threshold and entered from the start, or when
+  /// its backedge count crosses \c backedge_threshold and entered in the
+  /// middle of the loop, at the target of the branch (on-stack
+  /// replacement). Compilation is synchronous, on the thread that crossed
+  /// the threshold.
+  ///
+  /// The code speculates on what the interpreter saw: instructions not
+  /// quickened yet, and calls whose inline cache saw one receiver class
+  /// but meet another, leave it (deoptimization). The method goes back to
+  /// the interpreter and its counters restart, so it is compiled again
+  /// with what the interpreter learned, up to \c max_recompilations times.
+  ///
+  /// The compiler only exists on x86-64 Linux; elsewhere \c is_available
+  /// is \c false and methods stay interpreted.
+  class Compiler {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    CodeCache cache {};
+    PodVector<CompiledMethod *> methods {};
+    CompilerStats stats {};
+    bool enabled;
+    bool print_compilation {false};
+    /// Whether the code cache filled up, which is reported once.
+    bool cache_full {false};
+    uint32_t compile_threshold {default_compile_threshold};
+    uint32_t backedge_threshold {default_backedge_threshold};
+
+    auto compile(Thread &thread, Method &method, bool osr)
+      -> CompiledMethod *;
+    auto run(Thread &thread, Frame &frame, CompiledMethod &compiled,
+             uint32_t index, Value &result) -> CompiledExit;
+    auto deoptimize(Method &method, CompiledMethod &compiled) -> void;
+
+   public:
+    static constexpr uint32_t default_compile_threshold = 1000;
+    static constexpr uint32_t default_backedge_threshold = 10000;
+
+    /// Deoptimizations after which a method is left interpreted.
+    static constexpr uint8_t max_recompilations = 8;
+
+    Compiler() noexcept;
+    Compiler(Compiler const&) = delete;
+    auto operator=(Compiler const&) -> Compiler & = delete;
+    ~Compiler() noexcept;
+
+    /// Whether this build can compile methods.
+    [[nodiscard]]
+    static auto is_available() -> bool;
+
+    [[nodiscard]]
+    auto is_enabled() const -> bool {
+      return enabled;
+    }
+
+    /// Enable or disable compilation, not to be changed while Java code
+    /// runs. Enabling it has no effect if the compiler is not available.
+    auto set_enabled(bool enable) -> void {
+      enabled = enable and is_available();
+    }
+
+    auto set_compile_threshold(uint32_t threshold) -> void {
+      compile_threshold = threshold;
+    }
+
+    auto set_backedge_threshold(uint32_t threshold) -> void {
+      backedge_threshold = threshold;
+    }
+
+    /// Print each compilation and deoptimization on \c stdout.
+    auto set_print_compilation(bool print) -> void {
+      print_compilation = print;
+    }
+
+    [[nodiscard]]
+    auto get_stats() -> CompilerStats;
+
+    /// Interpret the rest of \p frame, whose \p compiled code a caller
+    /// in compiled code entered directly, and which threw an exception or,
+    /// when \p deoptimized, deoptimized. Returns the result of the method,
+    /// leaving the frame to the caller to pop.
+    auto finish(Thread &thread, Frame &frame, CompiledMethod &compiled,
+                bool deoptimized) -> Value;
+
+    /// The compiled code of \p method, compiling it now if needed, or
+    /// \c nullptr if it cannot be compiled.
+    [[nodiscard]]
+    auto compiled(Thread &thread, Method &method) -> CompiledMethod *;
+
+    /// Count a call of the method of \p frame, about to be interpreted, and
+    /// run its compiled code from the start if it has some. Returns
+    /// \c not_entered to interpret it.
+    auto on_invocation(Thread &thread, Frame &frame, Value &result)
+      -> CompiledExit;
+
+    /// Count a taken backward branch to \c Frame::ip, saved with
+    /// \c Frame::sp, and continue in compiled code from there if the method
+    /// has some. Returns \c not_entered to keep interpreting.
+    auto on_backedge(Thread &thread, Frame &frame, Value &result)
+      -> CompiledExit;
+  };
+} // namespace skjvm
+
+#endif /* skjvm_compiler_hpp */
@@ -0,0 +1,31 @@
+#ifndef skjvm_descriptor_hpp
+#define skjvm_descriptor_hpp
+
+#include <skjvm/class_file.hpp>
+
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief Length of the field type starting at \p position of
+  /// \p descriptor (e.g. 1 for \c I, 18 for \c Ljava/lang/String;), or 0 if
+  /// it is malformed.
+  [[nodiscard]]
+  auto field_type_length(Utf8View descriptor, uint16_t position) -> uint16_t;
+
+  /// \brief Number of local variable slots taken by the parameters of the
+  /// method \p descriptor, \c long and \c double counting twice, or -1 if it
+  /// is malformed. The receiver is not included.
+  [[nodiscard]]
+  auto parameter_slots(Utf8View descriptor) -> int;
+
+  /// \brief The first character of the return type of the method
+  /// \p descriptor (\c V for \c void), or 0 if it is malformed.
+  [[nodiscard]]
+  auto return_type(Utf8View descriptor) -> char;
+
+  /// \brief A view of the NUL-terminated \p string, for comparisons.
+  [[nodiscard]]
+  auto make_view(char const *string) -> Utf8View;
+} // namespace skjvm
+
+#endif /* skjvm_descriptor_hpp */
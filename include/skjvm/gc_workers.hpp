@@ -0,0 +1,115 @@
+#ifndef skjvm_gc_workers_hpp
+#define skjvm_gc_workers_hpp
+
+#include <skjvm/memory.hpp>
+#include <skjvm/object.hpp>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief The threads the collector runs its parallel phases on.
+  ///
+  /// \details \c run calls a task once per worker with the index of the
+  /// worker, the calling thread being worker 0, and returns once every
+  /// call returned. The other threads are started by the first \c run and
+  /// wait for the next one in between.
+  class GcWorkers {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t work_available = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+
+    PodVector<pthread_t> threads {};
+    uint32_t count {1};
+    uint32_t started {0};
+
+    /// The task of the current \c run, numbered by \c generation, and the
+    /// workers still running it.
+    void (*task)(void *, uint32_t) {nullptr};
+    void *context {nullptr};
+    uint64_t generation {0};
+    uint32_t pending {0};
+    bool stopping {false};
+
+    auto work() -> void;
+    auto run(void (*function)(void *, uint32_t), void *argument) -> void;
+
+    static auto worker_main(void *workers) -> void *;
+
+    template <typename Function>
+    static auto call(void *function, uint32_t index) -> void {
+      (*static_cast<Function *>(function))(index);
+    }
+
+   public:
+    GcWorkers() noexcept = default;
+    GcWorkers(GcWorkers const&) = delete;
+    auto operator=(GcWorkers const&) -> GcWorkers & = delete;
+    ~GcWorkers() noexcept;
+
+    /// Run parallel phases on \p workers threads, the caller included.
+    /// Has no effect once started.
+    auto set_count(uint32_t workers) -> void;
+
+    [[nodiscard]]
+    auto get_count() const -> uint32_t {
+      return count;
+    }
+
+    /// Call \p function with each worker index, in parallel.
+    template <typename Function>
+    auto run(Function &function) -> void {
+      run(&call<Function>, &function);
+    }
+  };
+
+  /// \brief A deque of objects to scan, owned by one collector worker and
+  /// stolen from by the others: Chase and Lev's.
+  ///
+  /// \details The owner pushes and pops at the bottom without atomic
+  /// read-modify-writes except for the last object, which it may race a
+  /// thief for. Thieves take the oldest object at the top. The capacity is
+  /// fixed: \c push returns \c false when the deque is full, and the owner
+  /// keeps the object elsewhere. The deque has no constructor, so that an
+  /// array of them can be allocated for as many workers as there are.
+  class WorkStealingDeque {
+    Object **buffer;
+    int64_t mask;
+    int64_t top;
+    int64_t bottom;
+
+   public:
+    /// Start empty, with \p storage for \p capacity objects, a power of
+    /// two, which the deque does not own.
+    auto init(Object **storage, uint32_t capacity) -> void {
+      buffer = storage;
+      mask = int64_t(capacity) - 1;
+      top = 0;
+      bottom = 0;
+    }
+
+    /// Push \p object at the bottom, by the owner.
+    [[nodiscard]]
+    auto push(Object *object) -> bool;
+
+    /// The object at the bottom, by the owner, or \c nullptr if empty.
+    [[nodiscard]]
+    auto pop() -> Object *;
+
+    /// The object at the top, by any thread, or \c nullptr if empty or
+    /// taken by another thread meanwhile.
+    [[nodiscard]]
+    auto steal() -> Object *;
+
+    /// Whether the deque looked empty. Exact only while nobody else uses
+    /// it.
+    [[nodiscard]]
+    auto is_empty() const -> bool {
+      return __atomic_load_n(&bottom, __ATOMIC_ACQUIRE) <=
+             __atomic_load_n(&top, __ATOMIC_ACQUIRE);
+    }
+  };
+} // namespace skjvm
+
+#endif /* skjvm_gc_workers_hpp */
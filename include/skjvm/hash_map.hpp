@@ -0,0 +1,350 @@
+#ifndef skjvm_hash_map_hpp
+#define skjvm_hash_map_hpp
+
+#include <skjvm/memory.hpp>
+#include <skjvm/utility.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace skjvm {
+  /// \brief An open-addressing hash table from keys of type \p K to values
+  /// of type \p V, with keys hashed by \p H and compared with \c ==.
+  ///
+  /// \details Collisions are resolved with Robin Hood hashing: an entry
+  /// that has probed further from its home slot than the one in its way
+  /// takes that slot, and the displaced entry probes on. Probe lengths
+  /// stay short and even, which lets a lookup stop as soon as it meets an
+  /// entry closer to home than the key would be, and lets erasing shift
+  /// the following entries back instead of leaving tombstones.
+  ///
+  /// Each slot has a 32-bit tag, zero when empty, that holds the probe
+  /// distance and 16 bits of the hash, so most mismatches are rejected
+  /// without reading the entry. Tags and entries share one allocation,
+  /// and the table doubles at 80% load.
+  template <typename K, typename V, typename H = Hash<K>>
+  class HashMap {
+   public:
+    struct Entry {
+      K key;
+      V value;
+    };
+
+    struct InsertResult {
+      V *value;
+      bool inserted;
+    };
+
+   private:
+    static constexpr size_t initial_capacity = 16;
+    static constexpr uint32_t distance_mask = 0xffff;
+
+    uint32_t *tags {nullptr};
+    Entry *entries {nullptr};
+    size_t capacity {0};
+    size_t count {0};
+    size_t allocations {0};
+    [[no_unique_address]] H hasher {};
+
+    /// The tag of an entry with \p hash at \p distance from its home slot.
+    [[nodiscard]]
+    static auto make_tag(uint64_t hash, uint32_t distance) -> uint32_t {
+      return uint32_t(hash >> 48) << 16 | (distance + 1);
+    }
+
+    [[nodiscard]]
+    static auto get_distance(uint32_t tag) -> uint32_t {
+      return (tag & distance_mask) - 1;
+    }
+
+    auto release() noexcept -> void {
+      for (size_t i = 0; i < capacity; ++i) {
+        if (tags[i] != 0) { entries[i].~Entry(); }
+      }
+      free(tags);
+    }
+
+    auto allocate(size_t new_capacity) -> void {
+      size_t tag_bytes = new_capacity * sizeof(uint32_t);
+      tag_bytes = (tag_bytes + alignof(Entry) - 1) & ~(alignof(Entry) - 1);
+      void *block = checked_malloc(tag_bytes + new_capacity * sizeof(Entry));
+      ++allocations;
+      tags = static_cast<uint32_t *>(block);
+      entries = reinterpret_cast<Entry *>(static_cast<uint8_t *>(block)
+                                          + tag_bytes);
+      capacity = new_capacity;
+      for (size_t i = 0; i < capacity; ++i) { tags[i] = 0; }
+    }
+
+    auto rehash(size_t new_capacity) -> void {
+      uint32_t *old_tags = tags;
+      Entry *old_entries = entries;
+      size_t old_capacity = capacity;
+      allocate(new_capacity);
+      count = 0;
+      for (size_t i = 0; i < old_capacity; ++i) {
+        if (old_tags[i] == 0) { continue; }
+        place(skjvm::move(old_entries[i]), hasher(old_entries[i].key));
+        old_entries[i].~Entry();
+      }
+      free(old_tags);
+    }
+
+    /// The slot of \p key, or \c capacity if it is absent.
+    template <typename Key>
+    [[nodiscard]]
+    auto search(Key const &key) const -> size_t {
+      if (count == 0) { return capacity; }
+      uint64_t hash = hasher(key);
+      size_t mask = capacity - 1;
+      size_t slot = size_t(hash) & mask;
+      for (uint32_t tag = make_tag(hash, 0);; ++tag, slot = (slot + 1) & mask) {
+        uint32_t found = tags[slot];
+        // An empty slot, or an entry closer to home than the key would be,
+        // ends the probe.
+        if (found == 0 or (found & distance_mask) < (tag & distance_mask)) {
+          return capacity;
+        }
+        if (found == tag and entries[slot].key == key) { return slot; }
+      }
+    }
+
+    /// Insert \p entry, known to be absent, returning where it went.
+    auto place(Entry &&entry, uint64_t hash) -> Entry * {
+      Entry *placed = nullptr;
+      size_t mask = capacity - 1;
+      size_t slot = size_t(hash) & mask;
+      uint32_t tag = make_tag(hash, 0);
+      alignas(Entry) unsigned char carried_storage[sizeof(Entry)];
+      Entry *carried = &entry;
+      for (;; slot = (slot + 1) & mask, ++tag) {
+        if (tags[slot] == 0) {
+          new (static_cast<void *>(&entries[slot]))
+            Entry(skjvm::move(*carried));
+          if (carried != &entry) { carried->~Entry(); }
+          tags[slot] = tag;
+          ++count;
+          return placed == nullptr ? &entries[slot] : placed;
+        }
+        if ((tags[slot] & distance_mask) < (tag & distance_mask)) {
+          // Robin Hood: the entry here is richer, so it moves on instead.
+          if (carried == &entry) {
+            carried = new (static_cast<void *>(carried_storage))
+              Entry(skjvm::move(entries[slot]));
+            entries[slot].~Entry();
+            new (static_cast<void *>(&entries[slot])) Entry(skjvm::move(entry));
+          } else {
+            skjvm::swap(*carried, entries[slot]);
+          }
+          skjvm::swap(tag, tags[slot]);
+          if (placed == nullptr) { placed = &entries[slot]; }
+        }
+        if ((tag & distance_mask) == distance_mask) {
+          fatal("hash map probe longer than %u slots", distance_mask);
+        }
+      }
+    }
+
+   public:
+    HashMap() noexcept = default;
+    HashMap(HashMap const&) = delete;
+    auto operator=(HashMap const&) -> HashMap & = delete;
+
+    HashMap(HashMap &&other) noexcept
+      : tags(other.tags), entries(other.entries), capacity(other.capacity),
+        count(other.count), allocations(other.allocations),
+        hasher(skjvm::move(other.hasher)) {
+      other.tags = nullptr;
+      other.entries = nullptr;
+      other.capacity = 0;
+      other.count = 0;
+      other.allocations = 0;
+    }
+
+    auto operator=(HashMap &&other) noexcept -> HashMap & {
+      if (this != &other) {
+        release();
+        tags = other.tags;
+        entries = other.entries;
+        capacity = other.capacity;
+        count = other.count;
+        allocations = other.allocations;
+        hasher = skjvm::move(other.hasher);
+        other.tags = nullptr;
+        other.entries = nullptr;
+        other.capacity = 0;
+        other.count = 0;
+        other.allocations = 0;
+      }
+      return *this;
+    }
+
+    ~HashMap() noexcept {
+      release();
+    }
+
+    /// Make room for \p wanted entries without growing.
+    auto reserve(size_t wanted) -> void {
+      size_t new_capacity = capacity == 0 ? initial_capacity : capacity;
+      while (wanted * 5 > new_capacity * 4) { new_capacity *= 2; }
+      if (new_capacity > capacity) { rehash(new_capacity); }
+    }
+
+    template <typename Key>
+    [[nodiscard]]
+    auto find(Key const &key) -> V * {
+      size_t slot = search(key);
+      return slot == capacity ? nullptr : &entries[slot].value;
+    }
+
+    template <typename Key>
+    [[nodiscard]]
+    auto find(Key const &key) const -> V const * {
+      size_t slot = search(key);
+      return slot == capacity ? nullptr : &entries[slot].value;
+    }
+
+    template <typename Key>
+    [[nodiscard]]
+    auto contains(Key const &key) const -> bool {
+      return search(key) != capacity;
+    }
+
+    /// Insert \p key with a value constructed from \p arguments, unless the
+    /// key is already there, in which case nothing is constructed.
+    template <typename... Arguments>
+    auto emplace(K key, Arguments &&...arguments) -> InsertResult {
+      size_t slot = search(key);
+      if (slot != capacity) { return {&entries[slot].value, false}; }
+      reserve(count + 1);
+      uint64_t hash = hasher(key);
+      Entry *placed = place(
+        Entry {skjvm::move(key), V(skjvm::forward<Arguments>(arguments)...)},
+        hash);
+      return {&placed->value, true};
+    }
+
+    auto insert(K key, V value) -> InsertResult {
+      return emplace(skjvm::move(key), skjvm::move(value));
+    }
+
+    /// Insert \p key with \p value, replacing the value it had if any.
+    auto assign(K key, V value) -> V & {
+      InsertResult result = emplace(skjvm::move(key), skjvm::move(value));
+      if (not result.inserted) { *result.value = skjvm::move(value); }
+      return *result.value;
+    }
+
+    /// Remove \p key, returning whether it was there.
+    template <typename Key>
+    auto erase(Key const &key) -> bool {
+      size_t slot = search(key);
+      if (slot == capacity) { return false; }
+      entries[slot].~Entry();
+      // Shift the entries after it back a slot, until one at home.
+      size_t mask = capacity - 1;
+      for (size_t next = (slot + 1) & mask;
+           tags[next] != 0 and get_distance(tags[next]) != 0;
+           slot = next, next = (next + 1) & mask) {
+        new (static_cast<void *>(&entries[slot]))
+          Entry(skjvm::move(entries[next]));
+        entries[next].~Entry();
+        tags[slot] = tags[next] - 1;
+      }
+      tags[slot] = 0;
+      --count;
+      return true;
+    }
+
+    /// Remove all entries, keeping the storage.
+    auto clear() noexcept -> void {
+      for (size_t i = 0; i < capacity; ++i) {
+        if (tags[i] != 0) {
+          entries[i].~Entry();
+          tags[i] = 0;
+        }
+      }
+      count = 0;
+    }
+
+    [[nodiscard]]
+    auto get_size() const -> size_t {
+      return count;
+    }
+
+    [[nodiscard]]
+    auto get_capacity() const -> size_t {
+      return capacity;
+    }
+
+    [[nodiscard]]
+    auto is_empty() const -> bool {
+      return count == 0;
+    }
+
+    /// The number of heap allocations made by this table.
+    [[nodiscard]]
+    auto get_allocations() const -> size_t {
+      return allocations;
+    }
+
+    /// Visits the entries in slot order, which changes when the table
+    /// grows or an entry is erased.
+    template <typename E>
+    class Iterator {
+      friend class HashMap;
+
+      uint32_t const *tags;
+      E *entries;
+      size_t slot;
+      size_t capacity;
+
+      Iterator(uint32_t const *tags, E *entries, size_t slot, size_t capacity)
+        : tags(tags), entries(entries), slot(slot), capacity(capacity) {
+        skip();
+      }
+
+      auto skip() -> void {
+        while (slot < capacity and tags[slot] == 0) { ++slot; }
+      }
+
+     public:
+      auto operator*() const -> E & {
+        return entries[slot];
+      }
+
+      auto operator->() const -> E * {
+        return &entries[slot];
+      }
+
+      auto operator++() -> Iterator & {
+        ++slot;
+        skip();
+        return *this;
+      }
+
+      auto operator!=(Iterator const &other) const -> bool {
+        return slot != other.slot;
+      }
+    };
+
+    auto begin() -> Iterator<Entry> {
+      return {tags, entries, 0, capacity};
+    }
+
+    auto end() -> Iterator<Entry> {
+      return {tags, entries, capacity, capacity};
+    }
+
+    auto begin() const -> Iterator<Entry const> {
+      return {tags, entries, 0, capacity};
+    }
+
+    auto end() const -> Iterator<Entry const> {
+      return {tags, entries, capacity, capacity};
+    }
+  };
+} // namespace skjvm
+
+#endif /* skjvm_hash_map_hpp */
@@ -0,0 +1,341 @@
+#ifndef skjvm_heap_hpp
+#define skjvm_heap_hpp
+
+#include <skjvm/gc_workers.hpp>
+#include <skjvm/memory.hpp>
+#include <skjvm/object.hpp>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief A thread-local allocation buffer: a zeroed piece of eden that
+  /// one thread allocates from by bumping \c top, without synchronizing.
+  struct Tlab {
+    uint8_t *top;
+    uint8_t *end;
+  };
+
+  /// \brief What the collector did since the heap was created.
+  struct GcStats {
+    uint64_t collections;
+    uint64_t total_pause_ns;
+    uint64_t max_pause_ns;
+
+    /// Bytes copied into a survivor space, and into the old generation.
+    uint64_t copied_bytes;
+    uint64_t promoted_bytes;
+
+    /// Buffers handed to threads, and bytes of eden and old generation
+    /// handed out, buffers included.
+    uint64_t tlab_refills;
+    uint64_t allocated_bytes;
+
+    /// Full collections, counted in \c collections too, and the time
+    /// their phases took: clearing the mark bitmap, marking, and sweeping
+    /// the old generation, which happens later, as it is needed.
+    uint64_t full_collections;
+    uint64_t clear_ns;
+    uint64_t mark_ns;
+    uint64_t sweep_ns;
+    uint64_t swept_blocks;
+  };
+
+  /// \brief The Java heap: a young generation collected by copying, and an
+  /// old generation objects are promoted to.
+  ///
+  /// \details The heap is reserved at once, the young generation first:
+  ///
+  /// \code
+  /// [ eden | survivor | survivor | old generation ]
+  /// \endcode
+  ///
+  /// Threads allocate in eden through their \c Tlab, and refill it from
+  /// eden with an atomic bump. Objects too large for a buffer are
+  /// allocated in eden directly, and those larger than half of it in the
+  /// old generation. Allocation returns \c nullptr once eden is full: the
+  /// \c VM then stops the world and calls \c collect_young.
+  ///
+  /// The young collection is Cheney's: live objects are copied from eden
+  /// and the survivor space in use to the other survivor space, then the
+  /// copies are scanned in order for the objects they refer to, which are
+  /// copied in turn. Objects that survived \c get_tenuring_threshold
+  /// collections, or that do not fit in the survivor space, are promoted to
+  /// the old generation and scanned the same way. The original is left
+  /// forwarded to its copy, see \c mark_word.
+  ///
+  /// Old objects referring to young ones are found through a card table:
+  /// a byte per \c card_size bytes of the heap, dirtied by the write
+  /// barrier of every reference store into an object, see \c mark_card.
+  /// The collection scans the reference fields of the old objects on dirty
+  /// cards, and cleans the cards that no longer refer to the young
+  /// generation. A table of where objects start in each old card makes the
+  /// old generation walkable from any card.
+  ///
+  /// When the old generation may not have room for what a young
+  /// collection would promote, \c collect_full marks every live object
+  /// first, on \c GcWorkers: each worker traces from its share of the
+  /// roots with a \c WorkStealingDeque of objects to scan, stealing from
+  /// the others once its own is empty, and marks objects in a bitmap on
+  /// the side, a bit per word of the heap. Old objects do not move. The
+  /// old generation is swept lazily, in blocks of \c sweep_block_size:
+  /// when promotion or a large object needs room the free lists do not
+  /// have, the workers sweep the next blocks in parallel, turning runs of
+  /// dead objects into free chunks on lists segregated by size. Until its
+  /// block is swept, an old object is live only if it is marked.
+  class Heap {
+    struct Space {
+      uint8_t *start;
+      uint8_t *top;
+      uint8_t *end;
+
+      [[nodiscard]]
+      auto contains(void const *address) const -> bool {
+        return static_cast<uint8_t const *>(address) >= start and
+               static_cast<uint8_t const *>(address) < end;
+      }
+
+      [[nodiscard]]
+      auto get_used() const -> size_t {
+        return size_t(top - start);
+      }
+    };
+
+    /// A free chunk of the old generation: its header has no class, to
+    /// tell it from an object, and its size in the low half. Chunks of 8
+    /// bytes are too small to be linked, and stay unused until the next
+    /// sweep.
+    struct FreeChunk {
+      uintptr_t header;
+      FreeChunk *next;
+
+      [[nodiscard]]
+      auto get_size() const -> size_t {
+        return uint32_t(header);
+      }
+    };
+
+    /// Longer runs of dead objects make several chunks.
+    static constexpr size_t max_chunk_size = size_t(1) << 31;
+
+    /// A list per size of chunk up to \c small_chunk_limit, then a list
+    /// per power of two.
+    static constexpr size_t small_chunk_limit = 512;
+    static constexpr uint32_t free_list_count = small_chunk_limit / 8 + 1 + 40;
+
+    struct FreeLists {
+      FreeChunk *heads[free_list_count];
+      FreeChunk *tails[free_list_count];
+      /// Bytes in linked chunks.
+      size_t bytes;
+    };
+
+    struct MarkContext;
+
+    uint8_t *base {nullptr};
+    size_t reserved {0};
+    Space eden {};
+    Space from {};
+    Space to {};
+    Space old {};
+    size_t tlab_size {0};
+
+    /// The card table, and its address biased by the start of the heap so
+    /// that the card of an address is <tt>card_base[address >>
+    /// card_shift]</tt>.
+    uint8_t *cards {nullptr};
+    uint8_t *card_base {nullptr};
+
+    /// For each card of the old generation, the offset in words from its
+    /// start of the object covering the first byte of the card.
+    uint32_t *object_starts {nullptr};
+
+    /// The mark bitmap of the last full collection.
+    uint64_t *mark_bits {nullptr};
+    GcWorkers workers {};
+
+    /// Old objects below \c sweep_limit, the top of the old generation
+    /// when it was last marked, are dead unless they are marked or their
+    /// block is below \c next_block, already swept.
+    uint8_t *sweep_limit {nullptr};
+    size_t next_block {0};
+    size_t block_count {0};
+    /// For each block, the bytes of marked objects starting in it, and the
+    /// offset in words of the first object starting in it.
+    uint32_t *block_live {nullptr};
+    uint32_t *block_first {nullptr};
+    /// Dead bytes in the blocks not swept yet.
+    size_t unswept_free {0};
+
+    /// Serializes the allocation of large objects in the old generation,
+    /// which may sweep. Promotion happens with the world stopped.
+    pthread_mutex_t old_mutex = PTHREAD_MUTEX_INITIALIZER;
+    FreeLists free_lists {};
+
+    /// Promoted objects not scanned yet, during a young collection.
+    PodVector<Object *> promoted {};
+
+    uint32_t tenuring_threshold {default_tenuring_threshold};
+    bool log {false};
+    int64_t start_time;
+    GcStats stats {};
+
+    auto claim(Space &space, size_t size) -> uint8_t *;
+    auto allocate_slow(Tlab &tlab, size_t size) -> void *;
+    auto allocate_old(size_t size) -> uint8_t *;
+    auto find_old_space(size_t size) -> uint8_t *;
+    auto record_object_start(uint8_t const *object, size_t size) -> void;
+    auto evacuate(Object *object) -> Object *;
+    auto scan_object(Object *object, bool promoted) -> void;
+    auto scan_card(uint8_t *card, uint8_t const *limit) -> void;
+    auto scan_cards(uint8_t const *limit) -> void;
+    [[nodiscard]]
+    auto get_old_free() const -> size_t;
+
+    [[nodiscard]]
+    auto is_marked(void const *object) const -> bool;
+    auto mark(Object *object) -> bool;
+    [[nodiscard]]
+    auto is_live(Object const *object) const -> bool;
+    auto mark_work(MarkContext &context, uint32_t worker) -> void;
+
+    auto take_chunk(size_t size) -> uint8_t *;
+    auto add_chunk(FreeLists &lists, uint8_t *start, size_t size) -> void;
+    auto sweep_block(size_t block, FreeLists &lists) -> size_t;
+    auto sweep_some() -> bool;
+
+   public:
+    /// Each card covers 512 bytes.
+    static constexpr unsigned card_shift = 9;
+    static constexpr size_t card_size = size_t(1) << card_shift;
+    static constexpr uint8_t clean_card = 0;
+    static constexpr uint8_t dirty_card = 1;
+
+    static constexpr uint32_t default_tenuring_threshold = 7;
+    static constexpr size_t default_tlab_size = size_t(256) * 1024;
+
+    /// The old generation is swept a block at a time per worker.
+    static constexpr size_t sweep_block_size = size_t(256) * 1024;
+
+    /// At most that many workers by default, one per hardware thread
+    /// below.
+    static constexpr uint32_t max_default_gc_threads = 8;
+
+    /// A heap of \p size bytes, \p young_size of which for the young
+    /// generation, a third by default. Each survivor space takes a tenth
+    /// of the young generation.
+    explicit Heap(size_t size, size_t young_size = 0) noexcept;
+    Heap(Heap const&) = delete;
+    auto operator=(Heap const&) -> Heap & = delete;
+    ~Heap() noexcept;
+
+    /// Size of an object of \p size bytes in the heap, with its alignment.
+    [[nodiscard]]
+    static constexpr auto align(size_t size) -> size_t {
+      return (size + 7) & ~size_t(7);
+    }
+
+    /// \p size zeroed bytes, 8-byte aligned, from \p tlab when they fit,
+    /// or \c nullptr when eden, or the old generation for large objects,
+    /// is full.
+    [[nodiscard]]
+    auto allocate(Tlab &tlab, size_t size) -> void * {
+      size = align(size);
+      if (size <= size_t(tlab.end - tlab.top)) {
+        void *object = tlab.top;
+        tlab.top += size;
+        return object;
+      }
+      return allocate_slow(tlab, size);
+    }
+
+    /// The write barrier: record a store of a reference at \p slot, a
+    /// field or element of an object in the heap.
+    __attribute__((always_inline))
+    auto mark_card(void const *slot) -> void {
+      card_base[uintptr_t(slot) >> card_shift] = dirty_card;
+    }
+
+    /// The write barrier of stores into \p size bytes from \p start.
+    auto mark_cards(void const *start, size_t size) -> void;
+
+    /// The biased card table, for compiled code, see \c mark_card. It does
+    /// not move.
+    [[nodiscard]]
+    auto get_card_base() const -> uint8_t * {
+      return card_base;
+    }
+
+    /// Collect the young generation, stopping the world. \p roots are the
+    /// slots referring to objects from outside the heap, which are updated
+    /// to the new addresses. \p weak_roots are updated too, but do not keep
+    /// objects alive: those of the objects collected are cleared. Every
+    /// \c Tlab must have been given back.
+    ///
+    /// Returns \c false, collecting nothing, if the old generation may not
+    /// have room for all the young objects, which could not be promoted
+    /// then.
+    [[nodiscard]]
+    auto collect_young(PodVector<Object **> const &roots,
+                       PodVector<Object **> const &weak_roots) -> bool;
+
+    /// Mark what \p roots lead to, in parallel, and let the old
+    /// generation be swept lazily from then on. Objects do not move: the
+    /// young generation is collected by the \c collect_young that follows,
+    /// which has the dead old objects for room. \p weak_roots of the old
+    /// objects left unmarked are cleared. Every \c Tlab must have been
+    /// given back.
+    auto collect_full(PodVector<Object **> const &roots,
+                      PodVector<Object **> const &weak_roots) -> void;
+
+    [[nodiscard]]
+    auto get_stats() const -> GcStats;
+
+    [[nodiscard]]
+    auto get_tenuring_threshold() const -> uint32_t {
+      return tenuring_threshold;
+    }
+
+    /// Promote objects once they survived \p threshold young collections,
+    /// at most \c mark_word::max_age.
+    auto set_tenuring_threshold(uint32_t threshold) -> void {
+      tenuring_threshold = threshold < mark_word::max_age
+        ? threshold
+        : mark_word::max_age;
+    }
+
+    /// Run full collections on \p count threads, before the first one.
+    auto set_parallel_gc_threads(uint32_t count) -> void {
+      workers.set_count(count);
+    }
+
+    [[nodiscard]]
+    auto get_parallel_gc_threads() const -> uint32_t {
+      return workers.get_count();
+    }
+
+    /// Print a line per collection on \c stdout, like \c -Xlog:gc.
+    auto set_log(bool enable) -> void {
+      log = enable;
+    }
+
+    [[nodiscard]]
+    auto get_size() const -> size_t {
+      return reserved;
+    }
+
+    [[nodiscard]]
+    auto get_young_size() const -> size_t {
+      return size_t(old.start - base);
+    }
+
+    /// Whether \p object is in the young generation.
+    [[nodiscard]]
+    auto is_young(void const *object) const -> bool {
+      return object >= base and object < old.start;
+    }
+  };
+} // namespace skjvm
+
+#endif /* skjvm_heap_hpp */
@@ -0,0 +1,230 @@
+#ifndef skjvm_interpreter_hpp
+#define skjvm_interpreter_hpp
+
+#include <skjvm/klass.hpp>
+#include <skjvm/memory.hpp>
+#include <skjvm/object.hpp>
+#include <skjvm/opcodes.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// \brief The quick instructions, as an X-macro of \c X(name, opcode).
+///
+/// \details The interpreter rewrites an instruction referring to the
+/// constant pool into its quick form once the reference is resolved, so
+/// later executions use the operands stored in the instruction instead of
+/// resolving it again. Their opcodes follow the JVM's own.
+///
+/// - \c getfield_* and \c putfield_* carry the field offset in \c value.
+///   The \c word forms are for \c int and \c float fields, \c long for
+///   \c long and \c double, and \c narrow for the others, whose
+///   \c BasicType is in \c count.
+/// - \c getstatic and \c putstatic carry the \c address of the field and
+///   its type in \c count, once its class is initialized.
+/// - \c invokevirtual and \c invokeinterface use their \c cache.
+/// - \c invokespecial carries the \c method it calls, and \c invokestatic
+///   too once the class of the method is initialized.
+/// - \c new carries its initialized \c klass.
+#define SKJVM_QUICK_OPCODES(X)                                                 \
+  X(getfield_word,      0xcb) X(getfield_long,      0xcc)                      \
+  X(getfield_reference, 0xcd) X(getfield_narrow,    0xce)                      \
+  X(putfield_word,      0xcf) X(putfield_long,      0xd0)                      \
+  X(putfield_reference, 0xd1) X(putfield_narrow,    0xd2)                      \
+  X(getstatic,          0xd3) X(putstatic,          0xd4)                      \
+  X(invokevirtual,      0xd5) X(invokespecial,      0xd6)                      \
+  X(invokestatic,       0xd7) X(invokeinterface,    0xd8)                      \
+  X(new_,               0xd9)
+
+namespace skjvm {
+  struct SwitchTable;
+  struct InlineCache;
+
+  /// \brief The opcodes of the quick instructions, see
+  /// \c SKJVM_QUICK_OPCODES.
+  namespace quick {
+#define SKJVM_QUICK_OPCODE_CONSTANT(name, code) \
+    constexpr Opcode name = Opcode(code);
+    SKJVM_QUICK_OPCODES(SKJVM_QUICK_OPCODE_CONSTANT)
+#undef SKJVM_QUICK_OPCODE_CONSTANT
+
+    static_assert(uint8_t(getfield_word) >= opcode_limit);
+  } // namespace quick
+
+  /// \brief One instruction of a method decoded for the interpreter.
+  ///
+  /// \details Decoding makes every instruction the same size and removes
+  /// the variants the class file has for compactness: \c iload_1 becomes
+  /// \c iload with index 1, \c iconst_2, \c bipush, \c sipush and \c ldc of
+  /// an \c int all become \c sipush with the value widened, \c wide
+  /// disappears, and branch offsets become pointers to the target
+  /// instruction. The handler of the opcode is stored in the instruction,
+  /// so the direct-threaded interpreter jumps from one handler to the next
+  /// without a table lookup.
+  ///
+  /// Instructions are rewritten in place into their quick forms while they
+  /// run, see \c SKJVM_QUICK_OPCODES: the operands are written first, then
+  /// the handler and opcode with release stores, and a thread that still
+  /// sees the old opcode resolves the reference again to the same result.
+  struct Instruction {
+    /// Address of the handler in the direct-threaded interpreter.
+    void const *handler;
+    Opcode opcode;
+
+    /// Dimensions of \c multianewarray, element type of \c newarray, and
+    /// argument count of \c invokeinterface. For branches, \c no_osr once
+    /// compiled code turned out never to be enterable at their target.
+    uint8_t count;
+
+    static constexpr uint8_t no_osr = 1;
+
+    /// Local variable or constant pool index.
+    uint16_t index;
+
+    /// Immediate \c int or \c float bits, and the increment of \c iinc.
+    int32_t value;
+
+    union {
+      Instruction const *target;
+      SwitchTable const *table;
+      int64_t wide;  ///< Immediate \c long or \c double bits.
+      InlineCache *cache;
+      uint8_t *address;
+      Method *method;
+      Klass *klass;
+    };
+  };
+
+  static_assert(sizeof(Instruction) == 24);
+
+  /// \brief The inline cache of a virtual or interface call site: the
+  /// method called and, while the site is monomorphic, the one receiver
+  /// class seen there with the implementation it selected.
+  ///
+  /// \details \c klass goes from \c nullptr to a class, set once with
+  /// \c target, and from there to \c megamorphic when another class shows
+  /// up, after which calls always use the vtable or itable.
+  struct InlineCache {
+    Method *method;
+    Klass *klass;
+    Method *target;
+
+    /// Sentinel values of \c klass, never the address of a class: while
+    /// a thread fills the cache, and once it stopped caching.
+    static constexpr uintptr_t filling = 1;
+    static constexpr uintptr_t megamorphic = 2;
+  };
+
+  /// \brief The targets of a \c tableswitch (\c keys is \c nullptr, and
+  /// target \c i is for key <tt>low + i</tt>) or of a \c lookupswitch (keys
+  /// sorted for binary search).
+  struct SwitchTable {
+    Instruction const *default_target;
+    int32_t low;
+    uint32_t count;
+    int32_t const *keys;
+    Instruction const *const *targets;
+  };
+
+  /// \brief An entry of the exception table, with decoded bounds.
+  struct DecodedHandler {
+    Instruction const *start;
+    Instruction const *end;
+    Instruction const *target;
+    uint16_t catch_type;
+  };
+
+  /// \brief A method decoded for the interpreter.
+  ///
+  /// \details Decoding also computes the stack map of every instruction,
+  /// see \c compute_stack_maps: the depth of the operand stack before it
+  /// runs, and which locals and operands hold references then, for the
+  /// garbage collector and the compiler. Slots are numbered as in the
+  /// frame, locals first, then the operand stack from its bottom.
+  struct DecodedMethod {
+    Instruction *code;
+    uint32_t length;
+
+    /// Offset in the original bytecode of each instruction.
+    uint32_t *bcis;
+    DecodedHandler *handlers;
+    uint16_t handler_count;
+    uint16_t max_stack;
+    uint16_t max_locals;
+
+    /// Stack depth before each instruction, \c UINT16_MAX for those never
+    /// reached.
+    uint16_t *depths;
+
+    /// \c map_words bits per instruction, one per slot, set for the slots
+    /// that hold a reference before it.
+    uint64_t *references;
+    uint32_t map_words;
+
+    [[nodiscard]]
+    auto bci_of(Instruction const *instruction) const -> uint32_t {
+      return bcis[instruction - code];
+    }
+
+    /// Whether \p slot holds a reference before instruction \p index.
+    [[nodiscard]]
+    auto is_reference(uint32_t index, uint32_t slot) const -> bool {
+      uint64_t word = references[size_t(index) * map_words + slot / 64];
+      return ((word >> (slot % 64)) & 1) != 0;
+    }
+  };
+
+  /// \brief How the interpreter goes from one instruction to the next.
+  enum class DispatchMode : uint8_t {
+    /// Jump to the handler address stored in each instruction, with the
+    /// computed goto extension of GCC and Clang. Falls back to \c switch_
+    /// with other compilers.
+    threaded,
+    /// A \c switch on the opcode in a loop.
+    switch_,
+    /// Like \c switch_, also counting executed instructions in
+    /// \c Thread::executed, for benchmarks.
+    counting,
+  };
+
+  /// \brief A Java method activation.
+  ///
+  /// \details The locals of a frame are the arguments pushed on the operand
+  /// stack of its caller, followed by its other locals and its own operand
+  /// stack, all in the \c Value stack of the thread. \c ip and \c sp are
+  /// saved whenever the frame may be inspected: calls, allocations and
+  /// exceptions.
+  struct Frame {
+    Frame *caller;
+    Method *method;
+    Value *locals;
+    Value *stack;
+    Value *sp;
+    Instruction const *ip;
+  };
+
+  /// Whether this build has direct threading, see \c DispatchMode.
+  [[nodiscard]]
+  auto has_threaded_dispatch() -> bool;
+
+  /// Run the interpreted \p method of \p thread with \p locals, whose
+  /// first slots hold the arguments, using \p mode. The method must be
+  /// decoded. Returns the result; on exception, \c Thread::exception is set.
+  auto interpret(Thread &thread, DispatchMode mode, Method &method,
+                 Value *locals) -> Value;
+
+  /// Interpret \p frame, the innermost frame of \p thread, from its saved
+  /// \c ip and \c sp, or from the handler of \c Thread::exception if one
+  /// is set: what compiled code left of a method. Returns the result like
+  /// \c interpret, leaving the frame to its caller to pop.
+  auto resume(Thread &thread, DispatchMode mode, Frame &frame) -> Value;
+
+  /// Decode the code of \p method for the interpreter, with its stack
+  /// maps, in \p arena. Returns \c nullptr if the bytecode is malformed:
+  /// an unknown or unsupported opcode, a branch out of the code or into the
+  /// middle of an instruction, or an operand stack that does not add up.
+  [[nodiscard]]
+  auto decode_method(Method const &method, Arena &arena) -> DecodedMethod *;
+} // namespace skjvm
+
+#endif /* skjvm_interpreter_hpp */
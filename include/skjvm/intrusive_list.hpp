@@ -0,0 +1,198 @@
+#ifndef skjvm_intrusive_list_hpp
+#define skjvm_intrusive_list_hpp
+
+#include <stddef.h>
+
+namespace skjvm {
+  /// \brief The links of an item in an \c IntrusiveList, as a base class.
+  /// An item that is in several lists at once derives from one subclass of
+  /// this per list.
+  struct ListNode {
+    ListNode *previous {nullptr};
+    ListNode *next {nullptr};
+
+    [[nodiscard]]
+    auto is_linked() const -> bool {
+      return next != nullptr;
+    }
+  };
+
+  /// \brief A doubly linked list of items of type \p T, linked through
+  /// their \p Node base, such as threads waiting on a monitor.
+  ///
+  /// \details The list never allocates: items are linked in place, so
+  /// adding and removing them is O(1) and cannot fail. It does not own
+  /// them either, and unlinks whatever it still holds when destroyed. An
+  /// item is in at most one list through each node.
+  template <typename T, typename Node = ListNode>
+  class IntrusiveList {
+    // The sentinel, as the node before the first item and after the last.
+    ListNode head;
+    size_t size {0};
+
+    static auto item_of(ListNode *node) -> T * {
+      return static_cast<T *>(static_cast<Node *>(node));
+    }
+
+    static auto node_of(T &item) -> ListNode * {
+      return static_cast<ListNode *>(static_cast<Node *>(&item));
+    }
+
+    static auto link(ListNode *node, ListNode *before) -> void {
+      node->previous = before->previous;
+      node->next = before;
+      before->previous->next = node;
+      before->previous = node;
+    }
+
+    static auto unlink(ListNode *node) -> void {
+      node->previous->next = node->next;
+      node->next->previous = node->previous;
+      node->previous = nullptr;
+      node->next = nullptr;
+    }
+
+    /// Move the items of \p other here, leaving it empty.
+    auto take(IntrusiveList &other) noexcept -> void {
+      if (other.is_empty()) {
+        head.previous = &head;
+        head.next = &head;
+      } else {
+        head.previous = other.head.previous;
+        head.next = other.head.next;
+        head.previous->next = &head;
+        head.next->previous = &head;
+      }
+      size = other.size;
+      other.head.previous = &other.head;
+      other.head.next = &other.head;
+      other.size = 0;
+    }
+
+   public:
+    IntrusiveList() noexcept {
+      head.previous = &head;
+      head.next = &head;
+    }
+
+    IntrusiveList(IntrusiveList const&) = delete;
+    auto operator=(IntrusiveList const&) -> IntrusiveList & = delete;
+
+    IntrusiveList(IntrusiveList &&other) noexcept {
+      take(other);
+    }
+
+    auto operator=(IntrusiveList &&other) noexcept -> IntrusiveList & {
+      if (this != &other) {
+        clear();
+        take(other);
+      }
+      return *this;
+    }
+
+    ~IntrusiveList() noexcept {
+      clear();
+    }
+
+    auto push_front(T &item) -> void {
+      link(node_of(item), head.next);
+      ++size;
+    }
+
+    auto push_back(T &item) -> void {
+      link(node_of(item), &head);
+      ++size;
+    }
+
+    /// Link \p item before \p position, which is in this list.
+    auto insert_before(T &position, T &item) -> void {
+      link(node_of(item), node_of(position));
+      ++size;
+    }
+
+    /// Unlink \p item, which is in this list.
+    auto remove(T &item) -> void {
+      unlink(node_of(item));
+      --size;
+    }
+
+    /// Unlink and return the first item, or \c nullptr if there is none.
+    auto pop_front() -> T * {
+      if (is_empty()) { return nullptr; }
+      T *item = item_of(head.next);
+      remove(*item);
+      return item;
+    }
+
+    /// Unlink and return the last item, or \c nullptr if there is none.
+    auto pop_back() -> T * {
+      if (is_empty()) { return nullptr; }
+      T *item = item_of(head.previous);
+      remove(*item);
+      return item;
+    }
+
+    /// Unlink all items.
+    auto clear() noexcept -> void {
+      while (not is_empty()) { unlink(head.next); }
+      size = 0;
+    }
+
+    [[nodiscard]]
+    auto front() const -> T * {
+      return is_empty() ? nullptr : item_of(head.next);
+    }
+
+    [[nodiscard]]
+    auto back() const -> T * {
+      return is_empty() ? nullptr : item_of(head.previous);
+    }
+
+    [[nodiscard]]
+    auto get_size() const -> size_t {
+      return size;
+    }
+
+    [[nodiscard]]
+    auto is_empty() const -> bool {
+      return head.next == &head;
+    }
+
+    /// Visits the items in order.
+    class Iterator {
+      friend class IntrusiveList;
+
+      ListNode *node;
+
+      explicit Iterator(ListNode *node) : node(node) {}
+
+     public:
+      auto operator*() const -> T & {
+        return *item_of(node);
+      }
+
+      auto operator->() const -> T * {
+        return item_of(node);
+      }
+
+      auto operator++() -> Iterator & {
+        node = node->next;
+        return *this;
+      }
+
+      auto operator!=(Iterator const &other) const -> bool {
+        return node != other.node;
+      }
+    };
+
+    auto begin() const -> Iterator {
+      return Iterator(head.next);
+    }
+
+    auto end() const -> Iterator {
+      return Iterator(const_cast<ListNode *>(&head));
+    }
+  };
+} // namespace skjvm
+
+#endif /* skjvm_intrusive_list_hpp */
@@ -0,0 +1,296 @@
+#ifndef skjvm_klass_hpp
+#define skjvm_klass_hpp
+
+#include <skjvm/class_file.hpp>
+#include <skjvm/memory.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace skjvm {
+  struct CompiledMethod;
+  struct DecodedMethod;
+  struct Klass;
+  struct Object;
+  class Thread;
+  union Value;
+
+  /// A native method: \p arguments holds the receiver, if any, then the
+  /// arguments, in local variable slots.
+  using NativeFunction = auto (*)(Thread &thread, Value *arguments) -> Value;
+
+  /// Size of the header of every object: a single word holding the class,
+  /// the identity hash and the collector's state, see \c mark_word. Fields
+  /// start right after it.
+  constexpr uint32_t object_header_size = 8;
+
+  /// \brief A \c Klass as an object header holds it: its offset from
+  /// \c narrow_klass_base, 0 for no class.
+  using NarrowKlass = uint32_t;
+
+  /// Every \c Klass is allocated in the class space, a range of less than
+  /// 4 GiB reserved once, so that it can be referred to in 32 bits from
+  /// \c narrow_klass_base, which is 0 when the range is below 4 GiB. Set
+  /// by the first \c allocate_klass, before any object exists.
+  constinit inline uintptr_t narrow_klass_base {0};
+
+  [[nodiscard]]
+  inline auto encode_klass(Klass const *klass) -> NarrowKlass {
+    return NarrowKlass(uintptr_t(klass) - narrow_klass_base);
+  }
+
+  [[nodiscard]]
+  inline auto decode_klass(NarrowKlass narrow) -> Klass * {
+    return reinterpret_cast<Klass *>(narrow_klass_base + narrow);
+  }
+
+  /// A zeroed \c Klass in the class space.
+  [[nodiscard]]
+  auto allocate_klass() -> Klass *;
+
+  /// Give back \p klass, from \c allocate_klass, for another class.
+  auto free_klass(Klass *klass) -> void;
+
+  /// \brief The type of a field, a local or an array element, named after
+  /// the first character of its descriptor.
+  enum class BasicType : uint8_t {
+    boolean,
+    char_,
+    float_,
+    double_,
+    byte,
+    short_,
+    int_,
+    long_,
+    reference,
+    void_,
+  };
+
+  /// The type of a descriptor starting with \p first, \c L and \c [ both
+  /// being references. Returns \c void_ for anything else.
+  [[nodiscard]]
+  auto basic_type_of(char first) -> BasicType;
+
+  /// Size of a value of \p type in an object or array, in bytes.
+  [[nodiscard]]
+  auto size_of(BasicType type) -> uint32_t;
+
+  /// \brief A field of a linked class.
+  struct Field {
+    Klass *holder;
+    Utf8View name;
+    Utf8View descriptor;
+    uint16_t access_flags;
+    BasicType type;
+
+    /// Byte offset in the object for instance fields, or in
+    /// \c Klass::static_storage for static fields.
+    uint32_t offset;
+
+    [[nodiscard]]
+    auto is_static() const -> bool {
+      return (access_flags & access::static_) != 0;
+    }
+  };
+
+  enum class VerifyState : uint8_t {
+    unverified,
+    verified,
+    failed,
+  };
+
+  /// \brief A method of a linked class.
+  struct Method {
+    Klass *holder;
+    Utf8View name;
+    Utf8View descriptor;
+    uint16_t access_flags;
+
+    /// Local variable slots taken by the arguments, including the receiver
+    /// of instance methods.
+    uint16_t argument_slots;
+    BasicType return_type;
+
+    /// Index in the vtable of the holder, or -1 for static, private and
+    /// constructor methods, which are never dispatched virtually.
+    int32_t vtable_index;
+
+    /// The \c Code attribute, absent for abstract and native methods.
+    CodeView code;
+
+    /// The code decoded for the interpreter, built on the first call.
+    DecodedMethod *decoded;
+
+    /// The implementation of a native method, bound on the first call.
+    NativeFunction native;
+
+    /// Calls and taken backward branches counted by the interpreter,
+    /// which has the \c Compiler compile the method once one of them
+    /// crosses its threshold.
+    uint32_t invocation_count;
+    uint32_t backedge_count;
+
+    /// The machine code of the method, \c nullptr while interpreted. Set
+    /// and cleared by the \c Compiler with atomic operations.
+    CompiledMethod *compiled;
+
+    /// Times the compiled code was dropped by a deoptimization.
+    uint8_t recompilations;
+
+    /// Set when the \c Compiler gave up on the method.
+    bool not_compilable;
+
+    /// Whether \c VM::decoded type checked the code, which it does once,
+    /// and if it failed, why, for the \c VerifyError of every call.
+    VerifyState verification;
+    char const *verify_error;
+
+    [[nodiscard]]
+    auto is_static() const -> bool {
+      return (access_flags & access::static_) != 0;
+    }
+  };
+
+  /// \brief The implementations in a class of the methods of one of its
+  /// interfaces, indexed like \c Klass::methods of the interface.
+  struct ItableEntry {
+    Klass *interface;
+
+    /// \c nullptr for static methods, initializers and methods without an
+    /// implementation.
+    Method **methods;
+  };
+
+  /// \brief The interface dispatch table of a class: an entry for each
+  /// interface it implements, directly or not.
+  struct Itable {
+    ItableEntry *entries;
+    uint32_t length;
+  };
+
+  /// \brief Reference fields at consecutive offsets in an instance.
+  struct ReferenceBlock {
+    uint32_t offset;
+    uint32_t count;
+  };
+
+  enum class ClassState : uint8_t {
+    linked,
+    initializing,
+    initialized,
+    erroneous,
+  };
+
+  /// \brief A loaded and linked class: its members, field layout and vtable,
+  /// with symbolic references resolved on demand.
+  ///
+  /// \details A \c Klass is built either by \c ClassRegistry from a parsed
+  /// class file, or restored from a \c SharedArchive, in which case nothing
+  /// of it was parsed or computed in this process.
+  struct Klass {
+    Utf8View name;
+    ClassFile const *class_file;
+    uint16_t access_flags;
+    ClassState state;
+
+    /// Restored from the shared archive rather than parsed and linked.
+    bool shared;
+
+    /// For array classes, which have no class file: the type of the
+    /// elements, and their class if they are references.
+    BasicType element_type;
+    Klass *component;
+
+    Klass *super;
+    Klass **interfaces;
+    uint16_t interface_count;
+
+    Field *fields;
+    uint16_t field_count;
+    Method *methods;
+    uint16_t method_count;
+
+    Method **vtable;
+    uint32_t vtable_length;
+
+    /// Built by \c VM::find_interface_method on the first interface call
+    /// that misses its inline cache.
+    Itable *itable;
+
+    /// The object its \c static \c synchronized methods lock, made by
+    /// \c VM::class_lock on first use.
+    Object *lock;
+
+    /// Methods \c VM::decoded verified, and the nanoseconds it spent on
+    /// them, failures included.
+    uint32_t verified_methods;
+    uint64_t verify_time;
+
+    /// Size of an instance, header included, a multiple of 8, and the end
+    /// of its last field, where the fields of subclasses start.
+    uint32_t instance_size;
+    uint32_t fields_end;
+
+    /// The reference fields of an instance, inherited ones included, which
+    /// the garbage collector follows: a block per class declaring some, as
+    /// each class lays out its own references together.
+    ReferenceBlock *reference_blocks;
+    uint32_t reference_block_count;
+
+    uint32_t static_size;
+    uint8_t *static_storage;
+
+    /// One slot per constant pool entry, filled by \c ClassRegistry as
+    /// entries are resolved: \c Klass*, \c Field*, \c Method* or the
+    /// interned \c Symbol const* of a string, depending on the tag. Slots are written with release
+    /// stores and read with acquire loads.
+    void **resolved;
+
+    [[nodiscard]]
+    auto is_array() const -> bool {
+      return element_type != BasicType::void_;
+    }
+
+    [[nodiscard]]
+    auto is_interface() const -> bool {
+      return (access_flags & access::interface) != 0;
+    }
+
+    /// Whether this class is \p other or one of its subclasses or
+    /// implementations.
+    [[nodiscard]]
+    auto is_subclass_of(Klass const *other) const -> bool;
+
+    /// The method of this class (not its supers) named \p name with
+    /// \p descriptor.
+    [[nodiscard]]
+    auto find_method(Utf8View name, Utf8View descriptor) const -> Method *;
+
+    /// The field of this class (not its supers) named \p name with
+    /// \p descriptor.
+    [[nodiscard]]
+    auto find_field(Utf8View name, Utf8View descriptor) const -> Field *;
+  };
+
+  /// Set the offsets of the fields of \p klass, \c Klass::instance_size
+  /// and \c Klass::static_size, once its super class is laid out.
+  ///
+  /// \details Each class packs its own instance fields after those of its
+  /// super class: its references first, together, then the other fields
+  /// largest first, the smaller ones filling the holes that aligning the
+  /// larger ones left, in declaration order for the same size. Static
+  /// fields are packed the same way.
+  auto layout_fields(Klass &klass) -> void;
+
+  /// Set \c Klass::fields_end and \c Klass::reference_blocks of \p klass
+  /// from the offsets of its fields, in \p arena, once its super class has
+  /// them.
+  auto set_reference_blocks(Klass &klass, Arena &arena) -> void;
+
+  /// Print the instance layout of \p klass to \p stream: each field with
+  /// its offset and size, inherited ones included, and the holes.
+  auto print_layout(FILE *stream, Klass const &klass) -> void;
+} // namespace skjvm
+
+#endif /* skjvm_klass_hpp */
@@ -0,0 +1,49 @@
+#ifndef skjvm_mapped_file_hpp
+#define skjvm_mapped_file_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief A read-only, private mapping of a whole file.
+  ///
+  /// \details Class files are parsed in place, so the mapping must outlive
+  /// every view handed out by the \c ClassFile parsed from it. An empty file
+  /// opens successfully with no data.
+  class MappedFile {
+    uint8_t const *data {nullptr};
+    size_t size {0};
+
+   public:
+    MappedFile() noexcept = default;
+    MappedFile(MappedFile const&) = delete;
+    auto operator=(MappedFile const&) -> MappedFile & = delete;
+    ~MappedFile() noexcept;
+
+    /// Map \p path, unmapping the previous file if any. Returns \c false and
+    /// leaves the object empty if the file cannot be opened or mapped.
+    [[nodiscard]]
+    auto open(char const *path) -> bool;
+
+    auto close() -> void;
+
+    [[nodiscard]]
+    auto get_data() const -> uint8_t const * {
+      return data;
+    }
+
+    [[nodiscard]]
+    auto get_size() const -> size_t {
+      return size;
+    }
+  };
+
+  /// \brief Write \p size bytes of \p data to \p path, creating missing
+  /// parent directories. The file is written next to \p path and renamed
+  /// over it, so concurrent readers see the old file or the whole new one,
+  /// never a part.
+  [[nodiscard]]
+  auto replace_file(char const *path, void const *data, size_t size) -> bool;
+} // namespace skjvm
+
+#endif /* skjvm_mapped_file_hpp */
@@ -0,0 +1,193 @@
+#ifndef skjvm_memory_hpp
+#define skjvm_memory_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace skjvm {
+  /// \brief Print \p format like \c printf to \c stderr and abort. Used for
+  /// conditions the VM cannot recover from, such as running out of native
+  /// memory.
+  [[noreturn]] __attribute__((format(printf, 1, 2)))
+  auto fatal(char const *format, ...) -> void;
+
+  // `malloc`, `calloc` and `realloc` that never return null: the VM has no
+  // way to report native allocation failures to Java code, so it stops.
+
+  [[nodiscard]]
+  auto checked_malloc(size_t size) -> void *;
+
+  [[nodiscard]]
+  auto checked_calloc(size_t count, size_t size) -> void *;
+
+  [[nodiscard]]
+  auto checked_realloc(void *pointer, size_t size) -> void *;
+
+  /// \brief A growable array of trivially copyable values, for the VM's
+  /// internal tables.
+  template <typename T>
+  class PodVector {
+    T *items {nullptr};
+    size_t size {0};
+    size_t capacity {0};
+
+   public:
+    PodVector() noexcept = default;
+    PodVector(PodVector const&) = delete;
+    auto operator=(PodVector const&) -> PodVector & = delete;
+    ~PodVector() noexcept {
+      free(items);
+    }
+
+    auto reserve(size_t wanted) -> void {
+      if (wanted <= capacity) { return; }
+      size_t grown = capacity == 0 ? 16 : capacity * 2;
+      capacity = grown > wanted ? grown : wanted;
+      items = static_cast<T *>(checked_realloc(items, capacity * sizeof(T)));
+    }
+
+    auto push(T const &item) -> T & {
+      if (size == capacity) { reserve(size + 1); }
+      items[size] = item;
+      return items[size++];
+    }
+
+    auto pop() -> T {
+      return items[--size];
+    }
+
+    auto clear() -> void {
+      size = 0;
+    }
+
+    /// Drop the items from \p new_size on.
+    auto truncate(size_t new_size) -> void {
+      if (new_size < size) { size = new_size; }
+    }
+
+    auto operator[](size_t index) -> T & {
+      return items[index];
+    }
+
+    auto operator[](size_t index) const -> T const & {
+      return items[index];
+    }
+
+    [[nodiscard]]
+    auto get_size() const -> size_t {
+      return size;
+    }
+
+    [[nodiscard]]
+    auto is_empty() const -> bool {
+      return size == 0;
+    }
+
+    [[nodiscard]]
+    auto get_data() const -> T * {
+      return items;
+    }
+
+    auto begin() const -> T * {
+      return items;
+    }
+
+    auto end() const -> T * {
+      return items + size;
+    }
+  };
+
+  /// \brief A bump allocator for metadata that lives as long as its owner,
+  /// such as classes and symbols. Blocks are never freed individually.
+  ///
+  /// \details Scratch work, such as decoding or verifying one method, can
+  /// also use an arena as a region: take a \c Mark, or open an
+  /// \c ArenaScope, and everything allocated after it goes at once on
+  /// \c reset. The last chunk given back is kept for the next region, so
+  /// a loop of scopes does not call \c malloc each time.
+  class Arena {
+    struct Chunk {
+      Chunk *previous;
+      size_t size;
+    };
+
+    Chunk *chunk {nullptr};
+    uint8_t *position {nullptr};
+    uint8_t *limit {nullptr};
+    Chunk *spare {nullptr};
+    size_t allocations {0};
+
+    auto release(Chunk *until) noexcept -> void;
+
+   public:
+    static constexpr size_t chunk_size = size_t(64) * 1024;
+
+    /// \brief Where an arena was, for \c reset to go back to.
+    class Mark {
+      friend class Arena;
+
+      Chunk *chunk;
+      uint8_t *position;
+
+      Mark(Chunk *chunk, uint8_t *position) noexcept
+        : chunk(chunk), position(position) {}
+    };
+
+    Arena() noexcept = default;
+    Arena(Arena const&) = delete;
+    auto operator=(Arena const&) -> Arena & = delete;
+    Arena(Arena &&other) noexcept;
+    auto operator=(Arena &&other) noexcept -> Arena &;
+    ~Arena() noexcept;
+
+    /// \p size zeroed bytes aligned to \p alignment, a power of two.
+    [[nodiscard]]
+    auto allocate(size_t size, size_t alignment = 8) -> void *;
+
+    /// Zeroed storage for \p count objects of type \c T, which must be
+    /// valid when all zero, like the VM's metadata structures.
+    template <typename T>
+    [[nodiscard]]
+    auto allocate_array(size_t count) -> T * {
+      return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    [[nodiscard]]
+    auto get_mark() const -> Mark {
+      return {chunk, position};
+    }
+
+    /// Free everything allocated since \p mark was taken. Marks taken
+    /// after it are no longer valid.
+    auto reset(Mark mark) noexcept -> void;
+
+    /// Free everything.
+    auto reset() noexcept -> void {
+      reset({nullptr, nullptr});
+    }
+
+    /// The number of chunks taken from \c malloc so far.
+    [[nodiscard]]
+    auto get_allocations() const -> size_t {
+      return allocations;
+    }
+  };
+
+  /// \brief Frees what is allocated from an arena during its lifetime.
+  class ArenaScope {
+    Arena &arena;
+    Arena::Mark mark;
+
+   public:
+    explicit ArenaScope(Arena &arena) noexcept
+      : arena(arena), mark(arena.get_mark()) {}
+    ArenaScope(ArenaScope const&) = delete;
+    auto operator=(ArenaScope const&) -> ArenaScope & = delete;
+    ~ArenaScope() noexcept {
+      arena.reset(mark);
+    }
+  };
+} // namespace skjvm
+
+#endif /* skjvm_memory_hpp */
@@ -0,0 +1,201 @@
+#ifndef skjvm_monitor_hpp
+#define skjvm_monitor_hpp
+
+#include <skjvm/memory.hpp>
+#include <skjvm/object.hpp>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief The lock of an object whose header could not hold it: one a
+  /// thread blocked on, waited on, or that has an identity hash.
+  ///
+  /// \details \c lock is a futex: 0 when free, 1 when held, 2 when held
+  /// and threads may sleep on it. The owner alone changes \c owner,
+  /// \c recursions and \c hash once the monitor is in use, except for
+  /// \c hash, set with a compare and swap by any thread that asks for it.
+  struct Monitor {
+    /// The object locked, a root of the collector, or \c nullptr when the
+    /// monitor is free.
+    Object *object;
+    uint32_t lock;
+    uint32_t owner;
+    /// Entries beyond the first.
+    uint32_t recursions;
+    uint32_t hash;
+
+    /// Threads between reading the header and owning the monitor, which
+    /// may not be deflated meanwhile, and \c deflated once it was.
+    uint32_t pins;
+    /// Threads in \c Monitors::wait, and the futex they sleep on, bumped
+    /// by each notification.
+    uint32_t waiters;
+    uint32_t sequence;
+
+    /// The number of the monitor, in the header of its object.
+    uint32_t index;
+    Monitor *next_free;
+
+    static constexpr uint32_t deflated = uint32_t(1) << 31;
+  };
+
+  /// \brief What the locks did since the VM started.
+  struct MonitorStats {
+    /// Locks moved from the header to a \c Monitor, and back once
+    /// released.
+    uint64_t inflations;
+    uint64_t deflations;
+
+    /// Entries that found the monitor held by another thread, and those
+    /// of them that went to sleep in the kernel rather than spinning.
+    uint64_t contended_enters;
+    uint64_t blocked_enters;
+
+    uint64_t waits;
+    uint64_t notifications;
+
+    /// Monitors in use now.
+    uint64_t in_use;
+  };
+
+  /// \brief The locks of Java objects: thin locks in the object header,
+  /// inflated to a \c Monitor when needed.
+  ///
+  /// \details A thread locks an unlocked object with a single compare and
+  /// swap of the header, which then holds its id and a count of recursive
+  /// entries, see \c mark_word. It inflates the lock to a monitor when
+  /// another thread finds it held, when it waits on the object, when the
+  /// object has an identity hash, which takes the bits a thin lock needs,
+  /// or when it entered more than \c mark_word::max_recursions times. The
+  /// header then holds the index of the monitor, and blocked threads sleep
+  /// on its futex. The owner deflates the monitor back to an unlocked
+  /// header when it releases it for good and nobody waits.
+  ///
+  /// Monitors are allocated in chunks that are never freed, so that a
+  /// thread may read one through a stale header: it pins the monitor
+  /// before using it, then checks the header still refers to it. Thread
+  /// ids are those of \c Thread, from 1.
+  class Monitors {
+    static constexpr unsigned chunk_shift = 10;
+    static constexpr uint32_t chunk_size = uint32_t(1) << chunk_shift;
+    static constexpr uint32_t max_monitors =
+      uint32_t(mark_word::hash_mask >> mark_word::monitor_shift) + 1;
+
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    Monitor **chunks {nullptr};
+    uint32_t count {0};
+    Monitor *free_list {nullptr};
+
+    MonitorStats stats {};
+
+    /// The state of the generator of identity hashes.
+    uint32_t hash_state {2463534242u};
+
+    [[nodiscard]]
+    auto at(uint32_t index) const -> Monitor * {
+      Monitor *chunk = __atomic_load_n(&chunks[index >> chunk_shift],
+                                       __ATOMIC_ACQUIRE);
+      return &chunk[index & (chunk_size - 1)];
+    }
+
+    auto count_event(uint64_t &counter) -> void {
+      __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+    }
+
+    auto next_hash(Object const *object) -> uint32_t;
+    auto allocate() -> Monitor *;
+    auto release(Monitor &monitor) -> void;
+    auto inflate(Object *object, uintptr_t mark, uint32_t owner,
+                 uint32_t recursions, uint32_t hash, bool pin) -> Monitor *;
+    auto pin(Object *object, uintptr_t mark) -> Monitor *;
+    auto unpin(Monitor &monitor) -> void;
+    auto owned(uint32_t thread, Object *object, uintptr_t mark)
+      -> Monitor *;
+    auto lock(Monitor &monitor) -> void;
+    auto unlock(Monitor &monitor) -> void;
+    auto acquire(Monitor &monitor, uint32_t thread) -> void;
+    auto enter_slow(uint32_t thread, Object *object) -> void;
+    auto exit_slow(uint32_t thread, Object *object) -> bool;
+
+   public:
+    /// At most that many threads may be running at once.
+    static constexpr uint32_t max_threads =
+      uint32_t(mark_word::owner_mask >> mark_word::owner_shift);
+
+    /// Spins on a held monitor before sleeping.
+    static constexpr uint32_t spin_limit = 100;
+
+    Monitors() noexcept = default;
+    Monitors(Monitors const&) = delete;
+    auto operator=(Monitors const&) -> Monitors & = delete;
+    ~Monitors() noexcept;
+
+    /// The header bits of an object \p thread holds a thin lock on, once.
+    [[nodiscard]]
+    static constexpr auto thin_lock(uint32_t thread) -> uintptr_t {
+      return mark_word::thin_locked |
+             uintptr_t(thread) << mark_word::owner_shift;
+    }
+
+    /// Lock \p object for \p thread, waiting while another thread holds it.
+    __attribute__((always_inline))
+    auto enter(uint32_t thread, Object *object) -> void {
+      uintptr_t mark = __atomic_load_n(&object->mark, __ATOMIC_RELAXED);
+      if ((mark & mark_word::lock_bits) != 0 or
+          not __atomic_compare_exchange_n(&object->mark, &mark,
+                                          mark | thin_lock(thread), false,
+                                          __ATOMIC_ACQUIRE,
+                                          __ATOMIC_RELAXED)) {
+        enter_slow(thread, object);
+      }
+    }
+
+    /// Unlock \p object once. Returns \c false if \p thread does not hold
+    /// it.
+    [[nodiscard]]
+    __attribute__((always_inline))
+    auto exit(uint32_t thread, Object *object) -> bool {
+      uintptr_t mark = __atomic_load_n(&object->mark, __ATOMIC_RELAXED);
+      if ((mark & mark_word::lock_bits) != thin_lock(thread) or
+          not __atomic_compare_exchange_n(&object->mark, &mark,
+                                          mark ^ thin_lock(thread), false,
+                                          __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED)) {
+        return exit_slow(thread, object);
+      }
+      return true;
+    }
+
+    /// Release \p object, which \p thread holds, until notified or
+    /// \p millis milliseconds passed, forever with 0, then take it back as
+    /// many times as it held it. Returns \c false if \p thread does not
+    /// hold it.
+    [[nodiscard]]
+    auto wait(uint32_t thread, Object *object, int64_t millis) -> bool;
+
+    /// Wake one of the threads waiting on \p object, or all of them with
+    /// \p all. Returns \c false if \p thread does not hold it.
+    [[nodiscard]]
+    auto notify(uint32_t thread, Object *object, bool all) -> bool;
+
+    /// Whether \p thread holds \p object.
+    [[nodiscard]]
+    auto holds(uint32_t thread, Object *object) -> bool;
+
+    /// The identity hash of \p object, never 0, chosen the first time it
+    /// is asked for and kept in its header or monitor, so that it
+    /// survives the object moving.
+    [[nodiscard]]
+    auto identity_hash(Object *object) -> int32_t;
+
+    /// Add the objects of the monitors in use to \p roots.
+    auto add_roots(PodVector<Object **> &roots) -> void;
+
+    [[nodiscard]]
+    auto get_stats() const -> MonitorStats;
+  };
+} // namespace skjvm
+
+#endif /* skjvm_monitor_hpp */
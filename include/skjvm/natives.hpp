@@ -0,0 +1,25 @@
+#ifndef skjvm_natives_hpp
+#define skjvm_natives_hpp
+
+#include <skjvm/class_file.hpp>
+#include <skjvm/klass.hpp>
+
+#include <stdint.h>
+#include <stdio.h>
+
+namespace skjvm {
+  /// \brief The implementation of the native method \p name with
+  /// \p descriptor of the class \p class_name, or \c nullptr if the VM has
+  /// none. Natives exist for the methods of the built-in classes, see
+  /// \c bootstrap.hpp.
+  [[nodiscard]]
+  auto find_native(Utf8View class_name, Utf8View name, Utf8View descriptor)
+    -> NativeFunction;
+
+  /// Write \p length UTF-16 \p chars to \p stream as UTF-8, the way
+  /// \c java/io/PrintStream prints strings.
+  auto write_utf16(FILE *stream, uint16_t const *chars, uint32_t length)
+    -> void;
+} // namespace skjvm
+
+#endif /* skjvm_natives_hpp */
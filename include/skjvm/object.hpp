@@ -0,0 +1,124 @@
+#ifndef skjvm_object_hpp
+#define skjvm_object_hpp
+
+#include <skjvm/klass.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief The layout of \c Object::mark.
+  ///
+  /// \details The upper half holds the \c NarrowKlass of the object, and
+  /// bits 3 to 6 the number of young collections the object survived. The
+  /// two low bits tell what bits 7 to 31 hold, see \c Monitors:
+  ///
+  /// \code
+  /// unlocked      00   identity hash, 0 until it is asked for
+  /// thin locked   01   owner thread id (7-22), recursive entries (23-31)
+  /// inflated      10   index of the Monitor, which keeps the hash
+  /// \endcode
+  ///
+  /// An object the collector copied elsewhere has the address of the copy
+  /// with both low bits set for mark instead.
+  namespace mark_word {
+    constexpr uintptr_t lock_mask = 3;
+    constexpr uintptr_t unlocked = 0;
+    constexpr uintptr_t thin_locked = 1;
+    constexpr uintptr_t inflated = 2;
+    constexpr uintptr_t forwarded = 3;
+    constexpr uintptr_t forwarded_mask = 3;
+    constexpr unsigned age_shift = 3;
+    constexpr uintptr_t age_mask = uintptr_t(0xf) << age_shift;
+    constexpr uint32_t max_age = 15;
+    constexpr unsigned hash_shift = 7;
+    constexpr uint32_t hash_bits = 25;
+    constexpr uintptr_t hash_mask = ((uintptr_t(1) << hash_bits) - 1)
+                                    << hash_shift;
+    constexpr unsigned owner_shift = 7;
+    constexpr uint32_t owner_bits = 16;
+    constexpr uintptr_t owner_mask = ((uintptr_t(1) << owner_bits) - 1)
+                                     << owner_shift;
+    constexpr unsigned recursion_shift = 23;
+    constexpr uint32_t max_recursions = 511;
+    constexpr uintptr_t recursion_mask = uintptr_t(max_recursions)
+                                         << recursion_shift;
+    constexpr unsigned monitor_shift = 7;
+    /// The bits the lock state gives a meaning to, all of them clear in an
+    /// unlocked object without a hash.
+    constexpr uintptr_t lock_bits = lock_mask | hash_mask;
+    constexpr unsigned klass_shift = 32;
+  } // namespace mark_word
+
+  /// Offset of the \c NarrowKlass in an object, for compiled code.
+  constexpr int32_t narrow_klass_offset = mark_word::klass_shift / 8;
+
+  /// \brief The header of every Java object, a single word. Fields follow
+  /// it, at the offsets computed by \c layout_fields.
+  struct Object {
+    /// The class, the identity hash and the collector's state, see
+    /// \c mark_word.
+    uintptr_t mark;
+
+    /// The class, 0 for a free chunk of the heap.
+    [[nodiscard]]
+    auto get_narrow_klass() const -> NarrowKlass {
+      return NarrowKlass(mark >> mark_word::klass_shift);
+    }
+
+    [[nodiscard]]
+    auto get_klass() const -> Klass * {
+      return decode_klass(get_narrow_klass());
+    }
+
+    /// Make this zeroed object an instance of \p klass.
+    auto init_header(Klass const *klass) -> void {
+      mark = uintptr_t(encode_klass(klass)) << mark_word::klass_shift;
+    }
+
+    /// The field at \p offset, as a \p T.
+    template <typename T>
+    [[nodiscard]]
+    auto at(uint32_t offset) -> T & {
+      return *reinterpret_cast<T *>(reinterpret_cast<uint8_t *>(this) +
+                                    offset);
+    }
+  };
+
+  static_assert(sizeof(Object) == object_header_size);
+
+  /// \brief An array: the object header, the length, then the elements,
+  /// from the same offset whatever their type.
+  struct ArrayObject {
+    Object header;
+    int32_t length;
+    int32_t reserved;
+
+    template <typename T>
+    [[nodiscard]]
+    auto elements() -> T * {
+      return reinterpret_cast<T *>(this + 1);
+    }
+  };
+
+  /// Offset of the first element of an array, aligned for every type.
+  constexpr uint32_t array_data_offset = sizeof(ArrayObject);
+
+  static_assert(array_data_offset % 8 == 0);
+
+  /// \brief A local variable or operand stack slot. \c long and \c double
+  /// values take two slots, the value being in the first one, as in the
+  /// class file.
+  union Value {
+    int32_t i;
+    int64_t j;
+    float f;
+    double d;
+    Object *l;
+    uint64_t raw;
+  };
+
+  static_assert(sizeof(Value) == 8);
+} // namespace skjvm
+
+#endif /* skjvm_object_hpp */
@@ -0,0 +1,128 @@
+#ifndef skjvm_options_hpp
+#define skjvm_options_hpp
+
+#include <skjvm/compiler.hpp>
+#include <skjvm/heap.hpp>
+#include <skjvm/interpreter.hpp>
+#include <skjvm/vm.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief How the \c java launcher uses the \c SharedArchive.
+  enum class ShareMode : uint8_t {
+    off,
+    auto_,  ///< Use the archive if it is valid.
+    on,     ///< Fail if the archive cannot be used.
+    dump,   ///< Link the main class and what it uses, and write the archive.
+  };
+
+  /// \brief Command line options of the \c java launcher.
+  ///
+  /// \details Options come before the main class, everything after it is
+  /// passed to \c main. The spelling follows the JDK launcher where there is
+  /// an equivalent.
+  ///
+  /// \code
+  /// -cp PATH, -classpath PATH, --class-path PATH
+  ///                   directories to load classes from, separated by ':'
+  ///                   (default is the current directory)
+  /// -Xcpcache:FILE    keep the class path index in FILE instead of the
+  ///                   default under ~/.cache/skjvm; -Xcpcache:none disables
+  ///                   the cache, see skjvm::ClassPath
+  /// -Xpreload:N       parse the classes referenced by the main class on N
+  ///                   background threads (default is one per hardware
+  ///                   thread, 0 disables it)
+  /// -Xshare:MODE      use the shared class archive: off, auto (default,
+  ///                   use it when valid), on (fail otherwise), or dump
+  ///                   (write it for the main class and exit)
+  /// -XX:SharedArchiveFile=FILE
+  ///                   keep the shared class archive in FILE instead of
+  ///                   the default under ~/.cache/skjvm
+  /// -Xinterpreter:MODE
+  ///                   how the interpreter dispatches instructions:
+  ///                   threaded (default) or switch, see skjvm::DispatchMode
+  /// -Xint            interpret everything, without compiling hot methods
+  /// -Xverify:MODE     type check methods before they first run: none,
+  ///                   remote (default, all but the java/ packages) or
+  ///                   all, see skjvm::verify_method
+  /// -XX:CompileThreshold=N
+  ///                   compile a method once called N times (default 1000)
+  /// -XX:BackEdgeThreshold=N
+  ///                   compile a method once its loops went back N times,
+  ///                   and continue the running loop in the compiled code
+  ///                   (default 10000)
+  /// -XX:+PrintCompilation
+  ///                   print each method compiled or deoptimized
+  /// -XX:+PrintInlineCacheStats
+  ///                   print the hit rate of the inline caches of virtual
+  ///                   and interface calls on exit
+  /// -XX:+PrintMonitorStats
+  ///                   print how often locks were inflated and contended
+  ///                   on exit, see skjvm::Monitors
+  /// -XX:+PrintVerificationStats
+  ///                   print the methods verified in each class and the
+  ///                   time it took on exit
+  /// -XmxSIZE          size of the Java heap (default 256M); sizes are in
+  ///                   bytes, or with a K, M or G suffix
+  /// -XmnSIZE          size of the young generation, within the heap
+  ///                   (default a third of it), see skjvm::Heap
+  /// -XX:MaxTenuringThreshold=N
+  ///                   promote objects once they survived N young
+  ///                   collections, at most 15 (default 7)
+  /// -XX:ParallelGCThreads=N
+  ///                   mark and sweep the old generation on N threads
+  ///                   (default is one per hardware thread, at most 8)
+  /// -Xlog:gc, -verbose:gc
+  ///                   print a line per collection with its pause time
+  /// -XX:+PrintFieldLayout
+  ///                   print the instance layout of each class as it is
+  ///                   linked, see skjvm::print_layout
+  /// -verbose:class    print each class as it is loaded
+  /// -Xprint           print the main class like javap instead of running it
+  /// -help, -h         print usage and exit
+  /// \endcode
+  struct Options {
+    char const *class_path {"."};
+    char const *class_path_cache {nullptr};
+    bool no_class_path_cache {false};
+    uint32_t preload_threads {0};
+    bool preload_threads_given {false};
+    ShareMode share {ShareMode::auto_};
+    char const *shared_archive {nullptr};
+    DispatchMode dispatch {DispatchMode::threaded};
+    bool interpret_only {false};
+    VerifyMode verify {VerifyMode::remote};
+    uint32_t compile_threshold {Compiler::default_compile_threshold};
+    uint32_t backedge_threshold {Compiler::default_backedge_threshold};
+    bool print_compilation {false};
+    bool print_inline_cache_stats {false};
+    bool print_monitor_stats {false};
+    bool print_verification_stats {false};
+    size_t heap_size {VM::default_heap_size};
+    /// Zero for the default, see \c Heap.
+    size_t young_size {0};
+    uint32_t tenuring_threshold {Heap::default_tenuring_threshold};
+    /// Zero for the default, see \c Heap.
+    uint32_t parallel_gc_threads {0};
+    bool log_gc {false};
+    bool print_field_layout {false};
+    bool verbose_class {false};
+    bool print_class {false};
+    bool help {false};
+
+    /// The main class as given, with dots or slashes.
+    char const *main_class {nullptr};
+    int argument_count {0};
+    char **arguments {nullptr};
+
+    /// Parse \c argv into \p options. Unknown options and malformed values
+    /// are reported on \c stderr, and \c false is returned.
+    static auto parse(int argc, char **argv, Options &options) -> bool;
+
+    static auto print_usage(char const *program) -> void;
+  };
+} // namespace skjvm
+
+#endif /* skjvm_options_hpp */
@@ -0,0 +1,66 @@
+#ifndef skjvm_shared_archive_hpp
+#define skjvm_shared_archive_hpp
+
+#include <skjvm/class_path.hpp>
+#include <skjvm/class_registry.hpp>
+#include <skjvm/mapped_file.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  enum class ArchiveStatus : uint8_t {
+    ok,
+    missing,      ///< No archive file.
+    bad_format,   ///< Not an archive of this VM, or a damaged one.
+    stale,        ///< Made for another class path, or a class file changed.
+  };
+
+  [[nodiscard]]
+  auto describe(ArchiveStatus status) -> char const *;
+
+  /// \brief A snapshot of linked classes that a later run maps and uses
+  /// instead of loading, parsing and linking them again, like class data
+  /// sharing in the JDK.
+  ///
+  /// \details \c dump writes every class of a \c ClassRegistry with what
+  /// linking computed for it: the class file bytes and parse tables, field
+  /// offsets, vtables, and the constant pool entries resolved so far, with
+  /// the strings they refer to. The archive holds no pointers, only offsets
+  /// and class indexes, so it can be mapped anywhere.
+  ///
+  /// \c open maps it read-only and checks that it was made for the same
+  /// class path and that every archived class would still be loaded from the
+  /// same, unchanged class file: same class path root, modification time and
+  /// size. \c restore then registers all the classes in two passes over the
+  /// mapping, without parsing or linking anything. Class files and member
+  /// tables are used in place; only the \c Klass objects and their pointer
+  /// tables are allocated.
+  class SharedArchive {
+    MappedFile file {};
+
+   public:
+    SharedArchive() noexcept = default;
+    SharedArchive(SharedArchive const&) = delete;
+    auto operator=(SharedArchive const&) -> SharedArchive & = delete;
+    ~SharedArchive() noexcept = default;
+
+    /// Write the classes of \p registry, loaded from \p class_path, to
+    /// \p path. Array classes are left out; they are cheap to create again.
+    [[nodiscard]]
+    static auto dump(ClassRegistry const &registry, ClassPath const &class_path,
+                     char const *class_path_string, char const *path) -> bool;
+
+    /// Map and validate the archive at \p path for \p class_path.
+    [[nodiscard]]
+    auto open(char const *path, ClassPath const &class_path,
+              char const *class_path_string) -> ArchiveStatus;
+
+    /// Register the archived classes in \p registry, which must have no
+    /// classes yet. The archive must stay open as long as the registry.
+    /// Returns the number of classes restored.
+    auto restore(ClassRegistry &registry, bool verbose) const -> uint32_t;
+  };
+} // namespace skjvm
+
+#endif /* skjvm_shared_archive_hpp */
@@ -0,0 +1,204 @@
+#ifndef skjvm_small_vector_hpp
+#define skjvm_small_vector_hpp
+
+#include <skjvm/memory.hpp>
+#include <skjvm/utility.hpp>
+
+#include <stddef.h>
+#include <stdlib.h>
+
+namespace skjvm {
+  /// \brief A growable array that keeps its first \p N items inline, for
+  /// lists that are short in the common case, such as the operands of an
+  /// instruction or the interfaces of a class.
+  ///
+  /// \details Unlike \c PodVector, items may be any type that can be moved:
+  /// they are constructed in place and moved when the array grows, which
+  /// takes a heap allocation only past \p N items.
+  template <typename T, size_t N>
+  class SmallVector {
+    static_assert(N > 0, "use a PodVector for arrays with no inline items");
+
+    T *items;
+    size_t size {0};
+    size_t capacity {N};
+    size_t allocations {0};
+    alignas(T) unsigned char storage[N * sizeof(T)];
+
+    auto inline_items() noexcept -> T * {
+      return reinterpret_cast<T *>(storage);
+    }
+
+    auto destroy() noexcept -> void {
+      for (size_t i = 0; i < size; ++i) { items[i].~T(); }
+      if (not is_inline()) { free(items); }
+    }
+
+    /// Take the items of \p other, leaving it empty and inline.
+    auto take(SmallVector &other) noexcept -> void {
+      if (other.is_inline()) {
+        items = inline_items();
+        capacity = N;
+        relocate(other.items, other.size, items);
+      } else {
+        items = other.items;
+        capacity = other.capacity;
+      }
+      size = other.size;
+      allocations += other.allocations;
+      other.items = other.inline_items();
+      other.size = 0;
+      other.capacity = N;
+      other.allocations = 0;
+    }
+
+    auto next_capacity(size_t wanted) -> size_t {
+      size_t grown = capacity * 2;
+      return grown > wanted ? grown : wanted;
+    }
+
+    auto grow(size_t wanted) -> void {
+      size_t new_capacity = next_capacity(wanted);
+      ++allocations;
+      if constexpr (__is_trivially_copyable(T)) {
+        // Past the inline storage, the allocator may extend the block in
+        // place.
+        if (not is_inline()) {
+          items = static_cast<T *>(checked_realloc(items,
+                                                   new_capacity * sizeof(T)));
+          capacity = new_capacity;
+          return;
+        }
+      }
+      auto *grown = static_cast<T *>(checked_malloc(new_capacity * sizeof(T)));
+      relocate(items, size, grown);
+      if (not is_inline()) { free(items); }
+      items = grown;
+      capacity = new_capacity;
+    }
+
+    /// Construct the new last item before growing, as \p arguments may
+    /// refer to an item.
+    template <typename... Arguments>
+    auto emplace_grown(Arguments &&...arguments) -> T & {
+      T item(skjvm::forward<Arguments>(arguments)...);
+      grow(size + 1);
+      auto *placed = new (static_cast<void *>(items + size))
+        T(skjvm::move(item));
+      ++size;
+      return *placed;
+    }
+
+   public:
+    SmallVector() noexcept : items(inline_items()) {}
+    SmallVector(SmallVector const&) = delete;
+    auto operator=(SmallVector const&) -> SmallVector & = delete;
+
+    SmallVector(SmallVector &&other) noexcept {
+      take(other);
+    }
+
+    auto operator=(SmallVector &&other) noexcept -> SmallVector & {
+      if (this != &other) {
+        destroy();
+        allocations = 0;
+        take(other);
+      }
+      return *this;
+    }
+
+    ~SmallVector() noexcept {
+      destroy();
+    }
+
+    auto reserve(size_t wanted) -> void {
+      if (wanted > capacity) { grow(wanted); }
+    }
+
+    template <typename... Arguments>
+    auto emplace(Arguments &&...arguments) -> T & {
+      if (size == capacity) {
+        return emplace_grown(skjvm::forward<Arguments>(arguments)...);
+      }
+      auto *item = new (static_cast<void *>(items + size))
+        T(skjvm::forward<Arguments>(arguments)...);
+      ++size;
+      return *item;
+    }
+
+    auto push(T const &item) -> T & {
+      return emplace(item);
+    }
+
+    auto push(T &&item) -> T & {
+      return emplace(skjvm::move(item));
+    }
+
+    auto pop() -> T {
+      T item = skjvm::move(items[--size]);
+      items[size].~T();
+      return item;
+    }
+
+    /// Drop the items from \p new_size on.
+    auto truncate(size_t new_size) noexcept -> void {
+      while (size > new_size) { items[--size].~T(); }
+    }
+
+    /// Drop all items, keeping the storage.
+    auto clear() noexcept -> void {
+      truncate(0);
+    }
+
+    auto operator[](size_t index) -> T & {
+      return items[index];
+    }
+
+    auto operator[](size_t index) const -> T const & {
+      return items[index];
+    }
+
+    [[nodiscard]]
+    auto get_size() const -> size_t {
+      return size;
+    }
+
+    [[nodiscard]]
+    auto get_capacity() const -> size_t {
+      return capacity;
+    }
+
+    [[nodiscard]]
+    auto is_empty() const -> bool {
+      return size == 0;
+    }
+
+    /// Whether the items are still in the inline storage.
+    [[nodiscard]]
+    auto is_inline() const -> bool {
+      return items == reinterpret_cast<T const *>(storage);
+    }
+
+    /// The number of heap allocations made by this array, including those
+    /// of the arrays moved into it.
+    [[nodiscard]]
+    auto get_allocations() const -> size_t {
+      return allocations;
+    }
+
+    [[nodiscard]]
+    auto get_data() const -> T * {
+      return items;
+    }
+
+    auto begin() const -> T * {
+      return items;
+    }
+
+    auto end() const -> T * {
+      return items + size;
+    }
+  };
+} // namespace skjvm
+
+#endif /* skjvm_small_vector_hpp */
@@ -0,0 +1,28 @@
+#ifndef skjvm_stack_map_hpp
+#define skjvm_stack_map_hpp
+
+#include <skjvm/interpreter.hpp>
+#include <skjvm/klass.hpp>
+#include <skjvm/memory.hpp>
+
+namespace skjvm {
+  /// \brief Fill \c DecodedMethod::depths and \c DecodedMethod::references
+  /// of \p decoded, the code of \p method, in \p arena.
+  ///
+  /// \details The maps flow from the start of the method, where the
+  /// receiver and the parameters are the locals, along every branch, and
+  /// from each instruction to the exception handlers covering it, which
+  /// start with the exception alone on the stack. Where paths join, a slot
+  /// is a reference only if it is one on every path: a slot that is not
+  /// cannot be used as a reference there anyway. Instructions whose effect
+  /// is unknown, \c invokedynamic and those the interpreter does not
+  /// support, can only throw, so nothing flows past them.
+  ///
+  /// Returns \c false if the operand stack does not add up: it underflows,
+  /// outgrows \c max_stack, or has different depths where paths join.
+  [[nodiscard]]
+  auto compute_stack_maps(Method const &method, DecodedMethod &decoded,
+                          Arena &arena) -> bool;
+} // namespace skjvm
+
+#endif /* skjvm_stack_map_hpp */
@@ -0,0 +1,151 @@
+#ifndef skjvm_symbol_table_hpp
+#define skjvm_symbol_table_hpp
+
+#include <skjvm/class_file.hpp>
+#include <skjvm/memory.hpp>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief An interned MUTF-8 string, such as a string literal. Equal
+  /// symbols are the same object, so they compare by address.
+  ///
+  /// \details The bytes follow the header, and a symbol holds no pointers,
+  /// so symbols can be stored in a \c SharedArchive and used from the
+  /// mapping.
+  struct Symbol {
+    uint32_t hash;
+    uint16_t length;
+    uint16_t reserved;
+
+    [[nodiscard]]
+    auto bytes() const -> uint8_t const * {
+      return reinterpret_cast<uint8_t const *>(this + 1);
+    }
+
+    [[nodiscard]]
+    auto view() const -> Utf8View {
+      return {bytes(), length};
+    }
+
+    /// Bytes taken by a symbol of \p length bytes, padded so symbols can be
+    /// laid out back to back.
+    static constexpr auto size_for(uint16_t length) -> size_t {
+      return (sizeof(Symbol) + length + 1 + 7) & ~size_t(7);
+    }
+  };
+
+  struct Object;
+
+  /// \brief The table of interned symbols of the VM, and of the
+  /// \c java/lang/String of each that a class used as a constant.
+  ///
+  /// \details Open addressing with linear probing over the symbols, which
+  /// are hashed straight from the bytes of the class file, see
+  /// \c Utf8View::hash: only a symbol created for the first time copies
+  /// them. Symbols are never removed, so an empty slot ends a probe.
+  ///
+  /// Readers take no lock: they load the table with acquire, and each slot
+  /// is filled before its symbol is published with release. Writers take
+  /// \c mutex. Growing allocates a table twice as large and publishes it
+  /// at once, then each insertion moves \c migration_step slots of the
+  /// previous table into it, which readers and writers search too until
+  /// it is empty, so no reader ever waits for a resize. A reader may still
+  /// be probing a table that was replaced: those are kept until the table
+  /// is destroyed, and take less room than the current one together.
+  ///
+  /// The strings are weak roots of the collector, see \c add_weak_roots:
+  /// one only a slot refers to is collected and its slot cleared, and the
+  /// next \c VM::intern creates another, which nothing can tell from it.
+  class SymbolTable {
+    struct Entry {
+      Symbol const *symbol;
+      Object *string;
+    };
+
+    /// A table of \c capacity entries, which follow it.
+    struct Table {
+      uint32_t capacity;
+      /// The next older table replaced, until the table is destroyed.
+      Table *retired;
+
+      [[nodiscard]]
+      auto entries() -> Entry * {
+        return reinterpret_cast<Entry *>(this + 1);
+      }
+    };
+
+    mutable pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    Table *current {nullptr};
+    /// The table being migrated into \c current, or \c nullptr, and the
+    /// slots of it moved so far.
+    Table *previous {nullptr};
+    uint32_t migrated {0};
+    Table *retired {nullptr};
+
+    uint32_t count {0};
+    Arena arena {};
+
+    static auto allocate_table(uint32_t capacity) -> Table *;
+    static auto find(Table *table, Utf8View bytes, uint32_t hash)
+      -> Entry *;
+    static auto find(Table *table, Symbol const *symbol) -> Entry *;
+    static auto place(Table &table, Entry entry) -> Entry *;
+
+    auto search(Utf8View bytes, uint32_t hash) const -> Entry *;
+    auto search(Symbol const *symbol) const -> Entry *;
+    auto migrate_locked(uint32_t slots) -> void;
+    auto insert_locked(Symbol const *symbol) -> Entry *;
+
+   public:
+    /// Slots of the previous table each insertion moves while growing.
+    static constexpr uint32_t migration_step = 16;
+
+    SymbolTable() noexcept = default;
+    SymbolTable(SymbolTable const&) = delete;
+    auto operator=(SymbolTable const&) -> SymbolTable & = delete;
+    ~SymbolTable() noexcept;
+
+    /// The symbol for \p bytes, created on first use.
+    [[nodiscard]]
+    auto intern(Utf8View bytes) -> Symbol const *;
+
+    /// The symbol for \p bytes if it was interned, or \c nullptr.
+    [[nodiscard]]
+    auto lookup(Utf8View bytes) const -> Symbol const *;
+
+    /// Intern \p symbol itself instead of a copy, unless an equal symbol
+    /// exists. \p symbol must outlive the table; used for symbols mapped
+    /// from a shared archive.
+    auto add(Symbol const *symbol) -> Symbol const *;
+
+    /// The interned string of \p symbol, or \c nullptr if there is none
+    /// or it was collected.
+    [[nodiscard]]
+    auto find_string(Symbol const *symbol) const -> Object *;
+
+    /// Make \p string the interned string of \p symbol, unless another
+    /// thread made one first. Returns the one interned.
+    auto set_string(Symbol const *symbol, Object *string) -> Object *;
+
+    /// Add the slots of the interned strings to \p roots, with the world
+    /// stopped. The collector updates the slots of the strings it moves,
+    /// and clears those of the strings it frees.
+    auto add_weak_roots(PodVector<Object **> &roots) -> void;
+
+    /// Forget every interned string, when their heap is destroyed.
+    auto clear_strings() -> void;
+
+    [[nodiscard]]
+    auto get_count() const -> uint32_t;
+
+    /// The slots of the current table.
+    [[nodiscard]]
+    auto get_capacity() const -> uint32_t;
+  };
+} // namespace skjvm
+
+#endif /* skjvm_symbol_table_hpp */
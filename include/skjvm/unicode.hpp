@@ -0,0 +1,81 @@
+#ifndef skjvm_unicode_hpp
+#define skjvm_unicode_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  /// \brief The instruction sets the transcoders below may use, each one
+  /// implying those before it.
+  ///
+  /// \details The vector kernels handle runs of ASCII a block at a time:
+  /// 16 bytes with SSE2, 32 with AVX2, which also transcodes blocks of
+  /// 2-byte UTF-8 sequences, as in Latin, Greek or Cyrillic text, with
+  /// byte shuffles. Other characters go through the scalar loops, which are
+  /// the reference the kernels must agree with.
+  enum class UnicodeIsa : uint8_t {
+    scalar,
+    sse2,
+    avx2,
+  };
+
+  [[nodiscard]]
+  auto describe(UnicodeIsa isa) -> char const *;
+
+  /// \brief The best instruction set the CPU and the OS support, from
+  /// CPUID.
+  [[nodiscard]]
+  auto detect_unicode_isa() -> UnicodeIsa;
+
+  /// \brief The instruction set the transcoders use, the detected one
+  /// unless changed.
+  [[nodiscard]]
+  auto get_unicode_isa() -> UnicodeIsa;
+
+  /// \brief Use \p isa from now on, for tests and benchmarks. Returns
+  /// \c false, changing nothing, if the CPU does not support it.
+  auto set_unicode_isa(UnicodeIsa isa) -> bool;
+
+  /// \brief Decode modified UTF-8 (JVMS 4.4.7) into \p out, which may be
+  /// \c nullptr to only count code units. Returns the number of UTF-16 code
+  /// units, or -1 if \p bytes are malformed.
+  auto decode_modified_utf8(uint8_t const *bytes, uint32_t length,
+                            uint16_t *out) -> int64_t;
+
+  /// \brief Decode UTF-8 into \p out like \c decode_modified_utf8, with
+  /// characters outside the BMP as surrogate pairs. Overlong forms,
+  /// surrogates and code points past U+10FFFF are malformed.
+  auto decode_utf8(uint8_t const *bytes, uint32_t length, uint16_t *out)
+    -> int64_t;
+
+  /// \brief Encode \p length UTF-16 code units as UTF-8 into \p out, which
+  /// may be \c nullptr to only count bytes, at most 3 per unit. Unpaired
+  /// surrogates become \c '?', like \c String.getBytes does. Returns the
+  /// number of bytes.
+  auto encode_utf8(uint16_t const *chars, uint32_t length, uint8_t *out)
+    -> size_t;
+
+  /// \brief Encode \p length UTF-16 code units as modified UTF-8 into
+  /// \p out like \c encode_utf8: U+0000 takes 2 bytes, and each surrogate
+  /// 3, paired or not.
+  auto encode_modified_utf8(uint16_t const *chars, uint32_t length,
+                            uint8_t *out) -> size_t;
+
+  /// \brief Narrow \p length UTF-16 code units to Latin-1 into \p out,
+  /// which may be \c nullptr to only check them, the way compact strings
+  /// store text. Returns \c false, with \p out partly written, if one of
+  /// them is past U+00FF.
+  auto compress_latin1(uint16_t const *chars, uint32_t length, uint8_t *out)
+    -> bool;
+
+  /// \brief Widen \p length Latin-1 bytes to UTF-16 into \p out.
+  auto inflate_latin1(uint8_t const *bytes, uint32_t length, uint16_t *out)
+    -> void;
+
+  /// \brief Encode \p length Latin-1 bytes as UTF-8 into \p out like
+  /// \c encode_utf8, at most 2 bytes each.
+  auto encode_latin1_utf8(uint8_t const *bytes, uint32_t length,
+                          uint8_t *out) -> size_t;
+} // namespace skjvm
+
+#endif /* skjvm_unicode_hpp */
@@ -0,0 +1,91 @@
+#ifndef skjvm_utility_hpp
+#define skjvm_utility_hpp
+
+// Placement new only, which is inline and needs no library to link.
+#include <new>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  template <typename T>
+  struct RemoveReference {
+    using Type = T;
+  };
+
+  template <typename T>
+  struct RemoveReference<T &> {
+    using Type = T;
+  };
+
+  template <typename T>
+  struct RemoveReference<T &&> {
+    using Type = T;
+  };
+
+  /// \brief Cast \p value to an rvalue, like \c std::move. Call it
+  /// qualified, so that argument-dependent lookup does not find
+  /// \c std::move as well.
+  template <typename T>
+  [[nodiscard]]
+  constexpr auto move(T &&value) noexcept
+      -> typename RemoveReference<T>::Type && {
+    return static_cast<typename RemoveReference<T>::Type &&>(value);
+  }
+
+  /// \brief Pass \p value on as it was passed, like \c std::forward.
+  template <typename T>
+  [[nodiscard]]
+  constexpr auto forward(typename RemoveReference<T>::Type &value) noexcept
+      -> T && {
+    return static_cast<T &&>(value);
+  }
+
+  template <typename T>
+  constexpr auto swap(T &left, T &right) noexcept -> void {
+    T saved = skjvm::move(left);
+    left = skjvm::move(right);
+    right = skjvm::move(saved);
+  }
+
+  /// \brief Move \p count objects from \p from to the uninitialized
+  /// \p to, and destroy the originals.
+  template <typename T>
+  auto relocate(T *from, size_t count, T *to) noexcept -> void {
+    for (size_t i = 0; i < count; ++i) {
+      new (static_cast<void *>(to + i)) T(skjvm::move(from[i]));
+      from[i].~T();
+    }
+  }
+
+  /// \brief The default hash of keys: integers, enumerations and
+  /// pointers, mixed with the finalizer of MurmurHash3 so that keys
+  /// differing in a few bits spread over the table.
+  template <typename T>
+  struct Hash {
+    [[nodiscard]]
+    auto operator()(T key) const -> uint64_t {
+      return mix(uint64_t(key));
+    }
+
+    [[nodiscard]]
+    static constexpr auto mix(uint64_t key) -> uint64_t {
+      key ^= key >> 33;
+      key *= 0xff51afd7ed558ccdull;
+      key ^= key >> 33;
+      key *= 0xc4ceb9fe1a85ec53ull;
+      key ^= key >> 33;
+      return key;
+    }
+  };
+
+  template <typename T>
+  struct Hash<T *> {
+    [[nodiscard]]
+    auto operator()(T const *key) const -> uint64_t {
+      return Hash<uintptr_t>::mix(uintptr_t(key));
+    }
+  };
+} // namespace skjvm
+
+#endif /* skjvm_utility_hpp */
@@ -0,0 +1,82 @@
+#ifndef skjvm_verifier_hpp
+#define skjvm_verifier_hpp
+
+#include <skjvm/class_file.hpp>
+#include <skjvm/klass.hpp>
+#include <skjvm/memory.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  class ClassRegistry;
+
+  /// \brief Which classes \c VM::decoded verifies before their methods
+  /// first run, as \c -Xverify sets it.
+  enum class VerifyMode : uint8_t {
+    none,    ///< Trust all code.
+    remote,  ///< Trust the classes of the \c java/ packages only.
+    all,
+  };
+
+  [[nodiscard]]
+  auto describe(VerifyMode mode) -> char const *;
+
+  /// Whether \p mode has the methods of \p klass verified. The \c java/
+  /// packages hold the classes the VM builds itself and those of the
+  /// class library, which a JVM loads with its boot loader.
+  [[nodiscard]]
+  auto needs_verification(VerifyMode mode, Klass const &klass) -> bool;
+
+  /// \brief Type check the code of \p method, JVMS 4.10.1, returning
+  /// \c false with the reason in \p message if it is not type safe.
+  ///
+  /// \details The \c StackMapTable attribute gives the types of the locals
+  /// and the operand stack where control flow joins: at branch targets,
+  /// exception handlers and after unconditional jumps. With them, one
+  /// pass over the instructions in order checks each against the types
+  /// flowing in, and each jump against the frame of its target, without
+  /// iterating to a fixpoint. Class files older than version 50 have no
+  /// such frames; their types are inferred by data flow instead, JVMS
+  /// 4.10.2, which has to visit join points until nothing changes.
+  ///
+  /// Classes named in the code are linked to check assignments between
+  /// them, except when either is an interface, which JVMS treats as
+  /// \c java/lang/Object. A class that cannot be linked is assumed to be
+  /// assignable, as using it throws \c NoClassDefFoundError anyway.
+  /// Protected member access is not checked.
+  ///
+  /// The code must have been decoded, so its instructions, branch
+  /// targets and handler ranges are known to be well formed. The type
+  /// states, a frame per stack map entry and the current one, are built
+  /// in \p arena, which the caller resets afterwards.
+  [[nodiscard]]
+  auto verify_method(Method const &method, ClassRegistry &registry,
+                     Arena &arena, char *message, size_t message_size)
+    -> bool;
+
+  /// \brief Where \c infer_stack_map_table gets the \c CONSTANT_Class
+  /// of each class named in a frame.
+  using ClassConstantFunction = auto (*)(void *context, Utf8View name)
+    -> uint16_t;
+
+  /// \brief The \c StackMapTable entries for \p code, the code of a method
+  /// with \p access_flags, \p name and \p descriptor whose constants are
+  /// those of \p constants, appended to \p table in their compact forms.
+  /// Returns the number of entries, or -1 if the code does not type check
+  /// even by inference.
+  ///
+  /// \details This is what a compiler does for the verifier, and what
+  /// \c ClassWriter does for the code it assembles: the types are inferred
+  /// by data flow, and where two classes meet, their common type is taken
+  /// to be \c java/lang/Object, as no other classes are known.
+  [[nodiscard]]
+  auto infer_stack_map_table(ClassFile const &constants,
+                             uint16_t access_flags, Utf8View name,
+                             Utf8View descriptor, CodeView const &code,
+                             ClassConstantFunction class_constant,
+                             void *context, PodVector<uint8_t> &table)
+    -> int32_t;
+} // namespace skjvm
+
+#endif /* skjvm_verifier_hpp */
@@ -0,0 +1,455 @@
+#ifndef skjvm_vm_hpp
+#define skjvm_vm_hpp
+
+#include <skjvm/class_registry.hpp>
+#include <skjvm/compiler.hpp>
+#include <skjvm/heap.hpp>
+#include <skjvm/interpreter.hpp>
+#include <skjvm/klass.hpp>
+#include <skjvm/memory.hpp>
+#include <skjvm/monitor.hpp>
+#include <skjvm/object.hpp>
+#include <skjvm/symbol_table.hpp>
+#include <skjvm/verifier.hpp>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace skjvm {
+  class VM;
+
+  /// \brief A Java thread: its stack of \c Value slots, its frames, and the
+  /// exception being thrown, if any.
+  ///
+  /// \details A thread is known to its \c VM from its construction to its
+  /// destruction, so that the garbage collector finds the references in
+  /// its frames.
+  class Thread {
+    VM &vm;
+    Value *stack_base;
+    Value *stack_limit;
+    char const *native_stack_limit {nullptr};
+
+   public:
+    /// The exception being thrown, \c nullptr when there is none.
+    Object *exception {nullptr};
+
+    /// The innermost Java frame.
+    Frame *frame {nullptr};
+
+    /// Where the thread allocates objects, see \c Heap::allocate.
+    Tlab tlab {};
+
+    /// The slots of the live \c Handle s of the thread, innermost last.
+    PodVector<Object **> handles {};
+
+    /// Java calls currently active, to detect stack overflows.
+    uint32_t depth {0};
+
+    /// The number of the thread among those of its VM, from 1, which its
+    /// thin locks hold, and those header bits, for compiled code, see
+    /// \c Monitors. Set when the thread starts.
+    uint32_t id {0};
+    uint32_t thin_lock {0};
+
+    /// Instructions executed in \c DispatchMode::counting.
+    uint64_t executed {0};
+
+    /// Virtual and interface calls whose receiver class was the one cached
+    /// at the call site, and those that looked the method up, added to
+    /// \c VM::get_inline_cache_stats when the thread ends.
+    uint64_t inline_cache_hits {0};
+    uint64_t inline_cache_misses {0};
+
+    /// Maximum number of nested Java calls.
+    static constexpr uint32_t max_depth = 4096;
+
+    /// Default size of the \c Value stack, 8 MiB.
+    static constexpr size_t default_stack_slots = size_t(1) << 20;
+
+    /// Native stack kept free below the deepest Java call, for the natives
+    /// and the runtime functions it calls.
+    static constexpr size_t native_stack_reserve = size_t(64) << 10;
+
+    explicit Thread(VM &vm,
+                    size_t stack_slots = default_stack_slots) noexcept;
+    Thread(Thread const&) = delete;
+    auto operator=(Thread const&) -> Thread & = delete;
+    ~Thread() noexcept;
+
+    [[nodiscard]]
+    auto get_vm() const -> VM & {
+      return vm;
+    }
+
+    [[nodiscard]]
+    auto get_stack_base() const -> Value * {
+      return stack_base;
+    }
+
+    [[nodiscard]]
+    auto get_stack_limit() const -> Value * {
+      return stack_limit;
+    }
+
+    /// Where the limits are kept, for compiled code, which checks them
+    /// inline before a call.
+    [[nodiscard]]
+    auto get_stack_limit_address() const -> Value * const * {
+      return &stack_limit;
+    }
+
+    [[nodiscard]]
+    auto get_native_stack_limit_address() const -> char const * const * {
+      return &native_stack_limit;
+    }
+
+    /// Whether a Java call made from here would overflow the native stack.
+    [[nodiscard]]
+    __attribute__((always_inline))
+    auto is_native_stack_exhausted() const -> bool {
+      return static_cast<char const *>(__builtin_frame_address(0)) <
+             native_stack_limit;
+    }
+  };
+
+  /// \brief A reference held by native code across a call that may
+  /// collect garbage, which moves objects: the collector updates it.
+  ///
+  /// \details Handles are released in the reverse order they were made, as
+  /// their scopes end. A raw \c Object* is only valid until the next
+  /// allocation, call of Java code or exception thrown.
+  template <typename T>
+  class Handle {
+    Thread &thread;
+    Object *object;
+
+   public:
+    Handle(Thread &thread, T *object) noexcept
+      : thread(thread), object(reinterpret_cast<Object *>(object)) {
+      thread.handles.push(&this->object);
+    }
+    Handle(Handle const&) = delete;
+    auto operator=(Handle const&) -> Handle & = delete;
+    ~Handle() noexcept {
+      thread.handles.pop();
+    }
+
+    [[nodiscard]]
+    auto get() const -> T * {
+      return reinterpret_cast<T *>(object);
+    }
+
+    auto operator->() const -> T * {
+      return get();
+    }
+  };
+
+  /// \brief How well the inline caches of virtual and interface call sites
+  /// work, over the threads that ended.
+  struct InlineCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+
+    /// Call sites that saw more than one receiver class and stopped
+    /// caching.
+    uint64_t megamorphic_sites;
+  };
+
+  /// \brief The execution engine: the heap, class initialization, method
+  /// invocation and the services the interpreter and native methods need.
+  ///
+  /// \details Failures that Java code can observe are thrown as Java
+  /// exceptions: the function sets \c Thread::exception and returns
+  /// \c nullptr or \c false, and the caller propagates it.
+  ///
+  /// Any allocation may collect garbage, which moves objects: references
+  /// held in native code across one must be in a \c Handle, and stores of
+  /// references into objects go through \c store_reference.
+  class VM {
+    friend class Thread;
+
+    ClassRegistry &registry;
+    Heap heap;
+    DispatchMode mode {DispatchMode::threaded};
+
+    /// The threads the collector stops and scans, see \c collect.
+    pthread_mutex_t thread_mutex = PTHREAD_MUTEX_INITIALIZER;
+    PodVector<Thread *> threads {};
+    PodVector<Object **> roots {};
+    /// The interned strings, see \c SymbolTable::add_weak_roots.
+    PodVector<Object **> weak_roots {};
+    /// Ids of threads that ended, given to the next ones.
+    PodVector<uint32_t> free_thread_ids {};
+    uint32_t next_thread_id {1};
+
+    Monitors monitors {};
+
+    /// Decoded methods live as long as the VM, see \c decoded.
+    pthread_mutex_t code_mutex = PTHREAD_MUTEX_INITIALIZER;
+    Arena code_arena {};
+    VerifyMode verify_mode {VerifyMode::remote};
+    /// The type states of the method being verified, under \c code_mutex.
+    Arena verify_arena {};
+
+    Klass *string_class {nullptr};
+    uint32_t string_value_offset {0};
+    Klass *primitive_arrays[uint8_t(BasicType::void_)] {};
+
+    /// Allocated before anything else, since it cannot be allocated once
+    /// the heap is full.
+    Object *out_of_memory {nullptr};
+
+    InlineCacheStats inline_cache_stats {};
+
+    Compiler compiler {};
+
+    auto link_or_throw(Thread &thread, Utf8View name) -> Klass *;
+    auto call(Thread &thread, Method &method, Value *arguments) -> Value;
+    auto invoke_synchronized(Thread &thread, Method &method,
+                             Value *arguments) -> Value;
+    auto allocate(Thread &thread, Klass &klass, size_t size) -> Object *;
+    auto attach(Thread &thread) -> void;
+    auto detach(Thread &thread) -> void;
+    auto add_roots(Thread &thread) -> void;
+
+   public:
+    /// Default size of the Java heap.
+    static constexpr size_t default_heap_size = size_t(256) * 1024 * 1024;
+
+    /// A VM with a heap of \p heap_size bytes, \p young_size of which for
+    /// the young generation, see \c Heap.
+    explicit VM(ClassRegistry &registry,
+                size_t heap_size = default_heap_size,
+                size_t young_size = 0) noexcept;
+    VM(VM const&) = delete;
+    auto operator=(VM const&) -> VM & = delete;
+    ~VM() noexcept;
+
+    [[nodiscard]]
+    auto get_registry() -> ClassRegistry & {
+      return registry;
+    }
+
+    [[nodiscard]]
+    auto get_heap() -> Heap & {
+      return heap;
+    }
+
+    [[nodiscard]]
+    auto get_dispatch_mode() const -> DispatchMode {
+      return mode;
+    }
+
+    auto set_dispatch_mode(DispatchMode dispatch) -> void {
+      mode = dispatch;
+    }
+
+    [[nodiscard]]
+    auto get_verify_mode() const -> VerifyMode {
+      return verify_mode;
+    }
+
+    /// Set which classes have their methods verified before they first
+    /// run, see \c decoded.
+    auto set_verify_mode(VerifyMode verify) -> void {
+      verify_mode = verify;
+    }
+
+    [[nodiscard]]
+    auto get_inline_cache_stats() const -> InlineCacheStats;
+
+    /// The locks of the objects, see \c Monitors.
+    [[nodiscard]]
+    auto get_monitors() -> Monitors & {
+      return monitors;
+    }
+
+    /// The compiler of hot methods, enabled by default where it exists.
+    /// Its settings only take effect for methods run after they are set.
+    [[nodiscard]]
+    auto get_compiler() -> Compiler & {
+      return compiler;
+    }
+
+    /// Add the counters of a thread that ends, and \p megamorphic_sites
+    /// call sites that stopped caching.
+    auto add_inline_cache_stats(uint64_t hits, uint64_t misses,
+                                uint64_t megamorphic_sites) -> void;
+
+    /// Run the static initializer of \p klass and its super classes unless
+    /// done already.
+    [[nodiscard]]
+    auto initialize(Thread &thread, Klass &klass) -> bool;
+
+    /// Call \p method with \p arguments, the receiver first for instance
+    /// methods. \p arguments must be at the top of the thread stack, where
+    /// they become the first locals of an interpreted method. A
+    /// \c synchronized method holds the lock of its receiver, or of its
+    /// class if static, while it runs.
+    auto invoke(Thread &thread, Method &method, Value *arguments) -> Value;
+
+    /// Lock \p object, not \c null, for \p thread, waiting while another
+    /// thread holds it: \c monitorenter.
+    __attribute__((always_inline))
+    auto monitor_enter(Thread &thread, Object *object) -> void {
+      monitors.enter(thread.id, object);
+    }
+
+    /// Unlock \p object once: \c monitorexit. Throws
+    /// \c IllegalMonitorStateException if \p thread does not hold it.
+    [[nodiscard]]
+    __attribute__((always_inline))
+    auto monitor_exit(Thread &thread, Object *object) -> bool {
+      if (monitors.exit(thread.id, object)) { return true; }
+      throw_illegal_monitor_state(thread);
+      return false;
+    }
+
+    /// \c Object.wait(millis), see \c Monitors::wait.
+    [[nodiscard]]
+    auto monitor_wait(Thread &thread, Object *object, int64_t millis)
+      -> bool;
+
+    /// \c Object.notify() or, with \p all, \c Object.notifyAll().
+    [[nodiscard]]
+    auto monitor_notify(Thread &thread, Object *object, bool all) -> bool;
+
+    /// The object the \c static \c synchronized methods of \p klass lock,
+    /// made on first use as there are no \c Class objects.
+    [[nodiscard]]
+    auto class_lock(Thread &thread, Klass &klass) -> Object *;
+
+    /// Collect the young generation now, on \p thread, the others being
+    /// stopped: there are no other Java threads yet. With \p full, or if
+    /// the old generation may be too full for what the young generation
+    /// promotes, the whole heap is marked first, see
+    /// \c Heap::collect_full. Returns \c false if the young generation
+    /// could not be collected even then.
+    auto collect(Thread &thread, bool full = false) -> bool;
+
+    /// Store \p value in \p slot, a reference field or element of an
+    /// object, with the write barrier of the collector.
+    __attribute__((always_inline))
+    auto store_reference(Object **slot, Object *value) -> void {
+      *slot = value;
+      heap.mark_card(slot);
+    }
+
+    /// The implementation of \p method in the class of \p receiver.
+    [[nodiscard]]
+    auto find_virtual(Klass &receiver, Method &method) -> Method *;
+
+    /// The implementation of \p method, an interface method, in
+    /// \p receiver, from its itable. Returns \c nullptr if \p receiver does
+    /// not implement the interface or the method.
+    [[nodiscard]]
+    auto find_interface_method(Klass &receiver, Method &method) -> Method *;
+
+    /// The decoded code of \p method, decoding it on first use. Throws
+    /// \c VerifyError for malformed code, or for code that does not type
+    /// check if the verify mode covers its class, see \c verify_method.
+    /// Either way the method is checked once, and a failure is kept to be
+    /// thrown again on later calls.
+    [[nodiscard]]
+    auto decoded(Thread &thread, Method &method) -> DecodedMethod *;
+
+    [[nodiscard]]
+    auto new_object(Thread &thread, Klass &klass) -> Object *;
+
+    /// An array of \p array_class, such as the class named \c [I .
+    [[nodiscard]]
+    auto new_array(Thread &thread, Klass &array_class, int32_t length)
+      -> ArrayObject *;
+
+    /// The class of arrays of \p type, a primitive type.
+    [[nodiscard]]
+    auto primitive_array_class(Thread &thread, BasicType type) -> Klass *;
+
+    /// The class of arrays of \p component.
+    [[nodiscard]]
+    auto array_class(Thread &thread, Klass &component) -> Klass *;
+
+    /// A \c java/lang/String of \p length UTF-16 \p chars.
+    [[nodiscard]]
+    auto new_string(Thread &thread, uint16_t const *chars, uint32_t length)
+      -> Object *;
+
+    /// A \c java/lang/String of the UTF-8 \p text.
+    [[nodiscard]]
+    auto new_string(Thread &thread, char const *text) -> Object *;
+
+    /// The interned \c java/lang/String of \p symbol, kept in the symbol
+    /// table and created again if it was collected.
+    [[nodiscard]]
+    auto intern(Thread &thread, Symbol const *symbol) -> Object *;
+
+    /// The characters of \p string, a \c java/lang/String.
+    [[nodiscard]]
+    auto string_chars(Object *string) const -> ArrayObject *;
+
+    /// The detail message of \p throwable, a \c java/lang/String or
+    /// \c nullptr.
+    [[nodiscard]]
+    auto exception_message(Object *throwable) const -> Object *;
+
+    /// Throw a new exception of class \p class_name with the UTF-8
+    /// \p message, which may be \c nullptr.
+    auto throw_new(Thread &thread, char const *class_name,
+                   char const *message) -> void;
+
+    /// Throw the Java error for \p error, about \p name.
+    auto throw_link_error(Thread &thread, LinkError error, Utf8View name)
+      -> void;
+
+    /// Throw \c ArrayIndexOutOfBoundsException for \p index.
+    auto throw_index_out_of_bounds(Thread &thread, int32_t index,
+                                   int32_t length) -> void;
+
+    /// Throw \p class_name with the name of \p klass, dotted and followed
+    /// by \p suffix, as message.
+    auto throw_with_class(Thread &thread, char const *class_name,
+                          Klass const &klass, char const *suffix) -> void;
+
+    /// Throw \c IllegalMonitorStateException, for a thread that does not
+    /// hold the lock it releases, waits or notifies on.
+    auto throw_illegal_monitor_state(Thread &thread) -> void;
+
+    /// Throw \c ClassCastException for a cast of \p from to \p to.
+    auto throw_class_cast(Thread &thread, Klass const &from, Klass const &to)
+      -> void;
+
+    /// The class at \p index in the constants of \p klass, or \c nullptr
+    /// with the link error thrown.
+    [[nodiscard]]
+    auto resolve_class(Thread &thread, Klass &klass, uint16_t index)
+      -> Klass *;
+
+    /// The method at \p index in the constants of \p klass, or \c nullptr
+    /// with the link error thrown.
+    [[nodiscard]]
+    auto resolve_method(Thread &thread, Klass &klass, uint16_t index)
+      -> Method *;
+
+    /// The string loaded by \c ldc from \p index in the constants of
+    /// \p klass. Other constants throw \c UnsupportedOperationException.
+    [[nodiscard]]
+    auto load_constant(Thread &thread, Klass &klass, uint16_t index)
+      -> Object *;
+
+    /// Whether a value of class \p from can be assigned to \p to.
+    [[nodiscard]]
+    auto is_assignable(Klass const *from, Klass const *to) const -> bool;
+
+    /// Call \c main(String[]) of \p main_class with \p arguments, printing
+    /// an uncaught exception like the JDK. Returns the exit status.
+    auto run_main(Klass &main_class, int argument_count, char **arguments)
+      -> int;
+
+    /// Print \p throwable to \c stderr as the JDK does for uncaught ones.
+    auto print_exception(Object *throwable) const -> void;
+  };
+} // namespace skjvm
+
+#endif /* skjvm_vm_hpp */
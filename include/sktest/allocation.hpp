@@ -0,0 +1,163 @@
+#ifndef sktest_allocation_hpp
+#define sktest_allocation_hpp
+
+#include <sktest/assertion.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sktest {
+
+  /// \brief Running allocation counters of one thread.
+  ///
+  /// \details The counters only move when the allocation hooks are compiled
+  /// into the test binary, see \c USE_SKTEST_ALLOCATION_HOOKS in \c test.hpp.
+  /// Sizes are usable sizes as reported by the allocator, which may be a bit
+  /// larger than the requested ones.
+  struct AllocationCounters {
+    uint64_t allocation_count;
+    uint64_t free_count;
+    uint64_t allocated_bytes;
+    uint64_t live_bytes;
+    uint64_t peak_live_bytes;
+
+    /// While non-zero, allocations of this thread are not counted. SkTest
+    /// sets it around its own bookkeeping inside a test group.
+    uint32_t suspended;
+  };
+
+  /// Counters of the calling thread. The hooks run inside \c malloc, so the
+  /// variable is constant initialized and uses the initial-exec TLS model,
+  /// which never allocates on access.
+  extern constinit thread_local AllocationCounters allocation_counters
+    __attribute__((tls_model("initial-exec")));
+
+  /// Set by the hooks before \c main, so allocation assertions can tell
+  /// "no allocation" from "not tracked".
+  extern constinit bool allocation_hooks_installed;
+
+  inline auto record_allocation(size_t bytes) noexcept -> void {
+    auto &counters = allocation_counters;
+    if (counters.suspended != 0) { return; }
+    ++counters.allocation_count;
+    counters.allocated_bytes += bytes;
+    counters.live_bytes += bytes;
+    if (counters.live_bytes > counters.peak_live_bytes) {
+      counters.peak_live_bytes = counters.live_bytes;
+    }
+  }
+
+  inline auto record_free(size_t bytes) noexcept -> void {
+    auto &counters = allocation_counters;
+    if (counters.suspended != 0) { return; }
+    ++counters.free_count;
+    // Memory allocated on another thread, or before counting started, may
+    // be freed here; the live size saturates instead of wrapping around.
+    counters.live_bytes -= bytes < counters.live_bytes ? bytes
+                                                       : counters.live_bytes;
+  }
+
+  /// \brief Stop counting the allocations of this thread in a scope.
+  class AllocationSuspension {
+   public:
+    AllocationSuspension() noexcept {
+      ++allocation_counters.suspended;
+    }
+
+    ~AllocationSuspension() noexcept {
+      --allocation_counters.suspended;
+    }
+
+    AllocationSuspension(AllocationSuspension const &) = delete;
+    auto operator=(AllocationSuspension const &)
+      -> AllocationSuspension & = delete;
+  };
+
+  /// \brief Allocations of a test group, filled in by the runner.
+  struct AllocationSummary {
+    uint64_t allocation_count {0};
+    uint64_t allocated_bytes {0};
+
+    /// The highest live size during the group, above the live size when the
+    /// group started.
+    uint64_t peak_live_bytes {0};
+
+    /// Allocations not freed by the end of the group, as a count and a size.
+    uint64_t leaked_count {0};
+    uint64_t leaked_bytes {0};
+
+    [[nodiscard]]
+    auto has_leaks() const -> bool {
+      return leaked_count != 0 or leaked_bytes != 0;
+    }
+  };
+
+  /// \brief The scope of an \c assert_no_alloc or \c assert_max_alloc block.
+  ///
+  /// \details The block is the body of a one-shot \c for loop, and the
+  /// assertion is submitted by the destructor, so leaving the block early
+  /// with \c break or \c return still checks it. You should not use this class
+  /// directly.
+  class AllocationScope {
+   private:
+    AssertionRecord record;
+    uint64_t limit;
+    uint64_t start_count;
+    uint64_t start_bytes;
+    bool entered {false};
+
+   public:
+    AllocationScope(AssertionRecord const &record, uint64_t limit) noexcept
+      : record(record), limit(limit),
+        start_count(allocation_counters.allocation_count),
+        start_bytes(allocation_counters.allocated_bytes) {}
+
+    ~AllocationScope() noexcept;
+
+    AllocationScope(AllocationScope const &) = delete;
+    auto operator=(AllocationScope const &) -> AllocationScope & = delete;
+
+    /// \c true the first time only, so the block runs exactly once.
+    auto enter() noexcept -> bool {
+      return not entered and (entered = true);
+    }
+  };
+} // namespace sktest
+
+#define sktest_allocation_block(kind, limit, source)                           \
+  for (sktest::AllocationScope sktest_allocation_scope (                       \
+         sktest::AssertionRecord {                                             \
+           __FILE__, "", source, nullptr, __LINE__, kind },                    \
+         limit);                                                               \
+       sktest_allocation_scope.enter();)
+
+/// \brief Creates an assertion that the block does not allocate.
+///
+/// \details Every allocation of the calling thread is counted, whether it
+/// comes from \c new or from \c malloc. The allocation hooks must be compiled
+/// into the test binary, otherwise the assertion fails.
+///
+/// \code
+/// test_group ("the fast path does not allocate") {
+///     assert_no_alloc {
+///         table.lookup(key);
+///     }
+/// }
+/// \endcode
+#define assert_no_alloc                                                        \
+  sktest_allocation_block(sktest::AssertionKind::no_alloc, 0, "")
+
+/// \brief Creates an assertion that the block allocates at most \p bytes.
+///
+/// \code
+/// test_group ("growing by one element allocates once") {
+///     assert_max_alloc(256) {
+///         vector.push_back(1);
+///     }
+/// }
+/// \endcode
+#define assert_max_alloc(bytes)                                                \
+  sktest_allocation_block(                                                     \
+    sktest::AssertionKind::max_alloc, uint64_t(bytes), #bytes)
+
+#endif /* sktest_allocation_hpp */
@@ -0,0 +1,148 @@
+#ifndef sktest_allocation_hooks_hpp
+#define sktest_allocation_hooks_hpp
+
+// Replacement allocation functions that feed `sktest::allocation_counters`.
+// This header defines global functions, so it is only included by
+// <sktest/test.hpp>, and only when `USE_SKTEST_ALLOCATION_HOOKS` is defined
+// next to `USE_SKTEST_DEFAULT_MAIN_FUNCTION`.
+//
+// With glibc, the malloc family is interposed, which also covers the default
+// `operator new`, C libraries and the STL. Elsewhere, only the replaceable
+// `operator new` and `operator delete` are counted, and since the allocator
+// does not tell the size of a block being freed, live and leaked bytes are
+// only tracked for sized deallocation.
+
+#include <sktest/allocation.hpp>
+
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+
+extern "C" {
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t count, size_t size);
+  void *__libc_realloc(void *pointer, size_t size);
+  void *__libc_memalign(size_t alignment, size_t size);
+  void __libc_free(void *pointer);
+
+  void *malloc(size_t size) noexcept {
+    void *pointer = __libc_malloc(size);
+    if (pointer != nullptr) {
+      sktest::record_allocation(malloc_usable_size(pointer));
+    }
+    return pointer;
+  }
+
+  void *calloc(size_t count, size_t size) noexcept {
+    void *pointer = __libc_calloc(count, size);
+    if (pointer != nullptr) {
+      sktest::record_allocation(malloc_usable_size(pointer));
+    }
+    return pointer;
+  }
+
+  void *realloc(void *pointer, size_t size) noexcept {
+    size_t old_size = pointer == nullptr ? 0 : malloc_usable_size(pointer);
+    void *resized = __libc_realloc(pointer, size);
+    if (resized != nullptr) {
+      if (pointer != nullptr) {
+        sktest::record_free(old_size);
+      }
+      sktest::record_allocation(malloc_usable_size(resized));
+    } else if (pointer != nullptr and size == 0) {
+      sktest::record_free(old_size);
+    }
+    return resized;
+  }
+
+  void *memalign(size_t alignment, size_t size) noexcept {
+    void *pointer = __libc_memalign(alignment, size);
+    if (pointer != nullptr) {
+      sktest::record_allocation(malloc_usable_size(pointer));
+    }
+    return pointer;
+  }
+
+  void *aligned_alloc(size_t alignment, size_t size) noexcept {
+    return memalign(alignment, size);
+  }
+
+  int posix_memalign(void **result, size_t alignment, size_t size) noexcept {
+    if (alignment % sizeof(void *) != 0 or
+        (alignment & (alignment - 1)) != 0) {
+      return EINVAL;
+    }
+    void *pointer = memalign(alignment, size);
+    if (pointer == nullptr) {
+      return ENOMEM;
+    }
+    *result = pointer;
+    return 0;
+  }
+
+  void free(void *pointer) noexcept {
+    if (pointer != nullptr) {
+      sktest::record_free(malloc_usable_size(pointer));
+    }
+    __libc_free(pointer);
+  }
+}
+#else
+auto operator new(size_t size) -> void * {
+  void *pointer = malloc(size == 0 ? 1 : size);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  sktest::record_allocation(size);
+  return pointer;
+}
+
+auto operator new[](size_t size) -> void * {
+  return operator new(size);
+}
+
+auto operator new(size_t size, std::nothrow_t const &) noexcept -> void * {
+  void *pointer = malloc(size == 0 ? 1 : size);
+  if (pointer != nullptr) {
+    sktest::record_allocation(size);
+  }
+  return pointer;
+}
+
+auto operator new[](size_t size, std::nothrow_t const &tag) noexcept
+    -> void * {
+  return operator new(size, tag);
+}
+
+auto operator delete(void *pointer) noexcept -> void {
+  if (pointer != nullptr) {
+    sktest::record_free(0);
+  }
+  free(pointer);
+}
+
+auto operator delete[](void *pointer) noexcept -> void {
+  operator delete(pointer);
+}
+
+auto operator delete(void *pointer, size_t size) noexcept -> void {
+  if (pointer != nullptr) {
+    sktest::record_free(size);
+  }
+  free(pointer);
+}
+
+auto operator delete[](void *pointer, size_t size) noexcept -> void {
+  operator delete(pointer, size);
+}
+#endif
+
+namespace {
+  [[maybe_unused]] bool const sktest_allocation_hooks_installer =
+    (sktest::allocation_hooks_installed = true);
+} // namespace
+
+#endif /* sktest_allocation_hooks_hpp */
@@ -5,137 +5,62 @@
 #include <sktest/ansi_color.hpp>
 #include <sktest/source_info.hpp>
 
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
 
 namespace sktest {
-  class TestGroup;
-
-  class Assertion {
-   protected:
-    bool passed;
-    char const *description;
-    const SourceInfo info;
-    const TestGroup &test_group;
-
-   public:
-    Assertion(bool passed, char const *description,
-              char const *file_name, size_t line_number)
-      : passed(passed), description(description),
-        info(file_name, line_number),
-        test_group(RegistrationCenter::get_current_test_group()) {}
-
-    virtual ~Assertion() = default;
-
-    virtual auto print_report_if_failed() const -> void {} // = 0;
-
-    auto submit_to_registration_center() -> Assertion &;
-
-    [[nodiscard]]
-    auto has_passed() const -> bool {
-      return passed;
-    }
-
-    [[nodiscard]]
-    auto get_test_group() const -> const TestGroup & {
-      return test_group;
-    }
-
-    [[nodiscard]]
-    auto get_description() const -> char const * {
-      return description;
-    }
-
-    [[nodiscard]]
-    auto get_file() const -> char const * {
-      return info.get_file();
-    }
-
-    [[nodiscard]]
-    auto get_line() const -> size_t {
-      return info.get_line();
-    }
-  };
-
-  class BooleanAssertion : public Assertion {
-   protected:
-    const char *condition;
-   public:
-    BooleanAssertion(bool passed, const char *condition,
-                    const char *description,
-                    const char *file_name, size_t line_number)
-      : Assertion(passed, description, file_name, line_number),
-        condition(condition) {}
-
-    [[nodiscard]]
-    auto get_condition() const -> const char * {
-      return condition;
-    }
-  };
-
-  class IsTrueAssertion : public BooleanAssertion {
-   public:
-    using BooleanAssertion::BooleanAssertion;
-
-    auto print_report_if_failed() const -> void override;
+  enum class AssertionKind : uint8_t {
+    is_true,
+    is_false,
+    are_equal,
+    are_not_equal,
+    no_alloc,
+    max_alloc,
   };
 
-  class IsFalseAssertion : public BooleanAssertion {
-   public:
-    using BooleanAssertion::BooleanAssertion;
+  /// \brief Compact record of an assertion, kept only when it fails.
+  ///
+  /// \details All strings are string literals produced by the assertion
+  /// macros, so a record is plain data and can be stored, copied, and printed
+  /// after the test group has returned. Passed assertions are never recorded,
+  /// they only bump the counters of their test group.
+  struct AssertionRecord {
+    char const *file_name;
+    char const *description;
 
-    auto print_report_if_failed() const -> void override;
-  };
+    /// Source text of the condition for boolean assertions, of the left
+    /// operand for equivalence assertions, or of the limit for
+    /// \c assert_max_alloc.
+    char const *left;
 
-  class EquivalenceAssertion : public Assertion {
-   protected:
-    const char *left;
-    const char *right;
-   public:
-    EquivalenceAssertion(bool passed, const char *left, const char *right,
-                         const char *description,
-                         const char *file_name, size_t line_number)
-      : Assertion(passed, description, file_name, line_number),
-        left(left), right(right) {}
-
-    [[nodiscard]]
-    auto get_left() const -> const char * {
-      return left;
-    }
-
-    [[nodiscard]]
-    auto get_right() const -> const char * {
-      return right;
-    }
-  };
+    /// Source text of the right operand, \c nullptr for boolean assertions.
+    char const *right;
 
-  class AreEqualAssertion : public EquivalenceAssertion {
-   public:
-    using EquivalenceAssertion::EquivalenceAssertion;
+    uint32_t line_number;
+    AssertionKind kind;
 
-    auto print_report_if_failed() const -> void override;
+    /// What an allocation block actually allocated, zero for other kinds.
+    uint64_t allocation_count {0};
+    uint64_t allocated_bytes {0};
   };
 
-  class AreNotEqualAssertion : public EquivalenceAssertion {
-   public:
-    using EquivalenceAssertion::EquivalenceAssertion;
-
-    auto print_report_if_failed() const -> void override;
-  };
+  /// Count \p passed in the current test group of the calling thread, and
+  /// keep \p record if the assertion failed. Defined in \c test_group.hpp,
+  /// because it needs the complete \c TestGroup.
+  inline auto submit_assertion(bool passed, AssertionRecord const &record)
+    -> void;
 
 } // namespace sktest
 
 #define sktest_overload_boolean_assert(_1, _2, _3, name, ...) name
 
 #define sktest_boolean_assert_with_description(kind, condition, description)   \
-  kind((condition), #condition, description, __FILE__, __LINE__)               \
-    .submit_to_registration_center()                                           \
-    .print_report_if_failed();
+  sktest::submit_assertion(bool(condition), sktest::AssertionRecord {          \
+    __FILE__, description, #condition, nullptr, __LINE__, kind })
 
 #define sktest_boolean_assert_without_description(kind, condition)             \
-  kind((condition), #condition, /*description=*/"", __FILE__, __LINE__)        \
-    .submit_to_registration_center()                                           \
-    .print_report_if_failed()
+  sktest_boolean_assert_with_description(kind, condition, /*description=*/"")
 
 #define sktest_boolean_assert(...)                                             \
   sktest_overload_boolean_assert(                                              \
@@ -154,7 +79,7 @@ namespace sktest {
 /// }
 /// \endcode
 #define assert_true(...)                                                       \
-  sktest_boolean_assert(sktest::IsTrueAssertion, __VA_ARGS__)
+  sktest_boolean_assert(sktest::AssertionKind::is_true, __VA_ARGS__)
 
 /// \brief Creates an assertion that the expression is false.
 ///
@@ -167,19 +92,16 @@ namespace sktest {
 /// }
 /// \endcode
 #define assert_false(...)                                                      \
-  sktest_boolean_assert(sktest::IsFalseAssertion, __VA_ARGS__)
+  sktest_boolean_assert(sktest::AssertionKind::is_false, __VA_ARGS__)
 
 #define sktest_overload_equivalence_assert(_1, _2, _3, _4, _5, name, ...) name
 
 #define sktest_equal_assert_with_description(kind, op, left, right, desc)      \
-  kind((left) op (right), #left, #right, desc, __FILE__, __LINE__)             \
-    .submit_to_registration_center()                                           \
-    .print_report_if_failed();
+  sktest::submit_assertion(bool((left) op (right)), sktest::AssertionRecord {  \
+    __FILE__, desc, #left, #right, __LINE__, kind })
 
 #define sktest_equal_assert_without_description(kind, op, left, right)         \
-  kind((left) op (right), #left, #right, "", __FILE__, __LINE__)               \
-    .submit_to_registration_center()                                           \
-    .print_report_if_failed()
+  sktest_equal_assert_with_description(kind, op, left, right, "")
 
 #define sktest_equal_assert(...)                                               \
   sktest_overload_equivalence_assert(                                          \
@@ -199,7 +121,7 @@ namespace sktest {
 /// }
 /// \endcode
 #define assert_equal(...)                                                      \
-  sktest_equal_assert(sktest::AreEqualAssertion, ==, __VA_ARGS__)
+  sktest_equal_assert(sktest::AssertionKind::are_equal, ==, __VA_ARGS__)
 
 /// \brief Creates an assertion that two expressions are not equal.
 ///
@@ -212,6 +134,6 @@ namespace sktest {
 /// }
 /// \endcode
 #define assert_not_equal(...)                                                  \
-  sktest_equal_assert(sktest::AreNotEqualAssertion, !=, __VA_ARGS__)
+  sktest_equal_assert(sktest::AssertionKind::are_not_equal, !=, __VA_ARGS__)
 
 #endif /* sktest_assertion_hpp */
\ No newline at end of file
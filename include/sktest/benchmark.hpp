@@ -0,0 +1,166 @@
+#ifndef sktest_benchmark_hpp
+#define sktest_benchmark_hpp
+
+#include <sktest/registration.hpp>
+#include <sktest/source_info.hpp>
+#include <sktest/perf_counters.hpp>
+#include <sktest/test_group.hpp>
+
+#include <cstddef>
+
+namespace sktest {
+
+  /// \brief A micro-benchmark registered by the \c bench_group macro.
+  ///
+  /// \details The body of a \c bench_group is one iteration of the benchmark.
+  /// The macro wraps it in a loop function, so the runner can execute any
+  /// number of iterations per sample without paying for an indirect call on
+  /// each one. Like \c TestGroup, benchmarks are constant initialized statics
+  /// linked into an intrusive list. You should not use this struct directly.
+  struct Benchmark {
+   private:
+    char const *description;
+    SourceInfo info;
+    void(*loop_function)(size_t iterations);
+
+    Benchmark *next {nullptr};
+
+    static constinit inline Benchmark *registered {nullptr};
+
+    friend class BenchmarkRegistrar;
+
+   public:
+    constexpr Benchmark(char const *description, void(*loop_function)(size_t),
+                        char const *file_name, size_t line_number) noexcept
+      : description(description), info(file_name, line_number),
+        loop_function(loop_function) {}
+
+    [[nodiscard]]
+    static auto first_registered() -> Benchmark * {
+      return registered;
+    }
+
+    [[nodiscard]]
+    auto next_registered() const -> Benchmark * {
+      return next;
+    }
+
+    [[nodiscard]]
+    auto get_description() const -> char const * {
+      return description;
+    }
+
+    [[nodiscard]]
+    auto get_file() const -> char const * {
+      return info.get_file();
+    }
+
+    [[nodiscard]]
+    auto get_line() const -> size_t {
+      return info.get_line();
+    }
+
+    auto run(size_t iterations) const -> void {
+      loop_function(iterations);
+    }
+  };
+
+  /// \brief Statistics of one benchmark, per iteration, in nanoseconds.
+  struct BenchmarkResult {
+    size_t iterations_per_sample {0};
+    size_t sample_count {0};
+    double min {0};
+    double median {0};
+    double p99 {0};
+    double mean {0};
+    double stddev {0};
+
+    /// Hardware events counted over all samples with \c --perf, not divided
+    /// by the number of iterations.
+    PerfCounts perf {};
+  };
+
+  /// \brief Warm up and calibrate \p benchmark, then time its samples.
+  ///
+  /// \details Calibration doubles the iteration count until a run is long
+  /// enough to time, but gives up after a second or 2^40 iterations, so a
+  /// body the compiler removed still finishes. With \p count_perf, hardware
+  /// events are counted over all samples.
+  auto measure(Benchmark const &benchmark, bool count_perf)
+      -> BenchmarkResult;
+
+  /// \brief Link a benchmark into the registration list while initializing.
+  class BenchmarkRegistrar {
+   public:
+    explicit BenchmarkRegistrar(Benchmark &benchmark) noexcept {
+      benchmark.next = Benchmark::registered;
+      Benchmark::registered = &benchmark;
+    }
+    ~BenchmarkRegistrar() noexcept = default;
+  };
+
+  /// \brief Prevent the compiler from optimizing away the computation of
+  /// \p value.
+  ///
+  /// \details The value is passed to an empty \c asm statement that claims to
+  /// read it, so it must be materialized, but no instruction is emitted.
+  template <typename T>
+  inline auto do_not_optimize(T const &value) -> void {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile T const *sink;
+    sink = &value;
+#endif
+  }
+
+  /// \brief Force all pending writes to memory, so stores made by the
+  /// benchmark body cannot be elided or sunk out of the loop.
+  inline auto clobber_memory() -> void {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : : "memory");
+#endif
+  }
+} // namespace sktest
+
+#define sktest_bench_group_impl(description, line, file)                       \
+  static void sktest_name_mangling(sktest_bench_, line)();                     \
+  static void sktest_name_mangling(sktest_bench_loop_, line)(size_t count) {   \
+    for (size_t i = 0; i < count; ++i) {                                       \
+      sktest_name_mangling(sktest_bench_, line)();                             \
+    }                                                                          \
+  }                                                                            \
+  namespace {                                                                  \
+    constinit sktest::Benchmark sktest_name_mangling(sktest_bench_group_, line)(\
+      description,                                                             \
+      &sktest_name_mangling(sktest_bench_loop_, line),                         \
+      file,                                                                    \
+      size_t(line)                                                             \
+    );                                                                         \
+    sktest::BenchmarkRegistrar                                                 \
+    sktest_name_mangling(sktest_bench_registrar, line) (                       \
+      sktest_name_mangling(sktest_bench_group_, line)                          \
+    );                                                                         \
+  }                                                                            \
+  static void sktest_name_mangling(sktest_bench_, line)()
+
+/// \brief Define a micro-benchmark with the given description.
+///
+/// \details The body is one iteration. Benchmarks only run when the test
+/// binary is started with \c --bench, and then test groups are skipped. Each
+/// benchmark is warmed up, calibrated so one sample takes about 2ms, and
+/// measured over 100 samples with a monotonic clock.
+///
+/// \code
+/// bench_group ("strlen of a short string") {
+///     sktest::do_not_optimize(strlen("hello, world"));
+/// }
+/// \endcode
+///
+/// Use \c sktest::do_not_optimize to keep results alive, and
+/// \c sktest::clobber_memory to keep stores to memory. Like \c test_group,
+/// leave a space before the parentheses.
+#define bench_group(description)                                               \
+  sktest_bench_group_impl(description, __LINE__, __FILE__)
+
+#endif /* sktest_benchmark_hpp */
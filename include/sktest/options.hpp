@@ -0,0 +1,91 @@
+#ifndef sktest_options_hpp
+#define sktest_options_hpp
+
+#include <cstddef>
+#include <vector>
+
+namespace sktest {
+
+  /// \brief Command line options accepted by the SkTest default main function.
+  ///
+  /// \details Options are parsed by \c Options::parse, and both the
+  /// \c --name=value and the \c --name value forms are accepted.
+  ///
+  /// \code
+  /// --jobs N, -j N    run test groups on N worker threads (0 means one worker
+  ///                   per hardware thread, default is 1)
+  /// --filter=GLOB     run only test groups whose description matches the
+  ///                   shell pattern GLOB; may be repeated
+  /// --file=PATH       run only test groups defined in PATH, which is either
+  ///                   a suffix of the source path or a shell pattern; may be
+  ///                   repeated
+  /// --list            print the selected test groups instead of running them
+  /// --shard=I/N       run only the I-th of N shards (0 <= I < N) of the
+  ///                   sorted, selected test groups
+  /// --isolate[=K]     run every batch of K test groups (default 1) in a
+  ///                   forked child process, up to --jobs children at a time
+  /// --timeout=MS      kill a test group that runs longer than MS
+  ///                   milliseconds and mark it as failed; implies
+  ///                   --isolate=K with one batch per job unless --isolate
+  ///                   is given
+  /// --slowest=N       list the N slowest test groups after the statistics
+  /// --failed-first    run the test groups that failed last time first
+  /// --only-failed     run only the test groups that failed last time, or
+  ///                   all selected groups if none did
+  /// --incremental     reuse the passing results of test groups whose source
+  ///                   file and test binary have not changed since they
+  ///                   last ran
+  /// --state=FILE      keep the results of previous runs in FILE instead of
+  ///                   <binary>.sktest-state, see sktest::StateFile
+  /// --reporter=NAME   report in the console (default), junit or jsonl
+  ///                   format, see sktest::Reporter
+  /// --output=FILE, -o FILE
+  ///                   write the report to FILE instead of stdout
+  /// --perf            count cycles, instructions, cache misses and branch
+  ///                   misses around each test group and benchmark (Linux)
+  /// --bench           run the benchmarks instead of the test groups
+  /// --baseline=FILE   compare benchmarks against a run saved in FILE
+  /// --save-baseline=FILE
+  ///                   save the benchmark results to FILE as JSON
+  /// --threshold=P     report benchmarks whose median moved by more than P
+  ///                   percent from the baseline (default 10)
+  /// --help, -h        print usage and exit
+  /// \endcode
+  struct Options {
+    size_t jobs {1};
+    std::vector<char const *> filters {};
+    std::vector<char const *> files {};
+    bool list {false};
+    size_t shard_index {0};
+    size_t shard_count {1};
+    size_t isolate_batch_size {0}; // 0 means not isolated
+    size_t timeout_ms {0};         // 0 means no timeout
+    size_t slowest_count {0};
+    bool failed_first {false};
+    bool only_failed {false};
+    bool incremental {false};
+    char const *state_path {nullptr};
+    char const *reporter {"console"};
+    char const *output_path {nullptr};
+    bool perf {false};
+    bool bench {false};
+    char const *baseline_path {nullptr};
+    char const *save_baseline_path {nullptr};
+    double regression_threshold {0.10};
+    bool help {false};
+
+    /// Parse \c argv into \p options. Unknown options and malformed values
+    /// are reported on \c stderr, and \c false is returned.
+    static auto parse(int argc, char **argv, Options &options) -> bool;
+
+    static auto print_usage(char const *program) -> void;
+
+    /// Whether a test group or benchmark with \p description, defined in
+    /// \p file, passes every \c --filter and \c --file given.
+    [[nodiscard]]
+    auto selects(char const *description, char const *file) const -> bool;
+  };
+
+} // namespace sktest
+
+#endif /* sktest_options_hpp */
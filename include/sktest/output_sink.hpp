@@ -0,0 +1,75 @@
+#ifndef sktest_output_sink_hpp
+#define sktest_output_sink_hpp
+
+#include <sktest/utilities.hpp>
+
+#include <cstddef>
+#include <mutex>
+
+namespace sktest {
+
+  /// \brief A large write buffer in front of a file descriptor, shared by
+  /// everything a reporter prints.
+  ///
+  /// \details Reports are formatted straight into the buffer, and the buffer
+  /// only reaches the file descriptor when it is full or flushed, so a run
+  /// with many failures costs a handful of \c write calls instead of one
+  /// \c printf per line.
+  ///
+  /// The colors of \c ansi_color.hpp are string literals pasted into the
+  /// format strings, so when color is turned off, ANSI escape sequences are
+  /// dropped on their way into the buffer instead.
+  ///
+  /// The sink is \c BasicLockable. Reporters hold the lock while they write
+  /// one event, so events of test groups running on different workers do not
+  /// interleave.
+  class OutputSink : private NonCopyable {
+   public:
+    static constexpr size_t buffer_capacity = size_t(64) * 1024;
+
+   private:
+    int fd;
+    bool owns_fd;
+    bool color;
+    size_t used {0};
+    std::mutex mutex {};
+    char buffer[buffer_capacity];
+
+    auto append(char const *data, size_t size) -> void;
+
+   public:
+    /// Write to \p fd, closing it on destruction if \p owns_fd is set. Color
+    /// is on if and only if \p fd is a terminal.
+    OutputSink(int fd, bool owns_fd) noexcept;
+    ~OutputSink() noexcept override;
+
+    [[nodiscard]]
+    auto has_color() const -> bool {
+      return color;
+    }
+
+    auto set_color(bool enabled) -> void {
+      color = enabled;
+    }
+
+    auto write(char const *data, size_t size) -> void;
+    auto write(char const *string) -> void;
+
+    /// Format like \c printf into the buffer.
+    __attribute__((format(printf, 2, 3)))
+    auto format(char const *format, ...) -> void;
+
+    /// Hand everything buffered to the file descriptor.
+    auto flush() -> void;
+
+    auto lock() -> void {
+      mutex.lock();
+    }
+
+    auto unlock() -> void {
+      mutex.unlock();
+    }
+  };
+} // namespace sktest
+
+#endif /* sktest_output_sink_hpp */
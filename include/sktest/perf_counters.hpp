@@ -0,0 +1,100 @@
+#ifndef sktest_perf_counters_hpp
+#define sktest_perf_counters_hpp
+
+#include <sktest/utilities.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace sktest {
+
+  /// \brief Hardware events counted around a test group or a benchmark.
+  enum class PerfEvent : uint8_t {
+    cycles,
+    instructions,
+    cache_misses,
+    branch_misses,
+    /// The totals the misses are rates of.
+    cache_references,
+    branches,
+  };
+
+  constexpr size_t perf_event_count = 6;
+
+  /// \brief Values of the hardware counters, one slot per \c PerfEvent.
+  ///
+  /// \details A slot is only meaningful if its bit is set in \c valid_mask,
+  /// since some events may be missing on a given CPU or virtual machine.
+  struct PerfCounts {
+    uint64_t values[perf_event_count] {};
+    uint8_t valid_mask {0};
+
+    [[nodiscard]]
+    auto has(PerfEvent event) const -> bool {
+      return (valid_mask & (1U << unsigned(event))) != 0;
+    }
+
+    [[nodiscard]]
+    auto get(PerfEvent event) const -> uint64_t {
+      return values[size_t(event)];
+    }
+
+    /// Instructions per cycle, or 0 if either counter is missing.
+    [[nodiscard]]
+    auto ipc() const -> double {
+      if (not has(PerfEvent::cycles) or not has(PerfEvent::instructions) or
+          get(PerfEvent::cycles) == 0) {
+        return 0;
+      }
+      return double(get(PerfEvent::instructions))
+           / double(get(PerfEvent::cycles));
+    }
+
+    /// \p part per \p whole, such as cache misses per cache reference, or
+    /// -1 if either counter is missing or \p whole is 0.
+    [[nodiscard]]
+    auto rate(PerfEvent part, PerfEvent whole) const -> double {
+      if (not has(part) or not has(whole) or get(whole) == 0) {
+        return -1;
+      }
+      return double(get(part)) / double(get(whole));
+    }
+  };
+
+  /// Write \p rate, from \c PerfCounts::rate, as a percentage in
+  /// \p buffer, or "n/a" if it is missing. Returns \p buffer.
+  auto format_rate(char *buffer, size_t size, double rate) -> char const *;
+
+  /// \brief Hardware performance counters of the calling thread.
+  ///
+  /// \details On Linux, each event is opened with \c perf_event_open for the
+  /// calling thread, user space only, so the default
+  /// \c kernel.perf_event_paranoid setting is enough. Events that cannot be
+  /// opened are skipped. On other systems, or when no event can be opened,
+  /// \c is_available returns \c false and \c stop returns empty counts.
+  class PerfCounters : private NonCopyable {
+   private:
+    int fds[perf_event_count] {-1, -1, -1, -1, -1, -1};
+    bool available {false};
+
+   public:
+    PerfCounters() noexcept;
+    ~PerfCounters() noexcept override;
+
+    [[nodiscard]]
+    auto is_available() const -> bool {
+      return available;
+    }
+
+    /// Reset and enable the counters.
+    auto start() noexcept -> void;
+
+    /// Disable the counters and read them.
+    auto stop() noexcept -> PerfCounts;
+
+    /// The counters of the calling thread, opened on first use.
+    static auto for_this_thread() -> PerfCounters &;
+  };
+} // namespace sktest
+
+#endif /* sktest_perf_counters_hpp */
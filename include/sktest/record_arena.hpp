@@ -0,0 +1,112 @@
+#ifndef sktest_record_arena_hpp
+#define sktest_record_arena_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <type_traits>
+#include <utility>
+
+namespace sktest {
+
+  /// \brief Append-only storage for trivially copyable records.
+  ///
+  /// \details Records live in fixed-size blocks that are chained together, so
+  /// appending never moves the records already stored and never allocates
+  /// until the first record arrives. A test group that has no failures owns no
+  /// memory at all.
+  template <typename Record, size_t block_capacity = 32>
+  class RecordArena {
+    static_assert(std::is_trivially_copyable_v<Record>,
+                  "records are copied into the arena byte by byte");
+
+   private:
+    struct Block {
+      Block *next;
+      size_t size;
+      Record records[block_capacity];
+    };
+
+    Block *head {nullptr};
+    Block *tail {nullptr};
+    size_t count {0};
+
+    auto release() noexcept -> void {
+      while (head != nullptr) {
+        Block *next = head->next;
+        free(head);
+        head = next;
+      }
+      tail = nullptr;
+      count = 0;
+    }
+
+   public:
+    RecordArena() noexcept = default;
+
+    RecordArena(RecordArena const &) = delete;
+    auto operator=(RecordArena const &) -> RecordArena & = delete;
+
+    RecordArena(RecordArena &&other) noexcept
+      : head(std::exchange(other.head, nullptr)),
+        tail(std::exchange(other.tail, nullptr)),
+        count(std::exchange(other.count, 0)) {}
+
+    auto operator=(RecordArena &&other) noexcept -> RecordArena & {
+      if (this != &other) {
+        release();
+        head = std::exchange(other.head, nullptr);
+        tail = std::exchange(other.tail, nullptr);
+        count = std::exchange(other.count, 0);
+      }
+      return *this;
+    }
+
+    ~RecordArena() noexcept {
+      release();
+    }
+
+    auto push(Record const &record) -> void {
+      if (tail == nullptr or tail->size == block_capacity) {
+        auto *block = static_cast<Block *>(malloc(sizeof(Block)));
+        if (block == nullptr) {
+          abort();
+        }
+        block->next = nullptr;
+        block->size = 0;
+
+        if (tail == nullptr) {
+          head = block;
+        } else {
+          tail->next = block;
+        }
+        tail = block;
+      }
+
+      tail->records[tail->size++] = record;
+      ++count;
+    }
+
+    [[nodiscard]]
+    auto size() const -> size_t {
+      return count;
+    }
+
+    [[nodiscard]]
+    auto empty() const -> bool {
+      return count == 0;
+    }
+
+    /// Call \p visit on every record, in insertion order.
+    template <typename Visitor>
+    auto for_each(Visitor &&visit) const -> void {
+      for (Block const *block = head; block != nullptr; block = block->next) {
+        for (size_t i = 0; i < block->size; ++i) {
+          visit(block->records[i]);
+        }
+      }
+    }
+  };
+} // namespace sktest
+
+#endif /* sktest_record_arena_hpp */
@@ -3,24 +3,62 @@
 
 #include <sktest/utilities.hpp>
 #include <sktest/ansi_color.hpp>
+#include <sktest/options.hpp>
 
 #include <cstddef>
 #include <cstdio>
 #include <cassert>
+#include <deque>
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace sktest {
   class TestGroup;
+  struct GroupResult;
+  struct AssertionRecord;
+  struct Benchmark;
+  class OutputSink;
+  class Reporter;
+  class StateFile;
 
   /// \brief Registration center of all test groups.
   ///
-  /// This is a singleton class that is used to register all test groups. It
-  /// will be initialized by the main function (provide by SkTest)
-  /// automatically.
+  /// This is a singleton class that runs the registered test groups. Test
+  /// groups do not register here: each one links itself into a static list
+  /// (see \c Registrar), and the center is only created by the main function
+  /// (provide by SkTest), which collects the list on demand.
   class RegistrationCenter : private NonCopyable {
    private:
-    std::vector<TestGroup> test_groups {};
-    size_t current_test_group {0};
+    /// The registered test groups in registration order, collected from the
+    /// static list when the tests are invoked.
+    std::vector<TestGroup *> test_groups {};
+    bool invoked {false};
+
+    /// Indices into \c test_groups of the groups selected for this run (by
+    /// \c --filter, \c --file and \c --shard), sorted by file and line.
+    std::vector<size_t> selection {};
+
+    /// Results of the selected test groups, parallel to \c selection.
+    std::vector<GroupResult> results {};
+
+    /// Selected test groups whose results are reused by \c --incremental
+    /// instead of being invoked, with those results.
+    std::vector<size_t> cached_selection {};
+    std::vector<GroupResult> cached_results {};
+
+    /// Texts of the failures received from the children of
+    /// \c invoke_isolated, which their records point to.
+    std::deque<std::string> received_texts {};
+
+    /// Benchmarks registered by \c bench_group, only collected and run with
+    /// \c --bench.
+    std::vector<Benchmark> benchmarks;
+
+    /// The test group being invoked on this thread. Each worker of the
+    /// parallel runner has its own current test group, so assertions are
+    /// always submitted to the group that evaluated them.
+    static thread_local TestGroup *current_test_group;
 
     static auto get_instance_pointer() -> RegistrationCenter * {
       static RegistrationCenter *instance = nullptr;
@@ -30,79 +68,70 @@ namespace sktest {
       return instance;
     }
 
-    static constexpr size_t default_capacity = 16;
+    auto collect_test_groups() -> void;
 
-    auto sort_tests() -> void;
+    /// Count hardware events around each test group (\c --perf).
+    bool measure_perf {false};
 
-   public:
-    RegistrationCenter() noexcept = default;
+    /// Where test results go, chosen by \c --reporter and \c --output.
+    std::unique_ptr<OutputSink> sink;
+    std::unique_ptr<Reporter> reporter;
 
-    auto push_test_group(TestGroup group) -> void;
+    /// Invoke the test group at \p position of the selection with it set as
+    /// the current test group of the calling thread, store its result, and
+    /// pass both to the reporter.
+    auto invoke_test_group(size_t position) -> void;
 
-    [[maybe_unused]] // This is used in the main function, which is defined
-                     // with `USE_SKTEST_DEFAULT_MAIN_FUNCTION` macro. Static
-                     // analysis may misreport unused function errors, we use
-                     // `[[maybe_unused]]` attribute to suppress this warning.
-    auto invoke_tests() -> int;
+    /// Select the test groups to run, without touching the order of
+    /// \c test_groups itself.
+    auto select_tests(Options const &options) -> void;
 
-    static auto print_statistics(
-      size_t total_test_group_count, size_t passed_test_group_count,
-      size_t total_assertion_count, size_t passed_assertion_count) -> void {
+    /// Reorder or narrow the selection by the outcomes of previous runs, for
+    /// \c --failed-first, \c --only-failed and \c --incremental.
+    auto apply_state(Options const &options, StateFile &state) -> void;
 
-      // Fix the divide-by-zero bug when statistics test results in #9
-      if (total_assertion_count == 0) {
-        puts(bold_green("no test found:") " process will exit with 0");
-        return;
-      }
+    /// Print the selected test groups for \c --list.
+    auto list_tests() const -> void;
 
-      if (passed_assertion_count == total_assertion_count) {
-        puts(bold_green("test passed:"));
-      } else {
-        puts(bold_red("tests failed:"));
-      }
+    auto invoke_serially() -> void;
+    auto invoke_in_parallel(size_t jobs) -> void;
 
-      double pass_rate = double(passed_assertion_count)
-                    / // ------------------------------
-                         double(total_assertion_count);
+    /// Invoke the selected test groups in forked child processes, so a crash
+    /// in one test group only fails that group. See \c isolation.cpp.
+    /// A child that spends more than \p timeout_ms milliseconds in one test
+    /// group is killed, and the group is marked as timed out. Zero means no
+    /// timeout.
+    auto invoke_isolated(size_t batch_size, size_t jobs, size_t timeout_ms)
+      -> void;
 
-      constexpr unsigned int pass_rate_bar_width = 32;
+    auto collect_benchmarks() -> void;
+    auto sort_benchmarks() -> void;
 
-      auto red_part_width =
-        (unsigned int)((1.0 - pass_rate) * double(pass_rate_bar_width));
+    /// Measure the benchmarks and compare them with the baseline, if any. See
+    /// \c benchmark.cpp.
+    auto invoke_benchmarks(Options const &options) -> int;
 
-      // When the pass rate is close to but not equal to 1. `red_bar_count` may
-      // be equal to 0 after rounding, making it look like all the tests
-      // passed. We need to manually set `red_bar_count` to 1 in this case.
-      if (red_part_width == 0 and
-          passed_assertion_count != total_assertion_count) {
-        red_part_width = 1;
-      }
+   public:
+    // Defined out of line, so translation units that only submit assertions
+    // do not need the complete types of every member vector.
+    RegistrationCenter() noexcept;
+    ~RegistrationCenter() noexcept override;
 
-      unsigned int green_part_width = pass_rate_bar_width - red_part_width;
-
-      constexpr int percentage_base = 100;
-      printf("  [" green("%.*s") red("%.*s") "] %.1f%%\n",
-             green_part_width, "========================================",
-             red_part_width,   "========================================",
-             pass_rate * percentage_base);
-
-      printf("  " bold("test group:") "   "
-             green("%zu passed") ", " red("%zu failed") ", " "%zu total\n",
-             passed_test_group_count,
-             total_test_group_count - passed_test_group_count,
-             total_test_group_count);
-
-      printf("  " bold("assertion:") "    "
-             green("%zu passed") ", " red("%zu failed") ", " "%zu total\n",
-             passed_assertion_count,
-             total_assertion_count - passed_assertion_count,
-             total_assertion_count);
-    }
+    [[maybe_unused]] // This is used in the main function, which is defined
+                     // with `USE_SKTEST_DEFAULT_MAIN_FUNCTION` macro. Static
+                     // analysis may misreport unused function errors, we use
+                     // `[[maybe_unused]]` attribute to suppress this warning.
+    auto invoke_tests(int argc, char **argv) -> int;
+
+    /// Send the failure \p record to the parent as soon as it is recorded,
+    /// when the current test group runs in a child of \c invoke_isolated.
+    static auto failure_recorded(AssertionRecord const &record) -> void;
 
     [[nodiscard]]
     static auto get_current_test_group() -> TestGroup & {
-      auto current_test_group = get_immutable().current_test_group;
-      return get_mutable().test_groups[current_test_group];
+      assert(current_test_group != nullptr &&
+             "assertions must be evaluated inside a test group");
+      return *current_test_group;
     }
 
     /// Get the const reference of the singleton instance of the
@@ -118,17 +147,6 @@ namespace sktest {
       return *get_instance_pointer();
     }
   };
-
-  /// \brief Register a test group to \c RegistrationCenter while initializing.
-  ///
-  /// This class's initializer will be called in \c test_group macro. It's an
-  /// idiomatic way to performing registration code in global scope.
-  class Registrar {
-   public:
-    Registrar(char const *name, void(*test)(),
-              char const *file_name, size_t line_number) noexcept;
-    ~Registrar() noexcept = default;
-  };
 }
 
 #endif /* sktest_registration_hpp */
@@ -0,0 +1,84 @@
+#ifndef sktest_reporter_hpp
+#define sktest_reporter_hpp
+
+#include <sktest/utilities.hpp>
+#include <sktest/output_sink.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sktest {
+  class TestGroup;
+  struct GroupResult;
+  struct Options;
+
+  /// \brief One selected test group with its result, in the sorted order.
+  struct ReportEntry {
+    TestGroup const *test_group;
+    GroupResult const *result;
+  };
+
+  /// \brief Totals of a run, handed to \c Reporter::run_finished.
+  struct RunSummary {
+    size_t total_test_group_count {0};
+    size_t passed_test_group_count {0};
+    size_t crashed_test_group_count {0};
+    size_t timed_out_test_group_count {0};
+    size_t cached_test_group_count {0};
+    size_t total_assertion_count {0};
+    size_t passed_assertion_count {0};
+    uint64_t wall_ns {0};
+  };
+
+  /// \brief Receives the events of a test run and writes them to an
+  /// \c OutputSink in some format.
+  ///
+  /// \details \c group_finished is called on the thread (or in the child
+  /// process, with \c --isolate) that invoked the test group, right after it
+  /// returned, so implementations must lock the sink while they write. It is
+  /// also called up front for results reused by \c --incremental.
+  /// \c group_aborted is called in the runner process for a group that
+  /// crashed or timed out, and never reached \c group_finished, with the
+  /// failures its child process sent before.
+  ///
+  /// Available reporters, selected with \c --reporter:
+  ///
+  /// \code
+  /// console   human readable failure reports and statistics (default)
+  /// junit     JUnit XML, streamed one <testcase> at a time
+  /// jsonl     JSON Lines, one object per test group
+  /// \endcode
+  class Reporter : private NonCopyable {
+   protected:
+    OutputSink &sink;
+
+   public:
+    explicit Reporter(OutputSink &sink) noexcept : sink(sink) {}
+    ~Reporter() noexcept override = default;
+
+    virtual auto run_started(size_t test_group_count) -> void = 0;
+
+    virtual auto group_finished(TestGroup const &test_group,
+                                GroupResult const &result) -> void = 0;
+
+    /// \p timeout_ms is the \c --timeout in effect, for timed out groups.
+    virtual auto group_aborted(TestGroup const &test_group,
+                               GroupResult const &result,
+                               size_t timeout_ms) -> void = 0;
+
+    virtual auto run_finished(RunSummary const &summary,
+                              std::vector<ReportEntry> const &entries)
+      -> void = 0;
+
+    /// Whether \p name names a reporter known to \c create.
+    [[nodiscard]]
+    static auto is_known(char const *name) -> bool;
+
+    /// Create the reporter chosen by \p options, writing to \p sink.
+    [[nodiscard]]
+    static auto create(Options const &options, OutputSink &sink) -> Reporter *;
+  };
+} // namespace sktest
+
+#endif /* sktest_reporter_hpp */
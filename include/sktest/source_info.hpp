@@ -1,6 +1,8 @@
 #ifndef sktest_source_info_hpp
 #define sktest_source_info_hpp
 
+#include <cstddef>
+
 namespace sktest {
 
   /// \brief Position information of an assertion, including file name and line
@@ -11,7 +13,7 @@ namespace sktest {
     size_t line_number;
 
    public:
-    SourceInfo(char const *file_name, size_t line_number) noexcept
+    constexpr SourceInfo(char const *file_name, size_t line_number) noexcept
       : file_name(file_name), line_number(line_number) {}
 
     [[nodiscard]]
@@ -0,0 +1,91 @@
+#ifndef sktest_state_file_hpp
+#define sktest_state_file_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace sktest {
+  class TestGroup;
+  struct GroupResult;
+
+  /// \brief Outcomes of previous runs, kept in a small text file next to the
+  /// test binary.
+  ///
+  /// \details Entries are keyed by the source file, line and description of a
+  /// test group, the same identity the runner sorts by. Each entry keeps the
+  /// outcome of the last run of the group, a hash of its source file at
+  /// that time and the identity of the test binary that ran it, which drive
+  /// \c --failed-first, \c --only-failed and \c --incremental. Groups that
+  /// were not selected in a run keep their old entries.
+  ///
+  /// Every line of the file holds one entry:
+  ///
+  /// \code
+  /// <P|F> <source hash> <binary identity> <total assertions> <passed assertions> <line>\t<file>\t<description>
+  /// \endcode
+  class StateFile {
+   public:
+    struct Entry {
+      bool passed {false};
+      uint64_t source_hash {0};
+      uint64_t binary_identity {0};
+      size_t total_assertion_count {0};
+      size_t passed_assertion_count {0};
+    };
+
+   private:
+    std::unordered_map<std::string, Entry> entries {};
+
+    /// FNV-1a hashes of source files, computed at most once per run.
+    std::unordered_map<std::string, uint64_t> source_hashes {};
+
+    uint64_t binary_identity {identify_binary()};
+
+    static auto make_key(char const *file, size_t line,
+                         char const *description) -> std::string;
+
+   public:
+    /// The state file of the binary at \p program, which is
+    /// \c "<program>.sktest-state".
+    static auto default_path(char const *program) -> std::string;
+
+    /// Load \p path. A missing or malformed file leaves the state empty.
+    auto load(char const *path) -> void;
+
+    /// Write the state to \p path through a temporary file, so an
+    /// interrupted run never leaves a truncated state behind.
+    auto save(char const *path) const -> bool;
+
+    [[nodiscard]]
+    auto find(TestGroup const &test_group) const -> Entry const *;
+
+    auto update(TestGroup const &test_group, GroupResult const &result)
+      -> void;
+
+    /// FNV-1a hash of the contents of \p file, or 0 if it cannot be read.
+    auto hash_source(char const *file) -> uint64_t;
+
+    /// FNV-1a hash of the size, modification time and inode of the running
+    /// binary, which change when it is rebuilt, or 0 where it cannot be
+    /// found.
+    static auto identify_binary() -> uint64_t;
+
+    [[nodiscard]]
+    auto get_binary_identity() const -> uint64_t {
+      return binary_identity;
+    }
+
+    /// Whether \p test_group passed in its last run, by this same binary,
+    /// and its source file is unchanged since, which lets \c --incremental
+    /// reuse the result: a rebuild may change what the group runs, through
+    /// the code it tests, even if its own source did not. A hash of 0,
+    /// recorded or current, never matches, so unreadable sources are always
+    /// rerun.
+    [[nodiscard]]
+    auto is_unchanged(TestGroup const &test_group) -> bool;
+  };
+} // namespace sktest
+
+#endif /* sktest_state_file_hpp */
@@ -30,6 +30,19 @@
 /// }
 /// \endcode
 ///
+/// \details The default main function accepts a few command line options, for
+/// example \c --jobs to run test groups on several threads, or
+/// \c --reporter=junit to write JUnit XML for a CI server. Run the test
+/// binary with \c --help, or see \c sktest::Options for the full list.
+///
+/// \details Define \c USE_SKTEST_ALLOCATION_HOOKS next to
+/// \c USE_SKTEST_DEFAULT_MAIN_FUNCTION to count the allocations of every test
+/// group, report the memory it leaks, and enable the \c assert_no_alloc and
+/// \c assert_max_alloc block assertions.
+///
+/// \details Micro-benchmarks are written with \c bench_group next to the test
+/// groups, and only run when the binary is started with \c --bench.
+///
 /// \details You can find richer examples in the \c test/example directory.
 ///
 /// \note SkTest is inspired by Catch2 (https://github.com/catchorg/Catch2),
@@ -45,14 +58,21 @@
 #include <sktest/registration.hpp>
 #include <sktest/test_group.hpp>
 #include <sktest/assertion.hpp>
+#include <sktest/benchmark.hpp>
+#include <sktest/allocation.hpp>
 
 // Let SkTest provide the main function if "USE_SKTEST_DEFAULT_MAIN_FUNCTION" is
 // defined.
 #ifdef USE_SKTEST_DEFAULT_MAIN_FUNCTION
-int main/* NOLINT */([[maybe_unused]] int _argc,
-                     [[maybe_unused]] char **_argv) {
-  return sktest::RegistrationCenter::get_mutable().invoke_tests();
+int main/* NOLINT */(int argc, char **argv) {
+  return sktest::RegistrationCenter::get_mutable().invoke_tests(argc, argv);
 }
+
+// Count allocations per test group if "USE_SKTEST_ALLOCATION_HOOKS" is also
+// defined.
+#ifdef USE_SKTEST_ALLOCATION_HOOKS
+#include <sktest/allocation_hooks.hpp>
+#endif
 #endif
 
 #endif /* sktest_test_hpp */
\ No newline at end of file
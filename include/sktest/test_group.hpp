@@ -3,36 +3,112 @@
 
 #include <sktest/source_info.hpp>
 #include <sktest/assertion.hpp>
+#include <sktest/record_arena.hpp>
+#include <sktest/perf_counters.hpp>
+#include <sktest/allocation.hpp>
 
 #include <cstddef>
 #include <cstring>
-#include <vector>
 #include <cassert>
 
 namespace sktest {
 
+  /// \brief Outcome of one invoked test group, as seen by the runner.
+  ///
+  /// \details The runner keeps results apart from \c TestGroup, because a
+  /// test group may run in another process (see \c --isolate), where only
+  /// these counts make it back to the parent.
+  struct GroupResult {
+    size_t total_assertion_count {0};
+    size_t passed_assertion_count {0};
+    bool finished {false};
+
+    /// The signal that killed the process running this group, or the exit
+    /// status if the process exited before finishing it. Only meaningful when
+    /// \c crashed is \c true.
+    int crash_code {0};
+    bool crash_by_signal {false};
+    bool crashed {false};
+
+    /// The group ran past \c --timeout and its process was killed.
+    bool timed_out {false};
+
+    /// Reused from the state file by \c --incremental, not invoked.
+    bool cached {false};
+
+    /// Wall clock and CPU time spent in the group, in nanoseconds. The CPU
+    /// time only covers the thread that invoked the group.
+    uint64_t wall_ns {0};
+    uint64_t cpu_ns {0};
+
+    /// Hardware events counted while the group ran, with \c --perf.
+    PerfCounts perf {};
+
+    /// Allocations made by the thread that ran the group, only meaningful
+    /// when \c allocation_hooks_installed is set.
+    AllocationSummary allocations {};
+
+    [[nodiscard]]
+    auto has_passed() const -> bool {
+      return not crashed and not timed_out and
+             passed_assertion_count == total_assertion_count;
+    }
+  };
+
   /// \brief The basic test collection in SkTest.
   ///
   /// \details A \c TestGroup is actually a invokable function that contains a
-  /// set of tests. The tests can be automatically registered to
-  /// \c RegistrationCenter by \c test_group macro. You should not use this
-  /// struct directly.
+  /// set of tests. The \c test_group macro defines each one as a constant
+  /// initialized static object and links it into an intrusive list with a
+  /// \c Registrar, so registration needs neither the heap nor any other
+  /// global to be initialized first. You should not use this struct directly.
   struct TestGroup {
    private:
     char const *description;
     SourceInfo info;
     void(*test_function)();
 
-    std::vector<Assertion> assertions {};
+    /// Next test group in the registration list.
+    TestGroup *next {nullptr};
+
+    /// Head of the registration list. Being \c constinit, it is already null
+    /// when the first \c Registrar runs, whatever the initialization order of
+    /// the translation units.
+    static constinit inline TestGroup *registered {nullptr};
+
+    friend class Registrar;
+
+    size_t total_assertion_count {0};
+    size_t passed_assertion_count {0};
+    RecordArena<AssertionRecord> failures {};
 
    public:
-    TestGroup(char const *description, void(*test_function)(),
-              char const *file_name, size_t line_number) noexcept
-      : description(description), test_function(test_function),
-        info(file_name, line_number) {};
+    constexpr TestGroup(char const *description, void(*test_function)(),
+                        char const *file_name, size_t line_number) noexcept
+      : description(description), info(file_name, line_number),
+        test_function(test_function) {}
+
+    /// The most recently registered test group, or \c nullptr.
+    [[nodiscard]]
+    static auto first_registered() -> TestGroup * {
+      return registered;
+    }
+
+    [[nodiscard]]
+    auto next_registered() const -> TestGroup * {
+      return next;
+    }
 
-    auto push_assertion(Assertion assertion) noexcept -> void {
-      assertions.push_back(std::move(assertion));
+    auto count_passed_assertion() noexcept -> void {
+      ++total_assertion_count;
+      ++passed_assertion_count;
+    }
+
+    auto record_failed_assertion(AssertionRecord const &record) -> void {
+      ++total_assertion_count;
+      // The arena outlives the group, its blocks are not the group's leaks.
+      AllocationSuspension suspension;
+      failures.push(record);
     }
 
     [[nodiscard]]
@@ -51,27 +127,65 @@ namespace sktest {
     }
 
     [[nodiscard]]
-    auto get_assertions() const -> const std::vector<Assertion> & {
-      return assertions;
+    auto get_failures() const -> RecordArena<AssertionRecord> const & {
+      return failures;
+    }
+
+    [[nodiscard]]
+    auto summarize() const -> GroupResult {
+      GroupResult result;
+      result.total_assertion_count = total_assertion_count;
+      result.passed_assertion_count = passed_assertion_count;
+      result.finished = true;
+      return result;
     }
 
     void invoke() const {
-      assert(assertions.empty() && "cannot invoke a test group more than once");
+      assert(total_assertion_count == 0 &&
+             "cannot invoke a test group more than once");
       test_function();
     }
   };
+
+  /// \brief Link a test group into the registration list while initializing.
+  ///
+  /// This class's initializer will be called in \c test_group macro. It's an
+  /// idiomatic way to performing registration code in global scope, and costs
+  /// two stores per test group.
+  class Registrar {
+   public:
+    explicit Registrar(TestGroup &group) noexcept {
+      group.next = TestGroup::registered;
+      TestGroup::registered = &group;
+    }
+    ~Registrar() noexcept = default;
+  };
+
+  inline auto submit_assertion(bool passed, AssertionRecord const &record)
+      -> void {
+    auto &test_group = RegistrationCenter::get_current_test_group();
+    if (passed) [[likely]] {
+      test_group.count_passed_assertion();
+    } else {
+      test_group.record_failed_assertion(record);
+      RegistrationCenter::failure_recorded(record);
+    }
+  }
 } // namespace sktest
 
 #define sktest_name_mangling(name, line) name##line
 #define sktest_test_group_impl(description, line, file)                        \
   static void sktest_name_mangling(sktest_, line)();                           \
   namespace {                                                                  \
-    sktest::Registrar sktest_name_mangling(sktest_registrar, line) (           \
+    constinit sktest::TestGroup sktest_name_mangling(sktest_group_, line) (    \
       description,                                                             \
       &sktest_name_mangling(sktest_, line),                                    \
       file,                                                                    \
       size_t(line)                                                             \
     );                                                                         \
+    sktest::Registrar sktest_name_mangling(sktest_registrar, line) (           \
+      sktest_name_mangling(sktest_group_, line)                                \
+    );                                                                         \
   }                                                                            \
   static void sktest_name_mangling(sktest_, line)()
 
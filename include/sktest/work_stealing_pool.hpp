@@ -0,0 +1,55 @@
+#ifndef sktest_work_stealing_pool_hpp
+#define sktest_work_stealing_pool_hpp
+
+#include <sktest/utilities.hpp>
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace sktest {
+
+  /// \brief A fixed-size thread pool that runs a batch of indexed tasks with
+  /// work stealing.
+  ///
+  /// \details Tasks \c [0, task_count) are split into contiguous chunks, one
+  /// chunk per worker. Each worker pops tasks from the front of its own deque,
+  /// so neighbouring test groups tend to run on the same thread. A worker that
+  /// runs out of tasks steals from the back of another worker's deque. No new
+  /// tasks are created during a run, so a worker that finds every deque empty
+  /// can stop.
+  ///
+  /// The calling thread takes part in the run as worker 0, so a pool with one
+  /// worker does not create any thread.
+  class WorkStealingPool : private NonCopyable {
+   private:
+    struct Worker {
+      std::mutex mutex {};
+      std::deque<size_t> tasks {};
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers {};
+
+    auto pop_local(size_t worker, size_t &task) -> bool;
+    auto steal(size_t thief, size_t &task) -> bool;
+    auto work(size_t worker, std::function<void(size_t)> const &task) -> void;
+
+   public:
+    explicit WorkStealingPool(size_t worker_count);
+
+    /// Run \p task for every index in \c [0, task_count) and block until all
+    /// of them have finished.
+    auto run(size_t task_count, std::function<void(size_t)> const &task)
+      -> void;
+
+    [[nodiscard]]
+    auto get_worker_count() const -> size_t {
+      return workers.size();
+    }
+  };
+} // namespace sktest
+
+#endif /* sktest_work_stealing_pool_hpp */
@@ -4,7 +4,217 @@
 // instead here.
 #include <stdio.h> // NOLINT
 
-auto main() -> int {
-  printf("Hello, world!\n");
-  return 0;
-}
\ No newline at end of file
+#include <skjvm/class_file.hpp>
+#include <skjvm/class_loader.hpp>
+#include <skjvm/class_path.hpp>
+#include <skjvm/class_registry.hpp>
+#include <skjvm/descriptor.hpp>
+#include <skjvm/options.hpp>
+#include <skjvm/shared_archive.hpp>
+#include <skjvm/symbol_table.hpp>
+#include <skjvm/vm.hpp>
+
+#include <inttypes.h>
+#include <limits.h>
+#include <unistd.h>
+
+namespace {
+  auto print_view(skjvm::Utf8View view) -> void {
+    fwrite(view.bytes, 1, view.length, stdout);
+  }
+
+  /// Print the class, its fields and methods, like a tiny `javap`.
+  auto print_class(skjvm::ClassFile const &class_file) -> void {
+    printf("class ");
+    print_view(class_file.this_class_name());
+    if (not class_file.super_class_name().is_empty()) {
+      printf(" extends ");
+      print_view(class_file.super_class_name());
+    }
+    printf(" (version %u.%u, %u constants)\n",
+           class_file.get_major_version(), class_file.get_minor_version(),
+           class_file.get_constant_count());
+
+    for (auto const &field : class_file.fields()) {
+      printf("  field ");
+      print_view(class_file.name(field));
+      printf(" ");
+      print_view(class_file.descriptor(field));
+      printf("\n");
+    }
+    for (auto const &method : class_file.methods()) {
+      printf("  method ");
+      print_view(class_file.name(method));
+      print_view(class_file.descriptor(method));
+      skjvm::CodeView code = class_file.code(method);
+      if (code.is_present()) {
+        printf(" (%u bytes of code)", code.code_length);
+      }
+      printf("\n");
+    }
+  }
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+  skjvm::Options options;
+  if (not skjvm::Options::parse(argc, argv, options)) {
+    skjvm::Options::print_usage(argv[0]);
+    return 2;
+  }
+  if (options.help) {
+    skjvm::Options::print_usage(argv[0]);
+    return 0;
+  }
+
+  char cache_path[PATH_MAX];
+  char const *cache = options.class_path_cache;
+  if (cache == nullptr and not options.no_class_path_cache and
+      skjvm::ClassPath::default_cache_path(options.class_path, "classpath",
+                                           cache_path, sizeof(cache_path))) {
+    cache = cache_path;
+  }
+  skjvm::ClassPath class_path;
+  class_path.open(options.class_path, cache);
+
+  // Class names are given with dots, class files use slashes.
+  char main_class[PATH_MAX];
+  snprintf(main_class, sizeof(main_class), "%s", options.main_class);
+  for (char *c = main_class; *c != '\0'; ++c) {
+    if (*c == '.') { *c = '/'; }
+  }
+  skjvm::Utf8View main_name = skjvm::make_view(main_class);
+
+  skjvm::ClassLoader loader(class_path);
+  loader.set_verbose(options.verbose_class);
+  if (options.print_class) {
+    skjvm::LoadedClass &loaded = loader.load(main_name);
+    if (loaded.state != skjvm::LoadState::loaded) {
+      fprintf(stderr, "Error: Could not find or load main class %s\n",
+              options.main_class);
+      return 1;
+    }
+    print_class(loaded.class_file);
+    return 0;
+  }
+
+  char archive_path[PATH_MAX];
+  char const *archive_file = options.shared_archive;
+  if (archive_file == nullptr and
+      skjvm::ClassPath::default_cache_path(options.class_path, "shared",
+                                           archive_path,
+                                           sizeof(archive_path))) {
+    archive_file = archive_path;
+  }
+
+  // The archive outlives the registry, which uses its mapping.
+  skjvm::SharedArchive archive;
+  skjvm::SymbolTable symbols;
+  skjvm::ClassRegistry registry(loader, symbols);
+  registry.set_print_field_layout(options.print_field_layout);
+  bool restored = false;
+  if (options.share == skjvm::ShareMode::auto_ or
+      options.share == skjvm::ShareMode::on) {
+    skjvm::ArchiveStatus status = archive_file == nullptr
+      ? skjvm::ArchiveStatus::missing
+      : archive.open(archive_file, class_path, options.class_path);
+    if (status == skjvm::ArchiveStatus::ok) {
+      restored = archive.restore(registry, options.verbose_class) != 0;
+    } else if (options.share == skjvm::ShareMode::on) {
+      fprintf(stderr, "Error: Could not use the shared archive %s: %s\n",
+              archive_file == nullptr ? "" : archive_file,
+              skjvm::describe(status));
+      return 1;
+    }
+  }
+
+  // With the archive, the classes the program needs are already linked.
+  uint32_t preload_threads = options.preload_threads;
+  if (not options.preload_threads_given) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    preload_threads = online > 0 ? uint32_t(online) : 1;
+  }
+  if (preload_threads != 0 and not restored) {
+    loader.start_workers(preload_threads);
+    loader.preload(main_name);
+  }
+
+  skjvm::LinkError error = skjvm::LinkError::none;
+  skjvm::Klass *main_klass = registry.link(main_name, error);
+  if (main_klass == nullptr) {
+    fprintf(stderr, "Error: Could not find or load main class %s\n",
+            options.main_class);
+    fprintf(stderr, "Caused by: %s\n", skjvm::describe(error));
+    return 1;
+  }
+
+  if (options.share == skjvm::ShareMode::dump) {
+    // Link everything the program refers to, as far as it can be found.
+    for (size_t i = 0; i < registry.get_classes().get_size(); ++i) {
+      registry.resolve_all(*registry.get_classes()[i]);
+    }
+    if (archive_file == nullptr or
+        not skjvm::SharedArchive::dump(registry, class_path,
+                                       options.class_path, archive_file)) {
+      fprintf(stderr, "Error: Could not write the shared archive %s\n",
+              archive_file == nullptr ? "" : archive_file);
+      return 1;
+    }
+    printf("Dumped %u classes to %s\n",
+           uint32_t(registry.get_classes().get_size()), archive_file);
+    return 0;
+  }
+
+  skjvm::VM vm(registry, options.heap_size, options.young_size);
+  vm.get_heap().set_tenuring_threshold(options.tenuring_threshold);
+  vm.get_heap().set_parallel_gc_threads(options.parallel_gc_threads);
+  vm.get_heap().set_log(options.log_gc);
+  vm.set_dispatch_mode(options.dispatch);
+  vm.set_verify_mode(options.verify);
+  skjvm::Compiler &compiler = vm.get_compiler();
+  compiler.set_enabled(not options.interpret_only);
+  compiler.set_compile_threshold(options.compile_threshold);
+  compiler.set_backedge_threshold(options.backedge_threshold);
+  compiler.set_print_compilation(options.print_compilation);
+  int status = vm.run_main(*main_klass, options.argument_count,
+                           options.arguments);
+  if (options.print_inline_cache_stats) {
+    skjvm::InlineCacheStats stats = vm.get_inline_cache_stats();
+    uint64_t calls = stats.hits + stats.misses;
+    fprintf(stderr,
+            "inline caches: %" PRIu64 " hits, %" PRIu64 " misses "
+            "(%.2f%% hit rate), %" PRIu64 " megamorphic call sites\n",
+            stats.hits, stats.misses,
+            calls == 0 ? 0.0 : 100.0 * double(stats.hits) / double(calls),
+            stats.megamorphic_sites);
+  }
+  if (options.print_monitor_stats) {
+    skjvm::MonitorStats stats = vm.get_monitors().get_stats();
+    fprintf(stderr,
+            "monitors: %" PRIu64 " inflated, %" PRIu64 " deflated, "
+            "%" PRIu64 " contended enters (%" PRIu64 " blocked), "
+            "%" PRIu64 " waits, %" PRIu64 " notifications\n",
+            stats.inflations, stats.deflations, stats.contended_enters,
+            stats.blocked_enters, stats.waits, stats.notifications);
+  }
+  if (options.print_verification_stats) {
+    // A line per class verified, in the order they were linked.
+    uint64_t total_time = 0;
+    uint32_t total_methods = 0;
+    uint32_t classes = 0;
+    for (skjvm::Klass const *klass : registry.get_classes()) {
+      if (klass->verified_methods == 0) { continue; }
+      fprintf(stderr, "verification: %8.3f ms %5u methods  %.*s\n",
+              double(klass->verify_time) / 1e6, klass->verified_methods,
+              int(klass->name.length), klass->name.bytes);
+      total_time += klass->verify_time;
+      total_methods += klass->verified_methods;
+      ++classes;
+    }
+    fprintf(stderr,
+            "verification: %.3f ms for %u methods in %u classes (%s)\n",
+            double(total_time) / 1e6, total_methods, classes,
+            skjvm::describe(options.verify));
+  }
+  loader.wait_idle();
+  return status;
+}
@@ -0,0 +1,370 @@
+#include <skjvm/assembler.hpp>
+
+#include <string.h>
+
+namespace skjvm {
+  namespace {
+    auto code(Register value) -> unsigned {
+      return unsigned(value);
+    }
+
+    auto code(Xmm value) -> unsigned {
+      return unsigned(value);
+    }
+
+    auto modrm(unsigned mod, unsigned reg, unsigned rm) -> uint8_t {
+      return uint8_t(mod << 6 | (reg & 7) << 3 | (rm & 7));
+    }
+  } // namespace
+
+  auto Assembler::emit_int32(uint32_t value) -> void {
+    for (int i = 0; i < 4; ++i) {
+      emit(uint8_t(value >> (8 * i)));
+    }
+  }
+
+  auto Assembler::emit_rex(bool wide, unsigned reg, unsigned index,
+                           unsigned base, bool force) -> void {
+    auto rex = uint8_t(0x40 | (wide ? 8 : 0) | (reg >> 3) << 2 |
+                       (index >> 3) << 1 | base >> 3);
+    if (rex != 0x40 or force) { emit(rex); }
+  }
+
+  auto Assembler::emit_memory(unsigned reg, Address const &address) -> void {
+    unsigned base = code(address.base);
+    if (address.indexed) {
+      emit(modrm(2, reg, 4));
+      emit(uint8_t(address.scale << 6 | (code(address.index) & 7) << 3 |
+                   (base & 7)));
+    } else if ((base & 7) == 4) {
+      // `rsp` and `r12` as a base need a SIB byte without index.
+      emit(modrm(2, reg, 4));
+      emit(0x24);
+    } else {
+      emit(modrm(2, reg, base));
+    }
+    emit_int32(uint32_t(address.displacement));
+  }
+
+  auto Assembler::emit_memory_rex(bool wide, unsigned reg,
+                                  Address const &address, bool force)
+      -> void {
+    emit_rex(wide, reg, address.indexed ? code(address.index) : 0,
+             code(address.base), force);
+  }
+
+  auto Assembler::emit_sse(uint8_t prefix, uint8_t opcode, unsigned reg,
+                           Address const &address, bool wide) -> void {
+    if (prefix != 0) { emit(prefix); }
+    emit_memory_rex(wide, reg, address);
+    emit(0x0f);
+    emit(opcode);
+    emit_memory(reg, address);
+  }
+
+  auto Assembler::load(Register to, Address const &from, Width width)
+      -> void {
+    emit_memory_rex(width == Width::qword, code(to), from);
+    switch (width) {
+      case Width::byte:
+        emit(0x0f);
+        emit(0xb6);
+        break;
+      case Width::word:
+        emit(0x0f);
+        emit(0xb7);
+        break;
+      case Width::dword:
+      case Width::qword:
+        emit(0x8b);
+        break;
+    }
+    emit_memory(code(to), from);
+  }
+
+  auto Assembler::load_signed(Register to, Address const &from, Width width)
+      -> void {
+    if (width == Width::qword) {
+      load(to, from, width);
+      return;
+    }
+    // A signed dword is extended to 64 bits, `movsxd`.
+    emit_memory_rex(width == Width::dword, code(to), from);
+    switch (width) {
+      case Width::byte:
+        emit(0x0f);
+        emit(0xbe);
+        break;
+      case Width::word:
+        emit(0x0f);
+        emit(0xbf);
+        break;
+      default:
+        emit(0x63);
+        break;
+    }
+    emit_memory(code(to), from);
+  }
+
+  auto Assembler::store(Address const &to, Register from, Width width)
+      -> void {
+    if (width == Width::word) { emit(0x66); }
+    // Without a REX prefix, bytes 4 to 7 are `ah` to `bh`.
+    emit_memory_rex(width == Width::qword, code(from), to,
+                    width == Width::byte and code(from) >= 4);
+    emit(width == Width::byte ? 0x88 : 0x89);
+    emit_memory(code(from), to);
+  }
+
+  auto Assembler::store_immediate(Address const &to, int32_t value,
+                                  Width width) -> void {
+    if (width == Width::word) { emit(0x66); }
+    emit_memory_rex(width == Width::qword, 0, to);
+    emit(width == Width::byte ? 0xc6 : 0xc7);
+    emit_memory(0, to);
+    switch (width) {
+      case Width::byte:
+        emit(uint8_t(value));
+        break;
+      case Width::word:
+        emit(uint8_t(value));
+        emit(uint8_t(value >> 8));
+        break;
+      default:
+        emit_int32(uint32_t(value));
+        break;
+    }
+  }
+
+  auto Assembler::move(Register to, Register from) -> void {
+    emit_rex(true, code(from), 0, code(to));
+    emit(0x89);
+    emit(modrm(3, code(from), code(to)));
+  }
+
+  auto Assembler::move_immediate(Register to, uint64_t value) -> void {
+    if (value <= UINT32_MAX) {
+      // 32-bit moves clear the upper half.
+      emit_rex(false, 0, 0, code(to));
+      emit(uint8_t(0xb8 + (code(to) & 7)));
+      emit_int32(uint32_t(value));
+      return;
+    }
+    emit_rex(true, 0, 0, code(to));
+    emit(uint8_t(0xb8 + (code(to) & 7)));
+    emit_int32(uint32_t(value));
+    emit_int32(uint32_t(value >> 32));
+  }
+
+  auto Assembler::lea(Register to, Address const &address) -> void {
+    emit_memory_rex(true, code(to), address);
+    emit(0x8d);
+    emit_memory(code(to), address);
+  }
+
+  auto Assembler::lea_relative(Register to) -> uint32_t {
+    emit_rex(true, code(to), 0, 0);
+    emit(0x8d);
+    emit(modrm(0, code(to), 5));
+    uint32_t position = get_size();
+    emit_int32(0);
+    return position;
+  }
+
+  auto Assembler::alu(AluOp op, Register to, Address const &from, bool wide)
+      -> void {
+    emit_memory_rex(wide, code(to), from);
+    emit(uint8_t(uint8_t(op) << 3 | 3));
+    emit_memory(code(to), from);
+  }
+
+  auto Assembler::alu(AluOp op, Register to, Register from, bool wide)
+      -> void {
+    emit_rex(wide, code(from), 0, code(to));
+    emit(uint8_t(uint8_t(op) << 3 | 1));
+    emit(modrm(3, code(from), code(to)));
+  }
+
+  auto Assembler::alu_immediate(AluOp op, Address const &to, int32_t value,
+                                Width width) -> void {
+    if (width == Width::word) { emit(0x66); }
+    emit_memory_rex(width == Width::qword, 0, to);
+    emit(width == Width::byte ? 0x80 : 0x81);
+    emit_memory(unsigned(op), to);
+    switch (width) {
+      case Width::byte:
+        emit(uint8_t(value));
+        break;
+      case Width::word:
+        emit(uint8_t(value));
+        emit(uint8_t(value >> 8));
+        break;
+      default:
+        emit_int32(uint32_t(value));
+        break;
+    }
+  }
+
+  auto Assembler::alu_immediate(AluOp op, Register to, int32_t value,
+                                bool wide) -> void {
+    emit_rex(wide, 0, 0, code(to));
+    emit(0x81);
+    emit(modrm(3, unsigned(op), code(to)));
+    emit_int32(uint32_t(value));
+  }
+
+  auto Assembler::imul(Register to, Address const &from, bool wide) -> void {
+    emit_memory_rex(wide, code(to), from);
+    emit(0x0f);
+    emit(0xaf);
+    emit_memory(code(to), from);
+  }
+
+  auto Assembler::imul(Register to, Register from, bool wide) -> void {
+    emit_rex(wide, code(to), 0, code(from));
+    emit(0x0f);
+    emit(0xaf);
+    emit(modrm(3, code(to), code(from)));
+  }
+
+  auto Assembler::imul_immediate(Register to, Register from, int32_t value,
+                                 bool wide) -> void {
+    emit_rex(wide, code(to), 0, code(from));
+    emit(0x69);
+    emit(modrm(3, code(to), code(from)));
+    emit_int32(uint32_t(value));
+  }
+
+  auto Assembler::negate(Register value, bool wide) -> void {
+    emit_rex(wide, 0, 0, code(value));
+    emit(0xf7);
+    emit(modrm(3, 3, code(value)));
+  }
+
+  auto Assembler::shift(ShiftOp op, Register value, bool wide) -> void {
+    emit_rex(wide, 0, 0, code(value));
+    emit(0xd3);
+    emit(modrm(3, unsigned(op), code(value)));
+  }
+
+  auto Assembler::shift_immediate(ShiftOp op, Register value, uint8_t count,
+                                  bool wide) -> void {
+    emit_rex(wide, 0, 0, code(value));
+    emit(0xc1);
+    emit(modrm(3, unsigned(op), code(value)));
+    emit(count);
+  }
+
+  auto Assembler::test(Register a, Register b, bool wide) -> void {
+    emit_rex(wide, code(b), 0, code(a));
+    emit(0x85);
+    emit(modrm(3, code(b), code(a)));
+  }
+
+  auto Assembler::increment(Address const &to, bool wide) -> void {
+    emit_memory_rex(wide, 0, to);
+    emit(0xff);
+    emit_memory(0, to);
+  }
+
+  auto Assembler::compare_exchange(Address const &to, Register value,
+                                   bool wide) -> void {
+    emit(0xf0);
+    emit_memory_rex(wide, code(value), to);
+    emit(0x0f);
+    emit(0xb1);
+    emit_memory(code(value), to);
+  }
+
+  auto Assembler::sign_extend_accumulator(bool wide) -> void {
+    if (wide) { emit(0x48); }
+    emit(0x99);
+  }
+
+  auto Assembler::divide(Register divisor, bool wide) -> void {
+    emit_rex(wide, 0, 0, code(divisor));
+    emit(0xf7);
+    emit(modrm(3, 7, code(divisor)));
+  }
+
+  auto Assembler::load_float(Xmm to, Address const &from, bool is_double)
+      -> void {
+    emit_sse(is_double ? 0xf2 : 0xf3, 0x10, code(to), from);
+  }
+
+  auto Assembler::store_float(Address const &to, Xmm from, bool is_double)
+      -> void {
+    emit_sse(is_double ? 0xf2 : 0xf3, 0x11, code(from), to);
+  }
+
+  auto Assembler::float_op(FloatOp op, Xmm to, Address const &from,
+                           bool is_double) -> void {
+    emit_sse(is_double ? 0xf2 : 0xf3, uint8_t(op), code(to), from);
+  }
+
+  auto Assembler::compare_float(Xmm a, Address const &b, bool is_double)
+      -> void {
+    // `ucomiss` and `ucomisd`.
+    emit_sse(is_double ? 0x66 : 0, 0x2e, code(a), b);
+  }
+
+  auto Assembler::convert_integer(Xmm to, Address const &from, bool wide,
+                                  bool is_double) -> void {
+    emit_sse(is_double ? 0xf2 : 0xf3, 0x2a, code(to), from, wide);
+  }
+
+  auto Assembler::convert_float(Xmm to, Address const &from,
+                                bool from_double) -> void {
+    emit_sse(from_double ? 0xf2 : 0xf3, 0x5a, code(to), from);
+  }
+
+  auto Assembler::jump(Condition condition) -> uint32_t {
+    emit(0x0f);
+    emit(uint8_t(0x80 | uint8_t(condition)));
+    uint32_t position = get_size();
+    emit_int32(0);
+    return position;
+  }
+
+  auto Assembler::jump() -> uint32_t {
+    emit(0xe9);
+    uint32_t position = get_size();
+    emit_int32(0);
+    return position;
+  }
+
+  auto Assembler::jump(Register target) -> void {
+    emit_rex(false, 0, 0, code(target));
+    emit(0xff);
+    emit(modrm(3, 4, code(target)));
+  }
+
+  auto Assembler::call(Register target) -> void {
+    emit_rex(false, 0, 0, code(target));
+    emit(0xff);
+    emit(modrm(3, 2, code(target)));
+  }
+
+  auto Assembler::push(Register value) -> void {
+    emit_rex(false, 0, 0, code(value));
+    emit(uint8_t(0x50 + (code(value) & 7)));
+  }
+
+  auto Assembler::pop(Register value) -> void {
+    emit_rex(false, 0, 0, code(value));
+    emit(uint8_t(0x58 + (code(value) & 7)));
+  }
+
+  auto Assembler::ret() -> void {
+    emit(0xc3);
+  }
+
+  auto Assembler::bind(uint32_t position, uint32_t target) -> void {
+    // Offsets are relative to the end of the instruction, which they end.
+    patch(position, int32_t(target - (position + 4)));
+  }
+
+  auto Assembler::patch(uint32_t position, int32_t value) -> void {
+    memcpy(&bytes[position], &value, sizeof(value));
+  }
+} // namespace skjvm
@@ -0,0 +1,256 @@
+#include <skjvm/bootstrap.hpp>
+
+#include <skjvm/class_writer.hpp>
+
+namespace skjvm {
+  namespace {
+    /// The throwables the VM throws itself, with their super classes.
+    struct ThrowableClass {
+      char const *name;
+      char const *super;
+    };
+
+    constexpr ThrowableClass throwable_classes[] {
+      {"java/lang/Exception", "java/lang/Throwable"},
+      {"java/lang/Error", "java/lang/Throwable"},
+      {"java/lang/RuntimeException", "java/lang/Exception"},
+      {"java/lang/ArithmeticException", "java/lang/RuntimeException"},
+      {"java/lang/ArrayStoreException", "java/lang/RuntimeException"},
+      {"java/lang/ClassCastException", "java/lang/RuntimeException"},
+      {"java/lang/IllegalArgumentException", "java/lang/RuntimeException"},
+      {"java/lang/IllegalMonitorStateException", "java/lang/RuntimeException"},
+      {"java/lang/IndexOutOfBoundsException", "java/lang/RuntimeException"},
+      {"java/lang/ArrayIndexOutOfBoundsException",
+       "java/lang/IndexOutOfBoundsException"},
+      {"java/lang/StringIndexOutOfBoundsException",
+       "java/lang/IndexOutOfBoundsException"},
+      {"java/lang/NegativeArraySizeException", "java/lang/RuntimeException"},
+      {"java/lang/NullPointerException", "java/lang/RuntimeException"},
+      {"java/lang/UnsupportedOperationException",
+       "java/lang/RuntimeException"},
+      {"java/lang/LinkageError", "java/lang/Error"},
+      {"java/lang/ClassCircularityError", "java/lang/LinkageError"},
+      {"java/lang/ClassFormatError", "java/lang/LinkageError"},
+      {"java/lang/ExceptionInInitializerError", "java/lang/LinkageError"},
+      {"java/lang/IncompatibleClassChangeError", "java/lang/LinkageError"},
+      {"java/lang/AbstractMethodError",
+       "java/lang/IncompatibleClassChangeError"},
+      {"java/lang/InstantiationError",
+       "java/lang/IncompatibleClassChangeError"},
+      {"java/lang/NoSuchFieldError", "java/lang/IncompatibleClassChangeError"},
+      {"java/lang/NoSuchMethodError",
+       "java/lang/IncompatibleClassChangeError"},
+      {"java/lang/NoClassDefFoundError", "java/lang/LinkageError"},
+      {"java/lang/UnsatisfiedLinkError", "java/lang/LinkageError"},
+      {"java/lang/VerifyError", "java/lang/LinkageError"},
+      {"java/lang/VirtualMachineError", "java/lang/Error"},
+      {"java/lang/InternalError", "java/lang/VirtualMachineError"},
+      {"java/lang/OutOfMemoryError", "java/lang/VirtualMachineError"},
+      {"java/lang/StackOverflowError", "java/lang/VirtualMachineError"},
+    };
+
+    /// Add a constructor calling the one of \p super with the same
+    /// \p descriptor, either \c ()V or \c (Ljava/lang/String;)V .
+    auto add_forwarding_constructor(ClassWriter &writer, char const *super,
+                                    char const *descriptor, bool message)
+        -> void {
+      CodeWriter code(writer);
+      code.set_max(message ? 2 : 1, message ? 2 : 1).local(Opcode::aload, 0);
+      if (message) { code.local(Opcode::aload, 1); }
+      code.invoke(Opcode::invokespecial, super, "<init>", descriptor)
+          .op(Opcode::return_);
+      writer.add_method(access::public_, "<init>", descriptor, &code);
+    }
+
+    auto build_object(size_t &size) -> uint8_t * {
+      ClassWriter writer("java/lang/Object", nullptr);
+
+      CodeWriter constructor(writer);
+      constructor.set_max(0, 1).op(Opcode::return_);
+      writer.add_method(access::public_, "<init>", "()V", &constructor);
+
+      // Identity, which is what every class gets unless it overrides it.
+      CodeWriter equals(writer);
+      Label different = equals.new_label();
+      equals.set_max(2, 2)
+            .local(Opcode::aload, 0)
+            .local(Opcode::aload, 1)
+            .jump(Opcode::if_acmpne, different)
+            .iconst(1)
+            .op(Opcode::ireturn)
+            .bind(different)
+            .iconst(0)
+            .op(Opcode::ireturn);
+      writer.add_method(access::public_, "equals", "(Ljava/lang/Object;)Z",
+                        &equals);
+
+      writer.add_method(access::public_ | access::native, "hashCode", "()I",
+                        nullptr);
+
+      // Monitors, see `Monitors`.
+      constexpr uint16_t final_native = access::public_ | access::final |
+                                        access::native;
+      writer.add_method(final_native, "wait", "()V", nullptr);
+      writer.add_method(final_native, "wait", "(J)V", nullptr);
+      writer.add_method(final_native, "notify", "()V", nullptr);
+      writer.add_method(final_native, "notifyAll", "()V", nullptr);
+      return writer.finish(size);
+    }
+
+    auto build_string(size_t &size) -> uint8_t * {
+      ClassWriter writer("java/lang/String", "java/lang/Object",
+                         access::public_ | access::final | access::super);
+      writer.add_field(access::private_ | access::final, "value", "[C");
+
+      CodeWriter length(writer);
+      length.set_max(1, 1)
+            .local(Opcode::aload, 0)
+            .field(Opcode::getfield, "java/lang/String", "value", "[C")
+            .op(Opcode::arraylength)
+            .op(Opcode::ireturn);
+      writer.add_method(access::public_, "length", "()I", &length);
+
+      CodeWriter char_at(writer);
+      char_at.set_max(2, 2)
+             .local(Opcode::aload, 0)
+             .field(Opcode::getfield, "java/lang/String", "value", "[C")
+             .local(Opcode::iload, 1)
+             .op(Opcode::caload)
+             .op(Opcode::ireturn);
+      writer.add_method(access::public_, "charAt", "(I)C", &char_at);
+
+      CodeWriter to_string(writer);
+      to_string.set_max(1, 1).local(Opcode::aload, 0).op(Opcode::areturn);
+      writer.add_method(access::public_, "toString", "()Ljava/lang/String;",
+                        &to_string);
+
+      writer.add_method(access::public_ | access::native, "equals",
+                        "(Ljava/lang/Object;)Z", nullptr);
+      writer.add_method(access::public_ | access::native, "hashCode", "()I",
+                        nullptr);
+      return writer.finish(size);
+    }
+
+    auto build_print_stream(size_t &size) -> uint8_t * {
+      ClassWriter writer("java/io/PrintStream");
+      writer.add_field(access::private_ | access::final, "fd", "I");
+
+      CodeWriter constructor(writer);
+      constructor.set_max(2, 2)
+                 .local(Opcode::aload, 0)
+                 .invoke(Opcode::invokespecial, "java/lang/Object", "<init>",
+                         "()V")
+                 .local(Opcode::aload, 0)
+                 .local(Opcode::iload, 1)
+                 .field(Opcode::putfield, "java/io/PrintStream", "fd", "I")
+                 .op(Opcode::return_);
+      writer.add_method(access::public_, "<init>", "(I)V", &constructor);
+
+      char const *const descriptors[] {
+        "()V", "(Ljava/lang/String;)V", "(I)V", "(J)V", "(C)V", "(Z)V",
+        "(F)V", "(D)V",
+      };
+      for (char const *descriptor : descriptors) {
+        writer.add_method(access::public_ | access::native, "println",
+                          descriptor, nullptr);
+        if (descriptor[1] != ')') {
+          writer.add_method(access::public_ | access::native, "print",
+                            descriptor, nullptr);
+        }
+      }
+      writer.add_method(access::public_ | access::native, "flush", "()V",
+                        nullptr);
+      return writer.finish(size);
+    }
+
+    auto build_system(size_t &size) -> uint8_t * {
+      ClassWriter writer("java/lang/System", "java/lang/Object",
+                         access::public_ | access::final | access::super);
+      writer.add_field(access::public_ | access::static_ | access::final,
+                       "out", "Ljava/io/PrintStream;");
+      writer.add_field(access::public_ | access::static_ | access::final,
+                       "err", "Ljava/io/PrintStream;");
+
+      CodeWriter initializer(writer);
+      initializer.set_max(3, 0);
+      char const *const streams[] {"out", "err"};
+      for (int fd = 1; fd <= 2; ++fd) {
+        initializer.type(Opcode::new_, "java/io/PrintStream")
+                   .op(Opcode::dup)
+                   .iconst(fd)
+                   .invoke(Opcode::invokespecial, "java/io/PrintStream",
+                           "<init>", "(I)V")
+                   .field(Opcode::putstatic, "java/lang/System",
+                          streams[fd - 1], "Ljava/io/PrintStream;");
+      }
+      initializer.op(Opcode::return_);
+      writer.add_method(access::static_, "<clinit>", "()V", &initializer);
+
+      uint16_t const natives = access::public_ | access::static_ |
+                               access::native;
+      writer.add_method(natives, "currentTimeMillis", "()J", nullptr);
+      writer.add_method(natives, "nanoTime", "()J", nullptr);
+      writer.add_method(natives, "arraycopy",
+                        "(Ljava/lang/Object;ILjava/lang/Object;II)V", nullptr);
+      writer.add_method(natives, "identityHashCode", "(Ljava/lang/Object;)I",
+                        nullptr);
+      writer.add_method(natives, "exit", "(I)V", nullptr);
+      return writer.finish(size);
+    }
+
+    auto build_throwable(size_t &size) -> uint8_t * {
+      ClassWriter writer("java/lang/Throwable");
+      writer.add_field(access::private_, "detailMessage",
+                       "Ljava/lang/String;");
+      add_forwarding_constructor(writer, "java/lang/Object", "()V", false);
+
+      CodeWriter with_message(writer);
+      with_message.set_max(2, 2)
+                  .local(Opcode::aload, 0)
+                  .invoke(Opcode::invokespecial, "java/lang/Object", "<init>",
+                          "()V")
+                  .local(Opcode::aload, 0)
+                  .local(Opcode::aload, 1)
+                  .field(Opcode::putfield, "java/lang/Throwable",
+                         "detailMessage", "Ljava/lang/String;")
+                  .op(Opcode::return_);
+      writer.add_method(access::public_, "<init>", "(Ljava/lang/String;)V",
+                        &with_message);
+
+      CodeWriter get_message(writer);
+      get_message.set_max(1, 1)
+                 .local(Opcode::aload, 0)
+                 .field(Opcode::getfield, "java/lang/Throwable",
+                        "detailMessage", "Ljava/lang/String;")
+                 .op(Opcode::areturn);
+      writer.add_method(access::public_, "getMessage", "()Ljava/lang/String;",
+                        &get_message);
+      return writer.finish(size);
+    }
+
+    auto build_subclass(ThrowableClass const &throwable, size_t &size)
+        -> uint8_t * {
+      ClassWriter writer(throwable.name, throwable.super);
+      add_forwarding_constructor(writer, throwable.super, "()V", false);
+      add_forwarding_constructor(writer, throwable.super,
+                                 "(Ljava/lang/String;)V", true);
+      return writer.finish(size);
+    }
+  } // namespace
+
+  auto build_bootstrap_class(Utf8View name, size_t &size) -> uint8_t * {
+    if (name.equals("java/lang/Object")) { return build_object(size); }
+    if (name.equals("java/lang/String")) { return build_string(size); }
+    if (name.equals("java/lang/System")) { return build_system(size); }
+    if (name.equals("java/io/PrintStream")) {
+      return build_print_stream(size);
+    }
+    if (name.equals("java/lang/Throwable")) { return build_throwable(size); }
+    for (ThrowableClass const &throwable : throwable_classes) {
+      if (name.equals(throwable.name)) {
+        return build_subclass(throwable, size);
+      }
+    }
+    return nullptr;
+  }
+} // namespace skjvm
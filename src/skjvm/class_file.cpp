@@ -0,0 +1,555 @@
+#include <skjvm/class_file.hpp>
+
+#include <skjvm/unicode.hpp>
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace skjvm {
+  namespace {
+    constexpr uint32_t class_file_magic = 0xcafebabe;
+
+    /// Bounds-checked reader over the class file, used by \c parse only.
+    struct Cursor {
+      uint8_t const *data;
+      size_t size;
+      size_t position {0};
+
+      [[nodiscard]]
+      auto has(size_t count) const -> bool {
+        return size - position >= count;
+      }
+
+      auto u1() -> uint8_t {
+        return data[position++];
+      }
+
+      auto u2() -> uint16_t {
+        uint16_t value = read_u2(data + position);
+        position += 2;
+        return value;
+      }
+
+      auto u4() -> uint32_t {
+        uint32_t value = read_u4(data + position);
+        position += 4;
+        return value;
+      }
+    };
+
+    /// Skip \p count attributes, checking that each one fits in the buffer.
+    auto skip_attributes(Cursor &cursor, uint16_t count) -> bool {
+      for (uint16_t i = 0; i < count; ++i) {
+        if (not cursor.has(6)) { return false; }
+        cursor.position += 2;
+        uint32_t length = cursor.u4();
+        if (not cursor.has(length)) { return false; }
+        cursor.position += length;
+      }
+      return true;
+    }
+  } // namespace
+
+  auto describe(ClassFileError error) -> char const * {
+    switch (error) {
+      case ClassFileError::none:                return "no error";
+      case ClassFileError::truncated:           return "truncated class file";
+      case ClassFileError::bad_magic:           return "bad magic number";
+      case ClassFileError::unsupported_version: return "unsupported class file version";
+      case ClassFileError::bad_constant_tag:    return "bad constant pool tag";
+      case ClassFileError::bad_constant_index:  return "bad constant pool index";
+      case ClassFileError::bad_member:          return "malformed field or method";
+      case ClassFileError::trailing_bytes:      return "extra bytes at the end of the class file";
+      case ClassFileError::out_of_memory:       return "out of memory";
+    }
+    return "unknown error";
+  }
+
+  auto Utf8View::equals(char const *string) const -> bool {
+    // An empty view may have no bytes at all.
+    if (length == 0) { return string[0] == '\0'; }
+    return strncmp(reinterpret_cast<char const *>(bytes), string, length) == 0 and
+           string[length] == '\0';
+  }
+
+  auto Utf8View::equals(Utf8View other) const -> bool {
+    return length == other.length and
+           (length == 0 or memcmp(bytes, other.bytes, length) == 0);
+  }
+
+  auto Utf8View::hash() const -> uint32_t {
+    uint32_t hash = 2166136261u;
+    for (uint16_t i = 0; i < length; ++i) {
+      hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+  }
+
+  ClassFile::~ClassFile() noexcept {
+    release();
+  }
+
+  auto ClassFile::release() -> void {
+    if (decoded != nullptr) {
+      for (uint16_t i = 0; i < constant_count; ++i) {
+        free(decoded[i]);
+      }
+      free(static_cast<void *>(decoded));
+    }
+    if (owns_tables) {
+      free(constant_offsets);
+      free(members);
+    }
+
+    data = nullptr;
+    size = 0;
+    minor_version = major_version = 0;
+    constant_count = 0;
+    constant_offsets = nullptr;
+    access_flags = this_class = super_class = 0;
+    interface_count = 0;
+    interfaces_offset = 0;
+    members = nullptr;
+    field_count = method_count = 0;
+    attribute_count = 0;
+    attributes_offset = 0;
+    decoded = nullptr;
+    owns_tables = false;
+  }
+
+  auto ClassFile::parse(uint8_t const *bytes, size_t length)
+      -> ClassFileError {
+    release();
+
+    Cursor cursor {bytes, length};
+    if (not cursor.has(10)) { return ClassFileError::truncated; }
+    if (cursor.u4() != class_file_magic) { return ClassFileError::bad_magic; }
+    uint16_t minor = cursor.u2();
+    uint16_t major = cursor.u2();
+    if (major < min_major_version or major > max_major_version) {
+      return ClassFileError::unsupported_version;
+    }
+
+    uint16_t count = cursor.u2();
+    if (count == 0) { return ClassFileError::bad_constant_index; }
+
+    auto *offsets = static_cast<uint32_t *>(calloc(count, sizeof(uint32_t)));
+    if (offsets == nullptr) { return ClassFileError::out_of_memory; }
+
+    // Install what we have so far, so every early return below leaves an
+    // empty object through `release`.
+    data = bytes;
+    size = length;
+    constant_count = count;
+    constant_offsets = offsets;
+    owns_tables = true;
+
+    auto fail = [this](ClassFileError error) {
+      release();
+      return error;
+    };
+
+    // First pass over the constant pool: find where each entry starts.
+    for (uint16_t i = 1; i < count; ++i) {
+      if (not cursor.has(1)) { return fail(ClassFileError::truncated); }
+      offsets[i] = uint32_t(cursor.position);
+      size_t entry_size = 0;
+      switch (ConstantTag(cursor.data[cursor.position])) {
+        case ConstantTag::utf8:
+          if (not cursor.has(3)) { return fail(ClassFileError::truncated); }
+          entry_size = 3 + size_t(read_u2(bytes + cursor.position + 1));
+          break;
+        case ConstantTag::integer:
+        case ConstantTag::float_:
+        case ConstantTag::fieldref:
+        case ConstantTag::methodref:
+        case ConstantTag::interface_methodref:
+        case ConstantTag::name_and_type:
+        case ConstantTag::dynamic:
+        case ConstantTag::invoke_dynamic:
+          entry_size = 5;
+          break;
+        case ConstantTag::long_:
+        case ConstantTag::double_:
+          // Takes two slots, the second one is unusable.
+          if (i + 1 >= count) { return fail(ClassFileError::bad_constant_index); }
+          entry_size = 9;
+          ++i;
+          break;
+        case ConstantTag::class_:
+        case ConstantTag::string:
+        case ConstantTag::method_type:
+        case ConstantTag::module:
+        case ConstantTag::package:
+          entry_size = 3;
+          break;
+        case ConstantTag::method_handle:
+          entry_size = 4;
+          break;
+        default:
+          return fail(ClassFileError::bad_constant_tag);
+      }
+      if (not cursor.has(entry_size)) { return fail(ClassFileError::truncated); }
+      cursor.position += entry_size;
+    }
+
+    // Second pass: references between entries must point to the right kind
+    // of entry, so accessors can follow them without checking again.
+    auto is = [this](uint16_t index, ConstantTag expected) {
+      return tag(index) == expected;
+    };
+    for (uint16_t i = 1; i < count; ++i) {
+      if (offsets[i] == 0) { continue; }
+      uint8_t const *entry = bytes + offsets[i];
+      bool valid = true;
+      switch (ConstantTag(entry[0])) {
+        case ConstantTag::class_:
+        case ConstantTag::string:
+        case ConstantTag::method_type:
+        case ConstantTag::module:
+        case ConstantTag::package:
+          valid = is(read_u2(entry + 1), ConstantTag::utf8);
+          break;
+        case ConstantTag::fieldref:
+        case ConstantTag::methodref:
+        case ConstantTag::interface_methodref:
+          valid = is(read_u2(entry + 1), ConstantTag::class_) and
+                  is(read_u2(entry + 3), ConstantTag::name_and_type);
+          break;
+        case ConstantTag::name_and_type:
+          valid = is(read_u2(entry + 1), ConstantTag::utf8) and
+                  is(read_u2(entry + 3), ConstantTag::utf8);
+          break;
+        case ConstantTag::dynamic:
+        case ConstantTag::invoke_dynamic:
+          // The bootstrap method index refers to the BootstrapMethods
+          // attribute, which is only read when the call site is linked.
+          valid = is(read_u2(entry + 3), ConstantTag::name_and_type);
+          break;
+        case ConstantTag::method_handle: {
+          uint8_t kind = entry[1];
+          ConstantTag target = tag(read_u2(entry + 2));
+          valid = kind >= 1 and kind <= 9 and
+                  (target == ConstantTag::fieldref or
+                   target == ConstantTag::methodref or
+                   target == ConstantTag::interface_methodref);
+          break;
+        }
+        default:
+          break;
+      }
+      if (not valid) { return fail(ClassFileError::bad_constant_index); }
+    }
+
+    if (not cursor.has(8)) { return fail(ClassFileError::truncated); }
+    uint16_t flags = cursor.u2();
+    uint16_t this_index = cursor.u2();
+    uint16_t super_index = cursor.u2();
+    if (not is(this_index, ConstantTag::class_) or
+        (super_index != 0 and not is(super_index, ConstantTag::class_))) {
+      return fail(ClassFileError::bad_constant_index);
+    }
+
+    uint16_t interfaces = cursor.u2();
+    size_t interfaces_position = cursor.position;
+    if (not cursor.has(size_t(interfaces) * 2)) {
+      return fail(ClassFileError::truncated);
+    }
+    for (uint16_t i = 0; i < interfaces; ++i) {
+      if (not is(cursor.u2(), ConstantTag::class_)) {
+        return fail(ClassFileError::bad_constant_index);
+      }
+    }
+
+    // Walk fields and methods once to check them and count them, then
+    // allocate both tables at once and fill them in a second, unchecked walk.
+    uint16_t member_counts[2] {};
+    size_t member_positions[2] {};
+    for (int kind = 0; kind < 2; ++kind) {
+      if (not cursor.has(2)) { return fail(ClassFileError::truncated); }
+      member_counts[kind] = cursor.u2();
+      member_positions[kind] = cursor.position;
+      for (uint16_t i = 0; i < member_counts[kind]; ++i) {
+        if (not cursor.has(8)) { return fail(ClassFileError::truncated); }
+        cursor.position += 2;
+        if (not is(cursor.u2(), ConstantTag::utf8) or
+            not is(cursor.u2(), ConstantTag::utf8)) {
+          return fail(ClassFileError::bad_member);
+        }
+        if (not skip_attributes(cursor, cursor.u2())) {
+          return fail(ClassFileError::truncated);
+        }
+      }
+    }
+
+    if (not cursor.has(2)) { return fail(ClassFileError::truncated); }
+    uint16_t class_attributes = cursor.u2();
+    size_t class_attributes_position = cursor.position;
+    if (not skip_attributes(cursor, class_attributes)) {
+      return fail(ClassFileError::truncated);
+    }
+    if (cursor.position != length) {
+      return fail(ClassFileError::trailing_bytes);
+    }
+
+    size_t member_count = size_t(member_counts[0]) + member_counts[1];
+    if (member_count != 0) {
+      members = static_cast<MemberInfo *>(
+        malloc(member_count * sizeof(MemberInfo)));
+      if (members == nullptr) { return fail(ClassFileError::out_of_memory); }
+    }
+
+    MemberInfo *member = members;
+    for (int kind = 0; kind < 2; ++kind) {
+      Cursor walker {bytes, length, member_positions[kind]};
+      for (uint16_t i = 0; i < member_counts[kind]; ++i, ++member) {
+        member->access_flags = walker.u2();
+        member->name_index = walker.u2();
+        member->descriptor_index = walker.u2();
+        member->attribute_count = walker.u2();
+        member->attributes_offset = uint32_t(walker.position);
+        member->code_offset = MemberInfo::code_unknown;
+        skip_attributes(walker, member->attribute_count);
+      }
+    }
+
+    minor_version = minor;
+    major_version = major;
+    access_flags = flags;
+    this_class = this_index;
+    super_class = super_index;
+    interface_count = interfaces;
+    interfaces_offset = uint32_t(interfaces_position);
+    field_count = member_counts[0];
+    method_count = member_counts[1];
+    attribute_count = class_attributes;
+    attributes_offset = uint32_t(class_attributes_position);
+    return ClassFileError::none;
+  }
+
+  auto ClassFile::tag(uint16_t index) const -> ConstantTag {
+    if (index == 0 or index >= constant_count or
+        constant_offsets[index] == 0) {
+      return ConstantTag::none;
+    }
+    return ConstantTag(data[constant_offsets[index]]);
+  }
+
+  auto ClassFile::utf8(uint16_t index) const -> Utf8View {
+    if (tag(index) != ConstantTag::utf8) { return {}; }
+    uint8_t const *entry = data + constant_offsets[index];
+    return {entry + 3, read_u2(entry + 1)};
+  }
+
+  auto ClassFile::utf16(uint16_t index) const -> Utf16View {
+    if (tag(index) != ConstantTag::utf8) { return {}; }
+
+    if (__atomic_load_n(&decoded, __ATOMIC_ACQUIRE) == nullptr) {
+      auto **table = static_cast<uint16_t **>(
+        calloc(constant_count, sizeof(uint16_t *)));
+      if (table == nullptr) { return {}; }
+      uint16_t **expected = nullptr;
+      if (not __atomic_compare_exchange_n(&decoded, &expected, table, false,
+                                          __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE)) {
+        free(static_cast<void *>(table));
+      }
+    }
+
+    uint16_t *block = __atomic_load_n(&decoded[index], __ATOMIC_ACQUIRE);
+    if (block == nullptr) {
+      Utf8View bytes = utf8(index);
+      int64_t count = decode_modified_utf8(bytes.bytes, bytes.length, nullptr);
+      if (count < 0) { return {}; }
+
+      // Two leading code units hold the length.
+      block = static_cast<uint16_t *>(
+        malloc(size_t(count + 2) * sizeof(uint16_t)));
+      if (block == nullptr) { return {}; }
+      uint32_t units = uint32_t(count);
+      memcpy(block, &units, sizeof(units));
+      decode_modified_utf8(bytes.bytes, bytes.length, block + 2);
+
+      uint16_t *expected = nullptr;
+      if (not __atomic_compare_exchange_n(&decoded[index], &expected, block,
+                                          false, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE)) {
+        // Another thread decoded it first, use its copy.
+        free(block);
+        block = expected;
+      }
+    }
+
+    uint32_t units = 0;
+    memcpy(&units, block, sizeof(units));
+    return {block + 2, units};
+  }
+
+  auto ClassFile::class_name(uint16_t index) const -> Utf8View {
+    if (tag(index) != ConstantTag::class_) { return {}; }
+    return utf8(read_u2(data + constant_offsets[index] + 1));
+  }
+
+  auto ClassFile::string(uint16_t index) const -> Utf8View {
+    if (tag(index) != ConstantTag::string) { return {}; }
+    return utf8(read_u2(data + constant_offsets[index] + 1));
+  }
+
+  auto ClassFile::integer_value(uint16_t index) const -> int32_t {
+    if (tag(index) != ConstantTag::integer) { return 0; }
+    return int32_t(read_u4(data + constant_offsets[index] + 1));
+  }
+
+  auto ClassFile::float_value(uint16_t index) const -> float {
+    if (tag(index) != ConstantTag::float_) { return 0; }
+    uint32_t bits = read_u4(data + constant_offsets[index] + 1);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  auto ClassFile::long_value(uint16_t index) const -> int64_t {
+    if (tag(index) != ConstantTag::long_) { return 0; }
+    return int64_t(read_u8(data + constant_offsets[index] + 1));
+  }
+
+  auto ClassFile::double_value(uint16_t index) const -> double {
+    if (tag(index) != ConstantTag::double_) { return 0; }
+    uint64_t bits = read_u8(data + constant_offsets[index] + 1);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  auto ClassFile::name_and_type(uint16_t index) const -> NameAndType {
+    if (tag(index) != ConstantTag::name_and_type) { return {}; }
+    uint8_t const *entry = data + constant_offsets[index];
+    return {utf8(read_u2(entry + 1)), utf8(read_u2(entry + 3))};
+  }
+
+  auto ClassFile::member_ref(uint16_t index) const -> MemberRef {
+    ConstantTag kind = tag(index);
+    if (kind != ConstantTag::fieldref and kind != ConstantTag::methodref and
+        kind != ConstantTag::interface_methodref) {
+      return {};
+    }
+    uint8_t const *entry = data + constant_offsets[index];
+    NameAndType name_type = name_and_type(read_u2(entry + 3));
+    return {class_name(read_u2(entry + 1)), name_type.name,
+            name_type.descriptor, read_u2(entry + 1)};
+  }
+
+  auto ClassFile::interface_name(uint16_t index) const -> Utf8View {
+    if (index >= interface_count) { return {}; }
+    return class_name(read_u2(data + interfaces_offset + size_t(index) * 2));
+  }
+
+  auto ClassFile::find_attribute(AttributeList list, char const *name) const
+      -> AttributeView {
+    for (AttributeView attribute : list) {
+      if (utf8(attribute.name_index).equals(name)) {
+        return attribute;
+      }
+    }
+    return {};
+  }
+
+  auto ClassFile::code(MemberInfo const &method) const -> CodeView {
+    uint32_t offset = __atomic_load_n(&method.code_offset, __ATOMIC_RELAXED);
+    if (offset == MemberInfo::code_unknown) {
+      offset = 0;
+      AttributeView attribute = find_attribute(attributes(method), "Code");
+      if (attribute.is_present() and attribute.length >= 12) {
+        // Check the layout once, so the decoding below can trust it.
+        uint8_t const *payload = attribute.data;
+        uint32_t code_length = read_u4(payload + 4);
+        Cursor cursor {payload, attribute.length, 8};
+        bool valid = code_length != 0 and code_length < 65536 and
+                     cursor.has(size_t(code_length) + 2);
+        if (valid) {
+          cursor.position += code_length;
+          uint16_t handlers = cursor.u2();
+          valid = cursor.has(size_t(handlers) * 8 + 2);
+          if (valid) {
+            cursor.position += size_t(handlers) * 8;
+            valid = skip_attributes(cursor, cursor.u2()) and
+                    cursor.position == attribute.length;
+          }
+        }
+        if (valid) {
+          offset = uint32_t(payload - data);
+        }
+      }
+      __atomic_store_n(&method.code_offset, offset, __ATOMIC_RELAXED);
+    }
+    if (offset == 0) { return {}; }
+
+    uint8_t const *payload = data + offset;
+    CodeView view;
+    view.max_stack = read_u2(payload);
+    view.max_locals = read_u2(payload + 2);
+    view.code_length = read_u4(payload + 4);
+    view.code = payload + 8;
+    uint8_t const *handlers = view.code + view.code_length;
+    view.exception_table_length = read_u2(handlers);
+    view.exception_table = handlers + 2;
+    uint8_t const *attributes =
+      view.exception_table + size_t(view.exception_table_length) * 8;
+    view.attributes = {attributes + 2, read_u2(attributes)};
+    return view;
+  }
+
+  auto ClassFile::find_method(char const *name, char const *descriptor) const
+      -> MemberInfo const * {
+    for (MemberInfo const &method : methods()) {
+      if (utf8(method.name_index).equals(name) and
+          utf8(method.descriptor_index).equals(descriptor)) {
+        return &method;
+      }
+    }
+    return nullptr;
+  }
+
+  auto ClassFile::adopt(uint8_t const *bytes, size_t length,
+                        ClassFileTables const &tables) -> void {
+    release();
+    data = bytes;
+    size = length;
+    minor_version = tables.minor_version;
+    major_version = tables.major_version;
+    constant_count = tables.constant_count;
+    constant_offsets = const_cast<uint32_t *>(tables.constant_offsets);
+    access_flags = tables.access_flags;
+    this_class = tables.this_class;
+    super_class = tables.super_class;
+    interface_count = tables.interface_count;
+    interfaces_offset = tables.interfaces_offset;
+    members = const_cast<MemberInfo *>(tables.members);
+    field_count = tables.field_count;
+    method_count = tables.method_count;
+    attribute_count = tables.attribute_count;
+    attributes_offset = tables.attributes_offset;
+  }
+
+  auto ClassFile::tables() const -> ClassFileTables {
+    for (MemberInfo const &method : methods()) {
+      (void)code(method);
+    }
+    ClassFileTables result {};
+    result.minor_version = minor_version;
+    result.major_version = major_version;
+    result.constant_count = constant_count;
+    result.access_flags = access_flags;
+    result.this_class = this_class;
+    result.super_class = super_class;
+    result.interface_count = interface_count;
+    result.field_count = field_count;
+    result.method_count = method_count;
+    result.attribute_count = attribute_count;
+    result.interfaces_offset = interfaces_offset;
+    result.attributes_offset = attributes_offset;
+    result.constant_offsets = constant_offsets;
+    result.members = members;
+    return result;
+  }
+} // namespace skjvm
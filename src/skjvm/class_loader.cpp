@@ -0,0 +1,304 @@
+#include <skjvm/class_loader.hpp>
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace skjvm {
+  namespace {
+    /// The element class named by a \c CONSTANT_Class, which for arrays is a
+    /// descriptor like \c [[Ljava/lang/String; . Primitive arrays have none.
+    auto element_class(Utf8View name) -> Utf8View {
+      if (name.length == 0 or name.bytes[0] != '[') { return name; }
+      uint16_t dimensions = 0;
+      while (dimensions < name.length and name.bytes[dimensions] == '[') {
+        ++dimensions;
+      }
+      if (dimensions + 2 >= name.length or name.bytes[dimensions] != 'L' or
+          name.bytes[name.length - 1] != ';') {
+        return {};
+      }
+      return {name.bytes + dimensions + 1,
+              uint16_t(name.length - dimensions - 2)};
+    }
+
+    class MutexGuard {
+      pthread_mutex_t &mutex;
+
+     public:
+      explicit MutexGuard(pthread_mutex_t &mutex) noexcept : mutex(mutex) {
+        pthread_mutex_lock(&mutex);
+      }
+      MutexGuard(MutexGuard const&) = delete;
+      auto operator=(MutexGuard const&) -> MutexGuard & = delete;
+      ~MutexGuard() noexcept {
+        pthread_mutex_unlock(&mutex);
+      }
+    };
+  } // namespace
+
+  ClassLoader::ClassLoader(ClassPath const &class_path) noexcept
+    : class_path(class_path) {}
+
+  ClassLoader::~ClassLoader() noexcept {
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_broadcast(&work_available);
+    pthread_mutex_unlock(&mutex);
+    for (pthread_t worker : workers) {
+      pthread_join(worker, nullptr);
+    }
+
+    for (uint32_t i = 0; i < capacity; ++i) {
+      if (LoadedClass *loaded = table[i]) {
+        loaded->class_file.~ClassFile();
+        loaded->file.~MappedFile();
+        free(loaded->defined_data);
+        free(loaded);
+      }
+    }
+    free(static_cast<void *>(table));
+    pthread_cond_destroy(&work_available);
+    pthread_cond_destroy(&state_changed);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  auto ClassLoader::find_locked(Utf8View name, uint32_t hash) const
+      -> LoadedClass * {
+    if (capacity == 0) { return nullptr; }
+    for (uint32_t slot = hash & (capacity - 1);;
+         slot = (slot + 1) & (capacity - 1)) {
+      LoadedClass *loaded = table[slot];
+      if (loaded == nullptr) { return nullptr; }
+      if (loaded->hash == hash and loaded->name.equals(name)) {
+        return loaded;
+      }
+    }
+  }
+
+  auto ClassLoader::insert_locked(Utf8View name, uint32_t hash,
+                                  LoadState state) -> LoadedClass * {
+    if ((count + 1) * 2 > capacity) {
+      uint32_t grown = capacity == 0 ? 64 : capacity * 2;
+      auto **resized = static_cast<LoadedClass **>(
+        checked_calloc(grown, sizeof(LoadedClass *)));
+      for (uint32_t i = 0; i < capacity; ++i) {
+        if (LoadedClass *loaded = table[i]) {
+          uint32_t slot = loaded->hash & (grown - 1);
+          while (resized[slot] != nullptr) { slot = (slot + 1) & (grown - 1); }
+          resized[slot] = loaded;
+        }
+      }
+      free(static_cast<void *>(table));
+      table = resized;
+      capacity = grown;
+    }
+
+    // The name is copied after the object, so it does not depend on who
+    // asked for the class.
+    auto *loaded = static_cast<LoadedClass *>(
+      checked_calloc(1, sizeof(LoadedClass) + name.length + 1));
+    auto *name_copy = reinterpret_cast<uint8_t *>(loaded + 1);
+    memcpy(name_copy, name.bytes, name.length);
+    loaded->name = {name_copy, name.length};
+    loaded->hash = hash;
+    loaded->state = state;
+    loaded->error = ClassFileError::none;
+    // The members are trivially constructible to zero, which is their
+    // default state.
+
+    uint32_t slot = hash & (capacity - 1);
+    while (table[slot] != nullptr) { slot = (slot + 1) & (capacity - 1); }
+    table[slot] = loaded;
+    ++count;
+    return loaded;
+  }
+
+  auto ClassLoader::enqueue_locked(Utf8View name) -> void {
+    if (name.length == 0) { return; }
+    uint32_t hash = name.hash();
+    if (find_locked(name, hash) != nullptr) { return; }
+    queue.push(insert_locked(name, hash, LoadState::queued));
+    pthread_cond_signal(&work_available);
+  }
+
+  auto ClassLoader::enqueue_references_locked(LoadedClass const &loaded)
+      -> void {
+    ClassFile const &class_file = loaded.class_file;
+    for (uint16_t i = 1; i < class_file.get_constant_count(); ++i) {
+      if (class_file.tag(i) == ConstantTag::class_) {
+        enqueue_locked(element_class(class_file.class_name(i)));
+      }
+    }
+  }
+
+  auto ClassLoader::load_now(LoadedClass &loaded) -> void {
+    bool found = false;
+    ClassFileError error = ClassFileError::none;
+    char path[PATH_MAX];
+    if (ClassPath::Entry const *entry = class_path.find(loaded.name)) {
+      found = class_path.path_of(*entry, path, sizeof(path)) and
+              loaded.file.open(path);
+    }
+    if (found) {
+      error = loaded.class_file.parse(loaded.file.get_data(),
+                                      loaded.file.get_size());
+      // A class file in the wrong place is not the class we were asked for.
+      if (error == ClassFileError::none and
+          not loaded.class_file.this_class_name().equals(loaded.name)) {
+        found = false;
+      }
+    }
+
+    MutexGuard guard(mutex);
+    bool success = found and error == ClassFileError::none;
+    loaded.not_found = not found;
+    loaded.error = error;
+    loaded.state = success ? LoadState::loaded : LoadState::failed;
+    if (success) {
+      ++loaded_count;
+      if (verbose) {
+        printf("[Loaded %.*s from %s]\n", int(loaded.name.length),
+               reinterpret_cast<char const *>(loaded.name.bytes), path);
+      }
+      if (not workers.is_empty()) {
+        enqueue_references_locked(loaded);
+      }
+    }
+    pthread_cond_broadcast(&state_changed);
+  }
+
+  auto ClassLoader::load(Utf8View name) -> LoadedClass & {
+    uint32_t hash = name.hash();
+    LoadedClass *loaded = nullptr;
+    bool mine = false;
+    {
+      MutexGuard guard(mutex);
+      loaded = find_locked(name, hash);
+      if (loaded == nullptr) {
+        loaded = insert_locked(name, hash, LoadState::loading);
+        mine = true;
+      } else if (loaded->state == LoadState::queued) {
+        // Do not wait for a worker to get to it; it skips the class once it
+        // sees it is no longer queued.
+        loaded->state = LoadState::loading;
+        mine = true;
+      } else {
+        while (loaded->state == LoadState::loading) {
+          pthread_cond_wait(&state_changed, &mutex);
+        }
+      }
+    }
+    if (mine) {
+      load_now(*loaded);
+    }
+    return *loaded;
+  }
+
+  auto ClassLoader::define(Utf8View name, uint8_t *data, size_t size)
+      -> LoadedClass & {
+    uint32_t hash = name.hash();
+    MutexGuard guard(mutex);
+    LoadedClass *loaded = find_locked(name, hash);
+    if (loaded == nullptr) {
+      loaded = insert_locked(name, hash, LoadState::queued);
+    }
+    // Someone else may be loading it from the class path.
+    while (loaded->state == LoadState::loading) {
+      pthread_cond_wait(&state_changed, &mutex);
+    }
+    if (loaded->state == LoadState::loaded) {
+      free(data);
+      return *loaded;
+    }
+
+    loaded->file.close();
+    loaded->defined_data = data;
+    ClassFileError error = loaded->class_file.parse(data, size);
+    bool success = error == ClassFileError::none and
+                   loaded->class_file.this_class_name().equals(name);
+    loaded->not_found = false;
+    loaded->error = error;
+    loaded->state = success ? LoadState::loaded : LoadState::failed;
+    if (success) {
+      ++loaded_count;
+      if (verbose) {
+        printf("[Loaded %.*s from built-in classes]\n", int(name.length),
+               reinterpret_cast<char const *>(name.bytes));
+      }
+    }
+    pthread_cond_broadcast(&state_changed);
+    return *loaded;
+  }
+
+  auto ClassLoader::preload(Utf8View name) -> void {
+    MutexGuard guard(mutex);
+    if (workers.is_empty()) { return; }
+    enqueue_locked(name);
+  }
+
+  auto ClassLoader::start_workers(uint32_t worker_count) -> void {
+    MutexGuard guard(mutex);
+    if (not workers.is_empty()) { return; }
+    for (uint32_t i = 0; i < worker_count; ++i) {
+      pthread_t thread;
+      if (pthread_create(&thread, nullptr, &ClassLoader::worker_main, this) ==
+          0) {
+        workers.push(thread);
+      }
+    }
+  }
+
+  auto ClassLoader::worker_main(void *loader) -> void * {
+    static_cast<ClassLoader *>(loader)->work();
+    return nullptr;
+  }
+
+  auto ClassLoader::work() -> void {
+    pthread_mutex_lock(&mutex);
+    while (not stopping) {
+      if (queue_head == queue.get_size()) {
+        pthread_cond_wait(&work_available, &mutex);
+        continue;
+      }
+      LoadedClass *loaded = queue[queue_head++];
+      if (queue_head == queue.get_size()) {
+        queue.clear();
+        queue_head = 0;
+      }
+      if (loaded->state == LoadState::queued) {
+        loaded->state = LoadState::loading;
+        ++busy_workers;
+        pthread_mutex_unlock(&mutex);
+        load_now(*loaded);
+        pthread_mutex_lock(&mutex);
+        --busy_workers;
+      }
+      if (busy_workers == 0 and queue_head == queue.get_size()) {
+        pthread_cond_broadcast(&state_changed);
+      }
+    }
+    pthread_mutex_unlock(&mutex);
+  }
+
+  auto ClassLoader::wait_idle() -> void {
+    MutexGuard guard(mutex);
+    while (busy_workers != 0 or
+           (queue_head != queue.get_size() and not workers.is_empty())) {
+      pthread_cond_wait(&state_changed, &mutex);
+    }
+  }
+
+  auto ClassLoader::find_loaded(Utf8View name) const -> LoadedClass const * {
+    MutexGuard guard(mutex);
+    LoadedClass const *loaded = find_locked(name, name.hash());
+    return loaded != nullptr and loaded->state == LoadState::loaded ? loaded
+                                                                     : nullptr;
+  }
+
+  auto ClassLoader::get_loaded_count() const -> uint32_t {
+    MutexGuard guard(mutex);
+    return loaded_count;
+  }
+} // namespace skjvm
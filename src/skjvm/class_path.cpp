@@ -0,0 +1,418 @@
+#include <skjvm/class_path.hpp>
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+namespace skjvm {
+  namespace {
+    constexpr char cache_magic[8] {'S', 'K', 'C', 'P', 'I', 'X', '0', '1'};
+
+    /// Missing directories are recorded with this modification time, so a
+    /// class path root that appears later invalidates the cache.
+    constexpr int64_t missing_mtime = -1;
+
+    /// Header of the cache file, followed by the roots, directories, entries,
+    /// slots and strings of the index, each section 8-byte aligned.
+    struct CacheHeader {
+      char magic[8];
+      uint32_t root_count;
+      uint32_t directory_count;
+      uint32_t entry_count;
+      uint32_t slot_count;
+      uint32_t strings_size;
+      uint32_t class_path_offset;
+      uint64_t total_size;
+    };
+
+    constexpr auto align8(size_t size) -> size_t {
+      return (size + 7) & ~size_t(7);
+    }
+
+    struct CacheLayout {
+      size_t roots;
+      size_t directories;
+      size_t entries;
+      size_t slots;
+      size_t strings;
+      size_t total;
+    };
+
+    auto layout_of(CacheHeader const &header) -> CacheLayout {
+      CacheLayout layout {};
+      layout.roots = align8(sizeof(CacheHeader));
+      layout.directories = layout.roots +
+                           align8(size_t(header.root_count) * sizeof(uint32_t));
+      layout.entries = layout.directories +
+                       size_t(header.directory_count) *
+                         sizeof(ClassPath::Directory);
+      layout.slots = layout.entries +
+                     align8(size_t(header.entry_count) *
+                            sizeof(ClassPath::Entry));
+      layout.strings = layout.slots +
+                       align8(size_t(header.slot_count) * sizeof(uint32_t));
+      layout.total = layout.strings + header.strings_size;
+      return layout;
+    }
+
+    auto mtime_of(struct stat const &status, int64_t &sec, int64_t &nsec)
+        -> void {
+#if defined(__APPLE__)
+      sec = int64_t(status.st_mtimespec.tv_sec);
+      nsec = int64_t(status.st_mtimespec.tv_nsec);
+#else
+      sec = int64_t(status.st_mtim.tv_sec);
+      nsec = int64_t(status.st_mtim.tv_nsec);
+#endif
+    }
+
+    /// Call \p visit with each root of \p class_path, made absolute when it
+    /// exists. An empty element means the current directory.
+    template <typename Visitor>
+    auto for_each_root(char const *class_path, Visitor &&visit) -> void {
+      char given[PATH_MAX];
+      char resolved[PATH_MAX];
+      char const *start = class_path;
+      while (true) {
+        char const *end = strchr(start, ':');
+        size_t length = end == nullptr ? strlen(start) : size_t(end - start);
+        if (length == 0) {
+          strcpy(given, ".");
+        } else if (length < sizeof(given)) {
+          memcpy(given, start, length);
+          given[length] = '\0';
+        } else {
+          given[0] = '\0';
+        }
+        if (given[0] != '\0') {
+          visit(realpath(given, resolved) != nullptr ? resolved : given);
+        }
+        if (end == nullptr) { break; }
+        start = end + 1;
+      }
+    }
+
+
+  } // namespace
+
+  auto ClassPath::normalize(char const *class_path, PodVector<char> &out)
+      -> void {
+    out.clear();
+    for_each_root(class_path, [&out](char const *root) {
+      if (not out.is_empty()) { out.push(':'); }
+      for (char const *c = root; *c != '\0'; ++c) { out.push(*c); }
+    });
+    out.push('\0');
+  }
+
+  auto ClassPath::add_string(char const *string, size_t length) -> uint32_t {
+    auto offset = uint32_t(owned_strings.get_size());
+    owned_strings.reserve(owned_strings.get_size() + length + 1);
+    for (size_t i = 0; i < length; ++i) {
+      owned_strings.push(string[i]);
+    }
+    owned_strings.push('\0');
+    return offset;
+  }
+
+  auto ClassPath::open(char const *class_path, char const *cache_path)
+      -> void {
+    if (cache_path != nullptr and load_cache(class_path, cache_path)) {
+      return;
+    }
+    scan(class_path);
+    if (cache_path != nullptr) {
+      // A cache that cannot be written only costs the next run a scan.
+      (void)save_cache(class_path, cache_path);
+    }
+  }
+
+  auto ClassPath::scan(char const *class_path) -> void {
+    cache.close();
+    from_cache = false;
+    owned_strings.clear();
+    owned_entries.clear();
+    owned_directories.clear();
+    owned_roots.clear();
+
+    for_each_root(class_path, [this](char const *root) {
+      if (owned_roots.get_size() == UINT16_MAX) { return; }
+      auto index = uint16_t(owned_roots.get_size());
+      size_t length = strlen(root);
+      owned_roots.push(add_string(root, length));
+
+      char path[PATH_MAX];
+      memcpy(path, root, length + 1);
+      struct stat status {};
+      if (stat(path, &status) != 0 or not S_ISDIR(status.st_mode)) {
+        Directory missing {};
+        missing.path_offset = owned_roots[index];
+        missing.mtime_sec = missing_mtime;
+        owned_directories.push(missing);
+        return;
+      }
+      scan_directory(path, length, length, index);
+    });
+
+    build_slots();
+    use_owned();
+  }
+
+  auto ClassPath::scan_directory(char *path, size_t length,
+                                 size_t root_length, uint16_t root) -> void {
+    DIR *directory = opendir(path);
+    if (directory == nullptr) { return; }
+
+    // Take the modification time before reading, so a change made during
+    // the scan invalidates the cache on the next run.
+    Directory record {};
+    record.path_offset = add_string(path, length);
+    struct stat status {};
+    if (fstat(dirfd(directory), &status) == 0) {
+      mtime_of(status, record.mtime_sec, record.mtime_nsec);
+    }
+    owned_directories.push(record);
+
+    while (dirent *item = readdir(directory)) {
+      char const *name = item->d_name;
+      if (strcmp(name, ".") == 0 or strcmp(name, "..") == 0) { continue; }
+      size_t name_length = strlen(name);
+      if (length + 1 + name_length >= PATH_MAX) { continue; }
+
+      path[length] = '/';
+      memcpy(path + length + 1, name, name_length + 1);
+      size_t child_length = length + 1 + name_length;
+
+      bool is_directory = item->d_type == DT_DIR;
+      bool is_file = item->d_type == DT_REG;
+      if (item->d_type == DT_UNKNOWN or item->d_type == DT_LNK) {
+        struct stat child {};
+        if (stat(path, &child) == 0) {
+          is_directory = S_ISDIR(child.st_mode);
+          is_file = S_ISREG(child.st_mode);
+        }
+      }
+
+      if (is_directory) {
+        scan_directory(path, child_length, root_length, root);
+      } else if (is_file and name_length > 6 and
+                 strcmp(name + name_length - 6, ".class") == 0) {
+        size_t class_name_length = child_length - 6 - (root_length + 1);
+        if (class_name_length <= UINT16_MAX) {
+          Entry entry {};
+          entry.name_offset = add_string(path + root_length + 1,
+                                         class_name_length);
+          entry.name_length = uint16_t(class_name_length);
+          entry.root = root;
+          owned_entries.push(entry);
+        }
+      }
+    }
+    path[length] = '\0';
+    closedir(directory);
+  }
+
+  auto ClassPath::build_slots() -> void {
+    uint32_t count = 16;
+    while (count < owned_entries.get_size() * 2) { count *= 2; }
+    owned_slots.clear();
+    owned_slots.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) { owned_slots.push(0); }
+
+    // Entries of earlier roots come first; drop later duplicates so the
+    // first root that has a class wins.
+    size_t kept = 0;
+    for (size_t i = 0; i < owned_entries.get_size(); ++i) {
+      Entry entry = owned_entries[i];
+      Utf8View name {
+        reinterpret_cast<uint8_t const *>(owned_strings.get_data() +
+                                          entry.name_offset),
+        entry.name_length};
+      entry.hash = name.hash();
+
+      uint32_t slot = entry.hash & (count - 1);
+      bool duplicate = false;
+      while (owned_slots[slot] != 0) {
+        Entry const &other = owned_entries[owned_slots[slot] - 1];
+        if (other.hash == entry.hash and other.name_length == entry.name_length and
+            memcmp(owned_strings.get_data() + other.name_offset,
+                   name.bytes, name.length) == 0) {
+          duplicate = true;
+          break;
+        }
+        slot = (slot + 1) & (count - 1);
+      }
+      if (duplicate) { continue; }
+
+      owned_entries[kept] = entry;
+      owned_slots[slot] = uint32_t(++kept);
+    }
+    owned_entries.truncate(kept);
+  }
+
+  auto ClassPath::use_owned() -> void {
+    strings = owned_strings.get_data();
+    entries = owned_entries.get_data();
+    entry_count = uint32_t(owned_entries.get_size());
+    directories = owned_directories.get_data();
+    directory_count = uint32_t(owned_directories.get_size());
+    slots = owned_slots.get_data();
+    slot_count = uint32_t(owned_slots.get_size());
+    roots = owned_roots.get_data();
+    root_count = uint32_t(owned_roots.get_size());
+  }
+
+  auto ClassPath::find(Utf8View name) const -> Entry const * {
+    if (slot_count == 0) { return nullptr; }
+    uint32_t hash = name.hash();
+    for (uint32_t slot = hash & (slot_count - 1);; slot = (slot + 1) & (slot_count - 1)) {
+      uint32_t index = slots[slot];
+      if (index == 0) { return nullptr; }
+      Entry const &entry = entries[index - 1];
+      if (entry.hash == hash and entry.name_length == name.length and
+          memcmp(strings + entry.name_offset, name.bytes, name.length) == 0) {
+        return &entry;
+      }
+    }
+  }
+
+  auto ClassPath::path_of(Entry const &entry, char *buffer,
+                          size_t capacity) const -> bool {
+    int length = snprintf(buffer, capacity, "%s/%.*s.class",
+                          root_path(entry.root), int(entry.name_length),
+                          strings + entry.name_offset);
+    return length >= 0 and size_t(length) < capacity;
+  }
+
+  auto ClassPath::load_cache(char const *class_path, char const *cache_path)
+      -> bool {
+    if (not cache.open(cache_path)) { return false; }
+
+    auto reject = [this] {
+      cache.close();
+      return false;
+    };
+
+    CacheHeader header {};
+    if (cache.get_size() < sizeof(header)) { return reject(); }
+    memcpy(&header, cache.get_data(), sizeof(header));
+    CacheLayout layout = layout_of(header);
+    if (memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 or
+        header.total_size != cache.get_size() or
+        layout.total != cache.get_size() or header.strings_size == 0 or
+        header.class_path_offset >= header.strings_size or
+        (header.slot_count & (header.slot_count - 1)) != 0 or
+        header.slot_count < header.entry_count) {
+      return reject();
+    }
+
+    uint8_t const *base = cache.get_data();
+    auto const *cached_strings = reinterpret_cast<char const *>(
+      base + layout.strings);
+    if (cached_strings[header.strings_size - 1] != '\0') { return reject(); }
+
+    PodVector<char> normalized;
+    normalize(class_path, normalized);
+    if (strcmp(cached_strings + header.class_path_offset,
+               normalized.get_data()) != 0) {
+      return reject();
+    }
+
+    auto const *cached_directories = reinterpret_cast<Directory const *>(
+      base + layout.directories);
+    for (uint32_t i = 0; i < header.directory_count; ++i) {
+      Directory const &directory = cached_directories[i];
+      if (directory.path_offset >= header.strings_size) { return reject(); }
+      struct stat status {};
+      bool exists = stat(cached_strings + directory.path_offset, &status) == 0 and
+                    S_ISDIR(status.st_mode);
+      if (not exists) {
+        if (directory.mtime_sec == missing_mtime) { continue; }
+        return reject();
+      }
+      int64_t sec = 0;
+      int64_t nsec = 0;
+      mtime_of(status, sec, nsec);
+      if (sec != directory.mtime_sec or nsec != directory.mtime_nsec) {
+        return reject();
+      }
+    }
+
+    owned_strings.clear();
+    owned_entries.clear();
+    owned_directories.clear();
+    owned_slots.clear();
+    owned_roots.clear();
+
+    strings = cached_strings;
+    roots = reinterpret_cast<uint32_t const *>(base + layout.roots);
+    root_count = header.root_count;
+    directories = cached_directories;
+    directory_count = header.directory_count;
+    entries = reinterpret_cast<Entry const *>(base + layout.entries);
+    entry_count = header.entry_count;
+    slots = reinterpret_cast<uint32_t const *>(base + layout.slots);
+    slot_count = header.slot_count;
+    from_cache = true;
+    return true;
+  }
+
+  auto ClassPath::save_cache(char const *class_path, char const *cache_path)
+      const -> bool {
+    PodVector<char> normalized;
+    normalize(class_path, normalized);
+
+    CacheHeader header {};
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.root_count = root_count;
+    header.directory_count = directory_count;
+    header.entry_count = entry_count;
+    header.slot_count = slot_count;
+    header.class_path_offset = uint32_t(owned_strings.get_size());
+    header.strings_size = uint32_t(owned_strings.get_size() +
+                                   normalized.get_size());
+    CacheLayout layout = layout_of(header);
+    header.total_size = layout.total;
+
+    auto *image = static_cast<uint8_t *>(checked_calloc(1, layout.total));
+    memcpy(image, &header, sizeof(header));
+    memcpy(image + layout.roots, roots, root_count * sizeof(uint32_t));
+    memcpy(image + layout.directories, directories,
+           directory_count * sizeof(Directory));
+    memcpy(image + layout.entries, entries, entry_count * sizeof(Entry));
+    memcpy(image + layout.slots, slots, slot_count * sizeof(uint32_t));
+    memcpy(image + layout.strings, strings, owned_strings.get_size());
+    memcpy(image + layout.strings + owned_strings.get_size(),
+           normalized.get_data(), normalized.get_size());
+
+    bool written = replace_file(cache_path, image, layout.total);
+    free(image);
+    return written;
+  }
+
+  auto ClassPath::default_cache_path(char const *class_path,
+                                     char const *kind, char *buffer,
+                                     size_t capacity) -> bool {
+    char const *base = getenv("XDG_CACHE_HOME");
+    char const *suffix = "";
+    if (base == nullptr or base[0] == '\0') {
+      base = getenv("HOME");
+      suffix = "/.cache";
+    }
+    if (base == nullptr or base[0] == '\0') { return false; }
+
+    PodVector<char> normalized;
+    normalize(class_path, normalized);
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : normalized) {
+      hash = (hash ^ uint8_t(c)) * 1099511628211ULL;
+    }
+
+    int length = snprintf(buffer, capacity, "%s%s/skjvm/%s-%016llx", base,
+                          suffix, kind, (unsigned long long)hash);
+    return length >= 0 and size_t(length) < capacity;
+  }
+} // namespace skjvm
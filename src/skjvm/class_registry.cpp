@@ -0,0 +1,469 @@
+#include <skjvm/class_registry.hpp>
+
+#include <skjvm/bootstrap.hpp>
+#include <skjvm/descriptor.hpp>
+
+#include <string.h>
+
+namespace skjvm {
+  namespace {
+    class MutexGuard {
+      pthread_mutex_t &mutex;
+
+     public:
+      explicit MutexGuard(pthread_mutex_t &mutex) noexcept : mutex(mutex) {
+        pthread_mutex_lock(&mutex);
+      }
+      MutexGuard(MutexGuard const&) = delete;
+      auto operator=(MutexGuard const&) -> MutexGuard & = delete;
+      ~MutexGuard() noexcept {
+        pthread_mutex_unlock(&mutex);
+      }
+    };
+
+    auto is_virtual(Method const &method) -> bool {
+      return (method.access_flags & (access::static_ | access::private_)) ==
+               0 and
+             not method.name.equals("<init>") and
+             not method.name.equals("<clinit>");
+    }
+
+    auto find_field_in(Klass *klass, Utf8View name, Utf8View descriptor)
+        -> Field * {
+      for (; klass != nullptr; klass = klass->super) {
+        if (Field *field = klass->find_field(name, descriptor)) {
+          return field;
+        }
+        for (uint16_t i = 0; i < klass->interface_count; ++i) {
+          if (Field *field = find_field_in(klass->interfaces[i], name,
+                                           descriptor)) {
+            return field;
+          }
+        }
+      }
+      return nullptr;
+    }
+
+    auto find_interface_method(Klass *klass, Utf8View name,
+                               Utf8View descriptor) -> Method * {
+      for (uint16_t i = 0; i < klass->interface_count; ++i) {
+        Klass *interface = klass->interfaces[i];
+        if (Method *method = interface->find_method(name, descriptor)) {
+          return method;
+        }
+        if (Method *method = find_interface_method(interface, name,
+                                                   descriptor)) {
+          return method;
+        }
+      }
+      return nullptr;
+    }
+  } // namespace
+
+  auto describe(LinkError error) -> char const * {
+    switch (error) {
+      case LinkError::none: return "no error";
+      case LinkError::no_class_def_found: return "NoClassDefFoundError";
+      case LinkError::class_format: return "ClassFormatError";
+      case LinkError::class_circularity: return "ClassCircularityError";
+      case LinkError::incompatible_class_change:
+        return "IncompatibleClassChangeError";
+      case LinkError::no_such_field: return "NoSuchFieldError";
+      case LinkError::no_such_method: return "NoSuchMethodError";
+    }
+    return "unknown error";
+  }
+
+  ClassRegistry::ClassRegistry(ClassLoader &loader,
+                               SymbolTable &symbols) noexcept
+    : loader(loader), symbols(symbols) {}
+
+  ClassRegistry::~ClassRegistry() noexcept {
+    for (ClassFile *class_file : adopted) {
+      class_file->~ClassFile();
+    }
+    for (Klass *klass : classes) {
+      free_klass(klass);
+    }
+    free(static_cast<void *>(table));
+    pthread_mutex_destroy(&mutex);
+  }
+
+  auto ClassRegistry::find_locked(Utf8View name, uint32_t hash) const
+      -> Klass * {
+    if (capacity == 0) { return nullptr; }
+    for (uint32_t slot = hash & (capacity - 1);;
+         slot = (slot + 1) & (capacity - 1)) {
+      Klass *klass = table[slot];
+      if (klass == nullptr) { return nullptr; }
+      if (klass->name.equals(name)) { return klass; }
+    }
+  }
+
+  auto ClassRegistry::insert_locked(Klass *klass, uint32_t hash) -> void {
+    if ((classes.get_size() + 1) * 2 > capacity) {
+      uint32_t grown = capacity == 0 ? 64 : capacity * 2;
+      auto **resized = static_cast<Klass **>(
+        checked_calloc(grown, sizeof(Klass *)));
+      for (Klass *existing : classes) {
+        uint32_t slot = existing->name.hash() & (grown - 1);
+        while (resized[slot] != nullptr) { slot = (slot + 1) & (grown - 1); }
+        resized[slot] = existing;
+      }
+      free(static_cast<void *>(table));
+      table = resized;
+      capacity = grown;
+    }
+    uint32_t slot = hash & (capacity - 1);
+    while (table[slot] != nullptr) { slot = (slot + 1) & (capacity - 1); }
+    table[slot] = klass;
+    classes.push(klass);
+  }
+
+  auto ClassRegistry::link(Utf8View name, LinkError &error) -> Klass * {
+    MutexGuard guard(mutex);
+    error = LinkError::none;
+    return link_locked(name, error);
+  }
+
+  auto ClassRegistry::find(Utf8View name) const -> Klass * {
+    MutexGuard guard(mutex);
+    return find_locked(name, name.hash());
+  }
+
+  auto ClassRegistry::link_locked(Utf8View name, LinkError &error)
+      -> Klass * {
+    if (Klass *klass = find_locked(name, name.hash())) { return klass; }
+    if (name.length != 0 and name.bytes[0] == '[') {
+      return link_array_locked(name, error);
+    }
+    for (Utf8View pending : linking) {
+      if (pending.equals(name)) {
+        error = LinkError::class_circularity;
+        return nullptr;
+      }
+    }
+
+    LoadedClass *loaded = &loader.load(name);
+    if (loaded->state != LoadState::loaded and loaded->not_found) {
+      size_t size = 0;
+      if (uint8_t *data = build_bootstrap_class(name, size)) {
+        loaded = &loader.define(name, data, size);
+      }
+    }
+    if (loaded->state != LoadState::loaded) {
+      error = loaded->not_found ? LinkError::no_class_def_found
+                                : LinkError::class_format;
+      return nullptr;
+    }
+    ClassFile const &class_file = loaded->class_file;
+
+    // The name is kept in the loader, which outlives the registry.
+    linking.push(loaded->name);
+    auto done = [this](Klass *result) {
+      linking.pop();
+      return result;
+    };
+
+    Klass *super = nullptr;
+    Utf8View super_name = class_file.super_class_name();
+    if (not super_name.is_empty()) {
+      super = link_locked(super_name, error);
+      if (super == nullptr) { return done(nullptr); }
+      if (super->is_interface() or super->is_array() or
+          (super->access_flags & access::final) != 0) {
+        error = LinkError::incompatible_class_change;
+        return done(nullptr);
+      }
+    } else if (not name.equals("java/lang/Object")) {
+      error = LinkError::class_format;
+      return done(nullptr);
+    }
+
+    uint16_t interface_count = class_file.get_interface_count();
+    Klass **interfaces = arena.allocate_array<Klass *>(interface_count);
+    for (uint16_t i = 0; i < interface_count; ++i) {
+      interfaces[i] = link_locked(class_file.interface_name(i), error);
+      if (interfaces[i] == nullptr) { return done(nullptr); }
+      if (not interfaces[i]->is_interface()) {
+        error = LinkError::incompatible_class_change;
+        return done(nullptr);
+      }
+    }
+    return done(build_locked(class_file, super, interfaces));
+  }
+
+  auto ClassRegistry::link_array_locked(Utf8View name, LinkError &error)
+      -> Klass * {
+    // `[I`, `[Ljava/lang/String;` or `[[I`: the component is what follows
+    // the first bracket.
+    Utf8View component_name {name.bytes + 1, uint16_t(name.length - 1)};
+    BasicType element_type = basic_type_of(
+      component_name.length != 0 ? char(component_name.bytes[0]) : 'V');
+    if (element_type == BasicType::void_ or
+        field_type_length(name, 1) != component_name.length) {
+      error = LinkError::no_class_def_found;
+      return nullptr;
+    }
+    Klass *component = nullptr;
+    if (element_type == BasicType::reference) {
+      if (component_name.bytes[0] == 'L') {
+        component_name = {component_name.bytes + 1,
+                          uint16_t(component_name.length - 2)};
+      }
+      component = link_locked(component_name, error);
+      if (component == nullptr) { return nullptr; }
+    }
+    Klass *object = link_locked(make_view("java/lang/Object"), error);
+    if (object == nullptr) { return nullptr; }
+
+    Klass *klass = allocate_klass();
+    auto *name_copy = static_cast<uint8_t *>(arena.allocate(name.length, 1));
+    memcpy(name_copy, name.bytes, name.length);
+    klass->name = {name_copy, name.length};
+    klass->access_flags = access::public_ | access::final | access::abstract;
+    klass->state = ClassState::initialized;
+    klass->element_type = element_type;
+    klass->component = component;
+    klass->super = object;
+    klass->vtable = object->vtable;
+    klass->vtable_length = object->vtable_length;
+    klass->instance_size = object_header_size;
+    klass->fields_end = object_header_size;
+    insert_locked(klass, name.hash());
+    return klass;
+  }
+
+  auto ClassRegistry::build_locked(ClassFile const &class_file, Klass *super,
+                                   Klass **interfaces) -> Klass * {
+    Klass *klass = allocate_klass();
+    klass->name = class_file.this_class_name();
+    klass->class_file = &class_file;
+    klass->access_flags = class_file.get_access_flags();
+    klass->state = ClassState::linked;
+    klass->element_type = BasicType::void_;
+    klass->super = super;
+    klass->interfaces = interfaces;
+    klass->interface_count = class_file.get_interface_count();
+
+    MemberList fields = class_file.fields();
+    klass->field_count = fields.size();
+    klass->fields = arena.allocate_array<Field>(fields.size());
+    for (uint16_t i = 0; i < fields.size(); ++i) {
+      Field &field = klass->fields[i];
+      field.holder = klass;
+      field.name = class_file.name(fields[i]);
+      field.descriptor = class_file.descriptor(fields[i]);
+      field.access_flags = fields[i].access_flags;
+      field.type = basic_type_of(field.descriptor.is_empty()
+                                   ? 'V' : char(field.descriptor.bytes[0]));
+    }
+    layout_fields(*klass);
+    set_reference_blocks(*klass, arena);
+    klass->static_storage = static_cast<uint8_t *>(
+      arena.allocate(klass->static_size, 8));
+
+    MemberList methods = class_file.methods();
+    klass->method_count = methods.size();
+    klass->methods = arena.allocate_array<Method>(methods.size());
+    for (uint16_t i = 0; i < methods.size(); ++i) {
+      Method &method = klass->methods[i];
+      method.holder = klass;
+      method.name = class_file.name(methods[i]);
+      method.descriptor = class_file.descriptor(methods[i]);
+      method.access_flags = methods[i].access_flags;
+      int slots = parameter_slots(method.descriptor);
+      method.argument_slots = uint16_t((slots < 0 ? 0 : slots) +
+                                       (method.is_static() ? 0 : 1));
+      method.return_type = basic_type_of(return_type(method.descriptor));
+      method.vtable_index = -1;
+      method.code = class_file.code(methods[i]);
+    }
+    build_vtable(*klass);
+
+    klass->resolved = arena.allocate_array<void *>(
+      class_file.get_constant_count());
+    insert_locked(klass, klass->name.hash());
+    if (print_field_layout) { print_layout(stdout, *klass); }
+    return klass;
+  }
+
+  auto ClassRegistry::build_vtable(Klass &klass) -> void {
+    if (klass.is_interface()) { return; }
+    uint32_t inherited = klass.super != nullptr ? klass.super->vtable_length
+                                                : 0;
+    auto **vtable = arena.allocate_array<Method *>(inherited +
+                                                   klass.method_count);
+    if (inherited != 0) {
+      memcpy(static_cast<void *>(vtable), klass.super->vtable,
+             inherited * sizeof(Method *));
+    }
+    uint32_t length = inherited;
+    for (uint16_t i = 0; i < klass.method_count; ++i) {
+      Method &method = klass.methods[i];
+      if (not is_virtual(method)) { continue; }
+      for (uint32_t slot = 0; slot < inherited; ++slot) {
+        if (vtable[slot]->name.equals(method.name) and
+            vtable[slot]->descriptor.equals(method.descriptor)) {
+          method.vtable_index = int32_t(slot);
+          break;
+        }
+      }
+      if (method.vtable_index < 0) {
+        method.vtable_index = int32_t(length++);
+      }
+      vtable[method.vtable_index] = &method;
+    }
+    klass.vtable = vtable;
+    klass.vtable_length = length;
+  }
+
+  auto ClassRegistry::resolve_class_locked(Klass &from, uint16_t index,
+                                           LinkError &error) -> Klass * {
+    auto *cached = static_cast<Klass *>(
+      __atomic_load_n(&from.resolved[index], __ATOMIC_ACQUIRE));
+    if (cached != nullptr) { return cached; }
+    Utf8View name = from.class_file->class_name(index);
+    if (name.is_empty()) {
+      error = LinkError::class_format;
+      return nullptr;
+    }
+    Klass *klass = link_locked(name, error);
+    if (klass != nullptr) {
+      __atomic_store_n(&from.resolved[index], static_cast<void *>(klass),
+                       __ATOMIC_RELEASE);
+    }
+    return klass;
+  }
+
+  auto ClassRegistry::resolve_class(Klass &from, uint16_t index,
+                                    LinkError &error) -> Klass * {
+    void *cached = __atomic_load_n(&from.resolved[index], __ATOMIC_ACQUIRE);
+    if (cached != nullptr) { return static_cast<Klass *>(cached); }
+    MutexGuard guard(mutex);
+    error = LinkError::none;
+    return resolve_class_locked(from, index, error);
+  }
+
+  auto ClassRegistry::resolve_field(Klass &from, uint16_t index,
+                                    LinkError &error) -> Field * {
+    void *cached = __atomic_load_n(&from.resolved[index], __ATOMIC_ACQUIRE);
+    if (cached != nullptr) { return static_cast<Field *>(cached); }
+    MutexGuard guard(mutex);
+    error = LinkError::none;
+    ClassFile const &class_file = *from.class_file;
+    if (class_file.tag(index) != ConstantTag::fieldref) {
+      error = LinkError::class_format;
+      return nullptr;
+    }
+    MemberRef reference = class_file.member_ref(index);
+    Klass *holder = resolve_class_locked(from, reference.class_index, error);
+    if (holder == nullptr) { return nullptr; }
+    Field *field = find_field_in(holder, reference.name,
+                                 reference.descriptor);
+    if (field == nullptr) {
+      error = LinkError::no_such_field;
+      return nullptr;
+    }
+    __atomic_store_n(&from.resolved[index], static_cast<void *>(field),
+                     __ATOMIC_RELEASE);
+    return field;
+  }
+
+  auto ClassRegistry::resolve_method(Klass &from, uint16_t index,
+                                     LinkError &error) -> Method * {
+    void *cached = __atomic_load_n(&from.resolved[index], __ATOMIC_ACQUIRE);
+    if (cached != nullptr) { return static_cast<Method *>(cached); }
+    MutexGuard guard(mutex);
+    error = LinkError::none;
+    ClassFile const &class_file = *from.class_file;
+    ConstantTag kind = class_file.tag(index);
+    if (kind != ConstantTag::methodref and
+        kind != ConstantTag::interface_methodref) {
+      error = LinkError::class_format;
+      return nullptr;
+    }
+    MemberRef reference = class_file.member_ref(index);
+    Klass *holder = resolve_class_locked(from, reference.class_index, error);
+    if (holder == nullptr) { return nullptr; }
+    if (holder->is_interface() != (kind == ConstantTag::interface_methodref)) {
+      error = LinkError::incompatible_class_change;
+      return nullptr;
+    }
+
+    Method *method = nullptr;
+    for (Klass *klass = holder; klass != nullptr and method == nullptr;
+         klass = klass->super) {
+      method = klass->find_method(reference.name, reference.descriptor);
+    }
+    for (Klass *klass = holder; klass != nullptr and method == nullptr;
+         klass = klass->super) {
+      method = find_interface_method(klass, reference.name,
+                                     reference.descriptor);
+    }
+    if (method == nullptr and holder->is_interface()) {
+      // Interfaces inherit the public methods of `java/lang/Object`.
+      if (Klass *object = find_locked(make_view("java/lang/Object"),
+                                      make_view("java/lang/Object").hash())) {
+        method = object->find_method(reference.name, reference.descriptor);
+      }
+    }
+    if (method == nullptr) {
+      error = LinkError::no_such_method;
+      return nullptr;
+    }
+    __atomic_store_n(&from.resolved[index], static_cast<void *>(method),
+                     __ATOMIC_RELEASE);
+    return method;
+  }
+
+  auto ClassRegistry::resolve_string(Klass &from, uint16_t index)
+      -> Symbol const * {
+    void *cached = __atomic_load_n(&from.resolved[index], __ATOMIC_ACQUIRE);
+    if (cached != nullptr) { return static_cast<Symbol const *>(cached); }
+    Utf8View value = from.class_file->string(index);
+    if (value.bytes == nullptr) { return nullptr; }
+    Symbol const *symbol = symbols.intern(value);
+    __atomic_store_n(&from.resolved[index],
+                     const_cast<void *>(static_cast<void const *>(symbol)),
+                     __ATOMIC_RELEASE);
+    return symbol;
+  }
+
+  auto ClassRegistry::resolve_all(Klass &klass) -> void {
+    if (klass.class_file == nullptr) { return; }
+    ClassFile const &class_file = *klass.class_file;
+    LinkError error = LinkError::none;
+    for (uint16_t i = 1; i < class_file.get_constant_count(); ++i) {
+      switch (class_file.tag(i)) {
+        case ConstantTag::class_:
+          (void)resolve_class(klass, i, error);
+          break;
+        case ConstantTag::fieldref:
+          (void)resolve_field(klass, i, error);
+          break;
+        case ConstantTag::methodref:
+        case ConstantTag::interface_methodref:
+          (void)resolve_method(klass, i, error);
+          break;
+        case ConstantTag::string:
+          (void)resolve_string(klass, i);
+          break;
+        default:
+          break;
+      }
+    }
+  }
+
+  auto ClassRegistry::add(Klass *klass, ClassFile *adopted_file) -> void {
+    MutexGuard guard(mutex);
+    insert_locked(klass, klass->name.hash());
+    if (adopted_file != nullptr) {
+      adopted.push(adopted_file);
+    }
+    if (klass->shared) {
+      ++shared_count;
+    }
+    if (print_field_layout) { print_layout(stdout, *klass); }
+  }
+} // namespace skjvm
@@ -0,0 +1,575 @@
+#include <skjvm/class_writer.hpp>
+#include <skjvm/descriptor.hpp>
+#include <skjvm/verifier.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace skjvm {
+  namespace {
+    [[noreturn]]
+    auto writer_abort(char const *message) -> void {
+      fprintf(stderr, "skjvm: class writer: %s\n", message);
+      abort();
+    }
+
+    struct Fixup {
+      uint32_t at;
+      uint32_t base;
+      uint16_t label;
+      uint8_t width;
+    };
+  } // namespace
+
+  // ByteBuffer ----------------------------------------------------------------
+
+  ByteBuffer::~ByteBuffer() noexcept {
+    free(bytes);
+  }
+
+  auto ByteBuffer::grow(size_t extra) -> uint8_t * {
+    if (capacity - size < extra) {
+      size_t wanted = capacity == 0 ? 64 : capacity * 2;
+      while (wanted - size < extra) { wanted *= 2; }
+      auto *resized = static_cast<uint8_t *>(realloc(bytes, wanted));
+      if (resized == nullptr) { writer_abort("out of memory"); }
+      bytes = resized;
+      capacity = wanted;
+    }
+    uint8_t *position = bytes + size;
+    size += extra;
+    return position;
+  }
+
+  auto ByteBuffer::put_u1(uint8_t value) -> void {
+    *grow(1) = value;
+  }
+
+  auto ByteBuffer::put_u2(uint16_t value) -> void {
+    uint8_t *position = grow(2);
+    position[0] = uint8_t(value >> 8);
+    position[1] = uint8_t(value);
+  }
+
+  auto ByteBuffer::put_u4(uint32_t value) -> void {
+    put_u2(uint16_t(value >> 16));
+    put_u2(uint16_t(value));
+  }
+
+  auto ByteBuffer::put_u8(uint64_t value) -> void {
+    put_u4(uint32_t(value >> 32));
+    put_u4(uint32_t(value));
+  }
+
+  auto ByteBuffer::put(void const *data, size_t count) -> void {
+    if (count != 0) {
+      memcpy(grow(count), data, count);
+    }
+  }
+
+  auto ByteBuffer::patch_u2(size_t at, uint16_t value) -> void {
+    bytes[at] = uint8_t(value >> 8);
+    bytes[at + 1] = uint8_t(value);
+  }
+
+  auto ByteBuffer::patch_u4(size_t at, uint32_t value) -> void {
+    patch_u2(at, uint16_t(value >> 16));
+    patch_u2(at + 2, uint16_t(value));
+  }
+
+  auto ByteBuffer::release() -> uint8_t * {
+    uint8_t *result = bytes;
+    bytes = nullptr;
+    size = capacity = 0;
+    return result;
+  }
+
+  // CodeWriter ----------------------------------------------------------------
+
+  auto CodeWriter::set_max(uint16_t stack, uint16_t locals) -> CodeWriter & {
+    max_stack = stack;
+    max_locals = locals;
+    return *this;
+  }
+
+  auto CodeWriter::op(Opcode opcode) -> CodeWriter & {
+    code.put_u1(uint8_t(opcode));
+    return *this;
+  }
+
+  auto CodeWriter::u1(uint8_t value) -> CodeWriter & {
+    code.put_u1(value);
+    return *this;
+  }
+
+  auto CodeWriter::u2(uint16_t value) -> CodeWriter & {
+    code.put_u2(value);
+    return *this;
+  }
+
+  auto CodeWriter::iconst(int32_t value) -> CodeWriter & {
+    if (value >= -1 and value <= 5) {
+      return op(Opcode(int(Opcode::iconst_0) + value));
+    }
+    if (value >= -128 and value <= 127) {
+      return op(Opcode::bipush).u1(uint8_t(int8_t(value)));
+    }
+    if (value >= -32768 and value <= 32767) {
+      return op(Opcode::sipush).u2(uint16_t(int16_t(value)));
+    }
+    uint16_t index = owner.integer_constant(value);
+    if (index <= 0xff) {
+      return op(Opcode::ldc).u1(uint8_t(index));
+    }
+    return op(Opcode::ldc_w).u2(index);
+  }
+
+  auto CodeWriter::lconst(int64_t value) -> CodeWriter & {
+    if (value == 0 or value == 1) {
+      return op(Opcode(int(Opcode::lconst_0) + int(value)));
+    }
+    return op(Opcode::ldc2_w).u2(owner.long_constant(value));
+  }
+
+  auto CodeWriter::fconst(float value) -> CodeWriter & {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    // Only +0.0 has the bits of 0, -0.0 must be loaded from the pool.
+    if (bits == 0 or value == 1.0f or value == 2.0f) {
+      return op(Opcode(int(Opcode::fconst_0) + int(value)));
+    }
+    uint16_t index = owner.float_constant(value);
+    if (index <= 0xff) {
+      return op(Opcode::ldc).u1(uint8_t(index));
+    }
+    return op(Opcode::ldc_w).u2(index);
+  }
+
+  auto CodeWriter::dconst(double value) -> CodeWriter & {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (bits == 0 or value == 1.0) {
+      return op(Opcode(int(Opcode::dconst_0) + int(value)));
+    }
+    return op(Opcode::ldc2_w).u2(owner.double_constant(value));
+  }
+
+  auto CodeWriter::ldc_string(char const *value) -> CodeWriter & {
+    uint16_t index = owner.string_constant(value);
+    if (index <= 0xff) {
+      return op(Opcode::ldc).u1(uint8_t(index));
+    }
+    return op(Opcode::ldc_w).u2(index);
+  }
+
+  auto CodeWriter::local(Opcode opcode, uint16_t index) -> CodeWriter & {
+    if (index > 0xff) {
+      return op(Opcode::wide).op(opcode).u2(index);
+    }
+    return op(opcode).u1(uint8_t(index));
+  }
+
+  auto CodeWriter::iinc(uint16_t index, int16_t delta) -> CodeWriter & {
+    if (index > 0xff or delta < -128 or delta > 127) {
+      return op(Opcode::wide).op(Opcode::iinc).u2(index).u2(uint16_t(delta));
+    }
+    return op(Opcode::iinc).u1(uint8_t(index)).u1(uint8_t(int8_t(delta)));
+  }
+
+  auto CodeWriter::field(Opcode opcode, char const *class_name,
+                         char const *name, char const *descriptor)
+      -> CodeWriter & {
+    return op(opcode).u2(owner.field_ref(class_name, name, descriptor));
+  }
+
+  auto CodeWriter::invoke(Opcode opcode, char const *class_name,
+                          char const *name, char const *descriptor)
+      -> CodeWriter & {
+    if (opcode != Opcode::invokeinterface) {
+      return op(opcode).u2(owner.method_ref(class_name, name, descriptor));
+    }
+    int slots = parameter_slots(make_view(descriptor));
+    if (slots < 0) { writer_abort("malformed method descriptor"); }
+    return op(opcode)
+      .u2(owner.interface_method_ref(class_name, name, descriptor))
+      .u1(uint8_t(slots + 1))
+      .u1(0);
+  }
+
+  auto CodeWriter::type(Opcode opcode, char const *class_name)
+      -> CodeWriter & {
+    return op(opcode).u2(owner.class_constant(class_name));
+  }
+
+  auto CodeWriter::newarray(uint8_t element_type) -> CodeWriter & {
+    return op(Opcode::newarray).u1(element_type);
+  }
+
+  auto CodeWriter::new_label() -> Label {
+    labels.put_u4(uint32_t(-1));
+    return {label_count++};
+  }
+
+  auto CodeWriter::label_position(uint16_t id) const -> int32_t {
+    return int32_t(read_u4(labels.get_data() + size_t(id) * 4));
+  }
+
+  auto CodeWriter::bind(Label label) -> CodeWriter & {
+    labels.patch_u4(size_t(label.id) * 4, get_position());
+    return *this;
+  }
+
+  auto CodeWriter::branch_offset(Label label, size_t base, uint8_t width)
+      -> void {
+    Fixup fixup {get_position(), uint32_t(base), label.id, width};
+    fixups.put(&fixup, sizeof(fixup));
+    ++fixup_count;
+    if (width == 2) {
+      code.put_u2(0);
+    } else {
+      code.put_u4(0);
+    }
+  }
+
+  auto CodeWriter::jump(Opcode opcode, Label label) -> CodeWriter & {
+    size_t base = get_position();
+    op(opcode);
+    branch_offset(label, base,
+                  opcode == Opcode::goto_w or opcode == Opcode::jsr_w ? 4 : 2);
+    return *this;
+  }
+
+  auto CodeWriter::tableswitch(int32_t low, int32_t high,
+                               Label default_target, Label const *targets)
+      -> CodeWriter & {
+    size_t base = get_position();
+    op(Opcode::tableswitch);
+    while (get_position() % 4 != 0) { code.put_u1(0); }
+    branch_offset(default_target, base, 4);
+    code.put_u4(uint32_t(low));
+    code.put_u4(uint32_t(high));
+    for (int64_t i = 0; i <= int64_t(high) - low; ++i) {
+      branch_offset(targets[i], base, 4);
+    }
+    return *this;
+  }
+
+  auto CodeWriter::lookupswitch(Label default_target, int32_t const *keys,
+                                Label const *targets, uint32_t count)
+      -> CodeWriter & {
+    size_t base = get_position();
+    op(Opcode::lookupswitch);
+    while (get_position() % 4 != 0) { code.put_u1(0); }
+    branch_offset(default_target, base, 4);
+    code.put_u4(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      code.put_u4(uint32_t(keys[i]));
+      branch_offset(targets[i], base, 4);
+    }
+    return *this;
+  }
+
+  auto CodeWriter::handler(Label start, Label end, Label target,
+                           char const *catch_type) -> CodeWriter & {
+    // Labels may still be unbound, so store their ids and resolve them in
+    // `ClassWriter::add_method`.
+    handlers.put_u2(start.id);
+    handlers.put_u2(end.id);
+    handlers.put_u2(target.id);
+    handlers.put_u2(catch_type == nullptr ? 0
+                                          : owner.class_constant(catch_type));
+    ++handler_count;
+    return *this;
+  }
+
+  // ClassWriter ---------------------------------------------------------------
+
+  ClassWriter::ClassWriter(char const *name, char const *super_name,
+                           uint16_t access_flags) noexcept
+    : access_flags(access_flags), this_class(class_constant(name)),
+      super_class(super_name == nullptr ? 0 : class_constant(super_name)) {}
+
+  auto ClassWriter::add_constant(uint8_t const *entry, size_t size,
+                                 uint16_t slots) -> uint16_t {
+    // Linear search: generated classes are small, and this keeps the writer
+    // free of a hash table.
+    uint16_t index = 1;
+    size_t count = pool_offsets.get_size() / 4;
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t offset = read_u4(pool_offsets.get_data() + i * 4);
+      uint32_t next = i + 1 < count
+                    ? read_u4(pool_offsets.get_data() + (i + 1) * 4)
+                    : uint32_t(pool.get_size());
+      if (next - offset == size and
+          memcmp(pool.get_data() + offset, entry, size) == 0) {
+        return index;
+      }
+      ConstantTag tag = ConstantTag(pool.get_data()[offset]);
+      index = uint16_t(index + (tag == ConstantTag::long_ or
+                                tag == ConstantTag::double_ ? 2 : 1));
+    }
+
+    if (uint32_t(constant_count) + slots > 0xffff) {
+      writer_abort("too many constants");
+    }
+    pool_offsets.put_u4(uint32_t(pool.get_size()));
+    pool.put(entry, size);
+    index = constant_count;
+    constant_count = uint16_t(constant_count + slots);
+    return index;
+  }
+
+  auto ClassWriter::reference(ConstantTag tag, uint16_t first,
+                              uint16_t second) -> uint16_t {
+    uint8_t entry[5] {uint8_t(tag), uint8_t(first >> 8), uint8_t(first),
+                      uint8_t(second >> 8), uint8_t(second)};
+    bool short_entry = tag == ConstantTag::class_ or
+                       tag == ConstantTag::string;
+    return add_constant(entry, short_entry ? 3 : 5, 1);
+  }
+
+  auto ClassWriter::utf8(char const *string) -> uint16_t {
+    size_t length = strlen(string);
+    if (length > 0xffff) { writer_abort("string constant too long"); }
+    return utf8(reinterpret_cast<uint8_t const *>(string), uint16_t(length));
+  }
+
+  auto ClassWriter::utf8(uint8_t const *bytes, uint16_t length) -> uint16_t {
+    ByteBuffer entry;
+    entry.put_u1(uint8_t(ConstantTag::utf8));
+    entry.put_u2(length);
+    entry.put(bytes, length);
+    return add_constant(entry.get_data(), entry.get_size(), 1);
+  }
+
+  auto ClassWriter::class_constant(char const *name) -> uint16_t {
+    return reference(ConstantTag::class_, utf8(name), 0);
+  }
+
+  auto ClassWriter::string_constant(char const *value) -> uint16_t {
+    return reference(ConstantTag::string, utf8(value), 0);
+  }
+
+  auto ClassWriter::integer_constant(int32_t value) -> uint16_t {
+    uint8_t entry[5] {uint8_t(ConstantTag::integer)};
+    uint32_t bits = __builtin_bswap32(uint32_t(value));
+    memcpy(entry + 1, &bits, 4);
+    return add_constant(entry, sizeof(entry), 1);
+  }
+
+  auto ClassWriter::float_constant(float value) -> uint16_t {
+    uint8_t entry[5] {uint8_t(ConstantTag::float_)};
+    uint32_t bits;
+    memcpy(&bits, &value, 4);
+    bits = __builtin_bswap32(bits);
+    memcpy(entry + 1, &bits, 4);
+    return add_constant(entry, sizeof(entry), 1);
+  }
+
+  auto ClassWriter::long_constant(int64_t value) -> uint16_t {
+    uint8_t entry[9] {uint8_t(ConstantTag::long_)};
+    uint64_t bits = __builtin_bswap64(uint64_t(value));
+    memcpy(entry + 1, &bits, 8);
+    return add_constant(entry, sizeof(entry), 2);
+  }
+
+  auto ClassWriter::double_constant(double value) -> uint16_t {
+    uint8_t entry[9] {uint8_t(ConstantTag::double_)};
+    uint64_t bits;
+    memcpy(&bits, &value, 8);
+    bits = __builtin_bswap64(bits);
+    memcpy(entry + 1, &bits, 8);
+    return add_constant(entry, sizeof(entry), 2);
+  }
+
+  auto ClassWriter::name_and_type(char const *name, char const *descriptor)
+      -> uint16_t {
+    return reference(ConstantTag::name_and_type, utf8(name), utf8(descriptor));
+  }
+
+  auto ClassWriter::field_ref(char const *class_name, char const *name,
+                              char const *descriptor) -> uint16_t {
+    return reference(ConstantTag::fieldref, class_constant(class_name),
+                     name_and_type(name, descriptor));
+  }
+
+  auto ClassWriter::method_ref(char const *class_name, char const *name,
+                               char const *descriptor) -> uint16_t {
+    return reference(ConstantTag::methodref, class_constant(class_name),
+                     name_and_type(name, descriptor));
+  }
+
+  auto ClassWriter::interface_method_ref(char const *class_name,
+                                         char const *name,
+                                         char const *descriptor) -> uint16_t {
+    return reference(ConstantTag::interface_methodref,
+                     class_constant(class_name),
+                     name_and_type(name, descriptor));
+  }
+
+  auto ClassWriter::add_interface(char const *name) -> void {
+    interfaces.put_u2(class_constant(name));
+    ++interface_count;
+  }
+
+  auto ClassWriter::add_field(uint16_t flags, char const *name,
+                              char const *descriptor) -> void {
+    fields.put_u2(flags);
+    fields.put_u2(utf8(name));
+    fields.put_u2(utf8(descriptor));
+    fields.put_u2(0);
+    ++field_count;
+  }
+
+  auto ClassWriter::add_method(uint16_t flags, char const *name,
+                               char const *descriptor, CodeWriter const *code)
+      -> void {
+    methods.put_u2(flags);
+    methods.put_u2(utf8(name));
+    methods.put_u2(utf8(descriptor));
+    if (code == nullptr) {
+      methods.put_u2(0);
+      ++method_count;
+      return;
+    }
+
+    // Patch the branches into a copy, so the code writer stays untouched.
+    ByteBuffer bytecode;
+    bytecode.put(code->code.get_data(), code->code.get_size());
+    auto const *fixups = reinterpret_cast<Fixup const *>(
+      code->fixups.get_data());
+    for (size_t i = 0; i < code->fixup_count; ++i) {
+      Fixup fixup;
+      memcpy(&fixup, fixups + i, sizeof(fixup));
+      int32_t target = code->label_position(fixup.label);
+      if (target < 0) { writer_abort("branch to an unbound label"); }
+      int32_t offset = target - int32_t(fixup.base);
+      if (fixup.width == 2) {
+        if (offset < -32768 or offset > 32767) {
+          writer_abort("branch offset does not fit in 16 bits");
+        }
+        bytecode.patch_u2(fixup.at, uint16_t(int16_t(offset)));
+      } else {
+        bytecode.patch_u4(fixup.at, uint32_t(offset));
+      }
+    }
+
+    ByteBuffer handlers;
+    uint8_t const *handler = code->handlers.get_data();
+    for (uint16_t i = 0; i < code->handler_count; ++i, handler += 8) {
+      for (int j = 0; j < 3; ++j) {
+        int32_t position = code->label_position(read_u2(handler + j * 2));
+        if (position < 0) { writer_abort("handler with an unbound label"); }
+        handlers.put_u2(uint16_t(position));
+      }
+      handlers.put_u2(read_u2(handler + 6));
+    }
+
+    uint32_t code_length = uint32_t(bytecode.get_size());
+    PodVector<uint8_t> stack_map;
+    int32_t frames = 0;
+    if (major_version >= 50 and
+        (code->fixup_count > 0 or code->handler_count > 0)) {
+      CodeView view;
+      view.max_stack = code->max_stack;
+      view.max_locals = code->max_locals;
+      view.code = bytecode.get_data();
+      view.code_length = code_length;
+      view.exception_table_length = code->handler_count;
+      view.exception_table = handlers.get_data();
+      frames = stack_map_table(flags, name, descriptor, view, stack_map);
+    }
+
+    uint32_t attribute_length = 12 + code_length +
+                                uint32_t(code->handler_count) * 8;
+    if (frames > 0) {
+      attribute_length += 8 + uint32_t(stack_map.get_size());
+    }
+    methods.put_u2(1);
+    methods.put_u2(utf8("Code"));
+    methods.put_u4(attribute_length);
+    methods.put_u2(code->max_stack);
+    methods.put_u2(code->max_locals);
+    methods.put_u4(code_length);
+    methods.put(bytecode.get_data(), code_length);
+    methods.put_u2(code->handler_count);
+    methods.put(handlers.get_data(), handlers.get_size());
+    if (frames > 0) {
+      methods.put_u2(1);
+      methods.put_u2(utf8("StackMapTable"));
+      methods.put_u4(2 + uint32_t(stack_map.get_size()));
+      methods.put_u2(uint16_t(frames));
+      methods.put(stack_map.get_data(), stack_map.get_size());
+    } else {
+      methods.put_u2(0);
+    }
+    ++method_count;
+  }
+
+  auto ClassWriter::stack_map_table(uint16_t flags, char const *name,
+                                    char const *descriptor,
+                                    CodeView const &code,
+                                    PodVector<uint8_t> &table) -> int32_t {
+    // The frames name classes by constants, so the inference reads the
+    // constants from a snapshot of the class as it is so far, and adds
+    // those it needs here.
+    ByteBuffer snapshot;
+    snapshot.put_u4(0xcafebabe);
+    snapshot.put_u2(0);
+    snapshot.put_u2(major_version);
+    snapshot.put_u2(constant_count);
+    snapshot.put(pool.get_data(), pool.get_size());
+    snapshot.put_u2(access_flags);
+    snapshot.put_u2(this_class);
+    snapshot.put_u2(super_class);
+    for (int i = 0; i < 4; ++i) { snapshot.put_u2(0); }
+    ClassFile constants;
+    if (constants.parse(snapshot.get_data(), snapshot.get_size()) !=
+        ClassFileError::none) {
+      return -1;
+    }
+    auto class_constant = [](void *context, Utf8View class_name) {
+      auto *writer = static_cast<ClassWriter *>(context);
+      return writer->reference(ConstantTag::class_,
+                               writer->utf8(class_name.bytes,
+                                            class_name.length), 0);
+    };
+    return infer_stack_map_table(constants, flags, make_view(name),
+                                 make_view(descriptor), code, class_constant,
+                                 this, table);
+  }
+
+  auto ClassWriter::finish(size_t &size) const -> uint8_t * {
+    ByteBuffer out;
+    out.put_u4(0xcafebabe);
+    out.put_u2(0);
+    out.put_u2(major_version);
+    out.put_u2(constant_count);
+    out.put(pool.get_data(), pool.get_size());
+    out.put_u2(access_flags);
+    out.put_u2(this_class);
+    out.put_u2(super_class);
+    out.put_u2(interface_count);
+    out.put(interfaces.get_data(), interfaces.get_size());
+    out.put_u2(field_count);
+    out.put(fields.get_data(), fields.get_size());
+    out.put_u2(method_count);
+    out.put(methods.get_data(), methods.get_size());
+    out.put_u2(0);
+    size = out.get_size();
+    return out.release();
+  }
+
+  auto ClassWriter::write_to(char const *path) const -> bool {
+    size_t size = 0;
+    uint8_t *bytes = finish(size);
+    FILE *file = fopen(path, "wb");
+    bool written = file != nullptr and fwrite(bytes, 1, size, file) == size;
+    if (file != nullptr) {
+      written = fclose(file) == 0 and written;
+    }
+    free(bytes);
+    return written;
+  }
+} // namespace skjvm
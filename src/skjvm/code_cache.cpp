@@ -0,0 +1,72 @@
+#include <skjvm/code_cache.hpp>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace skjvm {
+  namespace {
+    /// An anonymous shared memory object of \p size bytes, or -1.
+    auto create_shared_memory(size_t size) -> int {
+#if defined(__linux__)
+      int fd = memfd_create("skjvm-code-cache", MFD_CLOEXEC);
+#else
+      // Unlinked as soon as it is open, so only the mappings keep it.
+      char name[64];
+      snprintf(name, sizeof(name), "/skjvm-code-%ld-%p", long(getpid()),
+               static_cast<void *>(name));
+      int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+      if (fd >= 0) { shm_unlink(name); }
+#endif
+      if (fd < 0) { return -1; }
+      if (ftruncate(fd, off_t(size)) != 0) {
+        close(fd);
+        return -1;
+      }
+      return fd;
+    }
+  } // namespace
+
+  CodeCache::~CodeCache() noexcept {
+    if (executable != nullptr) { munmap(executable, capacity); }
+    if (writable != nullptr) { munmap(writable, capacity); }
+  }
+
+  auto CodeCache::reserve() -> bool {
+    int fd = create_shared_memory(capacity);
+    if (fd < 0) { return false; }
+    void *code = mmap(nullptr, capacity, PROT_READ | PROT_EXEC, MAP_SHARED,
+                      fd, 0);
+    void *data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      fd, 0);
+    close(fd);
+    if (code == MAP_FAILED or data == MAP_FAILED) {
+      if (code != MAP_FAILED) { munmap(code, capacity); }
+      if (data != MAP_FAILED) { munmap(data, capacity); }
+      return false;
+    }
+    executable = static_cast<uint8_t *>(code);
+    writable = static_cast<uint8_t *>(data);
+    return true;
+  }
+
+  auto CodeCache::install(uint8_t const *code, size_t size) -> uint8_t * {
+    if (executable == nullptr) {
+      if (failed) { return nullptr; }
+      if (not reserve()) {
+        failed = true;
+        return nullptr;
+      }
+    }
+    size_t aligned = (size + 15) & ~size_t(15);
+    if (aligned > capacity - used) { return nullptr; }
+    memcpy(writable + used, code, size);
+    uint8_t *result = executable + used;
+    __builtin___clear_cache(reinterpret_cast<char *>(result),
+                            reinterpret_cast<char *>(result + size));
+    used += aligned;
+    return result;
+  }
+} // namespace skjvm
@@ -0,0 +1,2049 @@
+#include <skjvm/compiler.hpp>
+
+#include <skjvm/assembler.hpp>
+#include <skjvm/vm.hpp>
+
+#include <inttypes.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/// The compiler emits x86-64 code for the System V ABI.
+#if defined(__x86_64__) and defined(__linux__)
+#define SKJVM_COMPILER 1
+#else
+#define SKJVM_COMPILER 0
+#endif
+
+namespace skjvm {
+  namespace {
+#if SKJVM_COMPILER
+    /// \brief Compiled code, entered at \p entry, an instruction of the
+    /// method of \p frame: from the start, or from the interpreter in the
+    /// middle of a loop. Returns \c status_returned with the result in
+    /// \p result, \c status_exception or \c status_deoptimized.
+    using CompiledCode = auto (*)(Thread *thread, Frame *frame,
+                                  uint8_t const *entry, Value *result) -> int;
+
+    constexpr int32_t status_returned = 0;
+    constexpr int32_t status_exception = 1;
+    constexpr int32_t status_deoptimized = 2;
+
+    // Functions called by compiled code, for what is too large to emit
+    // inline. Compiled code saves the frame before calling those that may
+    // throw, call Java code or allocate, and checks for an exception after.
+
+    auto throw_null_pointer(Thread *thread) -> void {
+      thread->get_vm().throw_new(*thread, "java/lang/NullPointerException",
+                                 nullptr);
+    }
+
+    auto throw_index_out_of_bounds(Thread *thread, ArrayObject *array,
+                                   int32_t index) -> void {
+      thread->get_vm().throw_index_out_of_bounds(*thread, index,
+                                                 array->length);
+    }
+
+    auto throw_division_by_zero(Thread *thread) -> void {
+      thread->get_vm().throw_new(*thread, "java/lang/ArithmeticException",
+                                 "/ by zero");
+    }
+
+    /// Call \p target with \p arguments, leaving the result in their place.
+    auto invoke(Thread *thread, Method *target, Value *arguments) -> void {
+      *arguments = thread->get_vm().invoke(*thread, *target, arguments);
+    }
+
+    /// What a direct call keeps below the stack pointer of the caller: the
+    /// frame of the callee, then its \c CompiledMethod, in a multiple of
+    /// 16 bytes to keep the stack aligned.
+    constexpr int32_t call_frame_size = 64;
+    constexpr auto call_compiled_offset = int32_t(sizeof(Frame));
+    static_assert(sizeof(Frame) + sizeof(CompiledMethod *) <= call_frame_size);
+
+    /// The end of a direct call to \p compiled whose code left \p frame
+    /// with \p status, an exception or a deoptimization, see
+    /// \c MethodCompiler::call_method.
+    auto finish_call(Thread *thread, Frame *frame, int32_t status,
+                     CompiledMethod *compiled) -> void {
+      *frame->locals = thread->get_vm().get_compiler().finish(
+        *thread, *frame, *compiled, status == status_deoptimized);
+    }
+
+    /// \c invokevirtual at a call site that saw several receiver classes.
+    /// The receiver is not \c null.
+    auto invoke_virtual(Thread *thread, Instruction const *ip, Value *sp)
+        -> void {
+      VM &vm = thread->get_vm();
+      Method *method = ip->cache->method;
+      Value *arguments = sp - method->argument_slots;
+      Klass *receiver = arguments[0].l->get_klass();
+      ++thread->inline_cache_misses;
+      Method *target = method;
+      if (method->vtable_index >= 0) {
+        target = receiver->vtable[method->vtable_index];
+      } else if (method->holder->is_interface()) {
+        target = vm.find_interface_method(*receiver, *method);
+        if (target == nullptr) {
+          vm.throw_new(*thread, "java/lang/AbstractMethodError", nullptr);
+          return;
+        }
+      }
+      invoke(thread, target, arguments);
+    }
+
+    /// \c invokeinterface at a call site that saw several receiver
+    /// classes. The receiver is not \c null.
+    auto invoke_interface(Thread *thread, Instruction const *ip, Value *sp)
+        -> void {
+      VM &vm = thread->get_vm();
+      Method *method = ip->cache->method;
+      Value *arguments = sp - method->argument_slots;
+      Klass *receiver = arguments[0].l->get_klass();
+      ++thread->inline_cache_misses;
+      Method *target = vm.find_interface_method(*receiver, *method);
+      if (target == nullptr) {
+        if (not receiver->is_subclass_of(method->holder)) {
+          vm.throw_with_class(*thread,
+                              "java/lang/IncompatibleClassChangeError",
+                              *receiver, " does not implement the interface");
+        } else {
+          vm.throw_new(*thread, "java/lang/AbstractMethodError", nullptr);
+        }
+        return;
+      }
+      invoke(thread, target, arguments);
+    }
+
+    /// \c monitorenter and \c monitorexit once the thin lock fast path
+    /// failed. The object is not \c null.
+    auto monitor_enter(Thread *thread, Instruction const *, Value *sp)
+        -> void {
+      thread->get_vm().monitor_enter(*thread, sp[-1].l);
+    }
+
+    auto monitor_exit(Thread *thread, Instruction const *, Value *sp)
+        -> void {
+      (void)thread->get_vm().monitor_exit(*thread, sp[-1].l);
+    }
+
+    auto new_object(Thread *thread, Klass *klass, Value *sp) -> void {
+      sp->l = thread->get_vm().new_object(*thread, *klass);
+    }
+
+    auto new_array(Thread *thread, Instruction const *ip, Value *sp) -> void {
+      VM &vm = thread->get_vm();
+      Klass *array_class = vm.primitive_array_class(*thread,
+                                                    BasicType(ip->count));
+      if (array_class == nullptr) { return; }
+      ArrayObject *array = vm.new_array(*thread, *array_class, sp[-1].i);
+      if (array != nullptr) { sp[-1].l = &array->header; }
+    }
+
+    auto new_reference_array(Thread *thread, Instruction const *ip,
+                             Value *sp) -> void {
+      VM &vm = thread->get_vm();
+      Klass *component = vm.resolve_class(
+        *thread, *thread->frame->method->holder, ip->index);
+      if (component == nullptr) { return; }
+      Klass *array_class = vm.array_class(*thread, *component);
+      if (array_class == nullptr) { return; }
+      ArrayObject *array = vm.new_array(*thread, *array_class, sp[-1].i);
+      if (array != nullptr) { sp[-1].l = &array->header; }
+    }
+
+    /// \c aastore, with all its checks.
+    auto store_reference(Thread *thread, Instruction const *, Value *sp)
+        -> void {
+      VM &vm = thread->get_vm();
+      int32_t index = sp[-2].i;
+      auto *array = reinterpret_cast<ArrayObject *>(sp[-3].l);
+      if (array == nullptr) {
+        throw_null_pointer(thread);
+        return;
+      }
+      if (uint32_t(index) >= uint32_t(array->length)) {
+        vm.throw_index_out_of_bounds(*thread, index, array->length);
+        return;
+      }
+      Object *value = sp[-1].l;
+      if (value != nullptr and
+          not vm.is_assignable(value->get_klass(),
+                               array->header.get_klass()->component)) {
+        vm.throw_with_class(*thread, "java/lang/ArrayStoreException",
+                            *value->get_klass(), "");
+        return;
+      }
+      vm.store_reference(&array->elements<Object *>()[index], value);
+    }
+
+    /// \c checkcast of an object that is not \c null.
+    auto check_cast(Thread *thread, Instruction const *ip, Value *sp)
+        -> void {
+      VM &vm = thread->get_vm();
+      Klass *target = vm.resolve_class(
+        *thread, *thread->frame->method->holder, ip->index);
+      if (target == nullptr) { return; }
+      Klass *klass = sp[-1].l->get_klass();
+      if (not vm.is_assignable(klass, target)) {
+        vm.throw_class_cast(*thread, *klass, *target);
+      }
+    }
+
+    auto instance_of(Thread *thread, Instruction const *ip, Value *sp)
+        -> void {
+      Object *object = sp[-1].l;
+      if (object == nullptr) {
+        sp[-1].i = 0;
+        return;
+      }
+      VM &vm = thread->get_vm();
+      Klass *target = vm.resolve_class(
+        *thread, *thread->frame->method->holder, ip->index);
+      if (target == nullptr) { return; }
+      sp[-1].i = vm.is_assignable(object->get_klass(), target);
+    }
+
+    auto load_constant(Thread *thread, Instruction const *ip, Value *sp)
+        -> void {
+      sp->l = thread->get_vm().load_constant(
+        *thread, *thread->frame->method->holder, ip->index);
+    }
+
+    /// The index of the target of \c lookupswitch \p table for \p key,
+    /// \c count for the default target.
+    auto lookup(SwitchTable const *table, int32_t key) -> uint64_t {
+      uint32_t low = 0;
+      uint32_t high = table->count;
+      while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (table->keys[middle] < key) {
+          low = middle + 1;
+        } else {
+          high = middle;
+        }
+      }
+      return low < table->count and table->keys[low] == key ? low
+                                                            : table->count;
+    }
+
+    /// Java's conversion of a floating point \p value to an integer type:
+    /// NaN is 0, and out of range values saturate.
+    template <typename Integer, typename Floating>
+    auto saturate(Floating value, Integer min, Integer max) -> Integer {
+      if (value != value) { return 0; }
+      if (value <= Floating(min)) { return min; }
+      if (value >= Floating(max)) { return max; }
+      return Integer(value);
+    }
+
+    auto f2i(float value) -> int32_t {
+      return saturate<int32_t>(value, INT32_MIN, INT32_MAX);
+    }
+
+    auto f2l(float value) -> int64_t {
+      return saturate<int64_t>(value, INT64_MIN, INT64_MAX);
+    }
+
+    auto d2i(double value) -> int32_t {
+      return saturate<int32_t>(value, INT32_MIN, INT32_MAX);
+    }
+
+    auto d2l(double value) -> int64_t {
+      return saturate<int64_t>(value, INT64_MIN, INT64_MAX);
+    }
+
+    auto frem(float a, float b) -> float {
+      return fmodf(a, b);
+    }
+
+    auto drem(double a, double b) -> double {
+      return fmod(a, b);
+    }
+
+    template <typename Function>
+    auto address_of(Function *function) -> uint64_t {
+      return reinterpret_cast<uintptr_t>(function);
+    }
+
+    auto slots_of(BasicType type) -> uint8_t {
+      switch (type) {
+        case BasicType::long_:
+        case BasicType::double_: return 2;
+        case BasicType::void_: return 0;
+        default: return 1;
+      }
+    }
+
+    /// Whether an instruction still refers to the constant pool: compiled
+    /// code leaves the method there, and the interpreter resolves it.
+    auto is_unresolved(Opcode opcode) -> bool {
+      switch (opcode) {
+        case Opcode::getstatic:
+        case Opcode::putstatic:
+        case Opcode::getfield:
+        case Opcode::putfield:
+        case Opcode::invokevirtual:
+        case Opcode::invokespecial:
+        case Opcode::invokestatic:
+        case Opcode::invokeinterface:
+        case Opcode::new_:
+          return true;
+        default:
+          return false;
+      }
+    }
+
+    /// The offset of \p member of \p thread, the same in every thread.
+    auto offset_in(Thread const &thread, void const *member) -> int32_t {
+      return int32_t(static_cast<char const *>(member) -
+                     reinterpret_cast<char const *>(&thread));
+    }
+
+    constexpr auto field_offset(size_t offset) -> int32_t {
+      return int32_t(offset);
+    }
+
+    /// \brief Translates one method: a template of machine code per decoded
+    /// instruction, operating on the \c Value slots of the frame.
+    ///
+    /// \details Registers hold the same values throughout: \c rbx the
+    /// locals, followed by the operand stack, \c r12 the thread, \c r13 the
+    /// frame and \c r14 where the result goes. The stack depth of every
+    /// instruction is known from the stack maps of the decoded method, so
+    /// operands are addressed directly and no stack pointer is kept.
+    /// Instructions use \c rax, \c rcx, \c rdx, \c rsi, \c xmm0 and
+    /// \c xmm1 and keep nothing in them from one instruction to the next.
+    ///
+    /// The top few values of the operand stack may be deferred instead: a
+    /// local or a constant pushed but not copied yet, or a result left in
+    /// one of \c r8 to \c r11, which the instructions that know about them
+    /// use where they are. Every other instruction, and every branch
+    /// target, first stores them in their slots, so the frame is as the
+    /// interpreter expects wherever control flow joins or leaves compiled
+    /// code.
+    ///
+    /// Rare paths, throwing an exception or deoptimizing, go out of line
+    /// after the code of the method, followed by its exits and the jump
+    /// tables of its switches.
+    class MethodCompiler {
+      using enum Register;
+      using enum Xmm;
+
+      enum class SlowKind : uint8_t {
+        null_pointer,
+        index_out_of_bounds,
+        division_by_zero,
+        deoptimize,
+      };
+
+      enum class OperandKind : uint8_t {
+        /// In its stack slot.
+        slot,
+        /// A copy of the local \c value.
+        local,
+        /// The \c int or \c float bits \c value, or \c null.
+        constant,
+        /// In \c reg.
+        register_,
+      };
+
+      /// A value of the operand stack, at \c position.
+      struct Operand {
+        uint16_t position;
+        OperandKind kind;
+        Register reg;
+        int32_t value;
+      };
+
+      static constexpr uint8_t max_deferred = 4;
+      static constexpr Register operand_registers[max_deferred] {
+        r8, r9, r10, r11,
+      };
+
+      /// The operands not in their slots, from the bottom of the stack.
+      struct Deferred {
+        Operand operands[max_deferred];
+        uint8_t count;
+      };
+
+      struct SlowPath {
+        uint32_t jump;
+        uint32_t instruction;
+        uint16_t depth;
+        SlowKind kind;
+        /// Stack positions of the array and the index, for
+        /// \c index_out_of_bounds.
+        uint16_t array;
+        uint16_t index;
+        /// The operands to store before leaving, as the instruction found
+        /// them.
+        Deferred deferred;
+      };
+
+      struct Jump {
+        uint32_t position;
+        uint32_t target;
+      };
+
+      struct JumpTable {
+        uint32_t position;
+        uint32_t instruction;
+      };
+
+      Method &method;
+      DecodedMethod const &decoded;
+      Assembler assembler {};
+
+      Opcode *opcodes;
+      uint16_t const *depths;
+      uint32_t *entries;
+      /// Whether a branch or a switch goes to each instruction.
+      bool *targets;
+
+      Deferred deferred {};
+      /// \c deferred when the current instruction started.
+      Deferred entry_deferred {};
+
+      PodVector<Jump> jumps {};
+      PodVector<JumpTable> tables {};
+      PodVector<SlowPath> slow_paths {};
+      PodVector<uint32_t> exception_exits {};
+      PodVector<uint32_t> exits {};
+
+      int32_t exception_offset;
+      int32_t frame_offset;
+      int32_t depth_offset;
+      int32_t stack_limit_offset;
+      int32_t native_stack_limit_offset;
+      int32_t hits_offset;
+      int32_t tlab_top_offset;
+      int32_t tlab_end_offset;
+      int32_t thin_lock_offset;
+      uint8_t *card_base;
+
+      auto slot(uint32_t index) const -> Address {
+        return {rbx, int32_t(index * sizeof(Value))};
+      }
+
+      /// Position \p position of the operand stack.
+      auto stack(int32_t position) const -> Address {
+        return slot(uint32_t(decoded.max_locals + position));
+      }
+
+      auto index_of(Instruction const *instruction) const -> uint32_t {
+        return uint32_t(instruction - decoded.code);
+      }
+
+      /// Where \p operand can be read from, unless it is a constant or in
+      /// a register.
+      auto location(Operand const &operand) const -> Address {
+        return operand.kind == OperandKind::local
+          ? slot(uint32_t(operand.value))
+          : stack(operand.position);
+      }
+
+      auto store_operands(Deferred const &operands) -> void;
+      auto flush() -> void;
+      auto detach_local(uint16_t index) -> void;
+      auto push(Operand const &operand) -> void;
+      auto take(int32_t position) -> Operand;
+      auto discard(int32_t position) -> void;
+      auto allocate(Operand const &avoid) -> Register;
+      auto load_operand(Register to, Operand const &operand, Width width)
+        -> void;
+      auto operate(AluOp op, Register to, Operand const &operand, bool wide)
+        -> void;
+      auto push_result(int32_t position, Register value) -> void;
+
+      auto save(uint32_t i, int32_t depth) -> void;
+      auto call(uint64_t function) -> void;
+      auto call_runtime(uint64_t function, uint32_t i, int32_t depth) -> void;
+      auto check_exception() -> void;
+      auto call_method(Method *target, uint32_t i, int32_t depth) -> void;
+      auto slow_path(Condition condition, uint32_t i, int32_t depth,
+                     SlowKind kind, int32_t array = 0, int32_t index = 0)
+        -> void;
+      auto deoptimize(uint32_t i, int32_t depth) -> void;
+      auto null_check(Address const &object, uint32_t i, int32_t depth)
+        -> void;
+      auto branch(Condition condition, uint32_t i) -> void;
+
+      auto load_typed(Register to, Address const &from, BasicType type)
+        -> Width;
+      auto store_typed(Address const &to, Register from, BasicType type)
+        -> void;
+      auto array_load(uint32_t i, int32_t depth, BasicType type) -> void;
+      auto array_store(uint32_t i, int32_t depth, BasicType type) -> void;
+      auto divide(uint32_t i, int32_t depth, bool wide, bool remainder)
+        -> void;
+      auto compare_result(Address const &result, uint32_t unordered,
+                          bool is_float) -> void;
+      auto invoke_cached(uint32_t i, int32_t depth, bool interface) -> void;
+      auto jump_table(uint32_t i) -> void;
+
+      auto emit_deferred(uint32_t i) -> bool;
+      auto emit(uint32_t i) -> bool;
+      auto emit_stubs() -> void;
+
+     public:
+      MethodCompiler(Thread &thread, Method &method) noexcept;
+      MethodCompiler(MethodCompiler const&) = delete;
+      auto operator=(MethodCompiler const&) -> MethodCompiler & = delete;
+      ~MethodCompiler() noexcept;
+
+      /// Compile the method into \p cache. Returns \c nullptr if it cannot
+      /// be compiled, with \p out_of_space set if the cache is full.
+      [[nodiscard]]
+      auto compile(CodeCache &cache, bool &out_of_space) -> CompiledMethod *;
+    };
+
+    MethodCompiler::MethodCompiler(Thread &thread, Method &method) noexcept
+      : method(method), decoded(*method.decoded),
+        opcodes(static_cast<Opcode *>(
+          checked_malloc(sizeof(Opcode) * decoded.length))),
+        depths(decoded.depths),
+        entries(static_cast<uint32_t *>(
+          checked_calloc(decoded.length, sizeof(uint32_t)))),
+        targets(static_cast<bool *>(
+          checked_calloc(decoded.length, sizeof(bool)))),
+        exception_offset(offset_in(thread, &thread.exception)),
+        frame_offset(offset_in(thread, &thread.frame)),
+        depth_offset(offset_in(thread, &thread.depth)),
+        stack_limit_offset(offset_in(thread,
+                                     thread.get_stack_limit_address())),
+        native_stack_limit_offset(
+          offset_in(thread, thread.get_native_stack_limit_address())),
+        hits_offset(offset_in(thread, &thread.inline_cache_hits)),
+        tlab_top_offset(offset_in(thread, &thread.tlab.top)),
+        tlab_end_offset(offset_in(thread, &thread.tlab.end)),
+        thin_lock_offset(offset_in(thread, &thread.thin_lock)),
+        card_base(thread.get_vm().get_heap().get_card_base()) {
+      // The interpreter may quicken instructions meanwhile; the compiler
+      // works from one snapshot of their opcodes, whose operands the
+      // acquire loads make visible.
+      for (uint32_t i = 0; i < decoded.length; ++i) {
+        opcodes[i] = __atomic_load_n(&decoded.code[i].opcode,
+                                     __ATOMIC_ACQUIRE);
+      }
+    }
+
+    MethodCompiler::~MethodCompiler() noexcept {
+      free(opcodes);
+      free(entries);
+      free(targets);
+    }
+
+    /// Make the frame inspectable at instruction \p i, like the
+    /// interpreter's `SAVE`.
+    auto MethodCompiler::save(uint32_t i, int32_t depth) -> void {
+      assembler.move_immediate(rax, uintptr_t(&decoded.code[i]));
+      assembler.store({r13, field_offset(offsetof(Frame, ip))}, rax,
+                      Width::qword);
+      assembler.lea(rax, stack(depth));
+      assembler.store({r13, field_offset(offsetof(Frame, sp))}, rax,
+                      Width::qword);
+    }
+
+    auto MethodCompiler::call(uint64_t function) -> void {
+      assembler.move_immediate(rax, function);
+      assembler.call(rax);
+    }
+
+    /// Call \p function with the thread, instruction \p i and the top of
+    /// its stack.
+    auto MethodCompiler::call_runtime(uint64_t function, uint32_t i,
+                                      int32_t depth) -> void {
+      assembler.move(rdi, r12);
+      assembler.move_immediate(rsi, uintptr_t(&decoded.code[i]));
+      assembler.lea(rdx, stack(depth));
+      call(function);
+    }
+
+    auto MethodCompiler::check_exception() -> void {
+      assembler.alu_immediate(AluOp::cmp, {r12, exception_offset}, 0,
+                              Width::qword);
+      exception_exits.push(assembler.jump(Condition::not_equal));
+    }
+
+    /// Call \p target, its arguments on top of the stack of depth
+    /// \p depth at instruction \p i. While \p target is compiled, the
+    /// call goes straight to its code, with the frame \c interpret would
+    /// make on the native stack, and the runtime only finishes the call if
+    /// the code throws or deoptimizes. Otherwise, or when the call might
+    /// overflow a stack, \c invoke makes it.
+    auto MethodCompiler::call_method(Method *target, uint32_t i,
+                                     int32_t depth) -> void {
+      Assembler &a = assembler;
+      int32_t arguments = depth - target->argument_slots;
+      DecodedMethod const *callee = __atomic_load_n(&target->decoded,
+                                                    __ATOMIC_ACQUIRE);
+      save(i, depth);
+      uint32_t slow[4];
+      uint32_t slow_count = 0;
+      uint32_t done = 0;
+      bool direct = callee != nullptr and
+                    (target->access_flags & access::synchronized) == 0;
+      if (direct) {
+        a.move_immediate(rsi, uintptr_t(target));
+        a.load(rax, {rsi, field_offset(offsetof(Method, compiled))},
+               Width::qword);
+        a.test(rax, rax, true);
+        slow[slow_count++] = a.jump(Condition::equal);
+        a.alu_immediate(AluOp::cmp, {r12, depth_offset},
+                        int32_t(Thread::max_depth), Width::dword);
+        slow[slow_count++] = a.jump(Condition::above_equal);
+        a.lea(rcx, stack(arguments + callee->max_locals + callee->max_stack));
+        a.alu(AluOp::cmp, rcx, {r12, stack_limit_offset}, true);
+        slow[slow_count++] = a.jump(Condition::above);
+        a.alu(AluOp::cmp, rsp, {r12, native_stack_limit_offset}, true);
+        slow[slow_count++] = a.jump(Condition::below);
+
+        a.alu_immediate(AluOp::sub, rsp, call_frame_size, true);
+        a.store({rsp, field_offset(offsetof(Frame, caller))}, r13,
+                Width::qword);
+        a.store({rsp, field_offset(offsetof(Frame, method))}, rsi,
+                Width::qword);
+        a.lea(rcx, stack(arguments));
+        a.store({rsp, field_offset(offsetof(Frame, locals))}, rcx,
+                Width::qword);
+        a.lea(rdx, stack(arguments + callee->max_locals));
+        a.store({rsp, field_offset(offsetof(Frame, stack))}, rdx,
+                Width::qword);
+        a.store({rsp, field_offset(offsetof(Frame, sp))}, rdx, Width::qword);
+        a.move_immediate(rdx, uintptr_t(callee->code));
+        a.store({rsp, field_offset(offsetof(Frame, ip))}, rdx, Width::qword);
+        a.store({rsp, call_compiled_offset}, rax, Width::qword);
+        a.store({r12, frame_offset}, rsp, Width::qword);
+        a.increment({r12, depth_offset}, false);
+
+        // Enter at the first instruction, the result going in place of the
+        // arguments.
+        a.move(rdi, r12);
+        a.move(rsi, rsp);
+        a.load(rdx, {rax, field_offset(offsetof(CompiledMethod, entries))},
+               Width::qword);
+        a.load(rdx, {rdx, 0}, Width::dword);
+        a.load(rax, {rax, field_offset(offsetof(CompiledMethod, code))},
+               Width::qword);
+        a.alu(AluOp::add, rdx, rax, true);
+        a.call(rax);
+        a.test(rax, rax, false);
+        uint32_t returned = a.jump(Condition::equal);
+        a.move(rdi, r12);
+        a.move(rsi, rsp);
+        a.move(rdx, rax);
+        a.load(rcx, {rsp, call_compiled_offset}, Width::qword);
+        call(address_of(&finish_call));
+        a.bind(returned, a.get_size());
+
+        a.store({r12, frame_offset}, r13, Width::qword);
+        a.alu_immediate(AluOp::sub, {r12, depth_offset}, 1, Width::dword);
+        a.alu_immediate(AluOp::add, rsp, call_frame_size, true);
+        done = a.jump();
+        for (uint32_t k = 0; k < slow_count; ++k) {
+          a.bind(slow[k], a.get_size());
+        }
+      }
+      a.move(rdi, r12);
+      a.move_immediate(rsi, uintptr_t(target));
+      a.lea(rdx, stack(arguments));
+      call(address_of(&invoke));
+      if (direct) { a.bind(done, a.get_size()); }
+      check_exception();
+    }
+
+    auto MethodCompiler::slow_path(Condition condition, uint32_t i,
+                                   int32_t depth, SlowKind kind,
+                                   int32_t array, int32_t index) -> void {
+      slow_paths.push({assembler.jump(condition), i, uint16_t(depth), kind,
+                       uint16_t(array), uint16_t(index), entry_deferred});
+    }
+
+    auto MethodCompiler::deoptimize(uint32_t i, int32_t depth) -> void {
+      slow_paths.push({assembler.jump(), i, uint16_t(depth),
+                       SlowKind::deoptimize, 0, 0, entry_deferred});
+    }
+
+    auto MethodCompiler::null_check(Address const &object, uint32_t i,
+                                    int32_t depth) -> void {
+      assembler.alu_immediate(AluOp::cmp, object, 0, Width::qword);
+      slow_path(Condition::equal, i, depth, SlowKind::null_pointer);
+    }
+
+    auto MethodCompiler::branch(Condition condition, uint32_t i) -> void {
+      jumps.push({assembler.jump(condition),
+                  index_of(decoded.code[i].target)});
+    }
+
+    /// Store \p operands in their slots, using \c rax.
+    auto MethodCompiler::store_operands(Deferred const &operands) -> void {
+      for (uint8_t k = 0; k < operands.count; ++k) {
+        Operand const &operand = operands.operands[k];
+        Address to = stack(operand.position);
+        switch (operand.kind) {
+          case OperandKind::local:
+            assembler.load(rax, location(operand), Width::qword);
+            assembler.store(to, rax, Width::qword);
+            break;
+          case OperandKind::constant:
+            assembler.store_immediate(to, operand.value, Width::qword);
+            break;
+          case OperandKind::register_:
+            assembler.store(to, operand.reg, Width::qword);
+            break;
+          case OperandKind::slot:
+            break;
+        }
+      }
+    }
+
+    auto MethodCompiler::flush() -> void {
+      store_operands(deferred);
+      deferred.count = 0;
+    }
+
+    /// Store the copies of local \p index, before it changes.
+    auto MethodCompiler::detach_local(uint16_t index) -> void {
+      uint8_t kept = 0;
+      for (uint8_t k = 0; k < deferred.count; ++k) {
+        Operand const &operand = deferred.operands[k];
+        if (operand.kind == OperandKind::local and operand.value == index) {
+          store_operands({{operand}, 1});
+        } else {
+          deferred.operands[kept++] = operand;
+        }
+      }
+      deferred.count = kept;
+    }
+
+    /// Defer \p operand, the new top of the stack, making room by storing
+    /// the bottom one if needed.
+    auto MethodCompiler::push(Operand const &operand) -> void {
+      if (deferred.count == max_deferred) {
+        store_operands({{deferred.operands[0]}, 1});
+        memmove(&deferred.operands[0], &deferred.operands[1],
+                sizeof(Operand) * (max_deferred - 1));
+        --deferred.count;
+      }
+      deferred.operands[deferred.count++] = operand;
+    }
+
+    /// The operand at \p position, the top of the stack, no longer
+    /// deferred.
+    auto MethodCompiler::take(int32_t position) -> Operand {
+      if (deferred.count != 0 and
+          deferred.operands[deferred.count - 1].position == position) {
+        return deferred.operands[--deferred.count];
+      }
+      return {uint16_t(position), OperandKind::slot, rax, 0};
+    }
+
+    /// Drop the operands from \p position up.
+    auto MethodCompiler::discard(int32_t position) -> void {
+      while (deferred.count != 0 and
+             deferred.operands[deferred.count - 1].position >= position) {
+        --deferred.count;
+      }
+    }
+
+    /// A register for a new operand, other than the one of \p avoid, freed
+    /// by storing the lowest operand in a register if they all are taken.
+    auto MethodCompiler::allocate(Operand const &avoid) -> Register {
+      auto in_use = [&](Register candidate) {
+        if (avoid.kind == OperandKind::register_ and avoid.reg == candidate) {
+          return true;
+        }
+        for (uint8_t k = 0; k < deferred.count; ++k) {
+          if (deferred.operands[k].kind == OperandKind::register_ and
+              deferred.operands[k].reg == candidate) {
+            return true;
+          }
+        }
+        return false;
+      };
+      for (Register candidate : operand_registers) {
+        if (not in_use(candidate)) { return candidate; }
+      }
+      for (uint8_t k = 0; k < deferred.count; ++k) {
+        Operand const operand = deferred.operands[k];
+        if (operand.kind == OperandKind::register_) {
+          assembler.store(stack(operand.position), operand.reg,
+                          Width::qword);
+          memmove(&deferred.operands[k], &deferred.operands[k + 1],
+                  sizeof(Operand) * (deferred.count - k - 1));
+          --deferred.count;
+          return operand.reg;
+        }
+      }
+      fatal("no register left for an operand");
+    }
+
+    auto MethodCompiler::load_operand(Register to, Operand const &operand,
+                                      Width width) -> void {
+      switch (operand.kind) {
+        case OperandKind::constant:
+          assembler.move_immediate(to, uint32_t(operand.value));
+          break;
+        case OperandKind::register_:
+          if (operand.reg != to) { assembler.move(to, operand.reg); }
+          break;
+        default:
+          assembler.load(to, location(operand), width);
+          break;
+      }
+    }
+
+    /// \p to = \p to \p op \p operand, or compare them.
+    auto MethodCompiler::operate(AluOp op, Register to,
+                                 Operand const &operand, bool wide) -> void {
+      switch (operand.kind) {
+        case OperandKind::constant:
+          assembler.alu_immediate(op, to, operand.value, wide);
+          break;
+        case OperandKind::register_:
+          assembler.alu(op, to, operand.reg, wide);
+          break;
+        default:
+          assembler.alu(op, to, location(operand), wide);
+          break;
+      }
+    }
+
+    auto MethodCompiler::push_result(int32_t position, Register value)
+        -> void {
+      push({uint16_t(position), OperandKind::register_, value, 0});
+    }
+
+    /// Load a value of \p type, widened to an \c int if narrower. Returns
+    /// the width of the stack slot value.
+    auto MethodCompiler::load_typed(Register to, Address const &from,
+                                    BasicType type) -> Width {
+      switch (type) {
+        case BasicType::boolean:
+        case BasicType::byte:
+          assembler.load_signed(to, from, Width::byte);
+          return Width::dword;
+        case BasicType::char_:
+          assembler.load(to, from, Width::word);
+          return Width::dword;
+        case BasicType::short_:
+          assembler.load_signed(to, from, Width::word);
+          return Width::dword;
+        case BasicType::int_:
+        case BasicType::float_:
+          assembler.load(to, from, Width::dword);
+          return Width::dword;
+        default:
+          assembler.load(to, from, Width::qword);
+          return Width::qword;
+      }
+    }
+
+    /// Store the stack slot value in \p from as a \p type, clobbering it.
+    auto MethodCompiler::store_typed(Address const &to, Register from,
+                                     BasicType type) -> void {
+      switch (type) {
+        case BasicType::boolean:
+          assembler.alu_immediate(AluOp::and_, from, 1, false);
+          assembler.store(to, from, Width::byte);
+          break;
+        case BasicType::byte:
+          assembler.store(to, from, Width::byte);
+          break;
+        case BasicType::char_:
+        case BasicType::short_:
+          assembler.store(to, from, Width::word);
+          break;
+        case BasicType::int_:
+        case BasicType::float_:
+          assembler.store(to, from, Width::dword);
+          break;
+        default:
+          assembler.store(to, from, Width::qword);
+          break;
+      }
+    }
+
+    auto element_scale(BasicType type) -> uint8_t {
+      switch (size_of(type)) {
+        case 1: return 0;
+        case 2: return 1;
+        case 4: return 2;
+        default: return 3;
+      }
+    }
+
+    auto MethodCompiler::array_load(uint32_t i, int32_t depth,
+                                    BasicType type) -> void {
+      Operand index = take(depth - 1);
+      Operand array = take(depth - 2);
+      load_operand(rax, array, Width::qword);
+      assembler.test(rax, rax, true);
+      slow_path(Condition::equal, i, depth, SlowKind::null_pointer);
+      load_operand(rcx, index, Width::dword);
+      assembler.alu(AluOp::cmp, rcx,
+                    {rax, field_offset(offsetof(ArrayObject, length))}, false);
+      slow_path(Condition::above_equal, i, depth,
+                SlowKind::index_out_of_bounds, depth - 2, depth - 1);
+      Register result = allocate({});
+      (void)load_typed(
+        result,
+        {rax, int32_t(array_data_offset), true, rcx, element_scale(type)},
+        type);
+      push_result(depth - 2, result);
+    }
+
+    auto MethodCompiler::array_store(uint32_t i, int32_t depth,
+                                     BasicType type) -> void {
+      int32_t slots = slots_of(type);
+      int32_t array_position = depth - slots - 2;
+      int32_t index_position = depth - slots - 1;
+      Operand value = take(depth - slots);
+      Operand index = take(index_position);
+      Operand array = take(array_position);
+      load_operand(rax, array, Width::qword);
+      assembler.test(rax, rax, true);
+      slow_path(Condition::equal, i, depth, SlowKind::null_pointer);
+      load_operand(rcx, index, Width::dword);
+      assembler.alu(AluOp::cmp, rcx,
+                    {rax, field_offset(offsetof(ArrayObject, length))}, false);
+      slow_path(Condition::above_equal, i, depth,
+                SlowKind::index_out_of_bounds, array_position,
+                index_position);
+      load_operand(rdx, value, slots == 2 ? Width::qword : Width::dword);
+      Address element {rax, int32_t(array_data_offset), true, rcx,
+                       element_scale(type)};
+      if (type == BasicType::byte) {
+        // `bastore` also stores into `boolean[]`, which only holds 0 or 1.
+        assembler.load(rsi, {rax, int32_t(narrow_klass_offset)},
+                       Width::dword);
+        if (narrow_klass_base != 0) {
+          assembler.move_immediate(rdi, narrow_klass_base);
+          assembler.alu(AluOp::add, rsi, rdi, true);
+        }
+        assembler.alu_immediate(
+          AluOp::cmp, {rsi, field_offset(offsetof(Klass, element_type))},
+          int32_t(BasicType::boolean), Width::byte);
+        uint32_t not_boolean = assembler.jump(Condition::not_equal);
+        assembler.alu_immediate(AluOp::and_, rdx, 1, false);
+        assembler.bind(not_boolean, assembler.get_size());
+      }
+      store_typed(element, rdx, type);
+    }
+
+    /// `idiv`, `irem`, `ldiv` and `lrem`, which throw on a zero divisor,
+    /// and whose overflowing case, dividing the minimum by -1, traps on
+    /// x86 but wraps around in Java.
+    auto MethodCompiler::divide(uint32_t i, int32_t depth, bool wide,
+                                bool remainder) -> void {
+      int32_t slots = wide ? 2 : 1;
+      Width width = wide ? Width::qword : Width::dword;
+      assembler.load(rcx, stack(depth - slots), width);
+      assembler.test(rcx, rcx, wide);
+      slow_path(Condition::equal, i, depth, SlowKind::division_by_zero);
+      assembler.load(rax, stack(depth - 2 * slots), width);
+      assembler.alu_immediate(AluOp::cmp, rcx, -1, wide);
+      uint32_t general = assembler.jump(Condition::not_equal);
+      if (remainder) {
+        assembler.move_immediate(rax, 0);
+      } else {
+        assembler.negate(rax, wide);
+      }
+      uint32_t done = assembler.jump();
+      assembler.bind(general, assembler.get_size());
+      assembler.sign_extend_accumulator(wide);
+      assembler.divide(rcx, wide);
+      if (remainder) { assembler.move(rax, rdx); }
+      assembler.bind(done, assembler.get_size());
+      assembler.store(stack(depth - 2 * slots), rax, width);
+    }
+
+    /// Store -1, 0 or 1 in \p result after a comparison: \c less or
+    /// \c greater for integers, and \c below or \c above with \p unordered
+    /// for NaN after \c ucomiss. Moves keep the flags.
+    auto MethodCompiler::compare_result(Address const &result,
+                                        uint32_t unordered, bool is_float)
+        -> void {
+      uint32_t ends[3];
+      uint32_t count = 0;
+      if (is_float) {
+        assembler.move_immediate(rax, unordered);
+        ends[count++] = assembler.jump(Condition::parity);
+      }
+      assembler.move_immediate(rax, 0);
+      ends[count++] = assembler.jump(Condition::equal);
+      assembler.move_immediate(rax, 1);
+      ends[count++] = assembler.jump(is_float ? Condition::above
+                                              : Condition::greater);
+      assembler.move_immediate(rax, UINT32_MAX);
+      for (uint32_t k = 0; k < count; ++k) {
+        assembler.bind(ends[k], assembler.get_size());
+      }
+      assembler.store(result, rax, Width::dword);
+    }
+
+    /// A virtual or interface call. While its inline cache holds one
+    /// receiver class, the call goes straight to the method it selected,
+    /// and another class deoptimizes.
+    auto MethodCompiler::invoke_cached(uint32_t i, int32_t depth,
+                                       bool interface) -> void {
+      InlineCache const &cache = *decoded.code[i].cache;
+      Method *called = cache.method;
+      int32_t arguments = depth - called->argument_slots;
+      Klass *klass = __atomic_load_n(&cache.klass, __ATOMIC_ACQUIRE);
+
+      assembler.load(rax, stack(arguments), Width::qword);
+      assembler.test(rax, rax, true);
+      slow_path(Condition::equal, i, depth, SlowKind::null_pointer);
+      if (uintptr_t(klass) == InlineCache::filling or
+          uintptr_t(klass) == InlineCache::megamorphic or klass == nullptr) {
+        save(i, depth);
+        call_runtime(interface ? address_of(&invoke_interface)
+                               : address_of(&invoke_virtual), i, depth);
+        check_exception();
+        return;
+      }
+      assembler.alu_immediate(AluOp::cmp, {rax, int32_t(narrow_klass_offset)},
+                              int32_t(encode_klass(klass)), Width::dword);
+      slow_path(Condition::not_equal, i, depth, SlowKind::deoptimize);
+      assembler.increment({r12, hits_offset}, true);
+      call_method(cache.target, i, depth);
+    }
+
+    /// Jump through the table of the switch \p i, indexed by \c rax.
+    auto MethodCompiler::jump_table(uint32_t i) -> void {
+      tables.push({assembler.lea_relative(rcx), i});
+      assembler.load_signed(rax, {rcx, 0, true, rax, 2}, Width::dword);
+      assembler.alu(AluOp::add, rax, rcx, true);
+      assembler.jump(rax);
+    }
+
+    /// Translate instruction \p i if it is one that uses deferred operands
+    /// where they are and defers its result. Returns false, having emitted
+    /// nothing, for the others.
+    auto MethodCompiler::emit_deferred(uint32_t i) -> bool {
+      Instruction const &instruction = decoded.code[i];
+      int32_t const d = depths[i];
+      Opcode const opcode = opcodes[i];
+      Assembler &a = assembler;
+      auto const top = uint16_t(d);
+
+      switch (opcode) {
+        case Opcode::nop:
+          return true;
+        case Opcode::aconst_null:
+          push({top, OperandKind::constant, rax, 0});
+          return true;
+        case Opcode::sipush:
+        case Opcode::fconst_0:
+          push({top, OperandKind::constant, rax, instruction.value});
+          return true;
+
+        // Locals, copied whole like in the interpreter.
+        case Opcode::iload:
+        case Opcode::lload:
+        case Opcode::fload:
+        case Opcode::dload:
+        case Opcode::aload:
+          push({top, OperandKind::local, rax, instruction.index});
+          return true;
+        case Opcode::istore:
+        case Opcode::fstore:
+        case Opcode::astore:
+        case Opcode::lstore:
+        case Opcode::dstore: {
+          int32_t slots = opcode == Opcode::lstore or
+                          opcode == Opcode::dstore ? 2 : 1;
+          Operand value = take(d - slots);
+          detach_local(instruction.index);
+          Address to = slot(instruction.index);
+          switch (value.kind) {
+            case OperandKind::constant:
+              a.store_immediate(to, value.value, Width::qword);
+              break;
+            case OperandKind::register_:
+              a.store(to, value.reg, Width::qword);
+              break;
+            default:
+              a.load(rax, location(value), Width::qword);
+              a.store(to, rax, Width::qword);
+              break;
+          }
+          return true;
+        }
+        case Opcode::iinc:
+          detach_local(instruction.index);
+          a.alu_immediate(AluOp::add, slot(instruction.index),
+                          instruction.value, Width::dword);
+          return true;
+
+        // Arrays.
+        case Opcode::iaload: array_load(i, d, BasicType::int_); return true;
+        case Opcode::laload: array_load(i, d, BasicType::long_); return true;
+        case Opcode::faload: array_load(i, d, BasicType::float_); return true;
+        case Opcode::daload: array_load(i, d, BasicType::double_); return true;
+        case Opcode::aaload:
+          array_load(i, d, BasicType::reference);
+          return true;
+        case Opcode::baload: array_load(i, d, BasicType::byte); return true;
+        case Opcode::caload: array_load(i, d, BasicType::char_); return true;
+        case Opcode::saload: array_load(i, d, BasicType::short_); return true;
+        case Opcode::iastore: array_store(i, d, BasicType::int_); return true;
+        case Opcode::lastore: array_store(i, d, BasicType::long_); return true;
+        case Opcode::fastore:
+          array_store(i, d, BasicType::float_);
+          return true;
+        case Opcode::dastore:
+          array_store(i, d, BasicType::double_);
+          return true;
+        case Opcode::bastore: array_store(i, d, BasicType::byte); return true;
+        case Opcode::castore:
+          array_store(i, d, BasicType::char_);
+          return true;
+        case Opcode::sastore:
+          array_store(i, d, BasicType::short_);
+          return true;
+        case Opcode::arraylength: {
+          Operand array = take(d - 1);
+          load_operand(rax, array, Width::qword);
+          a.test(rax, rax, true);
+          slow_path(Condition::equal, i, d, SlowKind::null_pointer);
+          Register result = allocate({});
+          a.load(result, {rax, field_offset(offsetof(ArrayObject, length))},
+                 Width::dword);
+          push_result(d - 1, result);
+          return true;
+        }
+
+        // Operand stack.
+        case Opcode::pop:
+          discard(d - 1);
+          return true;
+        case Opcode::pop2:
+          discard(d - 2);
+          return true;
+        case Opcode::dup: {
+          Operand value = take(d - 1);
+          Operand copy = value;
+          copy.position = top;
+          if (value.kind == OperandKind::slot) {
+            copy.kind = OperandKind::register_;
+            copy.reg = allocate({});
+            a.load(copy.reg, stack(d - 1), Width::qword);
+          } else {
+            if (value.kind == OperandKind::register_) {
+              copy.reg = allocate(value);
+              a.move(copy.reg, value.reg);
+            }
+            push(value);
+          }
+          push(copy);
+          return true;
+        }
+
+        // Integer arithmetic, wrapping around like x86.
+        case Opcode::iadd:
+        case Opcode::isub:
+        case Opcode::iand:
+        case Opcode::ior:
+        case Opcode::ixor:
+        case Opcode::imul: {
+          Operand right = take(d - 1);
+          Operand left = take(d - 2);
+          Register result = left.kind == OperandKind::register_
+            ? left.reg
+            : allocate(right);
+          load_operand(result, left, Width::dword);
+          if (opcode == Opcode::imul) {
+            if (right.kind == OperandKind::constant) {
+              a.imul_immediate(result, result, right.value, false);
+            } else if (right.kind == OperandKind::register_) {
+              a.imul(result, right.reg, false);
+            } else {
+              a.imul(result, location(right), false);
+            }
+          } else {
+            AluOp op = AluOp::add;
+            switch (opcode) {
+              case Opcode::isub: op = AluOp::sub; break;
+              case Opcode::iand: op = AluOp::and_; break;
+              case Opcode::ior: op = AluOp::or_; break;
+              case Opcode::ixor: op = AluOp::xor_; break;
+              default: break;
+            }
+            operate(op, result, right, false);
+          }
+          push_result(d - 2, result);
+          return true;
+        }
+        case Opcode::ineg: {
+          Operand value = take(d - 1);
+          Register result = value.kind == OperandKind::register_
+            ? value.reg
+            : allocate({});
+          load_operand(result, value, Width::dword);
+          a.negate(result, false);
+          push_result(d - 1, result);
+          return true;
+        }
+        // Shifts use the low 5 bits of the count, like Java.
+        case Opcode::ishl:
+        case Opcode::ishr:
+        case Opcode::iushr: {
+          ShiftOp op = opcode == Opcode::ishl ? ShiftOp::shl
+                     : opcode == Opcode::ishr ? ShiftOp::sar
+                                              : ShiftOp::shr;
+          Operand count = take(d - 1);
+          Operand value = take(d - 2);
+          Register result = value.kind == OperandKind::register_
+            ? value.reg
+            : allocate(count);
+          if (count.kind == OperandKind::constant) {
+            load_operand(result, value, Width::dword);
+            a.shift_immediate(op, result, uint8_t(count.value & 31), false);
+          } else {
+            load_operand(rcx, count, Width::dword);
+            load_operand(result, value, Width::dword);
+            a.shift(op, result, false);
+          }
+          push_result(d - 2, result);
+          return true;
+        }
+        case Opcode::l2i:
+          // The low half of the slot already is the int.
+          return true;
+
+        // Branches, leaving every operand in its slot for the target.
+        case Opcode::ifeq:
+        case Opcode::ifne:
+        case Opcode::iflt:
+        case Opcode::ifge:
+        case Opcode::ifgt:
+        case Opcode::ifle:
+        case Opcode::ifnull:
+        case Opcode::ifnonnull: {
+          constexpr Condition conditions[] {
+            Condition::equal, Condition::not_equal, Condition::less,
+            Condition::greater_equal, Condition::greater,
+            Condition::less_equal,
+          };
+          bool is_reference = opcode == Opcode::ifnull or
+                              opcode == Opcode::ifnonnull;
+          Operand value = take(d - 1);
+          flush();
+          if (value.kind == OperandKind::slot or
+              value.kind == OperandKind::local) {
+            a.alu_immediate(AluOp::cmp, location(value), 0,
+                            is_reference ? Width::qword : Width::dword);
+          } else {
+            Register tested = value.reg;
+            if (value.kind == OperandKind::constant) {
+              tested = rax;
+              load_operand(rax, value, Width::dword);
+            }
+            a.test(tested, tested, is_reference);
+          }
+          if (is_reference) {
+            branch(opcode == Opcode::ifnull ? Condition::equal
+                                            : Condition::not_equal, i);
+          } else {
+            branch(conditions[uint8_t(opcode) - uint8_t(Opcode::ifeq)], i);
+          }
+          return true;
+        }
+        case Opcode::if_icmpeq:
+        case Opcode::if_icmpne:
+        case Opcode::if_icmplt:
+        case Opcode::if_icmpge:
+        case Opcode::if_icmpgt:
+        case Opcode::if_icmple:
+        case Opcode::if_acmpeq:
+        case Opcode::if_acmpne: {
+          constexpr Condition conditions[] {
+            Condition::equal, Condition::not_equal, Condition::less,
+            Condition::greater_equal, Condition::greater,
+            Condition::less_equal, Condition::equal, Condition::not_equal,
+          };
+          bool is_reference = opcode >= Opcode::if_acmpeq;
+          Operand right = take(d - 1);
+          Operand left = take(d - 2);
+          flush();
+          Register compared = rax;
+          if (left.kind == OperandKind::register_) {
+            compared = left.reg;
+          } else {
+            load_operand(rax, left,
+                         is_reference ? Width::qword : Width::dword);
+          }
+          operate(AluOp::cmp, compared, right, is_reference);
+          branch(conditions[uint8_t(opcode) - uint8_t(Opcode::if_icmpeq)], i);
+          return true;
+        }
+        case Opcode::goto_:
+          flush();
+          jumps.push({a.jump(), index_of(instruction.target)});
+          return true;
+
+        // Returns.
+        case Opcode::ireturn:
+        case Opcode::freturn:
+        case Opcode::areturn:
+        case Opcode::lreturn:
+        case Opcode::dreturn: {
+          int32_t slots = opcode == Opcode::lreturn or
+                          opcode == Opcode::dreturn ? 2 : 1;
+          load_operand(rax, take(d - slots), Width::qword);
+          deferred.count = 0;
+          a.store({r14, 0}, rax, Width::qword);
+          a.move_immediate(rax, status_returned);
+          exits.push(a.jump());
+          return true;
+        }
+        case Opcode::return_:
+          deferred.count = 0;
+          a.store_immediate({r14, 0}, 0, Width::qword);
+          a.move_immediate(rax, status_returned);
+          exits.push(a.jump());
+          return true;
+
+        default:
+          break;
+      }
+
+      // Quick field accesses.
+      auto type = BasicType(instruction.count);
+      if (opcode == quick::getstatic) {
+        Register result = allocate({});
+        a.move_immediate(rcx, uintptr_t(instruction.address));
+        (void)load_typed(result, {rcx, 0}, type);
+        push_result(d, result);
+        return true;
+      }
+      if (opcode == quick::putstatic) {
+        Operand value = take(d - slots_of(type));
+        load_operand(rax, value, Width::qword);
+        a.move_immediate(rcx, uintptr_t(instruction.address));
+        store_typed({rcx, 0}, rax, type);
+        return true;
+      }
+      if (opcode >= quick::getfield_word and
+          opcode <= quick::getfield_narrow) {
+        Operand object = take(d - 1);
+        load_operand(rax, object, Width::qword);
+        a.test(rax, rax, true);
+        slow_path(Condition::equal, i, d, SlowKind::null_pointer);
+        Register result = allocate({});
+        (void)load_typed(result, {rax, instruction.value}, type);
+        push_result(d - 1, result);
+        return true;
+      }
+      if (opcode >= quick::putfield_word and
+          opcode <= quick::putfield_narrow) {
+        int32_t slots = slots_of(type);
+        Operand value = take(d - slots);
+        Operand object = take(d - slots - 1);
+        load_operand(rax, object, Width::qword);
+        a.test(rax, rax, true);
+        slow_path(Condition::equal, i, d, SlowKind::null_pointer);
+        load_operand(rdx, value, Width::qword);
+        store_typed({rax, instruction.value}, rdx, type);
+        if (type == BasicType::reference) {
+          // The write barrier, see `Heap::mark_card`.
+          a.lea(rax, {rax, instruction.value});
+          a.shift_immediate(ShiftOp::shr, rax, Heap::card_shift, true);
+          a.move_immediate(rcx, uintptr_t(card_base));
+          a.store_immediate({rcx, 0, true, rax, 0}, Heap::dirty_card,
+                            Width::byte);
+        }
+        return true;
+      }
+      return false;
+    }
+
+    auto MethodCompiler::emit(uint32_t i) -> bool {
+      Instruction const &instruction = decoded.code[i];
+      int32_t const d = depths[i];
+      Opcode const opcode = opcodes[i];
+      Assembler &a = assembler;
+
+      entry_deferred = deferred;
+      if (emit_deferred(i)) { return true; }
+      flush();
+      entry_deferred = deferred;
+
+      if (is_unresolved(opcode)) {
+        deoptimize(i, d);
+        return true;
+      }
+
+      switch (opcode) {
+        // Constants.
+        case Opcode::lconst_0:
+        case Opcode::dconst_0:
+          a.move_immediate(rax, uint64_t(instruction.wide));
+          a.store(stack(d), rax, Width::qword);
+          return true;
+        case Opcode::ldc:
+          save(i, d);
+          call_runtime(address_of(&load_constant), i, d);
+          check_exception();
+          return true;
+
+        // Arrays.
+        case Opcode::aastore:
+          save(i, d);
+          call_runtime(address_of(&store_reference), i, d);
+          check_exception();
+          return true;
+
+        // Operand stack.
+        case Opcode::dup_x1:
+          a.load(rax, stack(d - 1), Width::qword);
+          a.load(rcx, stack(d - 2), Width::qword);
+          a.store(stack(d - 2), rax, Width::qword);
+          a.store(stack(d - 1), rcx, Width::qword);
+          a.store(stack(d), rax, Width::qword);
+          return true;
+        case Opcode::dup_x2:
+          a.load(rax, stack(d - 1), Width::qword);
+          a.load(rcx, stack(d - 2), Width::qword);
+          a.store(stack(d - 1), rcx, Width::qword);
+          a.load(rcx, stack(d - 3), Width::qword);
+          a.store(stack(d - 2), rcx, Width::qword);
+          a.store(stack(d - 3), rax, Width::qword);
+          a.store(stack(d), rax, Width::qword);
+          return true;
+        case Opcode::dup2:
+          a.load(rax, stack(d - 2), Width::qword);
+          a.store(stack(d), rax, Width::qword);
+          a.load(rax, stack(d - 1), Width::qword);
+          a.store(stack(d + 1), rax, Width::qword);
+          return true;
+        case Opcode::dup2_x1:
+        case Opcode::dup2_x2: {
+          // The top two values go below the next one or two.
+          int32_t below = opcode == Opcode::dup2_x1 ? 1 : 2;
+          a.load(rax, stack(d - 1), Width::qword);
+          a.load(rdx, stack(d - 2), Width::qword);
+          a.store(stack(d + 1), rax, Width::qword);
+          a.store(stack(d), rdx, Width::qword);
+          for (int32_t k = 1; k <= below; ++k) {
+            a.load(rcx, stack(d - 2 - k), Width::qword);
+            a.store(stack(d - k), rcx, Width::qword);
+          }
+          a.store(stack(d - 1 - below), rax, Width::qword);
+          a.store(stack(d - 2 - below), rdx, Width::qword);
+          return true;
+        }
+        case Opcode::swap:
+          a.load(rax, stack(d - 1), Width::qword);
+          a.load(rcx, stack(d - 2), Width::qword);
+          a.store(stack(d - 1), rcx, Width::qword);
+          a.store(stack(d - 2), rax, Width::qword);
+          return true;
+
+        // Long arithmetic, wrapping around like x86.
+        case Opcode::ladd:
+        case Opcode::lsub:
+        case Opcode::land:
+        case Opcode::lor:
+        case Opcode::lxor: {
+          AluOp op = AluOp::add;
+          switch (opcode) {
+            case Opcode::lsub: op = AluOp::sub; break;
+            case Opcode::land: op = AluOp::and_; break;
+            case Opcode::lor: op = AluOp::or_; break;
+            case Opcode::lxor: op = AluOp::xor_; break;
+            default: break;
+          }
+          a.load(rax, stack(d - 4), Width::qword);
+          a.alu(op, rax, stack(d - 2), true);
+          a.store(stack(d - 4), rax, Width::qword);
+          return true;
+        }
+        case Opcode::lmul:
+          a.load(rax, stack(d - 4), Width::qword);
+          a.imul(rax, stack(d - 2), true);
+          a.store(stack(d - 4), rax, Width::qword);
+          return true;
+        case Opcode::idiv: divide(i, d, false, false); return true;
+        case Opcode::irem: divide(i, d, false, true); return true;
+        case Opcode::ldiv: divide(i, d, true, false); return true;
+        case Opcode::lrem: divide(i, d, true, true); return true;
+        case Opcode::lneg:
+          a.load(rax, stack(d - 2), Width::qword);
+          a.negate(rax, true);
+          a.store(stack(d - 2), rax, Width::qword);
+          return true;
+        // Shifts by `cl` use the low 6 bits of the count, like Java.
+        case Opcode::lshl:
+        case Opcode::lshr:
+        case Opcode::lushr: {
+          ShiftOp op = opcode == Opcode::lshl ? ShiftOp::shl
+                     : opcode == Opcode::lshr ? ShiftOp::sar
+                                              : ShiftOp::shr;
+          a.load(rcx, stack(d - 1), Width::dword);
+          a.load(rax, stack(d - 3), Width::qword);
+          a.shift(op, rax, true);
+          a.store(stack(d - 3), rax, Width::qword);
+          return true;
+        }
+
+        // Floating point arithmetic, which SSE does as Java specifies.
+        case Opcode::fadd:
+        case Opcode::fsub:
+        case Opcode::fmul:
+        case Opcode::fdiv:
+        case Opcode::dadd:
+        case Opcode::dsub:
+        case Opcode::dmul:
+        case Opcode::ddiv: {
+          FloatOp op = FloatOp::add;
+          switch (opcode) {
+            case Opcode::fsub: case Opcode::dsub: op = FloatOp::sub; break;
+            case Opcode::fmul: case Opcode::dmul: op = FloatOp::mul; break;
+            case Opcode::fdiv: case Opcode::ddiv: op = FloatOp::div; break;
+            default: break;
+          }
+          bool is_double = uint8_t(opcode) % 2 == uint8_t(Opcode::dadd) % 2;
+          int32_t slots = is_double ? 2 : 1;
+          a.load_float(xmm0, stack(d - 2 * slots), is_double);
+          a.float_op(op, xmm0, stack(d - slots), is_double);
+          a.store_float(stack(d - 2 * slots), xmm0, is_double);
+          return true;
+        }
+        case Opcode::frem:
+          a.load_float(xmm0, stack(d - 2), false);
+          a.load_float(xmm1, stack(d - 1), false);
+          call(address_of(&frem));
+          a.store_float(stack(d - 2), xmm0, false);
+          return true;
+        case Opcode::drem:
+          a.load_float(xmm0, stack(d - 4), true);
+          a.load_float(xmm1, stack(d - 2), true);
+          call(address_of(&drem));
+          a.store_float(stack(d - 4), xmm0, true);
+          return true;
+        case Opcode::fneg:
+          a.alu_immediate(AluOp::xor_, stack(d - 1), INT32_MIN, Width::dword);
+          return true;
+        case Opcode::dneg: {
+          // The sign is the top bit of the upper half.
+          Address upper = stack(d - 2);
+          upper.displacement += 4;
+          a.alu_immediate(AluOp::xor_, upper, INT32_MIN, Width::dword);
+          return true;
+        }
+
+        // Conversions.
+        case Opcode::i2l:
+          a.load_signed(rax, stack(d - 1), Width::dword);
+          a.store(stack(d - 1), rax, Width::qword);
+          return true;
+        case Opcode::i2f:
+        case Opcode::i2d: {
+          bool is_double = opcode == Opcode::i2d;
+          a.convert_integer(xmm0, stack(d - 1), false, is_double);
+          a.store_float(stack(d - 1), xmm0, is_double);
+          return true;
+        }
+        case Opcode::l2f:
+        case Opcode::l2d: {
+          bool is_double = opcode == Opcode::l2d;
+          a.convert_integer(xmm0, stack(d - 2), true, is_double);
+          a.store_float(stack(d - 2), xmm0, is_double);
+          return true;
+        }
+        case Opcode::f2i:
+        case Opcode::f2l:
+          a.load_float(xmm0, stack(d - 1), false);
+          call(opcode == Opcode::f2i ? address_of(&f2i) : address_of(&f2l));
+          a.store(stack(d - 1), rax,
+                  opcode == Opcode::f2i ? Width::dword : Width::qword);
+          return true;
+        case Opcode::d2i:
+        case Opcode::d2l:
+          a.load_float(xmm0, stack(d - 2), true);
+          call(opcode == Opcode::d2i ? address_of(&d2i) : address_of(&d2l));
+          a.store(stack(d - 2), rax,
+                  opcode == Opcode::d2i ? Width::dword : Width::qword);
+          return true;
+        case Opcode::f2d:
+          a.convert_float(xmm0, stack(d - 1), false);
+          a.store_float(stack(d - 1), xmm0, true);
+          return true;
+        case Opcode::d2f:
+          a.convert_float(xmm0, stack(d - 2), true);
+          a.store_float(stack(d - 2), xmm0, false);
+          return true;
+        case Opcode::i2b:
+          a.load_signed(rax, stack(d - 1), Width::byte);
+          a.store(stack(d - 1), rax, Width::dword);
+          return true;
+        case Opcode::i2c:
+          a.load(rax, stack(d - 1), Width::word);
+          a.store(stack(d - 1), rax, Width::dword);
+          return true;
+        case Opcode::i2s:
+          a.load_signed(rax, stack(d - 1), Width::word);
+          a.store(stack(d - 1), rax, Width::dword);
+          return true;
+
+        // Comparisons and branches.
+        case Opcode::lcmp:
+          a.load(rax, stack(d - 4), Width::qword);
+          a.alu(AluOp::cmp, rax, stack(d - 2), true);
+          compare_result(stack(d - 4), 0, false);
+          return true;
+        case Opcode::fcmpl:
+        case Opcode::fcmpg:
+          a.load_float(xmm0, stack(d - 2), false);
+          a.compare_float(xmm0, stack(d - 1), false);
+          compare_result(stack(d - 2),
+                         opcode == Opcode::fcmpl ? UINT32_MAX : 1, true);
+          return true;
+        case Opcode::dcmpl:
+        case Opcode::dcmpg:
+          a.load_float(xmm0, stack(d - 4), true);
+          a.compare_float(xmm0, stack(d - 2), true);
+          compare_result(stack(d - 4),
+                         opcode == Opcode::dcmpl ? UINT32_MAX : 1, true);
+          return true;
+        case Opcode::tableswitch: {
+          SwitchTable const &table = *instruction.table;
+          // Tables are emitted whole, so keep them reasonable.
+          if (table.count > UINT16_MAX) { return false; }
+          a.load(rax, stack(d - 1), Width::dword);
+          a.alu_immediate(AluOp::sub, rax, table.low, false);
+          a.alu_immediate(AluOp::cmp, rax, int32_t(table.count), false);
+          jumps.push({a.jump(Condition::above_equal),
+                      index_of(table.default_target)});
+          jump_table(i);
+          return true;
+        }
+        case Opcode::lookupswitch:
+          if (instruction.table->count > UINT16_MAX) { return false; }
+          a.move_immediate(rdi, uintptr_t(instruction.table));
+          a.load(rsi, stack(d - 1), Width::dword);
+          call(address_of(&lookup));
+          jump_table(i);
+          return true;
+
+        // Objects.
+        case Opcode::newarray:
+        case Opcode::anewarray:
+          save(i, d);
+          call_runtime(opcode == Opcode::newarray
+                         ? address_of(&new_array)
+                         : address_of(&new_reference_array), i, d);
+          check_exception();
+          return true;
+        case Opcode::checkcast: {
+          a.alu_immediate(AluOp::cmp, stack(d - 1), 0, Width::qword);
+          uint32_t is_null = a.jump(Condition::equal);
+          save(i, d);
+          call_runtime(address_of(&check_cast), i, d);
+          check_exception();
+          a.bind(is_null, a.get_size());
+          return true;
+        }
+        case Opcode::instanceof:
+          save(i, d);
+          call_runtime(address_of(&instance_of), i, d);
+          check_exception();
+          return true;
+        case Opcode::athrow:
+          a.load(rax, stack(d - 1), Width::qword);
+          a.test(rax, rax, true);
+          slow_path(Condition::equal, i, d, SlowKind::null_pointer);
+          save(i, d);
+          a.load(rax, stack(d - 1), Width::qword);
+          a.store({r12, exception_offset}, rax, Width::qword);
+          exception_exits.push(a.jump());
+          return true;
+        case Opcode::monitorenter:
+        case Opcode::monitorexit: {
+          // The thin lock fast paths of `Monitors::enter` and `exit`: a
+          // compare and swap of the header when it is unlocked, or locked
+          // once by this thread, and the runtime otherwise.
+          bool enter = opcode == Opcode::monitorenter;
+          null_check(stack(d - 1), i, d);
+          a.load(rcx, stack(d - 1), Width::qword);
+          a.load(rax, {rcx, 0}, Width::qword);
+          a.move(rdx, rax);
+          a.alu_immediate(AluOp::and_, rdx,
+                          int32_t(uint32_t(mark_word::lock_bits)), false);
+          if (not enter) {
+            a.alu(AluOp::cmp, rdx, {r12, thin_lock_offset}, false);
+          }
+          uint32_t slow = a.jump(Condition::not_equal);
+          a.load(rdx, {r12, thin_lock_offset}, Width::dword);
+          // Set the bits to lock, clear them to unlock.
+          a.alu(enter ? AluOp::or_ : AluOp::xor_, rdx, rax, true);
+          a.compare_exchange({rcx, 0}, rdx, true);
+          uint32_t done = a.jump(Condition::equal);
+          a.bind(slow, a.get_size());
+          save(i, d);
+          call_runtime(enter ? address_of(&monitor_enter)
+                             : address_of(&monitor_exit), i, d);
+          check_exception();
+          a.bind(done, a.get_size());
+          return true;
+        }
+
+        default:
+          break;
+      }
+
+      // Quick instructions.
+      if (opcode == quick::invokevirtual) {
+        invoke_cached(i, d, false);
+        return true;
+      }
+      if (opcode == quick::invokeinterface) {
+        invoke_cached(i, d, true);
+        return true;
+      }
+      if (opcode == quick::invokespecial or opcode == quick::invokestatic) {
+        Method *target = instruction.method;
+        if (opcode == quick::invokespecial) {
+          null_check(stack(d - target->argument_slots), i, d);
+        }
+        call_method(target, i, d);
+        return true;
+      }
+      if (opcode == quick::new_) {
+        // Bump the buffer of the thread inline, see `Heap::allocate`, and
+        // call the runtime to refill it.
+        auto size = int32_t(Heap::align(instruction.klass->instance_size));
+        a.load(rax, {r12, tlab_top_offset}, Width::qword);
+        a.lea(rcx, {rax, size});
+        a.alu(AluOp::cmp, rcx, {r12, tlab_end_offset}, true);
+        uint32_t slow = a.jump(Condition::above);
+        a.store({r12, tlab_top_offset}, rcx, Width::qword);
+        // The buffer is zeroed: only the class is left to set.
+        a.store_immediate({rax, int32_t(narrow_klass_offset)},
+                          int32_t(encode_klass(instruction.klass)),
+                          Width::dword);
+        a.store(stack(d), rax, Width::qword);
+        uint32_t done = a.jump();
+        a.bind(slow, a.get_size());
+        save(i, d);
+        a.move(rdi, r12);
+        a.move_immediate(rsi, uintptr_t(instruction.klass));
+        a.lea(rdx, stack(d));
+        call(address_of(&new_object));
+        check_exception();
+        a.bind(done, a.get_size());
+        return true;
+      }
+      return false;
+    }
+
+    /// The out of line paths, the exits and the jump tables, after the
+    /// code of the instructions.
+    auto MethodCompiler::emit_stubs() -> void {
+      Assembler &a = assembler;
+      for (SlowPath const &path : slow_paths) {
+        a.bind(path.jump, a.get_size());
+        store_operands(path.deferred);
+        save(path.instruction, path.depth);
+        a.move(rdi, r12);
+        switch (path.kind) {
+          case SlowKind::null_pointer:
+            call(address_of(&throw_null_pointer));
+            break;
+          case SlowKind::index_out_of_bounds:
+            a.load(rsi, stack(path.array), Width::qword);
+            a.load(rdx, stack(path.index), Width::dword);
+            call(address_of(&throw_index_out_of_bounds));
+            break;
+          case SlowKind::division_by_zero:
+            call(address_of(&throw_division_by_zero));
+            break;
+          case SlowKind::deoptimize:
+            a.move_immediate(rax, status_deoptimized);
+            exits.push(a.jump());
+            continue;
+        }
+        exception_exits.push(a.jump());
+      }
+
+      uint32_t exception_exit = a.get_size();
+      for (uint32_t jump : exception_exits) {
+        a.bind(jump, exception_exit);
+      }
+      a.move_immediate(rax, status_exception);
+      uint32_t epilogue = a.get_size();
+      for (uint32_t jump : exits) {
+        a.bind(jump, epilogue);
+      }
+      a.pop(r14);
+      a.pop(r13);
+      a.pop(r12);
+      a.pop(rbx);
+      a.pop(rbp);
+      a.ret();
+
+      // Entries are offsets from the start of their table.
+      for (JumpTable const &table : tables) {
+        SwitchTable const &switch_table = *decoded.code[table.instruction].table;
+        uint32_t start = a.get_size();
+        a.bind(table.position, start);
+        for (uint32_t k = 0; k < switch_table.count; ++k) {
+          a.data(int32_t(entries[index_of(switch_table.targets[k])] - start));
+        }
+        if (opcodes[table.instruction] == Opcode::lookupswitch) {
+          a.data(int32_t(entries[index_of(switch_table.default_target)] -
+                         start));
+        }
+      }
+    }
+
+    auto MethodCompiler::compile(CodeCache &cache, bool &out_of_space)
+        -> CompiledMethod * {
+      out_of_space = false;
+
+      // The entry: save the registers compiled code uses, five of them to
+      // keep the stack aligned for calls, and go to the instruction.
+      Assembler &a = assembler;
+      a.push(rbp);
+      a.push(rbx);
+      a.push(r12);
+      a.push(r13);
+      a.push(r14);
+      a.move(r12, rdi);
+      a.move(r13, rsi);
+      a.move(r14, rcx);
+      a.load(rbx, {r13, field_offset(offsetof(Frame, locals))}, Width::qword);
+      a.jump(rdx);
+
+      // Operands are in their slots where control flow joins, the entries
+      // of loops included.
+      for (uint32_t i = 0; i < decoded.length; ++i) {
+        Instruction const &instruction = decoded.code[i];
+        if (depths[i] == UINT16_MAX) { continue; }
+        if ((opcodes[i] >= Opcode::ifeq and opcodes[i] <= Opcode::goto_) or
+            opcodes[i] == Opcode::ifnull or opcodes[i] == Opcode::ifnonnull) {
+          targets[index_of(instruction.target)] = true;
+        } else if (opcodes[i] == Opcode::tableswitch or
+                   opcodes[i] == Opcode::lookupswitch) {
+          SwitchTable const &table = *instruction.table;
+          for (uint32_t k = 0; k < table.count; ++k) {
+            targets[index_of(table.targets[k])] = true;
+          }
+          targets[index_of(table.default_target)] = true;
+        }
+      }
+
+      for (uint32_t i = 0; i < decoded.length; ++i) {
+        if (targets[i]) { flush(); }
+        entries[i] = a.get_size();
+        if (depths[i] == UINT16_MAX) { continue; }
+        if (not emit(i)) { return nullptr; }
+      }
+      for (Jump const &jump : jumps) {
+        a.bind(jump.position, entries[jump.target]);
+      }
+      emit_stubs();
+
+      uint8_t *code = cache.install(a.get_code(), a.get_size());
+      if (code == nullptr) {
+        out_of_space = true;
+        return nullptr;
+      }
+
+      auto *compiled = static_cast<CompiledMethod *>(
+        checked_malloc(sizeof(CompiledMethod)));
+      compiled->method = &method;
+      compiled->code = code;
+      compiled->size = a.get_size();
+      compiled->entries = entries;
+      entries = nullptr;
+      return compiled;
+    }
+#endif
+  } // namespace
+
+  Compiler::Compiler() noexcept : enabled(is_available()) {}
+
+  Compiler::~Compiler() noexcept {
+    for (CompiledMethod *compiled : methods) {
+      free(compiled->entries);
+      free(compiled);
+    }
+    pthread_mutex_destroy(&mutex);
+  }
+
+  auto Compiler::is_available() -> bool {
+    return SKJVM_COMPILER != 0;
+  }
+
+  auto Compiler::get_stats() -> CompilerStats {
+    pthread_mutex_lock(&mutex);
+    CompilerStats result = stats;
+    result.osr_entries = __atomic_load_n(&stats.osr_entries,
+                                         __ATOMIC_RELAXED);
+    result.deoptimizations = __atomic_load_n(&stats.deoptimizations,
+                                             __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&mutex);
+    return result;
+  }
+
+  auto Compiler::compiled(Thread &thread, Method &method)
+      -> CompiledMethod * {
+    CompiledMethod *compiled = __atomic_load_n(&method.compiled,
+                                               __ATOMIC_ACQUIRE);
+    if (compiled != nullptr) { return compiled; }
+    if (not enabled or method.decoded == nullptr) { return nullptr; }
+    return compile(thread, method, false);
+  }
+
+  auto Compiler::compile(Thread &thread, Method &method, bool osr)
+      -> CompiledMethod * {
+#if SKJVM_COMPILER
+    pthread_mutex_lock(&mutex);
+    CompiledMethod *compiled = __atomic_load_n(&method.compiled,
+                                               __ATOMIC_ACQUIRE);
+    if (compiled == nullptr and
+        not __atomic_load_n(&method.not_compilable, __ATOMIC_RELAXED)) {
+      MethodCompiler compiler(thread, method);
+      bool out_of_space = false;
+      compiled = compiler.compile(cache, out_of_space);
+      if (compiled == nullptr) {
+        ++stats.failed;
+        __atomic_store_n(&method.not_compilable, true, __ATOMIC_RELAXED);
+        if (out_of_space and not cache_full) {
+          cache_full = true;
+          fprintf(stderr, "warning: the code cache is full (%zu bytes), "
+                  "methods are no longer compiled\n", cache.get_capacity());
+        }
+      } else {
+        methods.push(compiled);
+        ++stats.compiled;
+        stats.code_bytes += compiled->size;
+        __atomic_store_n(&method.compiled, compiled, __ATOMIC_RELEASE);
+        if (print_compilation) {
+          printf("%6" PRIu64 " %c %.*s::%.*s%.*s (%u bytes)\n",
+                 stats.compiled, osr ? '%' : ' ',
+                 int(method.holder->name.length), method.holder->name.bytes,
+                 int(method.name.length), method.name.bytes,
+                 int(method.descriptor.length), method.descriptor.bytes,
+                 compiled->size);
+        }
+      }
+    }
+    pthread_mutex_unlock(&mutex);
+    return compiled;
+#else
+    (void)thread;
+    (void)method;
+    (void)osr;
+    return nullptr;
+#endif
+  }
+
+  auto Compiler::run(Thread &thread, Frame &frame, CompiledMethod &compiled,
+                     uint32_t index, Value &result) -> CompiledExit {
+#if SKJVM_COMPILER
+    auto code = reinterpret_cast<CompiledCode>(compiled.code);
+    switch (code(&thread, &frame, compiled.code + compiled.entries[index],
+                 &result)) {
+      case status_returned:
+        return CompiledExit::returned;
+      case status_exception:
+        return CompiledExit::exception;
+      default:
+        deoptimize(*frame.method, compiled);
+        return CompiledExit::deoptimized;
+    }
+#else
+    (void)thread;
+    (void)frame;
+    (void)compiled;
+    (void)index;
+    (void)result;
+    return CompiledExit::not_entered;
+#endif
+  }
+
+  auto Compiler::finish(Thread &thread, Frame &frame,
+                        CompiledMethod &compiled, bool deoptimized)
+      -> Value {
+    if (deoptimized) { deoptimize(*frame.method, compiled); }
+    return resume(thread, thread.get_vm().get_dispatch_mode(), frame);
+  }
+
+  auto Compiler::deoptimize(Method &method, CompiledMethod &compiled)
+      -> void {
+    __atomic_fetch_add(&stats.deoptimizations, 1, __ATOMIC_RELAXED);
+    // The first thread to leave the code drops it; others may still be
+    // running it, which is why code is never freed.
+    CompiledMethod *expected = &compiled;
+    if (not __atomic_compare_exchange_n(&method.compiled, &expected, nullptr,
+                                        false, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_RELAXED)) {
+      return;
+    }
+    __atomic_store_n(&method.invocation_count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&method.backedge_count, 0, __ATOMIC_RELAXED);
+    uint8_t count = uint8_t(__atomic_add_fetch(&method.recompilations, 1,
+                                               __ATOMIC_RELAXED));
+    if (count >= max_recompilations) {
+      __atomic_store_n(&method.not_compilable, true, __ATOMIC_RELAXED);
+    }
+    if (print_compilation) {
+      printf("       %.*s::%.*s%.*s made not entrant\n",
+             int(method.holder->name.length), method.holder->name.bytes,
+             int(method.name.length), method.name.bytes,
+             int(method.descriptor.length), method.descriptor.bytes);
+    }
+  }
+
+  auto Compiler::on_invocation(Thread &thread, Frame &frame, Value &result)
+      -> CompiledExit {
+    Method &method = *frame.method;
+    CompiledMethod *compiled = __atomic_load_n(&method.compiled,
+                                               __ATOMIC_ACQUIRE);
+    if (compiled == nullptr) {
+      if (__atomic_load_n(&method.not_compilable, __ATOMIC_RELAXED)) {
+        return CompiledExit::not_entered;
+      }
+      // Counters are approximate: threads may lose each other's updates.
+      uint32_t count = __atomic_load_n(&method.invocation_count,
+                                       __ATOMIC_RELAXED) + 1;
+      __atomic_store_n(&method.invocation_count, count, __ATOMIC_RELAXED);
+      if (count < compile_threshold) { return CompiledExit::not_entered; }
+      compiled = compile(thread, method, false);
+      if (compiled == nullptr) { return CompiledExit::not_entered; }
+    }
+    return run(thread, frame, *compiled, 0, result);
+  }
+
+  auto Compiler::on_backedge(Thread &thread, Frame &frame, Value &result)
+      -> CompiledExit {
+    Method &method = *frame.method;
+    // Checked first, so such a loop is neither counted nor compiled for.
+    auto index = uint32_t(frame.ip - method.decoded->code);
+    if (method.decoded->depths[index] != frame.sp - frame.stack) {
+      return CompiledExit::no_entry;
+    }
+    CompiledMethod *compiled = __atomic_load_n(&method.compiled,
+                                               __ATOMIC_ACQUIRE);
+    if (compiled == nullptr) {
+      if (__atomic_load_n(&method.not_compilable, __ATOMIC_RELAXED)) {
+        return CompiledExit::not_entered;
+      }
+      uint32_t count = __atomic_load_n(&method.backedge_count,
+                                       __ATOMIC_RELAXED) + 1;
+      __atomic_store_n(&method.backedge_count, count, __ATOMIC_RELAXED);
+      if (count < backedge_threshold) { return CompiledExit::not_entered; }
+      compiled = compile(thread, method, true);
+      if (compiled == nullptr) { return CompiledExit::not_entered; }
+    }
+    __atomic_fetch_add(&stats.osr_entries, 1, __ATOMIC_RELAXED);
+    return run(thread, frame, *compiled, index, result);
+  }
+} // namespace skjvm
@@ -0,0 +1,64 @@
+#include <skjvm/descriptor.hpp>
+
+#include <string.h>
+
+namespace skjvm {
+  auto field_type_length(Utf8View descriptor, uint16_t position) -> uint16_t {
+    uint16_t start = position;
+    while (position < descriptor.length and descriptor.bytes[position] == '[') {
+      ++position;
+    }
+    if (position >= descriptor.length or position - start > 255) { return 0; }
+
+    switch (descriptor.bytes[position]) {
+      case 'B': case 'C': case 'D': case 'F':
+      case 'I': case 'J': case 'S': case 'Z':
+        return uint16_t(position + 1 - start);
+      case 'L': {
+        auto *end = static_cast<uint8_t const *>(
+          memchr(descriptor.bytes + position, ';',
+                 size_t(descriptor.length - position)));
+        if (end == nullptr or end == descriptor.bytes + position + 1) {
+          return 0;
+        }
+        return uint16_t(end + 1 - descriptor.bytes - start);
+      }
+      default:
+        return 0;
+    }
+  }
+
+  auto parameter_slots(Utf8View descriptor) -> int {
+    if (descriptor.length == 0 or descriptor.bytes[0] != '(') { return -1; }
+    int slots = 0;
+    uint16_t position = 1;
+    while (position < descriptor.length and descriptor.bytes[position] != ')') {
+      uint16_t length = field_type_length(descriptor, position);
+      if (length == 0) { return -1; }
+      char kind = char(descriptor.bytes[position]);
+      slots += length == 1 and (kind == 'J' or kind == 'D') ? 2 : 1;
+      position = uint16_t(position + length);
+    }
+    if (position + 1 >= descriptor.length) { return -1; }
+    return slots;
+  }
+
+  auto return_type(Utf8View descriptor) -> char {
+    if (descriptor.length == 0) { return 0; }
+    auto *close = static_cast<uint8_t const *>(
+      memchr(descriptor.bytes, ')', descriptor.length));
+    if (close == nullptr) { return 0; }
+    auto position = uint16_t(close + 1 - descriptor.bytes);
+    if (position < descriptor.length and descriptor.bytes[position] == 'V') {
+      return position + 1 == descriptor.length ? 'V' : 0;
+    }
+    uint16_t length = field_type_length(descriptor, position);
+    if (length == 0 or position + length != descriptor.length) { return 0; }
+    return char(descriptor.bytes[position]);
+  }
+
+  auto make_view(char const *string) -> Utf8View {
+    return {reinterpret_cast<uint8_t const *>(string),
+            uint16_t(strlen(string))};
+  }
+} // namespace skjvm
@@ -0,0 +1,134 @@
+#include <skjvm/gc_workers.hpp>
+
+namespace skjvm {
+  namespace {
+    class MutexGuard {
+      pthread_mutex_t &mutex;
+
+     public:
+      explicit MutexGuard(pthread_mutex_t &mutex) noexcept : mutex(mutex) {
+        pthread_mutex_lock(&mutex);
+      }
+      MutexGuard(MutexGuard const&) = delete;
+      auto operator=(MutexGuard const&) -> MutexGuard & = delete;
+      ~MutexGuard() noexcept {
+        pthread_mutex_unlock(&mutex);
+      }
+    };
+  } // namespace
+
+  GcWorkers::~GcWorkers() noexcept {
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_broadcast(&work_available);
+    pthread_mutex_unlock(&mutex);
+    for (pthread_t thread : threads) {
+      pthread_join(thread, nullptr);
+    }
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&work_available);
+    pthread_cond_destroy(&work_done);
+  }
+
+  auto GcWorkers::set_count(uint32_t workers) -> void {
+    MutexGuard guard(mutex);
+    if (threads.is_empty() and workers != 0) { count = workers; }
+  }
+
+  auto GcWorkers::worker_main(void *workers) -> void * {
+    static_cast<GcWorkers *>(workers)->work();
+    return nullptr;
+  }
+
+  auto GcWorkers::work() -> void {
+    pthread_mutex_lock(&mutex);
+    // Threads are started before the generation of their first task.
+    uint32_t index = ++started;
+    uint64_t seen = 0;
+    while (true) {
+      while (generation == seen and not stopping) {
+        pthread_cond_wait(&work_available, &mutex);
+      }
+      if (stopping) { break; }
+      seen = generation;
+      void (*function)(void *, uint32_t) = task;
+      void *argument = context;
+      pthread_mutex_unlock(&mutex);
+      function(argument, index);
+      pthread_mutex_lock(&mutex);
+      if (--pending == 0) { pthread_cond_signal(&work_done); }
+    }
+    pthread_mutex_unlock(&mutex);
+  }
+
+  auto GcWorkers::run(void (*function)(void *, uint32_t), void *argument)
+      -> void {
+    {
+      MutexGuard guard(mutex);
+      if (threads.is_empty() and count > 1) {
+        for (uint32_t i = 1; i < count; ++i) {
+          pthread_t thread;
+          if (pthread_create(&thread, nullptr, &GcWorkers::worker_main,
+                             this) != 0) {
+            fatal("cannot start garbage collector threads");
+          }
+          threads.push(thread);
+        }
+      }
+      task = function;
+      context = argument;
+      pending = uint32_t(threads.get_size());
+      ++generation;
+      pthread_cond_broadcast(&work_available);
+    }
+    function(argument, 0);
+    MutexGuard guard(mutex);
+    while (pending != 0) {
+      pthread_cond_wait(&work_done, &mutex);
+    }
+  }
+
+  auto WorkStealingDeque::push(Object *object) -> bool {
+    int64_t b = __atomic_load_n(&bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&top, __ATOMIC_ACQUIRE);
+    if (b - t > mask) { return false; }
+    __atomic_store_n(&buffer[b & mask], object, __ATOMIC_RELAXED);
+    __atomic_store_n(&bottom, b + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  auto WorkStealingDeque::pop() -> Object * {
+    int64_t b = __atomic_load_n(&bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&top, __ATOMIC_RELAXED);
+    if (t > b) {
+      __atomic_store_n(&bottom, b + 1, __ATOMIC_RELAXED);
+      return nullptr;
+    }
+    Object *object = __atomic_load_n(&buffer[b & mask], __ATOMIC_RELAXED);
+    if (t == b) {
+      // The last one: whoever moves the top first takes it.
+      if (not __atomic_compare_exchange_n(&top, &t, t + 1, false,
+                                          __ATOMIC_SEQ_CST,
+                                          __ATOMIC_RELAXED)) {
+        object = nullptr;
+      }
+      __atomic_store_n(&bottom, b + 1, __ATOMIC_RELAXED);
+    }
+    return object;
+  }
+
+  auto WorkStealingDeque::steal() -> Object * {
+    int64_t t = __atomic_load_n(&top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) { return nullptr; }
+    Object *object = __atomic_load_n(&buffer[t & mask], __ATOMIC_RELAXED);
+    if (not __atomic_compare_exchange_n(&top, &t, t + 1, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+      return nullptr;
+    }
+    return object;
+  }
+} // namespace skjvm
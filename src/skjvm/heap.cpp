@@ -0,0 +1,796 @@
+#include <skjvm/heap.hpp>
+
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace skjvm {
+  namespace {
+    constexpr size_t page_size = 4096;
+
+    /// Objects each marking worker keeps before it overflows.
+    constexpr uint32_t mark_deque_capacity = 1 << 14;
+
+    auto round_down(size_t size, size_t alignment) -> size_t {
+      return size & ~(alignment - 1);
+    }
+
+    auto nanoseconds() -> int64_t {
+      timespec now {};
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      return int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    /// Size of \p object in the heap, or of a free chunk.
+    auto size_of(Object const *object) -> size_t {
+      if (object->get_narrow_klass() == 0) {
+        return uint32_t(object->mark);
+      }
+      Klass const *klass = object->get_klass();
+      if (not klass->is_array()) { return Heap::align(klass->instance_size); }
+      auto const *array = reinterpret_cast<ArrayObject const *>(object);
+      return Heap::align(array_data_offset + size_t(array->length) *
+                         size_of(klass->element_type));
+    }
+
+    auto is_forwarded(uintptr_t mark) -> bool {
+      return (mark & mark_word::forwarded_mask) == mark_word::forwarded;
+    }
+
+    auto kilobytes(size_t bytes) -> unsigned long long {
+      return (unsigned long long)(bytes / 1024);
+    }
+
+    auto milliseconds(uint64_t nanoseconds) -> double {
+      return double(nanoseconds) / 1e6;
+    }
+
+    /// Call \p visit with each reference field or element of \p object.
+    template <typename Visit>
+    auto for_each_reference(Object *object, Visit visit) -> void {
+      Klass const *klass = object->get_klass();
+      if (klass->is_array()) {
+        if (klass->element_type != BasicType::reference) { return; }
+        auto *array = reinterpret_cast<ArrayObject *>(object);
+        auto **elements = array->elements<Object *>();
+        for (int32_t i = 0; i < array->length; ++i) { visit(&elements[i]); }
+        return;
+      }
+      for (uint32_t i = 0; i < klass->reference_block_count; ++i) {
+        ReferenceBlock const &block = klass->reference_blocks[i];
+        auto **slot = &object->at<Object *>(block.offset);
+        for (Object **end = slot + block.count; slot < end; ++slot) {
+          visit(slot);
+        }
+      }
+    }
+
+    /// The free list of chunks of \p size bytes.
+    auto free_list_of(size_t size, size_t small_limit) -> uint32_t {
+      if (size <= small_limit) { return uint32_t(size / 8); }
+      // From the list after the small ones, a list per power of two.
+      auto log2 = uint32_t(63 - __builtin_clzll(size));
+      auto small_log2 = uint32_t(63 - __builtin_clzll(small_limit));
+      return uint32_t(small_limit / 8) + (log2 - small_log2);
+    }
+  } // namespace
+
+  /// What the workers of a full collection share while marking.
+  struct Heap::MarkContext {
+    PodVector<Object **> const &roots;
+    WorkStealingDeque *deques;
+    uint32_t count;
+
+    /// Objects that did not fit in a full deque.
+    pthread_mutex_t overflow_mutex = PTHREAD_MUTEX_INITIALIZER;
+    PodVector<Object *> overflow {};
+    size_t overflow_size {0};
+
+    /// Workers that found nothing left to do.
+    uint32_t idle {0};
+
+    [[nodiscard]]
+    auto has_work() const -> bool {
+      if (__atomic_load_n(&overflow_size, __ATOMIC_ACQUIRE) != 0) {
+        return true;
+      }
+      for (uint32_t i = 0; i < count; ++i) {
+        if (not deques[i].is_empty()) { return true; }
+      }
+      return false;
+    }
+  };
+
+  Heap::Heap(size_t size, size_t young_size) noexcept
+    : start_time(nanoseconds()) {
+    size = round_down(size, page_size);
+    size_t young = round_down(young_size != 0 ? young_size : size / 3,
+                              page_size);
+    size_t survivor = round_down(young / 10, page_size);
+    if (survivor == 0 or young <= 2 * survivor or young >= size) {
+      fatal("a Java heap of %zu bytes, %zu of them young, is too small",
+            size, young);
+    }
+
+    // Reserved now and committed by the system as it is touched, so that
+    // the heap, and the card table compiled code refers to, never move.
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED) {
+      fatal("cannot reserve a Java heap of %zu bytes", size);
+    }
+    base = static_cast<uint8_t *>(memory);
+    reserved = size;
+    uint8_t *position = base;
+    auto carve = [&](Space &space, size_t bytes) {
+      space = {position, position, position + bytes};
+      position += bytes;
+    };
+    carve(eden, young - 2 * survivor);
+    carve(from, survivor);
+    carve(to, survivor);
+    carve(old, size - young);
+
+    size_t eden_size = size_t(eden.end - eden.start);
+    tlab_size = round_down(eden_size / 16 < default_tlab_size
+                             ? eden_size / 16
+                             : default_tlab_size, 8);
+
+    cards = static_cast<uint8_t *>(checked_calloc(size >> card_shift, 1));
+    card_base = reinterpret_cast<uint8_t *>(
+      uintptr_t(cards) - (uintptr_t(base) >> card_shift));
+    object_starts = static_cast<uint32_t *>(
+      checked_calloc((size - young) >> card_shift, sizeof(uint32_t)));
+
+    mark_bits = static_cast<uint64_t *>(
+      checked_calloc((size / 8 + 63) / 64, sizeof(uint64_t)));
+    block_count = (size - young + sweep_block_size - 1) / sweep_block_size;
+    block_live = static_cast<uint32_t *>(
+      checked_calloc(block_count, sizeof(uint32_t)));
+    block_first = static_cast<uint32_t *>(
+      checked_calloc(block_count, sizeof(uint32_t)));
+    sweep_limit = old.start;
+    next_block = block_count;
+
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t threads = online > 0 ? uint32_t(online) : 1;
+    workers.set_count(threads < max_default_gc_threads
+                        ? threads
+                        : max_default_gc_threads);
+  }
+
+  Heap::~Heap() noexcept {
+    munmap(base, reserved);
+    free(cards);
+    free(object_starts);
+    free(mark_bits);
+    free(block_live);
+    free(block_first);
+    pthread_mutex_destroy(&old_mutex);
+  }
+
+  auto Heap::claim(Space &space, size_t size) -> uint8_t * {
+    uint8_t *top = __atomic_load_n(&space.top, __ATOMIC_RELAXED);
+    do {
+      if (size > size_t(space.end - top)) { return nullptr; }
+    } while (not __atomic_compare_exchange_n(&space.top, &top, top + size,
+                                             true, __ATOMIC_RELAXED,
+                                             __ATOMIC_RELAXED));
+    __atomic_fetch_add(&stats.allocated_bytes, size, __ATOMIC_RELAXED);
+    return top;
+  }
+
+  auto Heap::allocate_slow(Tlab &tlab, size_t size) -> void * {
+    size_t eden_size = size_t(eden.end - eden.start);
+    if (size > eden_size / 2) {
+      return allocate_old(size);
+    }
+    if (size >= tlab_size / 4) {
+      // Not worth a buffer of its own, nor wasting what is left of the
+      // current one.
+      uint8_t *object = claim(eden, size);
+      if (object != nullptr) { memset(object, 0, size); }
+      return object;
+    }
+    uint8_t *buffer = claim(eden, tlab_size);
+    if (buffer == nullptr) { return nullptr; }
+    __atomic_fetch_add(&stats.tlab_refills, 1, __ATOMIC_RELAXED);
+    memset(buffer, 0, tlab_size);
+    tlab = {buffer + size, buffer + tlab_size};
+    return buffer;
+  }
+
+  auto Heap::allocate_old(size_t size) -> uint8_t * {
+    pthread_mutex_lock(&old_mutex);
+    uint8_t *object = find_old_space(size);
+    pthread_mutex_unlock(&old_mutex);
+    if (object != nullptr) {
+      memset(object, 0, size);
+      record_object_start(object, size);
+    }
+    return object;
+  }
+
+  /// \p size bytes of the old generation: a free chunk, sweeping more
+  /// blocks if the lists have none, or else the space never used yet.
+  auto Heap::find_old_space(size_t size) -> uint8_t * {
+    do {
+      if (uint8_t *chunk = take_chunk(size)) { return chunk; }
+    } while (sweep_some());
+    return claim(old, size);
+  }
+
+  auto Heap::record_object_start(uint8_t const *object, size_t size) -> void {
+    // The cards whose first byte the object covers.
+    size_t offset = size_t(object - old.start);
+    size_t first = (offset + card_size - 1) >> card_shift;
+    size_t end = (offset + size + card_size - 1) >> card_shift;
+    for (size_t card = first; card < end; ++card) {
+      object_starts[card] = uint32_t(offset / 8);
+    }
+  }
+
+  auto Heap::mark_cards(void const *start, size_t size) -> void {
+    if (size == 0) { return; }
+    uintptr_t first = uintptr_t(start) >> card_shift;
+    uintptr_t last = (uintptr_t(start) + size - 1) >> card_shift;
+    memset(card_base + first, dirty_card, last - first + 1);
+  }
+
+  /// The address of \p object after the collection: its copy, made now if
+  /// it is young and was not copied yet, or itself.
+  auto Heap::evacuate(Object *object) -> Object * {
+    if (not eden.contains(object) and not from.contains(object)) {
+      return object;
+    }
+    uintptr_t mark = object->mark;
+    if (is_forwarded(mark)) {
+      return reinterpret_cast<Object *>(mark & ~mark_word::forwarded_mask);
+    }
+
+    size_t size = size_of(object);
+    uint32_t age = uint32_t((mark & mark_word::age_mask) >>
+                            mark_word::age_shift) + 1;
+    uint8_t *copy = nullptr;
+    if (age < tenuring_threshold and size <= size_t(to.end - to.top)) {
+      copy = to.top;
+      to.top += size;
+      stats.copied_bytes += size;
+    } else {
+      // The promotion guarantee leaves room for everything young, unless
+      // the free chunks are too fragmented.
+      copy = find_old_space(size);
+      if (copy != nullptr) {
+        record_object_start(copy, size);
+        promoted.push(reinterpret_cast<Object *>(copy));
+        stats.promoted_bytes += size;
+      } else if (size <= size_t(to.end - to.top)) {
+        copy = to.top;
+        to.top += size;
+        stats.copied_bytes += size;
+      } else {
+        fatal("promotion failed: no room for %zu bytes in the old "
+              "generation", size);
+      }
+    }
+    memcpy(copy, object, size);
+    if (age > mark_word::max_age) { age = mark_word::max_age; }
+    auto *moved = reinterpret_cast<Object *>(copy);
+    moved->mark = (mark & ~mark_word::age_mask) |
+                  (uintptr_t(age) << mark_word::age_shift);
+    object->mark = uintptr_t(copy) | mark_word::forwarded;
+    return moved;
+  }
+
+  /// Evacuate what the reference fields of \p object, a copy, refer to.
+  /// The cards of a \p promoted object are dirtied where it still refers
+  /// to young objects.
+  auto Heap::scan_object(Object *object, bool is_promoted) -> void {
+    for_each_reference(object, [&](Object **slot) {
+      Object *referent = evacuate(*slot);
+      *slot = referent;
+      if (is_promoted and referent != nullptr and is_young(referent)) {
+        mark_card(slot);
+      }
+    });
+  }
+
+  /// Evacuate what the reference fields on \p card, a dirty card of the
+  /// old generation below \p limit, refer to, and clean it unless they
+  /// still refer to young objects.
+  auto Heap::scan_card(uint8_t *card, uint8_t const *limit) -> void {
+    *card = clean_card;
+    size_t index = size_t(card - (card_base + (uintptr_t(old.start) >>
+                                                 card_shift)));
+    auto **card_start = reinterpret_cast<Object **>(
+      old.start + (index << card_shift));
+    Object **card_end = card_start + card_size / sizeof(Object *);
+    if (reinterpret_cast<uint8_t *>(card_end) > limit) {
+      card_end = reinterpret_cast<Object **>(const_cast<uint8_t *>(limit));
+    }
+
+    bool young = false;
+    auto visit = [&](Object **slot) {
+      Object *referent = evacuate(*slot);
+      *slot = referent;
+      young = young or (referent != nullptr and is_young(referent));
+    };
+    auto *position = old.start + size_t(object_starts[index]) * 8;
+    while (position < reinterpret_cast<uint8_t *>(card_end)) {
+      auto *object = reinterpret_cast<Object *>(position);
+      position += size_of(object);
+      // Dead objects may refer to anything.
+      if (not is_live(object)) { continue; }
+      Klass const *klass = object->get_klass();
+      if (klass->is_array()) {
+        if (klass->element_type != BasicType::reference) { continue; }
+        // Only the elements on the card.
+        auto *array = reinterpret_cast<ArrayObject *>(object);
+        Object **first = array->elements<Object *>();
+        Object **last = first + array->length;
+        if (first < card_start) { first = card_start; }
+        if (last > card_end) { last = card_end; }
+        for (Object **slot = first; slot < last; ++slot) { visit(slot); }
+        continue;
+      }
+      for (uint32_t i = 0; i < klass->reference_block_count; ++i) {
+        ReferenceBlock const &block = klass->reference_blocks[i];
+        Object **first = &object->at<Object *>(block.offset);
+        Object **last = first + block.count;
+        if (first < card_start) { first = card_start; }
+        if (last > card_end) { last = card_end; }
+        for (Object **slot = first; slot < last; ++slot) { visit(slot); }
+      }
+    }
+    if (young) { *card = dirty_card; }
+  }
+
+  /// Scan the dirty cards of the old generation up to \p limit.
+  auto Heap::scan_cards(uint8_t const *limit) -> void {
+    uint8_t *card = card_base + (uintptr_t(old.start) >> card_shift);
+    uint8_t *end = card_base + ((uintptr_t(limit) + card_size - 1) >>
+                                card_shift);
+    while (card < end) {
+      // Skip clean cards a word at a time.
+      if (size_t(end - card) >= 8 and uintptr_t(card) % 8 == 0) {
+        uint64_t group = 0;
+        memcpy(&group, card, sizeof(group));
+        if (group == 0) {
+          card += 8;
+          continue;
+        }
+      }
+      if (*card != clean_card) { scan_card(card, limit); }
+      ++card;
+    }
+  }
+
+  auto Heap::collect_young(PodVector<Object **> const &roots,
+                           PodVector<Object **> const &weak_roots) -> bool {
+    int64_t start = nanoseconds();
+    size_t eden_used = eden.get_used();
+    size_t survivors_before = from.get_used();
+    size_t old_free = get_old_free();
+    size_t old_before = size_t(old.end - old.start) - old_free;
+    if (old_free < eden_used + survivors_before) {
+      if (log) {
+        printf("[%.3fs][gc] GC(%" PRIu64 ") Pause Young (Allocation "
+               "Failure) cancelled: old generation %lluK free, young "
+               "generation %lluK used\n",
+               double(start - start_time) / 1e9, stats.collections,
+               kilobytes(old_free), kilobytes(eden_used + survivors_before));
+      }
+      return false;
+    }
+
+    uint64_t promoted_before = stats.promoted_bytes;
+    uint8_t *const old_limit = old.top;
+    to.top = to.start;
+    promoted.clear();
+    for (Object **root : roots) {
+      *root = evacuate(*root);
+    }
+    scan_cards(old_limit);
+
+    // The copies in the survivor space are scanned in the order they were
+    // made, the promoted ones from a list, and make more copies, until
+    // none is left to scan.
+    uint8_t *to_scan = to.start;
+    while (to_scan < to.top or not promoted.is_empty()) {
+      while (to_scan < to.top) {
+        auto *object = reinterpret_cast<Object *>(to_scan);
+        to_scan += size_of(object);
+        scan_object(object, false);
+      }
+      while (not promoted.is_empty()) {
+        scan_object(promoted.pop(), true);
+      }
+    }
+    for (Object **root : weak_roots) {
+      Object *object = *root;
+      if (eden.contains(object) or from.contains(object)) {
+        uintptr_t mark = object->mark;
+        *root = is_forwarded(mark)
+          ? reinterpret_cast<Object *>(mark & ~mark_word::forwarded_mask)
+          : nullptr;
+      }
+    }
+
+    Space survivors = to;
+    to = from;
+    from = survivors;
+    to.top = to.start;
+    eden.top = eden.start;
+    // What young objects referred to is scanned as they are copied.
+    memset(card_base + (uintptr_t(base) >> card_shift), clean_card,
+           size_t(old.start - base) >> card_shift);
+
+    auto pause = uint64_t(nanoseconds() - start);
+    ++stats.collections;
+    stats.total_pause_ns += pause;
+    if (pause > stats.max_pause_ns) { stats.max_pause_ns = pause; }
+    if (log) {
+      printf("[%.3fs][gc] GC(%" PRIu64 ") Pause Young (Allocation Failure) "
+             "eden %lluK->0K survivor %lluK->%lluK old %lluK->%lluK "
+             "promoted %lluK %.3fms\n",
+             double(start - start_time) / 1e9, stats.collections - 1,
+             kilobytes(eden_used), kilobytes(survivors_before),
+             kilobytes(from.get_used()), kilobytes(old_before),
+             kilobytes(size_t(old.end - old.start) - get_old_free()),
+             kilobytes(size_t(stats.promoted_bytes - promoted_before)),
+             double(pause) / 1e6);
+    }
+    return true;
+  }
+
+  /// Room for promotion: the space never used, the free lists, and what
+  /// sweeping the remaining blocks will find.
+  auto Heap::get_old_free() const -> size_t {
+    return size_t(old.end - old.top) + free_lists.bytes + unswept_free;
+  }
+
+  auto Heap::is_marked(void const *object) const -> bool {
+    size_t bit = size_t(static_cast<uint8_t const *>(object) - base) / 8;
+    return (mark_bits[bit / 64] & (uint64_t(1) << (bit % 64))) != 0;
+  }
+
+  /// Mark \p object. Returns \c false if it was marked already, maybe by
+  /// another worker.
+  auto Heap::mark(Object *object) -> bool {
+    size_t bit = size_t(reinterpret_cast<uint8_t *>(object) - base) / 8;
+    uint64_t mask = uint64_t(1) << (bit % 64);
+    if ((__atomic_load_n(&mark_bits[bit / 64], __ATOMIC_RELAXED) & mask) !=
+        0) {
+      return false;
+    }
+    return (__atomic_fetch_or(&mark_bits[bit / 64], mask, __ATOMIC_RELAXED) &
+            mask) == 0;
+  }
+
+  /// Whether \p object, in the old generation, is live, as far as the
+  /// last full collection knows.
+  auto Heap::is_live(Object const *object) const -> bool {
+    if (object->get_narrow_klass() == 0) { return false; }
+    auto const *address = reinterpret_cast<uint8_t const *>(object);
+    return address >= sweep_limit or
+           size_t(address - old.start) / sweep_block_size < next_block or
+           is_marked(object);
+  }
+
+  /// Mark what worker \p worker can reach from its share of the roots,
+  /// then help the others until nothing is left.
+  auto Heap::mark_work(MarkContext &context, uint32_t worker) -> void {
+    WorkStealingDeque &deque = context.deques[worker];
+    auto visit = [&](Object *object) {
+      if (object == nullptr or not mark(object)) { return; }
+      if (object >= reinterpret_cast<Object *>(old.start)) {
+        size_t block = size_t(reinterpret_cast<uint8_t *>(object) -
+                              old.start) / sweep_block_size;
+        __atomic_fetch_add(&block_live[block], uint32_t(size_of(object)),
+                           __ATOMIC_RELAXED);
+      }
+      if (not deque.push(object)) {
+        pthread_mutex_lock(&context.overflow_mutex);
+        context.overflow.push(object);
+        __atomic_store_n(&context.overflow_size,
+                         context.overflow.get_size(), __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&context.overflow_mutex);
+      }
+    };
+    auto scan = [&](Object *object) {
+      for_each_reference(object, [&](Object **slot) { visit(*slot); });
+    };
+
+    for (size_t i = worker; i < context.roots.get_size();
+         i += context.count) {
+      visit(*context.roots[i]);
+    }
+    while (true) {
+      while (Object *object = deque.pop()) { scan(object); }
+
+      Object *stolen = nullptr;
+      for (uint32_t i = 1; i < context.count and stolen == nullptr; ++i) {
+        stolen = context.deques[(worker + i) % context.count].steal();
+      }
+      if (stolen != nullptr) {
+        scan(stolen);
+        continue;
+      }
+
+      if (__atomic_load_n(&context.overflow_size, __ATOMIC_ACQUIRE) != 0) {
+        PodVector<Object *> taken;
+        pthread_mutex_lock(&context.overflow_mutex);
+        for (size_t i = 0; i < 1024 and not context.overflow.is_empty();
+             ++i) {
+          taken.push(context.overflow.pop());
+        }
+        __atomic_store_n(&context.overflow_size,
+                         context.overflow.get_size(), __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&context.overflow_mutex);
+        for (Object *object : taken) { scan(object); }
+        continue;
+      }
+
+      // Only workers with objects to scan add objects, so once they all
+      // found nothing, marking is over.
+      __atomic_add_fetch(&context.idle, 1, __ATOMIC_ACQ_REL);
+      while (true) {
+        if (__atomic_load_n(&context.idle, __ATOMIC_ACQUIRE) ==
+            context.count) {
+          return;
+        }
+        if (context.has_work()) {
+          __atomic_sub_fetch(&context.idle, 1, __ATOMIC_ACQ_REL);
+          break;
+        }
+        sched_yield();
+      }
+    }
+  }
+
+  /// A chunk of \p size bytes from the free lists, split off a larger one
+  /// if needed, or \c nullptr.
+  auto Heap::take_chunk(size_t size) -> uint8_t * {
+    auto take = [&](uint32_t list, FreeChunk *previous, FreeChunk *chunk) {
+      (previous == nullptr ? free_lists.heads[list] : previous->next) =
+        chunk->next;
+      if (free_lists.tails[list] == chunk) {
+        free_lists.tails[list] = previous;
+      }
+      size_t chunk_size = chunk->get_size();
+      free_lists.bytes -= chunk_size;
+      auto *start = reinterpret_cast<uint8_t *>(chunk);
+      // What is left, at least a word, is a free chunk itself.
+      if (chunk_size > size) {
+        add_chunk(free_lists, start + size, chunk_size - size);
+      }
+      return start;
+    };
+
+    uint32_t first = free_list_of(size, small_chunk_limit);
+    if (size <= small_chunk_limit) {
+      if (FreeChunk *chunk = free_lists.heads[first]) {
+        return take(first, nullptr, chunk);
+      }
+      ++first;
+    }
+    for (uint32_t list = first; list < free_list_count; ++list) {
+      FreeChunk *previous = nullptr;
+      for (FreeChunk *chunk = free_lists.heads[list]; chunk != nullptr;
+           previous = chunk, chunk = chunk->next) {
+        if (chunk->get_size() >= size) {
+          return take(list, previous, chunk);
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  /// Make the \p size bytes from \p start a free chunk of \p lists, or
+  /// several if they are more than \c max_chunk_size.
+  auto Heap::add_chunk(FreeLists &lists, uint8_t *start, size_t size)
+      -> void {
+    for (; size > max_chunk_size; start += max_chunk_size) {
+      add_chunk(lists, start, max_chunk_size);
+      size -= max_chunk_size;
+    }
+    auto *chunk = reinterpret_cast<FreeChunk *>(start);
+    chunk->header = size;
+    record_object_start(start, size);
+    if (size < sizeof(FreeChunk)) { return; }
+    uint32_t list = free_list_of(size, small_chunk_limit);
+    chunk->next = nullptr;
+    if (lists.tails[list] == nullptr) {
+      lists.heads[list] = chunk;
+    } else {
+      lists.tails[list]->next = chunk;
+    }
+    lists.tails[list] = chunk;
+    lists.bytes += size;
+  }
+
+  /// Turn the runs of dead objects starting in \p block into chunks of
+  /// \p lists. Returns the bytes they take.
+  auto Heap::sweep_block(size_t block, FreeLists &lists) -> size_t {
+    uint8_t *block_start = old.start + block * sweep_block_size;
+    uint8_t *limit = block_start + sweep_block_size;
+    if (limit > sweep_limit) { limit = sweep_limit; }
+    uint8_t *position = old.start + size_t(block_first[block]) * 8;
+    uint8_t *run = nullptr;
+    size_t freed = 0;
+    auto end_run = [&] {
+      if (run == nullptr) { return; }
+      add_chunk(lists, run, size_t(position - run));
+      freed += size_t(position - run);
+      run = nullptr;
+    };
+    while (position < limit) {
+      auto *object = reinterpret_cast<Object *>(position);
+      if (object->get_narrow_klass() != 0 and is_marked(object)) {
+        end_run();
+      } else if (run == nullptr) {
+        run = position;
+      }
+      position += size_of(object);
+    }
+    // The last run may end in the next block, at the end of the last
+    // object starting in this one.
+    end_run();
+    return freed;
+  }
+
+  /// Sweep the next blocks, one per worker, in parallel. Returns
+  /// \c false if every block is swept.
+  auto Heap::sweep_some() -> bool {
+    size_t limit_block = (size_t(sweep_limit - old.start) +
+                          sweep_block_size - 1) / sweep_block_size;
+    if (next_block >= limit_block) { return false; }
+    int64_t start = nanoseconds();
+    uint32_t count = workers.get_count();
+    size_t first = next_block;
+    size_t end = first + count < limit_block ? first + count : limit_block;
+
+    auto *lists = static_cast<FreeLists *>(
+      checked_calloc(count, sizeof(FreeLists)));
+    auto *freed = static_cast<size_t *>(checked_calloc(count, sizeof(size_t)));
+    size_t next = first;
+    auto sweep = [&](uint32_t worker) {
+      while (true) {
+        size_t block = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED);
+        if (block >= end) { return; }
+        freed[worker] += sweep_block(block, lists[worker]);
+      }
+    };
+    if (end - first > 1) {
+      workers.run(sweep);
+    } else {
+      sweep(0);
+    }
+
+    size_t swept = 0;
+    for (uint32_t worker = 0; worker < count; ++worker) {
+      FreeLists &local = lists[worker];
+      for (uint32_t list = 0; list < free_list_count; ++list) {
+        if (local.heads[list] == nullptr) { continue; }
+        if (free_lists.tails[list] == nullptr) {
+          free_lists.heads[list] = local.heads[list];
+        } else {
+          free_lists.tails[list]->next = local.heads[list];
+        }
+        free_lists.tails[list] = local.tails[list];
+      }
+      free_lists.bytes += local.bytes;
+      swept += freed[worker];
+    }
+    free(lists);
+    free(freed);
+    unswept_free = swept < unswept_free ? unswept_free - swept : 0;
+    next_block = end;
+
+    auto time = uint64_t(nanoseconds() - start);
+    stats.sweep_ns += time;
+    stats.swept_blocks += end - first;
+    if (log) {
+      printf("[%.3fs][gc] Sweep blocks %zu-%zu of %zu: %lluK free, %lluK "
+             "free lists %.3fms\n",
+             double(start - start_time) / 1e9, first, end - 1, limit_block,
+             kilobytes(swept), kilobytes(free_lists.bytes),
+             milliseconds(time));
+    }
+    return true;
+  }
+
+  auto Heap::collect_full(PodVector<Object **> const &roots,
+                          PodVector<Object **> const &weak_roots) -> void {
+    int64_t start = nanoseconds();
+    size_t old_before = size_t(old.end - old.start) - get_old_free();
+
+    // Chunks are not marked: sweeping finds them again with their
+    // neighbours.
+    free_lists = {};
+    sweep_limit = old.top;
+    size_t limit_block = (size_t(sweep_limit - old.start) +
+                          sweep_block_size - 1) / sweep_block_size;
+    memset(block_live, 0, limit_block * sizeof(uint32_t));
+
+    uint32_t count = workers.get_count();
+    size_t words = (size_t(sweep_limit - base) / 8 + 63) / 64;
+    auto clear = [&](uint32_t worker) {
+      size_t first = words * worker / count;
+      size_t end = words * (worker + 1) / count;
+      memset(mark_bits + first, 0, (end - first) * sizeof(uint64_t));
+    };
+    workers.run(clear);
+    int64_t cleared = nanoseconds();
+
+    MarkContext context {roots, nullptr, count};
+    context.deques = static_cast<WorkStealingDeque *>(
+      checked_malloc(count * sizeof(WorkStealingDeque)));
+    auto *buffers = static_cast<Object **>(
+      checked_malloc(count * mark_deque_capacity * sizeof(Object *)));
+    for (uint32_t i = 0; i < count; ++i) {
+      context.deques[i].init(buffers + size_t(i) * mark_deque_capacity,
+                             mark_deque_capacity);
+    }
+    auto mark_roots = [&](uint32_t worker) { mark_work(context, worker); };
+    workers.run(mark_roots);
+    free(buffers);
+    free(context.deques);
+    pthread_mutex_destroy(&context.overflow_mutex);
+    int64_t marked = nanoseconds();
+    // Young objects are left to the young collection.
+    for (Object **root : weak_roots) {
+      auto *object = reinterpret_cast<uint8_t *>(*root);
+      if (object >= old.start and object < sweep_limit and
+          not is_marked(object)) {
+        *root = nullptr;
+      }
+    }
+
+    // Where sweeping each block starts: after the object that covers its
+    // start, if that one starts in a block before.
+    size_t live = 0;
+    for (size_t block = 0; block < limit_block; ++block) {
+      size_t offset = block * sweep_block_size;
+      size_t first = size_t(object_starts[offset >> card_shift]) * 8;
+      if (first < offset) {
+        first += size_of(reinterpret_cast<Object *>(old.start + first));
+      }
+      block_first[block] = uint32_t(first / 8);
+      live += block_live[block];
+    }
+    next_block = 0;
+    unswept_free = size_t(sweep_limit - old.start) - live;
+
+    auto clear_time = uint64_t(cleared - start);
+    auto mark_time = uint64_t(marked - cleared);
+    auto pause = uint64_t(nanoseconds() - start);
+    ++stats.collections;
+    ++stats.full_collections;
+    stats.clear_ns += clear_time;
+    stats.mark_ns += mark_time;
+    stats.total_pause_ns += pause;
+    if (pause > stats.max_pause_ns) { stats.max_pause_ns = pause; }
+    if (log) {
+      printf("[%.3fs][gc] GC(%" PRIu64 ") Pause Full (Allocation Failure) "
+             "old %lluK->%lluK live, clear %.3fms mark %.3fms, %u workers "
+             "%.3fms\n",
+             double(start - start_time) / 1e9, stats.collections - 1,
+             kilobytes(old_before), kilobytes(live), milliseconds(clear_time),
+             milliseconds(mark_time), count, milliseconds(pause));
+    }
+  }
+
+  auto Heap::get_stats() const -> GcStats {
+    GcStats result = stats;
+    result.tlab_refills = __atomic_load_n(&stats.tlab_refills,
+                                          __ATOMIC_RELAXED);
+    result.allocated_bytes = __atomic_load_n(&stats.allocated_bytes,
+                                             __ATOMIC_RELAXED);
+    return result;
+  }
+} // namespace skjvm
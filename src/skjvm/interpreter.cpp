@@ -0,0 +1,1759 @@
+#include <skjvm/interpreter.hpp>
+
+#include <skjvm/bytes.hpp>
+#include <skjvm/stack_map.hpp>
+#include <skjvm/vm.hpp>
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Direct threading needs the "labels as values" extension.
+#if defined(__GNUC__)
+#define SKJVM_THREADED_DISPATCH 1
+#else
+#define SKJVM_THREADED_DISPATCH 0
+#endif
+
+/// \brief The opcodes left after decoding, which have a handler in the
+/// interpreter. Every other opcode is either rewritten by \c decode_method
+/// or unsupported.
+#define SKJVM_DECODED_OPCODES(X)                                               \
+  X(nop) X(aconst_null) X(sipush) X(lconst_0) X(fconst_0) X(dconst_0) X(ldc)   \
+  X(iload) X(lload) X(fload) X(dload) X(aload)                                 \
+  X(iaload) X(laload) X(faload) X(daload) X(aaload) X(baload) X(caload)        \
+  X(saload)                                                                    \
+  X(istore) X(lstore) X(fstore) X(dstore) X(astore)                            \
+  X(iastore) X(lastore) X(fastore) X(dastore) X(aastore) X(bastore)            \
+  X(castore) X(sastore)                                                        \
+  X(pop) X(pop2) X(dup) X(dup_x1) X(dup_x2) X(dup2) X(dup2_x1) X(dup2_x2)      \
+  X(swap)                                                                      \
+  X(iadd) X(ladd) X(fadd) X(dadd) X(isub) X(lsub) X(fsub) X(dsub)              \
+  X(imul) X(lmul) X(fmul) X(dmul) X(idiv) X(ldiv) X(fdiv) X(ddiv)              \
+  X(irem) X(lrem) X(frem) X(drem) X(ineg) X(lneg) X(fneg) X(dneg)              \
+  X(ishl) X(lshl) X(ishr) X(lshr) X(iushr) X(lushr)                            \
+  X(iand) X(land) X(ior) X(lor) X(ixor) X(lxor) X(iinc)                        \
+  X(i2l) X(i2f) X(i2d) X(l2i) X(l2f) X(l2d) X(f2i) X(f2l) X(f2d)               \
+  X(d2i) X(d2l) X(d2f) X(i2b) X(i2c) X(i2s)                                    \
+  X(lcmp) X(fcmpl) X(fcmpg) X(dcmpl) X(dcmpg)                                  \
+  X(ifeq) X(ifne) X(iflt) X(ifge) X(ifgt) X(ifle)                              \
+  X(if_icmpeq) X(if_icmpne) X(if_icmplt) X(if_icmpge) X(if_icmpgt)             \
+  X(if_icmple) X(if_acmpeq) X(if_acmpne) X(goto_)                              \
+  X(tableswitch) X(lookupswitch)                                               \
+  X(ireturn) X(lreturn) X(freturn) X(dreturn) X(areturn) X(return_)            \
+  X(getstatic) X(putstatic) X(getfield) X(putfield)                            \
+  X(invokevirtual) X(invokespecial) X(invokestatic) X(invokeinterface)         \
+  X(new_) X(newarray) X(anewarray) X(arraylength) X(athrow)                    \
+  X(checkcast) X(instanceof) X(monitorenter) X(monitorexit)                    \
+  X(multianewarray) X(ifnull) X(ifnonnull)
+
+namespace skjvm {
+  namespace {
+    constexpr unsigned handler_table_size = 256;
+
+    // Decoding.
+
+    auto float_bits(float value) -> int32_t {
+      int32_t bits = 0;
+      memcpy(&bits, &value, sizeof(bits));
+      return bits;
+    }
+
+    auto double_bits(double value) -> int64_t {
+      int64_t bits = 0;
+      memcpy(&bits, &value, sizeof(bits));
+      return bits;
+    }
+
+    auto read_s4(uint8_t const *bytes) -> int32_t {
+      return int32_t(read_u4(bytes));
+    }
+
+    /// The element type of \c newarray operand \p atype, \c void_ if
+    /// invalid.
+    auto array_type_of(uint8_t atype) -> BasicType {
+      switch (atype) {
+        case 4: return BasicType::boolean;
+        case 5: return BasicType::char_;
+        case 6: return BasicType::float_;
+        case 7: return BasicType::double_;
+        case 8: return BasicType::byte;
+        case 9: return BasicType::short_;
+        case 10: return BasicType::int_;
+        case 11: return BasicType::long_;
+        default: return BasicType::void_;
+      }
+    }
+
+    /// Whether execution never continues with the next instruction.
+    auto ends_flow(Opcode opcode) -> bool {
+      switch (opcode) {
+        case Opcode::goto_:
+        case Opcode::tableswitch:
+        case Opcode::lookupswitch:
+        case Opcode::ireturn:
+        case Opcode::lreturn:
+        case Opcode::freturn:
+        case Opcode::dreturn:
+        case Opcode::areturn:
+        case Opcode::return_:
+        case Opcode::athrow:
+          return true;
+        default:
+          return false;
+      }
+    }
+
+    /// \brief Translates the bytecode of one method into \c Instruction s.
+    class Decoder {
+      ClassFile const &class_file;
+      CodeView code;
+      Arena &arena;
+
+      /// Index of the instruction starting at each bytecode offset, or
+      /// \c UINT32_MAX inside an instruction.
+      uint32_t *index_of;
+      Instruction *instructions {nullptr};
+
+     public:
+      Decoder(ClassFile const &class_file, CodeView code, Arena &arena,
+              uint32_t *index_of) noexcept
+        : class_file(class_file), code(code), arena(arena),
+          index_of(index_of) {}
+
+      auto set_instructions(Instruction *decoded) -> void {
+        instructions = decoded;
+      }
+
+      /// The instruction at \p bci, or \c nullptr if no instruction
+      /// starts there.
+      [[nodiscard]]
+      auto at(int64_t bci) const -> Instruction const * {
+        if (bci < 0 or bci >= code.code_length or
+            index_of[bci] == UINT32_MAX) {
+          return nullptr;
+        }
+        return &instructions[index_of[bci]];
+      }
+
+      [[nodiscard]]
+      auto decode_switch(uint32_t bci, Instruction &instruction) -> bool;
+
+      [[nodiscard]]
+      auto decode(uint32_t bci, Instruction &instruction) -> bool;
+    };
+
+    auto Decoder::decode_switch(uint32_t bci, Instruction &instruction)
+        -> bool {
+      uint8_t const *operands = code.code + ((bci + 4) & ~uint32_t(3));
+      auto *table = arena.allocate_array<SwitchTable>(1);
+      table->default_target = at(int64_t(bci) + read_s4(operands));
+      if (instruction.opcode == Opcode::tableswitch) {
+        table->low = read_s4(operands + 4);
+        table->count = uint32_t(int64_t(read_s4(operands + 8)) -
+                                table->low + 1);
+        operands += 12;
+      } else {
+        table->count = read_u4(operands + 4);
+        auto *keys = arena.allocate_array<int32_t>(table->count);
+        for (uint32_t i = 0; i < table->count; ++i) {
+          keys[i] = read_s4(operands + 8 + size_t(i) * 8);
+          // Binary search needs sorted keys, which JVMS 4.10.1.9 requires.
+          if (i != 0 and keys[i] <= keys[i - 1]) { return false; }
+        }
+        table->keys = keys;
+        operands += 12;
+      }
+      auto **targets = arena.allocate_array<Instruction const *>(table->count);
+      size_t stride = instruction.opcode == Opcode::tableswitch ? 4 : 8;
+      for (uint32_t i = 0; i < table->count; ++i) {
+        targets[i] = at(int64_t(bci) + read_s4(operands + size_t(i) * stride));
+        if (targets[i] == nullptr) { return false; }
+      }
+      table->targets = targets;
+      instruction.table = table;
+      return table->default_target != nullptr;
+    }
+
+    auto Decoder::decode(uint32_t bci, Instruction &instruction) -> bool {
+      uint8_t const *bytes = code.code + bci;
+      auto opcode = Opcode(bytes[0]);
+      bool wide = opcode == Opcode::wide;
+      if (wide) {
+        opcode = Opcode(bytes[1]);
+        ++bytes;
+      }
+      instruction.opcode = opcode;
+
+      switch (opcode) {
+        case Opcode::iconst_m1:
+        case Opcode::iconst_0:
+        case Opcode::iconst_1:
+        case Opcode::iconst_2:
+        case Opcode::iconst_3:
+        case Opcode::iconst_4:
+        case Opcode::iconst_5:
+          instruction.opcode = Opcode::sipush;
+          instruction.value = int32_t(opcode) - int32_t(Opcode::iconst_0);
+          return true;
+        case Opcode::bipush:
+          instruction.opcode = Opcode::sipush;
+          instruction.value = int8_t(bytes[1]);
+          return true;
+        case Opcode::sipush:
+          instruction.value = int16_t(read_u2(bytes + 1));
+          return true;
+        case Opcode::lconst_0:
+        case Opcode::lconst_1:
+          instruction.opcode = Opcode::lconst_0;
+          instruction.wide = int32_t(opcode) - int32_t(Opcode::lconst_0);
+          return true;
+        case Opcode::fconst_0:
+        case Opcode::fconst_1:
+        case Opcode::fconst_2:
+          instruction.opcode = Opcode::fconst_0;
+          instruction.value = float_bits(
+            float(int32_t(opcode) - int32_t(Opcode::fconst_0)));
+          return true;
+        case Opcode::dconst_0:
+        case Opcode::dconst_1:
+          instruction.opcode = Opcode::dconst_0;
+          instruction.wide = double_bits(
+            double(int32_t(opcode) - int32_t(Opcode::dconst_0)));
+          return true;
+
+        case Opcode::ldc:
+        case Opcode::ldc_w: {
+          uint16_t index = opcode == Opcode::ldc ? read_u1(bytes + 1)
+                                                 : read_u2(bytes + 1);
+          instruction.opcode = Opcode::ldc;
+          instruction.index = index;
+          switch (class_file.tag(index)) {
+            case ConstantTag::integer:
+              instruction.opcode = Opcode::sipush;
+              instruction.value = class_file.integer_value(index);
+              return true;
+            case ConstantTag::float_:
+              instruction.opcode = Opcode::fconst_0;
+              instruction.value = float_bits(class_file.float_value(index));
+              return true;
+            case ConstantTag::none:
+            case ConstantTag::long_:
+            case ConstantTag::double_:
+              return false;
+            default:
+              // Strings, and constants the interpreter rejects when run.
+              return true;
+          }
+        }
+        case Opcode::ldc2_w: {
+          uint16_t index = read_u2(bytes + 1);
+          if (class_file.tag(index) == ConstantTag::long_) {
+            instruction.opcode = Opcode::lconst_0;
+            instruction.wide = class_file.long_value(index);
+            return true;
+          }
+          if (class_file.tag(index) == ConstantTag::double_) {
+            instruction.opcode = Opcode::dconst_0;
+            instruction.wide = double_bits(class_file.double_value(index));
+            return true;
+          }
+          return false;
+        }
+
+        case Opcode::iload:
+        case Opcode::lload:
+        case Opcode::fload:
+        case Opcode::dload:
+        case Opcode::aload:
+        case Opcode::istore:
+        case Opcode::lstore:
+        case Opcode::fstore:
+        case Opcode::dstore:
+        case Opcode::astore:
+          instruction.index = wide ? read_u2(bytes + 1) : read_u1(bytes + 1);
+          return instruction.index < code.max_locals;
+        case Opcode::iinc:
+          instruction.index = wide ? read_u2(bytes + 1) : read_u1(bytes + 1);
+          instruction.value = wide ? int16_t(read_u2(bytes + 3))
+                                   : int8_t(bytes[2]);
+          return instruction.index < code.max_locals;
+
+        case Opcode::ifeq:
+        case Opcode::ifne:
+        case Opcode::iflt:
+        case Opcode::ifge:
+        case Opcode::ifgt:
+        case Opcode::ifle:
+        case Opcode::if_icmpeq:
+        case Opcode::if_icmpne:
+        case Opcode::if_icmplt:
+        case Opcode::if_icmpge:
+        case Opcode::if_icmpgt:
+        case Opcode::if_icmple:
+        case Opcode::if_acmpeq:
+        case Opcode::if_acmpne:
+        case Opcode::goto_:
+        case Opcode::ifnull:
+        case Opcode::ifnonnull:
+          instruction.target = at(int64_t(bci) + int16_t(read_u2(bytes + 1)));
+          return instruction.target != nullptr;
+        case Opcode::goto_w:
+          instruction.opcode = Opcode::goto_;
+          instruction.target = at(int64_t(bci) + read_s4(bytes + 1));
+          return instruction.target != nullptr;
+        case Opcode::tableswitch:
+        case Opcode::lookupswitch:
+          return decode_switch(bci, instruction);
+
+        case Opcode::invokevirtual:
+          instruction.index = read_u2(bytes + 1);
+          instruction.cache = arena.allocate_array<InlineCache>(1);
+          return true;
+        case Opcode::getstatic:
+        case Opcode::putstatic:
+        case Opcode::getfield:
+        case Opcode::putfield:
+        case Opcode::invokespecial:
+        case Opcode::invokestatic:
+        case Opcode::invokedynamic:
+        case Opcode::new_:
+        case Opcode::anewarray:
+        case Opcode::checkcast:
+        case Opcode::instanceof:
+          instruction.index = read_u2(bytes + 1);
+          return true;
+        case Opcode::invokeinterface:
+          instruction.index = read_u2(bytes + 1);
+          instruction.count = bytes[3];
+          instruction.cache = arena.allocate_array<InlineCache>(1);
+          return true;
+        case Opcode::newarray:
+          instruction.count = uint8_t(array_type_of(bytes[1]));
+          return BasicType(instruction.count) != BasicType::void_;
+        case Opcode::multianewarray:
+          instruction.index = read_u2(bytes + 1);
+          instruction.count = bytes[3];
+          return instruction.count != 0;
+
+        // Subroutines are gone since Java 7 class files.
+        case Opcode::jsr:
+        case Opcode::jsr_w:
+        case Opcode::ret:
+          return false;
+
+        default:
+          break;
+      }
+
+      // The short forms of loads and stores, in groups of four.
+      auto const raw = uint8_t(opcode);
+      if (raw >= uint8_t(Opcode::iload_0) and raw <= uint8_t(Opcode::aload_3)) {
+        unsigned offset = raw - uint8_t(Opcode::iload_0);
+        instruction.opcode = Opcode(uint8_t(Opcode::iload) + offset / 4);
+        instruction.index = uint16_t(offset % 4);
+        return instruction.index < code.max_locals;
+      }
+      if (raw >= uint8_t(Opcode::istore_0) and
+          raw <= uint8_t(Opcode::astore_3)) {
+        unsigned offset = raw - uint8_t(Opcode::istore_0);
+        instruction.opcode = Opcode(uint8_t(Opcode::istore) + offset / 4);
+        instruction.index = uint16_t(offset % 4);
+        return instruction.index < code.max_locals;
+      }
+      return not wide;
+    }
+
+    // Execution.
+
+    auto slots_of(BasicType type) -> uint32_t {
+      switch (type) {
+        case BasicType::long_:
+        case BasicType::double_: return 2;
+        case BasicType::void_: return 0;
+        default: return 1;
+      }
+    }
+
+    auto load_value(uint8_t const *address, BasicType type) -> Value {
+      Value value {};
+      switch (type) {
+        case BasicType::boolean:
+        case BasicType::byte:
+          value.i = *reinterpret_cast<int8_t const *>(address);
+          break;
+        case BasicType::char_:
+          value.i = *reinterpret_cast<uint16_t const *>(address);
+          break;
+        case BasicType::short_:
+          value.i = *reinterpret_cast<int16_t const *>(address);
+          break;
+        case BasicType::int_:
+          value.i = *reinterpret_cast<int32_t const *>(address);
+          break;
+        case BasicType::float_:
+          value.f = *reinterpret_cast<float const *>(address);
+          break;
+        case BasicType::long_:
+          value.j = *reinterpret_cast<int64_t const *>(address);
+          break;
+        case BasicType::double_:
+          value.d = *reinterpret_cast<double const *>(address);
+          break;
+        case BasicType::reference:
+          value.l = *reinterpret_cast<Object *const *>(address);
+          break;
+        case BasicType::void_:
+          break;
+      }
+      return value;
+    }
+
+    auto store_value(uint8_t *address, BasicType type, Value value) -> void {
+      switch (type) {
+        case BasicType::boolean:
+          *reinterpret_cast<int8_t *>(address) = int8_t(value.i & 1);
+          break;
+        case BasicType::byte:
+          *reinterpret_cast<int8_t *>(address) = int8_t(value.i);
+          break;
+        case BasicType::char_:
+          *reinterpret_cast<uint16_t *>(address) = uint16_t(value.i);
+          break;
+        case BasicType::short_:
+          *reinterpret_cast<int16_t *>(address) = int16_t(value.i);
+          break;
+        case BasicType::int_:
+          *reinterpret_cast<int32_t *>(address) = value.i;
+          break;
+        case BasicType::float_:
+          *reinterpret_cast<float *>(address) = value.f;
+          break;
+        case BasicType::long_:
+          *reinterpret_cast<int64_t *>(address) = value.j;
+          break;
+        case BasicType::double_:
+          *reinterpret_cast<double *>(address) = value.d;
+          break;
+        case BasicType::reference:
+          *reinterpret_cast<Object **>(address) = value.l;
+          break;
+        case BasicType::void_:
+          break;
+      }
+    }
+
+    /// Java's conversion of a floating point \p value to an integer type:
+    /// NaN is 0, and out of range values saturate.
+    template <typename Integer, typename Floating>
+    auto saturate(Floating value, Integer min, Integer max) -> Integer {
+      if (value != value) { return 0; }
+      if (value <= Floating(min)) { return min; }
+      if (value >= Floating(max)) { return max; }
+      return Integer(value);
+    }
+
+    template <typename Floating>
+    auto compare(Floating a, Floating b, int32_t unordered) -> int32_t {
+      if (a > b) { return 1; }
+      if (a < b) { return -1; }
+      if (a == b) { return 0; }
+      return unordered;
+    }
+
+    /// The field of a \c getfield or \c putfield, or with \p is_static of a
+    /// \c getstatic or \c putstatic, whose class is then initialized.
+    auto resolve_field(Thread &thread, Klass &klass, uint16_t index,
+                       bool is_static) -> Field * {
+      VM &vm = thread.get_vm();
+      LinkError error = LinkError::none;
+      Field *field = vm.get_registry().resolve_field(klass, index, error);
+      if (field == nullptr) {
+        vm.throw_link_error(thread, error,
+                            klass.class_file->member_ref(index).name);
+        return nullptr;
+      }
+      if (field->is_static() != is_static) {
+        vm.throw_link_error(thread, LinkError::incompatible_class_change,
+                            field->name);
+        return nullptr;
+      }
+      if (is_static and field->holder->state != ClassState::initialized and
+          not vm.initialize(thread, *field->holder)) {
+        return nullptr;
+      }
+      return field;
+    }
+
+    auto new_multi_array(Thread &thread, Klass &array_class,
+                         Value const *counts, uint8_t dimensions)
+        -> ArrayObject * {
+      VM &vm = thread.get_vm();
+      ArrayObject *outer = vm.new_array(thread, array_class, counts[0].i);
+      if (outer == nullptr or dimensions == 1) { return outer; }
+      Handle<ArrayObject> array(thread, outer);
+      for (int32_t i = 0; i < array->length; ++i) {
+        ArrayObject *element = new_multi_array(thread, *array_class.component,
+                                               counts + 1,
+                                               uint8_t(dimensions - 1));
+        if (element == nullptr) { return nullptr; }
+        vm.store_reference(&array->elements<Object *>()[i], &element->header);
+      }
+      return array.get();
+    }
+
+    auto handler_table() -> void const *const *;
+
+    /// Rewrite \p ip into the quick instruction \p opcode, after \p write
+    /// stored its operands in it.
+    template <typename Write>
+    auto quicken(Instruction const *ip, Opcode opcode, Write write) -> void {
+      // Decoded code belongs to its method; the interpreter only reads it,
+      // but for this.
+      auto *instruction = const_cast<Instruction *>(ip);
+      write(*instruction);
+      if (void const *const *handlers = handler_table()) {
+        __atomic_store_n(&instruction->handler, handlers[uint8_t(opcode)],
+                         __ATOMIC_RELEASE);
+      }
+      __atomic_store_n(&instruction->opcode, opcode, __ATOMIC_RELEASE);
+    }
+
+    /// The quick form of a field access of \p type, \p word being the
+    /// \c word form: the forms of \c getfield and of \c putfield follow
+    /// each other in the order \c word, \c long, \c reference, \c narrow.
+    auto field_form(Opcode word, BasicType type) -> Opcode {
+      switch (type) {
+        case BasicType::int_:
+        case BasicType::float_:
+          return word;
+        case BasicType::long_:
+        case BasicType::double_:
+          return Opcode(uint8_t(word) + 1);
+        case BasicType::reference:
+          return Opcode(uint8_t(word) + 2);
+        default:
+          return Opcode(uint8_t(word) + 3);
+      }
+    }
+
+    static_assert(uint8_t(quick::getfield_narrow) ==
+                  uint8_t(quick::getfield_word) + 3);
+    static_assert(uint8_t(quick::putfield_narrow) ==
+                  uint8_t(quick::putfield_word) + 3);
+
+    /// Record in \p cache that \p target implements its method for
+    /// \p klass, after an inline cache miss. The first class seen fills the
+    /// cache; a second one makes the site megamorphic for good, so that
+    /// \c target never changes once published.
+    auto update_cache(Thread &thread, InlineCache &cache, Klass *klass,
+                      Method *target) -> void {
+      ++thread.inline_cache_misses;
+      Klass *cached = __atomic_load_n(&cache.klass, __ATOMIC_ACQUIRE);
+      if (cached == nullptr) {
+        auto *filling = reinterpret_cast<Klass *>(InlineCache::filling);
+        if (__atomic_compare_exchange_n(&cache.klass, &cached, filling, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+          cache.target = target;
+          __atomic_store_n(&cache.klass, klass, __ATOMIC_RELEASE);
+          return;
+        }
+      }
+      if (uintptr_t(cached) == InlineCache::filling or
+          uintptr_t(cached) == InlineCache::megamorphic or cached == klass) {
+        return;
+      }
+      auto *megamorphic = reinterpret_cast<Klass *>(InlineCache::megamorphic);
+      if (__atomic_compare_exchange_n(&cache.klass, &cached, megamorphic,
+                                      false, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED)) {
+        thread.get_vm().add_inline_cache_stats(0, 0, 1);
+      }
+    }
+
+    /// The handler of the exception being thrown at \p ip in \p frame.
+    auto find_handler(Thread &thread, Frame const &frame,
+                      Instruction const *ip) -> Instruction const * {
+      VM &vm = thread.get_vm();
+      DecodedMethod const &decoded = *frame.method->decoded;
+      Klass *thrown = thread.exception->get_klass();
+      for (uint16_t i = 0; i < decoded.handler_count; ++i) {
+        DecodedHandler const &handler = decoded.handlers[i];
+        if (ip < handler.start or ip >= handler.end) { continue; }
+        if (handler.catch_type == 0) { return handler.target; }
+        LinkError error = LinkError::none;
+        Klass *caught = vm.get_registry().resolve_class(
+          *frame.method->holder, handler.catch_type, error);
+        if (caught != nullptr and vm.is_assignable(thrown, caught)) {
+          return handler.target;
+        }
+      }
+      return nullptr;
+    }
+
+    /// \brief The interpreter loop, instantiated once per dispatch mode.
+    ///
+    /// \details Every handler is labeled \c op_<name>. With \p threaded,
+    /// each handler ends by jumping to the handler of the next instruction,
+    /// stored in it; otherwise it goes back to a \c switch on the opcode.
+    /// The threaded instantiation also exports the addresses of its handlers
+    /// for \c decode_method when called with \p handlers.
+    template <bool threaded, bool counting>
+    auto execute(Thread *thread, Frame *frame, void const **handlers)
+        -> Value {
+#if SKJVM_THREADED_DISPATCH
+      if constexpr (threaded) {
+        if (handlers != nullptr) {
+          // Label addresses are copied from a static table: stored
+          // directly, -Wdangling-pointer takes them for addresses of locals
+          // escaping through \p handlers.
+          static void const *const labels[] {
+#define SKJVM_HANDLER_LABEL(name) &&op_##name,
+            SKJVM_DECODED_OPCODES(SKJVM_HANDLER_LABEL)
+#undef SKJVM_HANDLER_LABEL
+#define SKJVM_QUICK_HANDLER_LABEL(name, code) &&op_quick_##name,
+            SKJVM_QUICK_OPCODES(SKJVM_QUICK_HANDLER_LABEL)
+#undef SKJVM_QUICK_HANDLER_LABEL
+            &&op_unsupported,
+          };
+          static constexpr uint8_t codes[] {
+#define SKJVM_HANDLER_CODE(name) uint8_t(Opcode::name),
+            SKJVM_DECODED_OPCODES(SKJVM_HANDLER_CODE)
+#undef SKJVM_HANDLER_CODE
+#define SKJVM_QUICK_HANDLER_CODE(name, code) uint8_t(code),
+            SKJVM_QUICK_OPCODES(SKJVM_QUICK_HANDLER_CODE)
+#undef SKJVM_QUICK_HANDLER_CODE
+          };
+          constexpr size_t label_count = sizeof(labels) / sizeof(labels[0]);
+          static_assert(sizeof(codes) + 1 == label_count);
+          for (unsigned i = 0; i < handler_table_size; ++i) {
+            handlers[i] = labels[label_count - 1];
+          }
+          for (size_t i = 0; i < sizeof(codes); ++i) {
+            handlers[codes[i]] = labels[i];
+          }
+          return {};
+        }
+      }
+#define SKJVM_DISPATCH_THREADED() goto *ip->handler
+#else
+#define SKJVM_DISPATCH_THREADED() goto dispatch
+#endif
+      (void)handlers;
+
+      VM &vm = thread->get_vm();
+      Klass &klass = *frame->method->holder;
+      Value *const locals = frame->locals;
+      Value *sp = frame->sp;
+      Instruction const *ip = frame->ip;
+      Compiler &compiler = vm.get_compiler();
+      // Counting measures the interpreter alone.
+      bool const compiling = not counting and compiler.is_enabled();
+      // The branch that went to `backedge`.
+      Instruction const *branch = nullptr;
+
+#define NEXT()                                                                 \
+  do {                                                                         \
+    if constexpr (counting) { ++thread->executed; }                            \
+    if constexpr (threaded) {                                                  \
+      SKJVM_DISPATCH_THREADED();                                               \
+    } else {                                                                   \
+      goto dispatch;                                                           \
+    }                                                                          \
+  } while (false)
+#define JUMP(to)                                                               \
+  do {                                                                         \
+    ip = (to);                                                                 \
+    NEXT();                                                                    \
+  } while (false)
+#define ADVANCE() JUMP(ip + 1)
+  // A taken branch. Going back, it may continue in compiled code.
+#define BRANCH(to)                                                             \
+  do {                                                                         \
+    Instruction const *target = (to);                                          \
+    if (compiling and target <= ip and ip->count != Instruction::no_osr) {     \
+      branch = ip;                                                             \
+      ip = target;                                                             \
+      goto backedge;                                                           \
+    }                                                                          \
+    JUMP(target);                                                              \
+  } while (false)
+  // Run the instruction again, now rewritten into its quick form, without
+  // counting it twice.
+#define REDISPATCH()                                                           \
+  do {                                                                         \
+    if constexpr (counting) { --thread->executed; }                            \
+    NEXT();                                                                    \
+  } while (false)
+  // Make the frame inspectable before anything that may call, allocate or
+  // throw.
+#define SAVE()                                                                 \
+  do {                                                                         \
+    frame->ip = ip;                                                            \
+    frame->sp = sp;                                                            \
+  } while (false)
+#define THROW(class_name, message)                                             \
+  do {                                                                         \
+    SAVE();                                                                    \
+    vm.throw_new(*thread, class_name, message);                                \
+    goto exception;                                                            \
+  } while (false)
+#define NULL_CHECK(object)                                                     \
+  do {                                                                         \
+    if ((object) == nullptr) {                                                 \
+      THROW("java/lang/NullPointerException", nullptr);                        \
+    }                                                                          \
+  } while (false)
+#define ARRAY_CHECK(array, index)                                              \
+  do {                                                                         \
+    NULL_CHECK(array);                                                         \
+    if (uint32_t(index) >= uint32_t((array)->length)) {                        \
+      SAVE();                                                                  \
+      vm.throw_index_out_of_bounds(*thread, (index), (array)->length);          \
+      goto exception;                                                          \
+    }                                                                          \
+  } while (false)
+#define ARRAY_LOAD(type, member, slots)                                        \
+  {                                                                            \
+    int32_t index = sp[-1].i;                                                  \
+    auto *array = reinterpret_cast<ArrayObject *>(sp[-2].l);                   \
+    ARRAY_CHECK(array, index);                                                 \
+    sp -= 2;                                                                   \
+    sp->member = array->elements<type>()[index];                               \
+    sp += (slots);                                                             \
+    ADVANCE();                                                                 \
+  }
+#define ARRAY_STORE(type, member, slots)                                       \
+  {                                                                            \
+    int32_t index = sp[-(slots) - 1].i;                                        \
+    auto *array = reinterpret_cast<ArrayObject *>(sp[-(slots) - 2].l);         \
+    ARRAY_CHECK(array, index);                                                 \
+    array->elements<type>()[index] = type(sp[-(slots)].member);                \
+    sp -= (slots) + 2;                                                         \
+    ADVANCE();                                                                 \
+  }
+#define INT_BINARY(expression)                                                 \
+  {                                                                            \
+    int32_t b = sp[-1].i;                                                      \
+    int32_t a = sp[-2].i;                                                      \
+    sp[-2].i = (expression);                                                   \
+    --sp;                                                                      \
+    ADVANCE();                                                                 \
+  }
+#define LONG_BINARY(expression)                                                \
+  {                                                                            \
+    int64_t b = sp[-2].j;                                                      \
+    int64_t a = sp[-4].j;                                                      \
+    sp[-4].j = (expression);                                                   \
+    sp -= 2;                                                                   \
+    ADVANCE();                                                                 \
+  }
+#define LONG_SHIFT(expression)                                                 \
+  {                                                                            \
+    int32_t b = sp[-1].i & 0x3f;                                               \
+    int64_t a = sp[-3].j;                                                      \
+    sp[-3].j = (expression);                                                   \
+    --sp;                                                                      \
+    ADVANCE();                                                                 \
+  }
+#define FLOAT_BINARY(expression)                                               \
+  {                                                                            \
+    float b = sp[-1].f;                                                        \
+    float a = sp[-2].f;                                                        \
+    sp[-2].f = (expression);                                                   \
+    --sp;                                                                      \
+    ADVANCE();                                                                 \
+  }
+#define DOUBLE_BINARY(expression)                                              \
+  {                                                                            \
+    double b = sp[-2].d;                                                       \
+    double a = sp[-4].d;                                                       \
+    sp[-4].d = (expression);                                                   \
+    sp -= 2;                                                                   \
+    ADVANCE();                                                                 \
+  }
+#define IF(condition)                                                          \
+  {                                                                            \
+    int32_t a = (--sp)->i;                                                     \
+    if (condition) { BRANCH(ip->target); }                                     \
+    ADVANCE();                                                                 \
+  }
+#define IF_COMPARE(member, condition)                                          \
+  {                                                                            \
+    auto b = sp[-1].member;                                                    \
+    auto a = sp[-2].member;                                                    \
+    sp -= 2;                                                                   \
+    if (condition) { BRANCH(ip->target); }                                     \
+    ADVANCE();                                                                 \
+  }
+  // Call `target` with the arguments at `arguments` and push its result.
+#define INVOKE(target, arguments)                                              \
+  do {                                                                         \
+    SAVE();                                                                    \
+    Value result = vm.invoke(*thread, *(target), (arguments));                 \
+    sp = (arguments);                                                          \
+    if (thread->exception != nullptr) { goto exception; }                      \
+    if ((target)->return_type != BasicType::void_) {                           \
+      *sp = result;                                                            \
+      sp += slots_of((target)->return_type);                                   \
+    }                                                                          \
+    ADVANCE();                                                                 \
+  } while (false)
+
+      // Compiled code gave the method back with an exception to unwind.
+      if (thread->exception != nullptr) { goto exception; }
+      NEXT();
+
+    dispatch:
+#if SKJVM_THREADED_DISPATCH
+      __attribute__((unused));
+#endif
+      // On the byte: the quick opcodes are not enumerators of \c Opcode.
+      switch (uint8_t(ip->opcode)) {
+#define SKJVM_CASE(name)                                                       \
+  case uint8_t(Opcode::name):                                                  \
+    goto op_##name;
+        SKJVM_DECODED_OPCODES(SKJVM_CASE)
+#undef SKJVM_CASE
+#define SKJVM_QUICK_CASE(name, code)                                           \
+  case code:                                                                   \
+    goto op_quick_##name;
+        SKJVM_QUICK_OPCODES(SKJVM_QUICK_CASE)
+#undef SKJVM_QUICK_CASE
+        default:
+          goto op_unsupported;
+      }
+
+      // Constants.
+    op_nop:
+      ADVANCE();
+    op_aconst_null:
+      sp->l = nullptr;
+      ++sp;
+      ADVANCE();
+    op_sipush:
+    op_fconst_0:
+      // `value` holds the bits of the int or float.
+      sp->i = ip->value;
+      ++sp;
+      ADVANCE();
+    op_lconst_0:
+    op_dconst_0:
+      sp->j = ip->wide;
+      sp += 2;
+      ADVANCE();
+    op_ldc: {
+      SAVE();
+      Object *constant = vm.load_constant(*thread, klass, ip->index);
+      if (constant == nullptr) { goto exception; }
+      sp->l = constant;
+      ++sp;
+      ADVANCE();
+    }
+
+      // Locals. Slots are copied whole, whatever they hold.
+    op_iload:
+    op_fload:
+    op_aload:
+      *sp = locals[ip->index];
+      ++sp;
+      ADVANCE();
+    op_lload:
+    op_dload:
+      *sp = locals[ip->index];
+      sp += 2;
+      ADVANCE();
+    op_istore:
+    op_fstore:
+    op_astore:
+      locals[ip->index] = *--sp;
+      ADVANCE();
+    op_lstore:
+    op_dstore:
+      sp -= 2;
+      locals[ip->index] = *sp;
+      ADVANCE();
+    op_iinc:
+      locals[ip->index].i = int32_t(uint32_t(locals[ip->index].i) +
+                                    uint32_t(ip->value));
+      ADVANCE();
+
+      // Arrays.
+    op_iaload: ARRAY_LOAD(int32_t, i, 1)
+    op_laload: ARRAY_LOAD(int64_t, j, 2)
+    op_faload: ARRAY_LOAD(float, f, 1)
+    op_daload: ARRAY_LOAD(double, d, 2)
+    op_aaload: ARRAY_LOAD(Object *, l, 1)
+    op_baload: ARRAY_LOAD(int8_t, i, 1)
+    op_caload: ARRAY_LOAD(uint16_t, i, 1)
+    op_saload: ARRAY_LOAD(int16_t, i, 1)
+    op_iastore: ARRAY_STORE(int32_t, i, 1)
+    op_lastore: ARRAY_STORE(int64_t, j, 2)
+    op_fastore: ARRAY_STORE(float, f, 1)
+    op_dastore: ARRAY_STORE(double, d, 2)
+    op_castore: ARRAY_STORE(uint16_t, i, 1)
+    op_sastore: ARRAY_STORE(int16_t, i, 1)
+    op_bastore: {
+      int32_t index = sp[-2].i;
+      auto *array = reinterpret_cast<ArrayObject *>(sp[-3].l);
+      ARRAY_CHECK(array, index);
+      // `bastore` also stores into `boolean[]`, which only holds 0 or 1.
+      int32_t value = sp[-1].i;
+      if (array->header.get_klass()->element_type == BasicType::boolean) {
+        value &= 1;
+      }
+      array->elements<int8_t>()[index] = int8_t(value);
+      sp -= 3;
+      ADVANCE();
+    }
+    op_aastore: {
+      int32_t index = sp[-2].i;
+      auto *array = reinterpret_cast<ArrayObject *>(sp[-3].l);
+      ARRAY_CHECK(array, index);
+      Object *value = sp[-1].l;
+      if (value != nullptr and
+          not vm.is_assignable(value->get_klass(),
+                               array->header.get_klass()->component)) {
+        SAVE();
+        vm.throw_with_class(*thread, "java/lang/ArrayStoreException",
+                         *value->get_klass(), "");
+        goto exception;
+      }
+      vm.store_reference(&array->elements<Object *>()[index], value);
+      sp -= 3;
+      ADVANCE();
+    }
+    op_arraylength: {
+      auto *array = reinterpret_cast<ArrayObject *>(sp[-1].l);
+      NULL_CHECK(array);
+      sp[-1].i = array->length;
+      ADVANCE();
+    }
+
+      // Operand stack. Long and double values take two slots, which move
+      // together like any two values.
+    op_pop:
+      --sp;
+      ADVANCE();
+    op_pop2:
+      sp -= 2;
+      ADVANCE();
+    op_dup:
+      sp[0] = sp[-1];
+      ++sp;
+      ADVANCE();
+    op_dup_x1: {
+      Value first = sp[-1];
+      sp[-1] = sp[-2];
+      sp[-2] = first;
+      sp[0] = first;
+      ++sp;
+      ADVANCE();
+    }
+    op_dup_x2: {
+      Value first = sp[-1];
+      sp[-1] = sp[-2];
+      sp[-2] = sp[-3];
+      sp[-3] = first;
+      sp[0] = first;
+      ++sp;
+      ADVANCE();
+    }
+    op_dup2:
+      sp[0] = sp[-2];
+      sp[1] = sp[-1];
+      sp += 2;
+      ADVANCE();
+    op_dup2_x1: {
+      Value first = sp[-1];
+      Value second = sp[-2];
+      sp[1] = first;
+      sp[0] = second;
+      sp[-1] = sp[-3];
+      sp[-2] = first;
+      sp[-3] = second;
+      sp += 2;
+      ADVANCE();
+    }
+    op_dup2_x2: {
+      Value first = sp[-1];
+      Value second = sp[-2];
+      sp[1] = first;
+      sp[0] = second;
+      sp[-1] = sp[-3];
+      sp[-2] = sp[-4];
+      sp[-3] = first;
+      sp[-4] = second;
+      sp += 2;
+      ADVANCE();
+    }
+    op_swap: {
+      Value first = sp[-1];
+      sp[-1] = sp[-2];
+      sp[-2] = first;
+      ADVANCE();
+    }
+
+      // Arithmetic, wrapping around on overflow.
+    op_iadd: INT_BINARY(int32_t(uint32_t(a) + uint32_t(b)))
+    op_isub: INT_BINARY(int32_t(uint32_t(a) - uint32_t(b)))
+    op_imul: INT_BINARY(int32_t(uint32_t(a) * uint32_t(b)))
+    op_idiv:
+      if (sp[-1].i == 0) { THROW("java/lang/ArithmeticException", "/ by zero"); }
+      INT_BINARY(b == -1 ? int32_t(0u - uint32_t(a)) : a / b)
+    op_irem:
+      if (sp[-1].i == 0) { THROW("java/lang/ArithmeticException", "/ by zero"); }
+      INT_BINARY(b == -1 ? 0 : a % b)
+    op_iand: INT_BINARY(a & b)
+    op_ior: INT_BINARY(a | b)
+    op_ixor: INT_BINARY(a ^ b)
+    op_ishl: INT_BINARY(int32_t(uint32_t(a) << (b & 0x1f)))
+    op_ishr: INT_BINARY(a >> (b & 0x1f))
+    op_iushr: INT_BINARY(int32_t(uint32_t(a) >> (b & 0x1f)))
+    op_ineg:
+      sp[-1].i = int32_t(0u - uint32_t(sp[-1].i));
+      ADVANCE();
+    op_ladd: LONG_BINARY(int64_t(uint64_t(a) + uint64_t(b)))
+    op_lsub: LONG_BINARY(int64_t(uint64_t(a) - uint64_t(b)))
+    op_lmul: LONG_BINARY(int64_t(uint64_t(a) * uint64_t(b)))
+    op_ldiv:
+      if (sp[-2].j == 0) { THROW("java/lang/ArithmeticException", "/ by zero"); }
+      LONG_BINARY(b == -1 ? int64_t(0u - uint64_t(a)) : a / b)
+    op_lrem:
+      if (sp[-2].j == 0) { THROW("java/lang/ArithmeticException", "/ by zero"); }
+      LONG_BINARY(b == -1 ? 0 : a % b)
+    op_land: LONG_BINARY(a & b)
+    op_lor: LONG_BINARY(a | b)
+    op_lxor: LONG_BINARY(a ^ b)
+    op_lshl: LONG_SHIFT(int64_t(uint64_t(a) << b))
+    op_lshr: LONG_SHIFT(a >> b)
+    op_lushr: LONG_SHIFT(int64_t(uint64_t(a) >> b))
+    op_lneg:
+      sp[-2].j = int64_t(0u - uint64_t(sp[-2].j));
+      ADVANCE();
+    op_fadd: FLOAT_BINARY(a + b)
+    op_fsub: FLOAT_BINARY(a - b)
+    op_fmul: FLOAT_BINARY(a * b)
+    op_fdiv: FLOAT_BINARY(a / b)
+    op_frem: FLOAT_BINARY(fmodf(a, b))
+    op_fneg:
+      sp[-1].f = -sp[-1].f;
+      ADVANCE();
+    op_dadd: DOUBLE_BINARY(a + b)
+    op_dsub: DOUBLE_BINARY(a - b)
+    op_dmul: DOUBLE_BINARY(a * b)
+    op_ddiv: DOUBLE_BINARY(a / b)
+    op_drem: DOUBLE_BINARY(fmod(a, b))
+    op_dneg:
+      sp[-2].d = -sp[-2].d;
+      ADVANCE();
+
+      // Conversions.
+    op_i2l:
+      sp[-1].j = sp[-1].i;
+      ++sp;
+      ADVANCE();
+    op_i2f:
+      sp[-1].f = float(sp[-1].i);
+      ADVANCE();
+    op_i2d:
+      sp[-1].d = double(sp[-1].i);
+      ++sp;
+      ADVANCE();
+    op_l2i:
+      sp[-2].i = int32_t(sp[-2].j);
+      --sp;
+      ADVANCE();
+    op_l2f:
+      sp[-2].f = float(sp[-2].j);
+      --sp;
+      ADVANCE();
+    op_l2d:
+      sp[-2].d = double(sp[-2].j);
+      ADVANCE();
+    op_f2i:
+      sp[-1].i = saturate<int32_t>(sp[-1].f, INT32_MIN, INT32_MAX);
+      ADVANCE();
+    op_f2l:
+      sp[-1].j = saturate<int64_t>(sp[-1].f, INT64_MIN, INT64_MAX);
+      ++sp;
+      ADVANCE();
+    op_f2d:
+      sp[-1].d = double(sp[-1].f);
+      ++sp;
+      ADVANCE();
+    op_d2i:
+      sp[-2].i = saturate<int32_t>(sp[-2].d, INT32_MIN, INT32_MAX);
+      --sp;
+      ADVANCE();
+    op_d2l:
+      sp[-2].j = saturate<int64_t>(sp[-2].d, INT64_MIN, INT64_MAX);
+      ADVANCE();
+    op_d2f:
+      sp[-2].f = float(sp[-2].d);
+      --sp;
+      ADVANCE();
+    op_i2b:
+      sp[-1].i = int8_t(sp[-1].i);
+      ADVANCE();
+    op_i2c:
+      sp[-1].i = uint16_t(sp[-1].i);
+      ADVANCE();
+    op_i2s:
+      sp[-1].i = int16_t(sp[-1].i);
+      ADVANCE();
+
+      // Comparisons and branches.
+    op_lcmp: {
+      int64_t b = sp[-2].j;
+      int64_t a = sp[-4].j;
+      sp[-4].i = (a > b) - (a < b);
+      sp -= 3;
+      ADVANCE();
+    }
+    op_fcmpl:
+      sp[-2].i = compare(sp[-2].f, sp[-1].f, -1);
+      --sp;
+      ADVANCE();
+    op_fcmpg:
+      sp[-2].i = compare(sp[-2].f, sp[-1].f, 1);
+      --sp;
+      ADVANCE();
+    op_dcmpl:
+      sp[-4].i = compare(sp[-4].d, sp[-2].d, -1);
+      sp -= 3;
+      ADVANCE();
+    op_dcmpg:
+      sp[-4].i = compare(sp[-4].d, sp[-2].d, 1);
+      sp -= 3;
+      ADVANCE();
+    op_ifeq: IF(a == 0)
+    op_ifne: IF(a != 0)
+    op_iflt: IF(a < 0)
+    op_ifge: IF(a >= 0)
+    op_ifgt: IF(a > 0)
+    op_ifle: IF(a <= 0)
+    op_if_icmpeq: IF_COMPARE(i, a == b)
+    op_if_icmpne: IF_COMPARE(i, a != b)
+    op_if_icmplt: IF_COMPARE(i, a < b)
+    op_if_icmpge: IF_COMPARE(i, a >= b)
+    op_if_icmpgt: IF_COMPARE(i, a > b)
+    op_if_icmple: IF_COMPARE(i, a <= b)
+    op_if_acmpeq: IF_COMPARE(l, a == b)
+    op_if_acmpne: IF_COMPARE(l, a != b)
+    op_ifnull: {
+      Object *a = (--sp)->l;
+      if (a == nullptr) { BRANCH(ip->target); }
+      ADVANCE();
+    }
+    op_ifnonnull: {
+      Object *a = (--sp)->l;
+      if (a != nullptr) { BRANCH(ip->target); }
+      ADVANCE();
+    }
+    op_goto_:
+      BRANCH(ip->target);
+    op_tableswitch: {
+      SwitchTable const &table = *ip->table;
+      uint32_t offset = uint32_t((--sp)->i) - uint32_t(table.low);
+      BRANCH(offset < table.count ? table.targets[offset]
+                                  : table.default_target);
+    }
+    op_lookupswitch: {
+      SwitchTable const &table = *ip->table;
+      int32_t key = (--sp)->i;
+      uint32_t low = 0;
+      uint32_t high = table.count;
+      while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (table.keys[middle] < key) {
+          low = middle + 1;
+        } else {
+          high = middle;
+        }
+      }
+      BRANCH(low < table.count and table.keys[low] == key
+               ? table.targets[low]
+               : table.default_target);
+    }
+
+      // Returns. The interpreter returns to its caller, which pushes the
+      // result on its own stack.
+    op_ireturn:
+    op_freturn:
+    op_areturn:
+      return sp[-1];
+    op_lreturn:
+    op_dreturn:
+      return sp[-2];
+    op_return_:
+      return {};
+
+      // Fields.
+    // Static fields are quickened once their class is initialized, not
+    // while its initializer runs in this thread.
+    op_getstatic: {
+      SAVE();
+      Field *field = resolve_field(*thread, klass, ip->index, true);
+      if (field == nullptr) { goto exception; }
+      uint8_t *address = field->holder->static_storage + field->offset;
+      if (field->holder->state == ClassState::initialized) {
+        quicken(ip, quick::getstatic, [&](Instruction &instruction) {
+          instruction.address = address;
+          instruction.count = uint8_t(field->type);
+        });
+        REDISPATCH();
+      }
+      *sp = load_value(address, field->type);
+      sp += slots_of(field->type);
+      ADVANCE();
+    }
+    op_putstatic: {
+      SAVE();
+      Field *field = resolve_field(*thread, klass, ip->index, true);
+      if (field == nullptr) { goto exception; }
+      uint8_t *address = field->holder->static_storage + field->offset;
+      if (field->holder->state == ClassState::initialized) {
+        quicken(ip, quick::putstatic, [&](Instruction &instruction) {
+          instruction.address = address;
+          instruction.count = uint8_t(field->type);
+        });
+        REDISPATCH();
+      }
+      sp -= slots_of(field->type);
+      store_value(address, field->type, *sp);
+      ADVANCE();
+    }
+    // Another thread may quicken the same instruction meanwhile, so the
+    // handlers below do not look at its opcode.
+#define QUICKEN_FIELD(word)                                                    \
+  {                                                                            \
+    SAVE();                                                                    \
+    Field *field = resolve_field(*thread, klass, ip->index, false);            \
+    if (field == nullptr) { goto exception; }                                  \
+    quicken(ip, field_form((word), field->type),                               \
+            [&](Instruction &instruction) {                                    \
+              instruction.value = int32_t(field->offset);                      \
+              instruction.count = uint8_t(field->type);                        \
+            });                                                                \
+    REDISPATCH();                                                              \
+  }
+    op_getfield:
+      QUICKEN_FIELD(quick::getfield_word);
+    op_putfield:
+      QUICKEN_FIELD(quick::putfield_word);
+#undef QUICKEN_FIELD
+    op_quick_getstatic: {
+      auto type = BasicType(ip->count);
+      *sp = load_value(ip->address, type);
+      sp += slots_of(type);
+      ADVANCE();
+    }
+    op_quick_putstatic: {
+      auto type = BasicType(ip->count);
+      sp -= slots_of(type);
+      store_value(ip->address, type, *sp);
+      ADVANCE();
+    }
+    op_quick_getfield_word: {
+      Object *object = sp[-1].l;
+      NULL_CHECK(object);
+      sp[-1].i = object->at<int32_t>(uint32_t(ip->value));
+      ADVANCE();
+    }
+    op_quick_getfield_long: {
+      Object *object = sp[-1].l;
+      NULL_CHECK(object);
+      sp[-1].j = object->at<int64_t>(uint32_t(ip->value));
+      ++sp;
+      ADVANCE();
+    }
+    op_quick_getfield_reference: {
+      Object *object = sp[-1].l;
+      NULL_CHECK(object);
+      sp[-1].l = object->at<Object *>(uint32_t(ip->value));
+      ADVANCE();
+    }
+    op_quick_getfield_narrow: {
+      Object *object = sp[-1].l;
+      NULL_CHECK(object);
+      sp[-1] = load_value(&object->at<uint8_t>(uint32_t(ip->value)),
+                          BasicType(ip->count));
+      ADVANCE();
+    }
+    op_quick_putfield_word: {
+      Object *object = sp[-2].l;
+      NULL_CHECK(object);
+      object->at<int32_t>(uint32_t(ip->value)) = sp[-1].i;
+      sp -= 2;
+      ADVANCE();
+    }
+    op_quick_putfield_long: {
+      Object *object = sp[-3].l;
+      NULL_CHECK(object);
+      object->at<int64_t>(uint32_t(ip->value)) = sp[-2].j;
+      sp -= 3;
+      ADVANCE();
+    }
+    op_quick_putfield_reference: {
+      Object *object = sp[-2].l;
+      NULL_CHECK(object);
+      vm.store_reference(&object->at<Object *>(uint32_t(ip->value)),
+                         sp[-1].l);
+      sp -= 2;
+      ADVANCE();
+    }
+    op_quick_putfield_narrow: {
+      Object *object = sp[-2].l;
+      NULL_CHECK(object);
+      store_value(&object->at<uint8_t>(uint32_t(ip->value)),
+                  BasicType(ip->count), sp[-1]);
+      sp -= 2;
+      ADVANCE();
+    }
+
+      // Calls.
+#define QUICKEN_CALL(opcode)                                                   \
+  {                                                                            \
+    SAVE();                                                                    \
+    Method *method = vm.resolve_method(*thread, klass, ip->index);                \
+    if (method == nullptr) { goto exception; }                                 \
+    __atomic_store_n(&ip->cache->method, method, __ATOMIC_RELEASE);            \
+    quicken(ip, (opcode), [](Instruction &) {});                               \
+    REDISPATCH();                                                              \
+  }
+    op_invokevirtual:
+      QUICKEN_CALL(quick::invokevirtual);
+    op_invokeinterface:
+      QUICKEN_CALL(quick::invokeinterface);
+#undef QUICKEN_CALL
+    op_invokespecial: {
+      SAVE();
+      Method *method = vm.resolve_method(*thread, klass, ip->index);
+      if (method == nullptr) { goto exception; }
+      Method *target = method;
+      // A call to a super class method skips overrides in between, see
+      // JVMS 6.5 invokespecial.
+      if (method->vtable_index >= 0 and method->holder != &klass and
+          (klass.access_flags & access::super) != 0 and
+          klass.super != nullptr and klass.is_subclass_of(method->holder)) {
+        target = klass.super->vtable[method->vtable_index];
+      }
+      quicken(ip, quick::invokespecial, [&](Instruction &instruction) {
+        instruction.method = target;
+      });
+      REDISPATCH();
+    }
+    op_invokestatic: {
+      SAVE();
+      Method *method = vm.resolve_method(*thread, klass, ip->index);
+      if (method == nullptr) { goto exception; }
+      if (not method->is_static()) {
+        vm.throw_link_error(*thread, LinkError::incompatible_class_change,
+                            method->name);
+        goto exception;
+      }
+      if (method->holder->state != ClassState::initialized and
+          not vm.initialize(*thread, *method->holder)) {
+        goto exception;
+      }
+      if (method->holder->state == ClassState::initialized) {
+        quicken(ip, quick::invokestatic, [&](Instruction &instruction) {
+          instruction.method = method;
+        });
+        REDISPATCH();
+      }
+      INVOKE(method, sp - method->argument_slots);
+    }
+    op_quick_invokevirtual: {
+      InlineCache *cache = ip->cache;
+      Method *method = cache->method;
+      Value *arguments = sp - method->argument_slots;
+      Object *receiver = arguments[0].l;
+      NULL_CHECK(receiver);
+      Method *target = nullptr;
+      if (__atomic_load_n(&cache->klass, __ATOMIC_ACQUIRE) ==
+          receiver->get_klass()) {
+        ++thread->inline_cache_hits;
+        target = cache->target;
+      } else {
+        target = method;
+        if (method->vtable_index >= 0) {
+          target = receiver->get_klass()->vtable[method->vtable_index];
+        } else if (method->holder->is_interface()) {
+          // A method an abstract class inherits from an interface.
+          target = vm.find_interface_method(*receiver->get_klass(), *method);
+          if (target == nullptr) {
+            THROW("java/lang/AbstractMethodError", nullptr);
+          }
+        }
+        update_cache(*thread, *cache, receiver->get_klass(), target);
+      }
+      INVOKE(target, arguments);
+    }
+    op_quick_invokeinterface: {
+      InlineCache *cache = ip->cache;
+      Method *method = cache->method;
+      Value *arguments = sp - method->argument_slots;
+      Object *receiver = arguments[0].l;
+      NULL_CHECK(receiver);
+      Method *target = nullptr;
+      if (__atomic_load_n(&cache->klass, __ATOMIC_ACQUIRE) ==
+          receiver->get_klass()) {
+        ++thread->inline_cache_hits;
+        target = cache->target;
+      } else {
+        target = vm.find_interface_method(*receiver->get_klass(), *method);
+        if (target == nullptr) {
+          if (not receiver->get_klass()->is_subclass_of(method->holder)) {
+            SAVE();
+            vm.throw_with_class(*thread,
+                             "java/lang/IncompatibleClassChangeError",
+                             *receiver->get_klass(),
+                             " does not implement the interface");
+            goto exception;
+          }
+          THROW("java/lang/AbstractMethodError", nullptr);
+        }
+        update_cache(*thread, *cache, receiver->get_klass(), target);
+      }
+      INVOKE(target, arguments);
+    }
+    op_quick_invokespecial: {
+      Method *target = ip->method;
+      Value *arguments = sp - target->argument_slots;
+      NULL_CHECK(arguments[0].l);
+      INVOKE(target, arguments);
+    }
+    op_quick_invokestatic:
+      INVOKE(ip->method, sp - ip->method->argument_slots);
+
+      // Objects.
+    op_new_: {
+      SAVE();
+      Klass *created = vm.resolve_class(*thread, klass, ip->index);
+      if (created == nullptr) { goto exception; }
+      if ((created->access_flags & (access::interface | access::abstract)) !=
+          0) {
+        vm.throw_with_class(*thread, "java/lang/InstantiationError", *created,
+                         "");
+        goto exception;
+      }
+      if (created->state != ClassState::initialized and
+          not vm.initialize(*thread, *created)) {
+        goto exception;
+      }
+      if (created->state == ClassState::initialized) {
+        quicken(ip, quick::new_, [&](Instruction &instruction) {
+          instruction.klass = created;
+        });
+        REDISPATCH();
+      }
+      Object *object = vm.new_object(*thread, *created);
+      if (object == nullptr) { goto exception; }
+      sp->l = object;
+      ++sp;
+      ADVANCE();
+    }
+    op_quick_new_: {
+      SAVE();
+      Object *object = vm.new_object(*thread, *ip->klass);
+      if (object == nullptr) { goto exception; }
+      sp->l = object;
+      ++sp;
+      ADVANCE();
+    }
+    op_newarray: {
+      SAVE();
+      Klass *array_class = vm.primitive_array_class(*thread,
+                                                    BasicType(ip->count));
+      if (array_class == nullptr) { goto exception; }
+      ArrayObject *array = vm.new_array(*thread, *array_class, sp[-1].i);
+      if (array == nullptr) { goto exception; }
+      sp[-1].l = &array->header;
+      ADVANCE();
+    }
+    op_anewarray: {
+      SAVE();
+      Klass *component = vm.resolve_class(*thread, klass, ip->index);
+      if (component == nullptr) { goto exception; }
+      Klass *array_class = vm.array_class(*thread, *component);
+      if (array_class == nullptr) { goto exception; }
+      ArrayObject *array = vm.new_array(*thread, *array_class, sp[-1].i);
+      if (array == nullptr) { goto exception; }
+      sp[-1].l = &array->header;
+      ADVANCE();
+    }
+    op_multianewarray: {
+      SAVE();
+      Klass *array_class = vm.resolve_class(*thread, klass, ip->index);
+      if (array_class == nullptr) { goto exception; }
+      Value *counts = sp - ip->count;
+      for (uint8_t i = 0; i < ip->count; ++i) {
+        if (counts[i].i < 0) {
+          THROW("java/lang/NegativeArraySizeException", nullptr);
+        }
+      }
+      ArrayObject *array = new_multi_array(*thread, *array_class, counts,
+                                           ip->count);
+      if (array == nullptr) { goto exception; }
+      sp = counts;
+      sp->l = &array->header;
+      ++sp;
+      ADVANCE();
+    }
+    op_checkcast: {
+      Object *object = sp[-1].l;
+      if (object == nullptr) { ADVANCE(); }
+      SAVE();
+      Klass *target = vm.resolve_class(*thread, klass, ip->index);
+      if (target == nullptr) { goto exception; }
+      if (not vm.is_assignable(object->get_klass(), target)) {
+        vm.throw_class_cast(*thread, *object->get_klass(), *target);
+        goto exception;
+      }
+      ADVANCE();
+    }
+    op_instanceof: {
+      Object *object = sp[-1].l;
+      if (object == nullptr) {
+        sp[-1].i = 0;
+        ADVANCE();
+      }
+      SAVE();
+      Klass *target = vm.resolve_class(*thread, klass, ip->index);
+      if (target == nullptr) { goto exception; }
+      sp[-1].i = vm.is_assignable(object->get_klass(), target);
+      ADVANCE();
+    }
+    op_athrow: {
+      Object *thrown = sp[-1].l;
+      NULL_CHECK(thrown);
+      SAVE();
+      thread->exception = thrown;
+      goto exception;
+    }
+
+    op_monitorenter: {
+      Object *object = sp[-1].l;
+      NULL_CHECK(object);
+      SAVE();
+      vm.monitor_enter(*thread, object);
+      --sp;
+      ADVANCE();
+    }
+    op_monitorexit: {
+      Object *object = sp[-1].l;
+      NULL_CHECK(object);
+      SAVE();
+      if (not vm.monitor_exit(*thread, object)) { goto exception; }
+      --sp;
+      ADVANCE();
+    }
+
+    op_unsupported: {
+      char message[64];
+      snprintf(message, sizeof(message), "%s is not supported",
+               opcode_name(uint8_t(ip->opcode)));
+      THROW("java/lang/UnsupportedOperationException", message);
+    }
+
+    backedge: {
+      // Continue the loop in compiled code, which returns from the method,
+      // or gives it back at another instruction.
+      SAVE();
+      Value result {};
+      switch (compiler.on_backedge(*thread, *frame, result)) {
+        case CompiledExit::returned:
+          return result;
+        case CompiledExit::exception:
+          ip = frame->ip;
+          goto exception;
+        case CompiledExit::deoptimized:
+          ip = frame->ip;
+          sp = frame->sp;
+          break;
+        case CompiledExit::not_entered:
+          break;
+        case CompiledExit::no_entry:
+          __atomic_store_n(&const_cast<Instruction *>(branch)->count,
+                           Instruction::no_osr, __ATOMIC_RELAXED);
+          break;
+      }
+      NEXT();
+    }
+
+    exception: {
+      // Unwind to the handler in this method, or return to the caller with
+      // `thread->exception` set.
+      Instruction const *handler = find_handler(*thread, *frame, ip);
+      if (handler == nullptr) { return {}; }
+      sp = frame->stack;
+      sp->l = thread->exception;
+      ++sp;
+      thread->exception = nullptr;
+      JUMP(handler);
+    }
+
+#undef NEXT
+#undef JUMP
+#undef ADVANCE
+#undef BRANCH
+#undef REDISPATCH
+#undef SAVE
+#undef THROW
+#undef NULL_CHECK
+#undef ARRAY_CHECK
+#undef ARRAY_LOAD
+#undef ARRAY_STORE
+#undef INT_BINARY
+#undef LONG_BINARY
+#undef LONG_SHIFT
+#undef FLOAT_BINARY
+#undef DOUBLE_BINARY
+#undef IF
+#undef IF_COMPARE
+#undef INVOKE
+#undef SKJVM_DISPATCH_THREADED
+    }
+
+    /// The handler addresses of the direct-threaded interpreter by opcode,
+    /// or \c nullptr without direct threading.
+    auto handler_table() -> void const *const * {
+#if SKJVM_THREADED_DISPATCH
+      static void const *table[handler_table_size];
+      static bool ready = false;
+      if (not __atomic_load_n(&ready, __ATOMIC_ACQUIRE)) {
+        // Filling it twice from two threads writes the same values.
+        (void)execute<true, false>(nullptr, nullptr, table);
+        __atomic_store_n(&ready, true, __ATOMIC_RELEASE);
+      }
+      return table;
+#else
+      return nullptr;
+#endif
+    }
+  } // namespace
+
+  auto has_threaded_dispatch() -> bool {
+    return SKJVM_THREADED_DISPATCH != 0;
+  }
+
+  auto interpret(Thread &thread, DispatchMode mode, Method &method,
+                 Value *locals) -> Value {
+    VM &vm = thread.get_vm();
+    DecodedMethod const &decoded = *method.decoded;
+    Value *stack = locals + decoded.max_locals;
+    if (thread.depth >= Thread::max_depth or
+        stack + decoded.max_stack > thread.get_stack_limit() or
+        thread.is_native_stack_exhausted()) {
+      vm.throw_new(thread, "java/lang/StackOverflowError", nullptr);
+      return {};
+    }
+
+    Frame frame {thread.frame, &method, locals, stack, stack, decoded.code};
+    thread.frame = &frame;
+    ++thread.depth;
+    Value result {};
+    CompiledExit exit = CompiledExit::not_entered;
+    Compiler &compiler = vm.get_compiler();
+    if (mode != DispatchMode::counting and compiler.is_enabled()) {
+      exit = compiler.on_invocation(thread, frame, result);
+    }
+    // Interpret the method, or what compiled code left of it.
+    if (exit != CompiledExit::returned) {
+      result = resume(thread, mode, frame);
+    }
+    --thread.depth;
+    thread.frame = frame.caller;
+    return result;
+  }
+
+  auto resume(Thread &thread, DispatchMode mode, Frame &frame) -> Value {
+    switch (mode) {
+      case DispatchMode::threaded:
+        return execute<SKJVM_THREADED_DISPATCH != 0, false>(&thread, &frame,
+                                                            nullptr);
+      case DispatchMode::switch_:
+        return execute<false, false>(&thread, &frame, nullptr);
+      case DispatchMode::counting:
+        return execute<false, true>(&thread, &frame, nullptr);
+    }
+    return {};
+  }
+
+  auto decode_method(Method const &method, Arena &arena)
+      -> DecodedMethod * {
+    ClassFile const &class_file = *method.holder->class_file;
+    CodeView const code = method.code;
+    uint32_t const length = code.code_length;
+    if (length == 0) { return nullptr; }
+    auto *index_of = static_cast<uint32_t *>(
+      checked_malloc(sizeof(uint32_t) * length));
+    memset(index_of, 0xff, sizeof(uint32_t) * length);
+
+    // Find where instructions start first, so that branches can be checked
+    // and turned into pointers.
+    uint32_t count = 0;
+    Opcode last = Opcode::nop;
+    for (uint32_t bci = 0; bci < length;) {
+      uint32_t size = instruction_length(code.code, length, bci);
+      if (size == 0) {
+        free(index_of);
+        return nullptr;
+      }
+      index_of[bci] = count++;
+      last = Opcode(code.code[bci]);
+      bci += size;
+    }
+    // Execution must not run off the end of the code.
+    if (not ends_flow(last) and last != Opcode::goto_w) {
+      free(index_of);
+      return nullptr;
+    }
+
+    auto *decoded = arena.allocate_array<DecodedMethod>(1);
+    decoded->code = arena.allocate_array<Instruction>(count);
+    decoded->length = count;
+    decoded->bcis = arena.allocate_array<uint32_t>(count);
+    decoded->max_stack = code.max_stack;
+    decoded->max_locals = code.max_locals;
+
+    Decoder decoder(class_file, code, arena, index_of);
+    decoder.set_instructions(decoded->code);
+    void const *const *handlers = handler_table();
+    bool valid = true;
+    for (uint32_t bci = 0; bci < length and valid;) {
+      Instruction &instruction = decoded->code[index_of[bci]];
+      decoded->bcis[index_of[bci]] = bci;
+      valid = decoder.decode(bci, instruction);
+      if (handlers != nullptr) {
+        instruction.handler = handlers[uint8_t(instruction.opcode)];
+      }
+      bci += instruction_length(code.code, length, bci);
+    }
+
+    decoded->handler_count = code.exception_table_length;
+    decoded->handlers = arena.allocate_array<DecodedHandler>(
+      code.exception_table_length);
+    for (uint16_t i = 0; i < code.exception_table_length and valid; ++i) {
+      ExceptionHandler entry = code.exception_handler(i);
+      DecodedHandler &handler = decoded->handlers[i];
+      handler.start = decoder.at(entry.start_pc);
+      handler.end = entry.end_pc == length ? decoded->code + count
+                                           : decoder.at(entry.end_pc);
+      handler.target = decoder.at(entry.handler_pc);
+      handler.catch_type = entry.catch_type;
+      valid = handler.start != nullptr and handler.end != nullptr and
+              handler.target != nullptr and handler.start < handler.end and
+              (entry.catch_type == 0 or
+               class_file.tag(entry.catch_type) == ConstantTag::class_);
+    }
+    free(index_of);
+    valid = valid and compute_stack_maps(method, *decoded, arena);
+    // The arena keeps what was allocated for a rejected method.
+    return valid ? decoded : nullptr;
+  }
+} // namespace skjvm
@@ -0,0 +1,333 @@
+#include <skjvm/klass.hpp>
+
+#include <skjvm/object.hpp>
+
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+
+namespace skjvm {
+  namespace {
+    class MutexGuard {
+      pthread_mutex_t &mutex;
+
+     public:
+      explicit MutexGuard(pthread_mutex_t &mutex) noexcept : mutex(mutex) {
+        pthread_mutex_lock(&mutex);
+      }
+      MutexGuard(MutexGuard const&) = delete;
+      auto operator=(MutexGuard const&) -> MutexGuard & = delete;
+      ~MutexGuard() noexcept {
+        pthread_mutex_unlock(&mutex);
+      }
+    };
+
+    /// The class space, reserved on the first allocation and never given
+    /// back. Freed classes are linked through their first word.
+    constexpr size_t class_space_size = size_t(256) * 1024 * 1024;
+    constexpr size_t klass_slot_size = (sizeof(Klass) + 7) & ~size_t(7);
+
+    pthread_mutex_t class_space_mutex = PTHREAD_MUTEX_INITIALIZER;
+    uint8_t *class_space_top = nullptr;
+    uint8_t *class_space_end = nullptr;
+    void *free_klasses = nullptr;
+
+    auto reserve_class_space() -> void {
+      // Below 4 GiB if the range is free there, so that a narrow class is
+      // its address.
+      void *hint = reinterpret_cast<void *>(uintptr_t(1) << 30);
+      void *memory = mmap(hint, class_space_size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (memory == MAP_FAILED) {
+        fatal("cannot reserve %zu bytes for the class space",
+              class_space_size);
+      }
+      auto *start = static_cast<uint8_t *>(memory);
+      bool low = uintptr_t(start) + class_space_size <= uintptr_t(1) << 32;
+      narrow_klass_base = low ? 0 : uintptr_t(start);
+      // Offset 0 stands for no class.
+      class_space_top = start + klass_slot_size;
+      class_space_end = start + class_space_size;
+    }
+
+    auto align_up(uint32_t offset, uint32_t alignment) -> uint32_t {
+      return (offset + alignment - 1) & ~(alignment - 1);
+    }
+
+    /// \brief Places fields after an end offset, or in the holes aligning
+    /// earlier ones left before it.
+    class FieldPacker {
+      struct Hole {
+        uint32_t start;
+        uint32_t end;
+      };
+
+      /// Holes beyond that many are left empty.
+      static constexpr uint32_t max_holes = 16;
+      Hole holes[max_holes] {};
+      uint32_t hole_count {0};
+      uint32_t end;
+
+      auto add_hole(uint32_t start, uint32_t limit) -> void {
+        if (start < limit and hole_count < max_holes) {
+          holes[hole_count++] = {start, limit};
+        }
+      }
+
+     public:
+      explicit FieldPacker(uint32_t start) noexcept : end(start) {}
+
+      /// The offset of \p size bytes aligned to \p alignment.
+      auto place(uint32_t size, uint32_t alignment) -> uint32_t {
+        for (uint32_t i = 0; i < hole_count; ++i) {
+          Hole hole = holes[i];
+          uint32_t offset = align_up(hole.start, alignment);
+          if (offset + size > hole.end) { continue; }
+          holes[i] = holes[--hole_count];
+          add_hole(hole.start, offset);
+          add_hole(offset + size, hole.end);
+          return offset;
+        }
+        uint32_t offset = align_up(end, alignment);
+        add_hole(end, offset);
+        end = offset + size;
+        return offset;
+      }
+
+      [[nodiscard]]
+      auto get_end() const -> uint32_t {
+        return end;
+      }
+    };
+
+    /// Place the fields of \p klass that are static or not as
+    /// \p static_, with \p packer.
+    auto pack_fields(Klass &klass, bool static_, FieldPacker &packer)
+        -> void {
+      uint32_t references = 0;
+      for (uint16_t i = 0; i < klass.field_count; ++i) {
+        Field const &field = klass.fields[i];
+        if (field.is_static() == static_ and
+            field.type == BasicType::reference) {
+          ++references;
+        }
+      }
+      if (references != 0) {
+        uint32_t offset = packer.place(references * 8, 8);
+        for (uint16_t i = 0; i < klass.field_count; ++i) {
+          Field &field = klass.fields[i];
+          if (field.is_static() == static_ and
+              field.type == BasicType::reference) {
+            field.offset = offset;
+            offset += 8;
+          }
+        }
+      }
+      for (uint32_t size = 8; size != 0; size /= 2) {
+        for (uint16_t i = 0; i < klass.field_count; ++i) {
+          Field &field = klass.fields[i];
+          if (field.is_static() == static_ and
+              field.type != BasicType::reference and
+              size_of(field.type) == size) {
+            field.offset = packer.place(size, size);
+          }
+        }
+      }
+    }
+  } // namespace
+
+  auto allocate_klass() -> Klass * {
+    MutexGuard guard(class_space_mutex);
+    void *slot = free_klasses;
+    if (slot != nullptr) {
+      memcpy(&free_klasses, slot, sizeof(void *));
+      memset(slot, 0, klass_slot_size);
+      return static_cast<Klass *>(slot);
+    }
+    if (class_space_top == nullptr) { reserve_class_space(); }
+    if (class_space_top + klass_slot_size > class_space_end) {
+      fatal("class space of %zu bytes exhausted", class_space_size);
+    }
+    slot = class_space_top;
+    class_space_top += klass_slot_size;
+    return static_cast<Klass *>(slot);
+  }
+
+  auto free_klass(Klass *klass) -> void {
+    MutexGuard guard(class_space_mutex);
+    memcpy(static_cast<void *>(klass), &free_klasses, sizeof(void *));
+    free_klasses = klass;
+  }
+
+  auto basic_type_of(char first) -> BasicType {
+    switch (first) {
+      case 'Z': return BasicType::boolean;
+      case 'C': return BasicType::char_;
+      case 'F': return BasicType::float_;
+      case 'D': return BasicType::double_;
+      case 'B': return BasicType::byte;
+      case 'S': return BasicType::short_;
+      case 'I': return BasicType::int_;
+      case 'J': return BasicType::long_;
+      case 'L':
+      case '[': return BasicType::reference;
+      default: return BasicType::void_;
+    }
+  }
+
+  auto size_of(BasicType type) -> uint32_t {
+    switch (type) {
+      case BasicType::boolean:
+      case BasicType::byte: return 1;
+      case BasicType::char_:
+      case BasicType::short_: return 2;
+      case BasicType::float_:
+      case BasicType::int_: return 4;
+      case BasicType::double_:
+      case BasicType::long_:
+      case BasicType::reference: return 8;
+      case BasicType::void_: return 0;
+    }
+    return 0;
+  }
+
+  auto Klass::is_subclass_of(Klass const *other) const -> bool {
+    for (Klass const *klass = this; klass != nullptr; klass = klass->super) {
+      if (klass == other) { return true; }
+      for (uint16_t i = 0; i < klass->interface_count; ++i) {
+        if (klass->interfaces[i]->is_subclass_of(other)) { return true; }
+      }
+    }
+    return false;
+  }
+
+  auto Klass::find_method(Utf8View name, Utf8View descriptor) const
+      -> Method * {
+    for (uint16_t i = 0; i < method_count; ++i) {
+      if (methods[i].name.equals(name) and
+          methods[i].descriptor.equals(descriptor)) {
+        return &methods[i];
+      }
+    }
+    return nullptr;
+  }
+
+  auto layout_fields(Klass &klass) -> void {
+    Klass const *super = klass.super;
+    FieldPacker instance(super != nullptr ? super->fields_end
+                                          : object_header_size);
+    pack_fields(klass, false, instance);
+    FieldPacker statics(0);
+    pack_fields(klass, true, statics);
+    klass.instance_size = align_up(instance.get_end(), 8);
+    klass.static_size = statics.get_end();
+  }
+
+  auto set_reference_blocks(Klass &klass, Arena &arena) -> void {
+    Klass const *super = klass.super;
+    uint32_t end = super != nullptr ? super->fields_end : object_header_size;
+    // The references of the class itself are together, see layout_fields.
+    uint32_t first = UINT32_MAX;
+    uint32_t count = 0;
+    for (uint16_t i = 0; i < klass.field_count; ++i) {
+      Field const &field = klass.fields[i];
+      if (field.is_static()) { continue; }
+      uint32_t field_end = field.offset + size_of(field.type);
+      if (field_end > end) { end = field_end; }
+      if (field.type == BasicType::reference) {
+        if (field.offset < first) { first = field.offset; }
+        ++count;
+      }
+    }
+    klass.fields_end = end;
+
+    uint32_t inherited = super != nullptr ? super->reference_block_count : 0;
+    auto *blocks = arena.allocate_array<ReferenceBlock>(inherited + 1);
+    for (uint32_t i = 0; i < inherited; ++i) {
+      blocks[i] = super->reference_blocks[i];
+    }
+    uint32_t block_count = inherited;
+    if (count != 0) {
+      ReferenceBlock *last = block_count != 0 ? &blocks[block_count - 1]
+                                              : nullptr;
+      if (last != nullptr and last->offset + last->count * 8 == first) {
+        last->count += count;
+      } else {
+        blocks[block_count++] = {first, count};
+      }
+    }
+    klass.reference_blocks = blocks;
+    klass.reference_block_count = block_count;
+  }
+
+  auto print_layout(FILE *stream, Klass const &klass) -> void {
+    fprintf(stream, "Layout of %.*s, %u bytes:\n", int(klass.name.length),
+            reinterpret_cast<char const *>(klass.name.bytes),
+            klass.is_array() ? array_data_offset : klass.instance_size);
+    fprintf(stream, "  @%-4u %4u  (object header)\n", 0u, object_header_size);
+    if (klass.is_array()) {
+      fprintf(stream, "  @%-4u %4u  (length)\n", object_header_size, 4u);
+      fprintf(stream, "  @%-4u %4u  (padding)\n", object_header_size + 4,
+              array_data_offset - object_header_size - 4);
+      fprintf(stream, "  @%-4u %4u  (each element)\n", array_data_offset,
+              size_of(klass.element_type));
+      return;
+    }
+
+    // The instance fields of the class and its supers, by offset.
+    PodVector<Field const *> fields;
+    for (Klass const *holder = &klass; holder != nullptr;
+         holder = holder->super) {
+      for (uint16_t i = 0; i < holder->field_count; ++i) {
+        if (not holder->fields[i].is_static()) {
+          fields.push(&holder->fields[i]);
+        }
+      }
+    }
+    for (size_t i = 1; i < fields.get_size(); ++i) {
+      Field const *field = fields[i];
+      size_t j = i;
+      for (; j > 0 and fields[j - 1]->offset > field->offset; --j) {
+        fields[j] = fields[j - 1];
+      }
+      fields[j] = field;
+    }
+
+    uint32_t position = object_header_size;
+    auto print_hole = [&](uint32_t end) {
+      if (end > position) {
+        fprintf(stream, "  @%-4u %4u  (padding)\n", position, end - position);
+      }
+    };
+    for (Field const *field : fields) {
+      print_hole(field->offset);
+      uint32_t size = size_of(field->type);
+      Utf8View holder = field->holder->name;
+      fprintf(stream, "  @%-4u %4u  %.*s.%.*s %.*s\n", field->offset, size,
+              int(holder.length),
+              reinterpret_cast<char const *>(holder.bytes),
+              int(field->name.length),
+              reinterpret_cast<char const *>(field->name.bytes),
+              int(field->descriptor.length),
+              reinterpret_cast<char const *>(field->descriptor.bytes));
+      position = field->offset + size;
+    }
+    print_hole(klass.instance_size);
+    for (uint32_t i = 0; i < klass.reference_block_count; ++i) {
+      ReferenceBlock const &block = klass.reference_blocks[i];
+      fprintf(stream, "  references @%u-%u\n", block.offset,
+              block.offset + block.count * 8 - 1);
+    }
+  }
+
+  auto Klass::find_field(Utf8View name, Utf8View descriptor) const
+      -> Field * {
+    for (uint16_t i = 0; i < field_count; ++i) {
+      if (fields[i].name.equals(name) and
+          fields[i].descriptor.equals(descriptor)) {
+        return &fields[i];
+      }
+    }
+    return nullptr;
+  }
+} // namespace skjvm
@@ -0,0 +1,94 @@
+#include <skjvm/mapped_file.hpp>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace skjvm {
+  namespace {
+    auto make_directories(char *path) -> void {
+      for (char *slash = strchr(path + 1, '/'); slash != nullptr;
+           slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, 0755);
+        *slash = '/';
+      }
+    }
+  } // namespace
+
+  MappedFile::~MappedFile() noexcept {
+    close();
+  }
+
+  auto MappedFile::open(char const *path) -> bool {
+    close();
+
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { return false; }
+
+    struct stat status {};
+    if (fstat(fd, &status) != 0 or not S_ISREG(status.st_mode)) {
+      ::close(fd);
+      return false;
+    }
+
+    if (status.st_size == 0) {
+      ::close(fd);
+      return true;
+    }
+
+    void *mapping = mmap(nullptr, size_t(status.st_size), PROT_READ,
+                         MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file.
+    ::close(fd);
+    if (mapping == MAP_FAILED) { return false; }
+
+    // Class files are small and read front to back exactly once.
+    madvise(mapping, size_t(status.st_size), MADV_WILLNEED);
+
+    data = static_cast<uint8_t const *>(mapping);
+    size = size_t(status.st_size);
+    return true;
+  }
+
+  auto MappedFile::close() -> void {
+    if (data != nullptr) {
+      munmap(const_cast<uint8_t *>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+  }
+
+  auto replace_file(char const *path, void const *data, size_t size) -> bool {
+    char temporary[PATH_MAX];
+    if (snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path,
+                 int(getpid())) >= int(sizeof(temporary))) {
+      return false;
+    }
+    make_directories(temporary);
+    int fd = ::open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool written = fd >= 0;
+    auto const *bytes = static_cast<uint8_t const *>(data);
+    size_t done = 0;
+    while (written and done < size) {
+      ssize_t count = write(fd, bytes + done, size - done);
+      if (count < 0 and errno == EINTR) { continue; }
+      written = count > 0;
+      done += written ? size_t(count) : 0;
+    }
+    if (fd >= 0) {
+      written = ::close(fd) == 0 and written;
+    }
+    // Renaming over the old file is atomic.
+    if (not written or rename(temporary, path) != 0) {
+      unlink(temporary);
+      return false;
+    }
+    return true;
+  }
+} // namespace skjvm
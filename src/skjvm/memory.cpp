@@ -0,0 +1,117 @@
+#include <skjvm/memory.hpp>
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace skjvm {
+  auto fatal(char const *format, ...) -> void {
+    va_list arguments;
+    va_start(arguments, format);
+    fputs("skjvm: fatal error: ", stderr);
+    vfprintf(stderr, format, arguments);
+    fputc('\n', stderr);
+    va_end(arguments);
+    abort();
+  }
+
+  auto checked_malloc(size_t size) -> void * {
+    void *pointer = malloc(size == 0 ? 1 : size);
+    if (pointer == nullptr) { fatal("out of memory allocating %zu bytes", size); }
+    return pointer;
+  }
+
+  auto checked_calloc(size_t count, size_t size) -> void * {
+    void *pointer = calloc(count == 0 ? 1 : count, size == 0 ? 1 : size);
+    if (pointer == nullptr) {
+      fatal("out of memory allocating %zu * %zu bytes", count, size);
+    }
+    return pointer;
+  }
+
+  auto checked_realloc(void *pointer, size_t size) -> void * {
+    void *resized = realloc(pointer, size == 0 ? 1 : size);
+    if (resized == nullptr) { fatal("out of memory allocating %zu bytes", size); }
+    return resized;
+  }
+
+  Arena::Arena(Arena &&other) noexcept
+    : chunk(other.chunk), position(other.position), limit(other.limit),
+      spare(other.spare), allocations(other.allocations) {
+    other.chunk = nullptr;
+    other.position = nullptr;
+    other.limit = nullptr;
+    other.spare = nullptr;
+    other.allocations = 0;
+  }
+
+  auto Arena::operator=(Arena &&other) noexcept -> Arena & {
+    if (this != &other) {
+      release(nullptr);
+      free(spare);
+      chunk = other.chunk;
+      position = other.position;
+      limit = other.limit;
+      spare = other.spare;
+      allocations = other.allocations;
+      other.chunk = nullptr;
+      other.position = nullptr;
+      other.limit = nullptr;
+      other.spare = nullptr;
+      other.allocations = 0;
+    }
+    return *this;
+  }
+
+  Arena::~Arena() noexcept {
+    release(nullptr);
+    free(spare);
+  }
+
+  auto Arena::release(Chunk *until) noexcept -> void {
+    while (chunk != until) {
+      Chunk *previous = chunk->previous;
+      // Keep one chunk of the usual size to start the next region with.
+      if (chunk->size == chunk_size and spare == nullptr) {
+        spare = chunk;
+      } else {
+        free(chunk);
+      }
+      chunk = previous;
+    }
+  }
+
+  auto Arena::reset(Mark mark) noexcept -> void {
+    release(mark.chunk);
+    position = mark.position;
+    limit = chunk == nullptr
+      ? nullptr : reinterpret_cast<uint8_t *>(chunk) + chunk->size;
+  }
+
+  auto Arena::allocate(size_t size, size_t alignment) -> void * {
+    auto aligned = (uintptr_t(position) + alignment - 1) & ~(alignment - 1);
+    if (position == nullptr or aligned + size > uintptr_t(limit)) {
+      // Large blocks get a chunk of their own.
+      size_t wanted = sizeof(Chunk) + size + alignment;
+      size_t chunk_bytes = wanted > chunk_size ? wanted : chunk_size;
+      Chunk *fresh = spare;
+      if (chunk_bytes == chunk_size and fresh != nullptr) {
+        spare = nullptr;
+      } else {
+        fresh = static_cast<Chunk *>(checked_malloc(chunk_bytes));
+        ++allocations;
+      }
+      fresh->previous = chunk;
+      fresh->size = chunk_bytes;
+      chunk = fresh;
+      position = reinterpret_cast<uint8_t *>(fresh + 1);
+      limit = reinterpret_cast<uint8_t *>(fresh) + chunk_bytes;
+      aligned = (uintptr_t(position) + alignment - 1) & ~(alignment - 1);
+    }
+    position = reinterpret_cast<uint8_t *>(aligned + size);
+    auto *block = reinterpret_cast<void *>(aligned);
+    memset(block, 0, size);
+    return block;
+  }
+} // namespace skjvm
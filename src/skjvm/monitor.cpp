@@ -0,0 +1,570 @@
+#include <skjvm/monitor.hpp>
+
+#include <limits.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+// The wait-on-address calls of Darwin, which libc++ uses for
+// std::atomic::wait; declared here as no public header has them.
+extern "C" {
+  auto __ulock_wait(uint32_t operation, void *address, uint64_t value,
+                    uint32_t timeout_us) -> int;
+  auto __ulock_wake(uint32_t operation, void *address, uint64_t value)
+    -> int;
+}
+#endif
+
+namespace skjvm {
+  namespace {
+    class MutexGuard {
+      pthread_mutex_t &mutex;
+
+     public:
+      explicit MutexGuard(pthread_mutex_t &mutex) noexcept : mutex(mutex) {
+        pthread_mutex_lock(&mutex);
+      }
+      MutexGuard(MutexGuard const&) = delete;
+      auto operator=(MutexGuard const&) -> MutexGuard & = delete;
+      ~MutexGuard() noexcept {
+        pthread_mutex_unlock(&mutex);
+      }
+    };
+
+#if defined(__linux__)
+    /// Sleep while \p word is \p expected, at most \p timeout unless it is
+    /// \c nullptr, or until woken. May return spuriously.
+    auto futex_wait(uint32_t *word, uint32_t expected,
+                    timespec const *timeout = nullptr) -> void {
+      syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, expected, timeout,
+              nullptr, 0);
+    }
+
+    auto futex_wake(uint32_t *word, int count) -> void {
+      syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr,
+              0);
+    }
+#elif defined(__APPLE__)
+    constexpr uint32_t ulock_compare_and_wait = 1;
+    constexpr uint32_t ulock_wake_all = 0x100;
+    constexpr uint32_t ulock_no_errno = 0x1000000;
+
+    auto futex_wait(uint32_t *word, uint32_t expected,
+                    timespec const *timeout = nullptr) -> void {
+      // Zero waits without a timeout, so round short timeouts up.
+      uint64_t micros = 0;
+      if (timeout != nullptr) {
+        micros = uint64_t(timeout->tv_sec) * 1000000 +
+                 uint64_t(timeout->tv_nsec) / 1000;
+        if (micros == 0) { micros = 1; }
+        if (micros > UINT32_MAX) { micros = UINT32_MAX; }
+      }
+      __ulock_wait(ulock_compare_and_wait | ulock_no_errno, word, expected,
+                   uint32_t(micros));
+    }
+
+    auto futex_wake(uint32_t *word, int count) -> void {
+      uint32_t operation = ulock_compare_and_wait | ulock_no_errno;
+      if (count > 1) { operation |= ulock_wake_all; }
+      __ulock_wake(operation, word, 0);
+    }
+#else
+    /// Elsewhere, waiters sleep on a condition variable picked by the
+    /// address of the word. A waker takes the same mutex after changing the
+    /// word, so a waiter either sees the change or is woken; it may also be
+    /// woken for another word of the bucket, which callers allow for.
+    struct WaitBucket {
+      pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+      pthread_cond_t condition = PTHREAD_COND_INITIALIZER;
+    };
+
+    WaitBucket wait_buckets[64];
+
+    auto bucket_of(uint32_t const *word) -> WaitBucket & {
+      auto address = uintptr_t(word);
+      return wait_buckets[(address >> 2 ^ address >> 8) % 64];
+    }
+
+    auto futex_wait(uint32_t *word, uint32_t expected,
+                    timespec const *timeout = nullptr) -> void {
+      WaitBucket &bucket = bucket_of(word);
+      timespec deadline {};
+      if (timeout != nullptr) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout->tv_sec;
+        deadline.tv_nsec += timeout->tv_nsec;
+        if (deadline.tv_nsec >= 1000000000) {
+          deadline.tv_sec += 1;
+          deadline.tv_nsec -= 1000000000;
+        }
+      }
+      pthread_mutex_lock(&bucket.mutex);
+      if (__atomic_load_n(word, __ATOMIC_ACQUIRE) == expected) {
+        if (timeout != nullptr) {
+          pthread_cond_timedwait(&bucket.condition, &bucket.mutex, &deadline);
+        } else {
+          pthread_cond_wait(&bucket.condition, &bucket.mutex);
+        }
+      }
+      pthread_mutex_unlock(&bucket.mutex);
+    }
+
+    auto futex_wake(uint32_t *word, int) -> void {
+      WaitBucket &bucket = bucket_of(word);
+      pthread_mutex_lock(&bucket.mutex);
+      pthread_cond_broadcast(&bucket.condition);
+      pthread_mutex_unlock(&bucket.mutex);
+    }
+#endif
+
+    auto cpu_relax() -> void {
+#if defined(__x86_64__) or defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    }
+
+    auto load(uint32_t const &field) -> uint32_t {
+      return __atomic_load_n(&field, __ATOMIC_RELAXED);
+    }
+
+    auto store(uint32_t &field, uint32_t value) -> void {
+      __atomic_store_n(&field, value, __ATOMIC_RELAXED);
+    }
+
+    [[nodiscard]]
+    auto owner_of(uintptr_t mark) -> uint32_t {
+      return uint32_t((mark & mark_word::owner_mask) >>
+                      mark_word::owner_shift);
+    }
+
+    [[nodiscard]]
+    auto recursions_of(uintptr_t mark) -> uint32_t {
+      return uint32_t((mark & mark_word::recursion_mask) >>
+                      mark_word::recursion_shift);
+    }
+
+    [[nodiscard]]
+    auto hash_of(uintptr_t mark) -> uint32_t {
+      return uint32_t((mark & mark_word::hash_mask) >> mark_word::hash_shift);
+    }
+
+    [[nodiscard]]
+    auto index_of(uintptr_t mark) -> uint32_t {
+      return uint32_t((mark & mark_word::hash_mask) >>
+                      mark_word::monitor_shift);
+    }
+
+    /// \p mark with the lock state and the bits it gives a meaning to
+    /// replaced by \p bits.
+    [[nodiscard]]
+    auto with_lock_bits(uintptr_t mark, uintptr_t bits) -> uintptr_t {
+      return (mark & ~mark_word::lock_bits) | bits;
+    }
+  } // namespace
+
+  Monitors::~Monitors() noexcept {
+    if (chunks != nullptr) {
+      for (uint32_t i = 0; i < max_monitors / chunk_size; ++i) {
+        free(chunks[i]);
+      }
+      free(chunks);
+    }
+    pthread_mutex_destroy(&mutex);
+  }
+
+  auto Monitors::next_hash(Object const *object) -> uint32_t {
+    // xorshift, seeded by the address. Threads racing may compute the same
+    // hash, which is allowed.
+    uint32_t x = __atomic_load_n(&hash_state, __ATOMIC_RELAXED) ^
+                 uint32_t(uintptr_t(object) >> 3);
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    __atomic_store_n(&hash_state, x, __ATOMIC_RELAXED);
+    return (x & ((uint32_t(1) << mark_word::hash_bits) - 1)) | 1;
+  }
+
+  auto Monitors::allocate() -> Monitor * {
+    MutexGuard guard(mutex);
+    ++stats.in_use;
+    Monitor *monitor = free_list;
+    if (monitor != nullptr) {
+      free_list = monitor->next_free;
+      // Threads that pinned it through a stale header see it is no longer
+      // deflated, then that the header does not refer to it.
+      __atomic_fetch_and(&monitor->pins, ~Monitor::deflated,
+                         __ATOMIC_RELAXED);
+      return monitor;
+    }
+    if (count == max_monitors) {
+      fatal("more than %u objects locked at once", max_monitors);
+    }
+    if (chunks == nullptr) {
+      chunks = static_cast<Monitor **>(
+        checked_calloc(max_monitors / chunk_size, sizeof(Monitor *)));
+    }
+    uint32_t index = count++;
+    if ((index & (chunk_size - 1)) == 0) {
+      __atomic_store_n(&chunks[index >> chunk_shift],
+                       static_cast<Monitor *>(
+                         checked_calloc(chunk_size, sizeof(Monitor))),
+                       __ATOMIC_RELEASE);
+    }
+    monitor = at(index);
+    monitor->index = index;
+    return monitor;
+  }
+
+  auto Monitors::release(Monitor &monitor) -> void {
+    MutexGuard guard(mutex);
+    --stats.in_use;
+    __atomic_store_n(&monitor.object, nullptr, __ATOMIC_RELAXED);
+    monitor.next_free = free_list;
+    free_list = &monitor;
+  }
+
+  /// Replace \p mark, the header of \p object, with a new monitor held by
+  /// \p owner, or by nobody with 0, and pinned if \p pin. Returns
+  /// \c nullptr if the header changed meanwhile.
+  auto Monitors::inflate(Object *object, uintptr_t mark, uint32_t owner,
+                         uint32_t recursions, uint32_t hash, bool pin)
+      -> Monitor * {
+    Monitor *monitor = allocate();
+    __atomic_store_n(&monitor->object, object, __ATOMIC_RELAXED);
+    store(monitor->lock, owner != 0 ? 1 : 0);
+    store(monitor->owner, owner);
+    store(monitor->recursions, recursions);
+    store(monitor->hash, hash);
+    store(monitor->waiters, 0);
+    if (pin) { __atomic_fetch_add(&monitor->pins, 1, __ATOMIC_RELAXED); }
+
+    uintptr_t inflated = with_lock_bits(
+      mark, mark_word::inflated |
+              uintptr_t(monitor->index) << mark_word::monitor_shift);
+    if (not __atomic_compare_exchange_n(&object->mark, &mark, inflated, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      if (pin) { __atomic_fetch_sub(&monitor->pins, 1, __ATOMIC_RELAXED); }
+      release(*monitor);
+      return nullptr;
+    }
+    count_event(stats.inflations);
+    return monitor;
+  }
+
+  /// The monitor \p mark, an inflated header of \p object, refers to,
+  /// pinned, or \c nullptr if it no longer does.
+  auto Monitors::pin(Object *object, uintptr_t mark) -> Monitor * {
+    Monitor *monitor = at(index_of(mark));
+    uint32_t pins = __atomic_fetch_add(&monitor->pins, 1, __ATOMIC_SEQ_CST);
+    if ((pins & Monitor::deflated) == 0 and
+        __atomic_load_n(&object->mark, __ATOMIC_SEQ_CST) == mark) {
+      return monitor;
+    }
+    unpin(*monitor);
+    return nullptr;
+  }
+
+  auto Monitors::unpin(Monitor &monitor) -> void {
+    __atomic_fetch_sub(&monitor.pins, 1, __ATOMIC_RELEASE);
+  }
+
+  /// The monitor of \p object, whose header is \p mark, if \p thread holds
+  /// it inflated. Only its owner frees a monitor, so it needs no pin then.
+  auto Monitors::owned(uint32_t thread, Object *object, uintptr_t mark)
+      -> Monitor * {
+    if ((mark & mark_word::lock_mask) != mark_word::inflated) {
+      return nullptr;
+    }
+    Monitor *monitor = at(index_of(mark));
+    if (load(monitor->owner) != thread or
+        __atomic_load_n(&monitor->object, __ATOMIC_RELAXED) != object) {
+      return nullptr;
+    }
+    return monitor;
+  }
+
+  // The futex lock of Drepper's "Futexes Are Tricky", spinning a while
+  // before sleeping.
+
+  auto Monitors::lock(Monitor &monitor) -> void {
+    uint32_t state = 0;
+    if (__atomic_compare_exchange_n(&monitor.lock, &state, 1, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      return;
+    }
+    count_event(stats.contended_enters);
+    for (uint32_t i = 0; i < spin_limit; ++i) {
+      cpu_relax();
+      state = 0;
+      if (load(monitor.lock) == 0 and
+          __atomic_compare_exchange_n(&monitor.lock, &state, 1, false,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+      }
+    }
+    count_event(stats.blocked_enters);
+    if (state != 2) {
+      state = __atomic_exchange_n(&monitor.lock, 2, __ATOMIC_ACQUIRE);
+    }
+    while (state != 0) {
+      futex_wait(&monitor.lock, 2);
+      state = __atomic_exchange_n(&monitor.lock, 2, __ATOMIC_ACQUIRE);
+    }
+  }
+
+  auto Monitors::unlock(Monitor &monitor) -> void {
+    if (__atomic_fetch_sub(&monitor.lock, 1, __ATOMIC_RELEASE) != 1) {
+      __atomic_store_n(&monitor.lock, 0, __ATOMIC_RELEASE);
+      futex_wake(&monitor.lock, 1);
+    }
+  }
+
+  /// Take \p monitor, pinned, for \p thread, and unpin it.
+  auto Monitors::acquire(Monitor &monitor, uint32_t thread) -> void {
+    lock(monitor);
+    store(monitor.owner, thread);
+    store(monitor.recursions, 0);
+    unpin(monitor);
+  }
+
+  auto Monitors::enter_slow(uint32_t thread, Object *object) -> void {
+    while (true) {
+      uintptr_t mark = __atomic_load_n(&object->mark, __ATOMIC_ACQUIRE);
+      switch (mark & mark_word::lock_mask) {
+        case mark_word::unlocked:
+          if ((mark & mark_word::hash_mask) == 0) {
+            if (__atomic_compare_exchange_n(&object->mark, &mark,
+                                            mark | thin_lock(thread), false,
+                                            __ATOMIC_ACQUIRE,
+                                            __ATOMIC_RELAXED)) {
+              return;
+            }
+          } else if (inflate(object, mark, thread, 0, hash_of(mark),
+                             false) != nullptr) {
+            // The hash leaves no room for a thin lock.
+            return;
+          }
+          break;
+        case mark_word::thin_locked: {
+          uint32_t recursions = recursions_of(mark);
+          if (owner_of(mark) == thread) {
+            if (recursions < mark_word::max_recursions) {
+              uintptr_t nested = mark + (uintptr_t(1)
+                                         << mark_word::recursion_shift);
+              if (__atomic_compare_exchange_n(&object->mark, &mark, nested,
+                                              false, __ATOMIC_RELAXED,
+                                              __ATOMIC_RELAXED)) {
+                return;
+              }
+            } else if (inflate(object, mark, thread, recursions + 1, 0,
+                               false) != nullptr) {
+              return;
+            }
+            break;
+          }
+          // Contended: inflate the lock on behalf of its owner, and wait
+          // for it like any other thread.
+          Monitor *monitor = inflate(object, mark, owner_of(mark),
+                                     recursions, 0, true);
+          if (monitor != nullptr) {
+            acquire(*monitor, thread);
+            return;
+          }
+          break;
+        }
+        case mark_word::inflated: {
+          Monitor *monitor = pin(object, mark);
+          if (monitor == nullptr) { break; }
+          if (load(monitor->owner) == thread) {
+            store(monitor->recursions, load(monitor->recursions) + 1);
+            unpin(*monitor);
+            return;
+          }
+          acquire(*monitor, thread);
+          return;
+        }
+        default:
+          fatal("locking an object being moved");
+      }
+    }
+  }
+
+  auto Monitors::exit_slow(uint32_t thread, Object *object) -> bool {
+    while (true) {
+      uintptr_t mark = __atomic_load_n(&object->mark, __ATOMIC_ACQUIRE);
+      if ((mark & mark_word::lock_mask) == mark_word::thin_locked) {
+        if (owner_of(mark) != thread) { return false; }
+        uintptr_t released = recursions_of(mark) == 0
+          ? with_lock_bits(mark, mark_word::unlocked)
+          : mark - (uintptr_t(1) << mark_word::recursion_shift);
+        // Fails when another thread inflated the lock meanwhile.
+        if (__atomic_compare_exchange_n(&object->mark, &mark, released,
+                                        false, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+          return true;
+        }
+        continue;
+      }
+      Monitor *monitor = owned(thread, object, mark);
+      if (monitor == nullptr) { return false; }
+      uint32_t recursions = load(monitor->recursions);
+      if (recursions != 0) {
+        store(monitor->recursions, recursions - 1);
+        return true;
+      }
+      // Deflate it unless a thread waits on it or is about to enter it:
+      // those coming later see it deflated and read the header again.
+      uint32_t unpinned = 0;
+      if (load(monitor->waiters) == 0 and
+          __atomic_compare_exchange_n(&monitor->pins, &unpinned,
+                                      Monitor::deflated, false,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+        uintptr_t hash = load(monitor->hash);
+        __atomic_store_n(&object->mark,
+                         with_lock_bits(mark, hash << mark_word::hash_shift),
+                         __ATOMIC_RELEASE);
+        store(monitor->owner, 0);
+        unlock(*monitor);
+        count_event(stats.deflations);
+        release(*monitor);
+        return true;
+      }
+      store(monitor->owner, 0);
+      unlock(*monitor);
+      return true;
+    }
+  }
+
+  auto Monitors::wait(uint32_t thread, Object *object, int64_t millis)
+      -> bool {
+    Monitor *monitor = nullptr;
+    while (monitor == nullptr) {
+      uintptr_t mark = __atomic_load_n(&object->mark, __ATOMIC_ACQUIRE);
+      if ((mark & mark_word::lock_mask) == mark_word::thin_locked) {
+        if (owner_of(mark) != thread) { return false; }
+        // Waiting needs somewhere to sleep.
+        monitor = inflate(object, mark, thread, recursions_of(mark), 0,
+                          false);
+      } else {
+        monitor = owned(thread, object, mark);
+        if (monitor == nullptr) { return false; }
+      }
+    }
+    count_event(stats.waits);
+    // Counted as a waiter, the monitor is not deflated until it is back.
+    __atomic_fetch_add(&monitor->waiters, 1, __ATOMIC_RELAXED);
+    uint32_t recursions = load(monitor->recursions);
+    uint32_t sequence = __atomic_load_n(&monitor->sequence,
+                                        __ATOMIC_ACQUIRE);
+    store(monitor->owner, 0);
+    unlock(*monitor);
+
+    if (millis > 0) {
+      timespec timeout {};
+      timeout.tv_sec = time_t(millis / 1000);
+      timeout.tv_nsec = long(millis % 1000) * 1000000;
+      futex_wait(&monitor->sequence, sequence, &timeout);
+    } else {
+      futex_wait(&monitor->sequence, sequence);
+    }
+
+    lock(*monitor);
+    store(monitor->owner, thread);
+    store(monitor->recursions, recursions);
+    __atomic_fetch_sub(&monitor->waiters, 1, __ATOMIC_RELAXED);
+    return true;
+  }
+
+  auto Monitors::notify(uint32_t thread, Object *object, bool all) -> bool {
+    uintptr_t mark = __atomic_load_n(&object->mark, __ATOMIC_ACQUIRE);
+    if ((mark & mark_word::lock_mask) == mark_word::thin_locked) {
+      // Nobody waits on a thin lock.
+      return owner_of(mark) == thread;
+    }
+    Monitor *monitor = owned(thread, object, mark);
+    if (monitor == nullptr) { return false; }
+    if (load(monitor->waiters) != 0) {
+      count_event(stats.notifications);
+      __atomic_fetch_add(&monitor->sequence, 1, __ATOMIC_RELEASE);
+      futex_wake(&monitor->sequence, all ? INT_MAX : 1);
+    }
+    return true;
+  }
+
+  auto Monitors::holds(uint32_t thread, Object *object) -> bool {
+    uintptr_t mark = __atomic_load_n(&object->mark, __ATOMIC_ACQUIRE);
+    if ((mark & mark_word::lock_mask) == mark_word::thin_locked) {
+      return owner_of(mark) == thread;
+    }
+    return owned(thread, object, mark) != nullptr;
+  }
+
+  auto Monitors::identity_hash(Object *object) -> int32_t {
+    while (true) {
+      uintptr_t mark = __atomic_load_n(&object->mark, __ATOMIC_ACQUIRE);
+      switch (mark & mark_word::lock_mask) {
+        case mark_word::unlocked: {
+          uint32_t hash = hash_of(mark);
+          if (hash != 0) { return int32_t(hash); }
+          hash = next_hash(object);
+          if (__atomic_compare_exchange_n(
+                &object->mark, &mark,
+                mark | uintptr_t(hash) << mark_word::hash_shift, false,
+                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return int32_t(hash);
+          }
+          break;
+        }
+        case mark_word::thin_locked:
+          // The hash goes in a monitor, held as the thin lock was.
+          (void)inflate(object, mark, owner_of(mark), recursions_of(mark),
+                        next_hash(object), false);
+          break;
+        case mark_word::inflated: {
+          Monitor *monitor = pin(object, mark);
+          if (monitor == nullptr) { break; }
+          uint32_t hash = load(monitor->hash);
+          if (hash == 0) {
+            uint32_t chosen = next_hash(object);
+            hash = __atomic_compare_exchange_n(&monitor->hash, &hash, chosen,
+                                               false, __ATOMIC_RELAXED,
+                                               __ATOMIC_RELAXED)
+              ? chosen
+              : hash;
+          }
+          unpin(*monitor);
+          return int32_t(hash);
+        }
+        default:
+          fatal("hashing an object being moved");
+      }
+    }
+  }
+
+  auto Monitors::add_roots(PodVector<Object **> &roots) -> void {
+    MutexGuard guard(mutex);
+    for (uint32_t i = 0; i < count; ++i) {
+      Monitor *monitor = at(i);
+      if (monitor->object != nullptr) { roots.push(&monitor->object); }
+    }
+  }
+
+  auto Monitors::get_stats() const -> MonitorStats {
+    MonitorStats result {};
+    result.inflations = __atomic_load_n(&stats.inflations, __ATOMIC_RELAXED);
+    result.deflations = __atomic_load_n(&stats.deflations, __ATOMIC_RELAXED);
+    result.contended_enters = __atomic_load_n(&stats.contended_enters,
+                                              __ATOMIC_RELAXED);
+    result.blocked_enters = __atomic_load_n(&stats.blocked_enters,
+                                            __ATOMIC_RELAXED);
+    result.waits = __atomic_load_n(&stats.waits, __ATOMIC_RELAXED);
+    result.notifications = __atomic_load_n(&stats.notifications,
+                                           __ATOMIC_RELAXED);
+    result.in_use = __atomic_load_n(&stats.in_use, __ATOMIC_RELAXED);
+    return result;
+  }
+} // namespace skjvm
@@ -0,0 +1,328 @@
+#include <skjvm/natives.hpp>
+
+#include <skjvm/descriptor.hpp>
+#include <skjvm/unicode.hpp>
+#include <skjvm/vm.hpp>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+namespace skjvm {
+  namespace {
+    // Object and System.
+
+    auto object_hash_code(Thread &thread, Value *arguments) -> Value {
+      Value result {};
+      result.i = thread.get_vm().get_monitors().identity_hash(arguments[0].l);
+      return result;
+    }
+
+    auto object_wait(Thread &thread, Value *arguments) -> Value {
+      (void)thread.get_vm().monitor_wait(thread, arguments[0].l, 0);
+      return {};
+    }
+
+    auto object_wait_millis(Thread &thread, Value *arguments) -> Value {
+      (void)thread.get_vm().monitor_wait(thread, arguments[0].l,
+                                         arguments[1].j);
+      return {};
+    }
+
+    template <bool all>
+    auto object_notify(Thread &thread, Value *arguments) -> Value {
+      (void)thread.get_vm().monitor_notify(thread, arguments[0].l, all);
+      return {};
+    }
+
+    auto system_identity_hash_code(Thread &thread, Value *arguments)
+        -> Value {
+      Value result {};
+      Object *object = arguments[0].l;
+      result.i = object == nullptr
+        ? 0
+        : thread.get_vm().get_monitors().identity_hash(object);
+      return result;
+    }
+
+    auto clock_nanoseconds(clockid_t clock) -> int64_t {
+      timespec now {};
+      clock_gettime(clock, &now);
+      return int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    auto system_current_time_millis(Thread &, Value *) -> Value {
+      Value result {};
+      result.j = clock_nanoseconds(CLOCK_REALTIME) / 1000000;
+      return result;
+    }
+
+    auto system_nano_time(Thread &, Value *) -> Value {
+      Value result {};
+      result.j = clock_nanoseconds(CLOCK_MONOTONIC);
+      return result;
+    }
+
+    auto system_exit(Thread &, Value *arguments) -> Value {
+      fflush(stdout);
+      fflush(stderr);
+      exit(arguments[0].i);
+    }
+
+    auto system_arraycopy(Thread &thread, Value *arguments) -> Value {
+      VM &vm = thread.get_vm();
+      auto *source = reinterpret_cast<ArrayObject *>(arguments[0].l);
+      int32_t source_position = arguments[1].i;
+      auto *destination = reinterpret_cast<ArrayObject *>(arguments[2].l);
+      int32_t destination_position = arguments[3].i;
+      int32_t length = arguments[4].i;
+      if (source == nullptr or destination == nullptr) {
+        vm.throw_new(thread, "java/lang/NullPointerException", nullptr);
+        return {};
+      }
+      Klass *source_class = source->header.get_klass();
+      Klass *destination_class = destination->header.get_klass();
+      if (not source_class->is_array() or not destination_class->is_array() or
+          source_class->element_type != destination_class->element_type) {
+        vm.throw_new(thread, "java/lang/ArrayStoreException",
+                     "arraycopy: type mismatch");
+        return {};
+      }
+      if (source_position < 0 or destination_position < 0 or length < 0 or
+          source_position > source->length - length or
+          destination_position > destination->length - length) {
+        vm.throw_new(thread, "java/lang/ArrayIndexOutOfBoundsException",
+                     "arraycopy: last source index out of bounds");
+        return {};
+      }
+
+      uint32_t element_size = size_of(source_class->element_type);
+      uint8_t *from = source->elements<uint8_t>() +
+                      size_t(source_position) * element_size;
+      uint8_t *to = destination->elements<uint8_t>() +
+                    size_t(destination_position) * element_size;
+      if (source_class->element_type == BasicType::reference) {
+        vm.get_heap().mark_cards(to, size_t(length) * element_size);
+      }
+      if (source_class->element_type == BasicType::reference and
+          not vm.is_assignable(source_class->component,
+                               destination_class->component)) {
+        // Each element must fit in the destination.
+        auto **elements = reinterpret_cast<Object **>(from);
+        auto **targets = reinterpret_cast<Object **>(to);
+        for (int32_t i = 0; i < length; ++i) {
+          Object *element = elements[i];
+          if (element != nullptr and
+              not vm.is_assignable(element->get_klass(),
+                                   destination_class->component)) {
+            vm.throw_new(thread, "java/lang/ArrayStoreException",
+                         "arraycopy: element type mismatch");
+            return {};
+          }
+          targets[i] = element;
+        }
+        return {};
+      }
+      memmove(to, from, size_t(length) * element_size);
+      return {};
+    }
+
+    // String.
+
+    auto string_equals(Thread &thread, Value *arguments) -> Value {
+      VM &vm = thread.get_vm();
+      Object *self = arguments[0].l;
+      Object *other = arguments[1].l;
+      Value result {};
+      if (self == other) {
+        result.i = 1;
+      } else if (other != nullptr and other->get_klass() == self->get_klass()) {
+        ArrayObject *left = vm.string_chars(self);
+        ArrayObject *right = vm.string_chars(other);
+        result.i = left->length == right->length and
+                   memcmp(left->elements<uint16_t>(),
+                          right->elements<uint16_t>(),
+                          size_t(left->length) * 2) == 0;
+      }
+      return result;
+    }
+
+    auto string_hash_code(Thread &thread, Value *arguments) -> Value {
+      ArrayObject *chars = thread.get_vm().string_chars(arguments[0].l);
+      uint32_t hash = 0;
+      for (int32_t i = 0; i < chars->length; ++i) {
+        hash = hash * 31 + chars->elements<uint16_t>()[i];
+      }
+      Value result {};
+      result.i = int32_t(hash);
+      return result;
+    }
+
+    // PrintStream.
+
+    auto stream_of(Value *arguments) -> FILE * {
+      Object *stream = arguments[0].l;
+      Field *fd = stream->get_klass()->find_field(make_view("fd"),
+                                                  make_view("I"));
+      return fd != nullptr and stream->at<int32_t>(fd->offset) == 2 ? stderr
+                                                                     : stdout;
+    }
+
+    /// Print \p value like \c Double.toString does in the common cases: the
+    /// shortest decimal that reads back the same, with at least one
+    /// fractional digit.
+    auto write_double(FILE *stream, double value, int max_precision) -> void {
+      if (value != value) {
+        fputs("NaN", stream);
+        return;
+      }
+      if (value == 1.0 / 0.0 or value == -1.0 / 0.0) {
+        fputs(value > 0 ? "Infinity" : "-Infinity", stream);
+        return;
+      }
+      char text[64];
+      for (int precision = 1; precision <= max_precision; ++precision) {
+        snprintf(text, sizeof(text), "%.*g", precision, value);
+        bool exact = max_precision == 17 ? strtod(text, nullptr) == value
+                                         : strtof(text, nullptr) ==
+                                             float(value);
+        if (exact) { break; }
+      }
+      if (strpbrk(text, ".eEn") == nullptr) {
+        strcat(text, ".0");
+      }
+      fputs(text, stream);
+    }
+
+    /// The argument of a \c print or \c println method, printed according
+    /// to its \p descriptor.
+    auto write_argument(Thread &thread, FILE *stream, char type,
+                        Value *arguments) -> void {
+      switch (type) {
+        case ')':
+          break;
+        case 'L': {
+          Object *string = arguments[1].l;
+          if (string == nullptr) {
+            fputs("null", stream);
+          } else {
+            ArrayObject *chars = thread.get_vm().string_chars(string);
+            write_utf16(stream, chars->elements<uint16_t>(),
+                        uint32_t(chars->length));
+          }
+          break;
+        }
+        case 'I':
+          fprintf(stream, "%" PRId32, arguments[1].i);
+          break;
+        case 'J':
+          fprintf(stream, "%" PRId64, arguments[1].j);
+          break;
+        case 'C': {
+          auto unit = uint16_t(arguments[1].i);
+          write_utf16(stream, &unit, 1);
+          break;
+        }
+        case 'Z':
+          fputs(arguments[1].i != 0 ? "true" : "false", stream);
+          break;
+        case 'F':
+          write_double(stream, double(arguments[1].f), 9);
+          break;
+        case 'D':
+          write_double(stream, arguments[1].d, 17);
+          break;
+        default:
+          break;
+      }
+    }
+
+    template <char type, bool newline>
+    auto print(Thread &thread, Value *arguments) -> Value {
+      FILE *stream = stream_of(arguments);
+      write_argument(thread, stream, type, arguments);
+      if (newline) { fputc('\n', stream); }
+      return {};
+    }
+
+    auto print_stream_flush(Thread &, Value *arguments) -> Value {
+      fflush(stream_of(arguments));
+      return {};
+    }
+
+    struct NativeMethod {
+      char const *class_name;
+      char const *name;
+      char const *descriptor;
+      NativeFunction function;
+    };
+
+    constexpr NativeMethod natives[] {
+      {"java/lang/Object", "hashCode", "()I", &object_hash_code},
+      {"java/lang/Object", "wait", "()V", &object_wait},
+      {"java/lang/Object", "wait", "(J)V", &object_wait_millis},
+      {"java/lang/Object", "notify", "()V", &object_notify<false>},
+      {"java/lang/Object", "notifyAll", "()V", &object_notify<true>},
+      {"java/lang/String", "equals", "(Ljava/lang/Object;)Z", &string_equals},
+      {"java/lang/String", "hashCode", "()I", &string_hash_code},
+      {"java/lang/System", "currentTimeMillis", "()J",
+       &system_current_time_millis},
+      {"java/lang/System", "nanoTime", "()J", &system_nano_time},
+      {"java/lang/System", "arraycopy",
+       "(Ljava/lang/Object;ILjava/lang/Object;II)V", &system_arraycopy},
+      {"java/lang/System", "identityHashCode", "(Ljava/lang/Object;)I",
+       &system_identity_hash_code},
+      {"java/lang/System", "exit", "(I)V", &system_exit},
+      {"java/io/PrintStream", "flush", "()V", &print_stream_flush},
+      {"java/io/PrintStream", "println", "()V", &print<')', true>},
+      {"java/io/PrintStream", "println", "(Ljava/lang/String;)V",
+       &print<'L', true>},
+      {"java/io/PrintStream", "println", "(I)V", &print<'I', true>},
+      {"java/io/PrintStream", "println", "(J)V", &print<'J', true>},
+      {"java/io/PrintStream", "println", "(C)V", &print<'C', true>},
+      {"java/io/PrintStream", "println", "(Z)V", &print<'Z', true>},
+      {"java/io/PrintStream", "println", "(F)V", &print<'F', true>},
+      {"java/io/PrintStream", "println", "(D)V", &print<'D', true>},
+      {"java/io/PrintStream", "print", "(Ljava/lang/String;)V",
+       &print<'L', false>},
+      {"java/io/PrintStream", "print", "(I)V", &print<'I', false>},
+      {"java/io/PrintStream", "print", "(J)V", &print<'J', false>},
+      {"java/io/PrintStream", "print", "(C)V", &print<'C', false>},
+      {"java/io/PrintStream", "print", "(Z)V", &print<'Z', false>},
+      {"java/io/PrintStream", "print", "(F)V", &print<'F', false>},
+      {"java/io/PrintStream", "print", "(D)V", &print<'D', false>},
+    };
+  } // namespace
+
+  auto write_utf16(FILE *stream, uint16_t const *chars, uint32_t length)
+      -> void {
+    uint8_t buffer[1024];
+    // Each piece takes at most 3 bytes a unit, and does not end between
+    // the two halves of a surrogate pair.
+    for (uint32_t i = 0; i < length;) {
+      uint32_t piece = length - i < sizeof(buffer) / 3
+        ? length - i
+        : uint32_t(sizeof(buffer) / 3);
+      if (i + piece < length and chars[i + piece - 1] >= 0xd800 and
+          chars[i + piece - 1] < 0xdc00) {
+        --piece;
+      }
+      size_t size = encode_utf8(chars + i, piece, buffer);
+      fwrite(buffer, 1, size, stream);
+      i += piece;
+    }
+  }
+
+  auto find_native(Utf8View class_name, Utf8View name, Utf8View descriptor)
+      -> NativeFunction {
+    for (NativeMethod const &native : natives) {
+      if (class_name.equals(native.class_name) and name.equals(native.name) and
+          descriptor.equals(native.descriptor)) {
+        return native.function;
+      }
+    }
+    return nullptr;
+  }
+} // namespace skjvm
@@ -0,0 +1,65 @@
+#include <skjvm/opcodes.hpp>
+#include <skjvm/bytes.hpp>
+
+namespace skjvm {
+  namespace {
+    struct OpcodeInfo {
+      char const *name;
+      int length;
+    };
+
+    constexpr auto make_opcode_table() {
+      struct Table {
+        OpcodeInfo entries[256];
+      } table {};
+      for (auto &entry : table.entries) {
+        entry = {nullptr, -1};
+      }
+#define SKJVM_OPCODE_INFO(name, code, length) table.entries[code] = {#name, length};
+      SKJVM_OPCODES(SKJVM_OPCODE_INFO)
+#undef SKJVM_OPCODE_INFO
+      return table;
+    }
+
+    constexpr auto opcode_table = make_opcode_table();
+  } // namespace
+
+  auto opcode_name(uint8_t opcode) -> char const * {
+    return opcode_table.entries[opcode].name;
+  }
+
+  auto opcode_length(uint8_t opcode) -> int {
+    return opcode_table.entries[opcode].length;
+  }
+
+  auto instruction_length(uint8_t const *code, uint32_t code_length,
+                          uint32_t bci) -> uint32_t {
+    if (bci >= code_length) { return 0; }
+    int length = opcode_length(code[bci]);
+    if (length < 0) { return 0; }
+
+    uint64_t size = uint64_t(length);
+    if (length == 0) {
+      auto opcode = Opcode(code[bci]);
+      if (opcode == Opcode::wide) {
+        if (bci + 1 >= code_length) { return 0; }
+        size = Opcode(code[bci + 1]) == Opcode::iinc ? 6 : 4;
+      } else {
+        // Switches are padded so their operands start 4-byte aligned.
+        uint64_t operands = (uint64_t(bci) + 4) & ~uint64_t(3);
+        if (operands + 12 > code_length) { return 0; }
+        if (opcode == Opcode::tableswitch) {
+          int64_t low = int32_t(read_u4(code + operands + 4));
+          int64_t high = int32_t(read_u4(code + operands + 8));
+          if (high < low) { return 0; }
+          size = operands + 12 + uint64_t(high - low + 1) * 4 - bci;
+        } else {
+          int64_t pairs = int32_t(read_u4(code + operands + 4));
+          if (pairs < 0) { return 0; }
+          size = operands + 8 + uint64_t(pairs) * 8 - bci;
+        }
+      }
+    }
+    return bci + size <= code_length ? uint32_t(size) : 0;
+  }
+} // namespace skjvm
@@ -0,0 +1,238 @@
+#include <skjvm/options.hpp>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace skjvm {
+  namespace {
+    /// If \p argument starts with \p prefix, point \p value past it.
+    auto match_prefix(char const *argument, char const *prefix,
+                      char const *&value) -> bool {
+      size_t length = strlen(prefix);
+      if (strncmp(argument, prefix, length) != 0) { return false; }
+      value = argument + length;
+      return true;
+    }
+
+    auto parse_count(char const *option, char const *value, uint32_t &result)
+        -> bool {
+      char *end = nullptr;
+      unsigned long parsed = strtoul(value, &end, 10);
+      if (*value == '\0' or *end != '\0' or *value == '-' or
+          parsed > UINT32_MAX) {
+        fprintf(stderr, "error: invalid value '%s' for %s\n", value, option);
+        return false;
+      }
+      result = uint32_t(parsed);
+      return true;
+    }
+
+    /// A size in bytes, with an optional \c K, \c M or \c G suffix.
+    auto parse_size(char const *option, char const *value, size_t &result)
+        -> bool {
+      char *end = nullptr;
+      unsigned long long parsed = strtoull(value, &end, 10);
+      unsigned shift = 0;
+      switch (*end) {
+        case 'k': case 'K': shift = 10; ++end; break;
+        case 'm': case 'M': shift = 20; ++end; break;
+        case 'g': case 'G': shift = 30; ++end; break;
+        default: break;
+      }
+      if (*value == '\0' or *value == '-' or *end != '\0' or parsed == 0 or
+          parsed > (SIZE_MAX >> shift)) {
+        fprintf(stderr, "error: invalid value '%s' for %s\n", value, option);
+        return false;
+      }
+      result = size_t(parsed) << shift;
+      return true;
+    }
+  } // namespace
+
+  auto Options::parse(int argc, char **argv, Options &options) -> bool {
+    int index = 1;
+    for (; index < argc; ++index) {
+      char const *argument = argv[index];
+      char const *value = nullptr;
+      if (argument[0] != '-') { break; }
+
+      if (strcmp(argument, "-cp") == 0 or
+          strcmp(argument, "-classpath") == 0 or
+          strcmp(argument, "--class-path") == 0) {
+        if (index + 1 >= argc) {
+          fprintf(stderr, "error: option %s requires a value\n", argument);
+          return false;
+        }
+        options.class_path = argv[++index];
+      } else if (match_prefix(argument, "-Xcpcache:", value)) {
+        options.no_class_path_cache = strcmp(value, "none") == 0;
+        options.class_path_cache = options.no_class_path_cache ? nullptr
+                                                               : value;
+      } else if (match_prefix(argument, "-Xpreload:", value)) {
+        if (not parse_count("-Xpreload", value, options.preload_threads)) {
+          return false;
+        }
+        options.preload_threads_given = true;
+      } else if (match_prefix(argument, "-Xshare:", value)) {
+        if (strcmp(value, "off") == 0) {
+          options.share = ShareMode::off;
+        } else if (strcmp(value, "auto") == 0) {
+          options.share = ShareMode::auto_;
+        } else if (strcmp(value, "on") == 0) {
+          options.share = ShareMode::on;
+        } else if (strcmp(value, "dump") == 0) {
+          options.share = ShareMode::dump;
+        } else {
+          fprintf(stderr, "error: invalid value '%s' for -Xshare\n", value);
+          return false;
+        }
+      } else if (match_prefix(argument, "-XX:SharedArchiveFile=", value)) {
+        options.shared_archive = value;
+      } else if (match_prefix(argument, "-Xinterpreter:", value)) {
+        if (strcmp(value, "threaded") == 0) {
+          options.dispatch = DispatchMode::threaded;
+        } else if (strcmp(value, "switch") == 0) {
+          options.dispatch = DispatchMode::switch_;
+        } else {
+          fprintf(stderr, "error: invalid value '%s' for -Xinterpreter\n",
+                  value);
+          return false;
+        }
+      } else if (strcmp(argument, "-Xint") == 0) {
+        options.interpret_only = true;
+      } else if (match_prefix(argument, "-Xverify:", value)) {
+        if (strcmp(value, "none") == 0) {
+          options.verify = VerifyMode::none;
+        } else if (strcmp(value, "remote") == 0) {
+          options.verify = VerifyMode::remote;
+        } else if (strcmp(value, "all") == 0) {
+          options.verify = VerifyMode::all;
+        } else {
+          fprintf(stderr, "error: invalid value '%s' for -Xverify\n", value);
+          return false;
+        }
+      } else if (match_prefix(argument, "-XX:CompileThreshold=", value)) {
+        if (not parse_count("-XX:CompileThreshold", value,
+                            options.compile_threshold)) {
+          return false;
+        }
+      } else if (match_prefix(argument, "-XX:BackEdgeThreshold=", value)) {
+        if (not parse_count("-XX:BackEdgeThreshold", value,
+                            options.backedge_threshold)) {
+          return false;
+        }
+      } else if (strcmp(argument, "-XX:+PrintCompilation") == 0) {
+        options.print_compilation = true;
+      } else if (strcmp(argument, "-XX:+PrintInlineCacheStats") == 0) {
+        options.print_inline_cache_stats = true;
+      } else if (strcmp(argument, "-XX:+PrintMonitorStats") == 0) {
+        options.print_monitor_stats = true;
+      } else if (strcmp(argument, "-XX:+PrintVerificationStats") == 0) {
+        options.print_verification_stats = true;
+      } else if (match_prefix(argument, "-Xmx", value)) {
+        if (not parse_size("-Xmx", value, options.heap_size)) {
+          return false;
+        }
+      } else if (match_prefix(argument, "-Xmn", value)) {
+        if (not parse_size("-Xmn", value, options.young_size)) {
+          return false;
+        }
+      } else if (match_prefix(argument, "-XX:MaxTenuringThreshold=", value)) {
+        if (not parse_count("-XX:MaxTenuringThreshold", value,
+                            options.tenuring_threshold)) {
+          return false;
+        }
+        if (options.tenuring_threshold > mark_word::max_age) {
+          fprintf(stderr, "error: -XX:MaxTenuringThreshold is at most %u\n",
+                  unsigned(mark_word::max_age));
+          return false;
+        }
+      } else if (match_prefix(argument, "-XX:ParallelGCThreads=", value)) {
+        if (not parse_count("-XX:ParallelGCThreads", value,
+                            options.parallel_gc_threads)) {
+          return false;
+        }
+        if (options.parallel_gc_threads == 0) {
+          fprintf(stderr, "error: -XX:ParallelGCThreads must be at least 1\n");
+          return false;
+        }
+      } else if (strcmp(argument, "-Xlog:gc") == 0 or
+                 strcmp(argument, "-verbose:gc") == 0) {
+        options.log_gc = true;
+      } else if (strcmp(argument, "-XX:+PrintFieldLayout") == 0) {
+        options.print_field_layout = true;
+      } else if (strcmp(argument, "-verbose:class") == 0) {
+        options.verbose_class = true;
+      } else if (strcmp(argument, "-Xprint") == 0) {
+        options.print_class = true;
+      } else if (strcmp(argument, "-help") == 0 or
+                 strcmp(argument, "-h") == 0 or
+                 strcmp(argument, "--help") == 0) {
+        options.help = true;
+        return true;
+      } else {
+        fprintf(stderr, "error: unknown option %s\n", argument);
+        return false;
+      }
+    }
+
+    if (options.young_size >= options.heap_size) {
+      fprintf(stderr, "error: -Xmn must be smaller than -Xmx\n");
+      return false;
+    }
+    if (index >= argc) {
+      fprintf(stderr, "error: no main class given\n");
+      return false;
+    }
+    options.main_class = argv[index];
+    options.argument_count = argc - index - 1;
+    options.arguments = argv + index + 1;
+    return true;
+  }
+
+  auto Options::print_usage(char const *program) -> void {
+    printf(
+      "usage: %s [options] <main class> [arguments...]\n"
+      "\n"
+      "options:\n"
+      "  -cp PATH, -classpath PATH, --class-path PATH\n"
+      "                    directories to load classes from, separated by ':'\n"
+      "  -Xcpcache:FILE    keep the class path index in FILE, or 'none'\n"
+      "  -Xpreload:N       parse referenced classes on N background threads\n"
+      "  -Xshare:MODE      shared class archive: off, auto, on or dump\n"
+      "  -XX:SharedArchiveFile=FILE\n"
+      "                    keep the shared class archive in FILE\n"
+      "  -Xinterpreter:MODE\n"
+      "                    instruction dispatch: threaded or switch\n"
+      "  -Xint             interpret everything, compile nothing\n"
+      "  -Xverify:MODE     verify classes: none, remote or all\n"
+      "  -XX:CompileThreshold=N\n"
+      "                    compile methods once called N times\n"
+      "  -XX:BackEdgeThreshold=N\n"
+      "                    compile methods once their loops went back N times\n"
+      "  -XX:+PrintCompilation\n"
+      "                    print each method compiled or deoptimized\n"
+      "  -XX:+PrintInlineCacheStats\n"
+      "                    print the inline cache hit rate on exit\n"
+      "  -XX:+PrintMonitorStats\n"
+      "                    print lock inflation and contention on exit\n"
+      "  -XX:+PrintVerificationStats\n"
+      "                    print the time spent verifying each class on exit\n"
+      "  -XmxSIZE          size of the Java heap, like 64M\n"
+      "  -XmnSIZE          size of the young generation in it\n"
+      "  -XX:MaxTenuringThreshold=N\n"
+      "                    promote objects after N young collections\n"
+      "  -XX:ParallelGCThreads=N\n"
+      "                    collect the old generation on N threads\n"
+      "  -Xlog:gc, -verbose:gc\n"
+      "                    print each garbage collection\n"
+      "  -XX:+PrintFieldLayout\n"
+      "                    print the field layout of each class linked\n"
+      "  -verbose:class    print each class as it is loaded\n"
+      "  -Xprint           print the main class instead of running it\n"
+      "  -help, -h         print this message\n",
+      program);
+  }
+} // namespace skjvm
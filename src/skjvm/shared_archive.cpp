@@ -0,0 +1,725 @@
+#include <skjvm/shared_archive.hpp>
+
+#include <skjvm/descriptor.hpp>
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+namespace skjvm {
+  namespace {
+    constexpr char archive_magic[8] {'S', 'K', 'C', 'D', 'S', '0', '0', '2'};
+
+    /// Header of the archive. Every offset in the archive is from the start
+    /// of the file, and every section is 8-byte aligned.
+    struct ArchiveHeader {
+      char magic[8];
+      uint32_t header_size;
+      uint32_t object_header_size;
+      uint32_t class_count;
+      uint32_t symbol_count;
+      uint32_t class_path_offset;
+      uint32_t classes_offset;
+      uint32_t symbols_offset;
+      uint32_t reserved;
+      uint64_t total_size;
+    };
+
+    /// A reference to a class, or to a member of it, by index in the
+    /// archive plus one, so zero is no class. For resolved strings,
+    /// \c member is the symbol index plus one.
+    struct ArchivedRef {
+      uint32_t klass;
+      uint32_t member;
+    };
+
+    struct ArchivedMethod {
+      int32_t vtable_index;
+      uint16_t argument_slots;
+      BasicType return_type;
+      uint8_t reserved;
+    };
+
+    struct ArchivedClass {
+      uint32_t data_offset;
+      uint32_t data_size;
+
+      // Where the class file was, to detect changes. Built-in classes have
+      // no file.
+      int64_t mtime_sec;
+      int64_t mtime_nsec;
+      uint64_t file_size;
+      uint16_t root;
+      uint8_t built_in;
+      uint8_t reserved;
+
+      // `ClassFileTables`, with offsets instead of pointers.
+      uint16_t minor_version;
+      uint16_t major_version;
+      uint16_t constant_count;
+      uint16_t access_flags;
+      uint16_t this_class;
+      uint16_t super_class;
+      uint16_t interface_count;
+      uint16_t field_count;
+      uint16_t method_count;
+      uint16_t attribute_count;
+      uint32_t interfaces_offset;
+      uint32_t attributes_offset;
+      uint32_t constant_offsets;
+      uint32_t members;
+
+      /// Index of the super class plus one, and the offset of the
+      /// \c uint32_t indexes of the interfaces.
+      uint32_t super;
+      uint32_t interfaces;
+
+      uint32_t instance_size;
+      uint32_t static_size;
+      /// \c uint32_t offset of each field.
+      uint32_t field_offsets;
+      /// \c ArchivedMethod of each method.
+      uint32_t methods;
+      /// \c ArchivedRef of each vtable entry.
+      uint32_t vtable;
+      uint32_t vtable_length;
+      /// \c ArchivedRef of each constant pool entry.
+      uint32_t resolved;
+      uint32_t reserved2;
+    };
+
+    /// The archive being written, in memory.
+    class Image {
+      PodVector<uint8_t> bytes {};
+
+     public:
+      auto append(void const *data, size_t size) -> uint32_t {
+        while ((bytes.get_size() & 7) != 0) { bytes.push(0); }
+        auto offset = uint32_t(bytes.get_size());
+        bytes.reserve(bytes.get_size() + size);
+        auto const *source = static_cast<uint8_t const *>(data);
+        for (size_t i = 0; i < size; ++i) { bytes.push(source[i]); }
+        return offset;
+      }
+
+      auto get_data() -> uint8_t * {
+        return bytes.get_data();
+      }
+
+      [[nodiscard]]
+      auto get_size() const -> size_t {
+        return bytes.get_size();
+      }
+    };
+
+    /// Indexes of pointers, by open addressing on the address.
+    class PointerIndex {
+      struct Slot {
+        void const *key;
+        uint32_t value;
+      };
+
+      Slot *slots {nullptr};
+      uint32_t capacity {0};
+      uint32_t count {0};
+
+      static auto hash(void const *key) -> uint32_t {
+        auto bits = uint64_t(uintptr_t(key));
+        return uint32_t((bits * 0x9e3779b97f4a7c15ULL) >> 32);
+      }
+
+     public:
+      PointerIndex() noexcept = default;
+      PointerIndex(PointerIndex const&) = delete;
+      auto operator=(PointerIndex const&) -> PointerIndex & = delete;
+      ~PointerIndex() noexcept {
+        free(slots);
+      }
+
+      auto insert(void const *key, uint32_t value) -> void {
+        if ((count + 1) * 2 > capacity) {
+          uint32_t grown = capacity == 0 ? 256 : capacity * 2;
+          auto *resized = static_cast<Slot *>(checked_calloc(grown,
+                                                             sizeof(Slot)));
+          for (uint32_t i = 0; i < capacity; ++i) {
+            if (slots[i].key == nullptr) { continue; }
+            uint32_t slot = hash(slots[i].key) & (grown - 1);
+            while (resized[slot].key != nullptr) {
+              slot = (slot + 1) & (grown - 1);
+            }
+            resized[slot] = slots[i];
+          }
+          free(slots);
+          slots = resized;
+          capacity = grown;
+        }
+        uint32_t slot = hash(key) & (capacity - 1);
+        while (slots[slot].key != nullptr) {
+          slot = (slot + 1) & (capacity - 1);
+        }
+        slots[slot] = {key, value};
+        ++count;
+      }
+
+      /// The value of \p key plus one, or 0 if it has none.
+      [[nodiscard]]
+      auto find(void const *key) const -> uint32_t {
+        if (capacity == 0 or key == nullptr) { return 0; }
+        for (uint32_t slot = hash(key) & (capacity - 1);;
+             slot = (slot + 1) & (capacity - 1)) {
+          if (slots[slot].key == nullptr) { return 0; }
+          if (slots[slot].key == key) { return slots[slot].value + 1; }
+        }
+      }
+    };
+
+    auto mtime_of(struct stat const &status, int64_t &sec, int64_t &nsec)
+        -> void {
+#if defined(__APPLE__)
+      sec = int64_t(status.st_mtimespec.tv_sec);
+      nsec = int64_t(status.st_mtimespec.tv_nsec);
+#else
+      sec = int64_t(status.st_mtim.tv_sec);
+      nsec = int64_t(status.st_mtim.tv_nsec);
+#endif
+    }
+
+    /// Fill the file fields of \p record for the class named \p name.
+    /// Returns \c false if its class file cannot be found.
+    auto describe_source(ClassPath const &class_path, Utf8View name,
+                         ArchivedClass &record) -> bool {
+      ClassPath::Entry const *entry = class_path.find(name);
+      if (entry == nullptr) {
+        record.built_in = 1;
+        return true;
+      }
+      char path[PATH_MAX];
+      struct stat status {};
+      if (not class_path.path_of(*entry, path, sizeof(path)) or
+          stat(path, &status) != 0) {
+        return false;
+      }
+      record.root = entry->root;
+      mtime_of(status, record.mtime_sec, record.mtime_nsec);
+      record.file_size = uint64_t(status.st_size);
+      return true;
+    }
+
+    auto method_index(Method const *method) -> uint32_t {
+      return uint32_t(method - method->holder->methods);
+    }
+
+    /// Whether a section of \p count elements of \p element_size bytes at
+    /// \p offset is aligned and ends within the \p size bytes of the archive.
+    auto fits(uint32_t offset, uint64_t count, size_t element_size,
+              size_t size) -> bool {
+      return (offset & 7) == 0 and offset + count * element_size <= size;
+    }
+
+    /// Whether \p reference names a class of the archive, and a member of
+    /// it below the \p count field of its record.
+    auto refers_to_member(ArchivedRef reference, ArchiveHeader const &header,
+                          ArchivedClass const *records,
+                          uint16_t ArchivedClass::*count) -> bool {
+      return reference.klass != 0 and reference.klass <= header.class_count and
+             reference.member < records[reference.klass - 1].*count;
+    }
+
+    /// Whether the sections of class \p index of the archive fit in it, and
+    /// the indexes they hold point to existing classes, members and
+    /// constants. The resolved constants are checked by
+    /// \c check_resolved, once the constant tags can be read.
+    auto check_record(uint8_t const *base, size_t size,
+                      ArchiveHeader const &header, uint32_t index) -> bool {
+      auto const *records = reinterpret_cast<ArchivedClass const *>(
+        base + header.classes_offset);
+      ArchivedClass const &record = records[index];
+      if ((record.data_offset & 7) != 0 or
+          uint64_t(record.data_offset) + record.data_size > size or
+          record.super > index or
+          not fits(record.constant_offsets, record.constant_count,
+                   sizeof(uint32_t), size) or
+          not fits(record.members,
+                   uint64_t(record.field_count) + record.method_count,
+                   sizeof(MemberInfo), size) or
+          not fits(record.interfaces, record.interface_count,
+                   sizeof(uint32_t), size) or
+          not fits(record.field_offsets, record.field_count,
+                   sizeof(uint32_t), size) or
+          not fits(record.methods, record.method_count,
+                   sizeof(ArchivedMethod), size) or
+          not fits(record.vtable, record.vtable_length, sizeof(ArchivedRef),
+                   size) or
+          not fits(record.resolved, record.constant_count,
+                   sizeof(ArchivedRef), size) or
+          record.this_class >= record.constant_count) {
+        return false;
+      }
+
+      auto const *constant_offsets = reinterpret_cast<uint32_t const *>(
+        base + record.constant_offsets);
+      for (uint16_t i = 0; i < record.constant_count; ++i) {
+        if (constant_offsets[i] >= record.data_size) { return false; }
+      }
+      // Interfaces come before the classes implementing them.
+      auto const *interfaces = reinterpret_cast<uint32_t const *>(
+        base + record.interfaces);
+      for (uint16_t i = 0; i < record.interface_count; ++i) {
+        if (interfaces[i] >= index) { return false; }
+      }
+      auto const *vtable = reinterpret_cast<ArchivedRef const *>(
+        base + record.vtable);
+      for (uint32_t i = 0; i < record.vtable_length; ++i) {
+        if (not refers_to_member(vtable[i], header, records,
+                                 &ArchivedClass::method_count)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    /// Whether the resolved constants of class \p index, whose class file
+    /// is \p class_file, point to existing classes, members and symbols.
+    auto check_resolved(uint8_t const *base, ArchiveHeader const &header,
+                        uint32_t index, ClassFile const &class_file) -> bool {
+      auto const *records = reinterpret_cast<ArchivedClass const *>(
+        base + header.classes_offset);
+      ArchivedClass const &record = records[index];
+      auto const *resolved = reinterpret_cast<ArchivedRef const *>(
+        base + record.resolved);
+      for (uint16_t i = 0; i < record.constant_count; ++i) {
+        ArchivedRef reference = resolved[i];
+        bool valid = true;
+        switch (class_file.tag(i)) {
+          case ConstantTag::class_:
+            valid = reference.klass <= header.class_count;
+            break;
+          case ConstantTag::fieldref:
+            valid = reference.klass == 0 or
+                    refers_to_member(reference, header, records,
+                                     &ArchivedClass::field_count);
+            break;
+          case ConstantTag::methodref:
+          case ConstantTag::interface_methodref:
+            valid = reference.klass == 0 or
+                    refers_to_member(reference, header, records,
+                                     &ArchivedClass::method_count);
+            break;
+          case ConstantTag::string:
+            valid = reference.member <= header.symbol_count;
+            break;
+          default:
+            break;
+        }
+        if (not valid) { return false; }
+      }
+      return true;
+    }
+  } // namespace
+
+  auto describe(ArchiveStatus status) -> char const * {
+    switch (status) {
+      case ArchiveStatus::ok: return "ok";
+      case ArchiveStatus::missing: return "no archive";
+      case ArchiveStatus::bad_format: return "not a valid archive";
+      case ArchiveStatus::stale: return "archive is out of date";
+    }
+    return "unknown status";
+  }
+
+  auto SharedArchive::dump(ClassRegistry const &registry,
+                           ClassPath const &class_path,
+                           char const *class_path_string, char const *path)
+      -> bool {
+    PodVector<Klass *> archived;
+    PointerIndex class_indexes;
+    for (Klass *klass : registry.get_classes()) {
+      if (klass->is_array() or klass->state == ClassState::erroneous or
+          klass->class_file == nullptr) {
+        continue;
+      }
+      // Supers come first in the registry, so if they were left out, so is
+      // the class.
+      bool complete = klass->super == nullptr or
+                      class_indexes.find(klass->super) != 0;
+      for (uint16_t i = 0; i < klass->interface_count; ++i) {
+        complete = complete and class_indexes.find(klass->interfaces[i]) != 0;
+      }
+      if (not complete) { continue; }
+      class_indexes.insert(klass, uint32_t(archived.get_size()));
+      archived.push(klass);
+    }
+
+    Image image;
+    ArchiveHeader header {};
+    (void)image.append(&header, sizeof(header));
+
+    PodVector<char> normalized;
+    ClassPath::normalize(class_path_string, normalized);
+    header.class_path_offset = image.append(normalized.get_data(),
+                                            normalized.get_size());
+
+    PointerIndex symbol_indexes;
+    PodVector<uint32_t> symbol_offsets;
+    PodVector<ArchivedClass> records;
+    PodVector<ArchivedRef> references;
+    PodVector<uint32_t> numbers;
+    PodVector<ArchivedMethod> methods;
+    for (Klass *klass : archived) {
+      ClassFile const &class_file = *klass->class_file;
+      ArchivedClass record {};
+      if (not describe_source(class_path, klass->name, record)) {
+        return false;
+      }
+      ClassFileTables tables = class_file.tables();
+      record.data_size = uint32_t(class_file.get_size());
+      record.data_offset = image.append(class_file.get_data(),
+                                        class_file.get_size());
+      record.minor_version = tables.minor_version;
+      record.major_version = tables.major_version;
+      record.constant_count = tables.constant_count;
+      record.access_flags = tables.access_flags;
+      record.this_class = tables.this_class;
+      record.super_class = tables.super_class;
+      record.interface_count = tables.interface_count;
+      record.field_count = tables.field_count;
+      record.method_count = tables.method_count;
+      record.attribute_count = tables.attribute_count;
+      record.interfaces_offset = tables.interfaces_offset;
+      record.attributes_offset = tables.attributes_offset;
+      record.constant_offsets = image.append(
+        tables.constant_offsets, tables.constant_count * sizeof(uint32_t));
+      record.members = image.append(
+        tables.members,
+        (size_t(tables.field_count) + tables.method_count) *
+          sizeof(MemberInfo));
+
+      record.super = class_indexes.find(klass->super);
+      numbers.clear();
+      for (uint16_t i = 0; i < klass->interface_count; ++i) {
+        numbers.push(class_indexes.find(klass->interfaces[i]) - 1);
+      }
+      record.interfaces = image.append(numbers.get_data(),
+                                       numbers.get_size() * sizeof(uint32_t));
+
+      record.instance_size = klass->instance_size;
+      record.static_size = klass->static_size;
+      numbers.clear();
+      for (uint16_t i = 0; i < klass->field_count; ++i) {
+        numbers.push(klass->fields[i].offset);
+      }
+      record.field_offsets = image.append(
+        numbers.get_data(), numbers.get_size() * sizeof(uint32_t));
+
+      methods.clear();
+      for (uint16_t i = 0; i < klass->method_count; ++i) {
+        Method const &method = klass->methods[i];
+        methods.push({method.vtable_index, method.argument_slots,
+                      method.return_type, 0});
+      }
+      record.methods = image.append(
+        methods.get_data(), methods.get_size() * sizeof(ArchivedMethod));
+
+      references.clear();
+      for (uint32_t i = 0; i < klass->vtable_length; ++i) {
+        Method const *method = klass->vtable[i];
+        references.push({class_indexes.find(method->holder),
+                         method_index(method)});
+      }
+      record.vtable_length = klass->vtable_length;
+      record.vtable = image.append(
+        references.get_data(), references.get_size() * sizeof(ArchivedRef));
+
+      references.clear();
+      for (uint16_t i = 0; i < class_file.get_constant_count(); ++i) {
+        void *resolved = __atomic_load_n(&klass->resolved[i],
+                                         __ATOMIC_ACQUIRE);
+        ArchivedRef reference {};
+        if (resolved != nullptr) {
+          switch (class_file.tag(i)) {
+            case ConstantTag::class_:
+              reference.klass = class_indexes.find(resolved);
+              break;
+            case ConstantTag::fieldref: {
+              auto const *field = static_cast<Field const *>(resolved);
+              reference.klass = class_indexes.find(field->holder);
+              reference.member = uint32_t(field - field->holder->fields);
+              break;
+            }
+            case ConstantTag::methodref:
+            case ConstantTag::interface_methodref: {
+              auto const *method = static_cast<Method const *>(resolved);
+              reference.klass = class_indexes.find(method->holder);
+              reference.member = method_index(method);
+              break;
+            }
+            case ConstantTag::string: {
+              auto const *symbol = static_cast<Symbol const *>(resolved);
+              uint32_t number = symbol_indexes.find(symbol);
+              if (number == 0) {
+                symbol_indexes.insert(symbol,
+                                      uint32_t(symbol_offsets.get_size()));
+                symbol_offsets.push(image.append(
+                  symbol, Symbol::size_for(symbol->length)));
+                number = uint32_t(symbol_offsets.get_size());
+              }
+              reference.member = number;
+              break;
+            }
+            default:
+              break;
+          }
+        }
+        references.push(reference);
+      }
+      record.resolved = image.append(
+        references.get_data(), references.get_size() * sizeof(ArchivedRef));
+      records.push(record);
+    }
+
+    header.classes_offset = image.append(
+      records.get_data(), records.get_size() * sizeof(ArchivedClass));
+    header.symbols_offset = image.append(
+      symbol_offsets.get_data(), symbol_offsets.get_size() * sizeof(uint32_t));
+    memcpy(header.magic, archive_magic, sizeof(archive_magic));
+    header.header_size = sizeof(ArchiveHeader);
+    header.object_header_size = object_header_size;
+    header.class_count = uint32_t(records.get_size());
+    header.symbol_count = uint32_t(symbol_offsets.get_size());
+    header.total_size = image.get_size();
+    memcpy(image.get_data(), &header, sizeof(header));
+    return replace_file(path, image.get_data(), image.get_size());
+  }
+
+  auto SharedArchive::open(char const *path, ClassPath const &class_path,
+                           char const *class_path_string) -> ArchiveStatus {
+    if (not file.open(path)) { return ArchiveStatus::missing; }
+    auto reject = [this](ArchiveStatus status) {
+      file.close();
+      return status;
+    };
+
+    uint8_t const *base = file.get_data();
+    size_t size = file.get_size();
+    ArchiveHeader header {};
+    if (size < sizeof(header)) { return reject(ArchiveStatus::bad_format); }
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.magic, archive_magic, sizeof(archive_magic)) != 0 or
+        header.header_size != sizeof(ArchiveHeader) or
+        header.object_header_size != object_header_size or
+        header.total_size != size or header.class_path_offset >= size or
+        not fits(header.classes_offset, header.class_count,
+                 sizeof(ArchivedClass), size) or
+        not fits(header.symbols_offset, header.symbol_count,
+                 sizeof(uint32_t), size) or
+        memchr(base + header.class_path_offset, '\0',
+               size - header.class_path_offset) == nullptr) {
+      return reject(ArchiveStatus::bad_format);
+    }
+    auto const *symbol_offsets = reinterpret_cast<uint32_t const *>(
+      base + header.symbols_offset);
+    for (uint32_t i = 0; i < header.symbol_count; ++i) {
+      uint32_t offset = symbol_offsets[i];
+      if (not fits(offset, 1, sizeof(Symbol), size) or
+          offset + Symbol::size_for(
+            reinterpret_cast<Symbol const *>(base + offset)->length) > size) {
+        return reject(ArchiveStatus::bad_format);
+      }
+    }
+
+    PodVector<char> normalized;
+    ClassPath::normalize(class_path_string, normalized);
+    if (strcmp(reinterpret_cast<char const *>(base + header.class_path_offset),
+               normalized.get_data()) != 0) {
+      return reject(ArchiveStatus::stale);
+    }
+
+    auto const *records = reinterpret_cast<ArchivedClass const *>(
+      base + header.classes_offset);
+    for (uint32_t i = 0; i < header.class_count; ++i) {
+      ArchivedClass const &record = records[i];
+      if (not check_record(base, size, header, i)) {
+        return reject(ArchiveStatus::bad_format);
+      }
+      ClassFile name_only;
+      ClassFileTables tables {};
+      tables.constant_count = record.constant_count;
+      tables.constant_offsets = reinterpret_cast<uint32_t const *>(
+        base + record.constant_offsets);
+      tables.this_class = record.this_class;
+      name_only.adopt(base + record.data_offset, record.data_size, tables);
+      if (not check_resolved(base, header, i, name_only)) {
+        return reject(ArchiveStatus::bad_format);
+      }
+
+      ArchivedClass current {};
+      if (not describe_source(class_path, name_only.this_class_name(),
+                              current) or
+          current.built_in != record.built_in or current.root != record.root or
+          current.mtime_sec != record.mtime_sec or
+          current.mtime_nsec != record.mtime_nsec or
+          current.file_size != record.file_size) {
+        return reject(ArchiveStatus::stale);
+      }
+    }
+    return ArchiveStatus::ok;
+  }
+
+  auto SharedArchive::restore(ClassRegistry &registry, bool verbose) const
+      -> uint32_t {
+    uint8_t const *base = file.get_data();
+    if (base == nullptr) { return 0; }
+    ArchiveHeader header {};
+    memcpy(&header, base, sizeof(header));
+    auto const *records = reinterpret_cast<ArchivedClass const *>(
+      base + header.classes_offset);
+    auto const *symbol_offsets = reinterpret_cast<uint32_t const *>(
+      base + header.symbols_offset);
+    Arena &arena = registry.get_arena();
+
+    auto **symbols = static_cast<Symbol const **>(
+      checked_calloc(header.symbol_count + 1, sizeof(Symbol const *)));
+    for (uint32_t i = 0; i < header.symbol_count; ++i) {
+      symbols[i + 1] = registry.get_symbols().add(
+        reinterpret_cast<Symbol const *>(base + symbol_offsets[i]));
+    }
+
+    // First pass: the classes and their members, in archive order, which
+    // puts super classes and interfaces first.
+    auto **klasses = static_cast<Klass **>(
+      checked_calloc(header.class_count + 1, sizeof(Klass *)));
+    for (uint32_t i = 0; i < header.class_count; ++i) {
+      ArchivedClass const &record = records[i];
+      ClassFileTables tables {};
+      tables.minor_version = record.minor_version;
+      tables.major_version = record.major_version;
+      tables.constant_count = record.constant_count;
+      tables.access_flags = record.access_flags;
+      tables.this_class = record.this_class;
+      tables.super_class = record.super_class;
+      tables.interface_count = record.interface_count;
+      tables.field_count = record.field_count;
+      tables.method_count = record.method_count;
+      tables.attribute_count = record.attribute_count;
+      tables.interfaces_offset = record.interfaces_offset;
+      tables.attributes_offset = record.attributes_offset;
+      tables.constant_offsets = reinterpret_cast<uint32_t const *>(
+        base + record.constant_offsets);
+      tables.members = reinterpret_cast<MemberInfo const *>(
+        base + record.members);
+      // A zeroed class file is an empty one.
+      auto *class_file = arena.allocate_array<ClassFile>(1);
+      class_file->adopt(base + record.data_offset, record.data_size, tables);
+
+      Klass *klass = allocate_klass();
+      klasses[i + 1] = klass;
+      klass->name = class_file->this_class_name();
+      klass->class_file = class_file;
+      klass->access_flags = record.access_flags;
+      klass->state = ClassState::linked;
+      klass->shared = true;
+      klass->element_type = BasicType::void_;
+      klass->super = klasses[record.super];
+      klass->interface_count = record.interface_count;
+      klass->interfaces = arena.allocate_array<Klass *>(record.interface_count);
+      auto const *interfaces = reinterpret_cast<uint32_t const *>(
+        base + record.interfaces);
+      for (uint16_t j = 0; j < record.interface_count; ++j) {
+        klass->interfaces[j] = klasses[interfaces[j] + 1];
+      }
+
+      klass->instance_size = record.instance_size;
+      klass->static_size = record.static_size;
+      klass->static_storage = static_cast<uint8_t *>(
+        arena.allocate(record.static_size, 8));
+      MemberList fields = class_file->fields();
+      auto const *field_offsets = reinterpret_cast<uint32_t const *>(
+        base + record.field_offsets);
+      klass->field_count = fields.size();
+      klass->fields = arena.allocate_array<Field>(fields.size());
+      for (uint16_t j = 0; j < fields.size(); ++j) {
+        Field &field = klass->fields[j];
+        field.holder = klass;
+        field.name = class_file->name(fields[j]);
+        field.descriptor = class_file->descriptor(fields[j]);
+        field.access_flags = fields[j].access_flags;
+        field.type = basic_type_of(char(field.descriptor.bytes[0]));
+        field.offset = field_offsets[j];
+      }
+      // Super classes come first, with their offsets set already.
+      set_reference_blocks(*klass, arena);
+
+      MemberList methods = class_file->methods();
+      auto const *archived_methods = reinterpret_cast<ArchivedMethod const *>(
+        base + record.methods);
+      klass->method_count = methods.size();
+      klass->methods = arena.allocate_array<Method>(methods.size());
+      for (uint16_t j = 0; j < methods.size(); ++j) {
+        Method &method = klass->methods[j];
+        method.holder = klass;
+        method.name = class_file->name(methods[j]);
+        method.descriptor = class_file->descriptor(methods[j]);
+        method.access_flags = methods[j].access_flags;
+        method.argument_slots = archived_methods[j].argument_slots;
+        method.return_type = archived_methods[j].return_type;
+        method.vtable_index = archived_methods[j].vtable_index;
+        method.code = class_file->code(methods[j]);
+      }
+      klass->resolved = arena.allocate_array<void *>(record.constant_count);
+      registry.add(klass, class_file);
+      if (verbose) {
+        printf("[Loaded %.*s from shared objects file]\n",
+               int(klass->name.length),
+               reinterpret_cast<char const *>(klass->name.bytes));
+      }
+    }
+
+    // Second pass: vtables and resolved references, which may point to any
+    // class.
+    for (uint32_t i = 0; i < header.class_count; ++i) {
+      ArchivedClass const &record = records[i];
+      Klass *klass = klasses[i + 1];
+      auto const *vtable = reinterpret_cast<ArchivedRef const *>(
+        base + record.vtable);
+      klass->vtable_length = record.vtable_length;
+      klass->vtable = arena.allocate_array<Method *>(record.vtable_length);
+      for (uint32_t j = 0; j < record.vtable_length; ++j) {
+        klass->vtable[j] = &klasses[vtable[j].klass]->methods[vtable[j].member];
+      }
+
+      ClassFile const &class_file = *klass->class_file;
+      auto const *resolved = reinterpret_cast<ArchivedRef const *>(
+        base + record.resolved);
+      for (uint16_t j = 0; j < record.constant_count; ++j) {
+        ArchivedRef reference = resolved[j];
+        void *value = nullptr;
+        switch (class_file.tag(j)) {
+          case ConstantTag::class_:
+            value = klasses[reference.klass];
+            break;
+          case ConstantTag::fieldref:
+            if (reference.klass != 0) {
+              value = &klasses[reference.klass]->fields[reference.member];
+            }
+            break;
+          case ConstantTag::methodref:
+          case ConstantTag::interface_methodref:
+            if (reference.klass != 0) {
+              value = &klasses[reference.klass]->methods[reference.member];
+            }
+            break;
+          case ConstantTag::string:
+            value = const_cast<Symbol *>(symbols[reference.member]);
+            break;
+          default:
+            break;
+        }
+        klass->resolved[j] = value;
+      }
+    }
+    free(static_cast<void *>(klasses));
+    free(static_cast<void *>(symbols));
+    return header.class_count;
+  }
+} // namespace skjvm
@@ -0,0 +1,510 @@
+#include <skjvm/stack_map.hpp>
+
+#include <skjvm/descriptor.hpp>
+
+#include <string.h>
+
+namespace skjvm {
+  namespace {
+    /// \brief What an instruction does to the operand stack, apart from
+    /// those moving slots around: it pops \c popped slots, then pushes
+    /// \c pushed, a reference if \c reference is set.
+    struct StackEffect {
+      uint8_t popped;
+      uint8_t pushed;
+      bool reference;
+    };
+
+    /// Slots of the field or return type \p descriptor starts with.
+    auto slots_of(char first) -> uint8_t {
+      if (first == 'V') { return 0; }
+      return first == 'J' or first == 'D' ? 2 : 1;
+    }
+
+    auto is_reference_type(char first) -> bool {
+      return first == 'L' or first == '[';
+    }
+
+    auto is_branch(Opcode opcode) -> bool {
+      return (opcode >= Opcode::ifeq and opcode <= Opcode::goto_) or
+             opcode == Opcode::ifnull or opcode == Opcode::ifnonnull;
+    }
+
+    /// Whether execution never continues with the next instruction.
+    auto ends_flow(Opcode opcode) -> bool {
+      switch (opcode) {
+        case Opcode::goto_:
+        case Opcode::tableswitch:
+        case Opcode::lookupswitch:
+        case Opcode::ireturn:
+        case Opcode::lreturn:
+        case Opcode::freturn:
+        case Opcode::dreturn:
+        case Opcode::areturn:
+        case Opcode::return_:
+        case Opcode::athrow:
+          return true;
+        default:
+          return false;
+      }
+    }
+
+    /// \brief Follows the stack maps through one decoded method, see
+    /// \c compute_stack_maps.
+    class StackMapper {
+      Method const &method;
+      DecodedMethod &decoded;
+      ClassFile const &class_file;
+      uint32_t const words;
+
+      /// The map of the instruction being followed, as it changes.
+      uint64_t *state;
+      uint32_t depth {0};
+
+      PodVector<uint32_t> pending {};
+
+      [[nodiscard]]
+      auto get(uint32_t slot) const -> bool {
+        return ((state[slot / 64] >> (slot % 64)) & 1) != 0;
+      }
+
+      auto set(uint32_t slot, bool reference) -> void {
+        uint64_t bit = uint64_t(1) << (slot % 64);
+        if (reference) {
+          state[slot / 64] |= bit;
+        } else {
+          state[slot / 64] &= ~bit;
+        }
+      }
+
+      [[nodiscard]]
+      auto push(bool reference) -> bool {
+        if (depth >= decoded.max_stack) { return false; }
+        set(decoded.max_locals + depth++, reference);
+        return true;
+      }
+
+      [[nodiscard]]
+      auto pop(uint32_t count) -> bool {
+        if (depth < count) { return false; }
+        depth -= count;
+        return true;
+      }
+
+      [[nodiscard]]
+      auto index_of(Instruction const *instruction) const -> uint32_t {
+        return uint32_t(instruction - decoded.code);
+      }
+
+      [[nodiscard]]
+      auto effect(Instruction const &instruction, StackEffect &result) const
+        -> bool;
+
+      [[nodiscard]]
+      auto shuffle(uint32_t popped, char const *pushed) -> bool;
+
+      [[nodiscard]]
+      auto step(uint32_t i) -> bool;
+
+      [[nodiscard]]
+      auto merge(uint32_t i) -> bool;
+
+     public:
+      StackMapper(Method const &method, DecodedMethod &decoded) noexcept
+        : method(method), decoded(decoded),
+          class_file(*method.holder->class_file),
+          words(decoded.map_words),
+          state(static_cast<uint64_t *>(
+            checked_malloc(sizeof(uint64_t) * decoded.map_words))) {}
+      StackMapper(StackMapper const&) = delete;
+      auto operator=(StackMapper const&) -> StackMapper & = delete;
+      ~StackMapper() noexcept {
+        free(state);
+      }
+
+      [[nodiscard]]
+      auto compute() -> bool;
+    };
+
+    auto StackMapper::effect(Instruction const &instruction,
+                             StackEffect &result) const -> bool {
+      auto set = [&](unsigned popped, unsigned pushed,
+                     bool reference = false) {
+        result = {uint8_t(popped), uint8_t(pushed), reference};
+        return true;
+      };
+      switch (instruction.opcode) {
+        case Opcode::nop:
+        case Opcode::iinc:
+        case Opcode::goto_:
+        case Opcode::return_:
+          return set(0, 0);
+        case Opcode::sipush:
+        case Opcode::fconst_0:
+        case Opcode::iload:
+        case Opcode::fload:
+          return set(0, 1);
+        case Opcode::aconst_null:
+        case Opcode::ldc:
+        case Opcode::new_:
+          return set(0, 1, true);
+        case Opcode::lconst_0:
+        case Opcode::dconst_0:
+        case Opcode::lload:
+        case Opcode::dload:
+          return set(0, 2);
+        case Opcode::pop:
+        case Opcode::ifeq:
+        case Opcode::ifne:
+        case Opcode::iflt:
+        case Opcode::ifge:
+        case Opcode::ifgt:
+        case Opcode::ifle:
+        case Opcode::ifnull:
+        case Opcode::ifnonnull:
+        case Opcode::tableswitch:
+        case Opcode::lookupswitch:
+        case Opcode::monitorenter:
+        case Opcode::monitorexit:
+        case Opcode::ireturn:
+        case Opcode::freturn:
+        case Opcode::areturn:
+        case Opcode::athrow:
+          return set(1, 0);
+        case Opcode::pop2:
+        case Opcode::if_icmpeq:
+        case Opcode::if_icmpne:
+        case Opcode::if_icmplt:
+        case Opcode::if_icmpge:
+        case Opcode::if_icmpgt:
+        case Opcode::if_icmple:
+        case Opcode::if_acmpeq:
+        case Opcode::if_acmpne:
+        case Opcode::lreturn:
+        case Opcode::dreturn:
+          return set(2, 0);
+        case Opcode::iaload:
+        case Opcode::faload:
+        case Opcode::baload:
+        case Opcode::caload:
+        case Opcode::saload:
+          return set(2, 1);
+        case Opcode::aaload:
+          return set(2, 1, true);
+        case Opcode::laload:
+        case Opcode::daload:
+          return set(2, 2);
+        case Opcode::iastore:
+        case Opcode::fastore:
+        case Opcode::aastore:
+        case Opcode::bastore:
+        case Opcode::castore:
+        case Opcode::sastore:
+          return set(3, 0);
+        case Opcode::lastore:
+        case Opcode::dastore:
+          return set(4, 0);
+        case Opcode::iadd:
+        case Opcode::isub:
+        case Opcode::imul:
+        case Opcode::idiv:
+        case Opcode::irem:
+        case Opcode::iand:
+        case Opcode::ior:
+        case Opcode::ixor:
+        case Opcode::ishl:
+        case Opcode::ishr:
+        case Opcode::iushr:
+        case Opcode::fadd:
+        case Opcode::fsub:
+        case Opcode::fmul:
+        case Opcode::fdiv:
+        case Opcode::frem:
+        case Opcode::fcmpl:
+        case Opcode::fcmpg:
+        case Opcode::l2i:
+        case Opcode::l2f:
+        case Opcode::d2i:
+        case Opcode::d2f:
+          return set(2, 1);
+        case Opcode::ladd:
+        case Opcode::lsub:
+        case Opcode::lmul:
+        case Opcode::ldiv:
+        case Opcode::lrem:
+        case Opcode::land:
+        case Opcode::lor:
+        case Opcode::lxor:
+        case Opcode::dadd:
+        case Opcode::dsub:
+        case Opcode::dmul:
+        case Opcode::ddiv:
+        case Opcode::drem:
+          return set(4, 2);
+        case Opcode::lshl:
+        case Opcode::lshr:
+        case Opcode::lushr:
+          return set(3, 2);
+        case Opcode::ineg:
+        case Opcode::fneg:
+        case Opcode::i2f:
+        case Opcode::f2i:
+        case Opcode::i2b:
+        case Opcode::i2c:
+        case Opcode::i2s:
+        case Opcode::arraylength:
+        case Opcode::instanceof:
+          return set(1, 1);
+        case Opcode::newarray:
+        case Opcode::anewarray:
+          return set(1, 1, true);
+        case Opcode::lneg:
+        case Opcode::dneg:
+        case Opcode::l2d:
+        case Opcode::d2l:
+          return set(2, 2);
+        case Opcode::i2l:
+        case Opcode::i2d:
+        case Opcode::f2l:
+        case Opcode::f2d:
+          return set(1, 2);
+        case Opcode::lcmp:
+        case Opcode::dcmpl:
+        case Opcode::dcmpg:
+          return set(4, 1);
+        case Opcode::multianewarray:
+          return set(instruction.count, 1, true);
+
+        case Opcode::getstatic:
+        case Opcode::putstatic:
+        case Opcode::getfield:
+        case Opcode::putfield: {
+          Utf8View descriptor = class_file.member_ref(
+            instruction.index).descriptor;
+          if (descriptor.length == 0 or
+              field_type_length(descriptor, 0) != descriptor.length) {
+            return false;
+          }
+          auto first = char(descriptor.bytes[0]);
+          uint8_t slots = slots_of(first);
+          switch (instruction.opcode) {
+            case Opcode::getstatic:
+              return set(0, slots, is_reference_type(first));
+            case Opcode::putstatic:
+              return set(slots, 0);
+            case Opcode::getfield:
+              return set(1, slots, is_reference_type(first));
+            default:
+              return set(slots + 1u, 0);
+          }
+        }
+        case Opcode::invokevirtual:
+        case Opcode::invokespecial:
+        case Opcode::invokestatic:
+        case Opcode::invokeinterface: {
+          Utf8View descriptor = class_file.member_ref(
+            instruction.index).descriptor;
+          int parameters = parameter_slots(descriptor);
+          char returned = return_type(descriptor);
+          if (parameters < 0 or returned == 0) { return false; }
+          unsigned receiver =
+            instruction.opcode == Opcode::invokestatic ? 0 : 1;
+          return set(unsigned(parameters) + receiver, slots_of(returned),
+                     is_reference_type(returned));
+        }
+
+        default:
+          // `invokedynamic`, and what the interpreter does not support.
+          return false;
+      }
+    }
+
+    /// Pop \p popped slots and push them again in the order of \p pushed,
+    /// where \c 'a' is the top slot popped, \c 'b' the one below, and so
+    /// on: the \c dup instructions and \c swap.
+    auto StackMapper::shuffle(uint32_t popped, char const *pushed) -> bool {
+      if (depth < popped) { return false; }
+      bool slots[4] {};
+      for (uint32_t k = 0; k < popped; ++k) {
+        slots[k] = get(decoded.max_locals + depth - 1 - k);
+      }
+      depth -= popped;
+      for (; *pushed != '\0'; ++pushed) {
+        if (not push(slots[*pushed - 'a'])) { return false; }
+      }
+      return true;
+    }
+
+    /// Apply instruction \p i to \c state, and merge the result into its
+    /// successors.
+    auto StackMapper::step(uint32_t i) -> bool {
+      Instruction const &instruction = decoded.code[i];
+      uint32_t const local = instruction.index;
+      bool known = true;
+      switch (instruction.opcode) {
+        case Opcode::aload:
+          if (not push(get(local))) { return false; }
+          break;
+        case Opcode::istore:
+        case Opcode::fstore:
+        case Opcode::astore:
+          if (not pop(1)) { return false; }
+          set(local, instruction.opcode == Opcode::astore and
+                     get(decoded.max_locals + depth));
+          break;
+        case Opcode::lstore:
+        case Opcode::dstore:
+          if (local + 1 >= decoded.max_locals or not pop(2)) {
+            return false;
+          }
+          set(local, false);
+          set(local + 1, false);
+          break;
+        case Opcode::checkcast:
+          if (depth < 1) { return false; }
+          break;
+        case Opcode::dup:
+          if (not shuffle(1, "aa")) { return false; }
+          break;
+        case Opcode::dup_x1:
+          if (not shuffle(2, "aba")) { return false; }
+          break;
+        case Opcode::dup_x2:
+          if (not shuffle(3, "acba")) { return false; }
+          break;
+        case Opcode::dup2:
+          if (not shuffle(2, "baba")) { return false; }
+          break;
+        case Opcode::dup2_x1:
+          if (not shuffle(3, "bacba")) { return false; }
+          break;
+        case Opcode::dup2_x2:
+          if (not shuffle(4, "badcba")) { return false; }
+          break;
+        case Opcode::swap:
+          if (not shuffle(2, "ab")) { return false; }
+          break;
+        default: {
+          StackEffect change {};
+          known = effect(instruction, change);
+          if (not known) { break; }
+          if (not pop(change.popped)) { return false; }
+          for (uint8_t k = 0; k < change.pushed; ++k) {
+            if (not push(change.reference and k + 1 == change.pushed)) {
+              return false;
+            }
+          }
+          break;
+        }
+      }
+      // Nothing continues after an instruction that can only throw.
+      if (not known) { return true; }
+
+      Opcode const opcode = instruction.opcode;
+      if (is_branch(opcode) and not merge(index_of(instruction.target))) {
+        return false;
+      }
+      if (opcode == Opcode::tableswitch or opcode == Opcode::lookupswitch) {
+        SwitchTable const &table = *instruction.table;
+        if (not merge(index_of(table.default_target))) { return false; }
+        for (uint32_t k = 0; k < table.count; ++k) {
+          if (not merge(index_of(table.targets[k]))) { return false; }
+        }
+      }
+      return ends_flow(opcode) or merge(i + 1);
+    }
+
+    /// Merge \c state into the map of instruction \p i, following it again
+    /// if that changed it.
+    auto StackMapper::merge(uint32_t i) -> bool {
+      if (i >= decoded.length) { return false; }
+      // Slots above the stack hold nothing.
+      for (uint32_t slot = decoded.max_locals + depth;
+           slot < uint32_t(decoded.max_locals) + decoded.max_stack; ++slot) {
+        set(slot, false);
+      }
+      uint64_t *map = decoded.references + size_t(i) * words;
+      if (decoded.depths[i] == UINT16_MAX) {
+        decoded.depths[i] = uint16_t(depth);
+        memcpy(map, state, sizeof(uint64_t) * words);
+        pending.push(i);
+        return true;
+      }
+      if (decoded.depths[i] != depth) { return false; }
+      bool changed = false;
+      for (uint32_t k = 0; k < words; ++k) {
+        uint64_t merged = map[k] & state[k];
+        changed = changed or merged != map[k];
+        map[k] = merged;
+      }
+      if (changed) { pending.push(i); }
+      return true;
+    }
+
+    auto StackMapper::compute() -> bool {
+      // The receiver and the parameters.
+      memset(state, 0, sizeof(uint64_t) * words);
+      uint32_t local = 0;
+      if (not method.is_static()) { set(local++, true); }
+      Utf8View descriptor = method.descriptor;
+      for (uint16_t position = 1;
+           position < descriptor.length and descriptor.bytes[position] != ')';) {
+        uint16_t length = field_type_length(descriptor, position);
+        if (length == 0) { return false; }
+        auto first = char(descriptor.bytes[position]);
+        if (local >= decoded.max_locals) { return false; }
+        set(local, is_reference_type(first));
+        local += slots_of(first);
+        position = uint16_t(position + length);
+      }
+      depth = 0;
+      if (not merge(0)) { return false; }
+
+      // Follow the branches, then the exception edges, until nothing
+      // changes: a handler starts with the locals of every instruction it
+      // covers merged, since any of them may throw.
+      bool changed = true;
+      while (changed) {
+        while (not pending.is_empty()) {
+          uint32_t i = pending.pop();
+          memcpy(state, decoded.references + size_t(i) * words,
+                 sizeof(uint64_t) * words);
+          depth = decoded.depths[i];
+          if (not step(i)) { return false; }
+        }
+        for (uint16_t h = 0; h < decoded.handler_count; ++h) {
+          DecodedHandler const &handler = decoded.handlers[h];
+          bool reached = false;
+          for (uint32_t i = index_of(handler.start);
+               i < index_of(handler.end); ++i) {
+            if (decoded.depths[i] == UINT16_MAX) { continue; }
+            uint64_t const *map = decoded.references + size_t(i) * words;
+            for (uint32_t k = 0; k < words; ++k) {
+              state[k] = reached ? state[k] & map[k] : map[k];
+            }
+            reached = true;
+          }
+          if (not reached) { continue; }
+          depth = 0;
+          if (not push(true) or not merge(index_of(handler.target))) {
+            return false;
+          }
+        }
+        changed = not pending.is_empty();
+      }
+      return true;
+    }
+  } // namespace
+
+  auto compute_stack_maps(Method const &method, DecodedMethod &decoded,
+                          Arena &arena) -> bool {
+    uint32_t slots = uint32_t(decoded.max_locals) + decoded.max_stack;
+    decoded.map_words = slots == 0 ? 1 : (slots + 63) / 64;
+    decoded.depths = arena.allocate_array<uint16_t>(decoded.length);
+    memset(decoded.depths, 0xff, sizeof(uint16_t) * decoded.length);
+    decoded.references = arena.allocate_array<uint64_t>(
+      size_t(decoded.length) * decoded.map_words);
+    StackMapper mapper(method, decoded);
+    return mapper.compute();
+  }
+} // namespace skjvm
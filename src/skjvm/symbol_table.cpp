@@ -0,0 +1,240 @@
+#include <skjvm/symbol_table.hpp>
+
+#include <string.h>
+
+namespace skjvm {
+  namespace {
+    class MutexGuard {
+      pthread_mutex_t &mutex;
+
+     public:
+      explicit MutexGuard(pthread_mutex_t &mutex) noexcept : mutex(mutex) {
+        pthread_mutex_lock(&mutex);
+      }
+      MutexGuard(MutexGuard const&) = delete;
+      auto operator=(MutexGuard const&) -> MutexGuard & = delete;
+      ~MutexGuard() noexcept {
+        pthread_mutex_unlock(&mutex);
+      }
+    };
+
+    /// Slots of the first table. Tables grow once half full.
+    constexpr uint32_t initial_capacity = 256;
+  } // namespace
+
+  SymbolTable::~SymbolTable() noexcept {
+    free(current);
+    free(previous);
+    while (retired != nullptr) {
+      Table *next = retired->retired;
+      free(retired);
+      retired = next;
+    }
+    pthread_mutex_destroy(&mutex);
+  }
+
+  auto SymbolTable::allocate_table(uint32_t capacity) -> Table * {
+    auto *table = static_cast<Table *>(
+      checked_calloc(1, sizeof(Table) + sizeof(Entry) * capacity));
+    table->capacity = capacity;
+    return table;
+  }
+
+  auto SymbolTable::find(Table *table, Utf8View bytes, uint32_t hash)
+      -> Entry * {
+    if (table == nullptr) { return nullptr; }
+    Entry *entries = table->entries();
+    uint32_t mask = table->capacity - 1;
+    for (uint32_t slot = hash & mask;; slot = (slot + 1) & mask) {
+      Symbol const *symbol = __atomic_load_n(&entries[slot].symbol,
+                                             __ATOMIC_ACQUIRE);
+      if (symbol == nullptr) { return nullptr; }
+      if (symbol->hash == hash and symbol->view().equals(bytes)) {
+        return &entries[slot];
+      }
+    }
+  }
+
+  auto SymbolTable::find(Table *table, Symbol const *symbol) -> Entry * {
+    if (table == nullptr) { return nullptr; }
+    Entry *entries = table->entries();
+    uint32_t mask = table->capacity - 1;
+    for (uint32_t slot = symbol->hash & mask;; slot = (slot + 1) & mask) {
+      Symbol const *found = __atomic_load_n(&entries[slot].symbol,
+                                            __ATOMIC_ACQUIRE);
+      if (found == nullptr) { return nullptr; }
+      if (found == symbol) { return &entries[slot]; }
+    }
+  }
+
+  /// Fill the first empty slot for \p entry, publishing it last.
+  auto SymbolTable::place(Table &table, Entry entry) -> Entry * {
+    Entry *entries = table.entries();
+    uint32_t mask = table.capacity - 1;
+    uint32_t slot = entry.symbol->hash & mask;
+    while (entries[slot].symbol != nullptr) { slot = (slot + 1) & mask; }
+    entries[slot].string = entry.string;
+    __atomic_store_n(&entries[slot].symbol, entry.symbol, __ATOMIC_RELEASE);
+    return &entries[slot];
+  }
+
+  /// Search the current table, then the previous one. \c previous is
+  /// published before \c current, so a reader that sees a table sees the
+  /// one it replaced, or none once that one was migrated.
+  auto SymbolTable::search(Utf8View bytes, uint32_t hash) const -> Entry * {
+    Table *table = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+    Table *older = __atomic_load_n(&previous, __ATOMIC_ACQUIRE);
+    Entry *entry = find(table, bytes, hash);
+    if (entry == nullptr and older != table) {
+      entry = find(older, bytes, hash);
+    }
+    return entry;
+  }
+
+  auto SymbolTable::search(Symbol const *symbol) const -> Entry * {
+    Table *table = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+    Table *older = __atomic_load_n(&previous, __ATOMIC_ACQUIRE);
+    Entry *entry = find(table, symbol);
+    if (entry == nullptr and older != table) { entry = find(older, symbol); }
+    return entry;
+  }
+
+  /// Move the next \p slots slots of \c previous to \c current, and retire
+  /// it once it is empty.
+  auto SymbolTable::migrate_locked(uint32_t slots) -> void {
+    Entry *entries = previous->entries();
+    uint32_t end = previous->capacity - migrated < slots
+      ? previous->capacity
+      : migrated + slots;
+    for (; migrated < end; ++migrated) {
+      Entry entry = entries[migrated];
+      // Copied ahead by set_string.
+      if (entry.symbol != nullptr and find(current, entry.symbol) == nullptr) {
+        place(*current, entry);
+      }
+    }
+    if (migrated < previous->capacity) { return; }
+
+    Table *done = previous;
+    __atomic_store_n(&previous, nullptr, __ATOMIC_RELEASE);
+    // Only the current table is a root from now on: readers still probing
+    // this one find no string, and ask again under the lock.
+    for (uint32_t i = 0; i < done->capacity; ++i) {
+      __atomic_store_n(&entries[i].string, nullptr, __ATOMIC_RELAXED);
+    }
+    done->retired = retired;
+    retired = done;
+  }
+
+  auto SymbolTable::insert_locked(Symbol const *symbol) -> Entry * {
+    if (previous != nullptr) { migrate_locked(migration_step); }
+    if (current == nullptr or (count + 1) * 2 > current->capacity) {
+      // The step outpaces the insertions that fill the table, but a table
+      // grown from a small one may not be migrated yet.
+      if (previous != nullptr) { migrate_locked(previous->capacity); }
+      Table *grown = allocate_table(current == nullptr
+                                    ? initial_capacity
+                                    : current->capacity * 2);
+      if (current != nullptr) {
+        migrated = 0;
+        __atomic_store_n(&previous, current, __ATOMIC_RELEASE);
+      }
+      __atomic_store_n(&current, grown, __ATOMIC_RELEASE);
+    }
+    Entry *entry = place(*current, {symbol, nullptr});
+    __atomic_store_n(&count, count + 1, __ATOMIC_RELAXED);
+    return entry;
+  }
+
+  auto SymbolTable::intern(Utf8View bytes) -> Symbol const * {
+    uint32_t hash = bytes.hash();
+    if (Entry *entry = search(bytes, hash)) { return entry->symbol; }
+
+    MutexGuard guard(mutex);
+    if (Entry *entry = search(bytes, hash)) { return entry->symbol; }
+    auto *created = static_cast<Symbol *>(
+      arena.allocate(Symbol::size_for(bytes.length)));
+    created->hash = hash;
+    created->length = bytes.length;
+    if (bytes.length != 0) {
+      memcpy(const_cast<uint8_t *>(created->bytes()), bytes.bytes,
+             bytes.length);
+    }
+    insert_locked(created);
+    return created;
+  }
+
+  auto SymbolTable::lookup(Utf8View bytes) const -> Symbol const * {
+    Entry *entry = search(bytes, bytes.hash());
+    return entry != nullptr ? entry->symbol : nullptr;
+  }
+
+  auto SymbolTable::add(Symbol const *symbol) -> Symbol const * {
+    MutexGuard guard(mutex);
+    if (Entry *entry = search(symbol->view(), symbol->hash)) {
+      return entry->symbol;
+    }
+    insert_locked(symbol);
+    return symbol;
+  }
+
+  auto SymbolTable::find_string(Symbol const *symbol) const -> Object * {
+    Entry *entry = search(symbol);
+    return entry != nullptr
+      ? __atomic_load_n(&entry->string, __ATOMIC_ACQUIRE)
+      : nullptr;
+  }
+
+  auto SymbolTable::set_string(Symbol const *symbol, Object *string)
+      -> Object * {
+    MutexGuard guard(mutex);
+    Entry *entry = find(current, symbol);
+    if (entry == nullptr) {
+      Entry *older = find(previous, symbol);
+      if (older != nullptr and older->string != nullptr) {
+        return older->string;
+      }
+      // Strings are only set in the current table, so the slot migrated
+      // later is skipped.
+      entry = older != nullptr ? place(*current, {symbol, nullptr})
+                               : insert_locked(symbol);
+    }
+    if (entry->string == nullptr) {
+      __atomic_store_n(&entry->string, string, __ATOMIC_RELEASE);
+    }
+    return entry->string;
+  }
+
+  auto SymbolTable::add_weak_roots(PodVector<Object **> &roots) -> void {
+    MutexGuard guard(mutex);
+    Table *tables[] = {current, previous};
+    for (Table *table : tables) {
+      if (table == nullptr) { continue; }
+      Entry *entries = table->entries();
+      for (uint32_t i = 0; i < table->capacity; ++i) {
+        if (entries[i].string != nullptr) { roots.push(&entries[i].string); }
+      }
+    }
+  }
+
+  auto SymbolTable::clear_strings() -> void {
+    MutexGuard guard(mutex);
+    Table *tables[] = {current, previous};
+    for (Table *table : tables) {
+      if (table == nullptr) { continue; }
+      Entry *entries = table->entries();
+      for (uint32_t i = 0; i < table->capacity; ++i) {
+        entries[i].string = nullptr;
+      }
+    }
+  }
+
+  auto SymbolTable::get_count() const -> uint32_t {
+    return __atomic_load_n(&count, __ATOMIC_RELAXED);
+  }
+
+  auto SymbolTable::get_capacity() const -> uint32_t {
+    Table *table = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+    return table != nullptr ? table->capacity : 0;
+  }
+} // namespace skjvm
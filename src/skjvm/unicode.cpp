@@ -0,0 +1,733 @@
+#include <skjvm/unicode.hpp>
+
+/// The vector kernels are written for x86-64, which always has SSE2.
+#if defined(__x86_64__)
+#define SKJVM_UNICODE_SIMD 1
+#include <cpuid.h>
+#include <immintrin.h>
+#else
+#define SKJVM_UNICODE_SIMD 0
+#endif
+
+namespace skjvm {
+  namespace {
+    /// \brief The vector loops of the transcoders for one instruction set.
+    /// Each converts whole blocks from the start of its input while they
+    /// only hold the characters it is for, and returns how many units of
+    /// input it took; the scalar loops go on from there. An output that is
+    /// \c nullptr is not written, only checked.
+    struct Kernels {
+      /// Sequences of UTF-8, or of modified UTF-8 with \p modified, into
+      /// UTF-16, counted in \p units. SSE2 only takes ASCII, AVX2 2-byte
+      /// sequences too.
+      auto (*decode)(uint8_t const *bytes, uint32_t length, uint16_t *out,
+                     bool modified, uint32_t &units) -> uint32_t;
+      /// Code units into UTF-8, or modified UTF-8, counted in \p size.
+      /// SSE2 only takes those below U+0080, AVX2 those below U+0800.
+      auto (*encode)(uint16_t const *chars, uint32_t length, uint8_t *out,
+                     bool modified, size_t &size) -> uint32_t;
+      /// ASCII bytes, copied.
+      auto (*copy_ascii)(uint8_t const *bytes, uint32_t length,
+                         uint8_t *out) -> uint32_t;
+      /// Code units below U+0100.
+      auto (*narrow_latin1)(uint16_t const *chars, uint32_t length,
+                            uint8_t *out) -> uint32_t;
+      /// Any byte.
+      auto (*widen_latin1)(uint8_t const *bytes, uint32_t length,
+                           uint16_t *out) -> uint32_t;
+    };
+
+    /// The scalar loops do everything.
+    constexpr Kernels scalar_kernels {
+      [](uint8_t const *, uint32_t, uint16_t *, bool, uint32_t &) {
+        return 0u;
+      },
+      [](uint16_t const *, uint32_t, uint8_t *, bool, size_t &) {
+        return 0u;
+      },
+      [](uint8_t const *, uint32_t, uint8_t *) { return 0u; },
+      [](uint16_t const *, uint32_t, uint8_t *) { return 0u; },
+      [](uint8_t const *, uint32_t, uint16_t *) { return 0u; },
+    };
+
+#if SKJVM_UNICODE_SIMD
+    auto load(void const *address) -> __m128i {
+      return _mm_loadu_si128(static_cast<__m128i const *>(address));
+    }
+
+    auto store(void *address, __m128i value) -> void {
+      _mm_storeu_si128(static_cast<__m128i *>(address), value);
+    }
+
+    auto sse2_decode(uint8_t const *bytes, uint32_t length, uint16_t *out,
+                     bool modified, uint32_t &units) -> uint32_t {
+      __m128i const zero = _mm_setzero_si128();
+      uint32_t i = 0;
+      for (; length - i >= 16; i += 16) {
+        __m128i block = load(bytes + i);
+        int rejected = _mm_movemask_epi8(block);
+        if (modified) {
+          rejected |= _mm_movemask_epi8(_mm_cmpeq_epi8(block, zero));
+        }
+        if (rejected != 0) { break; }
+        if (out != nullptr) {
+          store(out + i, _mm_unpacklo_epi8(block, zero));
+          store(out + i + 8, _mm_unpackhi_epi8(block, zero));
+        }
+      }
+      units = i;
+      return i;
+    }
+
+    /// The units of \p low and \p high with bits of \p mask set, or equal
+    /// to 0 with \p nul, as a bit mask.
+    auto sse2_reject(__m128i low, __m128i high, __m128i mask, bool nul)
+        -> int {
+      __m128i const zero = _mm_setzero_si128();
+      __m128i any = _mm_and_si128(_mm_or_si128(low, high), mask);
+      int rejected = _mm_movemask_epi8(_mm_cmpeq_epi16(any, zero)) ^ 0xffff;
+      if (nul) {
+        rejected |= _mm_movemask_epi8(_mm_or_si128(
+          _mm_cmpeq_epi16(low, zero), _mm_cmpeq_epi16(high, zero)));
+      }
+      return rejected;
+    }
+
+    auto sse2_encode(uint16_t const *chars, uint32_t length, uint8_t *out,
+                     bool modified, size_t &size) -> uint32_t {
+      __m128i const mask = _mm_set1_epi16(int16_t(0xff80));
+      uint32_t i = 0;
+      for (; length - i >= 16; i += 16) {
+        __m128i low = load(chars + i);
+        __m128i high = load(chars + i + 8);
+        if (sse2_reject(low, high, mask, modified) != 0) { break; }
+        if (out != nullptr) { store(out + i, _mm_packus_epi16(low, high)); }
+      }
+      size = i;
+      return i;
+    }
+
+    auto sse2_copy_ascii(uint8_t const *bytes, uint32_t length, uint8_t *out)
+        -> uint32_t {
+      uint32_t i = 0;
+      for (; length - i >= 16; i += 16) {
+        __m128i block = load(bytes + i);
+        if (_mm_movemask_epi8(block) != 0) { break; }
+        if (out != nullptr) { store(out + i, block); }
+      }
+      return i;
+    }
+
+    auto sse2_narrow_latin1(uint16_t const *chars, uint32_t length,
+                            uint8_t *out) -> uint32_t {
+      __m128i const mask = _mm_set1_epi16(int16_t(0xff00));
+      uint32_t i = 0;
+      for (; length - i >= 16; i += 16) {
+        __m128i low = load(chars + i);
+        __m128i high = load(chars + i + 8);
+        if (sse2_reject(low, high, mask, false) != 0) { break; }
+        if (out != nullptr) { store(out + i, _mm_packus_epi16(low, high)); }
+      }
+      return i;
+    }
+
+    auto sse2_widen_latin1(uint8_t const *bytes, uint32_t length,
+                           uint16_t *out) -> uint32_t {
+      __m128i const zero = _mm_setzero_si128();
+      uint32_t i = 0;
+      for (; length - i >= 16; i += 16) {
+        __m128i block = load(bytes + i);
+        store(out + i, _mm_unpacklo_epi8(block, zero));
+        store(out + i + 8, _mm_unpackhi_epi8(block, zero));
+      }
+      return i;
+    }
+
+    constexpr Kernels sse2_kernels {
+      &sse2_decode, &sse2_encode, &sse2_copy_ascii,
+      &sse2_narrow_latin1, &sse2_widen_latin1,
+    };
+
+#define SKJVM_AVX2 __attribute__((target("avx2")))
+
+    SKJVM_AVX2
+    auto load256(void const *address) -> __m256i {
+      return _mm256_loadu_si256(static_cast<__m256i const *>(address));
+    }
+
+    SKJVM_AVX2
+    auto store256(void *address, __m256i value) -> void {
+      _mm256_storeu_si256(static_cast<__m256i *>(address), value);
+    }
+
+    /// Whether \p low and \p high have bits of \p mask set, or units equal
+    /// to 0 with \p nul.
+    SKJVM_AVX2
+    auto avx2_reject(__m256i low, __m256i high, __m256i mask, bool nul)
+        -> bool {
+      if (_mm256_testz_si256(_mm256_or_si256(low, high), mask) == 0) {
+        return true;
+      }
+      if (not nul) { return false; }
+      __m256i const zero = _mm256_setzero_si256();
+      return _mm256_movemask_epi8(_mm256_or_si256(
+               _mm256_cmpeq_epi16(low, zero),
+               _mm256_cmpeq_epi16(high, zero))) != 0;
+    }
+
+    /// The units of \p low then \p high, all below U+0100, as bytes.
+    /// Packing works within each 128-bit lane, so the quarters are put
+    /// back in order.
+    SKJVM_AVX2
+    auto avx2_pack(__m256i low, __m256i high) -> __m256i {
+      return _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high),
+                                      0xd8);
+    }
+
+    /// Shuffles for \c _mm_shuffle_epi8 by a mask of 8 bits: \c words
+    /// keeps the 16-bit lanes whose bit is set, \c pairs the low byte of
+    /// each lane and the high one if its bit is set. Lanes not filled are
+    /// zeroed.
+    struct Shuffles {
+      uint8_t words[256][16];
+      uint8_t pairs[256][16];
+    };
+
+    constexpr auto make_shuffles() -> Shuffles {
+      Shuffles shuffles {};
+      for (uint32_t mask = 0; mask < 256; ++mask) {
+        uint32_t word = 0;
+        uint32_t pair = 0;
+        for (uint8_t lane = 0; lane < 8; ++lane) {
+          bool set = (mask >> lane & 1) != 0;
+          if (set) {
+            shuffles.words[mask][word++] = uint8_t(2 * lane);
+            shuffles.words[mask][word++] = uint8_t(2 * lane + 1);
+          }
+          shuffles.pairs[mask][pair++] = uint8_t(2 * lane);
+          if (set) { shuffles.pairs[mask][pair++] = uint8_t(2 * lane + 1); }
+        }
+        for (; word < 16; ++word) { shuffles.words[mask][word] = 0x80; }
+        for (; pair < 16; ++pair) { shuffles.pairs[mask][pair] = 0x80; }
+      }
+      return shuffles;
+    }
+
+    alignas(16) constexpr Shuffles shuffles = make_shuffles();
+
+    /// Decode 16 bytes of ASCII and 2-byte sequences, the last of which
+    /// may end with the next byte, and store the code units, 8 at a time,
+    /// the last 8 whole. Returns the bytes decoded, or 0 if the block holds
+    /// anything else, or a malformed sequence, for the scalar loop.
+    SKJVM_AVX2
+    auto avx2_decode_two_byte(uint8_t const *bytes, uint16_t *out,
+                              bool modified, uint32_t &units) -> uint32_t {
+      __m128i const zero = _mm_setzero_si128();
+      __m128i block = load(bytes);
+      auto has = [](__m128i bytes, uint8_t mask, uint8_t value) {
+        return _mm_cmpeq_epi8(_mm_and_si128(bytes, _mm_set1_epi8(char(mask))),
+                              _mm_set1_epi8(char(value)));
+      };
+      __m128i lead = has(block, 0xe0, 0xc0);
+      __m128i continuation = has(block, 0xc0, 0x80);
+      // Leads followed by a continuation, continuations after a lead.
+      __m128i followed = has(load(bytes + 1), 0xc0, 0x80);
+      __m128i rejected = _mm_or_si128(has(block, 0xe0, 0xe0),
+                                      _mm_xor_si128(lead, followed));
+      rejected = _mm_or_si128(rejected, modified
+                                ? _mm_cmpeq_epi8(block, zero)
+                                : has(block, 0xfe, 0xc0));
+      if (_mm_movemask_epi8(rejected) != 0 or
+          (_mm_movemask_epi8(continuation) & 1) != 0) {
+        return 0;
+      }
+
+      // Each continuation with its lead, each ASCII byte as it is.
+      __m256i current = _mm256_cvtepu8_epi16(block);
+      __m256i previous = _mm256_cvtepu8_epi16(_mm_slli_si128(block, 1));
+      __m256i combined = _mm256_or_si256(
+        _mm256_slli_epi16(_mm256_and_si256(previous,
+                                           _mm256_set1_epi16(0x1f)), 6),
+        _mm256_and_si256(current, _mm256_set1_epi16(0x3f)));
+      __m256i values = _mm256_blendv_epi8(
+        current, combined, _mm256_cvtepi8_epi16(continuation));
+
+      auto kept = uint32_t(~_mm_movemask_epi8(lead)) & 0xffff;
+      uint32_t low = kept & 0xff;
+      uint32_t high = kept >> 8;
+      if (out != nullptr) {
+        store(out, _mm_shuffle_epi8(_mm256_castsi256_si128(values),
+                                    load(shuffles.words[low])));
+        store(out + __builtin_popcount(low),
+              _mm_shuffle_epi8(_mm256_extracti128_si256(values, 1),
+                               load(shuffles.words[high])));
+      }
+      units = uint32_t(__builtin_popcount(kept));
+      // A lead ending the block is decoded with the next one.
+      return (kept & 0x8000) != 0 ? 16 : 15;
+    }
+
+    SKJVM_AVX2
+    auto avx2_decode(uint8_t const *bytes, uint32_t length, uint16_t *out,
+                     bool modified, uint32_t &units) -> uint32_t {
+      __m256i const zero = _mm256_setzero_si256();
+      uint32_t i = 0;
+      uint32_t count = 0;
+      while (length - i >= 32) {
+        __m256i block = load256(bytes + i);
+        int rejected = _mm256_movemask_epi8(block);
+        if (modified) {
+          rejected |= _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, zero));
+        }
+        if (rejected == 0) {
+          if (out != nullptr) {
+            store256(out + count,
+                     _mm256_cvtepu8_epi16(_mm256_castsi256_si128(block)));
+            store256(out + count + 16, _mm256_cvtepu8_epi16(
+                                         _mm256_extracti128_si256(block, 1)));
+          }
+          i += 32;
+          count += 32;
+          continue;
+        }
+        // The stores go up to 4 units past the decoded ones, which the
+        // 16 bytes left after the block decode to at least.
+        uint32_t decoded = 0;
+        uint32_t taken = avx2_decode_two_byte(
+          bytes + i, out != nullptr ? out + count : nullptr, modified,
+          decoded);
+        if (taken == 0) { break; }
+        i += taken;
+        count += decoded;
+      }
+      units = count;
+      return i;
+    }
+
+    /// Encode 8 code units below U+0800 into \p out, and store 16 bytes.
+    /// Returns \c false if one of them is not, for the scalar loop.
+    SKJVM_AVX2
+    auto avx2_encode_two_byte(uint16_t const *chars, uint8_t *out,
+                              bool modified, size_t &size) -> bool {
+      __m128i block = load(chars);
+      if (_mm_testz_si128(block, _mm_set1_epi16(int16_t(0xf800))) == 0) {
+        return false;
+      }
+      // U+0000 takes 2 bytes in modified UTF-8.
+      __m128i two_byte = _mm_cmpgt_epi16(block, _mm_set1_epi16(0x7f));
+      if (modified) {
+        two_byte = _mm_or_si128(two_byte, _mm_cmpeq_epi16(
+                                            block, _mm_setzero_si128()));
+      }
+      __m128i lead = _mm_blendv_epi8(
+        block, _mm_or_si128(_mm_srli_epi16(block, 6), _mm_set1_epi16(0xc0)),
+        two_byte);
+      __m128i trail = _mm_or_si128(_mm_and_si128(block, _mm_set1_epi16(0x3f)),
+                                   _mm_set1_epi16(0x80));
+      __m128i pairs = _mm_or_si128(lead, _mm_slli_epi16(trail, 8));
+      auto mask = uint32_t(_mm_movemask_epi8(
+        _mm_packs_epi16(two_byte, _mm_setzero_si128())));
+      if (out != nullptr) {
+        store(out, _mm_shuffle_epi8(pairs, load(shuffles.pairs[mask])));
+      }
+      size = 8 + uint32_t(__builtin_popcount(mask));
+      return true;
+    }
+
+    SKJVM_AVX2
+    auto avx2_encode(uint16_t const *chars, uint32_t length, uint8_t *out,
+                     bool modified, size_t &size) -> uint32_t {
+      __m256i const mask = _mm256_set1_epi16(int16_t(0xff80));
+      uint32_t i = 0;
+      size_t written = 0;
+      while (length - i >= 32) {
+        __m256i low = load256(chars + i);
+        __m256i high = load256(chars + i + 16);
+        if (not avx2_reject(low, high, mask, modified)) {
+          if (out != nullptr) {
+            store256(out + written, avx2_pack(low, high));
+          }
+          i += 32;
+          written += 32;
+          continue;
+        }
+        // The store goes up to 8 bytes past the encoded ones, which the
+        // units left after the block encode to at least.
+        size_t encoded = 0;
+        if (not avx2_encode_two_byte(chars + i,
+                                     out != nullptr ? out + written : nullptr,
+                                     modified, encoded)) {
+          break;
+        }
+        i += 8;
+        written += encoded;
+      }
+      size = written;
+      return i;
+    }
+
+    SKJVM_AVX2
+    auto avx2_copy_ascii(uint8_t const *bytes, uint32_t length, uint8_t *out)
+        -> uint32_t {
+      uint32_t i = 0;
+      for (; length - i >= 32; i += 32) {
+        __m256i block = load256(bytes + i);
+        if (_mm256_movemask_epi8(block) != 0) { break; }
+        if (out != nullptr) { store256(out + i, block); }
+      }
+      return i;
+    }
+
+    SKJVM_AVX2
+    auto avx2_narrow_latin1(uint16_t const *chars, uint32_t length,
+                            uint8_t *out) -> uint32_t {
+      __m256i const mask = _mm256_set1_epi16(int16_t(0xff00));
+      uint32_t i = 0;
+      for (; length - i >= 32; i += 32) {
+        __m256i low = load256(chars + i);
+        __m256i high = load256(chars + i + 16);
+        if (avx2_reject(low, high, mask, false)) { break; }
+        if (out != nullptr) { store256(out + i, avx2_pack(low, high)); }
+      }
+      return i;
+    }
+
+    SKJVM_AVX2
+    auto avx2_widen_latin1(uint8_t const *bytes, uint32_t length,
+                           uint16_t *out) -> uint32_t {
+      uint32_t i = 0;
+      for (; length - i >= 32; i += 32) {
+        __m256i block = load256(bytes + i);
+        store256(out + i,
+                 _mm256_cvtepu8_epi16(_mm256_castsi256_si128(block)));
+        store256(out + i + 16,
+                 _mm256_cvtepu8_epi16(_mm256_extracti128_si256(block, 1)));
+      }
+      return i;
+    }
+
+#undef SKJVM_AVX2
+
+    constexpr Kernels avx2_kernels {
+      &avx2_decode, &avx2_encode, &avx2_copy_ascii,
+      &avx2_narrow_latin1, &avx2_widen_latin1,
+    };
+
+    /// Whether the OS saves the AVX registers on context switches.
+    auto avx_enabled() -> bool {
+      uint32_t low = 0;
+      uint32_t high = 0;
+      __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+      return (low & 0x6) == 0x6;
+    }
+#endif
+
+    Kernels const *const kernel_tables[] = {
+      &scalar_kernels,
+#if SKJVM_UNICODE_SIMD
+      &sse2_kernels,
+      &avx2_kernels,
+#endif
+    };
+
+    /// The \c UnicodeIsa in use, or -1 before it is detected.
+    int isa_in_use = -1;
+
+    auto kernels() -> Kernels const & {
+      int isa = __atomic_load_n(&isa_in_use, __ATOMIC_RELAXED);
+      if (isa < 0) {
+        isa = int(detect_unicode_isa());
+        __atomic_store_n(&isa_in_use, isa, __ATOMIC_RELAXED);
+      }
+      return *kernel_tables[isa];
+    }
+
+    /// After a kernel stops, the scalar loops take at least that many
+    /// units before trying it again, so that text with few ASCII runs does
+    /// not pay for a kernel call per character.
+    constexpr uint32_t scalar_stretch = 32;
+
+    auto is_continuation(uint8_t byte) -> bool {
+      return (byte & 0xc0) == 0x80;
+    }
+
+    /// Decode the sequence at \p bytes, \p left bytes before the end, into
+    /// \p code. Returns its length, or 0 if it is malformed.
+    template <bool modified>
+    auto decode_sequence(uint8_t const *bytes, uint32_t left, uint32_t &code)
+        -> uint32_t {
+      uint8_t lead = bytes[0];
+      if constexpr (modified) {
+        // Overlong forms are accepted, as the JVM does; NUL must be one.
+        if (lead != 0 and lead < 0x80) {
+          code = lead;
+          return 1;
+        }
+        if ((lead & 0xe0) == 0xc0) {
+          if (left < 2 or not is_continuation(bytes[1])) { return 0; }
+          code = uint32_t(lead & 0x1f) << 6 | (bytes[1] & 0x3f);
+          return 2;
+        }
+        if ((lead & 0xf0) == 0xe0) {
+          if (left < 3 or not is_continuation(bytes[1]) or
+              not is_continuation(bytes[2])) {
+            return 0;
+          }
+          code = uint32_t(lead & 0x0f) << 12 |
+                 uint32_t(bytes[1] & 0x3f) << 6 | (bytes[2] & 0x3f);
+          return 3;
+        }
+        // Stray continuation bytes and 4-byte forms are not allowed.
+        return 0;
+      } else {
+        if (lead < 0x80) {
+          code = lead;
+          return 1;
+        }
+        if (lead < 0xc2) { return 0; }
+        if (lead < 0xe0) {
+          if (left < 2 or not is_continuation(bytes[1])) { return 0; }
+          code = uint32_t(lead & 0x1f) << 6 | (bytes[1] & 0x3f);
+          return 2;
+        }
+        if (lead < 0xf0) {
+          // No overlong forms, and no surrogates.
+          uint8_t low = lead == 0xe0 ? 0xa0 : 0x80;
+          uint8_t high = lead == 0xed ? 0x9f : 0xbf;
+          if (left < 3 or bytes[1] < low or bytes[1] > high or
+              not is_continuation(bytes[2])) {
+            return 0;
+          }
+          code = uint32_t(lead & 0x0f) << 12 |
+                 uint32_t(bytes[1] & 0x3f) << 6 | (bytes[2] & 0x3f);
+          return 3;
+        }
+        if (lead < 0xf5) {
+          // No overlong forms, and nothing past U+10FFFF.
+          uint8_t low = lead == 0xf0 ? 0x90 : 0x80;
+          uint8_t high = lead == 0xf4 ? 0x8f : 0xbf;
+          if (left < 4 or bytes[1] < low or bytes[1] > high or
+              not is_continuation(bytes[2]) or
+              not is_continuation(bytes[3])) {
+            return 0;
+          }
+          code = uint32_t(lead & 0x07) << 18 |
+                 uint32_t(bytes[1] & 0x3f) << 12 |
+                 uint32_t(bytes[2] & 0x3f) << 6 | (bytes[3] & 0x3f);
+          return 4;
+        }
+        return 0;
+      }
+    }
+
+    template <bool modified>
+    auto decode(uint8_t const *bytes, uint32_t length, uint16_t *out)
+        -> int64_t {
+      Kernels const &vector = kernels();
+      int64_t count = 0;
+      uint32_t next_vector = 0;
+      for (uint32_t i = 0; i < length;) {
+        if (i >= next_vector) {
+          uint32_t units = 0;
+          i += vector.decode(bytes + i, length - i,
+                             out != nullptr ? out + count : nullptr,
+                             modified, units);
+          count += units;
+          next_vector = i + scalar_stretch;
+          if (i == length) { break; }
+        }
+        uint32_t code = 0;
+        uint32_t size = decode_sequence<modified>(bytes + i, length - i,
+                                                  code);
+        if (size == 0) { return -1; }
+        i += size;
+        if (code >= 0x10000) {
+          if (out != nullptr) {
+            out[count] = uint16_t(0xd800 + ((code - 0x10000) >> 10));
+            out[count + 1] = uint16_t(0xdc00 + (code & 0x3ff));
+          }
+          count += 2;
+        } else {
+          if (out != nullptr) { out[count] = uint16_t(code); }
+          ++count;
+        }
+      }
+      return count;
+    }
+
+    /// Write \p code as UTF-8 at \p out unless it is \c nullptr. Returns
+    /// the number of bytes.
+    auto put_utf8(uint32_t code, uint8_t *out) -> size_t {
+      if (code < 0x80) {
+        if (out != nullptr) { out[0] = uint8_t(code); }
+        return 1;
+      }
+      if (code < 0x800) {
+        if (out != nullptr) {
+          out[0] = uint8_t(0xc0 | code >> 6);
+          out[1] = uint8_t(0x80 | (code & 0x3f));
+        }
+        return 2;
+      }
+      if (code < 0x10000) {
+        if (out != nullptr) {
+          out[0] = uint8_t(0xe0 | code >> 12);
+          out[1] = uint8_t(0x80 | (code >> 6 & 0x3f));
+          out[2] = uint8_t(0x80 | (code & 0x3f));
+        }
+        return 3;
+      }
+      if (out != nullptr) {
+        out[0] = uint8_t(0xf0 | code >> 18);
+        out[1] = uint8_t(0x80 | (code >> 12 & 0x3f));
+        out[2] = uint8_t(0x80 | (code >> 6 & 0x3f));
+        out[3] = uint8_t(0x80 | (code & 0x3f));
+      }
+      return 4;
+    }
+
+    template <bool modified>
+    auto encode(uint16_t const *chars, uint32_t length, uint8_t *out)
+        -> size_t {
+      Kernels const &vector = kernels();
+      size_t size = 0;
+      uint32_t next_vector = 0;
+      for (uint32_t i = 0; i < length;) {
+        if (i >= next_vector) {
+          size_t encoded = 0;
+          i += vector.encode(chars + i, length - i,
+                             out != nullptr ? out + size : nullptr,
+                             modified, encoded);
+          size += encoded;
+          next_vector = i + scalar_stretch;
+          if (i == length) { break; }
+        }
+        uint32_t code = chars[i++];
+        uint8_t *at = out != nullptr ? out + size : nullptr;
+        if constexpr (modified) {
+          if (code == 0) {
+            if (at != nullptr) {
+              at[0] = 0xc0;
+              at[1] = 0x80;
+            }
+            size += 2;
+            continue;
+          }
+        } else {
+          if (code >= 0xd800 and code < 0xe000) {
+            if (code < 0xdc00 and i < length and chars[i] >= 0xdc00 and
+                chars[i] < 0xe000) {
+              code = 0x10000 + ((code - 0xd800) << 10) + (chars[i] - 0xdc00);
+              ++i;
+            } else {
+              code = '?';
+            }
+          }
+        }
+        size += put_utf8(code, at);
+      }
+      return size;
+    }
+  } // namespace
+
+  auto describe(UnicodeIsa isa) -> char const * {
+    switch (isa) {
+      case UnicodeIsa::scalar: return "scalar";
+      case UnicodeIsa::sse2:   return "sse2";
+      case UnicodeIsa::avx2:   return "avx2";
+    }
+    return "unknown";
+  }
+
+  auto detect_unicode_isa() -> UnicodeIsa {
+#if SKJVM_UNICODE_SIMD
+    unsigned eax = 0;
+    unsigned ebx = 0;
+    unsigned ecx = 0;
+    unsigned edx = 0;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0 or
+        (ecx & bit_OSXSAVE) == 0 or (ecx & bit_AVX) == 0 or
+        not avx_enabled()) {
+      return UnicodeIsa::sse2;
+    }
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0 or
+        (ebx & bit_AVX2) == 0) {
+      return UnicodeIsa::sse2;
+    }
+    return UnicodeIsa::avx2;
+#else
+    return UnicodeIsa::scalar;
+#endif
+  }
+
+  auto get_unicode_isa() -> UnicodeIsa {
+    (void)kernels();
+    return UnicodeIsa(__atomic_load_n(&isa_in_use, __ATOMIC_RELAXED));
+  }
+
+  auto set_unicode_isa(UnicodeIsa isa) -> bool {
+    if (isa > detect_unicode_isa()) { return false; }
+    __atomic_store_n(&isa_in_use, int(isa), __ATOMIC_RELAXED);
+    return true;
+  }
+
+  auto decode_modified_utf8(uint8_t const *bytes, uint32_t length,
+                            uint16_t *out) -> int64_t {
+    return decode<true>(bytes, length, out);
+  }
+
+  auto decode_utf8(uint8_t const *bytes, uint32_t length, uint16_t *out)
+      -> int64_t {
+    return decode<false>(bytes, length, out);
+  }
+
+  auto encode_utf8(uint16_t const *chars, uint32_t length, uint8_t *out)
+      -> size_t {
+    return encode<false>(chars, length, out);
+  }
+
+  auto encode_modified_utf8(uint16_t const *chars, uint32_t length,
+                            uint8_t *out) -> size_t {
+    return encode<true>(chars, length, out);
+  }
+
+  auto compress_latin1(uint16_t const *chars, uint32_t length, uint8_t *out)
+      -> bool {
+    // The kernel stops at the first block with a wider unit, which the
+    // scalar loop finds again.
+    for (uint32_t i = kernels().narrow_latin1(chars, length, out);
+         i < length; ++i) {
+      if (chars[i] > 0xff) { return false; }
+      if (out != nullptr) { out[i] = uint8_t(chars[i]); }
+    }
+    return true;
+  }
+
+  auto inflate_latin1(uint8_t const *bytes, uint32_t length, uint16_t *out)
+      -> void {
+    for (uint32_t i = kernels().widen_latin1(bytes, length, out); i < length;
+         ++i) {
+      out[i] = bytes[i];
+    }
+  }
+
+  auto encode_latin1_utf8(uint8_t const *bytes, uint32_t length,
+                          uint8_t *out) -> size_t {
+    Kernels const &vector = kernels();
+    size_t size = 0;
+    uint32_t next_vector = 0;
+    for (uint32_t i = 0; i < length;) {
+      if (i >= next_vector) {
+        uint32_t run = vector.copy_ascii(bytes + i, length - i,
+                                         out != nullptr ? out + size
+                                                        : nullptr);
+        i += run;
+        size += run;
+        next_vector = i + scalar_stretch;
+        if (i == length) { break; }
+      }
+      size += put_utf8(bytes[i++], out != nullptr ? out + size : nullptr);
+    }
+    return size;
+  }
+} // namespace skjvm
@@ -0,0 +1,1571 @@
+#include <skjvm/verifier.hpp>
+
+#include <skjvm/bytes.hpp>
+#include <skjvm/class_registry.hpp>
+#include <skjvm/descriptor.hpp>
+#include <skjvm/opcodes.hpp>
+#include <skjvm/small_vector.hpp>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace skjvm {
+  namespace {
+    /// \brief The kinds of verification types, numbered like the
+    /// \c verification_type_info items of \c StackMapTable, JVMS 4.7.4.
+    enum class Item : uint8_t {
+      top,
+      integer,
+      float_,
+      double_,
+      long_,
+      null,
+      uninitialized_this,
+      object,
+      uninitialized,
+    };
+
+    /// \brief A verification type: its \c Item and, for \c object, the
+    /// index of its class name in \c TypeChecker::names, or for
+    /// \c uninitialized, the offset of the \c new that made it.
+    ///
+    /// \details \c long and \c double take two slots, the second being
+    /// \c top, in the locals and on the operand stack alike.
+    struct Type {
+      Item item;
+      uint16_t data;
+
+      auto operator==(Type const &other) const -> bool = default;
+    };
+
+    constexpr Type top_type {Item::top, 0};
+    constexpr Type int_type {Item::integer, 0};
+    constexpr Type float_type {Item::float_, 0};
+    constexpr Type long_type {Item::long_, 0};
+    constexpr Type double_type {Item::double_, 0};
+    constexpr Type null_type {Item::null, 0};
+    constexpr Type uninitialized_this_type {Item::uninitialized_this, 0};
+
+    auto is_wide(Type type) -> bool {
+      return type.item == Item::long_ or type.item == Item::double_;
+    }
+
+    auto is_reference(Type type) -> bool {
+      return type.item >= Item::null;
+    }
+
+    /// \brief A \c StackMapTable entry, expanded to one type per slot.
+    struct Frame {
+      uint32_t bci;
+      uint16_t depth;
+
+      /// The locals, then the operand stack.
+      Type *slots;
+    };
+
+    /// Names of the arrays \c newarray makes, by its operand less 4.
+    constexpr char const *primitive_array_names[] {
+      "[Z", "[C", "[F", "[D", "[B", "[S", "[I", "[J",
+    };
+
+    auto slice(Utf8View view, uint16_t start, uint16_t length) -> Utf8View {
+      return {view.bytes + start, length};
+    }
+
+    /// \brief Type checks one method, either against the frames of its
+    /// \c StackMapTable in one pass, or by inferring them, see
+    /// \c verify_method and \c infer_stack_map_table.
+    class TypeChecker {
+      ClassFile const &class_file;
+      uint16_t const access_flags;
+      Utf8View const method_name;
+      Utf8View const descriptor;
+      CodeView const &code;
+      Arena &arena;
+
+      /// Links the classes compared, or \c nullptr to take every class as
+      /// assignable to every other and \c java/lang/Object as where two
+      /// classes meet.
+      ClassRegistry *const registry;
+
+      uint16_t const max_locals;
+      uint16_t const max_stack;
+
+      /// The class names of the \c object types.
+      SmallVector<Utf8View, 16> names {};
+      uint16_t this_class {0};
+
+      /// The state at the instruction being checked, as it changes.
+      Type *locals;
+      Type *stack;
+      uint16_t depth {0};
+
+      /// Slots of the locals the parameters take, from which the first
+      /// \c StackMapTable entry is relative.
+      uint16_t parameter_slots {0};
+
+      /// The \c StackMapTable entries, by offset, when checking.
+      Frame *frames {nullptr};
+      uint32_t frame_count {0};
+
+      /// The state flowing into each instruction, \c nullptr until it is
+      /// reached, and whether it needs a frame, when inferring.
+      bool inferring {false};
+      Type **states {nullptr};
+      uint16_t *depths {nullptr};
+      bool *starts {nullptr};
+      bool *needs_frame {nullptr};
+      PodVector<uint32_t> pending {};
+
+      uint32_t bci {0};
+      char const *error {nullptr};
+
+      auto fail(char const *reason) -> bool {
+        if (error == nullptr) { error = reason; }
+        return false;
+      }
+
+      [[nodiscard]]
+      auto name_index(Utf8View name) -> uint16_t {
+        for (size_t i = 0; i < names.get_size(); ++i) {
+          if (names[i].equals(name)) { return uint16_t(i); }
+        }
+        if (names.get_size() > 0xffff) { fatal("too many class names"); }
+        names.push(name);
+        return uint16_t(names.get_size() - 1);
+      }
+
+      [[nodiscard]]
+      auto object(Utf8View name) -> Type {
+        return {Item::object, name_index(name)};
+      }
+
+      [[nodiscard]]
+      auto object(char const *name) -> Type {
+        return object(make_view(name));
+      }
+
+      /// The type of the field type of \p length at \p position of
+      /// \p descriptor, which is well formed.
+      [[nodiscard]]
+      auto type_of(Utf8View descriptor, uint16_t position, uint16_t length)
+        -> Type;
+
+      [[nodiscard]]
+      auto class_type(uint16_t index, Type &type) -> bool;
+
+      [[nodiscard]]
+      auto is_assignable_class(Utf8View from, Utf8View to) -> bool;
+
+      [[nodiscard]]
+      auto is_assignable(Type from, Type to) -> bool;
+
+      [[nodiscard]]
+      auto common_super(Utf8View first, Utf8View second) -> Utf8View;
+
+      [[nodiscard]]
+      auto merge(Type first, Type second) -> Type;
+
+      [[nodiscard]]
+      auto push(Type type) -> bool;
+
+      [[nodiscard]]
+      auto pop(Type expected) -> bool;
+
+      [[nodiscard]]
+      auto pop_reference(Type &popped) -> bool;
+
+      [[nodiscard]]
+      auto pop_array(char element, char alternative, Type &array) -> bool;
+
+      [[nodiscard]]
+      auto shuffle(uint32_t popped, uint32_t starts_mask, char const *pushed)
+        -> bool;
+
+      [[nodiscard]]
+      auto load(Item kind, uint32_t index) -> bool;
+
+      [[nodiscard]]
+      auto store(Item kind, uint32_t index) -> bool;
+
+      [[nodiscard]]
+      auto load_constant(uint16_t index, bool wide) -> bool;
+
+      [[nodiscard]]
+      auto access_field(Opcode opcode, uint16_t index) -> bool;
+
+      [[nodiscard]]
+      auto invoke(Opcode opcode, uint8_t const *bytes) -> bool;
+
+      [[nodiscard]]
+      auto initialize(Utf8View class_name) -> bool;
+
+      [[nodiscard]]
+      auto flow(int64_t target, bool jump) -> bool;
+
+      [[nodiscard]]
+      auto check_handlers() -> bool;
+
+      [[nodiscard]]
+      auto step(bool &ends) -> bool;
+
+      [[nodiscard]]
+      auto initial_state() -> bool;
+
+      [[nodiscard]]
+      auto read_type(uint8_t const *&position, uint8_t const *end,
+                     Type &type) -> bool;
+
+      [[nodiscard]]
+      auto parse_frames() -> bool;
+
+      [[nodiscard]]
+      auto matches(Frame const &frame) -> bool;
+
+      auto write_type(PodVector<uint8_t> &table, Type type,
+                      ClassConstantFunction class_constant, void *context)
+        -> void;
+
+     public:
+      TypeChecker(ClassFile const &class_file, uint16_t access_flags,
+                  Utf8View method_name, Utf8View descriptor,
+                  CodeView const &code, Arena &arena,
+                  ClassRegistry *registry) noexcept
+        : class_file(class_file), access_flags(access_flags),
+          method_name(method_name), descriptor(descriptor), code(code),
+          arena(arena), registry(registry), max_locals(code.max_locals),
+          max_stack(code.max_stack),
+          locals(arena.allocate_array<Type>(code.max_locals)),
+          stack(arena.allocate_array<Type>(size_t(code.max_stack) + 1)) {}
+      TypeChecker(TypeChecker const&) = delete;
+      auto operator=(TypeChecker const&) -> TypeChecker & = delete;
+      ~TypeChecker() noexcept = default;
+
+      /// Check the code against its \c StackMapTable, in one pass.
+      [[nodiscard]]
+      auto check() -> bool;
+
+      /// Infer the types flowing into each instruction.
+      [[nodiscard]]
+      auto infer() -> bool;
+
+      /// Append the frames \c infer found to \p table, returning how many.
+      [[nodiscard]]
+      auto encode(PodVector<uint8_t> &table,
+                  ClassConstantFunction class_constant, void *context)
+        -> int32_t;
+
+      [[nodiscard]]
+      auto get_error() const -> char const * {
+        return error;
+      }
+
+      [[nodiscard]]
+      auto get_bci() const -> uint32_t {
+        return bci;
+      }
+    };
+
+    auto TypeChecker::type_of(Utf8View descriptor, uint16_t position,
+                              uint16_t length) -> Type {
+      switch (descriptor.bytes[position]) {
+        case 'F': return float_type;
+        case 'J': return long_type;
+        case 'D': return double_type;
+        case 'L':
+          return object(slice(descriptor, uint16_t(position + 1),
+                              uint16_t(length - 2)));
+        case '[': return object(slice(descriptor, position, length));
+        default: return int_type;
+      }
+    }
+
+    auto TypeChecker::class_type(uint16_t index, Type &type) -> bool {
+      if (class_file.tag(index) != ConstantTag::class_) {
+        return fail("Expecting a class constant");
+      }
+      type = object(class_file.class_name(index));
+      return true;
+    }
+
+    auto TypeChecker::is_assignable_class(Utf8View from, Utf8View to)
+        -> bool {
+      if (from.equals(to) or to.equals("java/lang/Object")) { return true; }
+      bool from_array = from.length > 1 and from.bytes[0] == '[';
+      bool to_array = to.length > 1 and to.bytes[0] == '[';
+      if (from_array) {
+        if (not to_array) {
+          return to.equals("java/lang/Cloneable") or
+                 to.equals("java/io/Serializable");
+        }
+        // Arrays of the same primitive type, or of assignable references.
+        Utf8View from_element = slice(from, 1, uint16_t(from.length - 1));
+        Utf8View to_element = slice(to, 1, uint16_t(to.length - 1));
+        auto from_first = char(from_element.bytes[0]);
+        auto to_first = char(to_element.bytes[0]);
+        bool from_reference = from_first == 'L' or from_first == '[';
+        bool to_reference = to_first == 'L' or to_first == '[';
+        if (not from_reference or not to_reference) {
+          return from_element.equals(to_element);
+        }
+        if (from_first == 'L') {
+          from_element = slice(from_element, 1,
+                               uint16_t(from_element.length - 2));
+        }
+        if (to_first == 'L') {
+          to_element = slice(to_element, 1, uint16_t(to_element.length - 2));
+        }
+        return is_assignable_class(from_element, to_element);
+      }
+      if (to_array) { return false; }
+      if (registry == nullptr) { return true; }
+
+      LinkError link_error = LinkError::none;
+      Klass *target = registry->link(to, link_error);
+      if (target == nullptr or target->is_interface()) { return true; }
+      Klass *source = registry->link(from, link_error);
+      return source == nullptr or source->is_subclass_of(target);
+    }
+
+    auto TypeChecker::is_assignable(Type from, Type to) -> bool {
+      if (from == to or to.item == Item::top) { return true; }
+      if (to.item != Item::object) { return false; }
+      if (from.item == Item::null) { return true; }
+      return from.item == Item::object and
+             is_assignable_class(names[from.data], names[to.data]);
+    }
+
+    auto TypeChecker::common_super(Utf8View first, Utf8View second)
+        -> Utf8View {
+      Utf8View object_name = make_view("java/lang/Object");
+      if (registry == nullptr or first.bytes[0] == '[' or
+          second.bytes[0] == '[') {
+        return object_name;
+      }
+      LinkError link_error = LinkError::none;
+      Klass *one = registry->link(first, link_error);
+      Klass *other = registry->link(second, link_error);
+      if (one == nullptr or other == nullptr or one->is_interface() or
+          other->is_interface()) {
+        return object_name;
+      }
+      for (Klass const *klass = one; klass != nullptr; klass = klass->super) {
+        if (other->is_subclass_of(klass)) { return klass->name; }
+      }
+      return object_name;
+    }
+
+    auto TypeChecker::merge(Type first, Type second) -> Type {
+      if (first == second) { return first; }
+      if (first.item == Item::null and second.item == Item::object) {
+        return second;
+      }
+      if (first.item == Item::object and second.item == Item::null) {
+        return first;
+      }
+      if (first.item == Item::object and second.item == Item::object) {
+        return object(common_super(names[first.data], names[second.data]));
+      }
+      return top_type;
+    }
+
+    auto TypeChecker::push(Type type) -> bool {
+      uint32_t slots = is_wide(type) ? 2 : 1;
+      if (uint32_t(depth) + slots > max_stack) {
+        return fail("Operand stack overflow");
+      }
+      stack[depth++] = type;
+      if (slots == 2) { stack[depth++] = top_type; }
+      return true;
+    }
+
+    auto TypeChecker::pop(Type expected) -> bool {
+      if (is_wide(expected)) {
+        if (depth < 2) { return fail("Operand stack underflow"); }
+        if (stack[depth - 1] != top_type or stack[depth - 2] != expected) {
+          return fail("Bad type on operand stack");
+        }
+        depth = uint16_t(depth - 2);
+        return true;
+      }
+      if (depth < 1) { return fail("Operand stack underflow"); }
+      Type popped = stack[depth - 1];
+      if (popped.item == Item::top or not is_assignable(popped, expected)) {
+        return fail("Bad type on operand stack");
+      }
+      --depth;
+      return true;
+    }
+
+    auto TypeChecker::pop_reference(Type &popped) -> bool {
+      if (depth < 1) { return fail("Operand stack underflow"); }
+      popped = stack[depth - 1];
+      if (not is_reference(popped)) {
+        return fail("Bad type on operand stack");
+      }
+      --depth;
+      return true;
+    }
+
+    /// Pop an array whose elements have the descriptor \p element or
+    /// \p alternative, \c L standing for any reference, or \c null.
+    auto TypeChecker::pop_array(char element, char alternative, Type &array)
+        -> bool {
+      if (not pop_reference(array)) { return false; }
+      if (array.item == Item::null) { return true; }
+      if (array.item != Item::object) {
+        return fail("Bad type on operand stack");
+      }
+      Utf8View name = names[array.data];
+      if (name.length < 2 or name.bytes[0] != '[') {
+        return fail("Expecting an array on the operand stack");
+      }
+      auto first = char(name.bytes[1]);
+      if (element == 'L' ? first == 'L' or first == '['
+                         : name.length == 2 and
+                           (first == element or first == alternative)) {
+        return true;
+      }
+      return fail("Bad array type on operand stack");
+    }
+
+    /// Pop \p popped slots and push them again in the order of \p pushed,
+    /// \c 'a' being the top slot popped, like \c StackMapper::shuffle. Bit
+    /// \c k of \p starts_mask is set for each value the instruction moves
+    /// as a whole that starts \c k slots below the top; a \c long or
+    /// \c double must not be split there.
+    auto TypeChecker::shuffle(uint32_t popped, uint32_t starts_mask,
+                              char const *pushed) -> bool {
+      if (depth < popped) { return fail("Operand stack underflow"); }
+      for (uint32_t k = 0; k < popped; ++k) {
+        uint32_t start = depth - 1u - k;
+        if (((starts_mask >> k) & 1) != 0 and start > 0 and
+            is_wide(stack[start - 1])) {
+          return fail("Bad type on operand stack");
+        }
+      }
+      Type slots[4] {};
+      for (uint32_t k = 0; k < popped; ++k) {
+        slots[k] = stack[depth - 1 - k];
+      }
+      depth = uint16_t(depth - popped);
+      for (; *pushed != '\0'; ++pushed) {
+        if (depth >= max_stack) { return fail("Operand stack overflow"); }
+        stack[depth++] = slots[*pushed - 'a'];
+      }
+      return true;
+    }
+
+    auto TypeChecker::load(Item kind, uint32_t index) -> bool {
+      if (index >= max_locals) {
+        return fail("Illegal local variable number");
+      }
+      Type type = locals[index];
+      if (kind == Item::object) {
+        if (not is_reference(type)) {
+          return fail("Bad local variable type");
+        }
+        return push(type);
+      }
+      if (type.item != kind) { return fail("Bad local variable type"); }
+      if (is_wide(type) and
+          (index + 1u >= max_locals or locals[index + 1] != top_type)) {
+        return fail("Bad local variable type");
+      }
+      return push(type);
+    }
+
+    auto TypeChecker::store(Item kind, uint32_t index) -> bool {
+      Type type {kind, 0};
+      bool wide = is_wide(type);
+      if (index + (wide ? 1u : 0u) >= max_locals) {
+        return fail("Illegal local variable number");
+      }
+      if (kind == Item::object) {
+        if (not pop_reference(type)) { return false; }
+      } else if (not pop(type)) {
+        return false;
+      }
+      locals[index] = type;
+      if (wide) { locals[index + 1] = top_type; }
+      // Overwriting the second half of a long or double ends it.
+      if (index > 0 and is_wide(locals[index - 1])) {
+        locals[index - 1] = top_type;
+      }
+      return true;
+    }
+
+    auto TypeChecker::load_constant(uint16_t index, bool wide) -> bool {
+      uint16_t version = class_file.get_major_version();
+      switch (class_file.tag(index)) {
+        case ConstantTag::integer:
+          if (not wide) { return push(int_type); }
+          break;
+        case ConstantTag::float_:
+          if (not wide) { return push(float_type); }
+          break;
+        case ConstantTag::string:
+          if (not wide) { return push(object("java/lang/String")); }
+          break;
+        case ConstantTag::class_:
+          if (not wide and version >= 49) {
+            return push(object("java/lang/Class"));
+          }
+          break;
+        case ConstantTag::method_type:
+          if (not wide and version >= 51) {
+            return push(object("java/lang/invoke/MethodType"));
+          }
+          break;
+        case ConstantTag::method_handle:
+          if (not wide and version >= 51) {
+            return push(object("java/lang/invoke/MethodHandle"));
+          }
+          break;
+        case ConstantTag::long_:
+          if (wide) { return push(long_type); }
+          break;
+        case ConstantTag::double_:
+          if (wide) { return push(double_type); }
+          break;
+        default:
+          break;
+      }
+      return fail("Bad constant for ldc");
+    }
+
+    auto TypeChecker::access_field(Opcode opcode, uint16_t index) -> bool {
+      if (class_file.tag(index) != ConstantTag::fieldref) {
+        return fail("Expecting a field reference");
+      }
+      MemberRef field = class_file.member_ref(index);
+      uint16_t length = field_type_length(field.descriptor, 0);
+      if (length == 0 or length != field.descriptor.length) {
+        return fail("Bad field descriptor");
+      }
+      Type type = type_of(field.descriptor, 0, length);
+      Type holder = object(field.class_name);
+      switch (opcode) {
+        case Opcode::getstatic:
+          return push(type);
+        case Opcode::putstatic:
+          return pop(type);
+        case Opcode::getfield:
+          return pop(holder) and push(type);
+        default:
+          if (not pop(type)) { return false; }
+          // A constructor may set the fields of its class before calling
+          // the super constructor, as inner classes do with `this$0`.
+          if (depth > 0 and stack[depth - 1] == uninitialized_this_type and
+              field.class_name.equals(names[this_class])) {
+            --depth;
+            return true;
+          }
+          return pop(holder);
+      }
+    }
+
+    auto TypeChecker::invoke(Opcode opcode, uint8_t const *bytes) -> bool {
+      uint16_t index = read_u2(bytes + 1);
+      ConstantTag tag = class_file.tag(index);
+      bool interface = tag == ConstantTag::interface_methodref;
+      if (opcode == Opcode::invokeinterface
+            ? not interface
+            : tag != ConstantTag::methodref and
+              not (interface and opcode != Opcode::invokevirtual and
+                   class_file.get_major_version() >= 52)) {
+        return fail("Bad method reference");
+      }
+      MemberRef method = class_file.member_ref(index);
+      bool initializer = method.name.equals("<init>");
+      if (method.name.length > 0 and method.name.bytes[0] == '<' and
+          (not initializer or opcode != Opcode::invokespecial)) {
+        return fail("Illegal call to an initialization method");
+      }
+
+      SmallVector<Type, 8> parameters;
+      uint32_t slots = 0;
+      Utf8View signature = method.descriptor;
+      uint16_t position = 1;
+      if (signature.length == 0 or signature.bytes[0] != '(') {
+        return fail("Bad method descriptor");
+      }
+      while (position < signature.length and signature.bytes[position] != ')') {
+        uint16_t length = field_type_length(signature, position);
+        if (length == 0) { return fail("Bad method descriptor"); }
+        Type type = type_of(signature, position, length);
+        parameters.push(type);
+        slots += is_wide(type) ? 2 : 1;
+        position = uint16_t(position + length);
+      }
+      if (position + 1u >= signature.length) {
+        return fail("Bad method descriptor");
+      }
+      ++position;
+      uint16_t return_length = signature.bytes[position] == 'V'
+                             ? 1 : field_type_length(signature, position);
+      if (return_length == 0 or position + return_length != signature.length) {
+        return fail("Bad method descriptor");
+      }
+      if (opcode == Opcode::invokeinterface and
+          (bytes[3] != slots + 1 or bytes[4] != 0)) {
+        return fail("Inconsistent args count operand in invokeinterface");
+      }
+
+      for (size_t i = parameters.get_size(); i > 0; --i) {
+        if (not pop(parameters[i - 1])) { return false; }
+      }
+      if (initializer) {
+        if (not initialize(method.class_name)) { return false; }
+      } else if (opcode == Opcode::invokespecial) {
+        // A super or private method, called on this class or a subclass.
+        if (not pop(Type {Item::object, this_class})) { return false; }
+      } else if (opcode != Opcode::invokestatic and
+                 not pop(object(method.class_name))) {
+        return false;
+      }
+      if (signature.bytes[position] == 'V') { return true; }
+      return push(type_of(signature, position, return_length));
+    }
+
+    /// Pop the object a constructor of \p class_name initializes, and
+    /// replace it with an initialized one wherever it is.
+    auto TypeChecker::initialize(Utf8View class_name) -> bool {
+      Type receiver {};
+      if (not pop_reference(receiver)) { return false; }
+      Type initialized {};
+      if (receiver.item == Item::uninitialized_this) {
+        // `this()` or `super()`.
+        if (not class_name.equals(names[this_class]) and
+            not class_name.equals(class_file.super_class_name())) {
+          return fail("Bad constructor call on uninitialized this");
+        }
+        initialized = Type {Item::object, this_class};
+      } else if (receiver.item == Item::uninitialized) {
+        // Parsing the frames checked that a `new` is there.
+        Utf8View created = class_file.class_name(
+          read_u2(code.code + receiver.data + 1));
+        if (not created.equals(class_name)) {
+          return fail("Constructor of another class than the one created");
+        }
+        initialized = object(created);
+      } else {
+        return fail("Bad type on operand stack");
+      }
+      for (uint32_t i = 0; i < max_locals; ++i) {
+        if (locals[i] == receiver) { locals[i] = initialized; }
+      }
+      for (uint32_t i = 0; i < depth; ++i) {
+        if (stack[i] == receiver) { stack[i] = initialized; }
+      }
+      return true;
+    }
+
+    /// Continue from the current state at \p target: check it against the
+    /// frame there or, when inferring, merge it into the state there.
+    /// \p jump is \c false for falling through to the next instruction.
+    auto TypeChecker::flow(int64_t target, bool jump) -> bool {
+      if (target < 0 or target >= code.code_length) {
+        return fail("Illegal branch target");
+      }
+      auto at = uint32_t(target);
+      if (not inferring) {
+        Frame const *frame = nullptr;
+        for (uint32_t low = 0, high = frame_count; low < high;) {
+          uint32_t middle = (low + high) / 2;
+          if (frames[middle].bci == at) {
+            frame = &frames[middle];
+            break;
+          }
+          if (frames[middle].bci < at) {
+            low = middle + 1;
+          } else {
+            high = middle;
+          }
+        }
+        if (frame == nullptr) {
+          return fail("Expecting a stack map frame at branch target");
+        }
+        return matches(*frame);
+      }
+
+      if (not starts[at]) { return fail("Illegal branch target"); }
+      if (jump) { needs_frame[at] = true; }
+      uint32_t width = uint32_t(max_locals) + max_stack;
+      Type *state = states[at];
+      if (state == nullptr) {
+        state = arena.allocate_array<Type>(width);
+        memcpy(state, locals, sizeof(Type) * max_locals);
+        memcpy(state + max_locals, stack, sizeof(Type) * depth);
+        states[at] = state;
+        depths[at] = depth;
+        pending.push(at);
+        return true;
+      }
+      if (depths[at] != depth) {
+        return fail("Inconsistent stack height");
+      }
+      bool changed = false;
+      for (uint32_t i = 0; i < uint32_t(max_locals) + depth; ++i) {
+        Type incoming = i < max_locals ? locals[i] : stack[i - max_locals];
+        Type merged = merge(state[i], incoming);
+        changed = changed or merged != state[i];
+        state[i] = merged;
+      }
+      if (changed) { pending.push(at); }
+      return true;
+    }
+
+    /// Flow into the handlers covering the current instruction, with the
+    /// locals it starts with and the exception alone on the stack.
+    auto TypeChecker::check_handlers() -> bool {
+      for (uint16_t i = 0; i < code.exception_table_length; ++i) {
+        ExceptionHandler handler = code.exception_handler(i);
+        if (bci < handler.start_pc or bci >= handler.end_pc) { continue; }
+        Type caught = object("java/lang/Throwable");
+        if (handler.catch_type != 0) {
+          Type thrown {};
+          if (not class_type(handler.catch_type, thrown)) { return false; }
+          if (not is_assignable(thrown, caught)) {
+            return fail("Catch type is not a subclass of Throwable");
+          }
+          caught = thrown;
+        }
+        if (max_stack == 0) { return fail("Operand stack overflow"); }
+        uint16_t saved_depth = depth;
+        Type saved = stack[0];
+        depth = 1;
+        stack[0] = caught;
+        bool flowed = flow(handler.handler_pc, true);
+        depth = saved_depth;
+        stack[0] = saved;
+        if (not flowed) { return false; }
+      }
+      return true;
+    }
+
+    /// Apply the instruction at \c bci to the state, and flow to where it
+    /// jumps. \p ends is set if it never continues with the next one.
+    auto TypeChecker::step(bool &ends) -> bool {
+      uint8_t const *bytes = code.code + bci;
+      auto opcode = Opcode(bytes[0]);
+      ends = false;
+      Type type {};
+      Type array {};
+      switch (opcode) {
+        case Opcode::nop:
+          return true;
+        case Opcode::aconst_null:
+          return push(null_type);
+        case Opcode::iconst_m1:
+        case Opcode::iconst_0:
+        case Opcode::iconst_1:
+        case Opcode::iconst_2:
+        case Opcode::iconst_3:
+        case Opcode::iconst_4:
+        case Opcode::iconst_5:
+        case Opcode::bipush:
+        case Opcode::sipush:
+          return push(int_type);
+        case Opcode::lconst_0:
+        case Opcode::lconst_1:
+          return push(long_type);
+        case Opcode::fconst_0:
+        case Opcode::fconst_1:
+        case Opcode::fconst_2:
+          return push(float_type);
+        case Opcode::dconst_0:
+        case Opcode::dconst_1:
+          return push(double_type);
+        case Opcode::ldc:
+          return load_constant(bytes[1], false);
+        case Opcode::ldc_w:
+          return load_constant(read_u2(bytes + 1), false);
+        case Opcode::ldc2_w:
+          return load_constant(read_u2(bytes + 1), true);
+
+        case Opcode::iload: return load(Item::integer, bytes[1]);
+        case Opcode::lload: return load(Item::long_, bytes[1]);
+        case Opcode::fload: return load(Item::float_, bytes[1]);
+        case Opcode::dload: return load(Item::double_, bytes[1]);
+        case Opcode::aload: return load(Item::object, bytes[1]);
+        case Opcode::istore: return store(Item::integer, bytes[1]);
+        case Opcode::lstore: return store(Item::long_, bytes[1]);
+        case Opcode::fstore: return store(Item::float_, bytes[1]);
+        case Opcode::dstore: return store(Item::double_, bytes[1]);
+        case Opcode::astore: return store(Item::object, bytes[1]);
+        case Opcode::iinc:
+          return load(Item::integer, bytes[1]) and pop(int_type);
+        case Opcode::wide: {
+          uint16_t index = read_u2(bytes + 2);
+          switch (Opcode(bytes[1])) {
+            case Opcode::iload: return load(Item::integer, index);
+            case Opcode::lload: return load(Item::long_, index);
+            case Opcode::fload: return load(Item::float_, index);
+            case Opcode::dload: return load(Item::double_, index);
+            case Opcode::aload: return load(Item::object, index);
+            case Opcode::istore: return store(Item::integer, index);
+            case Opcode::lstore: return store(Item::long_, index);
+            case Opcode::fstore: return store(Item::float_, index);
+            case Opcode::dstore: return store(Item::double_, index);
+            case Opcode::astore: return store(Item::object, index);
+            case Opcode::iinc:
+              return load(Item::integer, index) and pop(int_type);
+            default:
+              return fail("Bad wide instruction");
+          }
+        }
+
+        case Opcode::iaload:
+          return pop(int_type) and pop_array('I', 'I', array) and
+                 push(int_type);
+        case Opcode::baload:
+          return pop(int_type) and pop_array('B', 'Z', array) and
+                 push(int_type);
+        case Opcode::caload:
+          return pop(int_type) and pop_array('C', 'C', array) and
+                 push(int_type);
+        case Opcode::saload:
+          return pop(int_type) and pop_array('S', 'S', array) and
+                 push(int_type);
+        case Opcode::laload:
+          return pop(int_type) and pop_array('J', 'J', array) and
+                 push(long_type);
+        case Opcode::faload:
+          return pop(int_type) and pop_array('F', 'F', array) and
+                 push(float_type);
+        case Opcode::daload:
+          return pop(int_type) and pop_array('D', 'D', array) and
+                 push(double_type);
+        case Opcode::aaload: {
+          if (not pop(int_type) or not pop_array('L', 'L', array)) {
+            return false;
+          }
+          if (array.item == Item::null) { return push(null_type); }
+          Utf8View name = names[array.data];
+          return push(type_of(name, 1, uint16_t(name.length - 1)));
+        }
+        case Opcode::iastore:
+          return pop(int_type) and pop(int_type) and
+                 pop_array('I', 'I', array);
+        case Opcode::bastore:
+          return pop(int_type) and pop(int_type) and
+                 pop_array('B', 'Z', array);
+        case Opcode::castore:
+          return pop(int_type) and pop(int_type) and
+                 pop_array('C', 'C', array);
+        case Opcode::sastore:
+          return pop(int_type) and pop(int_type) and
+                 pop_array('S', 'S', array);
+        case Opcode::lastore:
+          return pop(long_type) and pop(int_type) and
+                 pop_array('J', 'J', array);
+        case Opcode::fastore:
+          return pop(float_type) and pop(int_type) and
+                 pop_array('F', 'F', array);
+        case Opcode::dastore:
+          return pop(double_type) and pop(int_type) and
+                 pop_array('D', 'D', array);
+        case Opcode::aastore:
+          // The element type is checked when storing.
+          return pop_reference(type) and pop(int_type) and
+                 pop_array('L', 'L', array);
+
+        case Opcode::pop: return shuffle(1, 0b1, "");
+        case Opcode::pop2: return shuffle(2, 0b10, "");
+        case Opcode::dup: return shuffle(1, 0b1, "aa");
+        case Opcode::dup_x1: return shuffle(2, 0b11, "aba");
+        case Opcode::dup_x2: return shuffle(3, 0b101, "acba");
+        case Opcode::dup2: return shuffle(2, 0b10, "baba");
+        case Opcode::dup2_x1: return shuffle(3, 0b110, "bacba");
+        case Opcode::dup2_x2: return shuffle(4, 0b1010, "badcba");
+        case Opcode::swap: return shuffle(2, 0b11, "ab");
+
+        case Opcode::iadd:
+        case Opcode::isub:
+        case Opcode::imul:
+        case Opcode::idiv:
+        case Opcode::irem:
+        case Opcode::ishl:
+        case Opcode::ishr:
+        case Opcode::iushr:
+        case Opcode::iand:
+        case Opcode::ior:
+        case Opcode::ixor:
+          return pop(int_type) and pop(int_type) and push(int_type);
+        case Opcode::ladd:
+        case Opcode::lsub:
+        case Opcode::lmul:
+        case Opcode::ldiv:
+        case Opcode::lrem:
+        case Opcode::land:
+        case Opcode::lor:
+        case Opcode::lxor:
+          return pop(long_type) and pop(long_type) and push(long_type);
+        case Opcode::lshl:
+        case Opcode::lshr:
+        case Opcode::lushr:
+          return pop(int_type) and pop(long_type) and push(long_type);
+        case Opcode::fadd:
+        case Opcode::fsub:
+        case Opcode::fmul:
+        case Opcode::fdiv:
+        case Opcode::frem:
+          return pop(float_type) and pop(float_type) and push(float_type);
+        case Opcode::dadd:
+        case Opcode::dsub:
+        case Opcode::dmul:
+        case Opcode::ddiv:
+        case Opcode::drem:
+          return pop(double_type) and pop(double_type) and
+                 push(double_type);
+        case Opcode::ineg:
+        case Opcode::i2b:
+        case Opcode::i2c:
+        case Opcode::i2s:
+          return pop(int_type) and push(int_type);
+        case Opcode::lneg: return pop(long_type) and push(long_type);
+        case Opcode::fneg: return pop(float_type) and push(float_type);
+        case Opcode::dneg: return pop(double_type) and push(double_type);
+        case Opcode::i2l: return pop(int_type) and push(long_type);
+        case Opcode::i2f: return pop(int_type) and push(float_type);
+        case Opcode::i2d: return pop(int_type) and push(double_type);
+        case Opcode::l2i: return pop(long_type) and push(int_type);
+        case Opcode::l2f: return pop(long_type) and push(float_type);
+        case Opcode::l2d: return pop(long_type) and push(double_type);
+        case Opcode::f2i: return pop(float_type) and push(int_type);
+        case Opcode::f2l: return pop(float_type) and push(long_type);
+        case Opcode::f2d: return pop(float_type) and push(double_type);
+        case Opcode::d2i: return pop(double_type) and push(int_type);
+        case Opcode::d2l: return pop(double_type) and push(long_type);
+        case Opcode::d2f: return pop(double_type) and push(float_type);
+        case Opcode::lcmp:
+          return pop(long_type) and pop(long_type) and push(int_type);
+        case Opcode::fcmpl:
+        case Opcode::fcmpg:
+          return pop(float_type) and pop(float_type) and push(int_type);
+        case Opcode::dcmpl:
+        case Opcode::dcmpg:
+          return pop(double_type) and pop(double_type) and push(int_type);
+
+        case Opcode::ifeq:
+        case Opcode::ifne:
+        case Opcode::iflt:
+        case Opcode::ifge:
+        case Opcode::ifgt:
+        case Opcode::ifle:
+          return pop(int_type) and
+                 flow(int64_t(bci) + int16_t(read_u2(bytes + 1)), true);
+        case Opcode::if_icmpeq:
+        case Opcode::if_icmpne:
+        case Opcode::if_icmplt:
+        case Opcode::if_icmpge:
+        case Opcode::if_icmpgt:
+        case Opcode::if_icmple:
+          return pop(int_type) and pop(int_type) and
+                 flow(int64_t(bci) + int16_t(read_u2(bytes + 1)), true);
+        case Opcode::if_acmpeq:
+        case Opcode::if_acmpne:
+          return pop_reference(type) and pop_reference(type) and
+                 flow(int64_t(bci) + int16_t(read_u2(bytes + 1)), true);
+        case Opcode::ifnull:
+        case Opcode::ifnonnull:
+          return pop_reference(type) and
+                 flow(int64_t(bci) + int16_t(read_u2(bytes + 1)), true);
+        case Opcode::goto_:
+          ends = true;
+          return flow(int64_t(bci) + int16_t(read_u2(bytes + 1)), true);
+        case Opcode::goto_w:
+          ends = true;
+          return flow(int64_t(bci) + int32_t(read_u4(bytes + 1)), true);
+        case Opcode::tableswitch:
+        case Opcode::lookupswitch: {
+          ends = true;
+          if (not pop(int_type)) { return false; }
+          uint8_t const *operands = code.code + ((bci + 4) & ~uint32_t(3));
+          if (not flow(int64_t(bci) + int32_t(read_u4(operands)), true)) {
+            return false;
+          }
+          uint32_t count = 0;
+          size_t stride = 8;
+          if (opcode == Opcode::tableswitch) {
+            count = uint32_t(int64_t(int32_t(read_u4(operands + 8))) -
+                             int32_t(read_u4(operands + 4)) + 1);
+            operands += 12;
+            stride = 4;
+          } else {
+            count = read_u4(operands + 4);
+            operands += 12;
+          }
+          for (uint32_t i = 0; i < count; ++i) {
+            int32_t offset = int32_t(read_u4(operands + size_t(i) * stride));
+            if (not flow(int64_t(bci) + offset, true)) { return false; }
+          }
+          return true;
+        }
+
+        case Opcode::ireturn:
+        case Opcode::lreturn:
+        case Opcode::freturn:
+        case Opcode::dreturn:
+        case Opcode::areturn:
+        case Opcode::return_: {
+          ends = true;
+          char returned = return_type(descriptor);
+          if (opcode == Opcode::return_) {
+            if (returned != 'V') {
+              return fail("Method expects a return value");
+            }
+            if (method_name.equals("<init>")) {
+              for (uint32_t i = 0; i < max_locals; ++i) {
+                if (locals[i] == uninitialized_this_type) {
+                  return fail("Constructor must call super() or this() "
+                              "before return");
+                }
+              }
+            }
+            return true;
+          }
+          char const *expected = nullptr;
+          switch (opcode) {
+            case Opcode::ireturn: expected = "IZBCS"; break;
+            case Opcode::lreturn: expected = "J"; break;
+            case Opcode::freturn: expected = "F"; break;
+            case Opcode::dreturn: expected = "D"; break;
+            default: expected = "L["; break;
+          }
+          if (returned == 0 or strchr(expected, returned) == nullptr) {
+            return fail("Bad return type");
+          }
+          uint16_t position = 1;
+          while (descriptor.bytes[position] != ')') { ++position; }
+          ++position;
+          return pop(type_of(descriptor, position,
+                             uint16_t(descriptor.length - position)));
+        }
+        case Opcode::athrow:
+          ends = true;
+          return pop(object("java/lang/Throwable"));
+
+        case Opcode::getstatic:
+        case Opcode::putstatic:
+        case Opcode::getfield:
+        case Opcode::putfield:
+          return access_field(opcode, read_u2(bytes + 1));
+        case Opcode::invokevirtual:
+        case Opcode::invokespecial:
+        case Opcode::invokestatic:
+        case Opcode::invokeinterface:
+          return invoke(opcode, bytes);
+
+        case Opcode::new_:
+          if (not class_type(read_u2(bytes + 1), type)) { return false; }
+          if (names[type.data].bytes[0] == '[') {
+            return fail("Illegal use of new on an array class");
+          }
+          return push(Type {Item::uninitialized, uint16_t(bci)});
+        case Opcode::newarray:
+          if (bytes[1] < 4 or bytes[1] > 11) {
+            return fail("Bad newarray type");
+          }
+          return pop(int_type) and
+                 push(object(primitive_array_names[bytes[1] - 4]));
+        case Opcode::anewarray: {
+          if (not class_type(read_u2(bytes + 1), type) or not pop(int_type)) {
+            return false;
+          }
+          // `[` then the descriptor of the element class.
+          Utf8View element = names[type.data];
+          bool nested = element.bytes[0] == '[';
+          uint32_t length = element.length + (nested ? 1u : 3u);
+          if (length > 0xffff) { return fail("Array type too long"); }
+          auto *name = static_cast<uint8_t *>(arena.allocate(length, 1));
+          uint8_t *end = name;
+          *end++ = '[';
+          if (not nested) { *end++ = 'L'; }
+          memcpy(end, element.bytes, element.length);
+          end += element.length;
+          if (not nested) { *end = ';'; }
+          return push(object(Utf8View {name, uint16_t(length)}));
+        }
+        case Opcode::arraylength:
+          return pop_reference(type) and
+                 (type.item == Item::null or
+                  (type.item == Item::object and
+                   names[type.data].bytes[0] == '[') or
+                  fail("Expecting an array on the operand stack")) and
+                 push(int_type);
+        case Opcode::checkcast:
+          return class_type(read_u2(bytes + 1), array) and
+                 pop(object("java/lang/Object")) and push(array);
+        case Opcode::instanceof:
+          return class_type(read_u2(bytes + 1), array) and
+                 pop(object("java/lang/Object")) and push(int_type);
+        case Opcode::monitorenter:
+        case Opcode::monitorexit:
+          return pop(object("java/lang/Object"));
+        case Opcode::multianewarray: {
+          if (not class_type(read_u2(bytes + 1), type)) { return false; }
+          uint8_t dimensions = bytes[3];
+          Utf8View name = names[type.data];
+          if (dimensions == 0 or name.length <= dimensions) {
+            return fail("Bad multianewarray dimensions");
+          }
+          for (uint8_t i = 0; i < dimensions; ++i) {
+            if (name.bytes[i] != '[') {
+              return fail("Bad multianewarray dimensions");
+            }
+            if (not pop(int_type)) { return false; }
+          }
+          return push(type);
+        }
+
+        default:
+          break;
+      }
+
+      // The short forms of loads and stores, in groups of four.
+      constexpr Item kinds[] {
+        Item::integer, Item::long_, Item::float_, Item::double_, Item::object,
+      };
+      auto const raw = uint8_t(opcode);
+      if (raw >= uint8_t(Opcode::iload_0) and raw <= uint8_t(Opcode::aload_3)) {
+        unsigned offset = raw - uint8_t(Opcode::iload_0);
+        return load(kinds[offset / 4], offset % 4);
+      }
+      if (raw >= uint8_t(Opcode::istore_0) and
+          raw <= uint8_t(Opcode::astore_3)) {
+        unsigned offset = raw - uint8_t(Opcode::istore_0);
+        return store(kinds[offset / 4], offset % 4);
+      }
+      // `jsr`, `ret` and `invokedynamic`.
+      return fail("Unsupported instruction");
+    }
+
+    /// Set the state to what the method starts with: the receiver and the
+    /// parameters in the locals, the rest \c top, and an empty stack.
+    auto TypeChecker::initial_state() -> bool {
+      this_class = name_index(class_file.this_class_name());
+      for (uint32_t i = 0; i < max_locals; ++i) { locals[i] = top_type; }
+      depth = 0;
+      uint32_t slot = 0;
+      if ((access_flags & access::static_) == 0) {
+        if (max_locals == 0) { return fail("Arguments can't fit into locals"); }
+        bool constructs = method_name.equals("<init>") and
+                          not names[this_class].equals("java/lang/Object");
+        locals[slot++] = constructs ? uninitialized_this_type
+                                    : Type {Item::object, this_class};
+      }
+      for (uint16_t position = 1; position < descriptor.length and
+                                  descriptor.bytes[position] != ')';) {
+        uint16_t length = field_type_length(descriptor, position);
+        if (length == 0) { return fail("Bad method descriptor"); }
+        Type type = type_of(descriptor, position, length);
+        uint32_t slots = is_wide(type) ? 2 : 1;
+        if (slot + slots > max_locals) {
+          return fail("Arguments can't fit into locals");
+        }
+        locals[slot] = type;
+        if (slots == 2) { locals[slot + 1] = top_type; }
+        slot += slots;
+        position = uint16_t(position + length);
+      }
+      parameter_slots = uint16_t(slot);
+      return true;
+    }
+
+    auto TypeChecker::read_type(uint8_t const *&position, uint8_t const *end,
+                                Type &type) -> bool {
+      if (position >= end) { return fail("Truncated StackMapTable"); }
+      auto item = Item(*position++);
+      switch (item) {
+        case Item::top:
+        case Item::integer:
+        case Item::float_:
+        case Item::double_:
+        case Item::long_:
+        case Item::null:
+        case Item::uninitialized_this:
+          type = Type {item, 0};
+          return true;
+        case Item::object:
+          if (end - position < 2) { return fail("Truncated StackMapTable"); }
+          position += 2;
+          return class_type(read_u2(position - 2), type);
+        case Item::uninitialized: {
+          if (end - position < 2) { return fail("Truncated StackMapTable"); }
+          uint16_t offset = read_u2(position);
+          position += 2;
+          if (offset >= code.code_length or
+              Opcode(code.code[offset]) != Opcode::new_) {
+            return fail("Uninitialized type without a new instruction");
+          }
+          type = Type {Item::uninitialized, offset};
+          return true;
+        }
+      }
+      return fail("Bad verification type in StackMapTable");
+    }
+
+    /// Expand the \c StackMapTable of the code into \c frames.
+    auto TypeChecker::parse_frames() -> bool {
+      AttributeView attribute = class_file.find_attribute(code.attributes,
+                                                          "StackMapTable");
+      if (not attribute.is_present()) { return true; }
+      uint8_t const *position = attribute.data;
+      uint8_t const *end = attribute.data + attribute.length;
+      if (attribute.length < 2) { return fail("Truncated StackMapTable"); }
+      uint16_t count = read_u2(position);
+      position += 2;
+      frames = arena.allocate_array<Frame>(count);
+
+      // The locals as the previous frame left them, each entry taking one
+      // slot, or two for a long or a double.
+      Type *current = arena.allocate_array<Type>(max_locals);
+      memcpy(current, locals, sizeof(Type) * max_locals);
+      uint32_t used = parameter_slots;
+      int64_t previous = -1;
+      for (uint16_t i = 0; i < count; ++i) {
+        if (position >= end) { return fail("Truncated StackMapTable"); }
+        uint8_t kind = *position++;
+        uint32_t delta = kind;
+        if (kind >= 64 and kind < 128) {
+          delta = kind - 64u;
+        } else if (kind >= 128) {
+          if (kind < 247) { return fail("Bad StackMapTable frame type"); }
+          if (end - position < 2) { return fail("Truncated StackMapTable"); }
+          delta = read_u2(position);
+          position += 2;
+        }
+        int64_t at = previous + int64_t(delta) + 1;
+        if (at >= code.code_length) {
+          return fail("StackMapTable frame beyond the end of the code");
+        }
+        previous = at;
+
+        // The stack of this frame, at most two slots but for full frames.
+        Type stack_item {};
+        uint32_t stack_count = 0;
+        Type const *stack_items = &stack_item;
+        if ((kind >= 64 and kind < 128) or kind == 247) {
+          if (not read_type(position, end, stack_item)) { return false; }
+          stack_count = 1;
+        } else if (kind >= 248 and kind <= 250) {
+          for (uint32_t k = 251u - kind; k > 0; --k) {
+            if (used == 0) { return fail("Bad chop frame in StackMapTable"); }
+            uint32_t slots = used >= 2 and is_wide(current[used - 2]) ? 2 : 1;
+            used -= slots;
+            for (uint32_t s = 0; s < slots; ++s) {
+              current[used + s] = top_type;
+            }
+          }
+        } else if (kind >= 252) {
+          uint32_t appended = kind == 255 ? 0 : kind - 251u;
+          if (kind == 255) {
+            if (end - position < 2) { return fail("Truncated StackMapTable"); }
+            appended = read_u2(position);
+            position += 2;
+            for (uint32_t s = 0; s < max_locals; ++s) {
+              current[s] = top_type;
+            }
+            used = 0;
+          }
+          for (uint32_t k = 0; k < appended; ++k) {
+            Type type {};
+            if (not read_type(position, end, type)) { return false; }
+            uint32_t slots = is_wide(type) ? 2 : 1;
+            if (used + slots > max_locals) {
+              return fail("StackMapTable frame has too many locals");
+            }
+            current[used] = type;
+            if (slots == 2) { current[used + 1] = top_type; }
+            used += slots;
+          }
+          if (kind == 255) {
+            if (end - position < 2) { return fail("Truncated StackMapTable"); }
+            stack_count = read_u2(position);
+            position += 2;
+            auto *items = arena.allocate_array<Type>(stack_count);
+            for (uint32_t k = 0; k < stack_count; ++k) {
+              if (not read_type(position, end, items[k])) { return false; }
+            }
+            stack_items = items;
+          }
+        }
+
+        Frame &frame = frames[i];
+        frame.bci = uint32_t(at);
+        uint32_t slots = 0;
+        for (uint32_t k = 0; k < stack_count; ++k) {
+          slots += is_wide(stack_items[k]) ? 2 : 1;
+        }
+        if (slots > max_stack) {
+          return fail("StackMapTable frame has too deep a stack");
+        }
+        frame.depth = uint16_t(slots);
+        frame.slots = arena.allocate_array<Type>(size_t(max_locals) + slots);
+        memcpy(frame.slots, current, sizeof(Type) * max_locals);
+        Type *slot = frame.slots + max_locals;
+        for (uint32_t k = 0; k < stack_count; ++k) {
+          *slot++ = stack_items[k];
+          if (is_wide(stack_items[k])) { *slot++ = top_type; }
+        }
+      }
+      if (position != end) { return fail("Trailing bytes in StackMapTable"); }
+      frame_count = count;
+      return true;
+    }
+
+    /// Whether the current state is assignable to \p frame.
+    auto TypeChecker::matches(Frame const &frame) -> bool {
+      if (depth != frame.depth) {
+        return fail("Stack size does not match the stack map frame");
+      }
+      for (uint32_t i = 0; i < max_locals; ++i) {
+        if (not is_assignable(locals[i], frame.slots[i])) {
+          return fail("Local variable type does not match the stack map "
+                      "frame");
+        }
+      }
+      for (uint32_t i = 0; i < depth; ++i) {
+        if (not is_assignable(stack[i], frame.slots[max_locals + i])) {
+          return fail("Operand stack type does not match the stack map "
+                      "frame");
+        }
+      }
+      return true;
+    }
+
+    auto TypeChecker::check() -> bool {
+      if (not initial_state() or not parse_frames()) { return false; }
+      uint32_t next = 0;
+      bool reachable = true;
+      for (bci = 0; bci < code.code_length;) {
+        uint32_t size = instruction_length(code.code, code.code_length, bci);
+        if (size == 0) { return fail("Bad instruction"); }
+        if (next < frame_count and frames[next].bci < bci) {
+          return fail("StackMapTable frame inside an instruction");
+        }
+        if (next < frame_count and frames[next].bci == bci) {
+          // The frame replaces the state, which must agree with it.
+          Frame const &frame = frames[next++];
+          if (reachable and not matches(frame)) { return false; }
+          memcpy(locals, frame.slots, sizeof(Type) * max_locals);
+          memcpy(stack, frame.slots + max_locals, sizeof(Type) * frame.depth);
+          depth = frame.depth;
+        } else if (not reachable) {
+          return fail("Expecting a stack map frame after an unconditional "
+                      "jump");
+        }
+        bool ends = false;
+        if (not check_handlers() or not step(ends)) { return false; }
+        reachable = not ends;
+        bci += size;
+      }
+      if (next < frame_count) {
+        return fail("StackMapTable frame inside an instruction");
+      }
+      if (reachable) { return fail("Falling off the end of the code"); }
+      return true;
+    }
+
+    auto TypeChecker::infer() -> bool {
+      inferring = true;
+      uint32_t length = code.code_length;
+      states = arena.allocate_array<Type *>(length);
+      depths = arena.allocate_array<uint16_t>(length);
+      starts = arena.allocate_array<bool>(length);
+      needs_frame = arena.allocate_array<bool>(length);
+      for (uint32_t at = 0; at < length;) {
+        uint32_t size = instruction_length(code.code, length, at);
+        if (size == 0) {
+          bci = at;
+          return fail("Bad instruction");
+        }
+        starts[at] = true;
+        at += size;
+      }
+      if (length == 0) { return fail("Empty code"); }
+      if (not initial_state() or not flow(0, false)) { return false; }
+
+      while (not pending.is_empty()) {
+        bci = pending.pop();
+        memcpy(locals, states[bci], sizeof(Type) * max_locals);
+        depth = depths[bci];
+        memcpy(stack, states[bci] + max_locals, sizeof(Type) * depth);
+        bool ends = false;
+        if (not check_handlers() or not step(ends)) { return false; }
+        uint32_t next = bci + instruction_length(code.code, length, bci);
+        if (ends) {
+          if (next < length) { needs_frame[next] = true; }
+        } else if (next >= length) {
+          return fail("Falling off the end of the code");
+        } else if (not flow(next, false)) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    auto TypeChecker::write_type(PodVector<uint8_t> &table, Type type,
+                                 ClassConstantFunction class_constant,
+                                 void *context) -> void {
+      table.push(uint8_t(type.item));
+      uint16_t operand = 0;
+      if (type.item == Item::object) {
+        operand = class_constant(context, names[type.data]);
+      } else if (type.item == Item::uninitialized) {
+        operand = type.data;
+      } else {
+        return;
+      }
+      table.push(uint8_t(operand >> 8));
+      table.push(uint8_t(operand));
+    }
+
+    auto TypeChecker::encode(PodVector<uint8_t> &table,
+                             ClassConstantFunction class_constant,
+                             void *context) -> int32_t {
+      // Frames list a long or a double once, and leave out the unused
+      // locals at the end.
+      auto entries = [this](Type const *slots, uint32_t count,
+                            Type *listed, bool trim) {
+        uint32_t listed_count = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+          listed[listed_count++] = slots[i];
+          if (is_wide(slots[i])) { ++i; }
+        }
+        while (trim and listed_count > 0 and
+               listed[listed_count - 1] == top_type) {
+          --listed_count;
+        }
+        return listed_count;
+      };
+      auto write_u2 = [&table](uint32_t value) {
+        table.push(uint8_t(value >> 8));
+        table.push(uint8_t(value));
+      };
+
+      auto *previous = arena.allocate_array<Type>(max_locals);
+      auto *current = arena.allocate_array<Type>(max_locals);
+      auto *stack_entries = arena.allocate_array<Type>(max_stack);
+      if (not initial_state()) { return -1; }
+      uint32_t previous_count = entries(locals, max_locals, previous, true);
+      int64_t previous_bci = -1;
+      int32_t count = 0;
+      for (uint32_t at = 0; at < code.code_length; ++at) {
+        if (not needs_frame[at] or states[at] == nullptr) { continue; }
+        Type const *state = states[at];
+        uint32_t local_count = entries(state, max_locals, current, true);
+        uint32_t stack_count = entries(state + max_locals, depths[at],
+                                       stack_entries, false);
+        auto delta = uint32_t(int64_t(at) - previous_bci - 1);
+        uint32_t common = local_count < previous_count ? local_count
+                                                       : previous_count;
+        bool same_prefix =
+          memcmp(previous, current, sizeof(Type) * common) == 0;
+        if (same_prefix and local_count == previous_count and
+            stack_count == 0) {
+          if (delta < 64) {
+            table.push(uint8_t(delta));
+          } else {
+            table.push(251);
+            write_u2(delta);
+          }
+        } else if (same_prefix and local_count == previous_count and
+                   stack_count == 1) {
+          if (delta < 64) {
+            table.push(uint8_t(64 + delta));
+          } else {
+            table.push(247);
+            write_u2(delta);
+          }
+          write_type(table, stack_entries[0], class_constant, context);
+        } else if (same_prefix and stack_count == 0 and
+                   local_count < previous_count and
+                   previous_count - local_count <= 3) {
+          table.push(uint8_t(251 - (previous_count - local_count)));
+          write_u2(delta);
+        } else if (same_prefix and stack_count == 0 and
+                   local_count > previous_count and
+                   local_count - previous_count <= 3) {
+          table.push(uint8_t(251 + (local_count - previous_count)));
+          write_u2(delta);
+          for (uint32_t i = previous_count; i < local_count; ++i) {
+            write_type(table, current[i], class_constant, context);
+          }
+        } else {
+          table.push(255);
+          write_u2(delta);
+          write_u2(local_count);
+          for (uint32_t i = 0; i < local_count; ++i) {
+            write_type(table, current[i], class_constant, context);
+          }
+          write_u2(stack_count);
+          for (uint32_t i = 0; i < stack_count; ++i) {
+            write_type(table, stack_entries[i], class_constant, context);
+          }
+        }
+        memcpy(previous, current, sizeof(Type) * local_count);
+        previous_count = local_count;
+        previous_bci = at;
+        ++count;
+      }
+      return count;
+    }
+  } // namespace
+
+  auto describe(VerifyMode mode) -> char const * {
+    switch (mode) {
+      case VerifyMode::none: return "none";
+      case VerifyMode::remote: return "remote";
+      case VerifyMode::all: return "all";
+    }
+    return "unknown";
+  }
+
+  auto needs_verification(VerifyMode mode, Klass const &klass) -> bool {
+    switch (mode) {
+      case VerifyMode::none:
+        return false;
+      case VerifyMode::remote:
+        return not (klass.name.length > 5 and
+                    memcmp(klass.name.bytes, "java/", 5) == 0);
+      case VerifyMode::all:
+        return true;
+    }
+    return true;
+  }
+
+  auto verify_method(Method const &method, ClassRegistry &registry,
+                     Arena &arena, char *message, size_t message_size)
+      -> bool {
+    ClassFile const &class_file = *method.holder->class_file;
+    TypeChecker checker(class_file, method.access_flags, method.name,
+                        method.descriptor, method.code, arena, &registry);
+    bool safe = class_file.get_major_version() >= 50 ? checker.check()
+                                                     : checker.infer();
+    if (not safe) {
+      snprintf(message, message_size, "%s in %.*s.%.*s%.*s at offset %u",
+               checker.get_error(),
+               int(method.holder->name.length), method.holder->name.bytes,
+               int(method.name.length), method.name.bytes,
+               int(method.descriptor.length), method.descriptor.bytes,
+               checker.get_bci());
+    }
+    return safe;
+  }
+
+  auto infer_stack_map_table(ClassFile const &constants,
+                             uint16_t access_flags, Utf8View name,
+                             Utf8View descriptor, CodeView const &code,
+                             ClassConstantFunction class_constant,
+                             void *context, PodVector<uint8_t> &table)
+      -> int32_t {
+    Arena arena;
+    TypeChecker checker(constants, access_flags, name, descriptor, code,
+                        arena, nullptr);
+    if (not checker.infer()) { return -1; }
+    return checker.encode(table, class_constant, context);
+  }
+} // namespace skjvm
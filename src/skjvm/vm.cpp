@@ -0,0 +1,862 @@
+#include <skjvm/vm.hpp>
+
+#include <skjvm/descriptor.hpp>
+#include <skjvm/natives.hpp>
+#include <skjvm/unicode.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+namespace skjvm {
+  namespace {
+    auto nanoseconds() -> int64_t {
+      timespec now {};
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      return int64_t(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    /// Names of the primitive array classes, by \c BasicType.
+    constexpr char const *primitive_array_names[] {
+      "[Z", "[C", "[F", "[D", "[B", "[S", "[I", "[J",
+    };
+
+    static_assert(sizeof(primitive_array_names) / sizeof(char const *) ==
+                  size_t(BasicType::reference));
+
+    /// The \c detailMessage field of \p klass, a throwable class.
+    auto message_field(Klass const *klass) -> Field * {
+      for (; klass != nullptr; klass = klass->super) {
+        if (klass->name.equals("java/lang/Throwable")) {
+          return klass->find_field(make_view("detailMessage"),
+                                   make_view("Ljava/lang/String;"));
+        }
+      }
+      return nullptr;
+    }
+
+    /// A method searched in the interfaces of \p klass and its super
+    /// classes that has code, as a default method does.
+    auto find_default_method(Klass const *klass, Utf8View name,
+                             Utf8View descriptor) -> Method * {
+      for (; klass != nullptr; klass = klass->super) {
+        for (uint16_t i = 0; i < klass->interface_count; ++i) {
+          Klass const *interface = klass->interfaces[i];
+          Method *method = interface->find_method(name, descriptor);
+          if (method != nullptr and
+              (method->access_flags & access::abstract) == 0) {
+            return method;
+          }
+          method = find_default_method(interface, name, descriptor);
+          if (method != nullptr) { return method; }
+        }
+      }
+      return nullptr;
+    }
+
+    /// Throw \p class_name with \p prefix and the name of \p method as
+    /// its message. Kept out of line so that the message buffer does not
+    /// grow the native frame of every Java call.
+    __attribute__((noinline))
+    auto throw_method_error(Thread &thread, char const *class_name,
+                            char const *prefix, Method const &method)
+        -> void {
+      char message[512];
+      snprintf(message, sizeof(message), "%s%.*s.%.*s%.*s", prefix,
+               int(method.holder->name.length), method.holder->name.bytes,
+               int(method.name.length), method.name.bytes,
+               int(method.descriptor.length), method.descriptor.bytes);
+      thread.get_vm().throw_new(thread, class_name, message);
+    }
+
+    /// The interfaces of \p klass and of its super classes and interfaces,
+    /// each once.
+    struct InterfaceSet {
+      Klass **interfaces {nullptr};
+      uint32_t count {0};
+      uint32_t capacity {0};
+
+      auto add_all(Klass const *klass) -> void {
+        for (; klass != nullptr; klass = klass->super) {
+          for (uint16_t i = 0; i < klass->interface_count; ++i) {
+            add(klass->interfaces[i]);
+          }
+        }
+      }
+
+      auto add(Klass *interface) -> void {
+        for (uint32_t i = 0; i < count; ++i) {
+          if (interfaces[i] == interface) { return; }
+        }
+        if (count == capacity) {
+          capacity = capacity == 0 ? 8 : capacity * 2;
+          interfaces = static_cast<Klass **>(
+            checked_realloc(interfaces, capacity * sizeof(Klass *)));
+        }
+        interfaces[count++] = interface;
+        add_all(interface);
+      }
+    };
+
+    /// Throw \p class_name with \p prefix and the name of \p method as
+    auto print_class_name(FILE *stream, Utf8View name) -> void {
+      for (uint16_t i = 0; i < name.length; ++i) {
+        fputc(name.bytes[i] == '/' ? '.' : name.bytes[i], stream);
+      }
+    }
+  } // namespace
+
+  Thread::Thread(VM &vm, size_t stack_slots) noexcept
+    : vm(vm),
+      stack_base(static_cast<Value *>(
+        checked_calloc(stack_slots, sizeof(Value)))),
+      stack_limit(stack_base + stack_slots) {
+    // Java calls nest native frames too: stop them well before the end of
+    // the native stack of the thread creating this one, which is the one
+    // it runs on.
+    pthread_attr_t attributes;
+    void *address = nullptr;
+    size_t size = 0;
+    if (pthread_getattr_np(pthread_self(), &attributes) == 0) {
+      pthread_attr_getstack(&attributes, &address, &size);
+      pthread_attr_destroy(&attributes);
+    }
+    if (address != nullptr and size > 2 * native_stack_reserve) {
+      native_stack_limit = static_cast<char *>(address) +
+                           native_stack_reserve;
+    }
+    vm.attach(*this);
+  }
+
+  Thread::~Thread() noexcept {
+    vm.detach(*this);
+    vm.add_inline_cache_stats(inline_cache_hits, inline_cache_misses, 0);
+    free(stack_base);
+  }
+
+  VM::VM(ClassRegistry &registry, size_t heap_size, size_t young_size) noexcept
+    : registry(registry), heap(heap_size, young_size) {}
+
+  VM::~VM() noexcept {
+    // Methods belong to the registry, which may outlive this VM; the code
+    // decoded and compiled for them, and their counters, do not.
+    for (Klass *klass : registry.get_classes()) {
+      for (uint16_t i = 0; i < klass->method_count; ++i) {
+        Method &method = klass->methods[i];
+        method.decoded = nullptr;
+        method.compiled = nullptr;
+        method.invocation_count = 0;
+        method.backedge_count = 0;
+        method.recompilations = 0;
+        method.not_compilable = false;
+        method.verification = VerifyState::unverified;
+        method.verify_error = nullptr;
+      }
+      klass->verified_methods = 0;
+      klass->verify_time = 0;
+      free(klass->itable);
+      klass->itable = nullptr;
+      klass->lock = nullptr;
+    }
+    registry.get_symbols().clear_strings();
+    pthread_mutex_destroy(&code_mutex);
+    pthread_mutex_destroy(&thread_mutex);
+  }
+
+  auto VM::attach(Thread &thread) -> void {
+    pthread_mutex_lock(&thread_mutex);
+    if (not free_thread_ids.is_empty()) {
+      thread.id = free_thread_ids.pop();
+    } else if (next_thread_id <= Monitors::max_threads) {
+      thread.id = next_thread_id++;
+    } else {
+      fatal("more than %u threads", Monitors::max_threads);
+    }
+    thread.thin_lock = uint32_t(Monitors::thin_lock(thread.id));
+    threads.push(&thread);
+    pthread_mutex_unlock(&thread_mutex);
+  }
+
+  auto VM::detach(Thread &thread) -> void {
+    pthread_mutex_lock(&thread_mutex);
+    for (size_t i = 0; i < threads.get_size(); ++i) {
+      if (threads[i] == &thread) {
+        threads[i] = threads[threads.get_size() - 1];
+        threads.pop();
+        break;
+      }
+    }
+    free_thread_ids.push(thread.id);
+    pthread_mutex_unlock(&thread_mutex);
+  }
+
+  auto VM::link_or_throw(Thread &thread, Utf8View name) -> Klass * {
+    LinkError error = LinkError::none;
+    Klass *klass = registry.link(name, error);
+    if (klass == nullptr) {
+      throw_link_error(thread, error, name);
+    }
+    return klass;
+  }
+
+  auto VM::allocate(Thread &thread, Klass &klass, size_t size) -> Object * {
+    if (out_of_memory == nullptr) {
+      Klass *error_class = link_or_throw(
+        thread, make_view("java/lang/OutOfMemoryError"));
+      if (error_class == nullptr) { return nullptr; }
+      out_of_memory = static_cast<Object *>(
+        heap.allocate(thread.tlab, error_class->instance_size));
+      if (out_of_memory == nullptr) {
+        fatal("the Java heap is too small to start");
+      }
+      out_of_memory->init_header(error_class);
+    }
+    void *memory = heap.allocate(thread.tlab, size);
+    if (memory == nullptr and collect(thread)) {
+      memory = heap.allocate(thread.tlab, size);
+      // Eden is empty now, so only the old generation can be full.
+      if (memory == nullptr and collect(thread, true)) {
+        memory = heap.allocate(thread.tlab, size);
+      }
+    }
+    if (memory == nullptr) {
+      thread.exception = out_of_memory;
+      return nullptr;
+    }
+    auto *object = static_cast<Object *>(memory);
+    object->init_header(&klass);
+    return object;
+  }
+
+  /// Add the slots of the frames of \p thread that hold references to
+  /// \c roots, as the stack maps of their current instructions tell.
+  auto VM::add_roots(Thread &thread) -> void {
+    Value const *limit = nullptr;
+    for (Frame *frame = thread.frame; frame != nullptr;
+         frame = frame->caller) {
+      DecodedMethod const &decoded = *frame->method->decoded;
+      auto index = uint32_t(frame->ip - decoded.code);
+      uint16_t depth = decoded.depths[index];
+      if (depth == UINT16_MAX) {
+        fatal("no stack map for %.*s.%.*s at %u",
+              int(frame->method->holder->name.length),
+              frame->method->holder->name.bytes,
+              int(frame->method->name.length), frame->method->name.bytes,
+              decoded.bci_of(frame->ip));
+      }
+      // What the frame popped is gone, and the arguments of the frame it
+      // calls are the locals of that one, which has its own map.
+      Value *end = frame->stack + depth;
+      if (frame->sp < end) { end = frame->sp; }
+      if (limit != nullptr and limit < end) {
+        end = const_cast<Value *>(limit);
+      }
+      for (Value *slot = frame->locals; slot < end; ++slot) {
+        if (slot->l != nullptr and
+            decoded.is_reference(index, uint32_t(slot - frame->locals))) {
+          roots.push(&slot->l);
+        }
+      }
+      limit = frame->locals;
+    }
+    if (thread.exception != nullptr) { roots.push(&thread.exception); }
+    for (Object **handle : thread.handles) { roots.push(handle); }
+  }
+
+  auto VM::collect(Thread &, bool full) -> bool {
+    pthread_mutex_lock(&thread_mutex);
+    roots.clear();
+    for (Thread *each : threads) {
+      each->tlab = {};
+      add_roots(*each);
+    }
+    weak_roots.clear();
+    registry.get_symbols().add_weak_roots(weak_roots);
+    if (out_of_memory != nullptr) { roots.push(&out_of_memory); }
+    monitors.add_roots(roots);
+    for (Klass *klass : registry.get_classes()) {
+      if (klass->lock != nullptr) { roots.push(&klass->lock); }
+      for (uint16_t i = 0; i < klass->field_count; ++i) {
+        Field const &field = klass->fields[i];
+        if (field.is_static() and field.type == BasicType::reference) {
+          roots.push(reinterpret_cast<Object **>(klass->static_storage +
+                                                 field.offset));
+        }
+      }
+    }
+    bool collected = not full and heap.collect_young(roots, weak_roots);
+    if (not collected) {
+      heap.collect_full(roots, weak_roots);
+      collected = heap.collect_young(roots, weak_roots);
+    }
+    pthread_mutex_unlock(&thread_mutex);
+    return collected;
+  }
+
+  auto VM::initialize(Thread &thread, Klass &klass) -> bool {
+    switch (klass.state) {
+      case ClassState::initialized:
+      // Asked again by its own initializer.
+      case ClassState::initializing:
+        return true;
+      case ClassState::erroneous: {
+        char message[512];
+        snprintf(message, sizeof(message), "Could not initialize class %.*s",
+                 int(klass.name.length), klass.name.bytes);
+        throw_new(thread, "java/lang/NoClassDefFoundError", message);
+        return false;
+      }
+      case ClassState::linked:
+        break;
+    }
+
+    klass.state = ClassState::initializing;
+    if (klass.super != nullptr and not klass.is_interface() and
+        not initialize(thread, *klass.super)) {
+      klass.state = ClassState::erroneous;
+      return false;
+    }
+    Method *initializer = klass.find_method(make_view("<clinit>"),
+                                            make_view("()V"));
+    if (initializer != nullptr) {
+      Value *top = thread.frame != nullptr ? thread.frame->sp
+                                           : thread.get_stack_base();
+      (void)invoke(thread, *initializer, top);
+      if (thread.exception != nullptr) {
+        klass.state = ClassState::erroneous;
+        // Errors propagate as they are, anything else is wrapped.
+        Klass *error = registry.find(make_view("java/lang/Error"));
+        if (error == nullptr or
+            not is_assignable(thread.exception->get_klass(), error)) {
+          char message[512];
+          Utf8View name = thread.exception->get_klass()->name;
+          snprintf(message, sizeof(message), "%.*s", int(name.length),
+                   name.bytes);
+          for (char *c = message; *c != '\0'; ++c) {
+            if (*c == '/') { *c = '.'; }
+          }
+          thread.exception = nullptr;
+          throw_new(thread, "java/lang/ExceptionInInitializerError", message);
+        }
+        return false;
+      }
+    }
+    klass.state = ClassState::initialized;
+    return true;
+  }
+
+  auto VM::invoke(Thread &thread, Method &method, Value *arguments) -> Value {
+    if ((method.access_flags & access::synchronized) != 0) {
+      return invoke_synchronized(thread, method, arguments);
+    }
+    return call(thread, method, arguments);
+  }
+
+  /// Kept out of line so that the handle does not grow the native frame of
+  /// every Java call.
+  __attribute__((noinline))
+  auto VM::invoke_synchronized(Thread &thread, Method &method,
+                               Value *arguments) -> Value {
+    Object *object = method.is_static() ? class_lock(thread, *method.holder)
+                                        : arguments[0].l;
+    if (object == nullptr) { return {}; }
+    Handle<Object> lock(thread, object);
+    monitor_enter(thread, lock.get());
+    Value result = call(thread, method, arguments);
+    // Released however the method completes; failing to release it, the
+    // method throws that instead.
+    if (not monitors.exit(thread.id, lock.get())) {
+      thread.exception = nullptr;
+      throw_illegal_monitor_state(thread);
+      return {};
+    }
+    return result;
+  }
+
+  auto VM::call(Thread &thread, Method &method, Value *arguments) -> Value {
+    if ((method.access_flags & access::native) != 0) {
+      NativeFunction native = __atomic_load_n(&method.native,
+                                              __ATOMIC_ACQUIRE);
+      if (native == nullptr) {
+        native = find_native(method.holder->name, method.name,
+                             method.descriptor);
+        if (native == nullptr) {
+          throw_method_error(thread, "java/lang/UnsatisfiedLinkError", "",
+                             method);
+          return {};
+        }
+        __atomic_store_n(&method.native, native, __ATOMIC_RELEASE);
+      }
+      return native(thread, arguments);
+    }
+    if ((method.access_flags & access::abstract) != 0) {
+      throw_method_error(thread, "java/lang/AbstractMethodError", "", method);
+      return {};
+    }
+    if (decoded(thread, method) == nullptr) { return {}; }
+    return interpret(thread, mode, method, arguments);
+  }
+
+  auto VM::monitor_wait(Thread &thread, Object *object, int64_t millis)
+      -> bool {
+    if (millis < 0) {
+      throw_new(thread, "java/lang/IllegalArgumentException",
+                "timeout value is negative");
+      return false;
+    }
+    if (not monitors.wait(thread.id, object, millis)) {
+      throw_illegal_monitor_state(thread);
+      return false;
+    }
+    return true;
+  }
+
+  auto VM::monitor_notify(Thread &thread, Object *object, bool all) -> bool {
+    if (not monitors.notify(thread.id, object, all)) {
+      throw_illegal_monitor_state(thread);
+      return false;
+    }
+    return true;
+  }
+
+  auto VM::class_lock(Thread &thread, Klass &klass) -> Object * {
+    Object *lock = __atomic_load_n(&klass.lock, __ATOMIC_ACQUIRE);
+    if (lock != nullptr) { return lock; }
+    Klass *object_class = link_or_throw(thread,
+                                        make_view("java/lang/Object"));
+    if (object_class == nullptr) { return nullptr; }
+    lock = new_object(thread, *object_class);
+    if (lock == nullptr) { return nullptr; }
+    // Another thread may have been first.
+    Object *expected = nullptr;
+    if (not __atomic_compare_exchange_n(&klass.lock, &expected, lock, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return expected;
+    }
+    return lock;
+  }
+
+  auto VM::find_virtual(Klass &receiver, Method &method) -> Method * {
+    if (method.vtable_index >= 0 and not method.holder->is_interface()) {
+      return receiver.vtable[method.vtable_index];
+    }
+    for (Klass *klass = &receiver; klass != nullptr; klass = klass->super) {
+      Method *found = klass->find_method(method.name, method.descriptor);
+      if (found != nullptr and not found->is_static()) { return found; }
+    }
+    return find_default_method(&receiver, method.name, method.descriptor);
+  }
+
+  auto VM::find_interface_method(Klass &receiver, Method &method)
+      -> Method * {
+    Itable *itable = __atomic_load_n(&receiver.itable, __ATOMIC_ACQUIRE);
+    if (itable == nullptr) {
+      // Built once per class, in one block: the table, its entries, then
+      // their methods.
+      InterfaceSet set;
+      set.add_all(&receiver);
+      size_t method_count = 0;
+      for (uint32_t i = 0; i < set.count; ++i) {
+        method_count += set.interfaces[i]->method_count;
+      }
+      size_t size = sizeof(Itable) + set.count * sizeof(ItableEntry) +
+                    method_count * sizeof(Method *);
+      auto *block = static_cast<uint8_t *>(checked_calloc(1, size));
+      itable = reinterpret_cast<Itable *>(block);
+      itable->entries = reinterpret_cast<ItableEntry *>(block +
+                                                        sizeof(Itable));
+      itable->length = set.count;
+      auto **methods = reinterpret_cast<Method **>(itable->entries +
+                                                   set.count);
+      for (uint32_t i = 0; i < set.count; ++i) {
+        Klass *interface = set.interfaces[i];
+        itable->entries[i] = {interface, methods};
+        for (uint16_t j = 0; j < interface->method_count; ++j) {
+          Method &declared = interface->methods[j];
+          if (not declared.is_static() and declared.name.length != 0 and
+              declared.name.bytes[0] != '<') {
+            methods[j] = find_virtual(receiver, declared);
+          }
+        }
+        methods += interface->method_count;
+      }
+      free(set.interfaces);
+
+      Itable *expected = nullptr;
+      if (not __atomic_compare_exchange_n(&receiver.itable, &expected, itable,
+                                          false, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE)) {
+        // Another thread built the same table first.
+        free(itable);
+        itable = expected;
+      }
+    }
+
+    for (uint32_t i = 0; i < itable->length; ++i) {
+      ItableEntry const &entry = itable->entries[i];
+      if (entry.interface == method.holder) {
+        return entry.methods[&method - method.holder->methods];
+      }
+    }
+    return nullptr;
+  }
+
+  auto VM::get_inline_cache_stats() const -> InlineCacheStats {
+    return {
+      __atomic_load_n(&inline_cache_stats.hits, __ATOMIC_RELAXED),
+      __atomic_load_n(&inline_cache_stats.misses, __ATOMIC_RELAXED),
+      __atomic_load_n(&inline_cache_stats.megamorphic_sites,
+                      __ATOMIC_RELAXED),
+    };
+  }
+
+  auto VM::add_inline_cache_stats(uint64_t hits, uint64_t misses,
+                                  uint64_t megamorphic_sites) -> void {
+    __atomic_fetch_add(&inline_cache_stats.hits, hits, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&inline_cache_stats.misses, misses, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&inline_cache_stats.megamorphic_sites,
+                       megamorphic_sites, __ATOMIC_RELAXED);
+  }
+
+  auto VM::decoded(Thread &thread, Method &method) -> DecodedMethod * {
+    DecodedMethod *code = __atomic_load_n(&method.decoded, __ATOMIC_ACQUIRE);
+    if (code != nullptr) { return code; }
+
+    pthread_mutex_lock(&code_mutex);
+    code = method.decoded;
+    if (code == nullptr and method.verification != VerifyState::failed and
+        method.code.is_present() and
+        method.code.max_locals >= method.argument_slots) {
+      code = decode_method(method, code_arena);
+      if (code != nullptr and
+          method.verification == VerifyState::unverified and
+          needs_verification(verify_mode, *method.holder)) {
+        // The decoded code is only published once it type checks.
+        char message[512];
+        int64_t start = nanoseconds();
+        bool safe;
+        {
+          ArenaScope scope(verify_arena);
+          safe = verify_method(method, registry, verify_arena, message,
+                               sizeof(message));
+        }
+        method.holder->verify_time += uint64_t(nanoseconds() - start);
+        ++method.holder->verified_methods;
+        if (safe) {
+          method.verification = VerifyState::verified;
+        } else {
+          size_t length = strlen(message) + 1;
+          auto *copy = static_cast<char *>(code_arena.allocate(length, 1));
+          memcpy(copy, message, length);
+          method.verify_error = copy;
+          method.verification = VerifyState::failed;
+          code = nullptr;
+        }
+      }
+      __atomic_store_n(&method.decoded, code, __ATOMIC_RELEASE);
+    }
+    char const *verify_error = method.verify_error;
+    pthread_mutex_unlock(&code_mutex);
+
+    if (code == nullptr) {
+      if (verify_error != nullptr) {
+        throw_new(thread, "java/lang/VerifyError", verify_error);
+      } else {
+        throw_method_error(thread, "java/lang/VerifyError", "Bad code in ",
+                           method);
+      }
+    }
+    return code;
+  }
+
+  auto VM::new_object(Thread &thread, Klass &klass) -> Object * {
+    return allocate(thread, klass, klass.instance_size);
+  }
+
+  auto VM::new_array(Thread &thread, Klass &array_class, int32_t length)
+      -> ArrayObject * {
+    if (length < 0) {
+      char message[16];
+      snprintf(message, sizeof(message), "%d", length);
+      throw_new(thread, "java/lang/NegativeArraySizeException", message);
+      return nullptr;
+    }
+    size_t size = array_data_offset +
+                  size_t(length) * size_of(array_class.element_type);
+    auto *array = reinterpret_cast<ArrayObject *>(
+      allocate(thread, array_class, size));
+    if (array != nullptr) {
+      array->length = length;
+    }
+    return array;
+  }
+
+  auto VM::primitive_array_class(Thread &thread, BasicType type) -> Klass * {
+    Klass *&klass = primitive_arrays[uint8_t(type)];
+    if (klass == nullptr) {
+      klass = link_or_throw(thread,
+                            make_view(primitive_array_names[uint8_t(type)]));
+    }
+    return klass;
+  }
+
+  auto VM::array_class(Thread &thread, Klass &component) -> Klass * {
+    // `[[I` for arrays of arrays, `[Ljava/lang/String;` for the others.
+    size_t length = component.name.length + 3;
+    auto *name = static_cast<uint8_t *>(checked_malloc(length));
+    size_t used = 0;
+    name[used++] = '[';
+    if (not component.is_array()) { name[used++] = 'L'; }
+    memcpy(name + used, component.name.bytes, component.name.length);
+    used += component.name.length;
+    if (not component.is_array()) { name[used++] = ';'; }
+    Klass *klass = used <= UINT16_MAX
+      ? link_or_throw(thread, Utf8View {name, uint16_t(used)})
+      : nullptr;
+    if (used > UINT16_MAX) {
+      throw_new(thread, "java/lang/NoClassDefFoundError",
+                "array class name too long");
+    }
+    free(name);
+    return klass;
+  }
+
+  auto VM::new_string(Thread &thread, uint16_t const *chars, uint32_t length)
+      -> Object * {
+    if (string_class == nullptr) {
+      Klass *klass = link_or_throw(thread, make_view("java/lang/String"));
+      if (klass == nullptr) { return nullptr; }
+      Field *value = klass->find_field(make_view("value"), make_view("[C"));
+      if (value == nullptr) {
+        throw_new(thread, "java/lang/NoSuchFieldError", "value");
+        return nullptr;
+      }
+      string_value_offset = value->offset;
+      string_class = klass;
+    }
+    Klass *char_array = primitive_array_class(thread, BasicType::char_);
+    if (char_array == nullptr) { return nullptr; }
+    ArrayObject *chars_array = new_array(thread, *char_array,
+                                         int32_t(length));
+    if (chars_array == nullptr) { return nullptr; }
+    memcpy(chars_array->elements<uint16_t>(), chars, size_t(length) * 2);
+    Handle<ArrayObject> array(thread, chars_array);
+    Object *string = new_object(thread, *string_class);
+    if (string == nullptr) { return nullptr; }
+    store_reference(&string->at<Object *>(string_value_offset),
+                    &array->header);
+    return string;
+  }
+
+  auto VM::new_string(Thread &thread, char const *text) -> Object * {
+    auto const *bytes = reinterpret_cast<uint8_t const *>(text);
+    auto length = uint32_t(strlen(text));
+    int64_t count = decode_utf8(bytes, length, nullptr);
+    auto *chars = static_cast<uint16_t *>(
+      checked_malloc(sizeof(uint16_t) * (length + 1)));
+    if (count >= 0) {
+      (void)decode_utf8(bytes, length, chars);
+    } else {
+      // Not UTF-8; keep the bytes.
+      count = length;
+      inflate_latin1(bytes, length, chars);
+    }
+    Object *string = new_string(thread, chars, uint32_t(count));
+    free(chars);
+    return string;
+  }
+
+  auto VM::intern(Thread &thread, Symbol const *symbol) -> Object * {
+    SymbolTable &symbols = registry.get_symbols();
+    if (Object *interned = symbols.find_string(symbol)) { return interned; }
+
+    int64_t count = decode_modified_utf8(symbol->bytes(), symbol->length,
+                                         nullptr);
+    auto *chars = static_cast<uint16_t *>(
+      checked_malloc(sizeof(uint16_t) * (symbol->length + 1)));
+    if (count >= 0) {
+      (void)decode_modified_utf8(symbol->bytes(), symbol->length, chars);
+    } else {
+      count = symbol->length;
+      inflate_latin1(symbol->bytes(), symbol->length, chars);
+    }
+    Object *string = new_string(thread, chars, uint32_t(count));
+    free(chars);
+    // Another thread may have interned one meanwhile.
+    return string != nullptr ? symbols.set_string(symbol, string) : nullptr;
+  }
+
+  auto VM::string_chars(Object *string) const -> ArrayObject * {
+    return string->at<ArrayObject *>(string_value_offset);
+  }
+
+  auto VM::exception_message(Object *throwable) const -> Object * {
+    Field *field = message_field(throwable->get_klass());
+    return field != nullptr ? throwable->at<Object *>(field->offset)
+                            : nullptr;
+  }
+
+  auto VM::throw_new(Thread &thread, char const *class_name,
+                     char const *message) -> void {
+    Klass *klass = link_or_throw(thread, make_view(class_name));
+    if (klass == nullptr or not initialize(thread, *klass)) { return; }
+    Object *string = nullptr;
+    if (message != nullptr) {
+      string = new_string(thread, message);
+      if (string == nullptr) { return; }
+    }
+    Handle<Object> text(thread, string);
+    Object *throwable = new_object(thread, *klass);
+    if (throwable == nullptr) { return; }
+    if (Field *field = message_field(klass)) {
+      store_reference(&throwable->at<Object *>(field->offset), text.get());
+    }
+    thread.exception = throwable;
+  }
+
+  auto VM::throw_link_error(Thread &thread, LinkError error, Utf8View name)
+      -> void {
+    char class_name[64];
+    snprintf(class_name, sizeof(class_name), "java/lang/%s",
+             error == LinkError::none ? "InternalError" : describe(error));
+    char message[512];
+    snprintf(message, sizeof(message), "%.*s", int(name.length), name.bytes);
+    for (char *c = message; *c != '\0'; ++c) {
+      if (*c == '/') { *c = '.'; }
+    }
+    throw_new(thread, class_name, message);
+  }
+
+  auto VM::throw_index_out_of_bounds(Thread &thread, int32_t index,
+                                     int32_t length) -> void {
+    char message[64];
+    snprintf(message, sizeof(message), "Index %d out of bounds for length %d",
+             index, length);
+    throw_new(thread, "java/lang/ArrayIndexOutOfBoundsException", message);
+  }
+
+  auto VM::throw_with_class(Thread &thread, char const *class_name,
+                            Klass const &klass, char const *suffix) -> void {
+    char message[512];
+    int length = snprintf(message, sizeof(message), "%.*s%s",
+                          int(klass.name.length), klass.name.bytes, suffix);
+    for (int i = 0; i < length and i < int(sizeof(message)); ++i) {
+      if (message[i] == '/') { message[i] = '.'; }
+    }
+    throw_new(thread, class_name, message);
+  }
+
+  auto VM::throw_illegal_monitor_state(Thread &thread) -> void {
+    throw_new(thread, "java/lang/IllegalMonitorStateException",
+              "current thread is not owner");
+  }
+
+  auto VM::throw_class_cast(Thread &thread, Klass const &from,
+                            Klass const &to) -> void {
+    char message[512];
+    int length = snprintf(message, sizeof(message),
+                          "class %.*s cannot be cast to class %.*s",
+                          int(from.name.length), from.name.bytes,
+                          int(to.name.length), to.name.bytes);
+    for (int i = 0; i < length and i < int(sizeof(message)); ++i) {
+      if (message[i] == '/') { message[i] = '.'; }
+    }
+    throw_new(thread, "java/lang/ClassCastException", message);
+  }
+
+  auto VM::resolve_class(Thread &thread, Klass &klass, uint16_t index)
+      -> Klass * {
+    LinkError error = LinkError::none;
+    Klass *resolved = registry.resolve_class(klass, index, error);
+    if (resolved == nullptr) {
+      throw_link_error(thread, error, klass.class_file->class_name(index));
+    }
+    return resolved;
+  }
+
+  auto VM::resolve_method(Thread &thread, Klass &klass, uint16_t index)
+      -> Method * {
+    LinkError error = LinkError::none;
+    Method *method = registry.resolve_method(klass, index, error);
+    if (method == nullptr) {
+      throw_link_error(thread, error, klass.class_file->member_ref(index).name);
+    }
+    return method;
+  }
+
+  auto VM::load_constant(Thread &thread, Klass &klass, uint16_t index)
+      -> Object * {
+    if (klass.class_file->tag(index) != ConstantTag::string) {
+      throw_new(thread, "java/lang/UnsupportedOperationException",
+                "ldc of a class, method handle or dynamic constant");
+      return nullptr;
+    }
+    return intern(thread, registry.resolve_string(klass, index));
+  }
+
+  auto VM::is_assignable(Klass const *from, Klass const *to) const -> bool {
+    if (from == to) { return true; }
+    if (to->is_array()) {
+      return from->is_array() and from->element_type == to->element_type and
+             from->element_type == BasicType::reference and
+             is_assignable(from->component, to->component);
+    }
+    if (from->is_array()) {
+      // Arrays only extend `java/lang/Object`.
+      return to == from->super;
+    }
+    return from->is_subclass_of(to);
+  }
+
+  auto VM::run_main(Klass &main_class, int argument_count, char **arguments)
+      -> int {
+    Method *main = main_class.find_method(make_view("main"),
+                                          make_view("([Ljava/lang/String;)V"));
+    if (main == nullptr or not main->is_static()) {
+      fprintf(stderr, "Error: Main method not found in class ");
+      print_class_name(stderr, main_class.name);
+      fprintf(stderr, ", please define the main method as:\n"
+                      "   public static void main(String[] args)\n");
+      return 1;
+    }
+
+    Thread thread(*this);
+    if (initialize(thread, main_class)) {
+      Klass *array_class = link_or_throw(
+        thread, make_view("[Ljava/lang/String;"));
+      Handle<ArrayObject> array(
+        thread, array_class != nullptr
+          ? new_array(thread, *array_class, argument_count)
+          : nullptr);
+      for (int i = 0; array.get() != nullptr and i < argument_count; ++i) {
+        Object *argument = new_string(thread, arguments[i]);
+        if (argument == nullptr) { break; }
+        store_reference(&array->elements<Object *>()[i], argument);
+      }
+      if (thread.exception == nullptr) {
+        Value *locals = thread.get_stack_base();
+        locals[0].l = &array->header;
+        (void)invoke(thread, *main, locals);
+      }
+    }
+    fflush(stdout);
+    if (thread.exception != nullptr) {
+      print_exception(thread.exception);
+      return 1;
+    }
+    return 0;
+  }
+
+  auto VM::print_exception(Object *throwable) const -> void {
+    fflush(stdout);
+    fputs("Exception in thread \"main\" ", stderr);
+    print_class_name(stderr, throwable->get_klass()->name);
+    if (Object *message = exception_message(throwable)) {
+      ArrayObject *chars = string_chars(message);
+      fputs(": ", stderr);
+      write_utf16(stderr, chars->elements<uint16_t>(), uint32_t(chars->length));
+    }
+    fputc('\n', stderr);
+  }
+} // namespace skjvm
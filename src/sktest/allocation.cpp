@@ -0,0 +1,28 @@
+#include <sktest/allocation.hpp>
+#include <sktest/test_group.hpp>
+
+namespace sktest {
+
+  constinit thread_local AllocationCounters allocation_counters
+    __attribute__((tls_model("initial-exec"))) {};
+
+  constinit bool allocation_hooks_installed = false;
+
+  AllocationScope::~AllocationScope() noexcept {
+    auto const &counters = allocation_counters;
+    record.allocation_count = counters.allocation_count - start_count;
+    record.allocated_bytes = counters.allocated_bytes - start_bytes;
+
+    if (not allocation_hooks_installed) {
+      record.description = "allocation hooks are not installed, define "
+                           "USE_SKTEST_ALLOCATION_HOOKS with the main function";
+      submit_assertion(false, record);
+      return;
+    }
+
+    bool passed = record.kind == AssertionKind::no_alloc
+                ? record.allocation_count == 0
+                : record.allocated_bytes <= limit;
+    submit_assertion(passed, record);
+  }
+} // namespace sktest
@@ -0,0 +1,452 @@
+#include <sktest/benchmark.hpp>
+#include <sktest/registration.hpp>
+#include <sktest/test_group.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace sktest {
+  namespace {
+    using Clock = std::chrono::steady_clock;
+
+    static_assert(Clock::is_steady, "benchmarks need a monotonic clock");
+
+    constexpr double warm_up_time_ns = 20e6;
+    /// Calibration stops doubling past this or \c max_iterations, for bodies
+    /// too fast to measure, such as empty ones.
+    constexpr double warm_up_deadline_ns = 1e9;
+    constexpr size_t max_iterations = size_t(1) << 40;
+    constexpr double target_sample_time_ns = 2e6;
+    /// Enough samples that the nearest-rank p99 is not the maximum.
+    constexpr size_t sample_count = 100;
+
+    auto time_iterations(Benchmark const &benchmark, size_t iterations)
+        -> double {
+      auto start = Clock::now();
+      benchmark.run(iterations);
+      auto stop = Clock::now();
+      return std::chrono::duration<double, std::nano>(stop - start).count();
+    }
+  } // namespace
+
+  auto measure(Benchmark const &benchmark, bool count_perf)
+      -> BenchmarkResult {
+    // Warm up caches, branch predictors and the CPU frequency while looking
+    // for an iteration count that takes a measurable amount of time.
+    size_t iterations = 1;
+    double elapsed = 0;
+    auto warm_up_start = Clock::now();
+    for (;;) {
+      elapsed = time_iterations(benchmark, iterations);
+      double warmed = std::chrono::duration<double, std::nano>(
+        Clock::now() - warm_up_start).count();
+
+      if (elapsed >= target_sample_time_ns / 8) {
+        if (warmed >= warm_up_time_ns) { break; }
+      } else if (iterations < max_iterations) {
+        iterations *= 2;
+      } else {
+        break;
+      }
+      if (warmed >= warm_up_deadline_ns) { break; }
+    }
+
+    double scale = target_sample_time_ns / std::max(elapsed, 1.0);
+    iterations = size_t(std::clamp(double(iterations) * scale, 1.0,
+                                   double(max_iterations)));
+
+    // The counters are read once around all samples, so the syscalls do not
+    // disturb the timed region of any sample.
+    auto &counters = PerfCounters::for_this_thread();
+    if (count_perf) {
+      counters.start();
+    }
+
+    std::vector<double> samples(sample_count);
+    for (auto &sample : samples) {
+      sample = time_iterations(benchmark, iterations) / double(iterations);
+    }
+
+    BenchmarkResult result;
+    if (count_perf) {
+      result.perf = counters.stop();
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    result.iterations_per_sample = iterations;
+    result.sample_count = sample_count;
+    result.min = samples.front();
+
+    size_t middle = sample_count / 2;
+    result.median = sample_count % 2 == 1
+      ? samples[middle]
+      : (samples[middle - 1] + samples[middle]) / 2;
+
+    // Nearest-rank percentile.
+    auto rank = size_t(std::ceil(0.99 * double(sample_count)));
+    result.p99 = samples[std::max<size_t>(rank, 1) - 1];
+
+    double sum = 0;
+    for (double sample : samples) { sum += sample; }
+    result.mean = sum / double(sample_count);
+
+    double squares = 0;
+    for (double sample : samples) {
+      squares += (sample - result.mean) * (sample - result.mean);
+    }
+    result.stddev = std::sqrt(squares / double(sample_count - 1));
+
+    return result;
+  }
+
+  namespace {
+    /// Format \p nanoseconds with a unit that keeps 3 or 4 significant digits.
+    auto format_time(char *buffer, size_t size, double nanoseconds)
+        -> char const * {
+      if (nanoseconds < 1e3) {
+        snprintf(buffer, size, "%.2f ns", nanoseconds);
+      } else if (nanoseconds < 1e6) {
+        snprintf(buffer, size, "%.2f us", nanoseconds / 1e3);
+      } else if (nanoseconds < 1e9) {
+        snprintf(buffer, size, "%.2f ms", nanoseconds / 1e6);
+      } else {
+        snprintf(buffer, size, "%.2f s", nanoseconds / 1e9);
+      }
+      return buffer;
+    }
+
+    /// A benchmark of a saved run, identified like test groups by its file,
+    /// line and description.
+    struct BaselineEntry {
+      std::string name;
+      std::string file;
+      size_t line {0};
+      double median {0};
+
+      [[nodiscard]]
+      auto matches(Benchmark const &benchmark) const -> bool {
+        return line == benchmark.get_line() and
+               file == benchmark.get_file() and
+               name == benchmark.get_description();
+      }
+    };
+
+    /// A deliberately small reader for the files written by
+    /// \c save_baseline. It scans for the \c "name", \c "file", \c "line"
+    /// and \c "median_ns" members of each object and ignores everything
+    /// else.
+    class BaselineReader {
+     private:
+      std::string text;
+      size_t position {0};
+
+      auto skip_space() -> void {
+        while (position < text.size() and
+               strchr(" \t\r\n", text[position]) != nullptr) {
+          ++position;
+        }
+      }
+
+      auto read_string(std::string &value) -> bool {
+        if (position >= text.size() or text[position] != '"') { return false; }
+        ++position;
+        value.clear();
+        while (position < text.size() and text[position] != '"') {
+          char c = text[position++];
+          if (c == '\\' and position < text.size()) {
+            char escaped = text[position++];
+            switch (escaped) {
+              case 'n': c = '\n'; break;
+              case 't': c = '\t'; break;
+              default:  c = escaped; break;
+            }
+          }
+          value.push_back(c);
+        }
+        ++position;
+        return true;
+      }
+
+     public:
+      explicit BaselineReader(std::string text) : text(std::move(text)) {}
+
+      auto read(std::vector<BaselineEntry> &entries) -> void {
+        BaselineEntry entry;
+        bool has_name = false;
+        std::string key;
+
+        while (position < text.size()) {
+          char c = text[position];
+          if (c == '{') {
+            entry = {};
+            has_name = false;
+            ++position;
+          } else if (c == '}') {
+            if (has_name) { entries.push_back(entry); }
+            has_name = false;
+            ++position;
+          } else if (c == '"') {
+            read_string(key);
+            skip_space();
+            if (position >= text.size() or text[position] != ':') {
+              continue;
+            }
+            ++position;
+            skip_space();
+
+            if (key == "name") {
+              has_name = read_string(entry.name);
+            } else if (key == "file") {
+              read_string(entry.file);
+            } else if (key == "line") {
+              char *end = nullptr;
+              entry.line = size_t(strtoull(text.c_str() + position, &end, 10));
+              position = size_t(end - text.c_str());
+            } else if (key == "median_ns") {
+              char *end = nullptr;
+              entry.median = strtod(text.c_str() + position, &end);
+              position = size_t(end - text.c_str());
+            }
+          } else {
+            ++position;
+          }
+        }
+      }
+    };
+
+    auto load_baseline(char const *path, std::vector<BaselineEntry> &entries)
+        -> bool {
+      FILE *file = fopen(path, "rb");
+      if (file == nullptr) {
+        fprintf(stderr, bold_red("error:") " cannot open baseline '%s'\n",
+                path);
+        return false;
+      }
+
+      std::string text;
+      char buffer[4096];
+      size_t size = 0;
+      while ((size = fread(buffer, 1, sizeof(buffer), file)) != 0) {
+        text.append(buffer, size);
+      }
+      fclose(file);
+
+      BaselineReader(std::move(text)).read(entries);
+      return true;
+    }
+
+    auto write_json_string(FILE *file, char const *string) -> void {
+      fputc('"', file);
+      for (char const *c = string; *c != '\0'; ++c) {
+        switch (*c) {
+          case '"':  fputs("\\\"", file); break;
+          case '\\': fputs("\\\\", file); break;
+          case '\n': fputs("\\n", file); break;
+          case '\t': fputs("\\t", file); break;
+          default:   fputc(*c, file); break;
+        }
+      }
+      fputc('"', file);
+    }
+
+    auto save_baseline(char const *path,
+                       std::vector<Benchmark> const &benchmarks,
+                       std::vector<BenchmarkResult> const &results) -> bool {
+      FILE *file = fopen(path, "wb");
+      if (file == nullptr) {
+        fprintf(stderr, bold_red("error:") " cannot write baseline '%s'\n",
+                path);
+        return false;
+      }
+
+      fputs("{\n  \"benchmarks\": [\n", file);
+      for (size_t i = 0; i < benchmarks.size(); ++i) {
+        auto const &benchmark = benchmarks[i];
+        auto const &result = results[i];
+
+        fputs("    {\"name\": ", file);
+        write_json_string(file, benchmark.get_description());
+        fputs(", \"file\": ", file);
+        write_json_string(file, benchmark.get_file());
+        fprintf(file, ", \"line\": %zu, \"iterations\": %zu, \"samples\": %zu, "
+                "\"min_ns\": %.4f, \"median_ns\": %.4f, \"p99_ns\": %.4f, "
+                "\"stddev_ns\": %.4f}%s\n",
+                benchmark.get_line(), result.iterations_per_sample,
+                result.sample_count, result.min, result.median, result.p99,
+                result.stddev, i + 1 == benchmarks.size() ? "" : ",");
+      }
+      fputs("  ]\n}\n", file);
+
+      fclose(file);
+      return true;
+    }
+  } // namespace
+
+  namespace {
+    auto print_perf_per_iteration(BenchmarkResult const &result) -> void {
+      auto const &perf = result.perf;
+      double iterations = double(result.iterations_per_sample)
+                        * double(result.sample_count);
+
+      printf("  " bold("counters:") "     ");
+      char const *names[perf_event_count] = {
+        "cycles", "instructions", "cache misses", "branch misses",
+        "cache references", "branches",
+      };
+      char const *separator = "";
+      for (size_t i = 0; i < perf_event_count; ++i) {
+        if (not perf.has(PerfEvent(i))) { continue; }
+        printf("%s%.2f %s", separator, double(perf.values[i]) / iterations,
+               names[i]);
+        separator = ", ";
+      }
+      char cache_rate[16];
+      char branch_rate[16];
+      printf(" per iteration, IPC %.2f, cache miss rate %s, branch miss rate "
+             "%s\n", perf.ipc(),
+             format_rate(cache_rate, sizeof(cache_rate),
+                         perf.rate(PerfEvent::cache_misses,
+                                   PerfEvent::cache_references)),
+             format_rate(branch_rate, sizeof(branch_rate),
+                         perf.rate(PerfEvent::branch_misses,
+                                   PerfEvent::branches)));
+    }
+  } // namespace
+
+  auto RegistrationCenter::sort_benchmarks() -> void {
+    std::sort(benchmarks.begin(), benchmarks.end(),
+              [](auto const &lhs, auto const &rhs) {
+      int compare_name = strcmp(lhs.get_file(), rhs.get_file());
+      if (compare_name != 0) {
+        return compare_name < 0;
+      }
+      return lhs.get_line() < rhs.get_line();
+    });
+  }
+
+  auto RegistrationCenter::collect_benchmarks() -> void {
+    benchmarks.clear();
+    for (auto *benchmark = Benchmark::first_registered(); benchmark != nullptr;
+         benchmark = benchmark->next_registered()) {
+      benchmarks.push_back(*benchmark);
+    }
+  }
+
+  auto RegistrationCenter::invoke_benchmarks(Options const &options) -> int {
+    collect_benchmarks();
+    sort_benchmarks();
+
+    // Selection works as for test groups: --filter and --file first, then
+    // every N-th of the remaining benchmarks for --shard.
+    std::vector<Benchmark> matched;
+    for (auto const &benchmark : benchmarks) {
+      if (options.selects(benchmark.get_description(), benchmark.get_file())) {
+        matched.push_back(benchmark);
+      }
+    }
+
+    std::vector<Benchmark> measured;
+    for (size_t index = options.shard_index; index < matched.size();
+         index += options.shard_count) {
+      measured.push_back(matched[index]);
+    }
+
+    if (options.list) {
+      for (auto const &benchmark : measured) {
+        printf("%s:%zu: %s\n", benchmark.get_file(), benchmark.get_line(),
+               benchmark.get_description());
+      }
+      return 0;
+    }
+
+    std::vector<BaselineEntry> baseline;
+    if (options.baseline_path != nullptr and
+        not load_baseline(options.baseline_path, baseline)) {
+      return 2;
+    }
+
+    bool count_perf = options.perf;
+    if (count_perf and not PerfCounters::for_this_thread().is_available()) {
+      puts(bold("note:") " hardware performance counters are unavailable, "
+           "continuing without them");
+      count_perf = false;
+    }
+
+    std::vector<BenchmarkResult> bench_results;
+    bench_results.reserve(benchmarks.size());
+    size_t regression_count = 0;
+
+    for (auto const &benchmark : measured) {
+      auto result = measure(benchmark, count_perf);
+      bench_results.push_back(result);
+
+      char min[32];
+      char median[32];
+      char p99[32];
+      char stddev[32];
+      printf(bold("benchmark:") " %s\n", benchmark.get_description());
+      printf("  " bold("location:") "     %s:%zu\n",
+             benchmark.get_file(), benchmark.get_line());
+      printf("  " bold("time:") "         min %s, median %s, p99 %s, "
+             "stddev %s\n",
+             format_time(min, sizeof(min), result.min),
+             format_time(median, sizeof(median), result.median),
+             format_time(p99, sizeof(p99), result.p99),
+             format_time(stddev, sizeof(stddev), result.stddev));
+      printf("  " bold("samples:") "      %zu x %zu iterations\n",
+             result.sample_count, result.iterations_per_sample);
+      if (result.perf.valid_mask != 0) {
+        print_perf_per_iteration(result);
+      }
+
+      auto entry = std::find_if(baseline.begin(), baseline.end(),
+                                [&](auto const &entry) {
+        return entry.matches(benchmark);
+      });
+      if (entry != baseline.end() and entry->median > 0) {
+        double change = result.median / entry->median - 1.0;
+        char previous[32];
+        format_time(previous, sizeof(previous), entry->median);
+
+        if (change > options.regression_threshold) {
+          ++regression_count;
+          printf("  " bold("baseline:") "     %s, " bold_red("regressed %+.1f%%")
+                 "\n", previous, change * 100);
+        } else if (change < -options.regression_threshold) {
+          printf("  " bold("baseline:") "     %s, " green("improved %+.1f%%")
+                 "\n", previous, change * 100);
+        } else {
+          printf("  " bold("baseline:") "     %s, %+.1f%%\n",
+                 previous, change * 100);
+        }
+      }
+    }
+
+    if (options.save_baseline_path != nullptr) {
+      if (not save_baseline(options.save_baseline_path, measured,
+                            bench_results)) {
+        return 2;
+      }
+    }
+
+    if (bench_results.empty()) {
+      puts(bold_green("no benchmark found:") " process will exit with 0");
+      return 0;
+    }
+
+    if (regression_count != 0) {
+      printf(bold_red("benchmarks regressed:") " %zu of %zu\n",
+             regression_count, bench_results.size());
+      return 1;
+    }
+
+    printf(bold_green("benchmarks finished:") " %zu\n", bench_results.size());
+    return 0;
+  }
+} // namespace sktest
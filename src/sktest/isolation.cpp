@@ -0,0 +1,363 @@
+// Fork-based isolation for the SkTest runner (`--isolate`).
+//
+// The parent splits the selected test groups into batches and forks one child
+// per batch, keeping up to `--jobs` children alive at a time. A child invokes
+// its test groups in order and streams messages back over a pipe: each failed
+// assertion as soon as it is recorded, and a record per finished group. When
+// a child dies before reporting every group of its batch, the first
+// unreported group is the one that crashed; it is marked as crashed, reported
+// with the failures it sent before, and the rest of the batch is queued again
+// as a new batch.
+//
+// With `--timeout`, the parent also remembers when each child started its
+// current group. A child that stays in one group for too long is killed, and
+// that group is marked as timed out instead of crashed; the rest of its batch
+// is queued again the same way.
+
+#include <sktest/registration.hpp>
+#include <sktest/test_group.hpp>
+#include <sktest/output_sink.hpp>
+#include <sktest/reporter.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace sktest {
+  namespace {
+
+    enum class MessageKind : uint32_t {
+      failure,
+      finished,
+    };
+
+    /// Header of every message from a child, followed by \c size bytes: a
+    /// \c FailureRecord and its texts, or a \c ChildRecord.
+    struct MessageHeader {
+      MessageKind kind;
+      uint32_t size;
+    };
+
+    /// A failed assertion, sent as soon as it is recorded, so a crash later
+    /// in the group does not lose it. The texts follow, in this order.
+    struct FailureRecord {
+      uint64_t position;
+      uint64_t allocation_count;
+      uint64_t allocated_bytes;
+      uint32_t line_number;
+      AssertionKind kind;
+      /// Lengths of the file name, the description, the left and the right
+      /// operand, \c no_text for a missing right operand.
+      uint32_t lengths[4];
+    };
+
+    constexpr uint32_t no_text = UINT32_MAX;
+
+    /// Record streamed from a child to the parent for each finished group.
+    struct ChildRecord {
+      uint64_t position;
+      uint64_t total_assertion_count;
+      uint64_t passed_assertion_count;
+      uint64_t wall_ns;
+      uint64_t cpu_ns;
+      PerfCounts perf;
+      AllocationSummary allocations;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    /// A half-open range \c [begin, end) of positions in the selection.
+    struct Batch {
+      size_t begin;
+      size_t end;
+    };
+
+    struct Child {
+      pid_t pid;
+      int fd;
+      Batch batch;
+      size_t next; // First position of the batch not reported yet.
+      Clock::time_point next_started;
+      bool killed;
+      /// Bytes received and not yet parsed into complete messages.
+      std::string buffer;
+    };
+
+    /// The pipe to the parent in a child process, and the position of the
+    /// group it is invoking.
+    int child_pipe = -1;
+    size_t child_position = 0;
+
+    auto write_all(int fd, void const *data, size_t size) -> bool {
+      auto const *bytes = static_cast<char const *>(data);
+      while (size != 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0) {
+          if (errno == EINTR) { continue; }
+          return false;
+        }
+        bytes += written;
+        size -= size_t(written);
+      }
+      return true;
+    }
+
+    auto send(int fd, MessageKind kind, std::string const &payload) -> bool {
+      MessageHeader header {kind, uint32_t(payload.size())};
+      std::string message(reinterpret_cast<char const *>(&header),
+                          sizeof(header));
+      message += payload;
+      return write_all(fd, message.data(), message.size());
+    }
+  } // namespace
+
+  auto RegistrationCenter::failure_recorded(AssertionRecord const &record)
+      -> void {
+    if (child_pipe < 0) { return; }
+
+    char const *texts[4] = {record.file_name, record.description, record.left,
+                            record.right};
+    FailureRecord failure {child_position, record.allocation_count,
+                           record.allocated_bytes, record.line_number,
+                           record.kind, {}};
+    for (size_t i = 0; i < 4; ++i) {
+      failure.lengths[i] = texts[i] == nullptr ? no_text
+                                               : uint32_t(strlen(texts[i]));
+    }
+
+    // The arena of the group is the only memory it is expected to hold.
+    AllocationSuspension suspension;
+    std::string payload(reinterpret_cast<char const *>(&failure),
+                        sizeof(failure));
+    for (char const *text : texts) {
+      if (text != nullptr) { payload += text; }
+    }
+    if (not send(child_pipe, MessageKind::failure, payload)) {
+      _exit(1);
+    }
+  }
+
+  auto RegistrationCenter::invoke_isolated(size_t batch_size, size_t jobs,
+                                           size_t timeout_ms) -> void {
+    auto const timeout = std::chrono::milliseconds(timeout_ms);
+
+    std::deque<Batch> pending;
+    for (size_t begin = 0; begin < selection.size(); begin += batch_size) {
+      pending.push_back({begin, std::min(begin + batch_size, selection.size())});
+    }
+
+    std::vector<Child> children;
+    std::vector<pollfd> poll_fds;
+
+    while (not pending.empty() or not children.empty()) {
+      while (children.size() < jobs and not pending.empty()) {
+        Batch batch = pending.front();
+        pending.pop_front();
+
+        int fds[2];
+        if (pipe(fds) != 0) {
+          perror("sktest: pipe");
+          abort();
+        }
+
+        // Anything still buffered would be written twice, once by the parent
+        // and once by the child.
+        sink->flush();
+        fflush(stdout);
+        fflush(stderr);
+
+        pid_t pid = fork();
+        if (pid < 0) {
+          perror("sktest: fork");
+          abort();
+        }
+
+        if (pid == 0) {
+          close(fds[0]);
+          for (auto const &child : children) {
+            close(child.fd);
+          }
+          child_pipe = fds[1];
+
+          for (size_t position = batch.begin; position < batch.end;
+               ++position) {
+            child_position = position;
+            invoke_test_group(position);
+
+            // The report reaches the output before the record reaches the
+            // parent, so a crash in a later group cannot lose it.
+            sink->flush();
+
+            auto const &result = results[position];
+            ChildRecord record {position, result.total_assertion_count,
+                                result.passed_assertion_count, result.wall_ns,
+                                result.cpu_ns, result.perf,
+                                result.allocations};
+
+            fflush(stdout);
+            if (not send(fds[1], MessageKind::finished,
+                         std::string(reinterpret_cast<char const *>(&record),
+                                     sizeof(record)))) {
+              _exit(1);
+            }
+          }
+
+          fflush(stdout);
+          fflush(stderr);
+          _exit(0);
+        }
+
+        close(fds[1]);
+        children.push_back({pid, fds[0], batch, batch.begin, Clock::now(),
+                            false, {}});
+      }
+
+      // Wake up in time for the earliest deadline among the children.
+      int poll_timeout = -1;
+      if (timeout_ms != 0) {
+        auto now = Clock::now();
+        for (auto const &child : children) {
+          if (child.killed) { continue; }
+          auto left = std::chrono::ceil<std::chrono::milliseconds>(
+            child.next_started + timeout - now).count();
+          left = std::max<decltype(left)>(left, 0);
+          if (poll_timeout < 0 or left < poll_timeout) {
+            poll_timeout = int(left);
+          }
+        }
+      }
+
+      poll_fds.clear();
+      for (auto const &child : children) {
+        poll_fds.push_back({child.fd, POLLIN, 0});
+      }
+
+      if (poll(poll_fds.data(), poll_fds.size(), poll_timeout) < 0) {
+        if (errno == EINTR) { continue; }
+        perror("sktest: poll");
+        abort();
+      }
+
+      // Walk backwards, so finished children can be erased in place.
+      for (size_t i = children.size(); i-- > 0;) {
+        if (poll_fds[i].revents == 0) { continue; }
+        auto &child = children[i];
+
+        char chunk[4096];
+        ssize_t size = read(child.fd, chunk, sizeof(chunk));
+        if (size < 0 and errno == EINTR) { continue; }
+
+        if (size > 0) {
+          child.buffer.append(chunk, size_t(size));
+          size_t parsed = 0;
+          MessageHeader header;
+          while (child.buffer.size() - parsed >= sizeof(header)) {
+            memcpy(&header, child.buffer.data() + parsed, sizeof(header));
+            if (child.buffer.size() - parsed - sizeof(header) < header.size) {
+              break;
+            }
+            char const *payload = child.buffer.data() + parsed +
+                                  sizeof(header);
+            parsed += sizeof(header) + header.size;
+
+            if (header.kind == MessageKind::failure) {
+              FailureRecord failure;
+              memcpy(&failure, payload, sizeof(failure));
+              char const *text = payload + sizeof(failure);
+              char const *texts[4];
+              for (size_t k = 0; k < 4; ++k) {
+                if (failure.lengths[k] == no_text) {
+                  texts[k] = nullptr;
+                  continue;
+                }
+                texts[k] = received_texts.emplace_back(
+                  text, failure.lengths[k]).c_str();
+                text += failure.lengths[k];
+              }
+              // Kept by the parent's copy of the group, for the report of
+              // a crash: the child reports the failures of the groups it
+              // finishes itself, whose record then replaces these counts.
+              ++results[failure.position].total_assertion_count;
+              auto &test_group = *test_groups[selection[failure.position]];
+              test_group.record_failed_assertion(
+                {texts[0], texts[1], texts[2], texts[3], failure.line_number,
+                 failure.kind, failure.allocation_count,
+                 failure.allocated_bytes});
+              continue;
+            }
+
+            ChildRecord record;
+            memcpy(&record, payload, sizeof(record));
+            auto &result = results[record.position];
+            result.total_assertion_count = record.total_assertion_count;
+            result.passed_assertion_count = record.passed_assertion_count;
+            result.wall_ns = record.wall_ns;
+            result.cpu_ns = record.cpu_ns;
+            result.perf = record.perf;
+            result.allocations = record.allocations;
+            result.finished = true;
+            child.next = record.position + 1;
+            child.next_started = Clock::now();
+          }
+          child.buffer.erase(0, parsed);
+          continue;
+        }
+
+        // End of stream (or a broken pipe): the child is gone.
+        int status = 0;
+        while (waitpid(child.pid, &status, 0) < 0 and errno == EINTR) {}
+        close(child.fd);
+
+        if (child.next < child.batch.end) {
+          auto &result = results[child.next];
+          result.wall_ns = uint64_t(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+              Clock::now() - child.next_started).count());
+          if (child.killed) {
+            result.timed_out = true;
+            reporter->group_aborted(*test_groups[selection[child.next]],
+                                    result, timeout_ms);
+          } else {
+            result.crashed = true;
+            if (WIFSIGNALED(status)) {
+              result.crash_by_signal = true;
+              result.crash_code = WTERMSIG(status);
+            } else {
+              result.crash_code = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+            }
+            reporter->group_aborted(*test_groups[selection[child.next]],
+                                    result, timeout_ms);
+          }
+
+          if (child.next + 1 < child.batch.end) {
+            pending.push_front({child.next + 1, child.batch.end});
+          }
+        }
+
+        children.erase(children.begin() + std::ptrdiff_t(i));
+      }
+
+      // Check deadlines only after the records above have been read, so a
+      // group that finished just in time is not blamed. A killed child is
+      // reaped in a later round, once its pipe reports end of stream.
+      if (timeout_ms != 0) {
+        auto now = Clock::now();
+        for (auto &child : children) {
+          if (not child.killed and now - child.next_started >= timeout) {
+            kill(child.pid, SIGKILL);
+            child.killed = true;
+          }
+        }
+      }
+    }
+  }
+} // namespace sktest
@@ -0,0 +1,276 @@
+#include <sktest/options.hpp>
+#include <sktest/ansi_color.hpp>
+#include <sktest/reporter.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <fnmatch.h>
+
+namespace sktest {
+  namespace {
+
+    /// Match \c argv[index] against \p long_name (and \p short_name, if it is
+    /// not null). On success, \p value points to the option value, which is
+    /// either the part after \c '=' or the next argument, and \p index is
+    /// advanced past the consumed arguments.
+    auto match_valued_option(int argc, char **argv, int &index,
+                             char const *long_name, char const *short_name,
+                             char const *&value) -> bool {
+      char const *argument = argv[index];
+      size_t long_length = strlen(long_name);
+
+      if (strncmp(argument, long_name, long_length) == 0 and
+          argument[long_length] == '=') {
+        value = argument + long_length + 1;
+        return true;
+      }
+
+      bool is_long = strcmp(argument, long_name) == 0;
+      bool is_short = short_name != nullptr and strcmp(argument, short_name) == 0;
+      if (not is_long and not is_short) {
+        return false;
+      }
+
+      if (index + 1 >= argc) {
+        fprintf(stderr, bold_red("error:") " option %s requires a value\n",
+                argument);
+        value = nullptr;
+        return true;
+      }
+
+      value = argv[++index];
+      return true;
+    }
+
+    auto parse_size(char const *option, char const *value, size_t &result)
+        -> bool {
+      if (value == nullptr) {
+        return false;
+      }
+
+      char *end = nullptr;
+      unsigned long long parsed = strtoull(value, &end, 10);
+      if (*value == '\0' or *end != '\0' or *value == '-') {
+        fprintf(stderr, bold_red("error:") " invalid value '%s' for %s\n",
+                value, option);
+        return false;
+      }
+
+      result = size_t(parsed);
+      return true;
+    }
+
+    auto parse_percent(char const *option, char const *value, double &result)
+        -> bool {
+      if (value == nullptr) {
+        return false;
+      }
+
+      char *end = nullptr;
+      double parsed = strtod(value, &end);
+      if (*value == '\0' or *end != '\0' or not std::isfinite(parsed) or
+          parsed < 0) {
+        fprintf(stderr, bold_red("error:") " invalid value '%s' for %s\n",
+                value, option);
+        return false;
+      }
+
+      result = parsed;
+      return true;
+    }
+
+    auto parse_shard(char const *value, size_t &index, size_t &count) -> bool {
+      if (value == nullptr) {
+        return false;
+      }
+
+      unsigned long long parsed_index = 0;
+      unsigned long long parsed_count = 0;
+      int consumed = 0;
+      if (sscanf(value, "%llu/%llu%n", &parsed_index, &parsed_count,
+                 &consumed) != 2 or value[consumed] != '\0' or
+          parsed_count == 0 or parsed_index >= parsed_count) {
+        fprintf(stderr, bold_red("error:") " invalid value '%s' for --shard, "
+                "expected I/N with 0 <= I < N\n", value);
+        return false;
+      }
+
+      index = size_t(parsed_index);
+      count = size_t(parsed_count);
+      return true;
+    }
+  } // namespace
+
+  auto Options::selects(char const *description, char const *file) const
+      -> bool {
+    auto matches_filter = [description](char const *pattern) {
+      return fnmatch(pattern, description, 0) == 0;
+    };
+
+    // `__FILE__` is usually absolute, so a relative path such as
+    // `test/example/test_string.cpp` matches it as a suffix.
+    auto matches_file = [file](char const *path) {
+      size_t file_length = strlen(file);
+      size_t path_length = strlen(path);
+      if (path_length <= file_length and
+          strcmp(file + file_length - path_length, path) == 0 and
+          (path_length == file_length or
+           file[file_length - path_length - 1] == '/')) {
+        return true;
+      }
+      return fnmatch(path, file, 0) == 0;
+    };
+
+    return (filters.empty() or
+            std::any_of(filters.begin(), filters.end(), matches_filter)) and
+           (files.empty() or
+            std::any_of(files.begin(), files.end(), matches_file));
+  }
+
+  auto Options::parse(int argc, char **argv, Options &options) -> bool {
+    for (int index = 1; index < argc; ++index) {
+      char const *argument = argv[index];
+      char const *value = nullptr;
+
+      if (strcmp(argument, "--help") == 0 or strcmp(argument, "-h") == 0) {
+        options.help = true;
+      } else if (match_valued_option(argc, argv, index,
+                                     "--jobs", "-j", value)) {
+        if (not parse_size("--jobs", value, options.jobs)) {
+          return false;
+        }
+      } else if (match_valued_option(argc, argv, index,
+                                     "--filter", nullptr, value)) {
+        if (value == nullptr) { return false; }
+        options.filters.push_back(value);
+      } else if (match_valued_option(argc, argv, index,
+                                     "--file", nullptr, value)) {
+        if (value == nullptr) { return false; }
+        options.files.push_back(value);
+      } else if (strcmp(argument, "--list") == 0) {
+        options.list = true;
+      } else if (match_valued_option(argc, argv, index,
+                                     "--shard", nullptr, value)) {
+        if (not parse_shard(value, options.shard_index, options.shard_count)) {
+          return false;
+        }
+      } else if (match_valued_option(argc, argv, index,
+                                     "--timeout", nullptr, value)) {
+        if (not parse_size("--timeout", value, options.timeout_ms)) {
+          return false;
+        }
+      } else if (match_valued_option(argc, argv, index,
+                                     "--slowest", nullptr, value)) {
+        if (not parse_size("--slowest", value, options.slowest_count)) {
+          return false;
+        }
+      } else if (match_valued_option(argc, argv, index,
+                                     "--reporter", nullptr, value)) {
+        if (value == nullptr) { return false; }
+        if (not Reporter::is_known(value)) {
+          fprintf(stderr, bold_red("error:") " unknown reporter '%s'\n",
+                  value);
+          return false;
+        }
+        options.reporter = value;
+      } else if (match_valued_option(argc, argv, index,
+                                     "--output", "-o", value)) {
+        if (value == nullptr) { return false; }
+        options.output_path = value;
+      } else if (strcmp(argument, "--failed-first") == 0) {
+        options.failed_first = true;
+      } else if (strcmp(argument, "--only-failed") == 0) {
+        options.only_failed = true;
+      } else if (strcmp(argument, "--incremental") == 0) {
+        options.incremental = true;
+      } else if (match_valued_option(argc, argv, index,
+                                     "--state", nullptr, value)) {
+        if (value == nullptr) { return false; }
+        options.state_path = value;
+      } else if (strcmp(argument, "--perf") == 0) {
+        options.perf = true;
+      } else if (strcmp(argument, "--bench") == 0) {
+        options.bench = true;
+      } else if (match_valued_option(argc, argv, index,
+                                     "--baseline", nullptr, value)) {
+        if (value == nullptr) { return false; }
+        options.baseline_path = value;
+      } else if (match_valued_option(argc, argv, index,
+                                     "--save-baseline", nullptr, value)) {
+        if (value == nullptr) { return false; }
+        options.save_baseline_path = value;
+      } else if (match_valued_option(argc, argv, index,
+                                     "--threshold", nullptr, value)) {
+        double percent = 0;
+        if (not parse_percent("--threshold", value, percent)) {
+          return false;
+        }
+        options.regression_threshold = percent / 100.0;
+      } else if (strcmp(argument, "--isolate") == 0) {
+        options.isolate_batch_size = 1;
+      } else if (strncmp(argument, "--isolate=", strlen("--isolate=")) == 0) {
+        value = argument + strlen("--isolate=");
+        if (not parse_size("--isolate", value, options.isolate_batch_size)) {
+          return false;
+        }
+        if (options.isolate_batch_size == 0) {
+          fprintf(stderr, bold_red("error:") " --isolate batch size must be "
+                  "positive\n");
+          return false;
+        }
+      } else {
+        fprintf(stderr, bold_red("error:") " unknown option '%s'\n", argument);
+        return false;
+      }
+    }
+
+    if (options.jobs == 0) {
+      options.jobs = std::thread::hardware_concurrency();
+      if (options.jobs == 0) {
+        options.jobs = 1;
+      }
+    }
+
+    return true;
+  }
+
+  auto Options::print_usage(char const *program) -> void {
+    printf(bold("usage:") " %s [options]\n"
+           "  --jobs N, -j N    run test groups on N worker threads\n"
+           "                    (0 means one per hardware thread)\n"
+           "  --filter=GLOB     run only test groups whose description\n"
+           "                    matches GLOB (repeatable)\n"
+           "  --file=PATH       run only test groups defined in PATH\n"
+           "                    (a path suffix or a glob, repeatable)\n"
+           "  --list            list the selected test groups and exit\n"
+           "  --shard=I/N       run only the I-th of N shards of test groups\n"
+           "  --isolate[=K]     run each batch of K test groups (default 1)\n"
+           "                    in a forked child process\n"
+           "  --timeout=MS      fail test groups running longer than MS\n"
+           "                    milliseconds (runs them in child processes)\n"
+           "  --slowest=N       list the N slowest test groups\n"
+           "  --failed-first    run previously failed test groups first\n"
+           "  --only-failed     run only previously failed test groups\n"
+           "  --incremental     reuse passing results of unchanged sources,\n"
+           "                    from the same build of the binary\n"
+           "  --state=FILE      where results of previous runs are kept\n"
+           "  --reporter=NAME   console (default), junit or jsonl\n"
+           "  --output=FILE, -o FILE\n"
+           "                    write the report to FILE instead of stdout\n"
+           "  --perf            count hardware events per test group and\n"
+           "                    benchmark (Linux only)\n"
+           "  --bench           run benchmarks instead of test groups\n"
+           "  --baseline=FILE   compare benchmarks against a saved run\n"
+           "  --save-baseline=FILE\n"
+           "                    save benchmark results to FILE as JSON\n"
+           "  --threshold=P     regression threshold in percent, such as 2.5\n"
+           "                    (default 10)\n"
+           "  --help, -h        print this help\n",
+           program);
+  }
+} // namespace sktest
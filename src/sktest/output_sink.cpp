@@ -0,0 +1,130 @@
+#include <sktest/output_sink.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+namespace sktest {
+  namespace {
+
+    /// Remove the ANSI escape sequences (\c "\033[...m") from the \p size
+    /// bytes at \p text in place, and return the new size.
+    auto strip_escapes(char *text, size_t size) -> size_t {
+      size_t kept = 0;
+      for (size_t i = 0; i < size; ++i) {
+        if (text[i] == '\033' and i + 1 < size and text[i + 1] == '[') {
+          i += 2;
+          while (i < size and text[i] != 'm') { ++i; }
+          continue;
+        }
+        text[kept++] = text[i];
+      }
+      return kept;
+    }
+  } // namespace
+
+  OutputSink::OutputSink(int fd, bool owns_fd) noexcept
+    : fd(fd), owns_fd(owns_fd), color(isatty(fd) != 0) {}
+
+  OutputSink::~OutputSink() noexcept {
+    flush();
+    if (owns_fd) {
+      close(fd);
+    }
+  }
+
+  auto OutputSink::append(char const *data, size_t size) -> void {
+    while (size != 0) {
+      if (used == buffer_capacity) {
+        flush();
+      }
+      size_t chunk = std::min(size, buffer_capacity - used);
+      memcpy(buffer + used, data, chunk);
+      used += chunk;
+      data += chunk;
+      size -= chunk;
+    }
+  }
+
+  auto OutputSink::write(char const *data, size_t size) -> void {
+    if (color) {
+      append(data, size);
+      return;
+    }
+
+    char const *end = data + size;
+    while (data != end) {
+      auto const *escape = static_cast<char const *>(
+        memchr(data, '\033', size_t(end - data)));
+      if (escape == nullptr) {
+        append(data, size_t(end - data));
+        return;
+      }
+
+      append(data, size_t(escape - data));
+      data = escape + 1;
+      if (data != end and *data == '[') {
+        while (data != end and *data != 'm') { ++data; }
+        if (data != end) { ++data; }
+      }
+    }
+  }
+
+  auto OutputSink::write(char const *string) -> void {
+    write(string, strlen(string));
+  }
+
+  auto OutputSink::format(char const *format, ...) -> void {
+    va_list arguments;
+    va_start(arguments, format);
+    va_list retry;
+    va_copy(retry, arguments);
+
+    size_t room = buffer_capacity - used;
+    int length = vsnprintf(buffer + used, room, format, arguments);
+    va_end(arguments);
+
+    if (length < 0) {
+      va_end(retry);
+      return;
+    }
+
+    if (size_t(length) < room) {
+      // The text is already in place, only escapes may have to go.
+      used += color ? size_t(length)
+                    : strip_escapes(buffer + used, size_t(length));
+    } else if (size_t(length) < buffer_capacity) {
+      flush();
+      vsnprintf(buffer, buffer_capacity, format, retry);
+      used = color ? size_t(length) : strip_escapes(buffer, size_t(length));
+    } else {
+      // Larger than the whole buffer, which only happens with huge operands.
+      auto *text = static_cast<char *>(malloc(size_t(length) + 1));
+      if (text != nullptr) {
+        vsnprintf(text, size_t(length) + 1, format, retry);
+        write(text, size_t(length));
+        free(text);
+      }
+    }
+    va_end(retry);
+  }
+
+  auto OutputSink::flush() -> void {
+    char const *data = buffer;
+    while (used != 0) {
+      ssize_t written = ::write(fd, data, used);
+      if (written < 0) {
+        if (errno == EINTR) { continue; }
+        break; // Nowhere left to report the failure, drop the output.
+      }
+      data += written;
+      used -= size_t(written);
+    }
+    used = 0;
+  }
+} // namespace sktest
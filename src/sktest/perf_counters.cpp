@@ -0,0 +1,106 @@
+#include <sktest/perf_counters.hpp>
+
+#include <cstdio>
+
+#if defined(__linux__)
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace sktest {
+
+#if defined(__linux__)
+  namespace {
+    constexpr uint64_t event_configs[perf_event_count] = {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES,
+      PERF_COUNT_HW_BRANCH_MISSES,
+      PERF_COUNT_HW_CACHE_REFERENCES,
+      PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
+    };
+
+    auto open_event(uint64_t config) -> int {
+      perf_event_attr attribute;
+      memset(&attribute, 0, sizeof(attribute));
+      attribute.type = PERF_TYPE_HARDWARE;
+      attribute.size = sizeof(attribute);
+      attribute.config = config;
+      attribute.disabled = 1;
+      attribute.exclude_kernel = 1;
+      attribute.exclude_hv = 1;
+
+      // pid = 0 and cpu = -1 count the calling thread on any CPU.
+      return int(syscall(SYS_perf_event_open, &attribute, 0, -1, -1, 0));
+    }
+  } // namespace
+
+  PerfCounters::PerfCounters() noexcept {
+    for (size_t i = 0; i < perf_event_count; ++i) {
+      fds[i] = open_event(event_configs[i]);
+      if (fds[i] >= 0) {
+        available = true;
+      }
+    }
+  }
+
+  PerfCounters::~PerfCounters() noexcept {
+    for (int fd : fds) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  auto PerfCounters::start() noexcept -> void {
+    for (int fd : fds) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+  }
+
+  auto PerfCounters::stop() noexcept -> PerfCounts {
+    PerfCounts counts;
+    for (size_t i = 0; i < perf_event_count; ++i) {
+      if (fds[i] < 0) { continue; }
+
+      ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+      uint64_t value = 0;
+      if (read(fds[i], &value, sizeof(value)) == ssize_t(sizeof(value))) {
+        counts.values[i] = value;
+        counts.valid_mask |= uint8_t(1U << i);
+      }
+    }
+    return counts;
+  }
+#else
+  PerfCounters::PerfCounters() noexcept = default;
+  PerfCounters::~PerfCounters() noexcept = default;
+
+  auto PerfCounters::start() noexcept -> void {}
+
+  auto PerfCounters::stop() noexcept -> PerfCounts {
+    return {};
+  }
+#endif
+
+  auto format_rate(char *buffer, size_t size, double rate) -> char const * {
+    if (rate < 0) {
+      snprintf(buffer, size, "n/a");
+    } else {
+      snprintf(buffer, size, "%.2f%%", rate * 100);
+    }
+    return buffer;
+  }
+
+  auto PerfCounters::for_this_thread() -> PerfCounters & {
+    thread_local PerfCounters counters;
+    return counters;
+  }
+} // namespace sktest
@@ -1,64 +1,324 @@
 #include <sktest/registration.hpp>
 #include <sktest/test_group.hpp>
+#include <sktest/benchmark.hpp>
+#include <sktest/work_stealing_pool.hpp>
+#include <sktest/perf_counters.hpp>
+#include <sktest/output_sink.hpp>
+#include <sktest/reporter.hpp>
+#include <sktest/state_file.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace sktest {
 
-  auto RegistrationCenter::sort_tests() -> void {
-    std::sort(test_groups.begin(), test_groups.end(), [](auto lhs, auto rhs) {
-      int compare_name = strcmp(lhs.get_file(), rhs.get_file());
+  namespace {
+    auto thread_cpu_time_ns() -> uint64_t {
+      timespec now {};
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+      return uint64_t(now.tv_sec) * 1000000000ULL + uint64_t(now.tv_nsec);
+    }
+
+    auto summarize_allocations(AllocationCounters const &before,
+                               AllocationCounters const &after)
+        -> AllocationSummary {
+      auto saturating_difference = [](uint64_t lhs, uint64_t rhs) {
+        return lhs > rhs ? lhs - rhs : 0;
+      };
+
+      uint64_t allocation_count = after.allocation_count
+                                - before.allocation_count;
+      uint64_t free_count = after.free_count - before.free_count;
+
+      AllocationSummary summary;
+      summary.allocation_count = allocation_count;
+      summary.allocated_bytes = after.allocated_bytes - before.allocated_bytes;
+      summary.peak_live_bytes =
+        saturating_difference(after.peak_live_bytes, before.live_bytes);
+      summary.leaked_count =
+        saturating_difference(allocation_count, free_count);
+      summary.leaked_bytes =
+        saturating_difference(after.live_bytes, before.live_bytes);
+      return summary;
+    }
+  } // namespace
+
+  thread_local TestGroup *RegistrationCenter::current_test_group = nullptr;
+
+  RegistrationCenter::RegistrationCenter() noexcept = default;
+  RegistrationCenter::~RegistrationCenter() noexcept = default;
+
+  auto RegistrationCenter::collect_test_groups() -> void {
+    test_groups.clear();
+    for (auto *test_group = TestGroup::first_registered();
+         test_group != nullptr; test_group = test_group->next_registered()) {
+      test_groups.push_back(test_group);
+    }
+  }
+
+  auto RegistrationCenter::invoke_test_group(size_t position) -> void {
+    auto &test_group = *test_groups[selection[position]];
+    auto &counters = PerfCounters::for_this_thread();
+    bool counting = measure_perf and counters.is_available();
+
+    current_test_group = &test_group;
+    auto wall_start = std::chrono::steady_clock::now();
+    uint64_t cpu_start = thread_cpu_time_ns();
+    if (counting) {
+      counters.start();
+    }
+    AllocationCounters allocations_before = allocation_counters;
+    allocation_counters.peak_live_bytes = allocation_counters.live_bytes;
+    test_group.invoke();
+    AllocationCounters allocations_after = allocation_counters;
+    PerfCounts perf = counting ? counters.stop() : PerfCounts {};
+    uint64_t cpu_stop = thread_cpu_time_ns();
+    auto wall_stop = std::chrono::steady_clock::now();
+    current_test_group = nullptr;
+
+    auto &result = results[position];
+    result = test_group.summarize();
+    result.perf = perf;
+    result.wall_ns = uint64_t(std::chrono::duration_cast<
+      std::chrono::nanoseconds>(wall_stop - wall_start).count());
+    result.cpu_ns = cpu_stop - cpu_start;
+    result.allocations = summarize_allocations(allocations_before,
+                                               allocations_after);
+
+    reporter->group_finished(test_group, result);
+  }
+
+  auto RegistrationCenter::select_tests(Options const &options) -> void {
+    // Only the indices of the matching groups are sorted, so a run narrowed
+    // by --filter or --file does not pay for ordering the whole suite.
+    std::vector<size_t> matched;
+    for (size_t index = 0; index < test_groups.size(); ++index) {
+      auto const &test_group = *test_groups[index];
+      if (options.selects(test_group.get_description(),
+                          test_group.get_file())) {
+        matched.push_back(index);
+      }
+    }
+
+    std::sort(matched.begin(), matched.end(), [this](size_t lhs, size_t rhs) {
+      auto const &left = *test_groups[lhs];
+      auto const &right = *test_groups[rhs];
+      int compare_name = strcmp(left.get_file(), right.get_file());
       if (compare_name != 0) {
         return compare_name < 0;
       }
-      return lhs.get_line() < rhs.get_line();
+      return left.get_line() < right.get_line();
     });
+
+    // Shards take every N-th matching group rather than contiguous ranges,
+    // so groups of one slow source file spread over all shards.
+    selection.clear();
+    for (size_t index = options.shard_index; index < matched.size();
+         index += options.shard_count) {
+      selection.push_back(matched[index]);
+    }
+    results.assign(selection.size(), GroupResult {});
+  }
+
+  auto RegistrationCenter::apply_state(Options const &options,
+                                       StateFile &state) -> void {
+    auto failed_before = [this, &state](size_t index) {
+      auto const *entry = state.find(*test_groups[index]);
+      return entry != nullptr and not entry->passed;
+    };
+
+    if (options.only_failed) {
+      // Only failures among the selected groups count: those of groups
+      // filtered out, or of other binaries, would leave nothing to run.
+      if (std::any_of(selection.begin(), selection.end(), failed_before)) {
+        std::erase_if(selection, [&](size_t index) {
+          return not failed_before(index);
+        });
+      } else {
+        fputs(bold("note:") " no failed test group recorded, running all "
+              "selected test groups\n", stderr);
+      }
+    }
+
+    if (options.incremental) {
+      std::erase_if(selection, [&](size_t index) {
+        auto const &test_group = *test_groups[index];
+        if (not state.is_unchanged(test_group)) { return false; }
+        auto const *entry = state.find(test_group);
+
+        GroupResult result;
+        result.total_assertion_count = entry->total_assertion_count;
+        result.passed_assertion_count = entry->passed_assertion_count;
+        result.finished = true;
+        result.cached = true;
+        cached_selection.push_back(index);
+        cached_results.push_back(result);
+        return true;
+      });
+    }
+
+    if (options.failed_first) {
+      std::stable_partition(selection.begin(), selection.end(),
+                            failed_before);
+    }
+
+    results.assign(selection.size(), GroupResult {});
   }
 
-  auto RegistrationCenter::push_test_group(TestGroup group) -> void {
-    test_groups.push_back(std::move(group));
+  auto RegistrationCenter::list_tests() const -> void {
+    for (size_t index : selection) {
+      auto const &test_group = *test_groups[index];
+      printf("%s:%zu: %s\n", test_group.get_file(), test_group.get_line(),
+             test_group.get_description());
+    }
   }
 
-  auto RegistrationCenter::invoke_tests() -> int {
-    assert(current_test_group == 0 && "cannot invoke tests more than once");
+  auto RegistrationCenter::invoke_serially() -> void {
+    for (size_t position = 0; position < selection.size(); ++position) {
+      invoke_test_group(position);
+    }
+  }
 
-    sort_tests();
+  auto RegistrationCenter::invoke_in_parallel(size_t jobs) -> void {
+    // `test_groups` and `results` are not resized while the pool runs, and
+    // every test group is invoked by exactly one worker, so the workers only
+    // share read access to the vectors themselves.
+    WorkStealingPool pool(std::min(jobs, selection.size()));
+    pool.run(selection.size(), [this](size_t position) {
+      invoke_test_group(position);
+    });
+  }
 
-    size_t total_test_group_count  = 0;
-    size_t passed_test_group_count = 0;
-    size_t total_assertion_count   = 0;
-    size_t passed_assertion_count  = 0;
+  auto RegistrationCenter::invoke_tests(int argc, char **argv) -> int {
+    assert(not invoked && "cannot invoke tests more than once");
+    invoked = true;
 
-    for (; current_test_group < test_groups.size(); ++current_test_group) {
-      ++total_test_group_count;
+    Options options;
+    if (not Options::parse(argc, argv, options)) {
+      Options::print_usage(argv[0]);
+      return 2;
+    }
+    if (options.help) {
+      Options::print_usage(argv[0]);
+      return 0;
+    }
 
-      auto &test_group = get_current_test_group();
-      test_group.invoke();
+    if (options.bench) {
+      return invoke_benchmarks(options);
+    }
+
+    collect_test_groups();
+    select_tests(options);
+
+    std::string state_path = options.state_path != nullptr
+                           ? std::string(options.state_path)
+                           : StateFile::default_path(argv[0]);
+    StateFile state;
+    state.load(state_path.c_str());
+    apply_state(options, state);
+
+    if (options.list) {
+      list_tests();
+      return 0;
+    }
 
-      bool has_passed = true;
-      for (const auto &assertion : test_group.get_assertions()) {
-        ++total_assertion_count;
+    measure_perf = options.perf;
+    if (measure_perf and not PerfCounters::for_this_thread().is_available()) {
+      fputs(bold("note:") " hardware performance counters are unavailable, "
+            "continuing without them\n", stderr);
+      measure_perf = false;
+    }
 
-        if (assertion.has_passed()) {
-          ++passed_assertion_count;
-        } else {
-          has_passed = false;
-        }
+    if (options.output_path == nullptr) {
+      sink = std::make_unique<OutputSink>(STDOUT_FILENO, false);
+    } else {
+      int fd = open(options.output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd < 0) {
+        fprintf(stderr, bold_red("error:") " cannot open output '%s'\n",
+                options.output_path);
+        return 2;
       }
+      sink = std::make_unique<OutputSink>(fd, true);
+    }
+    reporter.reset(Reporter::create(options, *sink));
 
-      if (has_passed) {
-        ++passed_test_group_count;
+    auto run_start = std::chrono::steady_clock::now();
+    reporter->run_started(selection.size() + cached_selection.size());
+    for (size_t i = 0; i < cached_selection.size(); ++i) {
+      reporter->group_finished(*test_groups[cached_selection[i]],
+                               cached_results[i]);
+    }
+
+    // A hung test group cannot be stopped inside this process, so a timeout
+    // runs the groups in child processes that can be killed. Without an
+    // explicit --isolate, one batch per job keeps the forks few.
+    size_t batch_size = options.isolate_batch_size;
+    if (options.timeout_ms != 0 and batch_size == 0) {
+      batch_size = std::max<size_t>(
+        1, (selection.size() + options.jobs - 1) / options.jobs);
+    }
+
+    if (batch_size != 0) {
+      invoke_isolated(batch_size, options.jobs, options.timeout_ms);
+    } else if (options.jobs > 1 and selection.size() > 1) {
+      invoke_in_parallel(options.jobs);
+    } else {
+      invoke_serially();
+    }
+
+    // Statistics are collected after all test groups have finished and in
+    // the sorted order, so parallel and isolated runs report exactly what a
+    // serial run does.
+    RunSummary summary;
+    summary.wall_ns = uint64_t(std::chrono::duration_cast<
+      std::chrono::nanoseconds>(std::chrono::steady_clock::now()
+                                - run_start).count());
+
+    std::vector<ReportEntry> entries;
+    entries.reserve(selection.size() + cached_selection.size());
+    for (size_t position = 0; position < selection.size(); ++position) {
+      entries.push_back({test_groups[selection[position]], &results[position]});
+      state.update(*test_groups[selection[position]], results[position]);
+    }
+    for (size_t i = 0; i < cached_selection.size(); ++i) {
+      entries.push_back({test_groups[cached_selection[i]], &cached_results[i]});
+    }
+
+    for (auto const &entry : entries) {
+      auto const &result = *entry.result;
+
+      ++summary.total_test_group_count;
+      summary.total_assertion_count += result.total_assertion_count;
+      summary.passed_assertion_count += result.passed_assertion_count;
+
+      if (result.crashed) {
+        ++summary.crashed_test_group_count;
+      }
+      if (result.timed_out) {
+        ++summary.timed_out_test_group_count;
+      }
+      if (result.cached) {
+        ++summary.cached_test_group_count;
+      }
+      if (result.has_passed()) {
+        ++summary.passed_test_group_count;
       }
     }
 
-    print_statistics(
-      total_test_group_count, passed_test_group_count,
-      total_assertion_count, passed_assertion_count);
+    if (not state.save(state_path.c_str())) {
+      fprintf(stderr, bold("note:") " cannot write the state file '%s'\n",
+              state_path.c_str());
+    }
 
-    return total_assertion_count == passed_assertion_count ? 0 : 1;
-  }
+    reporter->run_finished(summary, entries);
+    sink->flush();
 
-  Registrar::Registrar(const char *name, void (*test)(),
-                       const char *file_name, size_t line_number) noexcept {
-    TestGroup group(name, test, file_name, line_number);
-    RegistrationCenter::get_mutable().push_test_group(group);
+    return summary.passed_test_group_count == summary.total_test_group_count
+         ? 0 : 1;
   }
-}
\ No newline at end of file
+}
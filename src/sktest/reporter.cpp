@@ -0,0 +1,582 @@
+#include <sktest/reporter.hpp>
+#include <sktest/options.hpp>
+#include <sktest/test_group.hpp>
+#include <sktest/ansi_color.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+namespace sktest {
+  namespace {
+
+    auto assertion_name(AssertionKind kind) -> char const * {
+      switch (kind) {
+        case AssertionKind::is_true:       return "assert_true";
+        case AssertionKind::is_false:      return "assert_false";
+        case AssertionKind::are_equal:     return "assert_equal";
+        case AssertionKind::are_not_equal: return "assert_not_equal";
+        case AssertionKind::no_alloc:      return "assert_no_alloc";
+        case AssertionKind::max_alloc:     return "assert_max_alloc";
+      }
+      return "assertion";
+    }
+
+    auto status_name(GroupResult const &result) -> char const * {
+      if (result.timed_out) { return "timed_out"; }
+      if (result.crashed)   { return "crashed"; }
+      return result.has_passed() ? "passed" : "failed";
+    }
+
+    /// Human readable reason of a crashed or timed out test group.
+    auto format_abort_reason(GroupResult const &result, size_t timeout_ms,
+                             char *buffer, size_t size) -> void {
+      if (result.timed_out) {
+        snprintf(buffer, size, "still running after %zu ms, killed",
+                 timeout_ms);
+      } else if (result.crash_by_signal) {
+        snprintf(buffer, size, "killed by signal %d (%s)", result.crash_code,
+                 strsignal(result.crash_code));
+      } else {
+        snprintf(buffer, size, "exited with status %d before the test group "
+                 "finished", result.crash_code);
+      }
+    }
+
+    class ConsoleReporter final : public Reporter {
+     private:
+      size_t slowest_count;
+
+      auto print_failure_report(AssertionRecord const &record,
+                                TestGroup const &test_group) -> void {
+        sink.format(bold_red("error:") " test failed at %s:%u\n",
+                    record.file_name, record.line_number);
+        sink.format("  " bold("test group:") "   %s\n",
+                    test_group.get_description());
+
+        switch (record.kind) {
+          case AssertionKind::is_true:
+          case AssertionKind::is_false:
+            sink.format("  " bold("condition:") "    %s( " blue("%s") " )\n",
+                        assertion_name(record.kind), record.left);
+            break;
+          case AssertionKind::are_equal:
+          case AssertionKind::are_not_equal:
+            sink.format(
+              "  " bold("condition:") "    %s(\n"
+              "                  left  = " blue("%s") " ,\n"
+              "                  right = " blue("%s") " ,\n"
+              "                )\n",
+              assertion_name(record.kind), record.left, record.right);
+            break;
+          case AssertionKind::no_alloc:
+            sink.format("  " bold("condition:") "    assert_no_alloc { ... }\n");
+            break;
+          case AssertionKind::max_alloc:
+            sink.format("  " bold("condition:") "    assert_max_alloc( " blue("%s")
+                        " ) { ... }\n", record.left);
+            break;
+        }
+
+        if (record.kind == AssertionKind::no_alloc or
+            record.kind == AssertionKind::max_alloc) {
+          sink.format("  " bold("allocated:") "    %llu bytes in %llu "
+                      "allocation(s)\n",
+                      (unsigned long long)record.allocated_bytes,
+                      (unsigned long long)record.allocation_count);
+        }
+
+        if (strcmp(record.description, "") != 0) {
+          sink.format("  " bold("description:") "  %s\n", record.description);
+        }
+      }
+
+      auto print_statistics(RunSummary const &summary) -> void {
+        size_t aborted_test_group_count = summary.crashed_test_group_count
+                                        + summary.timed_out_test_group_count;
+
+        // Fix the divide-by-zero bug when statistics test results in #9
+        if (summary.total_assertion_count == 0 and
+            aborted_test_group_count == 0) {
+          sink.write(bold_green("no test found:") " process will exit with 0\n");
+          return;
+        }
+
+        if (summary.passed_assertion_count == summary.total_assertion_count and
+            aborted_test_group_count == 0) {
+          sink.write(bold_green("test passed:") "\n");
+        } else {
+          sink.write(bold_red("tests failed:") "\n");
+        }
+
+        double pass_rate = summary.total_assertion_count == 0 ? 0.0 :
+                           double(summary.passed_assertion_count)
+                      / // --------------------------------------
+                           double(summary.total_assertion_count);
+
+        constexpr unsigned int pass_rate_bar_width = 32;
+
+        auto red_part_width =
+          (unsigned int)((1.0 - pass_rate) * double(pass_rate_bar_width));
+
+        // When the pass rate is close to but not equal to 1. `red_bar_count`
+        // may be equal to 0 after rounding, making it look like all the tests
+        // passed. We need to manually set `red_bar_count` to 1 in this case.
+        if (red_part_width == 0 and
+            summary.passed_assertion_count != summary.total_assertion_count) {
+          red_part_width = 1;
+        }
+
+        unsigned int green_part_width = pass_rate_bar_width - red_part_width;
+
+        constexpr int percentage_base = 100;
+        sink.format("  [" green("%.*s") red("%.*s") "] %.1f%%\n",
+                    green_part_width, "========================================",
+                    red_part_width,   "========================================",
+                    pass_rate * percentage_base);
+
+        sink.format("  " bold("test group:") "   "
+                    green("%zu passed") ", " red("%zu failed") ", "
+                    "%zu total\n",
+                    summary.passed_test_group_count,
+                    summary.total_test_group_count
+                      - summary.passed_test_group_count,
+                    summary.total_test_group_count);
+
+        sink.format("  " bold("assertion:") "    "
+                    green("%zu passed") ", " red("%zu failed") ", "
+                    "%zu total\n",
+                    summary.passed_assertion_count,
+                    summary.total_assertion_count
+                      - summary.passed_assertion_count,
+                    summary.total_assertion_count);
+
+        if (summary.crashed_test_group_count != 0) {
+          sink.format("  " bold("crashed:") "      " red("%zu test group(s)")
+                      "\n", summary.crashed_test_group_count);
+        }
+        if (summary.timed_out_test_group_count != 0) {
+          sink.format("  " bold("timed out:") "    " red("%zu test group(s)")
+                      "\n", summary.timed_out_test_group_count);
+        }
+        if (summary.cached_test_group_count != 0) {
+          sink.format("  " bold("cached:") "       %zu test group(s) with "
+                      "unchanged sources\n", summary.cached_test_group_count);
+        }
+      }
+
+      auto print_slowest(std::vector<ReportEntry> const &entries) -> void {
+        std::vector<ReportEntry> order = entries;
+        size_t count = std::min(slowest_count, order.size());
+        std::partial_sort(order.begin(),
+                          order.begin() + std::ptrdiff_t(count), order.end(),
+                          [](ReportEntry const &lhs, ReportEntry const &rhs) {
+          return lhs.result->wall_ns > rhs.result->wall_ns;
+        });
+
+        sink.format(bold("slowest %zu test group(s):") "\n", count);
+        sink.format("  %12s %12s  %s\n", "wall", "cpu", "test group");
+        for (size_t i = 0; i < count; ++i) {
+          auto const &result = *order[i].result;
+          sink.format("  %9.3f ms %9.3f ms  %s%s\n",
+                      double(result.wall_ns) / 1e6,
+                      double(result.cpu_ns) / 1e6,
+                      order[i].test_group->get_description(),
+                      result.timed_out ? red(" (timed out)") : "");
+        }
+      }
+
+      auto print_perf_counters(std::vector<ReportEntry> const &entries)
+          -> void {
+        sink.write(bold("performance counters:") "\n");
+        sink.format("  %14s %14s %6s %12s %7s %12s %7s  %s\n", "cycles",
+                    "instructions", "IPC", "cache-miss", "rate",
+                    "branch-miss", "rate", "test group");
+
+        for (auto const &entry : entries) {
+          auto const &perf = entry.result->perf;
+          if (perf.valid_mask == 0) { continue; }
+
+          char columns[perf_event_count][24];
+          for (size_t i = 0; i < perf_event_count; ++i) {
+            if (perf.has(PerfEvent(i))) {
+              snprintf(columns[i], sizeof(columns[i]), "%llu",
+                       (unsigned long long)perf.values[i]);
+            } else {
+              snprintf(columns[i], sizeof(columns[i]), "-");
+            }
+          }
+
+          char cache_rate[16];
+          char branch_rate[16];
+          sink.format("  %14s %14s %6.2f %12s %7s %12s %7s  %s\n",
+                      columns[size_t(PerfEvent::cycles)],
+                      columns[size_t(PerfEvent::instructions)], perf.ipc(),
+                      columns[size_t(PerfEvent::cache_misses)],
+                      format_rate(cache_rate, sizeof(cache_rate),
+                                  perf.rate(PerfEvent::cache_misses,
+                                            PerfEvent::cache_references)),
+                      columns[size_t(PerfEvent::branch_misses)],
+                      format_rate(branch_rate, sizeof(branch_rate),
+                                  perf.rate(PerfEvent::branch_misses,
+                                            PerfEvent::branches)),
+                      entry.test_group->get_description());
+        }
+      }
+
+     public:
+      ConsoleReporter(OutputSink &sink, size_t slowest_count) noexcept
+        : Reporter(sink), slowest_count(slowest_count) {}
+
+      auto run_started(size_t) -> void override {}
+
+      auto group_finished(TestGroup const &test_group,
+                          GroupResult const &result) -> void override {
+        bool leaked = allocation_hooks_installed and
+                      result.allocations.has_leaks();
+        if (test_group.get_failures().empty() and not leaked) { return; }
+
+        std::lock_guard<OutputSink> guard(sink);
+        test_group.get_failures().for_each(
+          [this, &test_group](AssertionRecord const &record) {
+          print_failure_report(record, test_group);
+        });
+
+        if (leaked) {
+          sink.format(bold("warning:") " test group leaked memory at %s:%zu\n",
+                      test_group.get_file(), test_group.get_line());
+          sink.format("  " bold("test group:") "   %s\n",
+                      test_group.get_description());
+          sink.format("  " bold("leaked:") "       %llu bytes in %llu "
+                      "allocation(s)\n",
+                      (unsigned long long)result.allocations.leaked_bytes,
+                      (unsigned long long)result.allocations.leaked_count);
+        }
+      }
+
+      auto group_aborted(TestGroup const &test_group,
+                         GroupResult const &result, size_t timeout_ms)
+          -> void override {
+        char reason[160];
+        format_abort_reason(result, timeout_ms, reason, sizeof(reason));
+
+        std::lock_guard<OutputSink> guard(sink);
+        // Failures a child sent before it crashed or was killed.
+        test_group.get_failures().for_each(
+          [this, &test_group](AssertionRecord const &record) {
+          print_failure_report(record, test_group);
+        });
+        sink.format(bold_red("error:") " test group %s at %s:%zu\n",
+                    result.timed_out ? "timed out" : "crashed",
+                    test_group.get_file(), test_group.get_line());
+        sink.format("  " bold("test group:") "   %s\n",
+                    test_group.get_description());
+        sink.format("  " bold("reason:") "       %s\n", reason);
+      }
+
+      auto run_finished(RunSummary const &summary,
+                        std::vector<ReportEntry> const &entries)
+          -> void override {
+        std::lock_guard<OutputSink> guard(sink);
+        print_statistics(summary);
+
+        if (slowest_count != 0) {
+          print_slowest(entries);
+        }
+
+        bool any_perf = std::any_of(entries.begin(), entries.end(),
+                                    [](ReportEntry const &entry) {
+          return entry.result->perf.valid_mask != 0;
+        });
+        if (any_perf) {
+          print_perf_counters(entries);
+        }
+      }
+    };
+
+    auto write_json_string(OutputSink &sink, char const *text) -> void {
+      sink.write("\"", 1);
+      for (char const *run = text; *text != '\0'; run = ++text) {
+        while (*text != '\0' and *text != '"' and *text != '\\' and
+               (unsigned char)(*text) >= 0x20) {
+          ++text;
+        }
+        sink.write(run, size_t(text - run));
+        if (*text == '\0') { break; }
+
+        switch (*text) {
+          case '"':  sink.write("\\\""); break;
+          case '\\': sink.write("\\\\"); break;
+          case '\n': sink.write("\\n"); break;
+          case '\t': sink.write("\\t"); break;
+          default:   sink.format("\\u%04x", unsigned((unsigned char)(*text)));
+        }
+      }
+      sink.write("\"", 1);
+    }
+
+    /// Lines of the form
+    /// \code
+    /// {"event":"group","name":"...","file":"...","line":12,"status":"failed",
+    ///  "assertions":3,"passed":2,"wall_ns":1200,"cpu_ns":1100,
+    ///  "failures":[{"file":"...","line":14,"assertion":"assert_equal",
+    ///  "left":"...","right":"...","description":"..."}]}
+    /// \endcode
+    /// followed by one \c "summary" event.
+    class JsonLinesReporter final : public Reporter {
+     private:
+      auto write_group_head(TestGroup const &test_group,
+                            GroupResult const &result) -> void {
+        sink.write("{\"event\":\"group\",\"name\":");
+        write_json_string(sink, test_group.get_description());
+        sink.write(",\"file\":");
+        write_json_string(sink, test_group.get_file());
+        sink.format(",\"line\":%zu,\"status\":\"%s\",\"assertions\":%zu,"
+                    "\"passed\":%zu,\"wall_ns\":%llu,\"cpu_ns\":%llu",
+                    test_group.get_line(), status_name(result),
+                    result.total_assertion_count,
+                    result.passed_assertion_count,
+                    (unsigned long long)result.wall_ns,
+                    (unsigned long long)result.cpu_ns);
+        if (result.cached) {
+          sink.write(",\"cached\":true");
+        }
+
+        static char const *const perf_names[perf_event_count] = {
+          "cycles", "instructions", "cache_misses", "branch_misses",
+          "cache_references", "branches",
+        };
+        for (size_t i = 0; i < perf_event_count; ++i) {
+          if (result.perf.has(PerfEvent(i))) {
+            sink.format(",\"%s\":%llu", perf_names[i],
+                        (unsigned long long)result.perf.values[i]);
+          }
+        }
+
+        if (allocation_hooks_installed) {
+          auto const &allocations = result.allocations;
+          sink.format(",\"allocations\":%llu,\"allocated_bytes\":%llu,"
+                      "\"peak_live_bytes\":%llu,\"leaked_allocations\":%llu,"
+                      "\"leaked_bytes\":%llu",
+                      (unsigned long long)allocations.allocation_count,
+                      (unsigned long long)allocations.allocated_bytes,
+                      (unsigned long long)allocations.peak_live_bytes,
+                      (unsigned long long)allocations.leaked_count,
+                      (unsigned long long)allocations.leaked_bytes);
+        }
+      }
+
+      auto write_failures(TestGroup const &test_group) -> void {
+        sink.write(",\"failures\":[");
+        char const *separator = "";
+        test_group.get_failures().for_each(
+          [this, &separator](AssertionRecord const &record) {
+          sink.write(separator);
+          separator = ",";
+          sink.write("{\"file\":");
+          write_json_string(sink, record.file_name);
+          sink.format(",\"line\":%u,\"assertion\":\"%s\",\"left\":",
+                      record.line_number, assertion_name(record.kind));
+          write_json_string(sink, record.left);
+          if (record.right != nullptr) {
+            sink.write(",\"right\":");
+            write_json_string(sink, record.right);
+          }
+          if (record.kind == AssertionKind::no_alloc or
+              record.kind == AssertionKind::max_alloc) {
+            sink.format(",\"allocations\":%llu,\"allocated_bytes\":%llu",
+                        (unsigned long long)record.allocation_count,
+                        (unsigned long long)record.allocated_bytes);
+          }
+          sink.write(",\"description\":");
+          write_json_string(sink, record.description);
+          sink.write("}");
+        });
+        sink.write("]");
+      }
+
+     public:
+      explicit JsonLinesReporter(OutputSink &sink) noexcept : Reporter(sink) {
+        sink.set_color(false);
+      }
+
+      auto run_started(size_t test_group_count) -> void override {
+        std::lock_guard<OutputSink> guard(sink);
+        sink.format("{\"event\":\"start\",\"test_groups\":%zu}\n",
+                    test_group_count);
+      }
+
+      auto group_finished(TestGroup const &test_group,
+                          GroupResult const &result) -> void override {
+        std::lock_guard<OutputSink> guard(sink);
+        write_group_head(test_group, result);
+        write_failures(test_group);
+        sink.write("}\n");
+      }
+
+      auto group_aborted(TestGroup const &test_group,
+                         GroupResult const &result, size_t timeout_ms)
+          -> void override {
+        char reason[160];
+        format_abort_reason(result, timeout_ms, reason, sizeof(reason));
+
+        std::lock_guard<OutputSink> guard(sink);
+        write_group_head(test_group, result);
+        sink.write(",\"reason\":");
+        write_json_string(sink, reason);
+        write_failures(test_group);
+        sink.write("}\n");
+      }
+
+      auto run_finished(RunSummary const &summary,
+                        std::vector<ReportEntry> const &) -> void override {
+        std::lock_guard<OutputSink> guard(sink);
+        sink.format("{\"event\":\"summary\",\"test_groups\":%zu,"
+                    "\"passed_test_groups\":%zu,\"crashed\":%zu,"
+                    "\"timed_out\":%zu,\"cached\":%zu,\"assertions\":%zu,"
+                    "\"passed_assertions\":%zu,\"wall_ns\":%llu}\n",
+                    summary.total_test_group_count,
+                    summary.passed_test_group_count,
+                    summary.crashed_test_group_count,
+                    summary.timed_out_test_group_count,
+                    summary.cached_test_group_count,
+                    summary.total_assertion_count,
+                    summary.passed_assertion_count,
+                    (unsigned long long)summary.wall_ns);
+      }
+    };
+
+    auto write_xml_text(OutputSink &sink, char const *text) -> void {
+      for (char const *run = text; *text != '\0'; run = ++text) {
+        while (*text != '\0' and strchr("&<>\"'", *text) == nullptr) {
+          ++text;
+        }
+        sink.write(run, size_t(text - run));
+        if (*text == '\0') { break; }
+
+        switch (*text) {
+          case '&':  sink.write("&amp;"); break;
+          case '<':  sink.write("&lt;"); break;
+          case '>':  sink.write("&gt;"); break;
+          case '"':  sink.write("&quot;"); break;
+          default:   sink.write("&apos;"); break;
+        }
+      }
+    }
+
+    /// JUnit XML as understood by common CI servers. Test cases are written
+    /// as soon as their group finishes, even from forked children, so the
+    /// \c <testsuite> element carries no counts; they would only be known at
+    /// the end of the run.
+    class JUnitReporter final : public Reporter {
+     private:
+      auto write_testcase_head(TestGroup const &test_group,
+                               GroupResult const &result) -> void {
+        sink.write("    <testcase name=\"");
+        write_xml_text(sink, test_group.get_description());
+        sink.write("\" classname=\"");
+        write_xml_text(sink, test_group.get_file());
+        sink.write("\" file=\"");
+        write_xml_text(sink, test_group.get_file());
+        sink.format("\" line=\"%zu\" assertions=\"%zu\" time=\"%.6f\"",
+                    test_group.get_line(), result.total_assertion_count,
+                    double(result.wall_ns) / 1e9);
+      }
+
+      auto write_failures(TestGroup const &test_group) -> void {
+        test_group.get_failures().for_each(
+          [this](AssertionRecord const &record) {
+          sink.write("      <failure type=\"");
+          sink.write(assertion_name(record.kind));
+          sink.write("\" message=\"");
+          write_xml_text(sink, record.description);
+          sink.write("\">");
+          write_xml_text(sink, record.file_name);
+          sink.format(":%u: %s(", record.line_number,
+                      assertion_name(record.kind));
+          write_xml_text(sink, record.left);
+          if (record.right != nullptr) {
+            sink.write(", ");
+            write_xml_text(sink, record.right);
+          }
+          sink.write(")</failure>\n");
+        });
+      }
+
+     public:
+      explicit JUnitReporter(OutputSink &sink) noexcept : Reporter(sink) {
+        sink.set_color(false);
+      }
+
+      auto run_started(size_t) -> void override {
+        std::lock_guard<OutputSink> guard(sink);
+        sink.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                   "<testsuites>\n"
+                   "  <testsuite name=\"sktest\">\n");
+      }
+
+      auto group_finished(TestGroup const &test_group,
+                          GroupResult const &result) -> void override {
+        bool leaked = allocation_hooks_installed and
+                      result.allocations.has_leaks();
+
+        std::lock_guard<OutputSink> guard(sink);
+        write_testcase_head(test_group, result);
+        if (test_group.get_failures().empty() and not leaked) {
+          sink.write("/>\n");
+          return;
+        }
+
+        sink.write(">\n");
+        write_failures(test_group);
+        if (leaked) {
+          sink.format("      <system-err>leaked %llu bytes in %llu "
+                      "allocation(s)</system-err>\n",
+                      (unsigned long long)result.allocations.leaked_bytes,
+                      (unsigned long long)result.allocations.leaked_count);
+        }
+        sink.write("    </testcase>\n");
+      }
+
+      auto group_aborted(TestGroup const &test_group,
+                         GroupResult const &result, size_t timeout_ms)
+          -> void override {
+        char reason[160];
+        format_abort_reason(result, timeout_ms, reason, sizeof(reason));
+
+        std::lock_guard<OutputSink> guard(sink);
+        write_testcase_head(test_group, result);
+        sink.write(">\n");
+        write_failures(test_group);
+        sink.format("      <error type=\"%s\" message=\"",
+                    result.timed_out ? "timeout" : "crash");
+        write_xml_text(sink, reason);
+        sink.write("\"/>\n    </testcase>\n");
+      }
+
+      auto run_finished(RunSummary const &, std::vector<ReportEntry> const &)
+          -> void override {
+        std::lock_guard<OutputSink> guard(sink);
+        sink.write("  </testsuite>\n"
+                   "</testsuites>\n");
+      }
+    };
+  } // namespace
+
+  auto Reporter::is_known(char const *name) -> bool {
+    return strcmp(name, "console") == 0 or strcmp(name, "junit") == 0 or
+           strcmp(name, "jsonl") == 0;
+  }
+
+  auto Reporter::create(Options const &options, OutputSink &sink)
+      -> Reporter * {
+    if (strcmp(options.reporter, "junit") == 0) {
+      return new JUnitReporter(sink);
+    }
+    if (strcmp(options.reporter, "jsonl") == 0) {
+      return new JsonLinesReporter(sink);
+    }
+    return new ConsoleReporter(sink, options.slowest_count);
+  }
+} // namespace sktest
@@ -0,0 +1,180 @@
+#include <sktest/state_file.hpp>
+#include <sktest/test_group.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__)
+#include <sys/stat.h>
+#endif
+
+namespace sktest {
+  namespace {
+    constexpr uint64_t fnv_offset_basis = 14695981039346656037ULL;
+    constexpr uint64_t fnv_prime = 1099511628211ULL;
+
+    auto fnv_append(uint64_t hash, void const *data, size_t size)
+        -> uint64_t {
+      auto const *bytes = static_cast<unsigned char const *>(data);
+      for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * fnv_prime;
+      }
+      return hash;
+    }
+
+    /// Escape the separators of the state file, so any key fits on one line
+    /// and can be stored and compared as it is.
+    auto append_escaped(std::string &out, char const *text) -> void {
+      for (; *text != '\0'; ++text) {
+        switch (*text) {
+          case '\\': out += "\\\\"; break;
+          case '\t': out += "\\t"; break;
+          case '\n': out += "\\n"; break;
+          default:   out += *text; break;
+        }
+      }
+    }
+  } // namespace
+
+  auto StateFile::make_key(char const *file, size_t line,
+                           char const *description) -> std::string {
+    std::string key = std::to_string(line);
+    key += '\t';
+    append_escaped(key, file);
+    key += '\t';
+    append_escaped(key, description);
+    return key;
+  }
+
+  auto StateFile::default_path(char const *program) -> std::string {
+    return std::string(program) + ".sktest-state";
+  }
+
+  auto StateFile::load(char const *path) -> void {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) { return; }
+
+    char *line = nullptr;
+    size_t capacity = 0;
+    ssize_t length = 0;
+    while ((length = getline(&line, &capacity, file)) > 0) {
+      if (line[length - 1] == '\n') {
+        line[--length] = '\0';
+      }
+
+      char status = 0;
+      unsigned long long hash = 0;
+      unsigned long long binary = 0;
+      unsigned long long total = 0;
+      unsigned long long passed = 0;
+      int consumed = 0;
+      if (sscanf(line, "%c %llx %llx %llu %llu %n", &status, &hash, &binary,
+                 &total, &passed, &consumed) != 5 or
+          (status != 'P' and status != 'F')) {
+        continue;
+      }
+
+      // The rest of the line is the key, already escaped by `make_key`.
+      std::string key(line + consumed, size_t(length - consumed));
+
+      Entry entry;
+      entry.passed = status == 'P';
+      entry.source_hash = hash;
+      entry.binary_identity = binary;
+      entry.total_assertion_count = size_t(total);
+      entry.passed_assertion_count = size_t(passed);
+      entries[key] = entry;
+    }
+
+    free(line);
+    fclose(file);
+  }
+
+  auto StateFile::save(char const *path) const -> bool {
+    std::string temporary = std::string(path) + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (file == nullptr) { return false; }
+
+    for (auto const &[key, entry] : entries) {
+      fprintf(file, "%c %llx %llx %llu %llu %s\n",
+              entry.passed ? 'P' : 'F',
+              (unsigned long long)entry.source_hash,
+              (unsigned long long)entry.binary_identity,
+              (unsigned long long)entry.total_assertion_count,
+              (unsigned long long)entry.passed_assertion_count,
+              key.c_str());
+    }
+
+    bool written = ferror(file) == 0;
+    written = fclose(file) == 0 and written;
+    if (not written or rename(temporary.c_str(), path) != 0) {
+      remove(temporary.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  auto StateFile::find(TestGroup const &test_group) const -> Entry const * {
+    auto found = entries.find(make_key(test_group.get_file(),
+                                       test_group.get_line(),
+                                       test_group.get_description()));
+    return found == entries.end() ? nullptr : &found->second;
+  }
+
+  auto StateFile::update(TestGroup const &test_group,
+                         GroupResult const &result) -> void {
+    Entry entry;
+    entry.passed = result.has_passed();
+    entry.source_hash = hash_source(test_group.get_file());
+    entry.binary_identity = binary_identity;
+    entry.total_assertion_count = result.total_assertion_count;
+    entry.passed_assertion_count = result.passed_assertion_count;
+    entries[make_key(test_group.get_file(), test_group.get_line(),
+                     test_group.get_description())] = entry;
+  }
+
+  auto StateFile::hash_source(char const *file) -> uint64_t {
+    auto cached = source_hashes.find(file);
+    if (cached != source_hashes.end()) {
+      return cached->second;
+    }
+
+    uint64_t hash = 0;
+    if (FILE *source = fopen(file, "rb")) {
+      hash = fnv_offset_basis;
+      unsigned char buffer[16384];
+      size_t size = 0;
+      while ((size = fread(buffer, 1, sizeof(buffer), source)) != 0) {
+        hash = fnv_append(hash, buffer, size);
+      }
+      fclose(source);
+    }
+
+    source_hashes.emplace(file, hash);
+    return hash;
+  }
+
+  auto StateFile::identify_binary() -> uint64_t {
+#if defined(__linux__)
+    struct stat status;
+    if (stat("/proc/self/exe", &status) != 0) { return 0; }
+    uint64_t const fields[] = {
+      uint64_t(status.st_size), uint64_t(status.st_mtim.tv_sec),
+      uint64_t(status.st_mtim.tv_nsec), uint64_t(status.st_ino),
+    };
+    return fnv_append(fnv_offset_basis, fields, sizeof(fields));
+#else
+    return 0;
+#endif
+  }
+
+  auto StateFile::is_unchanged(TestGroup const &test_group) -> bool {
+    Entry const *entry = find(test_group);
+    if (entry == nullptr or not entry->passed or entry->source_hash == 0 or
+        entry->binary_identity != binary_identity) {
+      return false;
+    }
+    return entry->source_hash == hash_source(test_group.get_file());
+  }
+} // namespace sktest
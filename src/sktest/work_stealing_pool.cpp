@@ -0,0 +1,81 @@
+#include <sktest/work_stealing_pool.hpp>
+
+#include <thread>
+
+namespace sktest {
+
+  WorkStealingPool::WorkStealingPool(size_t worker_count) {
+    if (worker_count == 0) {
+      worker_count = 1;
+    }
+
+    workers.reserve(worker_count);
+    for (size_t i = 0; i < worker_count; ++i) {
+      workers.push_back(std::make_unique<Worker>());
+    }
+  }
+
+  auto WorkStealingPool::pop_local(size_t worker, size_t &task) -> bool {
+    auto &self = *workers[worker];
+    std::lock_guard<std::mutex> lock(self.mutex);
+
+    if (self.tasks.empty()) {
+      return false;
+    }
+
+    task = self.tasks.front();
+    self.tasks.pop_front();
+    return true;
+  }
+
+  auto WorkStealingPool::steal(size_t thief, size_t &task) -> bool {
+    // Start from the next worker rather than worker 0, otherwise every thief
+    // would fight over the same victim.
+    for (size_t offset = 1; offset < workers.size(); ++offset) {
+      auto &victim = *workers[(thief + offset) % workers.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+
+      if (not victim.tasks.empty()) {
+        task = victim.tasks.back();
+        victim.tasks.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  auto WorkStealingPool::work(size_t worker,
+                              std::function<void(size_t)> const &task) -> void {
+    size_t index = 0;
+    while (pop_local(worker, index) or steal(worker, index)) {
+      task(index);
+    }
+  }
+
+  auto WorkStealingPool::run(size_t task_count,
+                             std::function<void(size_t)> const &task) -> void {
+    size_t worker_count = workers.size();
+    size_t chunk = task_count / worker_count;
+    size_t remainder = task_count % worker_count;
+
+    size_t next = 0;
+    for (size_t worker = 0; worker < worker_count; ++worker) {
+      size_t size = chunk + (worker < remainder ? 1 : 0);
+      for (size_t i = 0; i < size; ++i) {
+        workers[worker]->tasks.push_back(next++);
+      }
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(worker_count - 1);
+    for (size_t worker = 1; worker < worker_count; ++worker) {
+      threads.emplace_back([this, worker, &task] { work(worker, task); });
+    }
+
+    work(0, task);
+
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+} // namespace sktest
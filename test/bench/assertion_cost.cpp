@@ -0,0 +1,73 @@
+// Microbenchmark for the cost of a single passing assertion.
+//
+// "legacy" replays what `assert_equal` used to do before failures were kept
+// as compact records: build a polymorphic assertion object, then copy it into
+// a `std::vector` owned by the test group, whether it passed or not. "current"
+// is the real `assert_equal` macro, which only bumps a counter when the
+// assertion passes.
+
+#define USE_SKTEST_DEFAULT_MAIN_FUNCTION
+#include <sktest/test.hpp>
+
+#include <chrono>
+#include <vector>
+
+namespace {
+  constexpr size_t iterations = 10'000'000;
+
+  struct LegacyAssertion {
+    bool passed;
+    char const *description;
+    char const *file_name;
+    size_t line_number;
+    void const *group;
+
+    LegacyAssertion(bool passed, char const *description,
+                    char const *file_name, size_t line_number)
+      : passed(passed), description(description), file_name(file_name),
+        line_number(line_number), group(nullptr) {}
+    virtual ~LegacyAssertion() = default;
+  };
+
+  struct LegacyEqualAssertion : LegacyAssertion {
+    char const *left;
+    char const *right;
+
+    LegacyEqualAssertion(bool passed, char const *left, char const *right,
+                         char const *description,
+                         char const *file_name, size_t line_number)
+      : LegacyAssertion(passed, description, file_name, line_number),
+        left(left), right(right) {}
+  };
+
+  template <typename Body>
+  auto measure(char const *name, Body body) -> void {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    auto stop = std::chrono::steady_clock::now();
+
+    auto elapsed = std::chrono::duration<double, std::nano>(stop - start);
+    printf("%-8s %6.2f ns/assertion\n", name,
+           elapsed.count() / double(iterations));
+  }
+
+  volatile size_t sink = 0;
+} // namespace
+
+test_group ("cost of one passing assertion") {
+  measure("legacy", [] {
+    std::vector<LegacyAssertion> assertions;
+    for (size_t i = 0; i < iterations; ++i) {
+      LegacyEqualAssertion assertion(i + 1 == sink + i + 1, "i + 1", "i + 1",
+                                     "", __FILE__, __LINE__);
+      assertions.push_back(assertion);
+    }
+    sink = assertions.size() - iterations;
+  });
+
+  measure("current", [] {
+    for (size_t i = 0; i < iterations; ++i) {
+      assert_equal(i + 1, sink + i + 1);
+    }
+  });
+}
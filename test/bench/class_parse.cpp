@@ -0,0 +1,157 @@
+// Throughput of the class file parser over a directory of class files.
+//
+//     skjvm-bench-class-parse [directory] [rounds]
+//
+// Every round maps, parses and unmaps each `.class` file under the directory,
+// then touches what class loading reads first: the class name and the code of
+// every method. Without a directory, a synthetic set of classes is generated
+// into a temporary directory first.
+
+#include <skjvm/class_file.hpp>
+#include <skjvm/class_writer.hpp>
+#include <skjvm/mapped_file.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace skjvm;
+
+namespace {
+  constexpr int generated_class_count = 2000;
+
+  auto collect(std::string const &directory, std::vector<std::string> &paths)
+      -> void {
+    DIR *handle = opendir(directory.c_str());
+    if (handle == nullptr) { return; }
+    while (dirent *entry = readdir(handle)) {
+      std::string name = entry->d_name;
+      if (name == "." or name == "..") { continue; }
+      std::string path = directory + "/" + name;
+      struct stat status {};
+      if (stat(path.c_str(), &status) != 0) { continue; }
+      if (S_ISDIR(status.st_mode)) {
+        collect(path, paths);
+      } else if (name.size() > 6 and
+                 name.compare(name.size() - 6, 6, ".class") == 0) {
+        paths.push_back(path);
+      }
+    }
+    closedir(handle);
+  }
+
+  /// Classes shaped like ordinary application code: a few fields, getters,
+  /// and methods with some arithmetic and calls.
+  auto generate(std::string const &directory) -> void {
+    for (int i = 0; i < generated_class_count; ++i) {
+      std::string name = "bench/Generated" + std::to_string(i);
+      ClassWriter writer(name.c_str());
+      for (int j = 0; j < 8; ++j) {
+        std::string field = "field" + std::to_string(j);
+        writer.add_field(access::private_, field.c_str(), "I");
+      }
+      for (int j = 0; j < 16; ++j) {
+        std::string method = "method" + std::to_string(j);
+        std::string callee = "bench/Generated" + std::to_string((i + j) %
+                                                     generated_class_count);
+        CodeWriter code(writer);
+        code.set_max(3, 2);
+        for (int k = 0; k < 8; ++k) {
+          std::string field = "field" + std::to_string(k);
+          code.op(Opcode::aload_0)
+            .field(Opcode::getfield, name.c_str(), field.c_str(), "I")
+            .op(Opcode::iload_1)
+            .op(Opcode::iadd)
+            .op(Opcode::istore_1);
+        }
+        code.op(Opcode::iload_1)
+          .invoke(Opcode::invokestatic, callee.c_str(), "helper", "(I)I")
+          .ldc_string(method.c_str())
+          .op(Opcode::pop)
+          .op(Opcode::ireturn);
+        writer.add_method(access::public_, method.c_str(), "(I)I", &code);
+      }
+      std::string path = directory + "/Generated" + std::to_string(i) +
+                         ".class";
+      if (not writer.write_to(path.c_str())) {
+        fprintf(stderr, "cannot write %s\n", path.c_str());
+        exit(1);
+      }
+    }
+  }
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+  std::string directory;
+  bool generated = false;
+  if (argc >= 2) {
+    directory = argv[1];
+  } else {
+    char pattern[] = "/tmp/skjvm-bench-XXXXXX";
+    if (mkdtemp(pattern) == nullptr) {
+      perror("mkdtemp");
+      return 1;
+    }
+    directory = pattern;
+    generated = true;
+    generate(directory);
+  }
+  int rounds = argc >= 3 ? atoi(argv[2]) : 5;
+
+  std::vector<std::string> paths;
+  collect(directory, paths);
+  if (paths.empty()) {
+    fprintf(stderr, "no class files under %s\n", directory.c_str());
+    return 1;
+  }
+
+  size_t bytes = 0;
+  size_t failures = 0;
+  uint64_t checksum = 0;
+  double best = 0;
+  for (int round = 0; round < rounds; ++round) {
+    bytes = 0;
+    failures = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto const &path : paths) {
+      MappedFile file;
+      ClassFile class_file;
+      if (not file.open(path.c_str()) or
+          class_file.parse(file.get_data(), file.get_size()) !=
+            ClassFileError::none) {
+        ++failures;
+        continue;
+      }
+      bytes += file.get_size();
+      checksum += class_file.this_class_name().hash();
+      for (auto const &method : class_file.methods()) {
+        checksum += class_file.code(method).code_length;
+      }
+    }
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+    if (round == 0 or elapsed.count() < best) {
+      best = elapsed.count();
+    }
+  }
+
+  size_t parsed = paths.size() - failures;
+  printf("%zu class files, %zu bytes, %zu rejected (checksum %llx)\n",
+         paths.size(), bytes, failures, (unsigned long long)checksum);
+  printf("best of %d rounds: %.3f ms, %.0f classes/s, %.1f MB/s\n", rounds,
+         best * 1e3, double(parsed) / best, double(bytes) / best / 1e6);
+
+  if (generated) {
+    for (auto const &path : paths) {
+      unlink(path.c_str());
+    }
+    rmdir(directory.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,251 @@
+// The VM's collections against their standard library counterparts, in
+// nanoseconds an operation and heap allocations a round.
+//
+//     skjvm-bench-collections [count] [rounds]
+//
+// Each round works on count items, 1M by default: short arrays built and
+// summed, a hash table from 64-bit keys filled, probed with hits and misses
+// and walked, a queue of nodes filled and drained, and scratch blocks
+// allocated in a region then freed.
+
+#include <skjvm/hash_map.hpp>
+#include <skjvm/intrusive_list.hpp>
+#include <skjvm/memory.hpp>
+#include <skjvm/small_vector.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+using namespace skjvm;
+
+namespace {
+  size_t operator_news = 0;
+} // namespace
+
+// Count the allocations of the standard containers. The VM's own go
+// through malloc and count themselves.
+auto operator new(size_t size) -> void * {
+  ++operator_news;
+  return checked_malloc(size);
+}
+
+auto operator delete(void *pointer) noexcept -> void {
+  free(pointer);
+}
+
+auto operator delete(void *pointer, size_t) noexcept -> void {
+  free(pointer);
+}
+
+namespace {
+  struct Result {
+    double seconds;
+    size_t allocations;
+  };
+
+  /// Best time of \p rounds calls of \p run, which returns the allocations
+  /// it made, in seconds.
+  template <typename Run>
+  auto best_of(int rounds, Run run) -> Result {
+    Result best {0, 0};
+    for (int round = 0; round < rounds; ++round) {
+      size_t news = operator_news;
+      auto start = std::chrono::steady_clock::now();
+      size_t allocations = run();
+      std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+      allocations += operator_news - news;
+      if (round == 0 or elapsed.count() < best.seconds) {
+        best = {elapsed.count(), allocations};
+      }
+    }
+    return best;
+  }
+
+  auto report(char const *name, size_t operations, Result standard,
+              Result skjvm) -> void {
+    double standard_ns = standard.seconds * 1e9 / double(operations);
+    double skjvm_ns = skjvm.seconds * 1e9 / double(operations);
+    printf("%-22s %9.2f ns %10zu %9.2f ns %10zu %7.2fx\n", name,
+           standard_ns, standard.allocations, skjvm_ns, skjvm.allocations,
+           standard_ns / skjvm_ns);
+  }
+
+  auto next_key(uint64_t &state) -> uint64_t {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+
+  uint64_t checksum = 0;
+
+  constexpr size_t short_length = 6;
+
+  auto bench_vectors(size_t count, int rounds) -> void {
+    size_t arrays = count / short_length;
+    Result standard = best_of(rounds, [&] {
+      for (size_t i = 0; i < arrays; ++i) {
+        std::vector<uint32_t> items;
+        for (size_t j = 0; j < short_length; ++j) {
+          items.push_back(uint32_t(i + j));
+        }
+        for (uint32_t item : items) { checksum += item; }
+      }
+      return size_t(0);
+    });
+    Result small = best_of(rounds, [&] {
+      size_t allocations = 0;
+      for (size_t i = 0; i < arrays; ++i) {
+        SmallVector<uint32_t, 8> items;
+        for (size_t j = 0; j < short_length; ++j) {
+          items.push(uint32_t(i + j));
+        }
+        for (uint32_t item : items) { checksum += item; }
+        allocations += items.get_allocations();
+      }
+      return allocations;
+    });
+    report("vector: short arrays", arrays * short_length, standard, small);
+
+    standard = best_of(rounds, [&] {
+      std::vector<uint64_t> items;
+      for (size_t i = 0; i < count; ++i) { items.push_back(i); }
+      for (uint64_t item : items) { checksum += item; }
+      return size_t(0);
+    });
+    small = best_of(rounds, [&] {
+      SmallVector<uint64_t, 8> items;
+      for (size_t i = 0; i < count; ++i) { items.push(i); }
+      for (uint64_t item : items) { checksum += item; }
+      return items.get_allocations();
+    });
+    report("vector: one long array", count, standard, small);
+  }
+
+  auto bench_maps(size_t count, int rounds) -> void {
+    std::vector<uint64_t> keys;
+    uint64_t state = 88172645463325252ull;
+    for (size_t i = 0; i < count; ++i) { keys.push_back(next_key(state)); }
+
+    std::unordered_map<uint64_t, uint64_t> standard_map;
+    HashMap<uint64_t, uint64_t> map;
+    Result standard = best_of(rounds, [&] {
+      standard_map = {};
+      for (uint64_t key : keys) { standard_map.emplace(key, key); }
+      return size_t(0);
+    });
+    Result robin_hood = best_of(rounds, [&] {
+      map = HashMap<uint64_t, uint64_t>();
+      for (uint64_t key : keys) { map.insert(key, key); }
+      return map.get_allocations();
+    });
+    report("hash map: insert", count, standard, robin_hood);
+
+    standard = best_of(rounds, [&] {
+      for (uint64_t key : keys) {
+        checksum += standard_map.find(key)->second;
+        checksum += standard_map.count(key + 1);
+      }
+      return size_t(0);
+    });
+    robin_hood = best_of(rounds, [&] {
+      for (uint64_t key : keys) {
+        checksum += *map.find(key);
+        checksum += map.contains(key + 1);
+      }
+      return size_t(0);
+    });
+    report("hash map: lookup", count * 2, standard, robin_hood);
+
+    standard = best_of(rounds, [&] {
+      for (auto const &entry : standard_map) { checksum += entry.second; }
+      return size_t(0);
+    });
+    robin_hood = best_of(rounds, [&] {
+      for (auto const &entry : map) { checksum += entry.value; }
+      return size_t(0);
+    });
+    report("hash map: iterate", count, standard, robin_hood);
+  }
+
+  struct Node : ListNode {
+    uint64_t value;
+  };
+
+  auto bench_lists(size_t count, int rounds) -> void {
+    // Intrusive nodes live in their owners; here, one array of them.
+    auto *nodes = static_cast<Node *>(checked_calloc(count, sizeof(Node)));
+    for (size_t i = 0; i < count; ++i) { nodes[i].value = i; }
+
+    Result standard = best_of(rounds, [&] {
+      std::list<uint64_t> queue;
+      for (size_t i = 0; i < count; ++i) { queue.push_back(i); }
+      for (uint64_t value : queue) { checksum += value; }
+      while (not queue.empty()) {
+        checksum += queue.front();
+        queue.pop_front();
+      }
+      return size_t(0);
+    });
+    Result intrusive = best_of(rounds, [&] {
+      IntrusiveList<Node> queue;
+      for (size_t i = 0; i < count; ++i) { queue.push_back(nodes[i]); }
+      for (Node const &node : queue) { checksum += node.value; }
+      while (Node *node = queue.pop_front()) { checksum += node->value; }
+      return size_t(0);
+    });
+    report("list: fill, walk, drain", count * 3, standard, intrusive);
+    free(nodes);
+  }
+
+  auto bench_arenas(size_t count, int rounds) -> void {
+    // Scratch blocks of a few sizes, freed in batches of a thousand, like
+    // the temporary tables of decoding one method.
+    constexpr size_t batch = 1000;
+    std::vector<void *> blocks(batch);
+    Result standard = best_of(rounds, [&] {
+      for (size_t i = 0; i < count; i += batch) {
+        for (size_t j = 0; j < batch; ++j) {
+          auto *block = new uint64_t[1 + (i + j) % 8]();
+          checksum += *block;
+          blocks[j] = block;
+        }
+        for (void *block : blocks) { delete[] static_cast<uint64_t *>(block); }
+      }
+      return size_t(0);
+    });
+    Arena arena;
+    Result region = best_of(rounds, [&] {
+      size_t allocations = arena.get_allocations();
+      for (size_t i = 0; i < count; i += batch) {
+        ArenaScope scope(arena);
+        for (size_t j = 0; j < batch; ++j) {
+          auto *block = arena.allocate_array<uint64_t>(1 + (i + j) % 8);
+          checksum += *block;
+        }
+      }
+      return arena.get_allocations() - allocations;
+    });
+    report("arena: scoped blocks", count, standard, region);
+  }
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+  size_t count = argc >= 2 ? size_t(atoi(argv[1])) : size_t(1) << 20;
+  int rounds = argc >= 3 ? atoi(argv[2]) : 5;
+
+  printf("%-22s %12s %10s %12s %10s %8s\n", "", "std", "allocs", "skjvm",
+         "allocs", "speedup");
+  bench_vectors(count, rounds);
+  bench_maps(count, rounds);
+  bench_lists(count, rounds);
+  bench_arenas(count, rounds);
+  printf("(checksum %llx)\n", (unsigned long long)checksum);
+  return 0;
+}
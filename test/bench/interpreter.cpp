@@ -0,0 +1,298 @@
+// Instruction dispatch cost of the interpreter on small kernels.
+//
+//     skjvm-bench-interpreter [rounds]
+//
+// Each kernel is a static method of a generated class: an arithmetic loop,
+// recursive calls, an array fill and scan, virtual calls and field accesses in
+// a loop. It is run once in counting mode to learn how many instructions it
+// executes, then timed with threaded and with switch dispatch, and compiled
+// from its first call, reporting the best round as nanoseconds per executed
+// instruction, and the hit rate of the inline caches of its call sites.
+
+#include <skjvm/class_loader.hpp>
+#include <skjvm/class_path.hpp>
+#include <skjvm/class_registry.hpp>
+#include <skjvm/class_writer.hpp>
+#include <skjvm/descriptor.hpp>
+#include <skjvm/symbol_table.hpp>
+#include <skjvm/vm.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace skjvm;
+
+namespace {
+  struct Kernel {
+    char const *name;
+    int32_t argument;
+  };
+
+  constexpr Kernel kernels[] {
+    {"arithmetic", 1000000},
+    {"fib", 25},
+    {"scan", 200000},
+    {"calls", 500000},
+    {"fields", 500000},
+  };
+
+  auto kernel_method(ClassWriter &writer, char const *name,
+                     CodeWriter &code) -> void {
+    writer.add_method(access::public_ | access::static_, name, "(I)I", &code);
+  }
+
+  /// `bench/Kernels` and `bench/Counter`, whose \c next method the
+  /// \c calls kernel invokes virtually.
+  auto generate(std::string const &directory) -> bool {
+    ClassWriter kernels_class("bench/Kernels");
+
+    // s = s * 31 + (i ^ (i >> 3)) for i below n.
+    CodeWriter arithmetic(kernels_class);
+    Label arithmetic_loop = arithmetic.new_label();
+    Label arithmetic_end = arithmetic.new_label();
+    arithmetic.set_max(4, 3)
+              .iconst(0).local(Opcode::istore, 1)
+              .iconst(0).local(Opcode::istore, 2)
+              .bind(arithmetic_loop)
+              .local(Opcode::iload, 1).local(Opcode::iload, 0)
+              .jump(Opcode::if_icmpge, arithmetic_end)
+              .local(Opcode::iload, 2).iconst(31).op(Opcode::imul)
+              .local(Opcode::iload, 1).local(Opcode::iload, 1).iconst(3)
+              .op(Opcode::ishr).op(Opcode::ixor).op(Opcode::iadd)
+              .local(Opcode::istore, 2)
+              .iinc(1, 1)
+              .jump(Opcode::goto_, arithmetic_loop)
+              .bind(arithmetic_end)
+              .local(Opcode::iload, 2).op(Opcode::ireturn);
+    kernel_method(kernels_class, "arithmetic", arithmetic);
+
+    CodeWriter fib(kernels_class);
+    Label fib_recurse = fib.new_label();
+    fib.set_max(3, 1)
+       .local(Opcode::iload, 0).iconst(2)
+       .jump(Opcode::if_icmpge, fib_recurse)
+       .local(Opcode::iload, 0).op(Opcode::ireturn)
+       .bind(fib_recurse)
+       .local(Opcode::iload, 0).iconst(1).op(Opcode::isub)
+       .invoke(Opcode::invokestatic, "bench/Kernels", "fib", "(I)I")
+       .local(Opcode::iload, 0).iconst(2).op(Opcode::isub)
+       .invoke(Opcode::invokestatic, "bench/Kernels", "fib", "(I)I")
+       .op(Opcode::iadd).op(Opcode::ireturn);
+    kernel_method(kernels_class, "fib", fib);
+
+    // a = new int[n]; a[i] = i; then the sum of a.
+    CodeWriter scan(kernels_class);
+    Label fill = scan.new_label();
+    Label filled = scan.new_label();
+    Label add = scan.new_label();
+    Label added = scan.new_label();
+    scan.set_max(4, 4)
+        .local(Opcode::iload, 0).newarray(10).local(Opcode::astore, 1)
+        .iconst(0).local(Opcode::istore, 2)
+        .bind(fill)
+        .local(Opcode::iload, 2).local(Opcode::iload, 0)
+        .jump(Opcode::if_icmpge, filled)
+        .local(Opcode::aload, 1).local(Opcode::iload, 2)
+        .local(Opcode::iload, 2).op(Opcode::iastore)
+        .iinc(2, 1)
+        .jump(Opcode::goto_, fill)
+        .bind(filled)
+        .iconst(0).local(Opcode::istore, 3)
+        .iconst(0).local(Opcode::istore, 2)
+        .bind(add)
+        .local(Opcode::iload, 2).local(Opcode::aload, 1)
+        .op(Opcode::arraylength)
+        .jump(Opcode::if_icmpge, added)
+        .local(Opcode::iload, 3).local(Opcode::aload, 1)
+        .local(Opcode::iload, 2).op(Opcode::iaload).op(Opcode::iadd)
+        .local(Opcode::istore, 3)
+        .iinc(2, 1)
+        .jump(Opcode::goto_, add)
+        .bind(added)
+        .local(Opcode::iload, 3).op(Opcode::ireturn);
+    kernel_method(kernels_class, "scan", scan);
+
+    // c = new Counter(); s = c.next(s) n times.
+    CodeWriter calls(kernels_class);
+    Label call = calls.new_label();
+    Label called = calls.new_label();
+    calls.set_max(3, 4)
+         .type(Opcode::new_, "bench/Counter").op(Opcode::dup)
+         .invoke(Opcode::invokespecial, "bench/Counter", "<init>", "()V")
+         .local(Opcode::astore, 1)
+         .iconst(0).local(Opcode::istore, 2)
+         .iconst(0).local(Opcode::istore, 3)
+         .bind(call)
+         .local(Opcode::iload, 2).local(Opcode::iload, 0)
+         .jump(Opcode::if_icmpge, called)
+         .local(Opcode::aload, 1).local(Opcode::iload, 3)
+         .invoke(Opcode::invokevirtual, "bench/Counter", "next", "(I)I")
+         .local(Opcode::istore, 3)
+         .iinc(2, 1)
+         .jump(Opcode::goto_, call)
+         .bind(called)
+         .local(Opcode::iload, 3).op(Opcode::ireturn);
+    kernel_method(kernels_class, "calls", calls);
+
+    // c = new Counter(); c.value += i for i below n.
+    CodeWriter fields(kernels_class);
+    Label update = fields.new_label();
+    Label updated = fields.new_label();
+    fields.set_max(4, 3)
+          .type(Opcode::new_, "bench/Counter").op(Opcode::dup)
+          .invoke(Opcode::invokespecial, "bench/Counter", "<init>", "()V")
+          .local(Opcode::astore, 1)
+          .iconst(0).local(Opcode::istore, 2)
+          .bind(update)
+          .local(Opcode::iload, 2).local(Opcode::iload, 0)
+          .jump(Opcode::if_icmpge, updated)
+          .local(Opcode::aload, 1).op(Opcode::dup)
+          .field(Opcode::getfield, "bench/Counter", "value", "I")
+          .local(Opcode::iload, 2).op(Opcode::iadd)
+          .field(Opcode::putfield, "bench/Counter", "value", "I")
+          .iinc(2, 1)
+          .jump(Opcode::goto_, update)
+          .bind(updated)
+          .local(Opcode::aload, 1)
+          .field(Opcode::getfield, "bench/Counter", "value", "I")
+          .op(Opcode::ireturn);
+    kernel_method(kernels_class, "fields", fields);
+
+    ClassWriter counter("bench/Counter");
+    counter.add_field(access::public_, "value", "I");
+    CodeWriter counter_init(counter);
+    counter_init.set_max(1, 1)
+                .local(Opcode::aload, 0)
+                .invoke(Opcode::invokespecial, "java/lang/Object", "<init>",
+                        "()V")
+                .op(Opcode::return_);
+    counter.add_method(access::public_, "<init>", "()V", &counter_init);
+    CodeWriter next(counter);
+    next.set_max(2, 2)
+        .local(Opcode::iload, 1).iconst(1).op(Opcode::iadd)
+        .op(Opcode::ireturn);
+    counter.add_method(access::public_, "next", "(I)I", &next);
+
+    if (mkdir((directory + "/bench").c_str(), 0755) != 0) { return false; }
+    return kernels_class.write_to((directory +
+                                   "/bench/Kernels.class").c_str()) and
+           counter.write_to((directory + "/bench/Counter.class").c_str());
+  }
+
+  struct Result {
+    int32_t value;
+    double seconds;
+  };
+
+  auto run(VM &vm, Thread &thread, Method &method, int32_t argument)
+      -> Result {
+    Value *locals = thread.get_stack_base();
+    locals[0].i = argument;
+    auto start = std::chrono::steady_clock::now();
+    Value value = vm.invoke(thread, method, locals);
+    std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+    if (thread.exception != nullptr) {
+      vm.print_exception(thread.exception);
+      exit(1);
+    }
+    return {value.i, elapsed.count()};
+  }
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+  int rounds = argc >= 2 ? atoi(argv[1]) : 5;
+
+  char pattern[] = "/tmp/skjvm-bench-XXXXXX";
+  if (mkdtemp(pattern) == nullptr) {
+    perror("mkdtemp");
+    return 1;
+  }
+  std::string directory = pattern;
+  if (not generate(directory)) {
+    fprintf(stderr, "cannot write classes to %s\n", directory.c_str());
+    return 1;
+  }
+
+  ClassPath class_path;
+  class_path.open(directory.c_str(), nullptr);
+  ClassLoader loader(class_path);
+  SymbolTable symbols;
+  ClassRegistry registry(loader, symbols);
+  VM vm(registry);
+  Thread thread(vm);
+  Compiler &compiler = vm.get_compiler();
+  compiler.set_compile_threshold(1);
+  compiler.set_backedge_threshold(1);
+
+  LinkError error = LinkError::none;
+  Klass *klass = registry.link(make_view("bench/Kernels"), error);
+  if (klass == nullptr or not vm.initialize(thread, *klass)) {
+    fprintf(stderr, "cannot link bench/Kernels: %s\n", describe(error));
+    return 1;
+  }
+
+  printf("%-12s %14s %14s %14s %8s %14s %8s %9s\n", "kernel",
+         "instructions", "threaded ns/i", "switch ns/i", "speedup",
+         "compiled ns/i", "speedup", "ic hits");
+  for (Kernel const &kernel : kernels) {
+    Method *method = klass->find_method(make_view(kernel.name),
+                                        make_view("(I)I"));
+    vm.set_dispatch_mode(DispatchMode::counting);
+    compiler.set_enabled(false);
+    thread.executed = 0;
+    int32_t expected = run(vm, thread, *method, kernel.argument).value;
+    auto instructions = double(thread.executed);
+
+    thread.inline_cache_hits = 0;
+    thread.inline_cache_misses = 0;
+    // The last mode runs compiled code, with threaded dispatch for what
+    // stays interpreted.
+    double best[3] {};
+    DispatchMode const modes[3] {DispatchMode::threaded,
+                                 DispatchMode::switch_,
+                                 DispatchMode::threaded};
+    for (int mode = 0; mode < 3; ++mode) {
+      vm.set_dispatch_mode(modes[mode]);
+      compiler.set_enabled(mode == 2);
+      for (int round = 0; round < rounds; ++round) {
+        Result result = run(vm, thread, *method, kernel.argument);
+        if (result.value != expected) {
+          fprintf(stderr, "%s: %d instead of %d\n", kernel.name,
+                  result.value, expected);
+          return 1;
+        }
+        if (round == 0 or result.seconds < best[mode]) {
+          best[mode] = result.seconds;
+        }
+      }
+    }
+    uint64_t calls = thread.inline_cache_hits + thread.inline_cache_misses;
+    char hit_rate[16] = "-";
+    if (calls != 0) {
+      snprintf(hit_rate, sizeof(hit_rate), "%.2f%%",
+               100.0 * double(thread.inline_cache_hits) / double(calls));
+    }
+    printf("%-12s %14.0f %14.2f %14.2f %7.2fx %14.2f %7.2fx %9s\n",
+           kernel.name, instructions, best[0] * 1e9 / instructions,
+           best[1] * 1e9 / instructions, best[1] / best[0],
+           best[2] * 1e9 / instructions, best[0] / best[2], hit_rate);
+  }
+  if (not has_threaded_dispatch()) {
+    printf("(threaded dispatch is not available with this compiler)\n");
+  }
+  if (not Compiler::is_available()) {
+    printf("(compiled code is not available on this platform)\n");
+  }
+
+  unlink((directory + "/bench/Kernels.class").c_str());
+  unlink((directory + "/bench/Counter.class").c_str());
+  rmdir((directory + "/bench").c_str());
+  rmdir(directory.c_str());
+  return 0;
+}
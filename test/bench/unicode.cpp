@@ -0,0 +1,151 @@
+// Throughput of the Unicode transcoders, in GB/s of input, for each
+// instruction set the CPU supports.
+//
+//     skjvm-bench-unicode [megabytes] [rounds]
+//
+// Each corpus is generated text of the given size, 16 MB by default: ASCII
+// like class files and identifiers, Latin-1 with some accented letters, and
+// CJK, which is 3 bytes a character in UTF-8.
+
+#include <skjvm/unicode.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace skjvm;
+
+namespace {
+  struct Corpus {
+    char const *name;
+    std::vector<uint16_t> chars;
+    std::vector<uint8_t> utf8;
+    std::vector<uint8_t> modified;
+  };
+
+  /// About \p size bytes of UTF-8 text, words of letters from \p alphabet
+  /// separated by spaces.
+  auto generate(char const *name, std::vector<uint16_t> const &alphabet,
+                size_t size) -> Corpus {
+    Corpus corpus {name, {}, {}, {}};
+    uint32_t state = 12345;
+    size_t bytes = 0;
+    while (bytes < size) {
+      state = state * 1103515245u + 12345u;
+      uint32_t word = 2 + (state >> 16) % 9;
+      for (uint32_t i = 0; i < word; ++i) {
+        state = state * 1103515245u + 12345u;
+        uint16_t unit = alphabet[(state >> 16) % alphabet.size()];
+        corpus.chars.push_back(unit);
+        bytes += unit < 0x80 ? 1 : unit < 0x800 ? 2 : 3;
+      }
+      corpus.chars.push_back(' ');
+      ++bytes;
+    }
+    auto length = uint32_t(corpus.chars.size());
+    corpus.utf8.resize(encode_utf8(corpus.chars.data(), length, nullptr));
+    encode_utf8(corpus.chars.data(), length, corpus.utf8.data());
+    corpus.modified.resize(encode_modified_utf8(corpus.chars.data(), length,
+                                                nullptr));
+    encode_modified_utf8(corpus.chars.data(), length,
+                         corpus.modified.data());
+    return corpus;
+  }
+
+  auto letters(uint16_t first, uint16_t last) -> std::vector<uint16_t> {
+    std::vector<uint16_t> alphabet;
+    for (uint32_t unit = first; unit <= last; ++unit) {
+      alphabet.push_back(uint16_t(unit));
+    }
+    return alphabet;
+  }
+
+  /// Best time of \p rounds calls of \p run, in seconds.
+  template <typename Run>
+  auto best_of(int rounds, Run run) -> double {
+    double best = 0;
+    for (int round = 0; round < rounds; ++round) {
+      auto start = std::chrono::steady_clock::now();
+      run();
+      std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+      if (round == 0 or elapsed.count() < best) { best = elapsed.count(); }
+    }
+    return best;
+  }
+} // namespace
+
+auto main(int argc, char **argv) -> int {
+  size_t size = (argc >= 2 ? size_t(atoi(argv[1])) : 16) << 20;
+  int rounds = argc >= 3 ? atoi(argv[2]) : 5;
+
+  std::vector<uint16_t> latin1 = letters('a', 'z');
+  for (uint16_t accented : {0xe0, 0xe9, 0xe8, 0xf6, 0xfc, 0xe7}) {
+    latin1.push_back(accented);
+  }
+  std::vector<Corpus> corpora;
+  corpora.push_back(generate("ascii", letters('a', 'z'), size));
+  corpora.push_back(generate("latin1", latin1, size));
+  corpora.push_back(generate("cjk", letters(0x4e00, 0x4fff), size));
+
+  printf("%-7s %-7s %12s %12s %12s %12s %12s\n", "isa", "corpus",
+         "mutf8->utf16", "utf8->utf16", "utf16->utf8", "utf16->mutf8",
+         "latin1");
+  uint64_t checksum = 0;
+  for (UnicodeIsa isa : {UnicodeIsa::scalar, UnicodeIsa::sse2,
+                         UnicodeIsa::avx2}) {
+    if (not set_unicode_isa(isa)) { continue; }
+    for (Corpus const &corpus : corpora) {
+      auto length = uint32_t(corpus.chars.size());
+      std::vector<uint16_t> chars(length);
+      std::vector<uint8_t> bytes(size_t(length) * 3);
+      auto rate = [&](size_t input, double seconds) {
+        return double(input) / seconds / 1e9;
+      };
+
+      double modified = best_of(rounds, [&] {
+        checksum += uint64_t(decode_modified_utf8(
+          corpus.modified.data(), uint32_t(corpus.modified.size()),
+          chars.data()));
+      });
+      double utf8 = best_of(rounds, [&] {
+        checksum += uint64_t(decode_utf8(corpus.utf8.data(),
+                                         uint32_t(corpus.utf8.size()),
+                                         chars.data()));
+      });
+      double encode = best_of(rounds, [&] {
+        checksum += encode_utf8(corpus.chars.data(), length, bytes.data());
+      });
+      double encode_modified = best_of(rounds, [&] {
+        checksum += encode_modified_utf8(corpus.chars.data(), length,
+                                         bytes.data());
+      });
+      // Compact strings: compress, then inflate back, when it fits.
+      std::string latin1_rate = "-";
+      if (compress_latin1(corpus.chars.data(), length, nullptr)) {
+        double compact = best_of(rounds, [&] {
+          checksum += compress_latin1(corpus.chars.data(), length,
+                                      bytes.data());
+          inflate_latin1(bytes.data(), length, chars.data());
+        });
+        char formatted[32];
+        snprintf(formatted, sizeof(formatted), "%.2f GB/s",
+                 rate(size_t(length) * 2 * 2, compact));
+        latin1_rate = formatted;
+      }
+
+      printf("%-7s %-7s %7.2f GB/s %7.2f GB/s %7.2f GB/s %7.2f GB/s %12s\n",
+             describe(isa), corpus.name,
+             rate(corpus.modified.size(), modified),
+             rate(corpus.utf8.size(), utf8),
+             rate(size_t(length) * 2, encode),
+             rate(size_t(length) * 2, encode_modified),
+             latin1_rate.c_str());
+    }
+  }
+  (void)set_unicode_isa(detect_unicode_isa());
+  printf("(checksum %llx)\n", (unsigned long long)checksum);
+  return 0;
+}
@@ -0,0 +1,13 @@
+#include <sktest/test.hpp>
+#include <string.h>
+
+bench_group ("strlen of a short string") {
+  char const *volatile string = "hello, world";
+  sktest::do_not_optimize(strlen(string));
+}
+
+bench_group ("strcmp of two equal short strings") {
+  char const *volatile left = "hello, world";
+  char const *volatile right = "hello, world";
+  sktest::do_not_optimize(strcmp(left, right));
+}
@@ -2,6 +2,7 @@
 // careful when using it in CI.
 
 #define USE_SKTEST_DEFAULT_MAIN_FUNCTION
+#define USE_SKTEST_ALLOCATION_HOOKS
 #include <sktest/test.hpp>
 
 test_group ("test SkTest itself") {
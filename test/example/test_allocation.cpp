@@ -0,0 +1,31 @@
+#include <sktest/test.hpp>
+#include <stdlib.h>
+#include <string.h>
+
+test_group ("test allocation-free code (assert_no_alloc)") {
+  char buffer[16] = "hello";
+
+  assert_no_alloc {
+    assert_equal(strlen(buffer), 5);
+  }
+
+  assert_no_alloc {
+    free(malloc(8));
+  }
+}
+
+test_group ("test bounded allocation (assert_max_alloc)") {
+  assert_max_alloc(64) {
+    delete new int(1);
+  }
+
+  assert_max_alloc(64) {
+    free(malloc(4096));
+  }
+}
+
+test_group ("test leak report at the end of a test group") {
+  static char *leaked = nullptr;
+  leaked = static_cast<char *>(malloc(32));
+  assert_true(leaked != nullptr);
+}
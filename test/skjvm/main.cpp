@@ -0,0 +1,5 @@
+// Tests of the virtual machine. Class files are assembled with
+// `skjvm::ClassWriter`, since there is no Java compiler in the tree.
+
+#define USE_SKTEST_DEFAULT_MAIN_FUNCTION
+#include <sktest/test.hpp>
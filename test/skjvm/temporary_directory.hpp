@@ -0,0 +1,62 @@
+#ifndef skjvm_test_temporary_directory_hpp
+#define skjvm_test_temporary_directory_hpp
+
+#include <skjvm/class_writer.hpp>
+
+#include <cstdlib>
+#include <string>
+
+#include <ftw.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// \brief A directory under /tmp, removed with its contents on destruction,
+/// for tests that need class files on disk.
+class TemporaryDirectory {
+  std::string path;
+
+  static auto remove_entry(char const *entry, struct stat const *, int,
+                           struct FTW *) -> int {
+    return remove(entry);
+  }
+
+ public:
+  TemporaryDirectory() {
+    char pattern[] = "/tmp/skjvm-test-XXXXXX";
+    if (mkdtemp(pattern) != nullptr) {
+      path = pattern;
+    }
+  }
+
+  TemporaryDirectory(TemporaryDirectory const&) = delete;
+  auto operator=(TemporaryDirectory const&) -> TemporaryDirectory & = delete;
+
+  ~TemporaryDirectory() {
+    if (not path.empty()) {
+      nftw(path.c_str(), &remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+  }
+
+  [[nodiscard]]
+  auto get_path() const -> std::string const & {
+    return path;
+  }
+
+  /// Create the directories leading to \p relative_file.
+  auto make_parents(std::string const &relative_file) const -> void {
+    for (size_t slash = relative_file.find('/'); slash != std::string::npos;
+         slash = relative_file.find('/', slash + 1)) {
+      mkdir((path + "/" + relative_file.substr(0, slash)).c_str(), 0755);
+    }
+  }
+
+  /// Write \p writer as the class file of the binary class name \p name.
+  auto write_class(skjvm::ClassWriter const &writer,
+                   std::string const &name) const -> bool {
+    std::string relative = name + ".class";
+    make_parents(relative);
+    return writer.write_to((path + "/" + relative).c_str());
+  }
+};
+
+#endif /* skjvm_test_temporary_directory_hpp */
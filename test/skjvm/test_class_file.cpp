@@ -0,0 +1,317 @@
+#include <sktest/test.hpp>
+
+#include <skjvm/class_file.hpp>
+#include <skjvm/class_writer.hpp>
+#include <skjvm/mapped_file.hpp>
+#include <skjvm/opcodes.hpp>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace skjvm;
+
+namespace {
+  /// Modified UTF-8 for "a", U+0000 and U+1F600 (as a surrogate pair).
+  constexpr uint8_t mutf8_sample[] {
+    'a', 0xc0, 0x80, 0xed, 0xa0, 0xbd, 0xed, 0xb8, 0x80,
+  };
+
+  /// A small class using most kinds of constants, with fields, methods,
+  /// branches and an interface.
+  auto build_point(size_t &size) -> uint8_t * {
+    ClassWriter writer("demo/Point");
+    writer.add_interface("java/lang/Runnable");
+    writer.add_field(access::private_, "x", "I");
+    writer.add_field(access::private_, "y", "I");
+    writer.add_field(access::public_ | access::static_, "name",
+                     "Ljava/lang/String;");
+    writer.utf8(mutf8_sample, sizeof(mutf8_sample));
+
+    CodeWriter sum(writer);
+    sum.set_max(2, 1)
+      .op(Opcode::aload_0).field(Opcode::getfield, "demo/Point", "x", "I")
+      .op(Opcode::aload_0).field(Opcode::getfield, "demo/Point", "y", "I")
+      .op(Opcode::iadd)
+      .op(Opcode::ireturn);
+    writer.add_method(access::public_, "sum", "()I", &sum);
+
+    CodeWriter clamp(writer);
+    Label positive = clamp.new_label();
+    clamp.set_max(1, 1)
+      .op(Opcode::iload_0)
+      .jump(Opcode::ifge, positive)
+      .iconst(0)
+      .op(Opcode::ireturn)
+      .bind(positive)
+      .op(Opcode::iload_0)
+      .op(Opcode::ireturn);
+    writer.add_method(access::public_ | access::static_, "clamp", "(I)I",
+                      &clamp);
+
+    CodeWriter constants(writer);
+    constants.set_max(4, 0)
+      .iconst(100000).op(Opcode::pop)
+      .lconst(1234567890123LL).op(Opcode::pop2)
+      .dconst(2.5).op(Opcode::pop2)
+      .ldc_string("hello").op(Opcode::pop)
+      .op(Opcode::return_);
+    writer.add_method(access::static_, "constants", "()V", &constants);
+
+    writer.add_method(access::public_ | access::native, "run", "()V",
+                      nullptr);
+    return writer.finish(size);
+  }
+
+  auto find_utf8(ClassFile const &class_file, char const *text) -> uint16_t {
+    for (uint16_t i = 1; i < class_file.get_constant_count(); ++i) {
+      if (class_file.utf8(i).equals(text)) { return i; }
+    }
+    return 0;
+  }
+} // namespace
+
+test_group ("class file: class, fields and methods are read in place") {
+  size_t size = 0;
+  uint8_t *bytes = build_point(size);
+  ClassFile class_file;
+  assert_true(class_file.parse(bytes, size) == ClassFileError::none);
+
+  assert_true(class_file.this_class_name().equals("demo/Point"));
+  assert_true(class_file.super_class_name().equals("java/lang/Object"));
+  assert_equal(class_file.get_interface_count(), 1);
+  assert_true(class_file.interface_name(0).equals("java/lang/Runnable"));
+  assert_equal(class_file.get_major_version(), 52);
+
+  assert_equal(class_file.fields().size(), 3);
+  assert_true(class_file.name(class_file.fields()[2]).equals("name"));
+  assert_true(class_file.descriptor(class_file.fields()[2])
+                .equals("Ljava/lang/String;"));
+
+  // Views point into the buffer, nothing is copied.
+  Utf8View name = class_file.this_class_name();
+  assert_true(name.bytes > bytes and name.bytes < bytes + size);
+
+  assert_equal(class_file.methods().size(), 4);
+  MemberInfo const *sum = class_file.find_method("sum", "()I");
+  assert_true(sum != nullptr);
+  CodeView code = class_file.code(*sum);
+  assert_true(code.is_present());
+  assert_equal(code.max_stack, 2);
+  assert_equal(code.max_locals, 1);
+  assert_equal(code.code_length, 10u);
+  assert_equal(code.code[0], uint8_t(Opcode::aload_0));
+  assert_equal(code.exception_table_length, 0);
+
+  MemberRef field = class_file.member_ref(read_u2(code.code + 2));
+  assert_true(field.class_name.equals("demo/Point"));
+  assert_true(field.name.equals("x"));
+  assert_true(field.descriptor.equals("I"));
+
+  MemberInfo const *run = class_file.find_method("run", "()V");
+  assert_true(run != nullptr);
+  assert_true(not class_file.code(*run).is_present());
+  assert_true(class_file.find_method("run", "(I)V") == nullptr);
+  free(bytes);
+}
+
+test_group ("class file: constants of every kind decode") {
+  size_t size = 0;
+  uint8_t *bytes = build_point(size);
+  ClassFile class_file;
+  assert_true(class_file.parse(bytes, size) == ClassFileError::none);
+
+  MemberInfo const *constants = class_file.find_method("constants", "()V");
+  CodeView code = class_file.code(*constants);
+  assert_equal(code.code[0], uint8_t(Opcode::ldc));
+  assert_equal(class_file.integer_value(code.code[1]), 100000);
+  assert_equal(code.code[3], uint8_t(Opcode::ldc2_w));
+  uint16_t long_index = read_u2(code.code + 4);
+  assert_equal(class_file.long_value(long_index), 1234567890123LL);
+  // The slot after a long is unusable.
+  assert_true(class_file.tag(uint16_t(long_index + 1)) == ConstantTag::none);
+  assert_equal(class_file.double_value(read_u2(code.code + 8)), 2.5);
+  assert_true(class_file.string(code.code[12]).equals("hello"));
+
+  // Wrong kinds and indexes yield empty values instead of garbage.
+  assert_equal(class_file.integer_value(long_index), 0);
+  assert_true(class_file.utf8(0).is_empty());
+  assert_true(class_file.utf8(60000).is_empty());
+  free(bytes);
+}
+
+test_group ("class file: modified UTF-8 is decoded lazily and cached") {
+  size_t size = 0;
+  uint8_t *bytes = build_point(size);
+  ClassFile class_file;
+  assert_true(class_file.parse(bytes, size) == ClassFileError::none);
+
+  uint16_t index = 0;
+  for (uint16_t i = 1; i < class_file.get_constant_count(); ++i) {
+    Utf8View view = class_file.utf8(i);
+    if (view.length == sizeof(mutf8_sample) and
+        memcmp(view.bytes, mutf8_sample, sizeof(mutf8_sample)) == 0) {
+      index = i;
+    }
+  }
+  assert_not_equal(index, 0);
+
+  Utf16View text = class_file.utf16(index);
+  assert_equal(text.length, 4u);
+  assert_equal(text.chars[0], 'a');
+  assert_equal(text.chars[1], 0);
+  assert_equal(text.chars[2], 0xd83d);
+  assert_equal(text.chars[3], 0xde00);
+  assert_true(class_file.utf16(index).chars == text.chars,
+              "the second call returns the cached copy");
+
+  Utf16View ascii = class_file.utf16(find_utf8(class_file, "demo/Point"));
+  assert_equal(ascii.length, 10u);
+  assert_equal(ascii.chars[4], '/');
+  free(bytes);
+
+  Utf8View empty {};
+  assert_true(empty.equals(""), "an empty view has no bytes to compare");
+  assert_true(not empty.equals("a"));
+  assert_true(empty.equals(Utf8View {}));
+}
+
+test_group ("class file: malformed modified UTF-8 is rejected on access") {
+  uint8_t const nul[] {'a', 0x00};
+  uint8_t const four_bytes[] {0xf0, 0x9f, 0x98, 0x80};
+  uint8_t const cut[] {'a', 0xe2, 0x82};
+
+  ClassWriter writer("demo/Strings");
+  uint16_t nul_index = writer.utf8(nul, sizeof(nul));
+  uint16_t four_index = writer.utf8(four_bytes, sizeof(four_bytes));
+  uint16_t cut_index = writer.utf8(cut, sizeof(cut));
+  uint16_t empty_index = writer.utf8("");
+  size_t size = 0;
+  uint8_t *bytes = writer.finish(size);
+
+  // Parsing does not look at the contents of strings.
+  ClassFile class_file;
+  assert_true(class_file.parse(bytes, size) == ClassFileError::none);
+  assert_true(class_file.utf16(nul_index).chars == nullptr);
+  assert_true(class_file.utf16(four_index).chars == nullptr);
+  assert_true(class_file.utf16(cut_index).chars == nullptr);
+  assert_true(class_file.utf16(empty_index).chars != nullptr);
+  assert_equal(class_file.utf16(empty_index).length, 0u);
+  free(bytes);
+}
+
+test_group ("class file: every truncation is rejected") {
+  size_t size = 0;
+  uint8_t *bytes = build_point(size);
+  size_t accepted = 0;
+  for (size_t length = 0; length < size; ++length) {
+    // A private copy, so reads past `length` are caught by sanitizers.
+    auto *prefix = static_cast<uint8_t *>(malloc(length == 0 ? 1 : length));
+    memcpy(prefix, bytes, length);
+    ClassFile class_file;
+    if (class_file.parse(prefix, length) == ClassFileError::none) {
+      ++accepted;
+    }
+    free(prefix);
+  }
+  assert_equal(accepted, size_t(0));
+  free(bytes);
+}
+
+test_group ("class file: bad headers and references are reported") {
+  size_t size = 0;
+  uint8_t *bytes = build_point(size);
+  ClassFile class_file;
+
+  bytes[0] = 0xca;
+  bytes[3] = 0xbf;
+  assert_true(class_file.parse(bytes, size) == ClassFileError::bad_magic);
+  bytes[3] = 0xbe;
+
+  bytes[7] = 70;
+  assert_true(class_file.parse(bytes, size) ==
+              ClassFileError::unsupported_version);
+  bytes[7] = 52;
+
+  // The first constant is the UTF-8 name of the class; make it a tag that
+  // does not exist.
+  bytes[10] = 2;
+  assert_true(class_file.parse(bytes, size) ==
+              ClassFileError::bad_constant_tag);
+  bytes[10] = 1;
+
+  auto *longer = static_cast<uint8_t *>(malloc(size + 1));
+  memcpy(longer, bytes, size);
+  longer[size] = 0;
+  assert_true(class_file.parse(longer, size + 1) ==
+              ClassFileError::trailing_bytes);
+  free(longer);
+
+  assert_true(class_file.parse(bytes, size) == ClassFileError::none);
+  free(bytes);
+}
+
+test_group ("class file: parsed from a mapped file") {
+  char path[] = "/tmp/skjvm-class-XXXXXX";
+  int fd = mkstemp(path);
+  assert_true(fd >= 0);
+  close(fd);
+
+  ClassWriter writer("demo/Mapped");
+  CodeWriter code(writer);
+  code.set_max(1, 0).iconst(7).op(Opcode::ireturn);
+  writer.add_method(access::static_, "seven", "()I", &code);
+  assert_true(writer.write_to(path));
+
+  MappedFile file;
+  assert_true(file.open(path));
+  ClassFile class_file;
+  assert_true(class_file.parse(file.get_data(), file.get_size()) ==
+              ClassFileError::none);
+  assert_true(class_file.this_class_name().equals("demo/Mapped"));
+  assert_true(class_file.find_method("seven", "()I") != nullptr);
+
+  unlink(path);
+  assert_true(not file.open(path));
+  assert_true(file.get_data() == nullptr);
+}
+
+test_group ("opcodes: instruction lengths, including switches and wide") {
+  ClassWriter writer("demo/Switch");
+  CodeWriter code(writer);
+  Label cases[3] {code.new_label(), code.new_label(), code.new_label()};
+  Label fallback = code.new_label();
+  code.set_max(1, 300)
+    .op(Opcode::iload_0)
+    .tableswitch(0, 2, fallback, cases);
+  for (Label label : cases) {
+    code.bind(label).iconst(1).op(Opcode::ireturn);
+  }
+  code.bind(fallback).local(Opcode::iload, 299).op(Opcode::ireturn);
+  writer.add_method(access::static_, "pick", "(I)I", &code);
+
+  size_t size = 0;
+  uint8_t *bytes = writer.finish(size);
+  ClassFile class_file;
+  assert_true(class_file.parse(bytes, size) == ClassFileError::none);
+  CodeView view = class_file.code(class_file.methods()[0]);
+
+  // iload_0 at 0, tableswitch at 1 padded to 4: 3 + 12 + 3 * 4 bytes.
+  assert_equal(instruction_length(view.code, view.code_length, 0), 1u);
+  assert_equal(instruction_length(view.code, view.code_length, 1), 27u);
+  uint32_t bci = 28;
+  for (int i = 0; i < 3; ++i) {
+    bci += instruction_length(view.code, view.code_length, bci);
+    bci += instruction_length(view.code, view.code_length, bci);
+  }
+  assert_equal(view.code[bci], uint8_t(Opcode::wide));
+  assert_equal(instruction_length(view.code, view.code_length, bci), 4u);
+  assert_equal(instruction_length(view.code, bci + 3, bci), 0u,
+               "an instruction cut by the end of the code");
+
+  // Each case jumps to its own `iconst_1`.
+  int32_t first = int32_t(read_u4(view.code + 4 + 12));
+  assert_equal(first, 27);
+  assert_true(opcode_name(0xca) == nullptr);
+  free(bytes);
+}
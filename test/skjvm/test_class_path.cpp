@@ -0,0 +1,195 @@
+#include <sktest/test.hpp>
+
+#include "temporary_directory.hpp"
+#include "test_vm.hpp"
+
+#include <string>
+
+#include <unistd.h>
+
+using namespace skjvm;
+
+namespace {
+  /// Write a class named \p name whose constant pool refers to
+  /// \p references, as a class loader following them would see.
+  template <typename... References>
+  auto write_class(TemporaryDirectory const &directory, char const *name,
+                   References... references) -> bool {
+    ClassWriter writer(name);
+    (writer.class_constant(references), ...);
+    return directory.write_class(writer, name);
+  }
+} // namespace
+
+test_group ("class path: the index maps binary names to roots") {
+  TemporaryDirectory first;
+  TemporaryDirectory second;
+  assert_true(write_class(first, "app/Main"));
+  assert_true(write_class(first, "app/deep/er/Util"));
+  assert_true(write_class(second, "lib/Helper"));
+  assert_true(write_class(second, "app/Main"));
+
+  std::string roots = first.get_path() + ":" + second.get_path() +
+                      ":/nonexistent/skjvm";
+  ClassPath class_path;
+  class_path.open(roots.c_str(), nullptr);
+  assert_equal(class_path.get_root_count(), 3u);
+  assert_equal(class_path.get_class_count(), 3u,
+               "the second app/Main is hidden by the first root");
+  assert_true(not class_path.is_from_cache());
+
+  ClassPath::Entry const *main = class_path.find(view("app/Main"));
+  assert_true(main != nullptr);
+  assert_equal(main->root, 0);
+  ClassPath::Entry const *helper = class_path.find(view("lib/Helper"));
+  assert_true(helper != nullptr);
+  assert_equal(helper->root, 1);
+  assert_true(class_path.find(view("app/deep/er/Util")) != nullptr);
+  assert_true(class_path.find(view("app/Missing")) == nullptr);
+  assert_true(class_path.find(view("app")) == nullptr);
+
+  char path[4096];
+  assert_true(class_path.path_of(*helper, path, sizeof(path)));
+  assert_true(std::string(path) ==
+              second.get_path() + "/lib/Helper.class");
+  assert_true(not class_path.path_of(*helper, path, 8),
+              "a buffer too small is reported");
+}
+
+test_group ("class path: the cache is reused until a directory changes") {
+  TemporaryDirectory classes;
+  TemporaryDirectory cache_directory;
+  assert_true(write_class(classes, "app/Main"));
+  assert_true(write_class(classes, "app/util/Strings"));
+  std::string cache = cache_directory.get_path() + "/nested/index.idx";
+
+  {
+    ClassPath class_path;
+    class_path.open(classes.get_path().c_str(), cache.c_str());
+    assert_true(not class_path.is_from_cache());
+    assert_true(::access(cache.c_str(), R_OK) == 0, "the cache was written");
+  }
+  {
+    ClassPath class_path;
+    class_path.open(classes.get_path().c_str(), cache.c_str());
+    assert_true(class_path.is_from_cache());
+    assert_equal(class_path.get_class_count(), 2u);
+    assert_true(class_path.find(view("app/util/Strings")) != nullptr);
+  }
+
+  // A different class path must not reuse the index.
+  {
+    std::string other = classes.get_path() + ":/nonexistent/skjvm";
+    ClassPath class_path;
+    class_path.open(other.c_str(), cache.c_str());
+    assert_true(not class_path.is_from_cache());
+  }
+  {
+    ClassPath class_path;
+    class_path.open(classes.get_path().c_str(), cache.c_str());
+    assert_true(not class_path.is_from_cache(),
+                "the cache now belongs to the other class path");
+  }
+
+  // Adding a class deep in the tree changes the mtime of its directory.
+  // Sleep past coarse timestamp granularity first.
+  usleep(20000);
+  assert_true(write_class(classes, "app/util/Numbers"));
+  {
+    ClassPath class_path;
+    class_path.open(classes.get_path().c_str(), cache.c_str());
+    assert_true(not class_path.is_from_cache());
+    assert_true(class_path.find(view("app/util/Numbers")) != nullptr);
+  }
+  {
+    ClassPath class_path;
+    class_path.open(classes.get_path().c_str(), cache.c_str());
+    assert_true(class_path.is_from_cache());
+    assert_equal(class_path.get_class_count(), 3u);
+  }
+}
+
+test_group ("class path: a corrupt cache is rebuilt") {
+  TemporaryDirectory classes;
+  TemporaryDirectory cache_directory;
+  assert_true(write_class(classes, "app/Main"));
+  std::string cache = cache_directory.get_path() + "/index.idx";
+
+  FILE *file = fopen(cache.c_str(), "wb");
+  fputs("SKCPIX01 but truncated", file);
+  fclose(file);
+
+  ClassPath class_path;
+  class_path.open(classes.get_path().c_str(), cache.c_str());
+  assert_true(not class_path.is_from_cache());
+  assert_true(class_path.find(view("app/Main")) != nullptr);
+}
+
+test_group ("class loader: classes are loaded on demand") {
+  TemporaryDirectory classes;
+  assert_true(write_class(classes, "app/Main", "app/Util"));
+  assert_true(write_class(classes, "app/Util"));
+  // A class file whose name does not match its path.
+  {
+    ClassWriter writer("app/Other");
+    assert_true(classes.write_class(writer, "app/Wrong"));
+  }
+
+  ClassPath class_path;
+  class_path.open(classes.get_path().c_str(), nullptr);
+  ClassLoader loader(class_path);
+
+  LoadedClass &main = loader.load(view("app/Main"));
+  assert_true(main.state == LoadState::loaded);
+  assert_true(main.class_file.this_class_name().equals("app/Main"));
+  assert_equal(loader.get_loaded_count(), 1u,
+               "without workers, references are not followed");
+  assert_true(&loader.load(view("app/Main")) == &main,
+              "a class is loaded once");
+
+  LoadedClass &missing = loader.load(view("app/Missing"));
+  assert_true(missing.state == LoadState::failed);
+  assert_true(missing.not_found);
+
+  LoadedClass &wrong = loader.load(view("app/Wrong"));
+  assert_true(wrong.state == LoadState::failed);
+  assert_true(wrong.not_found);
+
+  assert_true(loader.find_loaded(view("app/Util")) == nullptr);
+  assert_true(loader.find_loaded(view("app/Main")) == &main);
+}
+
+test_group ("class loader: workers preload the transitive closure") {
+  TemporaryDirectory classes;
+  assert_true(write_class(classes, "app/Main", "app/A", "app/B"));
+  assert_true(write_class(classes, "app/A", "app/C", "[[Lapp/D;", "[I"));
+  assert_true(write_class(classes, "app/B", "app/C"));
+  assert_true(write_class(classes, "app/C", "app/Main"));
+  assert_true(write_class(classes, "app/D"));
+  assert_true(write_class(classes, "app/Unreferenced"));
+  for (int i = 0; i < 200; ++i) {
+    std::string name = "app/many/M" + std::to_string(i);
+    std::string next = "app/many/M" + std::to_string(i + 1);
+    assert_true(write_class(classes, name.c_str(),
+                            i + 1 < 200 ? next.c_str() : "app/A"));
+  }
+  assert_true(write_class(classes, "app/Root", "app/Main", "app/many/M0"));
+
+  ClassPath class_path;
+  class_path.open(classes.get_path().c_str(), nullptr);
+  ClassLoader loader(class_path);
+  loader.start_workers(4);
+  loader.preload(view("app/Root"));
+
+  // The main thread competes with the workers for the same classes.
+  assert_true(loader.load(view("app/Root")).state == LoadState::loaded);
+  assert_true(loader.load(view("app/many/M100")).state == LoadState::loaded);
+  loader.wait_idle();
+
+  // Everything but app/Unreferenced and the missing java/lang/Object.
+  assert_equal(loader.get_loaded_count(), 206u);
+  assert_true(loader.find_loaded(view("app/D")) != nullptr);
+  assert_true(loader.find_loaded(view("app/Unreferenced")) == nullptr);
+  LoadedClass &object = loader.load(view("java/lang/Object"));
+  assert_true(object.state == LoadState::failed);
+}
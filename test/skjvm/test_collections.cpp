@@ -0,0 +1,324 @@
+#include <sktest/test.hpp>
+
+#include <skjvm/hash_map.hpp>
+#include <skjvm/intrusive_list.hpp>
+#include <skjvm/memory.hpp>
+#include <skjvm/small_vector.hpp>
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+using namespace skjvm;
+
+namespace {
+  /// Counts the live instances, to check that containers destroy what
+  /// they construct, and the copies, to check that they move instead. Per
+  /// thread, as test groups may run in parallel.
+  struct Tracked {
+    static inline thread_local int64_t live = 0;
+    static inline thread_local int64_t copies = 0;
+
+    uint32_t value;
+    bool moved_from {false};
+
+    explicit Tracked(uint32_t value) : value(value) { ++live; }
+    Tracked(Tracked const &other) : value(other.value) {
+      ++live;
+      ++copies;
+    }
+    Tracked(Tracked &&other) noexcept : value(other.value) {
+      other.moved_from = true;
+      ++live;
+    }
+    auto operator=(Tracked const &other) -> Tracked & {
+      value = other.value;
+      ++copies;
+      return *this;
+    }
+    auto operator=(Tracked &&other) noexcept -> Tracked & {
+      value = other.value;
+      other.moved_from = true;
+      return *this;
+    }
+    ~Tracked() { --live; }
+
+    auto operator==(Tracked const &other) const -> bool {
+      return value == other.value;
+    }
+  };
+
+  struct TrackedHash {
+    auto operator()(Tracked const &key) const -> uint64_t {
+      return Hash<uint32_t>::mix(key.value);
+    }
+  };
+
+  /// Puts every key in the same home slot, for long probes.
+  struct CollidingHash {
+    auto operator()(uint32_t) const -> uint64_t {
+      return 7;
+    }
+  };
+
+  struct Waiter : ListNode {
+    uint32_t id;
+
+    explicit Waiter(uint32_t id) : id(id) {}
+  };
+
+  /// Two sets of links, for items in two lists at once.
+  struct TaskNode : ListNode {};
+  struct ReadyNode : ListNode {};
+
+  struct Task : TaskNode, ReadyNode {
+    uint32_t id;
+
+    explicit Task(uint32_t id) : id(id) {}
+  };
+
+  auto ids(IntrusiveList<Waiter> const &list) -> std::string {
+    std::string joined;
+    for (Waiter const &waiter : list) {
+      joined += std::to_string(waiter.id);
+    }
+    return joined;
+  }
+} // namespace
+
+test_group ("small vector: items stay inline up to its inline capacity") {
+  Tracked::copies = 0;
+  {
+    SmallVector<Tracked, 4> items;
+    assert_true(items.is_empty() and items.is_inline());
+    for (uint32_t i = 0; i < 4; ++i) { items.emplace(i); }
+    assert_true(items.is_inline());
+    assert_equal(items.get_allocations(), size_t(0));
+
+    // Pushing one of its own items while growing must copy it first.
+    items.push(items[0]);
+    assert_true(not items.is_inline());
+    assert_equal(items.get_allocations(), size_t(1));
+    assert_equal(items.get_size(), size_t(5));
+    assert_equal(items[4].value, uint32_t(0));
+    assert_equal(Tracked::copies, int64_t(1));
+
+    for (uint32_t i = 5; i < 100; ++i) { items.push(Tracked(i)); }
+    assert_equal(Tracked::copies, int64_t(1));
+    assert_true(items.get_allocations() <= 5);
+    uint32_t sum = 0;
+    for (Tracked const &item : items) { sum += item.value; }
+    assert_equal(sum, uint32_t(99 * 100 / 2 - 4));
+
+    assert_equal(items.pop().value, uint32_t(99));
+    items.truncate(10);
+    assert_equal(items.get_size(), size_t(10));
+    assert_equal(Tracked::live, int64_t(10));
+    items.clear();
+    assert_equal(Tracked::live, int64_t(0));
+  }
+  assert_equal(Tracked::live, int64_t(0));
+}
+
+test_group ("small vector: moves steal the heap buffer or the items") {
+  Tracked::copies = 0;
+  {
+    SmallVector<Tracked, 2> small;
+    small.emplace(1u);
+    SmallVector<Tracked, 2> moved = skjvm::move(small);
+    assert_true(moved.is_inline() and small.is_empty());
+    assert_equal(moved[0].value, uint32_t(1));
+
+    SmallVector<Tracked, 2> large;
+    for (uint32_t i = 0; i < 10; ++i) { large.emplace(i); }
+    Tracked *data = large.get_data();
+    moved = skjvm::move(large);
+    assert_true(moved.get_data() == data);
+    assert_equal(moved.get_size(), size_t(10));
+    assert_equal(moved.get_allocations(), size_t(3));
+    assert_true(large.is_empty() and large.is_inline());
+    assert_equal(Tracked::live, int64_t(10));
+
+    large.emplace(42u);
+    moved.reserve(100);
+    assert_equal(moved.get_capacity(), size_t(100));
+    assert_equal(moved[9].value, uint32_t(9));
+  }
+  assert_equal(Tracked::live, int64_t(0));
+  assert_equal(Tracked::copies, int64_t(0));
+}
+
+test_group ("hash map: agrees with std::unordered_map") {
+  HashMap<uint64_t, uint64_t> map;
+  std::unordered_map<uint64_t, uint64_t> reference;
+  assert_true(map.find(uint64_t(1)) == nullptr);
+
+  uint64_t state = 88172645463325252ull;
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; i < 50000; ++i) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    uint64_t key = state % 4096;
+    switch (state >> 62) {
+      case 0: {
+        bool erased = map.erase(key);
+        if (erased != (reference.erase(key) == 1)) { ++mismatches; }
+        break;
+      }
+      case 1:
+        map.assign(key, i);
+        reference[key] = i;
+        break;
+      default: {
+        HashMap<uint64_t, uint64_t>::InsertResult result = map.insert(key, i);
+        bool inserted = reference.emplace(key, i).second;
+        if (result.inserted != inserted or *result.value != reference[key]) {
+          ++mismatches;
+        }
+      }
+    }
+    uint64_t probe = (state >> 20) % 4096;
+    uint64_t const *found = map.find(probe);
+    auto expected = reference.find(probe);
+    if ((found == nullptr) != (expected == reference.end()) or
+        (found != nullptr and *found != expected->second)) {
+      ++mismatches;
+    }
+  }
+  assert_equal(mismatches, uint32_t(0));
+  assert_equal(map.get_size(), reference.size());
+
+  size_t visited = 0;
+  for (auto const &entry : map) {
+    if (reference.at(entry.key) == entry.value) { ++visited; }
+  }
+  assert_equal(visited, reference.size());
+
+  size_t allocations = map.get_allocations();
+  map.clear();
+  assert_true(map.is_empty());
+  assert_true(not map.contains(uint64_t(0)));
+  for (uint64_t key = 0; key < 1000; ++key) { map.insert(key, key); }
+  assert_equal(map.get_allocations(), allocations);
+}
+
+test_group ("hash map: collisions, erasure and moves") {
+  HashMap<uint32_t, uint32_t, CollidingHash> colliding;
+  for (uint32_t key = 0; key < 200; ++key) {
+    colliding.insert(key, key * 3);
+  }
+  for (uint32_t key = 0; key < 200; key += 2) {
+    assert_true(colliding.erase(key));
+  }
+  assert_true(not colliding.erase(uint32_t(0)));
+  uint32_t found = 0;
+  for (uint32_t key = 0; key < 200; ++key) {
+    uint32_t const *value = colliding.find(key);
+    if ((value != nullptr) == (key % 2 == 1) and
+        (value == nullptr or *value == key * 3)) {
+      ++found;
+    }
+  }
+  assert_equal(found, uint32_t(200));
+
+  Tracked::copies = 0;
+  {
+    HashMap<Tracked, Tracked, TrackedHash> map;
+    map.reserve(1000);
+    assert_equal(map.get_allocations(), size_t(1));
+    for (uint32_t i = 0; i < 1000; ++i) { map.emplace(Tracked(i), i * 2); }
+    assert_equal(map.get_allocations(), size_t(1));
+    assert_true(not map.emplace(Tracked(5), 0u).inserted);
+    assert_equal(map.find(Tracked(5))->value, uint32_t(10));
+    assert_equal(Tracked::live, int64_t(2000));
+
+    HashMap<Tracked, Tracked, TrackedHash> moved = skjvm::move(map);
+    assert_true(map.is_empty() and map.find(Tracked(5)) == nullptr);
+    assert_equal(moved.get_size(), size_t(1000));
+    for (uint32_t i = 0; i < 1000; i += 3) { moved.erase(Tracked(i)); }
+    assert_equal(Tracked::live, int64_t(2 * 666));
+    map.insert(Tracked(1), Tracked(1));
+    moved = skjvm::move(map);
+    assert_equal(moved.get_size(), size_t(1));
+  }
+  assert_equal(Tracked::live, int64_t(0));
+  assert_equal(Tracked::copies, int64_t(0));
+}
+
+test_group ("intrusive list: links items in place") {
+  Waiter waiters[] = {Waiter(1), Waiter(2), Waiter(3), Waiter(4)};
+  IntrusiveList<Waiter> list;
+  assert_true(list.is_empty() and list.pop_front() == nullptr);
+  list.push_back(waiters[1]);
+  list.push_back(waiters[2]);
+  list.push_front(waiters[0]);
+  list.insert_before(waiters[2], waiters[3]);
+  assert_equal(ids(list), std::string("1243"));
+  assert_equal(list.get_size(), size_t(4));
+  assert_true(waiters[3].is_linked());
+
+  list.remove(waiters[3]);
+  assert_true(not waiters[3].is_linked());
+  assert_equal(ids(list), std::string("123"));
+  assert_equal(list.pop_back()->id, uint32_t(3));
+  assert_equal(list.front()->id, uint32_t(1));
+
+  IntrusiveList<Waiter> moved = skjvm::move(list);
+  assert_true(list.is_empty());
+  assert_equal(ids(moved), std::string("12"));
+  moved.push_back(waiters[2]);
+  assert_equal(moved.back()->id, uint32_t(3));
+  moved.clear();
+  assert_true(moved.is_empty() and not waiters[0].is_linked());
+
+  // In two lists at once, through different nodes.
+  Task tasks[] = {Task(1), Task(2), Task(3)};
+  IntrusiveList<Task, TaskNode> all;
+  IntrusiveList<Task, ReadyNode> ready;
+  for (Task &task : tasks) { all.push_back(task); }
+  ready.push_back(tasks[2]);
+  ready.push_back(tasks[0]);
+  all.remove(tasks[0]);
+  assert_equal(all.front()->id, uint32_t(2));
+  assert_equal(ready.pop_front()->id, uint32_t(3));
+  assert_equal(ready.pop_front()->id, uint32_t(1));
+  assert_equal(all.get_size(), size_t(2));
+}
+
+test_group ("arena: scopes free what they allocated") {
+  Arena arena;
+  auto *kept = arena.allocate_array<uint64_t>(16);
+  kept[0] = 42;
+  assert_equal(arena.get_allocations(), size_t(1));
+
+  for (int round = 0; round < 10; ++round) {
+    ArenaScope scope(arena);
+    // Past the first chunk, and a block larger than a chunk.
+    for (int i = 0; i < 100; ++i) {
+      auto *block = arena.allocate_array<uint8_t>(1024);
+      block[1023] = 1;
+    }
+    auto *large = arena.allocate_array<uint8_t>(Arena::chunk_size * 2);
+    large[0] = 1;
+  }
+  // The second chunk is kept for reuse; the large ones are not.
+  assert_equal(arena.get_allocations(), size_t(2 + 10));
+  assert_equal(kept[0], uint64_t(42));
+
+  Arena::Mark mark = arena.get_mark();
+  auto *first = arena.allocate_array<uint64_t>(1);
+  *first = 7;
+  arena.reset(mark);
+  auto *second = arena.allocate_array<uint64_t>(1);
+  assert_true(second == first);
+  assert_equal(*second, uint64_t(0));
+
+  Arena moved = skjvm::move(arena);
+  assert_equal(moved.get_allocations(), size_t(12));
+  assert_equal(arena.get_allocations(), size_t(0));
+  assert_equal(kept[0], uint64_t(42));
+  moved.reset();
+  (void)moved.allocate(8);
+  assert_equal(moved.get_allocations(), size_t(12));
+}
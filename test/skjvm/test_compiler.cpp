@@ -0,0 +1,867 @@
+#include <sktest/test.hpp>
+
+#include "temporary_directory.hpp"
+#include "test_vm.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace skjvm;
+
+namespace {
+  /// How `array_kernel` handles one element type.
+  struct ArrayKind {
+    char const *name;
+    uint8_t newarray;
+    Opcode load;
+    Opcode store;
+    /// From the `int` computed for each element, `nop` for none.
+    Opcode widen;
+    Opcode add;
+    Opcode narrow;
+    Opcode load_sum;
+    Opcode store_sum;
+  };
+
+  /// `int <name>Array(int n)`: fills an array of the kind with truncated
+  /// `i * i * 37 + 200`, then returns the sum of its elements.
+  auto array_kernel(ClassWriter &writer, ArrayKind const &kind) -> void {
+    CodeWriter code(writer);
+    Label fill = code.new_label();
+    Label filled = code.new_label();
+    Label add = code.new_label();
+    Label added = code.new_label();
+    code.set_max(6, 5)
+        .local(Opcode::iload, 0).newarray(kind.newarray)
+        .local(Opcode::astore, 1)
+        .iconst(0).local(Opcode::istore, 2)
+        .bind(fill)
+        .local(Opcode::iload, 2).local(Opcode::iload, 0)
+        .jump(Opcode::if_icmpge, filled)
+        .local(Opcode::aload, 1).local(Opcode::iload, 2)
+        .local(Opcode::iload, 2).local(Opcode::iload, 2).op(Opcode::imul)
+        .iconst(37).op(Opcode::imul).iconst(200).op(Opcode::iadd);
+    if (kind.widen != Opcode::nop) { code.op(kind.widen); }
+    code.op(kind.store)
+        .iinc(2, 1)
+        .jump(Opcode::goto_, fill)
+        .bind(filled);
+    switch (kind.load_sum) {
+      case Opcode::lload: code.lconst(0); break;
+      case Opcode::fload: code.fconst(0); break;
+      case Opcode::dload: code.dconst(0); break;
+      default: code.iconst(0); break;
+    }
+    code.local(kind.store_sum, 3)
+        .iconst(0).local(Opcode::istore, 2)
+        .bind(add)
+        .local(Opcode::iload, 2).local(Opcode::aload, 1)
+        .op(Opcode::arraylength)
+        .jump(Opcode::if_icmpge, added)
+        .local(kind.load_sum, 3).local(Opcode::aload, 1)
+        .local(Opcode::iload, 2).op(kind.load).op(kind.add)
+        .local(kind.store_sum, 3)
+        .iinc(2, 1)
+        .jump(Opcode::goto_, add)
+        .bind(added)
+        .local(kind.load_sum, 3);
+    if (kind.narrow != Opcode::nop) { code.op(kind.narrow); }
+    code.op(Opcode::ireturn);
+    static_method(writer, kind.name, "(I)I", code);
+  }
+
+  std::vector<ArrayKind> const array_kinds {
+    {"booleanArray", 4, Opcode::baload, Opcode::bastore, Opcode::nop,
+     Opcode::iadd, Opcode::nop, Opcode::iload, Opcode::istore},
+    {"byteArray", 8, Opcode::baload, Opcode::bastore, Opcode::nop,
+     Opcode::iadd, Opcode::nop, Opcode::iload, Opcode::istore},
+    {"charArray", 5, Opcode::caload, Opcode::castore, Opcode::nop,
+     Opcode::iadd, Opcode::nop, Opcode::iload, Opcode::istore},
+    {"shortArray", 9, Opcode::saload, Opcode::sastore, Opcode::nop,
+     Opcode::iadd, Opcode::nop, Opcode::iload, Opcode::istore},
+    {"intArray", 10, Opcode::iaload, Opcode::iastore, Opcode::nop,
+     Opcode::iadd, Opcode::nop, Opcode::iload, Opcode::istore},
+    {"longArray", 11, Opcode::laload, Opcode::lastore, Opcode::i2l,
+     Opcode::ladd, Opcode::l2i, Opcode::lload, Opcode::lstore},
+    {"floatArray", 6, Opcode::faload, Opcode::fastore, Opcode::i2f,
+     Opcode::fadd, Opcode::f2i, Opcode::fload, Opcode::fstore},
+    {"doubleArray", 7, Opcode::daload, Opcode::dastore, Opcode::i2d,
+     Opcode::dadd, Opcode::d2i, Opcode::dload, Opcode::dstore},
+  };
+
+  /// `app/Jit`, whose static methods cover what the compiler translates,
+  /// and the classes they use.
+  auto write_classes(TemporaryDirectory const &directory) -> bool {
+    ClassWriter jit("app/Jit");
+    jit.add_field(access::public_ | access::static_, "count", "I");
+
+    // int sum(int n): 0 + 1 + ... + n - 1.
+    CodeWriter sum(jit);
+    Label sum_loop = sum.new_label();
+    Label sum_end = sum.new_label();
+    sum.set_max(2, 3)
+       .iconst(0).local(Opcode::istore, 2)
+       .iconst(0).local(Opcode::istore, 1)
+       .bind(sum_loop)
+       .local(Opcode::iload, 1).local(Opcode::iload, 0)
+       .jump(Opcode::if_icmpge, sum_end)
+       .local(Opcode::iload, 2).local(Opcode::iload, 1).op(Opcode::iadd)
+       .local(Opcode::istore, 2)
+       .iinc(1, 1)
+       .jump(Opcode::goto_, sum_loop)
+       .bind(sum_end)
+       .local(Opcode::iload, 2).op(Opcode::ireturn);
+    static_method(jit, "sum", "(I)I", sum);
+
+    // int fib(int n), recursively.
+    CodeWriter fib(jit);
+    Label fib_recurse = fib.new_label();
+    fib.set_max(3, 1)
+       .local(Opcode::iload, 0).iconst(2)
+       .jump(Opcode::if_icmpge, fib_recurse)
+       .local(Opcode::iload, 0).op(Opcode::ireturn)
+       .bind(fib_recurse)
+       .local(Opcode::iload, 0).iconst(1).op(Opcode::isub)
+       .invoke(Opcode::invokestatic, "app/Jit", "fib", "(I)I")
+       .local(Opcode::iload, 0).iconst(2).op(Opcode::isub)
+       .invoke(Opcode::invokestatic, "app/Jit", "fib", "(I)I")
+       .op(Opcode::iadd).op(Opcode::ireturn);
+    static_method(jit, "fib", "(I)I", fib);
+
+    // int ints(int a, int b): every int operation, with / and % by b.
+    CodeWriter ints(jit);
+    ints.set_max(4, 2)
+        .local(Opcode::iload, 0).local(Opcode::iload, 1).op(Opcode::idiv)
+        .local(Opcode::iload, 0).local(Opcode::iload, 1).op(Opcode::irem)
+        .op(Opcode::ixor)
+        .local(Opcode::iload, 0).local(Opcode::iload, 1).op(Opcode::ishl)
+        .op(Opcode::iadd)
+        .local(Opcode::iload, 0).local(Opcode::iload, 1).op(Opcode::ishr)
+        .op(Opcode::isub)
+        .local(Opcode::iload, 0).local(Opcode::iload, 1).op(Opcode::iushr)
+        .op(Opcode::ior)
+        .local(Opcode::iload, 0).op(Opcode::ineg).op(Opcode::imul)
+        .local(Opcode::iload, 1).iconst(0x7f0f).op(Opcode::iand)
+        .op(Opcode::iadd)
+        .op(Opcode::ireturn);
+    static_method(jit, "ints", "(II)I", ints);
+
+    // long longs(int a, int b): the same on longs built from a and b.
+    CodeWriter longs(jit);
+    longs.set_max(8, 6)
+         .local(Opcode::iload, 0).op(Opcode::i2l).lconst(1000003)
+         .op(Opcode::lmul)
+         .local(Opcode::iload, 1).op(Opcode::i2l).op(Opcode::ladd)
+         .local(Opcode::lstore, 2)
+         .local(Opcode::iload, 1).op(Opcode::i2l).local(Opcode::lstore, 4)
+         .local(Opcode::lload, 2).local(Opcode::lload, 4).op(Opcode::ldiv)
+         .local(Opcode::lload, 2).local(Opcode::lload, 4).op(Opcode::lrem)
+         .op(Opcode::lxor)
+         .local(Opcode::lload, 2).local(Opcode::iload, 1).op(Opcode::lshl)
+         .op(Opcode::ladd)
+         .local(Opcode::lload, 2).local(Opcode::iload, 1).op(Opcode::lshr)
+         .op(Opcode::lsub)
+         .local(Opcode::lload, 2).local(Opcode::iload, 1).op(Opcode::lushr)
+         .op(Opcode::lor)
+         .local(Opcode::lload, 2).op(Opcode::lneg).op(Opcode::land)
+         .local(Opcode::lload, 2).local(Opcode::lload, 4).op(Opcode::lcmp)
+         .op(Opcode::i2l).op(Opcode::ladd)
+         .op(Opcode::lreturn);
+    static_method(jit, "longs", "(II)J", longs);
+
+    // int floats(int a, int b): float and double arithmetic and
+    // conversions, from a / b as a float.
+    CodeWriter floats(jit);
+    floats.set_max(6, 5)
+          .local(Opcode::iload, 0).op(Opcode::i2f)
+          .local(Opcode::iload, 1).op(Opcode::i2f).op(Opcode::fdiv)
+          .local(Opcode::fstore, 2)
+          .local(Opcode::fload, 2).op(Opcode::f2d).dconst(1.5)
+          .op(Opcode::dmul).dconst(0.25).op(Opcode::dsub)
+          .local(Opcode::dstore, 3)
+          .local(Opcode::fload, 2).fconst(100).op(Opcode::fmul)
+          .op(Opcode::f2i)
+          .local(Opcode::dload, 3).dconst(1000).op(Opcode::dmul)
+          .op(Opcode::d2i).op(Opcode::iadd)
+          .local(Opcode::fload, 2).fconst(0.75f).op(Opcode::frem)
+          .fconst(1000).op(Opcode::fmul).op(Opcode::f2i).op(Opcode::iadd)
+          .local(Opcode::dload, 3).dconst(0.3).op(Opcode::drem)
+          .dconst(1e6).op(Opcode::dmul).op(Opcode::d2l).op(Opcode::l2i)
+          .op(Opcode::iadd)
+          .local(Opcode::fload, 2).op(Opcode::fneg).fconst(3).op(Opcode::fsub)
+          .fconst(10).op(Opcode::fmul).op(Opcode::f2l).op(Opcode::l2i)
+          .op(Opcode::iadd)
+          .local(Opcode::dload, 3).op(Opcode::dneg).op(Opcode::d2f)
+          .fconst(2).op(Opcode::fadd).op(Opcode::f2i).op(Opcode::iadd)
+          .local(Opcode::iload, 0).op(Opcode::i2d).dconst(3).op(Opcode::ddiv)
+          .dconst(100).op(Opcode::dmul).op(Opcode::d2i).op(Opcode::iadd)
+          .local(Opcode::iload, 0).op(Opcode::i2l).op(Opcode::l2f)
+          .op(Opcode::f2i).op(Opcode::iadd)
+          .local(Opcode::iload, 0).op(Opcode::i2l).op(Opcode::l2d)
+          .op(Opcode::dneg).op(Opcode::d2i).op(Opcode::iadd)
+          .op(Opcode::ireturn);
+    static_method(jit, "floats", "(II)I", floats);
+
+    // int compares(int a, int b): the floating point comparisons of a / b
+    // with 1, which is NaN for 0 / 0, as digits.
+    CodeWriter compares(jit);
+    compares.set_max(5, 3)
+            .local(Opcode::iload, 0).op(Opcode::i2f)
+            .local(Opcode::iload, 1).op(Opcode::i2f).op(Opcode::fdiv)
+            .local(Opcode::fstore, 2)
+            .local(Opcode::fload, 2).fconst(1).op(Opcode::fcmpl)
+            .local(Opcode::fload, 2).fconst(1).op(Opcode::fcmpg)
+            .iconst(10).op(Opcode::imul).op(Opcode::iadd)
+            .local(Opcode::fload, 2).op(Opcode::f2d).dconst(1)
+            .op(Opcode::dcmpl).iconst(100).op(Opcode::imul).op(Opcode::iadd)
+            .local(Opcode::fload, 2).op(Opcode::f2d).dconst(1)
+            .op(Opcode::dcmpg).iconst(1000).op(Opcode::imul)
+            .op(Opcode::iadd)
+            .local(Opcode::iload, 0).op(Opcode::i2l)
+            .local(Opcode::iload, 1).op(Opcode::i2l).op(Opcode::lcmp)
+            .iconst(10000).op(Opcode::imul).op(Opcode::iadd)
+            .op(Opcode::ireturn);
+    static_method(jit, "compares", "(II)I", compares);
+
+    // int narrow(int a): the narrowing conversions, and saturating ones.
+    CodeWriter narrow(jit);
+    narrow.set_max(5, 1)
+          .local(Opcode::iload, 0).op(Opcode::i2b)
+          .local(Opcode::iload, 0).op(Opcode::i2c).op(Opcode::iadd)
+          .local(Opcode::iload, 0).op(Opcode::i2s).op(Opcode::iadd)
+          .local(Opcode::iload, 0).op(Opcode::i2f).fconst(1e30f)
+          .op(Opcode::fmul).op(Opcode::f2i).op(Opcode::ixor)
+          .local(Opcode::iload, 0).op(Opcode::i2d).dconst(1e300)
+          .op(Opcode::dmul).op(Opcode::d2l).op(Opcode::l2i).op(Opcode::iadd)
+          .op(Opcode::ireturn);
+    static_method(jit, "narrow", "(I)I", narrow);
+
+    // int shuffle(int a, int b): every stack manipulation.
+    CodeWriter shuffle(jit);
+    shuffle.set_max(8, 2)
+           .local(Opcode::iload, 0).local(Opcode::iload, 1)
+           .op(Opcode::dup_x1).op(Opcode::isub).op(Opcode::swap)
+           .iconst(3).op(Opcode::dup_x2).op(Opcode::imul).op(Opcode::isub)
+           .op(Opcode::imul)
+           .local(Opcode::iload, 0).local(Opcode::iload, 1)
+           .op(Opcode::dup2_x1).op(Opcode::iadd).op(Opcode::imul)
+           .op(Opcode::isub).op(Opcode::imul)
+           .op(Opcode::i2l).local(Opcode::iload, 1).op(Opcode::i2l)
+           .op(Opcode::dup2_x2).op(Opcode::lsub).op(Opcode::lmul)
+           .op(Opcode::dup2).op(Opcode::pop2).op(Opcode::l2i)
+           .op(Opcode::dup).op(Opcode::pop)
+           .op(Opcode::ireturn);
+    static_method(jit, "shuffle", "(II)I", shuffle);
+
+    // int operands(int a, int b): an expression deeper than the operands
+    // compiled code keeps out of their slots, values on the stack where
+    // control flow joins, and locals changed while copies of them are on
+    // the stack.
+    CodeWriter operands(jit);
+    Label less = operands.new_label();
+    Label joined = operands.new_label();
+    Label skipped = operands.new_label();
+    operands.set_max(8, 2)
+            .local(Opcode::iload, 0).local(Opcode::iload, 1)
+            .local(Opcode::iload, 0).local(Opcode::iload, 1)
+            .local(Opcode::iload, 0).local(Opcode::iload, 1).iconst(5)
+            .op(Opcode::ior).op(Opcode::imul).op(Opcode::isub)
+            .op(Opcode::ixor).op(Opcode::iadd).op(Opcode::iadd)
+            .local(Opcode::iload, 0).local(Opcode::iload, 1)
+            .jump(Opcode::if_icmplt, less)
+            .iconst(1)
+            .jump(Opcode::goto_, joined)
+            .bind(less)
+            .iconst(2)
+            .bind(joined)
+            .op(Opcode::iadd)
+            .op(Opcode::dup).iconst(33).op(Opcode::ishl).op(Opcode::ixor)
+            .op(Opcode::dup).local(Opcode::iload, 1).op(Opcode::ishr)
+            .op(Opcode::iadd)
+            .iconst(7).op(Opcode::ineg).op(Opcode::imul)
+            .iconst(0).jump(Opcode::ifeq, skipped)
+            .iconst(99).op(Opcode::iadd)
+            .bind(skipped)
+            .local(Opcode::iload, 0).iinc(0, 3).local(Opcode::iload, 0)
+            .op(Opcode::isub).op(Opcode::iadd)
+            .local(Opcode::iload, 1).local(Opcode::iload, 0)
+            .local(Opcode::istore, 1).local(Opcode::iload, 1)
+            .op(Opcode::isub).op(Opcode::iadd)
+            .op(Opcode::ireturn);
+    static_method(jit, "operands", "(II)I", operands);
+
+    // int table(int key) and int lookup(int key).
+    CodeWriter table(jit);
+    Label table_default = table.new_label();
+    Label table_targets[] {table.new_label(), table.new_label(),
+                           table.new_label()};
+    table.set_max(1, 1)
+         .local(Opcode::iload, 0)
+         .tableswitch(-1, 1, table_default, table_targets);
+    for (int i = 0; i < 3; ++i) {
+      table.bind(table_targets[i]).iconst(10 * (i + 1)).op(Opcode::ireturn);
+    }
+    table.bind(table_default).iconst(-1).op(Opcode::ireturn);
+    static_method(jit, "table", "(I)I", table);
+
+    CodeWriter lookup(jit);
+    Label lookup_default = lookup.new_label();
+    Label lookup_targets[] {lookup.new_label(), lookup.new_label(),
+                            lookup.new_label()};
+    int32_t const keys[] {-5, 100, 1000};
+    lookup.set_max(1, 1)
+          .local(Opcode::iload, 0)
+          .lookupswitch(lookup_default, keys, lookup_targets, 3);
+    for (int i = 0; i < 3; ++i) {
+      lookup.bind(lookup_targets[i]).iconst(i + 1).op(Opcode::ireturn);
+    }
+    lookup.bind(lookup_default).iconst(0).op(Opcode::ireturn);
+    static_method(jit, "lookup", "(I)I", lookup);
+
+    for (ArrayKind const &kind : array_kinds) {
+      array_kernel(jit, kind);
+    }
+
+    // int references(int n): an Object[] of n elements, every other one
+    // the literal "jit", counted with instanceof, and the length of the
+    // first through checkcast.
+    CodeWriter references(jit);
+    Label store = references.new_label();
+    Label stored = references.new_label();
+    Label next = references.new_label();
+    Label count = references.new_label();
+    Label counted = references.new_label();
+    Label skip = references.new_label();
+    references.set_max(4, 4)
+              .local(Opcode::iload, 0)
+              .type(Opcode::anewarray, "java/lang/Object")
+              .local(Opcode::astore, 1)
+              .iconst(0).local(Opcode::istore, 2)
+              .bind(store)
+              .local(Opcode::iload, 2).local(Opcode::iload, 0)
+              .jump(Opcode::if_icmpge, stored)
+              .local(Opcode::iload, 2).iconst(1).op(Opcode::iand)
+              .jump(Opcode::ifne, next)
+              .local(Opcode::aload, 1).local(Opcode::iload, 2)
+              .ldc_string("jit").op(Opcode::aastore)
+              .bind(next)
+              .iinc(2, 1)
+              .jump(Opcode::goto_, store)
+              .bind(stored)
+              .iconst(0).local(Opcode::istore, 3)
+              .iconst(0).local(Opcode::istore, 2)
+              .bind(count)
+              .local(Opcode::iload, 2).local(Opcode::aload, 1)
+              .op(Opcode::arraylength)
+              .jump(Opcode::if_icmpge, counted)
+              .local(Opcode::aload, 1).local(Opcode::iload, 2)
+              .op(Opcode::aaload)
+              .type(Opcode::instanceof, "java/lang/String")
+              .local(Opcode::iload, 3).op(Opcode::iadd)
+              .local(Opcode::istore, 3)
+              .local(Opcode::aload, 1).local(Opcode::iload, 2)
+              .op(Opcode::aaload).jump(Opcode::ifnonnull, skip)
+              .iinc(3, 100)
+              .bind(skip)
+              .iinc(2, 1)
+              .jump(Opcode::goto_, count)
+              .bind(counted)
+              .local(Opcode::aload, 1).iconst(0).op(Opcode::aaload)
+              .type(Opcode::checkcast, "java/lang/String")
+              .invoke(Opcode::invokevirtual, "java/lang/String", "length",
+                      "()I")
+              .local(Opcode::iload, 3).op(Opcode::iadd)
+              .op(Opcode::ireturn);
+    static_method(jit, "references", "(I)I", references);
+
+    // int fields(int a): stores a into each field of an `app/Box`, then
+    // adds them up, and counts calls in the static `count`.
+    CodeWriter fields(jit);
+    Label different = fields.new_label();
+    fields.set_max(6, 2)
+          .type(Opcode::new_, "app/Box").op(Opcode::dup)
+          .invoke(Opcode::invokespecial, "app/Box", "<init>", "()V")
+          .local(Opcode::astore, 1);
+    char const *const narrow_fields[][2] {
+      {"z", "Z"}, {"b", "B"}, {"c", "C"}, {"s", "S"}, {"i", "I"},
+    };
+    for (auto const &field : narrow_fields) {
+      fields.local(Opcode::aload, 1).local(Opcode::iload, 0)
+            .field(Opcode::putfield, "app/Box", field[0], field[1]);
+    }
+    fields.local(Opcode::aload, 1).local(Opcode::iload, 0).op(Opcode::i2l)
+          .lconst(int64_t(1) << 40).op(Opcode::lmul)
+          .field(Opcode::putfield, "app/Box", "j", "J")
+          .local(Opcode::aload, 1).local(Opcode::iload, 0).op(Opcode::i2f)
+          .field(Opcode::putfield, "app/Box", "f", "F")
+          .local(Opcode::aload, 1).local(Opcode::iload, 0).op(Opcode::i2d)
+          .field(Opcode::putfield, "app/Box", "d", "D")
+          .local(Opcode::aload, 1).local(Opcode::aload, 1)
+          .field(Opcode::putfield, "app/Box", "o", "Ljava/lang/Object;")
+          .iconst(0);
+    for (auto const &field : narrow_fields) {
+      fields.local(Opcode::aload, 1)
+            .field(Opcode::getfield, "app/Box", field[0], field[1])
+            .op(Opcode::iadd);
+    }
+    fields.local(Opcode::aload, 1)
+          .field(Opcode::getfield, "app/Box", "j", "J")
+          .iconst(30).op(Opcode::lushr).op(Opcode::l2i).op(Opcode::iadd)
+          .local(Opcode::aload, 1)
+          .field(Opcode::getfield, "app/Box", "f", "F")
+          .op(Opcode::f2i).op(Opcode::iadd)
+          .local(Opcode::aload, 1)
+          .field(Opcode::getfield, "app/Box", "d", "D")
+          .op(Opcode::d2i).op(Opcode::iadd)
+          .local(Opcode::aload, 1)
+          .field(Opcode::getfield, "app/Box", "o", "Ljava/lang/Object;")
+          .local(Opcode::aload, 1)
+          .jump(Opcode::if_acmpne, different)
+          .iconst(1000).op(Opcode::iadd)
+          .bind(different)
+          .field(Opcode::getstatic, "app/Jit", "count", "I")
+          .iconst(1).op(Opcode::iadd)
+          .field(Opcode::putstatic, "app/Jit", "count", "I")
+          .field(Opcode::getstatic, "app/Jit", "count", "I")
+          .op(Opcode::iadd)
+          .op(Opcode::ireturn);
+    static_method(jit, "fields", "(I)I", fields);
+
+    // int shapeArea(Shape shape) and int shapeSize(Sized shape), at one
+    // call site each.
+    CodeWriter shape_area_call(jit);
+    shape_area_call.set_max(1, 1)
+                   .local(Opcode::aload, 0)
+                   .invoke(Opcode::invokevirtual, "app/Shape", "area", "()I")
+                   .op(Opcode::ireturn);
+    static_method(jit, "shapeArea", "(Lapp/Shape;)I", shape_area_call);
+    CodeWriter shape_size_call(jit);
+    shape_size_call.set_max(1, 1)
+                   .local(Opcode::aload, 0)
+                   .invoke(Opcode::invokeinterface, "app/Sized", "size",
+                           "()I")
+                   .op(Opcode::ireturn);
+    static_method(jit, "shapeSize", "(Lapp/Sized;)I", shape_size_call);
+
+    // int divide(int a, int b) and its guarded version, -1 on / by zero.
+    CodeWriter divide(jit);
+    divide.set_max(2, 2)
+          .local(Opcode::iload, 0).local(Opcode::iload, 1)
+          .op(Opcode::idiv).op(Opcode::ireturn);
+    static_method(jit, "divide", "(II)I", divide);
+    CodeWriter safe(jit);
+    Label safe_start = safe.new_label();
+    Label safe_end = safe.new_label();
+    Label safe_handler = safe.new_label();
+    safe.set_max(2, 2)
+        .bind(safe_start)
+        .local(Opcode::iload, 0).local(Opcode::iload, 1)
+        .op(Opcode::idiv).op(Opcode::ireturn)
+        .bind(safe_end)
+        .bind(safe_handler)
+        .op(Opcode::pop).iconst(-1).op(Opcode::ireturn)
+        .handler(safe_start, safe_end, safe_handler,
+                 "java/lang/ArithmeticException");
+    static_method(jit, "safeDivide", "(II)I", safe);
+
+    // int element(int index): new int[3][index], and int nothing(), the
+    // length of a null array caught as 7.
+    CodeWriter element(jit);
+    element.set_max(2, 1)
+           .iconst(3).newarray(10).local(Opcode::iload, 0)
+           .op(Opcode::iaload).op(Opcode::ireturn);
+    static_method(jit, "element", "(I)I", element);
+    CodeWriter nothing(jit);
+    Label nothing_start = nothing.new_label();
+    Label nothing_end = nothing.new_label();
+    nothing.set_max(1, 0)
+           .bind(nothing_start)
+           .op(Opcode::aconst_null).op(Opcode::arraylength)
+           .op(Opcode::ireturn)
+           .bind(nothing_end)
+           .op(Opcode::pop).iconst(7).op(Opcode::ireturn)
+           .handler(nothing_start, nothing_end, nothing_end,
+                    "java/lang/NullPointerException");
+    static_method(jit, "nothing", "()I", nothing);
+
+    // int guardedDivide(int a, int b), divide called with a handler, -1
+    // on / by zero; int depth(int n), n calls deep; and
+    // int shapeAreaOf(Shape shape), which calls shapeArea.
+    CodeWriter guarded(jit);
+    Label guarded_start = guarded.new_label();
+    Label guarded_end = guarded.new_label();
+    guarded.set_max(2, 2)
+           .bind(guarded_start)
+           .local(Opcode::iload, 0).local(Opcode::iload, 1)
+           .invoke(Opcode::invokestatic, "app/Jit", "divide", "(II)I")
+           .op(Opcode::ireturn)
+           .bind(guarded_end)
+           .op(Opcode::pop).iconst(-1).op(Opcode::ireturn)
+           .handler(guarded_start, guarded_end, guarded_end,
+                    "java/lang/ArithmeticException");
+    static_method(jit, "guardedDivide", "(II)I", guarded);
+    CodeWriter depth(jit);
+    Label depth_recurse = depth.new_label();
+    depth.set_max(2, 1)
+         .local(Opcode::iload, 0)
+         .jump(Opcode::ifne, depth_recurse)
+         .iconst(0).op(Opcode::ireturn)
+         .bind(depth_recurse)
+         .local(Opcode::iload, 0).iconst(1).op(Opcode::isub)
+         .invoke(Opcode::invokestatic, "app/Jit", "depth", "(I)I")
+         .iconst(1).op(Opcode::iadd).op(Opcode::ireturn);
+    static_method(jit, "depth", "(I)I", depth);
+    CodeWriter area_of(jit);
+    area_of.set_max(1, 1)
+           .local(Opcode::aload, 0)
+           .invoke(Opcode::invokestatic, "app/Jit", "shapeArea",
+                   "(Lapp/Shape;)I")
+           .op(Opcode::ireturn);
+    static_method(jit, "shapeAreaOf", "(Lapp/Shape;)I", area_of);
+
+    ClassWriter box("app/Box");
+    box.add_field(access::public_, "z", "Z");
+    box.add_field(access::public_, "b", "B");
+    box.add_field(access::public_, "c", "C");
+    box.add_field(access::public_, "s", "S");
+    box.add_field(access::public_, "i", "I");
+    box.add_field(access::public_, "j", "J");
+    box.add_field(access::public_, "f", "F");
+    box.add_field(access::public_, "d", "D");
+    box.add_field(access::public_, "o", "Ljava/lang/Object;");
+    CodeWriter box_init(box);
+    box_init.set_max(1, 1)
+            .local(Opcode::aload, 0)
+            .invoke(Opcode::invokespecial, "java/lang/Object", "<init>",
+                    "()V")
+            .op(Opcode::return_);
+    box.add_method(access::public_, "<init>", "()V", &box_init);
+
+    ClassWriter sized_interface("app/Sized", "java/lang/Object",
+                                access::public_ | access::interface |
+                                access::abstract);
+    sized_interface.add_method(access::public_ | access::abstract, "size",
+                               "()I", nullptr);
+
+    ClassWriter shape("app/Shape");
+    shape.add_interface("app/Sized");
+    CodeWriter shape_init(shape);
+    shape_init.set_max(1, 1)
+              .local(Opcode::aload, 0)
+              .invoke(Opcode::invokespecial, "java/lang/Object", "<init>",
+                      "()V")
+              .op(Opcode::return_);
+    shape.add_method(access::public_, "<init>", "()V", &shape_init);
+    CodeWriter shape_area(shape);
+    shape_area.set_max(1, 1).iconst(0).op(Opcode::ireturn);
+    shape.add_method(access::public_, "area", "()I", &shape_area);
+    CodeWriter shape_size(shape);
+    shape_size.set_max(1, 1).iconst(1).op(Opcode::ireturn);
+    shape.add_method(access::public_, "size", "()I", &shape_size);
+
+    ClassWriter circle("app/Circle", "app/Shape");
+    CodeWriter circle_init(circle);
+    circle_init.set_max(1, 1)
+               .local(Opcode::aload, 0)
+               .invoke(Opcode::invokespecial, "app/Shape", "<init>", "()V")
+               .op(Opcode::return_);
+    circle.add_method(access::public_, "<init>", "()V", &circle_init);
+    CodeWriter circle_area(circle);
+    circle_area.set_max(1, 1).iconst(3).op(Opcode::ireturn);
+    circle.add_method(access::public_, "area", "()I", &circle_area);
+    CodeWriter circle_size(circle);
+    circle_size.set_max(1, 1).iconst(7).op(Opcode::ireturn);
+    circle.add_method(access::public_, "size", "()I", &circle_size);
+
+    return directory.write_class(jit, "app/Jit") and
+           directory.write_class(box, "app/Box") and
+           directory.write_class(sized_interface, "app/Sized") and
+           directory.write_class(shape, "app/Shape") and
+           directory.write_class(circle, "app/Circle");
+  }
+
+  /// The VM of one run, with `app/Jit` linked and compiled once called
+  /// \p threshold times, or never with 0.
+  struct Runtime : TestVM {
+    Klass *jit {nullptr};
+
+    Runtime(std::string const &path, uint32_t threshold) : TestVM(path) {
+      set_compile_threshold(threshold);
+      vm.get_compiler().set_backedge_threshold(UINT32_MAX);
+      jit = klass("app/Jit");
+    }
+
+    [[nodiscard]]
+    auto method(char const *name, char const *descriptor) const -> Method * {
+      return jit->find_method(view(name), view(descriptor));
+    }
+
+    /// Call the static method \p name of `app/Jit` with int \p arguments.
+    auto call(char const *name, char const *descriptor,
+              std::vector<int32_t> const &arguments = {}) -> Value {
+      return TestVM::call(jit, name, descriptor, arguments);
+    }
+
+    /// Call the static method \p name with the object \p argument.
+    auto call(char const *name, char const *descriptor, Object *argument)
+      -> Value {
+      thread.exception = nullptr;
+      Method *called = method(name, descriptor);
+      thread.get_stack_base()[0].l = argument;
+      return vm.invoke(thread, *called, thread.get_stack_base());
+    }
+
+    [[nodiscard]]
+    auto is_compiled(char const *name, char const *descriptor) const
+      -> bool {
+      return method(name, descriptor)->compiled != nullptr;
+    }
+  };
+
+  struct Kernel {
+    char const *name;
+    char const *descriptor;
+    std::vector<std::vector<int32_t>> arguments;
+  };
+
+  std::vector<Kernel> const kernels {
+    {"sum", "(I)I", {{0}, {10}, {1000}}},
+    {"fib", "(I)I", {{1}, {15}}},
+    {"ints", "(II)I", {{1000, 7}, {-1000, 3}, {INT32_MIN, -1}, {5, 33}}},
+    {"longs", "(II)J", {{1000, 7}, {-123456, 5}, {INT32_MAX, -1}, {9, 65}}},
+    {"floats", "(II)I", {{1, 3}, {-7, 2}, {100000, 7}, {1, 0}, {0, 0}}},
+    {"compares", "(II)I", {{0, 0}, {1, 2}, {5, 1}, {3, 3}, {-1, 0}}},
+    {"narrow", "(I)I", {{0}, {200}, {-40000}, {70000}, {INT32_MIN}}},
+    {"shuffle", "(II)I", {{3, 5}, {-17, 1000}, {INT32_MAX, 2}}},
+    {"operands", "(II)I", {{3, 5}, {-17, 1000}, {INT32_MAX, -2}, {0, 0}}},
+    {"table", "(I)I", {{-2}, {-1}, {0}, {1}, {2}, {INT32_MIN}}},
+    {"lookup", "(I)I", {{-5}, {100}, {1000}, {0}, {INT32_MAX}}},
+    {"booleanArray", "(I)I", {{0}, {9}}},
+    {"byteArray", "(I)I", {{0}, {50}}},
+    {"charArray", "(I)I", {{50}}},
+    {"shortArray", "(I)I", {{50}}},
+    {"intArray", "(I)I", {{50}}},
+    {"longArray", "(I)I", {{50}}},
+    {"floatArray", "(I)I", {{50}}},
+    {"doubleArray", "(I)I", {{50}}},
+    {"references", "(I)I", {{1}, {10}}},
+    {"fields", "(I)I", {{0}, {1}, {-300}, {100000}}},
+  };
+
+  /// The results of every kernel with \p threshold, each run with each
+  /// argument list several times, so compiled code runs too, as
+  /// `name(arguments) = result` lines.
+  auto run_kernels(std::string const &path, uint32_t threshold)
+    -> std::vector<std::string> {
+    Runtime runtime(path, threshold);
+    std::vector<std::string> results;
+    for (Kernel const &kernel : kernels) {
+      bool is_long = std::string(kernel.descriptor).back() == 'J';
+      for (int round = 0; round < 4; ++round) {
+        for (auto const &arguments : kernel.arguments) {
+          Value result = runtime.call(kernel.name, kernel.descriptor,
+                                      arguments);
+          std::string line = std::string(kernel.name) + "(";
+          for (int32_t argument : arguments) {
+            line += std::to_string(argument) + ",";
+          }
+          line += ") = ";
+          if (runtime.thread.exception != nullptr) {
+            line += "exception";
+          } else {
+            line += is_long ? std::to_string(result.j)
+                            : std::to_string(result.i);
+          }
+          results.push_back(line);
+        }
+      }
+      if (threshold != 0 and
+          not runtime.is_compiled(kernel.name, kernel.descriptor)) {
+        results.push_back(std::string(kernel.name) + " not compiled");
+      }
+    }
+    return results;
+  }
+} // namespace
+
+test_group ("compiler: compiled code computes what the interpreter does") {
+  if (not Compiler::is_available()) { return; }
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  std::vector<std::string> interpreted = run_kernels(classes.get_path(),
+                                                     0);
+  for (uint32_t threshold : {1u, 2u, 4u}) {
+    std::vector<std::string> compiled = run_kernels(classes.get_path(),
+                                                    threshold);
+    assert_equal(compiled.size(), interpreted.size(),
+                 "every kernel was compiled");
+    for (size_t i = 0; i < compiled.size() and i < interpreted.size(); ++i) {
+      assert_equal(compiled[i], interpreted[i]);
+    }
+  }
+}
+
+test_group ("compiler: methods are compiled once hot") {
+  if (not Compiler::is_available()) { return; }
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  Runtime runtime(classes.get_path(), 10);
+  for (int i = 0; i < 9; ++i) {
+    assert_equal(runtime.call("sum", "(I)I", {10}).i, 45);
+  }
+  assert_true(not runtime.is_compiled("sum", "(I)I"));
+  assert_equal(runtime.call("sum", "(I)I", {10}).i, 45);
+  assert_true(runtime.is_compiled("sum", "(I)I"),
+              "the call that crosses the threshold compiles the method");
+  assert_equal(runtime.call("sum", "(I)I", {100}).i, 4950);
+
+  CompilerStats stats = runtime.vm.get_compiler().get_stats();
+  assert_equal(stats.compiled, uint64_t(1));
+  assert_equal(stats.failed, uint64_t(0));
+  assert_true(stats.code_bytes > 0);
+
+  Runtime interpreted(classes.get_path(), 0);
+  for (int i = 0; i < 20; ++i) {
+    (void)interpreted.call("sum", "(I)I", {10});
+  }
+  assert_true(not interpreted.is_compiled("sum", "(I)I"),
+              "a disabled compiler compiles nothing");
+}
+
+test_group ("compiler: loops move to compiled code while they run") {
+  if (not Compiler::is_available()) { return; }
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  Runtime runtime(classes.get_path(), UINT32_MAX);
+  runtime.vm.get_compiler().set_backedge_threshold(100);
+  assert_equal(runtime.call("sum", "(I)I", {100000}).i,
+               int32_t(uint32_t(99999) * 100000 / 2));
+  assert_true(runtime.is_compiled("sum", "(I)I"));
+  CompilerStats stats = runtime.vm.get_compiler().get_stats();
+  assert_equal(stats.osr_entries, uint64_t(1),
+               "the loop finished in compiled code");
+
+  Runtime interpreted(classes.get_path(), 0);
+  assert_equal(runtime.call("intArray", "(I)I", {5000}).i,
+               interpreted.call("intArray", "(I)I", {5000}).i);
+  assert_true(runtime.is_compiled("intArray", "(I)I"),
+              "a second loop compiles the method too");
+  assert_equal(runtime.vm.get_compiler().get_stats().osr_entries,
+               uint64_t(2));
+}
+
+test_group ("compiler: a new receiver class deoptimizes a call site") {
+  if (not Compiler::is_available()) { return; }
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  Runtime runtime(classes.get_path(), 3);
+  Object *circle = runtime.new_object("app/Circle");
+  Object *shape = runtime.new_object("app/Shape");
+  assert_true(circle != nullptr and shape != nullptr);
+
+  for (int i = 0; i < 4; ++i) {
+    assert_equal(runtime.call("shapeArea", "(Lapp/Shape;)I", circle).i, 3);
+    assert_equal(runtime.call("shapeSize", "(Lapp/Sized;)I", circle).i, 7);
+  }
+  assert_true(runtime.is_compiled("shapeArea", "(Lapp/Shape;)I"));
+  assert_true(runtime.is_compiled("shapeSize", "(Lapp/Sized;)I"));
+  assert_equal(runtime.vm.get_compiler().get_stats().deoptimizations,
+               uint64_t(0));
+
+  assert_equal(runtime.call("shapeArea", "(Lapp/Shape;)I", shape).i, 0,
+               "the interpreter calls the method of the new class");
+  assert_equal(runtime.call("shapeSize", "(Lapp/Sized;)I", shape).i, 1);
+  assert_equal(runtime.vm.get_compiler().get_stats().deoptimizations,
+               uint64_t(2));
+  assert_true(not runtime.is_compiled("shapeArea", "(Lapp/Shape;)I"),
+              "the speculating code is dropped");
+
+  // Compiled again, the megamorphic sites look methods up.
+  for (int i = 0; i < 4; ++i) {
+    assert_equal(runtime.call("shapeArea", "(Lapp/Shape;)I", shape).i, 0);
+    assert_equal(runtime.call("shapeArea", "(Lapp/Shape;)I", circle).i, 3);
+    assert_equal(runtime.call("shapeSize", "(Lapp/Sized;)I", shape).i, 1);
+    assert_equal(runtime.call("shapeSize", "(Lapp/Sized;)I", circle).i, 7);
+  }
+  assert_true(runtime.is_compiled("shapeArea", "(Lapp/Shape;)I"));
+  assert_equal(runtime.vm.get_compiler().get_stats().deoptimizations,
+               uint64_t(2));
+  assert_true(runtime.call("shapeArea", "(Lapp/Shape;)I", nullptr).i == 0 and
+                runtime.thrown("java/lang/NullPointerException"),
+              "a null receiver throws from compiled code");
+}
+
+test_group ("compiler: exceptions thrown by compiled code") {
+  if (not Compiler::is_available()) { return; }
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  Runtime runtime(classes.get_path(), 1);
+
+  assert_equal(runtime.call("divide", "(II)I", {7, 2}).i, 3);
+  assert_true(runtime.is_compiled("divide", "(II)I"));
+  (void)runtime.call("divide", "(II)I", {1, 0});
+  assert_true(runtime.thrown("java/lang/ArithmeticException"));
+  assert_equal(runtime.thread.depth, 0u);
+
+  assert_equal(runtime.call("safeDivide", "(II)I", {1, 0}).i, -1,
+               "the handler runs in the interpreter");
+  assert_true(runtime.thread.exception == nullptr);
+  assert_equal(runtime.call("safeDivide", "(II)I", {9, 3}).i, 3);
+  assert_true(runtime.is_compiled("safeDivide", "(II)I"),
+              "code with handlers compiles too");
+
+  assert_equal(runtime.call("element", "(I)I", {2}).i, 0);
+  (void)runtime.call("element", "(I)I", {3});
+  assert_true(runtime.thrown("java/lang/ArrayIndexOutOfBoundsException"));
+  (void)runtime.call("element", "(I)I", {12345});
+  assert_equal(runtime.message(), "Index 12345 out of bounds for length 3",
+               "the operands are in their slots for the message");
+  (void)runtime.call("element", "(I)I", {-1});
+  assert_true(runtime.thrown("java/lang/ArrayIndexOutOfBoundsException"));
+  assert_equal(runtime.call("nothing", "()I").i, 7);
+  assert_equal(runtime.call("nothing", "()I").i, 7);
+  assert_true(runtime.thread.exception == nullptr);
+  assert_equal(runtime.vm.get_compiler().get_stats().failed, uint64_t(0));
+}
+
+test_group ("compiler: compiled methods call each other directly") {
+  if (not Compiler::is_available()) { return; }
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  Runtime runtime(classes.get_path(), 1);
+
+  for (int i = 0; i < 3; ++i) {
+    assert_equal(runtime.call("guardedDivide", "(II)I", {7, 2}).i, 3);
+  }
+  assert_true(runtime.is_compiled("guardedDivide", "(II)I") and
+              runtime.is_compiled("divide", "(II)I"));
+  assert_equal(runtime.call("guardedDivide", "(II)I", {7, 0}).i, -1,
+               "the exception of the callee reaches the handler");
+  assert_true(runtime.thread.exception == nullptr);
+  assert_equal(runtime.thread.depth, 0u);
+
+  assert_equal(runtime.call("depth", "(I)I", {1}).i, 1);
+  assert_equal(runtime.call("depth", "(I)I", {1000}).i, 1000);
+  (void)runtime.call("depth", "(I)I", {1000000});
+  assert_true(runtime.thrown("java/lang/StackOverflowError"),
+              "recursion in compiled code overflows like interpreted");
+  assert_equal(runtime.thread.depth, 0u);
+  assert_true(runtime.thread.frame == nullptr);
+  assert_equal(runtime.call("depth", "(I)I", {1000}).i, 1000);
+
+  Object *circle = runtime.new_object("app/Circle");
+  Object *shape = runtime.new_object("app/Shape");
+  assert_true(circle != nullptr and shape != nullptr);
+  for (int i = 0; i < 4; ++i) {
+    assert_equal(runtime.call("shapeAreaOf", "(Lapp/Shape;)I", circle).i, 3);
+  }
+  assert_true(runtime.is_compiled("shapeAreaOf", "(Lapp/Shape;)I"));
+  assert_equal(runtime.call("shapeAreaOf", "(Lapp/Shape;)I", shape).i, 0,
+               "a callee that deoptimizes finishes in the interpreter");
+  assert_true(not runtime.is_compiled("shapeArea", "(Lapp/Shape;)I"));
+  assert_true(runtime.is_compiled("shapeAreaOf", "(Lapp/Shape;)I"),
+              "its caller stays compiled");
+  assert_equal(runtime.call("shapeAreaOf", "(Lapp/Shape;)I", circle).i, 3);
+  assert_equal(runtime.thread.depth, 0u);
+}
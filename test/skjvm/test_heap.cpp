@@ -0,0 +1,443 @@
+#include <sktest/test.hpp>
+
+#include "temporary_directory.hpp"
+#include "test_vm.hpp"
+
+#include <skjvm/gc_workers.hpp>
+#include <skjvm/heap.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace skjvm;
+
+namespace {
+  /// Push a new `app/Node` on the stack of \p code.
+  auto new_node(CodeWriter &code) -> CodeWriter & {
+    return code.type(Opcode::new_, "app/Node").op(Opcode::dup)
+               .invoke(Opcode::invokespecial, "app/Node", "<init>", "()V");
+  }
+
+  /// `app/Node`, a linked list node, and `app/Gc`, whose static methods
+  /// keep objects alive while they allocate garbage.
+  auto write_classes(TemporaryDirectory const &directory) -> bool {
+    ClassWriter node("app/Node");
+    node.add_field(access::public_, "next", "Lapp/Node;");
+    node.add_field(access::public_, "value", "I");
+    CodeWriter node_init(node);
+    node_init.set_max(1, 1)
+             .local(Opcode::aload, 0)
+             .invoke(Opcode::invokespecial, "java/lang/Object", "<init>",
+                     "()V")
+             .op(Opcode::return_);
+    node.add_method(access::public_, "<init>", "()V", &node_init);
+
+    ClassWriter gc("app/Gc");
+    gc.add_field(access::public_ | access::static_, "head", "Lapp/Node;");
+
+    // void churn(int n): allocates n arrays of 16 ints, all garbage.
+    CodeWriter churn(gc);
+    Label churn_loop = churn.new_label();
+    Label churn_end = churn.new_label();
+    churn.set_max(1, 1)
+         .bind(churn_loop)
+         .local(Opcode::iload, 0).jump(Opcode::ifle, churn_end)
+         .iconst(16).newarray(10).op(Opcode::pop)
+         .iinc(0, -1)
+         .jump(Opcode::goto_, churn_loop)
+         .bind(churn_end)
+         .op(Opcode::return_);
+    static_method(gc, "churn", "(I)V", churn);
+
+    // int list(int n): appends nodes 0 to n - 1 to a list held by the
+    // static `head`, churning after each, then adds up their values.
+    CodeWriter list(gc);
+    Label append = list.new_label();
+    Label built = list.new_label();
+    Label add = list.new_label();
+    Label added = list.new_label();
+    new_node(list.set_max(3, 5)).local(Opcode::astore, 1)
+        .local(Opcode::aload, 1).local(Opcode::astore, 2)
+        .iconst(0).local(Opcode::istore, 3)
+        .bind(append)
+        .local(Opcode::iload, 3).local(Opcode::iload, 0)
+        .jump(Opcode::if_icmpge, built);
+    new_node(list).local(Opcode::astore, 4)
+        .local(Opcode::aload, 4).local(Opcode::iload, 3)
+        .field(Opcode::putfield, "app/Node", "value", "I")
+        .local(Opcode::aload, 2).local(Opcode::aload, 4)
+        .field(Opcode::putfield, "app/Node", "next", "Lapp/Node;")
+        .local(Opcode::aload, 4).local(Opcode::astore, 2)
+        .iconst(4)
+        .invoke(Opcode::invokestatic, "app/Gc", "churn", "(I)V")
+        .iinc(3, 1)
+        .jump(Opcode::goto_, append)
+        .bind(built)
+        .local(Opcode::aload, 1)
+        .field(Opcode::putstatic, "app/Gc", "head", "Lapp/Node;")
+        .iconst(0).local(Opcode::istore, 3)
+        .field(Opcode::getstatic, "app/Gc", "head", "Lapp/Node;")
+        .field(Opcode::getfield, "app/Node", "next", "Lapp/Node;")
+        .local(Opcode::astore, 4)
+        .bind(add)
+        .local(Opcode::aload, 4).jump(Opcode::ifnull, added)
+        .local(Opcode::iload, 3).local(Opcode::aload, 4)
+        .field(Opcode::getfield, "app/Node", "value", "I")
+        .op(Opcode::iadd).local(Opcode::istore, 3)
+        .local(Opcode::aload, 4)
+        .field(Opcode::getfield, "app/Node", "next", "Lapp/Node;")
+        .local(Opcode::astore, 4)
+        .jump(Opcode::goto_, add)
+        .bind(added)
+        .local(Opcode::iload, 3).op(Opcode::ireturn);
+    static_method(gc, "list", "(I)I", list);
+
+    // int table(int n): fills a `Node[n]` with nodes 0 to n - 1, churning
+    // after each, then adds up their values.
+    CodeWriter table(gc);
+    Label fill = table.new_label();
+    Label filled = table.new_label();
+    Label sum = table.new_label();
+    Label summed = table.new_label();
+    table.set_max(5, 4)
+         .local(Opcode::iload, 0).type(Opcode::anewarray, "app/Node")
+         .local(Opcode::astore, 1)
+         .iconst(0).local(Opcode::istore, 2)
+         .bind(fill)
+         .local(Opcode::iload, 2).local(Opcode::iload, 0)
+         .jump(Opcode::if_icmpge, filled)
+         .local(Opcode::aload, 1).local(Opcode::iload, 2);
+    new_node(table).op(Opcode::dup).local(Opcode::iload, 2)
+         .field(Opcode::putfield, "app/Node", "value", "I")
+         .op(Opcode::aastore)
+         .iconst(4)
+         .invoke(Opcode::invokestatic, "app/Gc", "churn", "(I)V")
+         .iinc(2, 1)
+         .jump(Opcode::goto_, fill)
+         .bind(filled)
+         .iconst(0).local(Opcode::istore, 3)
+         .iconst(0).local(Opcode::istore, 2)
+         .bind(sum)
+         .local(Opcode::iload, 2).local(Opcode::iload, 0)
+         .jump(Opcode::if_icmpge, summed)
+         .local(Opcode::iload, 3)
+         .local(Opcode::aload, 1).local(Opcode::iload, 2).op(Opcode::aaload)
+         .field(Opcode::getfield, "app/Node", "value", "I")
+         .op(Opcode::iadd).local(Opcode::istore, 3)
+         .iinc(2, 1)
+         .jump(Opcode::goto_, sum)
+         .bind(summed)
+         .local(Opcode::iload, 3).op(Opcode::ireturn);
+    static_method(gc, "table", "(I)I", table);
+
+    // int hashes(int n): 1 if the identity hash of a node is the same
+    // before and after churning n arrays.
+    CodeWriter hashes(gc);
+    Label hash_changed = hashes.new_label();
+    new_node(hashes.set_max(2, 3)).local(Opcode::astore, 1)
+          .local(Opcode::aload, 1)
+          .invoke(Opcode::invokestatic, "java/lang/System",
+                  "identityHashCode", "(Ljava/lang/Object;)I")
+          .local(Opcode::istore, 2)
+          .local(Opcode::iload, 0)
+          .invoke(Opcode::invokestatic, "app/Gc", "churn", "(I)V")
+          .local(Opcode::aload, 1)
+          .invoke(Opcode::invokestatic, "java/lang/System",
+                  "identityHashCode", "(Ljava/lang/Object;)I")
+          .local(Opcode::iload, 2)
+          .jump(Opcode::if_icmpne, hash_changed)
+          .iconst(1).op(Opcode::ireturn)
+          .bind(hash_changed)
+          .iconst(0).op(Opcode::ireturn);
+    static_method(gc, "hashes", "(I)I", hashes);
+
+    // int strings(int n): 1 if a string literal is the same object before
+    // and after churning n arrays.
+    CodeWriter strings(gc);
+    Label string_changed = strings.new_label();
+    strings.set_max(2, 2)
+           .ldc_string("survivor").local(Opcode::astore, 1)
+           .local(Opcode::iload, 0)
+           .invoke(Opcode::invokestatic, "app/Gc", "churn", "(I)V")
+           .ldc_string("survivor").local(Opcode::aload, 1)
+           .jump(Opcode::if_acmpne, string_changed)
+           .iconst(1).op(Opcode::ireturn)
+           .bind(string_changed)
+           .iconst(0).op(Opcode::ireturn);
+    static_method(gc, "strings", "(I)I", strings);
+
+    return directory.write_class(node, "app/Node") and
+           directory.write_class(gc, "app/Gc");
+  }
+
+  /// The VM of one run with a small heap, with `app/Gc` linked and
+  /// compiled once called \p threshold times, or never with 0.
+  struct Runtime : TestVM {
+    Klass *gc {nullptr};
+
+    Runtime(std::string const &path, uint32_t threshold,
+            size_t heap_size = size_t(8) << 20,
+            size_t young_size = size_t(1) << 20)
+      : TestVM(path, heap_size, young_size) {
+      set_compile_threshold(threshold);
+      gc = klass("app/Gc");
+    }
+
+    /// Call the static method \p name of `app/Gc` with \p argument.
+    auto call(char const *name, int32_t argument) -> int32_t {
+      return TestVM::call(gc, name, "(I)I", {argument}).i;
+    }
+  };
+} // namespace
+
+test_group ("heap: live objects survive young collections") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (uint32_t threshold : {0u, 1u}) {
+    if (threshold != 0 and not Compiler::is_available()) { continue; }
+    // Promote at once, after a few collections, or as late as possible.
+    for (uint32_t tenuring : {0u, 2u, 15u}) {
+      Runtime runtime(classes.get_path(), threshold);
+      runtime.vm.get_heap().set_tenuring_threshold(tenuring);
+      for (int round = 0; round < 3; ++round) {
+        assert_equal(runtime.call("list", 20000), 20000 * 19999 / 2);
+        assert_true(runtime.thread.exception == nullptr);
+        assert_equal(runtime.call("table", 20000), 20000 * 19999 / 2);
+        assert_true(runtime.thread.exception == nullptr);
+      }
+      GcStats stats = runtime.vm.get_heap().get_stats();
+      assert_true(stats.collections > 0);
+      assert_true(stats.tlab_refills > 0);
+      assert_true(stats.promoted_bytes > 0,
+                  "the lists outgrow the survivor spaces");
+      assert_true(stats.max_pause_ns <= stats.total_pause_ns);
+    }
+  }
+}
+
+test_group ("heap: old arrays keep young objects alive") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (uint32_t threshold : {0u, 1u}) {
+    if (threshold != 0 and not Compiler::is_available()) { continue; }
+    // The array is larger than half of eden, so it starts out old, and
+    // only its cards tell which of its nodes are alive.
+    Runtime runtime(classes.get_path(), threshold);
+    assert_equal(runtime.call("table", 60000),
+                 int32_t(int64_t(60000) * 59999 / 2));
+    assert_true(runtime.thread.exception == nullptr);
+    assert_true(runtime.vm.get_heap().get_stats().collections > 0);
+  }
+}
+
+test_group ("heap: identity hashes and interned strings move along") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (uint32_t threshold : {0u, 1u}) {
+    if (threshold != 0 and not Compiler::is_available()) { continue; }
+    Runtime runtime(classes.get_path(), threshold);
+    for (uint32_t tenuring : {0u, 15u}) {
+      runtime.vm.get_heap().set_tenuring_threshold(tenuring);
+      assert_equal(runtime.call("hashes", 20000), 1);
+      assert_equal(runtime.call("strings", 20000), 1);
+    }
+  }
+}
+
+test_group ("heap: handles are updated when objects move") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  Runtime runtime(classes.get_path(), 0);
+  LinkError error = LinkError::none;
+  Klass *node_class = runtime.registry.link(view("app/Node"), error);
+  assert_true(node_class != nullptr);
+  Field *value = node_class->find_field(view("value"), view("I"));
+  Field *next = node_class->find_field(view("next"), view("Lapp/Node;"));
+  assert_true(value != nullptr and next != nullptr);
+
+  VM &vm = runtime.vm;
+  Object *first = vm.new_object(runtime.thread, *node_class);
+  first->at<int32_t>(value->offset) = 42;
+  Handle<Object> node(runtime.thread, first);
+  Object *second = vm.new_object(runtime.thread, *node_class);
+  second->at<int32_t>(value->offset) = 43;
+  vm.store_reference(&node->at<Object *>(next->offset), second);
+
+  assert_true(vm.collect(runtime.thread));
+  assert_true(node.get() != first, "the node was copied");
+  assert_true(vm.get_heap().is_young(node.get()));
+  assert_equal(node->at<int32_t>(value->offset), 42);
+  Object *copied = node->at<Object *>(next->offset);
+  assert_true(copied != nullptr and copied != second);
+  assert_equal(copied->at<int32_t>(value->offset), 43);
+
+  vm.get_heap().set_tenuring_threshold(0);
+  assert_true(vm.collect(runtime.thread));
+  assert_true(not vm.get_heap().is_young(node.get()), "the node was promoted");
+  assert_equal(node->at<int32_t>(value->offset), 42);
+
+  GcStats stats = vm.get_heap().get_stats();
+  assert_equal(stats.collections, uint64_t(2));
+  assert_true(stats.copied_bytes >= 2 * Heap::align(node_class->instance_size));
+  assert_true(stats.promoted_bytes >=
+              2 * Heap::align(node_class->instance_size));
+}
+
+test_group ("heap: interned strings only live while referred to") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  Runtime runtime(classes.get_path(), 0);
+  VM &vm = runtime.vm;
+  Symbol const *symbol = runtime.symbols.intern(view("interned"));
+  {
+    Handle<Object> string(runtime.thread, vm.intern(runtime.thread, symbol));
+    Object *first = string.get();
+    assert_true(first != nullptr);
+    assert_true(vm.intern(runtime.thread, symbol) == first);
+
+    assert_true(vm.collect(runtime.thread));
+    assert_true(string.get() != first, "the string was copied");
+    assert_true(runtime.symbols.find_string(symbol) == string.get());
+    assert_true(vm.intern(runtime.thread, symbol) == string.get());
+
+    vm.get_heap().set_tenuring_threshold(0);
+    assert_true(vm.collect(runtime.thread));
+    assert_true(not vm.get_heap().is_young(string.get()));
+    assert_true(vm.collect(runtime.thread, true));
+    assert_true(vm.intern(runtime.thread, symbol) == string.get());
+  }
+  assert_true(vm.collect(runtime.thread, true));
+  assert_true(runtime.symbols.find_string(symbol) == nullptr,
+              "the old string was collected");
+
+  Object *young = vm.intern(runtime.thread, symbol);
+  assert_true(young != nullptr and vm.get_heap().is_young(young));
+  assert_true(vm.collect(runtime.thread));
+  assert_true(runtime.symbols.find_string(symbol) == nullptr,
+              "the young string was collected");
+  assert_true(vm.intern(runtime.thread, symbol) != nullptr);
+}
+
+test_group ("heap: a full heap throws OutOfMemoryError") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (uint32_t threshold : {0u, 1u}) {
+    if (threshold != 0 and not Compiler::is_available()) { continue; }
+    Runtime runtime(classes.get_path(), threshold, size_t(4) << 20,
+                    size_t(1) << 20);
+    (void)runtime.call("list", 200000);
+    assert_true(runtime.thrown("java/lang/OutOfMemoryError"));
+  }
+}
+
+test_group ("heap: full collections make room in the old generation") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (uint32_t threshold : {0u, 1u}) {
+    if (threshold != 0 and not Compiler::is_available()) { continue; }
+    for (uint32_t workers : {1u, 4u}) {
+      // Each list replaces the previous one, promoted at once, so the old
+      // generation fills up with dead lists.
+      Runtime runtime(classes.get_path(), threshold, size_t(4) << 20,
+                      size_t(1) << 20);
+      Heap &heap = runtime.vm.get_heap();
+      heap.set_parallel_gc_threads(workers);
+      heap.set_tenuring_threshold(0);
+      for (int round = 0; round < 20; ++round) {
+        assert_equal(runtime.call("list", 20000), 20000 * 19999 / 2);
+        assert_true(runtime.thread.exception == nullptr);
+      }
+      GcStats stats = heap.get_stats();
+      assert_equal(heap.get_parallel_gc_threads(), workers);
+      assert_true(stats.full_collections > 0);
+      assert_true(stats.swept_blocks > 0);
+      assert_true(stats.collections > stats.full_collections);
+    }
+  }
+}
+
+test_group ("heap: large old objects reuse swept space") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (uint32_t workers : {1u, 3u}) {
+    // Each table is larger than half of eden, so it is allocated old.
+    Runtime runtime(classes.get_path(), 0, size_t(6) << 20,
+                    size_t(1) << 20);
+    runtime.vm.get_heap().set_parallel_gc_threads(workers);
+    for (int round = 0; round < 8; ++round) {
+      assert_equal(runtime.call("table", 60000),
+                   int32_t(int64_t(60000) * 59999 / 2));
+      assert_true(runtime.thread.exception == nullptr);
+    }
+    assert_true(runtime.vm.get_heap().get_stats().full_collections > 0);
+  }
+}
+
+test_group ("heap: work-stealing deques hand out each object once") {
+  std::vector<Object *> storage(64);
+  WorkStealingDeque deque;
+  deque.init(storage.data(), 64);
+  auto object = [](uintptr_t i) {
+    return reinterpret_cast<Object *>((i + 1) * 8);
+  };
+  for (uintptr_t i = 0; i < 64; ++i) { assert_true(deque.push(object(i))); }
+  assert_true(not deque.push(object(64)), "the deque is full");
+  assert_true(deque.pop() == object(63), "the owner takes the newest");
+  assert_true(deque.steal() == object(0), "thieves take the oldest");
+  for (uintptr_t i = 62; i > 0; --i) { assert_true(deque.pop() == object(i)); }
+  assert_true(deque.pop() == nullptr);
+  assert_true(deque.steal() == nullptr);
+  assert_true(deque.is_empty());
+
+  // The owner pushes and pops while thieves steal: every object is taken
+  // exactly once.
+  constexpr uintptr_t count = 200000;
+  std::vector<Object *> buffer(1024);
+  deque.init(buffer.data(), 1024);
+  std::vector<std::atomic<uint8_t>> taken(count);
+  std::atomic<bool> done {false};
+  std::vector<std::thread> thieves;
+  for (int i = 0; i < 3; ++i) {
+    thieves.emplace_back([&] {
+      while (not done.load()) {
+        if (Object *stolen = deque.steal()) {
+          taken[reinterpret_cast<uintptr_t>(stolen) / 8 - 1] += 1;
+        }
+      }
+    });
+  }
+  for (uintptr_t i = 0; i < count; ++i) {
+    while (not deque.push(object(i))) {
+      if (Object *popped = deque.pop()) {
+        taken[reinterpret_cast<uintptr_t>(popped) / 8 - 1] += 1;
+      }
+    }
+    if (i % 3 == 0) {
+      if (Object *popped = deque.pop()) {
+        taken[reinterpret_cast<uintptr_t>(popped) / 8 - 1] += 1;
+      }
+    }
+  }
+  while (Object *popped = deque.pop()) {
+    taken[reinterpret_cast<uintptr_t>(popped) / 8 - 1] += 1;
+  }
+  done = true;
+  for (std::thread &thief : thieves) { thief.join(); }
+  size_t once = 0;
+  for (auto const &times : taken) { once += times.load() == 1 ? 1 : 0; }
+  assert_equal(once, size_t(count));
+}
+
+test_group ("heap: workers run a task once each") {
+  GcWorkers workers;
+  workers.set_count(4);
+  std::vector<std::atomic<uint32_t>> calls(4);
+  auto task = [&](uint32_t worker) { calls[worker] += 1; };
+  for (int round = 0; round < 100; ++round) { workers.run(task); }
+  for (auto const &count : calls) { assert_equal(count.load(), 100u); }
+  workers.set_count(8);
+  assert_equal(workers.get_count(), 4u, "the count is fixed once started");
+}
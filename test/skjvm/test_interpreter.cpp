@@ -0,0 +1,528 @@
+#include <sktest/test.hpp>
+
+#include "temporary_directory.hpp"
+#include "test_vm.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace skjvm;
+
+namespace {
+  /// `app/Calc`, whose static methods exercise the instruction set, and
+  /// the classes they use.
+  auto write_classes(TemporaryDirectory const &directory) -> bool {
+    ClassWriter calc("app/Calc");
+
+    // int sum(int n): 0 + 1 + ... + n - 1.
+    CodeWriter sum(calc);
+    Label sum_loop = sum.new_label();
+    Label sum_end = sum.new_label();
+    sum.set_max(2, 3)
+       .iconst(0).local(Opcode::istore, 2)
+       .iconst(0).local(Opcode::istore, 1)
+       .bind(sum_loop)
+       .local(Opcode::iload, 1).local(Opcode::iload, 0)
+       .jump(Opcode::if_icmpge, sum_end)
+       .local(Opcode::iload, 2).local(Opcode::iload, 1).op(Opcode::iadd)
+       .local(Opcode::istore, 2)
+       .iinc(1, 1)
+       .jump(Opcode::goto_, sum_loop)
+       .bind(sum_end)
+       .local(Opcode::iload, 2).op(Opcode::ireturn);
+    static_method(calc, "sum", "(I)I", sum);
+
+    // int fib(int n), recursively.
+    CodeWriter fib(calc);
+    Label fib_recurse = fib.new_label();
+    fib.set_max(3, 1)
+       .local(Opcode::iload, 0).iconst(2)
+       .jump(Opcode::if_icmpge, fib_recurse)
+       .local(Opcode::iload, 0).op(Opcode::ireturn)
+       .bind(fib_recurse)
+       .local(Opcode::iload, 0).iconst(1).op(Opcode::isub)
+       .invoke(Opcode::invokestatic, "app/Calc", "fib", "(I)I")
+       .local(Opcode::iload, 0).iconst(2).op(Opcode::isub)
+       .invoke(Opcode::invokestatic, "app/Calc", "fib", "(I)I")
+       .op(Opcode::iadd).op(Opcode::ireturn);
+    static_method(calc, "fib", "(I)I", fib);
+
+    // long mix(long x): (x << 3) * x - (x >>> 1), wrapping around.
+    CodeWriter mix(calc);
+    mix.set_max(5, 2)
+       .local(Opcode::lload, 0).iconst(3).op(Opcode::lshl)
+       .local(Opcode::lload, 0).op(Opcode::lmul)
+       .local(Opcode::lload, 0).iconst(1).op(Opcode::lushr)
+       .op(Opcode::lsub).op(Opcode::lreturn);
+    static_method(calc, "mix", "(J)J", mix);
+
+    // int doubles(): (int) ((1.5 + 2.5) * (1.5 + 2.5)), with dup2.
+    CodeWriter doubles(calc);
+    doubles.set_max(4, 0)
+           .dconst(1.5).dconst(2.5).op(Opcode::dadd)
+           .op(Opcode::dup2).op(Opcode::dmul)
+           .op(Opcode::d2i).op(Opcode::ireturn);
+    static_method(calc, "doubles", "()I", doubles);
+
+    // int saturate(): (int) NaN + (int) 1e20f.
+    CodeWriter saturate(calc);
+    saturate.set_max(3, 0)
+            .fconst(0).fconst(0).op(Opcode::fdiv).op(Opcode::f2i)
+            .fconst(1e20f).op(Opcode::f2i)
+            .op(Opcode::iadd).op(Opcode::ireturn);
+    static_method(calc, "saturate", "()I", saturate);
+
+    // int divide(int a, int b) and its guarded version, -1 on / by zero.
+    CodeWriter divide(calc);
+    divide.set_max(2, 2)
+          .local(Opcode::iload, 0).local(Opcode::iload, 1)
+          .op(Opcode::idiv).op(Opcode::ireturn);
+    static_method(calc, "divide", "(II)I", divide);
+    CodeWriter safe(calc);
+    Label safe_start = safe.new_label();
+    Label safe_end = safe.new_label();
+    Label safe_handler = safe.new_label();
+    safe.set_max(2, 2)
+        .bind(safe_start)
+        .local(Opcode::iload, 0).local(Opcode::iload, 1)
+        .op(Opcode::idiv).op(Opcode::ireturn)
+        .bind(safe_end)
+        .bind(safe_handler)
+        .op(Opcode::pop).iconst(-1).op(Opcode::ireturn)
+        .handler(safe_start, safe_end, safe_handler,
+                 "java/lang/ArithmeticException");
+    static_method(calc, "safeDivide", "(II)I", safe);
+
+    // int squares(int n): the sum of an array filled with i * i.
+    CodeWriter squares(calc);
+    Label fill = squares.new_label();
+    Label filled = squares.new_label();
+    Label add = squares.new_label();
+    Label added = squares.new_label();
+    squares.set_max(4, 4)
+           .local(Opcode::iload, 0).newarray(10).local(Opcode::astore, 1)
+           .iconst(0).local(Opcode::istore, 2)
+           .bind(fill)
+           .local(Opcode::iload, 2).local(Opcode::iload, 0)
+           .jump(Opcode::if_icmpge, filled)
+           .local(Opcode::aload, 1).local(Opcode::iload, 2)
+           .local(Opcode::iload, 2).local(Opcode::iload, 2).op(Opcode::imul)
+           .op(Opcode::iastore)
+           .iinc(2, 1)
+           .jump(Opcode::goto_, fill)
+           .bind(filled)
+           .iconst(0).local(Opcode::istore, 3)
+           .iconst(0).local(Opcode::istore, 2)
+           .bind(add)
+           .local(Opcode::iload, 2).local(Opcode::aload, 1)
+           .op(Opcode::arraylength)
+           .jump(Opcode::if_icmpge, added)
+           .local(Opcode::iload, 3).local(Opcode::aload, 1)
+           .local(Opcode::iload, 2).op(Opcode::iaload).op(Opcode::iadd)
+           .local(Opcode::istore, 3)
+           .iinc(2, 1)
+           .jump(Opcode::goto_, add)
+           .bind(added)
+           .local(Opcode::iload, 3).op(Opcode::ireturn);
+    static_method(calc, "squares", "(I)I", squares);
+
+    // int outOfBounds(): new int[3][3].
+    CodeWriter bounds(calc);
+    bounds.set_max(2, 0)
+          .iconst(3).newarray(10).iconst(3).op(Opcode::iaload)
+          .op(Opcode::ireturn);
+    static_method(calc, "outOfBounds", "()I", bounds);
+
+    // int table(int key) and int lookup(int key).
+    CodeWriter table(calc);
+    Label table_default = table.new_label();
+    Label table_targets[] {table.new_label(), table.new_label(),
+                           table.new_label()};
+    table.set_max(1, 1)
+         .local(Opcode::iload, 0)
+         .tableswitch(0, 2, table_default, table_targets);
+    for (int i = 0; i < 3; ++i) {
+      table.bind(table_targets[i]).iconst(10 * (i + 1)).op(Opcode::ireturn);
+    }
+    table.bind(table_default).iconst(-1).op(Opcode::ireturn);
+    static_method(calc, "table", "(I)I", table);
+
+    CodeWriter lookup(calc);
+    Label lookup_default = lookup.new_label();
+    Label lookup_targets[] {lookup.new_label(), lookup.new_label(),
+                            lookup.new_label()};
+    int32_t const keys[] {-5, 100, 1000};
+    lookup.set_max(1, 1)
+          .local(Opcode::iload, 0)
+          .lookupswitch(lookup_default, keys, lookup_targets, 3);
+    for (int i = 0; i < 3; ++i) {
+      lookup.bind(lookup_targets[i]).iconst(i + 1).op(Opcode::ireturn);
+    }
+    lookup.bind(lookup_default).iconst(0).op(Opcode::ireturn);
+    static_method(calc, "lookup", "(I)I", lookup);
+
+    // int strings(): "hello".length(), plus 100 if literals are interned.
+    CodeWriter strings(calc);
+    Label different = strings.new_label();
+    strings.set_max(2, 1)
+           .ldc_string("hello")
+           .invoke(Opcode::invokevirtual, "java/lang/String", "length", "()I")
+           .local(Opcode::istore, 0)
+           .ldc_string("hello").ldc_string("hello")
+           .jump(Opcode::if_acmpne, different)
+           .iinc(0, 100)
+           .bind(different)
+           .local(Opcode::iload, 0).op(Opcode::ireturn);
+    static_method(calc, "strings", "()I", strings);
+
+    // int area(): ((Shape) new Circle()).area(), and the same through the
+    // interface `app/Sized`.
+    CodeWriter area(calc);
+    area.set_max(2, 0)
+        .type(Opcode::new_, "app/Circle").op(Opcode::dup)
+        .invoke(Opcode::invokespecial, "app/Circle", "<init>", "()V")
+        .invoke(Opcode::invokevirtual, "app/Shape", "area", "()I")
+        .op(Opcode::ireturn);
+    static_method(calc, "area", "()I", area);
+    CodeWriter sized(calc);
+    sized.set_max(2, 0)
+         .type(Opcode::new_, "app/Circle").op(Opcode::dup)
+         .invoke(Opcode::invokespecial, "app/Circle", "<init>", "()V")
+         .invoke(Opcode::invokeinterface, "app/Sized", "size", "()I")
+         .op(Opcode::ireturn);
+    static_method(calc, "sized", "()I", sized);
+
+    // int shapeArea(Shape shape): shape.area(), at one call site.
+    CodeWriter shape_area_call(calc);
+    shape_area_call.set_max(1, 1)
+                   .local(Opcode::aload, 0)
+                   .invoke(Opcode::invokevirtual, "app/Shape", "area", "()I")
+                   .op(Opcode::ireturn);
+    static_method(calc, "shapeArea", "(Lapp/Shape;)I", shape_area_call);
+
+    // int fields(): stores then loads fields of each size of an
+    // `app/Point`, 5 + 7 - 1.
+    CodeWriter fields(calc);
+    fields.set_max(4, 1)
+          .type(Opcode::new_, "app/Point").op(Opcode::dup)
+          .invoke(Opcode::invokespecial, "app/Point", "<init>", "()V")
+          .local(Opcode::astore, 0)
+          .local(Opcode::aload, 0).iconst(5)
+          .field(Opcode::putfield, "app/Point", "x", "I")
+          .local(Opcode::aload, 0).lconst(7)
+          .field(Opcode::putfield, "app/Point", "y", "J")
+          .local(Opcode::aload, 0).iconst(-1)
+          .field(Opcode::putfield, "app/Point", "b", "B")
+          .local(Opcode::aload, 0).local(Opcode::aload, 0)
+          .field(Opcode::putfield, "app/Point", "self", "Lapp/Point;")
+          .local(Opcode::aload, 0)
+          .field(Opcode::getfield, "app/Point", "self", "Lapp/Point;")
+          .field(Opcode::getfield, "app/Point", "x", "I")
+          .local(Opcode::aload, 0)
+          .field(Opcode::getfield, "app/Point", "y", "J")
+          .op(Opcode::l2i).op(Opcode::iadd)
+          .local(Opcode::aload, 0)
+          .field(Opcode::getfield, "app/Point", "b", "B")
+          .op(Opcode::iadd).op(Opcode::ireturn);
+    static_method(calc, "fields", "()I", fields);
+
+    // int counter(): a static field set by a static initializer.
+    CodeWriter counter(calc);
+    counter.set_max(1, 0)
+           .field(Opcode::getstatic, "app/Counter", "value", "I")
+           .op(Opcode::ireturn);
+    static_method(calc, "counter", "()I", counter);
+
+    // void recurse(), forever, and int catchOverflow(), 1 when it stops.
+    CodeWriter recurse(calc);
+    recurse.set_max(0, 0)
+           .invoke(Opcode::invokestatic, "app/Calc", "recurse", "()V")
+           .op(Opcode::return_);
+    static_method(calc, "recurse", "()V", recurse);
+    CodeWriter overflow(calc);
+    Label overflow_start = overflow.new_label();
+    Label overflow_end = overflow.new_label();
+    overflow.set_max(1, 0)
+            .bind(overflow_start)
+            .invoke(Opcode::invokestatic, "app/Calc", "recurse", "()V")
+            .iconst(0).op(Opcode::ireturn)
+            .bind(overflow_end)
+            .op(Opcode::pop).iconst(1).op(Opcode::ireturn)
+            .handler(overflow_start, overflow_end, overflow_end,
+                     "java/lang/StackOverflowError");
+    static_method(calc, "catchOverflow", "()I", overflow);
+
+    // void fallsOff(), which the decoder rejects.
+    CodeWriter falls_off(calc);
+    falls_off.set_max(1, 0).iconst(0).op(Opcode::pop);
+    static_method(calc, "fallsOff", "()V", falls_off);
+
+    ClassWriter sized_interface("app/Sized", "java/lang/Object",
+                                access::public_ | access::interface |
+                                access::abstract);
+    sized_interface.add_method(access::public_ | access::abstract, "size",
+                               "()I", nullptr);
+
+    ClassWriter shape("app/Shape");
+    CodeWriter shape_init(shape);
+    shape_init.set_max(1, 1)
+              .local(Opcode::aload, 0)
+              .invoke(Opcode::invokespecial, "java/lang/Object", "<init>",
+                      "()V")
+              .op(Opcode::return_);
+    shape.add_method(access::public_, "<init>", "()V", &shape_init);
+    CodeWriter shape_area(shape);
+    shape_area.set_max(1, 1).iconst(0).op(Opcode::ireturn);
+    shape.add_method(access::public_, "area", "()I", &shape_area);
+
+    ClassWriter circle("app/Circle", "app/Shape");
+    circle.add_interface("app/Sized");
+    CodeWriter circle_init(circle);
+    circle_init.set_max(1, 1)
+               .local(Opcode::aload, 0)
+               .invoke(Opcode::invokespecial, "app/Shape", "<init>", "()V")
+               .op(Opcode::return_);
+    circle.add_method(access::public_, "<init>", "()V", &circle_init);
+    CodeWriter circle_area(circle);
+    circle_area.set_max(1, 1).iconst(3).op(Opcode::ireturn);
+    circle.add_method(access::public_, "area", "()I", &circle_area);
+    CodeWriter circle_size(circle);
+    circle_size.set_max(1, 1).iconst(7).op(Opcode::ireturn);
+    circle.add_method(access::public_, "size", "()I", &circle_size);
+
+    ClassWriter counter_class("app/Counter");
+    counter_class.add_field(access::public_ | access::static_, "value", "I");
+    CodeWriter initializer(counter_class);
+    initializer.set_max(1, 0)
+               .iconst(42)
+               .field(Opcode::putstatic, "app/Counter", "value", "I")
+               .op(Opcode::return_);
+    counter_class.add_method(access::static_, "<clinit>", "()V",
+                             &initializer);
+
+    ClassWriter point("app/Point");
+    point.add_field(access::public_, "x", "I");
+    point.add_field(access::public_, "y", "J");
+    point.add_field(access::public_, "b", "B");
+    point.add_field(access::public_, "self", "Lapp/Point;");
+    CodeWriter point_init(point);
+    point_init.set_max(1, 1)
+              .local(Opcode::aload, 0)
+              .invoke(Opcode::invokespecial, "java/lang/Object", "<init>",
+                      "()V")
+              .op(Opcode::return_);
+    point.add_method(access::public_, "<init>", "()V", &point_init);
+
+    return directory.write_class(calc, "app/Calc") and
+           directory.write_class(point, "app/Point") and
+           directory.write_class(sized_interface, "app/Sized") and
+           directory.write_class(shape, "app/Shape") and
+           directory.write_class(circle, "app/Circle") and
+           directory.write_class(counter_class, "app/Counter");
+  }
+
+  /// The VM of one run, with `app/Calc` linked.
+  struct Runtime : TestVM {
+    Klass *calc {nullptr};
+
+    Runtime(std::string const &path, DispatchMode mode) : TestVM(path) {
+      vm.set_dispatch_mode(mode);
+      calc = klass("app/Calc");
+    }
+
+    /// Call the static method \p name of `app/Calc` with int \p arguments.
+    auto call(char const *name, char const *descriptor,
+              std::vector<int32_t> const &arguments = {}) -> Value {
+      return TestVM::call(calc, name, descriptor, arguments);
+    }
+  };
+
+  std::vector<DispatchMode> const modes {
+    DispatchMode::threaded, DispatchMode::switch_, DispatchMode::counting,
+  };
+} // namespace
+
+test_group ("interpreter: arithmetic, loops and calls in every mode") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (DispatchMode mode : modes) {
+    Runtime runtime(classes.get_path(), mode);
+    assert_true(runtime.calc != nullptr);
+
+    assert_equal(runtime.call("sum", "(I)I", {100}).i, 4950);
+    assert_equal(runtime.call("sum", "(I)I", {0}).i, 0);
+    assert_equal(runtime.call("fib", "(I)I", {20}).i, 6765);
+
+    int64_t x = 123456789012;
+    auto expected = int64_t((uint64_t(x) << 3) * uint64_t(x) -
+                            (uint64_t(x) >> 1));
+    Value *locals = runtime.thread.get_stack_base();
+    locals[0].j = x;
+    Method *mix = runtime.calc->find_method(view("mix"), view("(J)J"));
+    assert_equal(runtime.vm.invoke(runtime.thread, *mix, locals).j, expected,
+                 "long arithmetic wraps around like Java");
+
+    assert_equal(runtime.call("doubles", "()I").i, 16);
+    assert_equal(runtime.call("saturate", "()I").i, INT32_MAX,
+                 "NaN converts to 0 and large floats saturate");
+    assert_equal(runtime.call("divide", "(II)I", {-7, 2}).i, -3);
+    assert_equal(runtime.call("divide", "(II)I", {INT32_MIN, -1}).i,
+                 INT32_MIN);
+    assert_true(runtime.thread.exception == nullptr);
+  }
+}
+
+test_group ("interpreter: arrays, switches, strings and statics") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (DispatchMode mode : modes) {
+    Runtime runtime(classes.get_path(), mode);
+
+    assert_equal(runtime.call("squares", "(I)I", {10}).i, 285);
+    assert_equal(runtime.call("table", "(I)I", {0}).i, 10);
+    assert_equal(runtime.call("table", "(I)I", {2}).i, 30);
+    assert_equal(runtime.call("table", "(I)I", {3}).i, -1);
+    assert_equal(runtime.call("table", "(I)I", {-1}).i, -1);
+    assert_equal(runtime.call("lookup", "(I)I", {-5}).i, 1);
+    assert_equal(runtime.call("lookup", "(I)I", {1000}).i, 3);
+    assert_equal(runtime.call("lookup", "(I)I", {7}).i, 0);
+    assert_equal(runtime.call("strings", "()I").i, 105,
+                 "literals are interned strings");
+    assert_equal(runtime.call("counter", "()I").i, 42,
+                 "the static initializer runs before the first access");
+    Klass *counter = runtime.registry.find(view("app/Counter"));
+    assert_true(counter != nullptr and
+                counter->state == ClassState::initialized);
+  }
+}
+
+test_group ("interpreter: virtual and interface calls") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (DispatchMode mode : modes) {
+    Runtime runtime(classes.get_path(), mode);
+    assert_equal(runtime.call("area", "()I").i, 3,
+                 "invokevirtual through the super class runs the override");
+    assert_equal(runtime.call("sized", "()I").i, 7);
+    assert_true(runtime.thread.exception == nullptr);
+  }
+}
+
+test_group ("interpreter: exceptions unwind to handlers or the caller") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (DispatchMode mode : modes) {
+    Runtime runtime(classes.get_path(), mode);
+
+    (void)runtime.call("divide", "(II)I", {1, 0});
+    assert_true(runtime.thrown("java/lang/ArithmeticException"));
+    assert_equal(runtime.message(), "/ by zero");
+    assert_equal(runtime.call("safeDivide", "(II)I", {1, 0}).i, -1);
+    assert_true(runtime.thread.exception == nullptr,
+                "a handler clears the exception");
+    assert_equal(runtime.call("safeDivide", "(II)I", {9, 3}).i, 3);
+
+    (void)runtime.call("outOfBounds", "()I");
+    assert_true(runtime.thrown("java/lang/ArrayIndexOutOfBoundsException"));
+    assert_equal(runtime.message(), "Index 3 out of bounds for length 3");
+
+    (void)runtime.call("recurse", "()V");
+    assert_true(runtime.thrown("java/lang/StackOverflowError"));
+    assert_equal(runtime.thread.depth, 0u, "every frame was popped");
+    assert_equal(runtime.call("catchOverflow", "()I").i, 1);
+  }
+}
+
+test_group ("interpreter: resolved instructions are quickened") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (DispatchMode mode : modes) {
+    Runtime runtime(classes.get_path(), mode);
+    assert_equal(runtime.call("fields", "()I").i, 11);
+    assert_equal(runtime.call("fields", "()I").i, 11,
+                 "quick instructions behave the same");
+    assert_equal(runtime.call("counter", "()I").i, 42);
+
+    Method *fields = runtime.calc->find_method(view("fields"), view("()I"));
+    DecodedMethod const *decoded = fields->decoded;
+    assert_true(decoded != nullptr);
+    uint32_t quick_count = 0;
+    for (uint32_t i = 0; i < decoded->length; ++i) {
+      Opcode opcode = decoded->code[i].opcode;
+      assert_true(opcode != Opcode::getfield and opcode != Opcode::putfield and
+                  opcode != Opcode::new_ and
+                  opcode != Opcode::invokespecial);
+      quick_count += uint8_t(opcode) >= opcode_limit;
+    }
+    assert_equal(quick_count, 10u);
+    assert_true(decoded->code[0].opcode == quick::new_);
+  }
+}
+
+test_group ("interpreter: virtual call sites cache one receiver class") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (DispatchMode mode : modes) {
+    Runtime runtime(classes.get_path(), mode);
+    VM &vm = runtime.vm;
+    Thread &thread = runtime.thread;
+    LinkError error = LinkError::none;
+    Klass *shape = runtime.registry.link(view("app/Shape"), error);
+    Klass *circle = runtime.registry.link(view("app/Circle"), error);
+    assert_true(shape != nullptr and circle != nullptr);
+    Object *a_shape = vm.new_object(thread, *shape);
+    Object *a_circle = vm.new_object(thread, *circle);
+    Method *call = runtime.calc->find_method(view("shapeArea"),
+                                             view("(Lapp/Shape;)I"));
+    auto area_of = [&](Object *receiver) {
+      thread.get_stack_base()[0].l = receiver;
+      return vm.invoke(thread, *call, thread.get_stack_base()).i;
+    };
+
+    assert_equal(area_of(a_circle), 3);
+    assert_equal(area_of(a_circle), 3);
+    assert_equal(area_of(a_circle), 3);
+    assert_equal(thread.inline_cache_misses, uint64_t(1),
+                 "the first call fills the cache");
+    assert_equal(thread.inline_cache_hits, uint64_t(2));
+    assert_equal(vm.get_inline_cache_stats().megamorphic_sites, uint64_t(0));
+
+    assert_equal(area_of(a_shape), 0,
+                 "another receiver class misses and calls its own method");
+    assert_equal(area_of(a_circle), 3);
+    assert_equal(thread.inline_cache_misses, uint64_t(3),
+                 "a megamorphic site always looks the method up");
+    assert_equal(thread.inline_cache_hits, uint64_t(2));
+    assert_equal(vm.get_inline_cache_stats().megamorphic_sites, uint64_t(1));
+
+    // Interface calls through the itable.
+    assert_equal(runtime.call("sized", "()I").i, 7);
+    assert_equal(runtime.call("sized", "()I").i, 7);
+    assert_true(circle->itable != nullptr);
+    assert_equal(circle->itable->length, 1u);
+  }
+}
+
+test_group ("interpreter: malformed code is rejected when first called") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  Runtime runtime(classes.get_path(), DispatchMode::threaded);
+  (void)runtime.call("fallsOff", "()V");
+  assert_true(runtime.thrown("java/lang/VerifyError"),
+              "code may not run past its end");
+  assert_equal(runtime.message(), "Bad code in app/Calc.fallsOff()V");
+}
+
+test_group ("interpreter: counting mode counts executed instructions") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  Runtime runtime(classes.get_path(), DispatchMode::counting);
+  assert_equal(runtime.call("sum", "(I)I", {10}).i, 45);
+  // 4 to start, 9 per iteration, 3 for the last test and 2 to return.
+  assert_equal(runtime.thread.executed, uint64_t(4 + 9 * 10 + 3 + 2));
+
+  Runtime threaded(classes.get_path(), DispatchMode::threaded);
+  (void)threaded.call("sum", "(I)I", {10});
+  assert_equal(threaded.thread.executed, uint64_t(0));
+}
@@ -0,0 +1,506 @@
+#include <sktest/test.hpp>
+
+#include "temporary_directory.hpp"
+#include "test_vm.hpp"
+
+#include <skjvm/monitor.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace skjvm;
+
+namespace {
+  /// A header as \c init_header leaves it, with some age, which locking
+  /// keeps.
+  constexpr uintptr_t fresh_mark = uintptr_t(0x1234) << mark_word::klass_shift |
+                                   uintptr_t(5) << mark_word::age_shift;
+
+  auto lock_state(Object const &object) -> uintptr_t {
+    return object.mark & mark_word::lock_mask;
+  }
+
+  /// `app/Locks`, whose static `count` its methods increment under locks
+  /// of every kind.
+  auto write_classes(TemporaryDirectory const &directory) -> bool {
+    ClassWriter locks("app/Locks");
+    locks.add_field(access::public_ | access::static_, "count", "I");
+    locks.add_field(access::public_ | access::static_, "turn", "I");
+    CodeWriter init(locks);
+    init.set_max(1, 1)
+        .local(Opcode::aload, 0)
+        .invoke(Opcode::invokespecial, "java/lang/Object", "<init>", "()V")
+        .op(Opcode::return_);
+    locks.add_method(access::public_, "<init>", "()V", &init);
+
+    auto increment = [](CodeWriter &code) -> CodeWriter & {
+      return code.field(Opcode::getstatic, "app/Locks", "count", "I")
+                 .iconst(1).op(Opcode::iadd)
+                 .field(Opcode::putstatic, "app/Locks", "count", "I");
+    };
+
+    // void add(Object lock, int n): n increments, each in a block
+    // synchronized on lock.
+    CodeWriter add(locks);
+    Label add_loop = add.new_label();
+    Label add_end = add.new_label();
+    add.set_max(2, 2)
+       .bind(add_loop)
+       .local(Opcode::iload, 1).jump(Opcode::ifle, add_end)
+       .local(Opcode::aload, 0).op(Opcode::monitorenter);
+    increment(add)
+       .local(Opcode::aload, 0).op(Opcode::monitorexit)
+       .iinc(1, -1)
+       .jump(Opcode::goto_, add_loop)
+       .bind(add_end)
+       .op(Opcode::return_);
+    static_method(locks, "add", "(Ljava/lang/Object;I)V", add);
+
+    // static synchronized void bump(), and void bumps(int n), which calls
+    // it n times.
+    CodeWriter bump(locks);
+    increment(bump.set_max(2, 0)).op(Opcode::return_);
+    static_method(locks, "bump", "()V", bump, access::synchronized);
+
+    CodeWriter bumps(locks);
+    Label bumps_loop = bumps.new_label();
+    Label bumps_end = bumps.new_label();
+    bumps.set_max(1, 1)
+         .bind(bumps_loop)
+         .local(Opcode::iload, 0).jump(Opcode::ifle, bumps_end)
+         .invoke(Opcode::invokestatic, "app/Locks", "bump", "()V")
+         .iinc(0, -1)
+         .jump(Opcode::goto_, bumps_loop)
+         .bind(bumps_end)
+         .op(Opcode::return_);
+    static_method(locks, "bumps", "(I)V", bumps);
+
+    // synchronized void touch(), and void touches(Locks self, int n).
+    CodeWriter touch(locks);
+    increment(touch.set_max(2, 1)).op(Opcode::return_);
+    locks.add_method(access::public_ | access::synchronized, "touch", "()V",
+                     &touch);
+
+    CodeWriter touches(locks);
+    Label touches_loop = touches.new_label();
+    Label touches_end = touches.new_label();
+    touches.set_max(1, 2)
+           .bind(touches_loop)
+           .local(Opcode::iload, 1).jump(Opcode::ifle, touches_end)
+           .local(Opcode::aload, 0)
+           .invoke(Opcode::invokevirtual, "app/Locks", "touch", "()V")
+           .iinc(1, -1)
+           .jump(Opcode::goto_, touches_loop)
+           .bind(touches_end)
+           .op(Opcode::return_);
+    static_method(locks, "touches", "(Lapp/Locks;I)V", touches);
+
+    // int nest(Object lock, int n): enters lock n times, then exits it as
+    // many times.
+    CodeWriter nest(locks);
+    Label enter_loop = nest.new_label();
+    Label entered = nest.new_label();
+    Label exit_loop = nest.new_label();
+    Label exited = nest.new_label();
+    nest.set_max(1, 3)
+        .local(Opcode::iload, 1).local(Opcode::istore, 2)
+        .bind(enter_loop)
+        .local(Opcode::iload, 2).jump(Opcode::ifle, entered)
+        .local(Opcode::aload, 0).op(Opcode::monitorenter)
+        .iinc(2, -1)
+        .jump(Opcode::goto_, enter_loop)
+        .bind(entered)
+        .local(Opcode::iload, 1).local(Opcode::istore, 2)
+        .bind(exit_loop)
+        .local(Opcode::iload, 2).jump(Opcode::ifle, exited)
+        .local(Opcode::aload, 0).op(Opcode::monitorexit)
+        .iinc(2, -1)
+        .jump(Opcode::goto_, exit_loop)
+        .bind(exited)
+        .iconst(1).op(Opcode::ireturn);
+    static_method(locks, "nest", "(Ljava/lang/Object;I)I", nest);
+
+    // int hashed(Object lock): 1 if the identity hash of lock is the same
+    // before, while and after it is locked.
+    CodeWriter hashed(locks);
+    Label changed = hashed.new_label();
+    auto hash = [](CodeWriter &code) -> CodeWriter & {
+      return code.local(Opcode::aload, 0)
+                 .invoke(Opcode::invokestatic, "java/lang/System",
+                         "identityHashCode", "(Ljava/lang/Object;)I");
+    };
+    hash(hashed.set_max(2, 2)).local(Opcode::istore, 1)
+          .local(Opcode::aload, 0).op(Opcode::monitorenter);
+    hash(hashed).local(Opcode::iload, 1).jump(Opcode::if_icmpne, changed)
+          .local(Opcode::aload, 0).op(Opcode::monitorexit);
+    hash(hashed).local(Opcode::iload, 1).jump(Opcode::if_icmpne, changed)
+          .iconst(1).op(Opcode::ireturn)
+          .bind(changed)
+          .iconst(0).op(Opcode::ireturn);
+    static_method(locks, "hashed", "(Ljava/lang/Object;)I", hashed);
+
+    // void unlock(Object lock), void await(Object lock), which do not hold
+    // lock, and static synchronized void fail(), which throws.
+    CodeWriter unlock(locks);
+    unlock.set_max(1, 1)
+          .local(Opcode::aload, 0).op(Opcode::monitorexit)
+          .op(Opcode::return_);
+    static_method(locks, "unlock", "(Ljava/lang/Object;)V", unlock);
+
+    CodeWriter await(locks);
+    await.set_max(1, 1)
+         .local(Opcode::aload, 0)
+         .invoke(Opcode::invokevirtual, "java/lang/Object", "wait", "()V")
+         .op(Opcode::return_);
+    static_method(locks, "await", "(Ljava/lang/Object;)V", await);
+
+    CodeWriter fail(locks);
+    fail.set_max(1, 0).op(Opcode::aconst_null).op(Opcode::athrow);
+    static_method(locks, "fail", "()V", fail, access::synchronized);
+
+    // void play(Object lock, int me, int rounds): waits for `turn` to be
+    // me, then hands it to the other player, rounds times.
+    CodeWriter play(locks);
+    Label round = play.new_label();
+    Label check = play.new_label();
+    Label go = play.new_label();
+    Label done = play.new_label();
+    play.set_max(2, 3)
+        .bind(round)
+        .local(Opcode::iload, 2).jump(Opcode::ifle, done)
+        .local(Opcode::aload, 0).op(Opcode::monitorenter)
+        .bind(check)
+        .field(Opcode::getstatic, "app/Locks", "turn", "I")
+        .local(Opcode::iload, 1).jump(Opcode::if_icmpeq, go)
+        .local(Opcode::aload, 0)
+        .invoke(Opcode::invokevirtual, "java/lang/Object", "wait", "()V")
+        .jump(Opcode::goto_, check)
+        .bind(go)
+        .iconst(1).local(Opcode::iload, 1).op(Opcode::isub)
+        .field(Opcode::putstatic, "app/Locks", "turn", "I")
+        .local(Opcode::aload, 0)
+        .invoke(Opcode::invokevirtual, "java/lang/Object", "notifyAll",
+                "()V")
+        .local(Opcode::aload, 0).op(Opcode::monitorexit)
+        .iinc(2, -1)
+        .jump(Opcode::goto_, round)
+        .bind(done)
+        .op(Opcode::return_);
+    static_method(locks, "play", "(Ljava/lang/Object;II)V", play);
+
+    return directory.write_class(locks, "app/Locks");
+  }
+
+  /// The VM of one run, with `app/Locks` linked and initialized, and
+  /// compiled once called \p threshold times, or never with 0.
+  struct Runtime : TestVM {
+    Klass *locks {nullptr};
+    Klass *object_class {nullptr};
+    uint32_t count_offset {0};
+
+    Runtime(std::string const &path, uint32_t threshold) : TestVM(path) {
+      set_compile_threshold(threshold);
+      locks = klass("app/Locks");
+      object_class = klass("java/lang/Object");
+      if (locks != nullptr and vm.initialize(thread, *locks)) {
+        count_offset = locks->find_field(view("count"), view("I"))->offset;
+      }
+    }
+
+    /// Call the static method \p name of `app/Locks` on \p on.
+    auto call(Thread &on, char const *name, char const *descriptor,
+              std::initializer_list<Value> arguments) -> int32_t {
+      on.exception = nullptr;
+      Method *called = locks->find_method(view(name), view(descriptor));
+      Value *stack = on.get_stack_base();
+      for (Value argument : arguments) {
+        *stack = argument;
+        stack += 1;
+      }
+      return vm.invoke(on, *called, on.get_stack_base()).i;
+    }
+
+    auto call(char const *name, char const *descriptor,
+              std::initializer_list<Value> arguments) -> int32_t {
+      return call(thread, name, descriptor, arguments);
+    }
+
+    auto count() -> int32_t & {
+      return *reinterpret_cast<int32_t *>(locks->static_storage +
+                                          count_offset);
+    }
+  };
+
+  auto reference(Object *object) -> Value {
+    Value value {};
+    value.l = object;
+    return value;
+  }
+
+  auto integer(int32_t i) -> Value {
+    Value value {};
+    value.i = i;
+    return value;
+  }
+} // namespace
+
+test_group ("monitor: thin locks live in the header") {
+  Monitors monitors;
+  Object object {fresh_mark};
+  monitors.enter(1, &object);
+  assert_equal(lock_state(object), mark_word::thin_locked);
+  assert_equal(object.mark & ~mark_word::recursion_mask,
+               fresh_mark | Monitors::thin_lock(1));
+  assert_true(monitors.holds(1, &object));
+  assert_true(not monitors.holds(2, &object));
+
+  // Recursive entries are counted in the header.
+  monitors.enter(1, &object);
+  monitors.enter(1, &object);
+  assert_equal(lock_state(object), mark_word::thin_locked);
+  assert_true(not monitors.exit(2, &object), "only the owner unlocks");
+  for (int i = 0; i < 3; ++i) { assert_true(monitors.exit(1, &object)); }
+  assert_equal(object.mark, fresh_mark, "the header is as it was");
+  assert_true(not monitors.exit(1, &object), "no longer held");
+  assert_true(not monitors.holds(1, &object));
+  assert_equal(monitors.get_stats().inflations, uint64_t(0));
+}
+
+test_group ("monitor: deep recursion and hashes inflate") {
+  Monitors monitors;
+  Object object {fresh_mark};
+  uint32_t entries = mark_word::max_recursions + 10;
+  for (uint32_t i = 0; i < entries; ++i) { monitors.enter(3, &object); }
+  assert_equal(lock_state(object), mark_word::inflated);
+  assert_true(monitors.holds(3, &object));
+  for (uint32_t i = 0; i < entries; ++i) {
+    assert_true(monitors.exit(3, &object));
+  }
+  assert_equal(object.mark, fresh_mark, "deflated once released");
+
+  // A hash asked for while thin locked moves to the monitor, and back to
+  // the header when it is released.
+  monitors.enter(3, &object);
+  int32_t hash = monitors.identity_hash(&object);
+  assert_true(hash != 0);
+  assert_equal(lock_state(object), mark_word::inflated);
+  assert_true(monitors.holds(3, &object));
+  assert_true(monitors.exit(3, &object));
+  assert_equal(lock_state(object), mark_word::unlocked);
+  assert_equal(monitors.identity_hash(&object), hash);
+
+  // A hashed object is locked through a monitor, and keeps its hash.
+  monitors.enter(4, &object);
+  assert_equal(lock_state(object), mark_word::inflated);
+  assert_equal(monitors.identity_hash(&object), hash);
+  assert_true(monitors.exit(4, &object));
+  assert_equal(object.mark & ~mark_word::hash_mask, fresh_mark);
+  assert_equal(monitors.identity_hash(&object), hash);
+
+  MonitorStats stats = monitors.get_stats();
+  assert_equal(stats.inflations, uint64_t(3));
+  assert_equal(stats.deflations, uint64_t(3));
+  assert_equal(stats.in_use, uint64_t(0));
+}
+
+test_group ("monitor: contended locks exclude each other") {
+  Monitors monitors;
+  Object object {fresh_mark};
+  constexpr uint32_t thread_count = 4;
+  constexpr int32_t increments = 200000;
+  int32_t counter = 0;
+
+  // The first thread holds the lock until the others found it held.
+  monitors.enter(1, &object);
+  std::vector<std::thread> threads;
+  for (uint32_t id = 2; id < thread_count + 2; ++id) {
+    threads.emplace_back([&, id] {
+      for (int32_t i = 0; i < increments; ++i) {
+        monitors.enter(id, &object);
+        counter = counter + 1;
+        if (not monitors.exit(id, &object)) { return; }
+      }
+    });
+  }
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (monitors.get_stats().contended_enters == 0 and
+         std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+  assert_equal(lock_state(object), mark_word::inflated,
+               "inflated by the threads waiting");
+  assert_true(monitors.exit(1, &object));
+  for (std::thread &thread : threads) { thread.join(); }
+
+  assert_equal(counter, int32_t(thread_count) * increments);
+  MonitorStats stats = monitors.get_stats();
+  assert_true(stats.inflations >= 1);
+  assert_true(stats.contended_enters >= 1);
+  assert_true(stats.contended_enters >= stats.blocked_enters);
+  assert_equal(stats.inflations, stats.deflations);
+  assert_equal(stats.in_use, uint64_t(0));
+  assert_equal(object.mark, fresh_mark, "deflated once uncontended");
+}
+
+test_group ("monitor: waiting releases the lock until notified") {
+  Monitors monitors;
+  Object object {fresh_mark};
+  assert_true(not monitors.wait(1, &object, 0), "only the owner waits");
+  assert_true(not monitors.notify(1, &object, false));
+
+  // A timed wait returns by itself, holding the lock as many times.
+  monitors.enter(1, &object);
+  monitors.enter(1, &object);
+  assert_true(monitors.notify(1, &object, true), "nobody waits");
+  assert_true(monitors.wait(1, &object, 1));
+  assert_true(monitors.holds(1, &object));
+  assert_true(monitors.exit(1, &object));
+  assert_true(monitors.exit(1, &object));
+  assert_equal(object.mark, fresh_mark);
+
+  // Two threads hand a turn to each other.
+  constexpr int32_t rounds = 2000;
+  int32_t turn = 0;
+  auto player = [&](uint32_t id, int32_t me) {
+    for (int32_t i = 0; i < rounds; ++i) {
+      monitors.enter(id, &object);
+      while (turn != me) {
+        if (not monitors.wait(id, &object, 0)) { return; }
+      }
+      turn = 1 - me;
+      (void)monitors.notify(id, &object, i % 2 == 0);
+      if (not monitors.exit(id, &object)) { return; }
+    }
+  };
+  std::thread first(player, 2, 0);
+  std::thread second(player, 3, 1);
+  first.join();
+  second.join();
+  assert_equal(turn, 0);
+  MonitorStats stats = monitors.get_stats();
+  assert_true(stats.waits >= 1);
+  assert_true(stats.notifications >= 1);
+  assert_equal(stats.in_use, uint64_t(0));
+  assert_equal(object.mark, fresh_mark);
+}
+
+test_group ("monitor: synchronized code locks objects and classes") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (uint32_t threshold : {0u, 1u}) {
+    if (threshold != 0 and not Compiler::is_available()) { continue; }
+    Runtime runtime(classes.get_path(), threshold);
+    assert_true(runtime.locks != nullptr and runtime.object_class != nullptr);
+    VM &vm = runtime.vm;
+    Handle<Object> lock(runtime.thread,
+                        vm.new_object(runtime.thread, *runtime.object_class));
+    uintptr_t unlocked = lock->mark;
+
+    for (int i = 0; i < 3; ++i) {
+      runtime.call("add", "(Ljava/lang/Object;I)V",
+                   {reference(lock.get()), integer(100)});
+      runtime.call("bumps", "(I)V", {integer(100)});
+    }
+    assert_true(runtime.thread.exception == nullptr);
+    assert_equal(runtime.count(), 600);
+    assert_equal(lock->mark, unlocked);
+    assert_true(runtime.locks->lock != nullptr, "the class has its lock");
+    assert_equal(lock_state(*runtime.locks->lock), mark_word::unlocked);
+
+    assert_equal(runtime.call("nest", "(Ljava/lang/Object;I)I",
+                              {reference(lock.get()), integer(1000)}), 1);
+    assert_equal(lock->mark, unlocked);
+    assert_equal(runtime.call("hashed", "(Ljava/lang/Object;)I",
+                              {reference(lock.get())}), 1);
+    assert_true(runtime.thread.exception == nullptr);
+    assert_equal(lock->mark & ~mark_word::hash_mask, unlocked);
+
+    // Locks are released however methods complete, and only owners
+    // release them.
+    runtime.call("fail", "()V", {});
+    assert_true(runtime.thrown("java/lang/NullPointerException"));
+    assert_equal(lock_state(*runtime.locks->lock), mark_word::unlocked);
+    runtime.call("unlock", "(Ljava/lang/Object;)V", {reference(lock.get())});
+    assert_true(runtime.thrown("java/lang/IllegalMonitorStateException"));
+    runtime.call("await", "(Ljava/lang/Object;)V", {reference(lock.get())});
+    assert_true(runtime.thrown("java/lang/IllegalMonitorStateException"));
+
+    // Objects stay locked across collections, which move them.
+    Monitors &monitors = vm.get_monitors();
+    monitors.enter(runtime.thread.id, lock.get());
+    (void)monitors.identity_hash(lock.get());
+    Object *before = lock.get();
+    assert_true(vm.collect(runtime.thread));
+    assert_true(lock.get() != before);
+    assert_true(monitors.holds(runtime.thread.id, lock.get()));
+    assert_true(monitors.exit(runtime.thread.id, lock.get()));
+    assert_equal(monitors.get_stats().in_use, uint64_t(0));
+  }
+}
+
+test_group ("monitor: Java threads contend and wait") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  for (uint32_t threshold : {0u, 1u}) {
+    if (threshold != 0 and not Compiler::is_available()) { continue; }
+    Runtime runtime(classes.get_path(), threshold);
+    assert_true(runtime.locks != nullptr and runtime.object_class != nullptr);
+    VM &vm = runtime.vm;
+    Handle<Object> lock(runtime.thread,
+                        vm.new_object(runtime.thread, *runtime.object_class));
+    Handle<Object> self(runtime.thread,
+                        vm.new_object(runtime.thread, *runtime.locks));
+    // Everything the threads need is allocated already: the collector
+    // does not stop other threads yet.
+    runtime.call("bumps", "(I)V", {integer(1)});
+
+    // A block synchronized on an object, static synchronized methods and
+    // synchronized methods, each incrementing `count` under its own lock.
+    constexpr int32_t thread_count = 3;
+    constexpr int32_t increments = 20000;
+    std::atomic<int32_t> failures {0};
+    for (int phase = 0; phase < 3; ++phase) {
+      runtime.count() = 0;
+      std::vector<std::thread> threads;
+      for (int32_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&] {
+          Thread thread(vm);
+          if (phase == 0) {
+            runtime.call(thread, "add", "(Ljava/lang/Object;I)V",
+                         {reference(lock.get()), integer(increments)});
+          } else if (phase == 1) {
+            runtime.call(thread, "bumps", "(I)V", {integer(increments)});
+          } else {
+            runtime.call(thread, "touches", "(Lapp/Locks;I)V",
+                         {reference(self.get()), integer(increments)});
+          }
+          if (thread.exception != nullptr) { ++failures; }
+        });
+      }
+      for (std::thread &thread : threads) { thread.join(); }
+      assert_equal(failures.load(), 0);
+      assert_equal(runtime.count(), thread_count * increments);
+    }
+
+    std::vector<std::thread> players;
+    for (int32_t me = 0; me < 2; ++me) {
+      players.emplace_back([&, me] {
+        Thread thread(vm);
+        runtime.call(thread, "play", "(Ljava/lang/Object;II)V",
+                     {reference(lock.get()), integer(me), integer(1000)});
+        if (thread.exception != nullptr) { ++failures; }
+      });
+    }
+    for (std::thread &player : players) { player.join(); }
+    assert_equal(failures.load(), 0);
+    MonitorStats stats = vm.get_monitors().get_stats();
+    assert_true(stats.waits > 0);
+    assert_equal(stats.in_use, uint64_t(0));
+    assert_equal(lock_state(*lock.get()), mark_word::unlocked);
+  }
+}
@@ -0,0 +1,452 @@
+#include <sktest/test.hpp>
+
+#include "temporary_directory.hpp"
+#include "test_vm.hpp"
+
+#include <skjvm/shared_archive.hpp>
+
+#include <string>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace skjvm;
+
+namespace {
+  /// A small hierarchy: `app/Circle` extends `app/Shape` and overrides
+  /// `area`, and `app/Main` refers to both. There is no `java/lang/Object`
+  /// on the class path, so the built-in one is used.
+  auto write_classes(TemporaryDirectory const &directory) -> bool {
+    ClassWriter shape("app/Shape");
+    shape.add_field(access::protected_, "x", "I");
+    shape.add_field(access::protected_, "y", "J");
+    shape.add_field(access::static_, "count", "I");
+    shape.add_field(access::protected_, "flag", "Z");
+    CodeWriter shape_area(shape);
+    shape_area.set_max(1, 1).iconst(0).op(Opcode::ireturn);
+    shape.add_method(access::public_, "area", "()I", &shape_area);
+    CodeWriter shape_init(shape);
+    shape_init.set_max(1, 1)
+              .local(Opcode::aload, 0)
+              .invoke(Opcode::invokespecial, "java/lang/Object", "<init>",
+                      "()V")
+              .op(Opcode::return_);
+    shape.add_method(access::public_, "<init>", "()V", &shape_init);
+
+    ClassWriter circle("app/Circle", "app/Shape");
+    circle.add_field(access::private_, "radius", "D");
+    CodeWriter circle_area(circle);
+    circle_area.set_max(1, 1).iconst(3).op(Opcode::ireturn);
+    circle.add_method(access::public_, "area", "()I", &circle_area);
+    circle.add_method(access::public_ | access::native, "scale", "(D)V",
+                      nullptr);
+
+    ClassWriter main("app/Main");
+    CodeWriter run(main);
+    run.set_max(2, 1)
+       .type(Opcode::new_, "app/Circle")
+       .invoke(Opcode::invokevirtual, "app/Circle", "area", "()I")
+       .field(Opcode::getstatic, "app/Circle", "count", "I")
+       .ldc_string("hello")
+       .type(Opcode::anewarray, "[Lapp/Circle;")
+       .op(Opcode::return_);
+    main.add_method(access::public_ | access::static_, "main",
+                    "([Ljava/lang/String;)V", &run);
+
+    return directory.write_class(shape, "app/Shape") and
+           directory.write_class(circle, "app/Circle") and
+           directory.write_class(main, "app/Main");
+  }
+
+  /// Index of the constant pool entry of \p klass with \p tag that refers
+  /// to something named \p name.
+  auto constant_named(Klass const &klass, ConstantTag tag, char const *name)
+      -> uint16_t {
+    ClassFile const &class_file = *klass.class_file;
+    for (uint16_t i = 1; i < class_file.get_constant_count(); ++i) {
+      if (class_file.tag(i) != tag) { continue; }
+      Utf8View value = tag == ConstantTag::class_
+                     ? class_file.class_name(i)
+                     : tag == ConstantTag::string
+                     ? class_file.string(i)
+                     : class_file.member_ref(i).name;
+      if (value.equals(name)) { return i; }
+    }
+    return 0;
+  }
+
+  /// The VM of one run, without the execution engine.
+  struct Runtime {
+    ClassPath class_path;
+    ClassLoader loader {class_path};
+    SharedArchive archive;
+    SymbolTable symbols;
+    ClassRegistry registry {loader, symbols};
+
+    explicit Runtime(std::string const &path) {
+      class_path.open(path.c_str(), nullptr);
+    }
+  };
+
+  auto read_file(std::string const &path) -> std::string {
+    std::string contents;
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == nullptr) { return contents; }
+    char buffer[4096];
+    size_t count = 0;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+      contents.append(buffer, count);
+    }
+    fclose(file);
+    return contents;
+  }
+
+  auto write_file(std::string const &path, std::string const &contents)
+      -> void {
+    FILE *file = fopen(path.c_str(), "wb");
+    fwrite(contents.data(), 1, contents.size(), file);
+    fclose(file);
+  }
+
+  auto set_uint32(std::string &contents, size_t offset, uint32_t value)
+      -> void {
+    memcpy(&contents[offset], &value, sizeof(value));
+  }
+
+  auto get_uint32(std::string const &contents, size_t offset) -> uint32_t {
+    uint32_t value = 0;
+    memcpy(&value, &contents[offset], sizeof(value));
+    return value;
+  }
+} // namespace
+
+test_group ("class registry: fields are laid out and vtables built") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  Runtime runtime(classes.get_path());
+  LinkError error = LinkError::none;
+
+  Klass *circle = runtime.registry.link(view("app/Circle"), error);
+  assert_true(circle != nullptr);
+  Klass *shape = runtime.registry.find(view("app/Shape"));
+  Klass *object = runtime.registry.find(view("java/lang/Object"));
+  assert_true(shape != nullptr and object != nullptr,
+              "supers are linked first");
+  assert_true(circle->super == shape and shape->super == object);
+  assert_true(circle->is_subclass_of(object));
+  assert_true(not shape->is_subclass_of(circle));
+
+  Field *x = shape->find_field(view("x"), view("I"));
+  Field *y = shape->find_field(view("y"), view("J"));
+  Field *flag = shape->find_field(view("flag"), view("Z"));
+  Field *count = shape->find_field(view("count"), view("I"));
+  Field *radius = circle->find_field(view("radius"), view("D"));
+  assert_equal(y->offset, object_header_size, "largest first");
+  assert_equal(x->offset, object_header_size + 8);
+  assert_equal(flag->offset, object_header_size + 12);
+  assert_equal(count->offset, 0u);
+  assert_true(count->is_static());
+  assert_equal(shape->instance_size, object_header_size + 16);
+  assert_equal(radius->offset, shape->instance_size,
+               "subclass fields follow the inherited ones");
+
+  Method *shape_area = shape->find_method(view("area"), view("()I"));
+  Method *circle_area = circle->find_method(view("area"), view("()I"));
+  assert_equal(circle_area->vtable_index, shape_area->vtable_index,
+               "an override takes the slot of the method it overrides");
+  assert_true(circle->vtable[circle_area->vtable_index] == circle_area);
+  assert_true(shape->vtable[shape_area->vtable_index] == shape_area);
+  Method *init = shape->find_method(view("<init>"), view("()V"));
+  assert_equal(init->vtable_index, -1);
+  assert_equal(init->argument_slots, 1);
+  Method *scale = circle->find_method(view("scale"), view("(D)V"));
+  assert_equal(scale->argument_slots, 3);
+  assert_true(not scale->code.is_present());
+  assert_equal(circle->vtable_length, object->vtable_length + 2u);
+
+  assert_true(runtime.registry.link(view("app/Missing"), error) == nullptr);
+  assert_true(error == LinkError::no_class_def_found);
+}
+
+test_group ("class registry: fields are packed with references together") {
+  TemporaryDirectory classes;
+  ClassWriter packed("app/Packed");
+  packed.add_field(0, "b", "B");
+  packed.add_field(0, "first", "Ljava/lang/Object;");
+  packed.add_field(0, "i", "I");
+  packed.add_field(0, "l", "J");
+  packed.add_field(0, "s", "S");
+  packed.add_field(0, "second", "[I");
+  ClassWriter child("app/PackedChild", "app/Packed");
+  child.add_field(0, "c", "I");
+  child.add_field(0, "third", "Ljava/lang/Object;");
+  child.add_field(0, "d", "Z");
+  assert_true(classes.write_class(packed, "app/Packed") and
+              classes.write_class(child, "app/PackedChild"));
+  Runtime runtime(classes.get_path());
+  LinkError error = LinkError::none;
+  Klass *sub = runtime.registry.link(view("app/PackedChild"), error);
+  assert_true(sub != nullptr);
+  Klass *super = sub->super;
+
+  auto offset = [](Klass *klass, char const *name, char const *type) {
+    Field *field = klass->find_field(view(name), view(type));
+    return field != nullptr ? field->offset : 0u;
+  };
+  assert_equal(offset(super, "first", "Ljava/lang/Object;"), 8u);
+  assert_equal(offset(super, "second", "[I"), 16u);
+  assert_equal(offset(super, "l", "J"), 24u);
+  assert_equal(offset(super, "i", "I"), 32u);
+  assert_equal(offset(super, "s", "S"), 36u);
+  assert_equal(offset(super, "b", "B"), 38u);
+  assert_equal(super->fields_end, 39u);
+  assert_equal(super->instance_size, 40u);
+  assert_equal(super->reference_block_count, 1u);
+  assert_equal(super->reference_blocks[0].offset, 8u);
+  assert_equal(super->reference_blocks[0].count, 2u);
+
+  // The subclass starts in the padding of its super class, and fills the
+  // hole that aligning its reference left.
+  assert_equal(offset(sub, "third", "Ljava/lang/Object;"), 40u);
+  assert_equal(offset(sub, "c", "I"), 48u);
+  assert_equal(offset(sub, "d", "Z"), 39u);
+  assert_equal(sub->instance_size, 56u);
+  assert_equal(sub->reference_block_count, 2u);
+  assert_equal(sub->reference_blocks[1].offset, 40u);
+  assert_equal(sub->reference_blocks[1].count, 1u);
+
+  char *text = nullptr;
+  size_t size = 0;
+  FILE *stream = open_memstream(&text, &size);
+  print_layout(stream, *sub);
+  fclose(stream);
+  std::string layout(text, size);
+  free(text);
+  assert_true(layout.find("Layout of app/PackedChild, 56 bytes:") !=
+              std::string::npos);
+  assert_true(layout.find("@39      1  app/PackedChild.d Z") !=
+              std::string::npos);
+  assert_true(layout.find("@52      4  (padding)") != std::string::npos);
+  assert_true(layout.find("references @8-23") != std::string::npos);
+}
+
+test_group ("class registry: references resolve and are cached") {
+  TemporaryDirectory classes;
+  assert_true(write_classes(classes));
+  Runtime runtime(classes.get_path());
+  LinkError error = LinkError::none;
+  Klass *main = runtime.registry.link(view("app/Main"), error);
+  assert_true(main != nullptr);
+
+  uint16_t area = constant_named(*main, ConstantTag::methodref, "area");
+  Method *method = runtime.registry.resolve_method(*main, area, error);
+  assert_true(method != nullptr);
+  assert_true(method->holder->name.equals("app/Circle"));
+  assert_true(main->resolved[area] == method);
+
+  uint16_t count = constant_named(*main, ConstantTag::fieldref, "count");
+  Field *field = runtime.registry.resolve_field(*main, count, error);
+  assert_true(field != nullptr);
+  assert_true(field->holder->name.equals("app/Shape"),
+              "fields are found in super classes");
+
+  uint16_t hello = constant_named(*main, ConstantTag::string, "hello");
+  Symbol const *symbol = runtime.registry.resolve_string(*main, hello);
+  assert_true(symbol == runtime.symbols.intern(view("hello")),
+              "strings are interned");
+
+  uint16_t array = constant_named(*main, ConstantTag::class_,
+                                  "[Lapp/Circle;");
+  Klass *circles = runtime.registry.resolve_class(*main, array, error);
+  assert_true(circles != nullptr and circles->is_array());
+  assert_true(circles->component == method->holder);
+  assert_true(circles->element_type == BasicType::reference);
+  Klass *ints = runtime.registry.link(view("[I"), error);
+  assert_true(ints != nullptr and ints->element_type == BasicType::int_);
+}
+
+test_group ("class registry: circular hierarchies are rejected") {
+  TemporaryDirectory classes;
+  ClassWriter first("app/A", "app/B");
+  ClassWriter second("app/B", "app/A");
+  assert_true(classes.write_class(first, "app/A"));
+  assert_true(classes.write_class(second, "app/B"));
+  Runtime runtime(classes.get_path());
+  LinkError error = LinkError::none;
+  assert_true(runtime.registry.link(view("app/A"), error) == nullptr);
+  assert_true(error == LinkError::class_circularity);
+}
+
+test_group ("shared archive: restored classes match linked ones") {
+  TemporaryDirectory classes;
+  TemporaryDirectory cache;
+  assert_true(write_classes(classes));
+  std::string archive_path = cache.get_path() + "/nested/app.jsa";
+
+  uint32_t linked_count = 0;
+  {
+    Runtime runtime(classes.get_path());
+    LinkError error = LinkError::none;
+    assert_true(runtime.registry.link(view("app/Main"), error) != nullptr);
+    for (size_t i = 0; i < runtime.registry.get_classes().get_size(); ++i) {
+      runtime.registry.resolve_all(*runtime.registry.get_classes()[i]);
+    }
+    assert_true(SharedArchive::dump(runtime.registry, runtime.class_path,
+                                    classes.get_path().c_str(),
+                                    archive_path.c_str()));
+    // Array classes are not archived.
+    for (Klass *klass : runtime.registry.get_classes()) {
+      linked_count += klass->is_array() ? 0 : 1;
+    }
+  }
+  assert_equal(linked_count, 4u);
+
+  Runtime runtime(classes.get_path());
+  assert_true(runtime.archive.open(archive_path.c_str(), runtime.class_path,
+                                   classes.get_path().c_str()) ==
+              ArchiveStatus::ok);
+  assert_equal(runtime.archive.restore(runtime.registry, false), 4u);
+  assert_equal(runtime.registry.get_shared_count(), 4u);
+  assert_equal(runtime.loader.get_loaded_count(), 0u,
+               "nothing was loaded from the class path");
+
+  Klass *circle = runtime.registry.find(view("app/Circle"));
+  Klass *shape = runtime.registry.find(view("app/Shape"));
+  Klass *main = runtime.registry.find(view("app/Main"));
+  assert_true(circle != nullptr and shape != nullptr and main != nullptr);
+  assert_true(circle->shared and circle->super == shape);
+  assert_equal(circle->find_field(view("radius"), view("D"))->offset,
+               shape->instance_size);
+  Method *circle_area = circle->find_method(view("area"), view("()I"));
+  assert_true(circle->vtable[circle_area->vtable_index] == circle_area);
+  assert_true(circle_area->code.is_present());
+  assert_equal(circle_area->code.code_length, 2u);
+
+  // Entries resolved before the dump are resolved in the restored classes.
+  uint16_t area = constant_named(*main, ConstantTag::methodref, "area");
+  assert_true(main->resolved[area] == circle_area);
+  uint16_t count = constant_named(*main, ConstantTag::fieldref, "count");
+  assert_true(main->resolved[count] ==
+              shape->find_field(view("count"), view("I")));
+  uint16_t hello = constant_named(*main, ConstantTag::string, "hello");
+  assert_true(main->resolved[hello] ==
+              runtime.symbols.lookup(view("hello")),
+              "archived strings are interned");
+  uint16_t array = constant_named(*main, ConstantTag::class_,
+                                  "[Lapp/Circle;");
+  assert_true(main->resolved[array] == nullptr);
+  LinkError error = LinkError::none;
+  Klass *circles = runtime.registry.resolve_class(*main, array, error);
+  assert_true(circles != nullptr and circles->component == circle,
+              "array classes are linked again on demand");
+}
+
+test_group ("shared archive: changed class files invalidate it") {
+  TemporaryDirectory classes;
+  TemporaryDirectory cache;
+  assert_true(write_classes(classes));
+  std::string archive_path = cache.get_path() + "/app.jsa";
+  {
+    Runtime runtime(classes.get_path());
+    LinkError error = LinkError::none;
+    assert_true(runtime.registry.link(view("app/Main"), error) != nullptr);
+    assert_true(SharedArchive::dump(runtime.registry, runtime.class_path,
+                                    classes.get_path().c_str(),
+                                    archive_path.c_str()));
+  }
+
+  {
+    Runtime runtime(classes.get_path() + ":/nonexistent/skjvm");
+    assert_true(runtime.archive.open(archive_path.c_str(), runtime.class_path,
+                                     (classes.get_path() +
+                                      ":/nonexistent/skjvm").c_str()) ==
+                ArchiveStatus::stale,
+                "another class path does not use the archive");
+  }
+
+  usleep(20000);
+  ClassWriter main("app/Main");
+  main.add_field(access::static_, "added", "I");
+  assert_true(classes.write_class(main, "app/Main"));
+  {
+    Runtime runtime(classes.get_path());
+    assert_true(runtime.archive.open(archive_path.c_str(), runtime.class_path,
+                                     classes.get_path().c_str()) ==
+                ArchiveStatus::stale);
+  }
+
+  FILE *file = fopen(archive_path.c_str(), "wb");
+  fputs("SKCDS001 but truncated", file);
+  fclose(file);
+  {
+    Runtime runtime(classes.get_path());
+    assert_true(runtime.archive.open(archive_path.c_str(), runtime.class_path,
+                                     classes.get_path().c_str()) ==
+                ArchiveStatus::bad_format);
+    assert_true(runtime.archive.open((archive_path + ".missing").c_str(),
+                                     runtime.class_path,
+                                     classes.get_path().c_str()) ==
+                ArchiveStatus::missing);
+  }
+}
+
+test_group ("shared archive: offsets out of the file are rejected") {
+  TemporaryDirectory classes;
+  TemporaryDirectory cache;
+  assert_true(write_classes(classes));
+  std::string archive_path = cache.get_path() + "/app.jsa";
+  {
+    Runtime runtime(classes.get_path());
+    LinkError error = LinkError::none;
+    assert_true(runtime.registry.link(view("app/Main"), error) != nullptr);
+    for (size_t i = 0; i < runtime.registry.get_classes().get_size(); ++i) {
+      runtime.registry.resolve_all(*runtime.registry.get_classes()[i]);
+    }
+    assert_true(SharedArchive::dump(runtime.registry, runtime.class_path,
+                                    classes.get_path().c_str(),
+                                    archive_path.c_str()));
+  }
+  std::string archive = read_file(archive_path);
+  assert_true(archive.size() > 48);
+
+  auto status_of = [&](std::string const &contents) {
+    write_file(archive_path, contents);
+    Runtime runtime(classes.get_path());
+    return runtime.archive.open(archive_path.c_str(), runtime.class_path,
+                                classes.get_path().c_str());
+  };
+  assert_true(status_of(archive) == ArchiveStatus::ok);
+
+  // The layout written by `SharedArchive::dump`: the header has the class
+  // count at 16 and the classes at 28, the symbols at 32, and each class
+  // record is 112 bytes. Every class has constants, methods, a vtable and
+  // resolved entries.
+  uint32_t class_count = get_uint32(archive, 16);
+  uint32_t last = get_uint32(archive, 28) + (class_count - 1) * 112;
+  auto const beyond = uint32_t(archive.size() + 8) & ~7u;
+  struct Section {
+    uint32_t offset;
+    char const *name;
+  };
+  Section const sections[] {
+    {64, "constant offsets"}, {68, "members"}, {92, "methods"},
+    {96, "vtable"}, {104, "resolved"},
+  };
+  for (Section const &section : sections) {
+    std::string corrupted = archive;
+    set_uint32(corrupted, last + section.offset, beyond);
+    assert_true(status_of(corrupted) == ArchiveStatus::bad_format,
+                section.name);
+  }
+
+  std::string corrupted = archive;
+  set_uint32(corrupted, last + 100, 0x10000000);
+  assert_true(status_of(corrupted) == ArchiveStatus::bad_format,
+              "a vtable longer than the file");
+  corrupted = archive;
+  set_uint32(corrupted, get_uint32(archive, 32), beyond);
+  assert_true(status_of(corrupted) == ArchiveStatus::bad_format,
+              "a symbol out of the file");
+}
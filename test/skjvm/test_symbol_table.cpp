@@ -0,0 +1,173 @@
+#include <sktest/test.hpp>
+
+#include <skjvm/symbol_table.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace skjvm;
+
+namespace {
+  auto view(std::string const &name) -> Utf8View {
+    return {reinterpret_cast<uint8_t const *>(name.data()),
+            uint16_t(name.size())};
+  }
+
+  auto name_of(uint32_t i) -> std::string {
+    return "app/Name" + std::to_string(i);
+  }
+
+  /// Stand-ins for strings, never dereferenced by the table.
+  auto fake_string(uint64_t *storage) -> Object * {
+    return reinterpret_cast<Object *>(storage);
+  }
+} // namespace
+
+test_group ("symbol table: equal bytes intern to the same symbol") {
+  SymbolTable symbols;
+  assert_true(symbols.lookup(view("java/lang/Object")) == nullptr);
+  assert_equal(symbols.get_capacity(), uint32_t(0));
+
+  Symbol const *object = symbols.intern(view("java/lang/Object"));
+  assert_true(object != nullptr);
+  assert_true(object->view().equals("java/lang/Object"));
+  assert_true(symbols.intern(view("java/lang/Object")) == object);
+  assert_true(symbols.lookup(view("java/lang/Object")) == object);
+
+  // Interned from the middle of a larger buffer, like a constant of a
+  // class file.
+  std::string buffer = "(Ljava/lang/Object;)V";
+  Utf8View inner {reinterpret_cast<uint8_t const *>(buffer.data()) + 2, 16};
+  assert_true(symbols.intern(inner) == object);
+
+  Symbol const *empty = symbols.intern(view(""));
+  assert_true(empty != nullptr and empty != object);
+  assert_equal(empty->length, uint16_t(0));
+  assert_equal(symbols.get_count(), uint32_t(2));
+
+  // Through several resizes, each migrated while the next symbols go in.
+  std::vector<Symbol const *> interned;
+  for (uint32_t i = 0; i < 5000; ++i) {
+    interned.push_back(symbols.intern(view(name_of(i))));
+  }
+  assert_true(symbols.get_capacity() >= 8192);
+  assert_equal(symbols.get_count(), uint32_t(5002));
+  uint32_t found = 0;
+  for (uint32_t i = 0; i < 5000; ++i) {
+    if (symbols.lookup(view(name_of(i))) == interned[i] and
+        symbols.intern(view(name_of(i))) == interned[i]) {
+      ++found;
+    }
+  }
+  assert_equal(found, uint32_t(5000));
+  assert_true(symbols.lookup(view("java/lang/Object")) == object);
+}
+
+test_group ("symbol table: readers never miss a symbol while it grows") {
+  SymbolTable symbols;
+  std::vector<Symbol const *> known;
+  for (uint32_t i = 0; i < 100; ++i) {
+    known.push_back(symbols.intern(view("known/" + std::to_string(i))));
+  }
+  std::vector<std::string> names;
+  for (uint32_t i = 0; i < 40000; ++i) { names.push_back(name_of(i)); }
+
+  std::atomic<bool> done {false};
+  std::atomic<uint32_t> misses {0};
+  std::atomic<uint64_t> reads {0};
+  std::vector<std::thread> readers;
+  for (uint32_t t = 0; t < 3; ++t) {
+    readers.emplace_back([&] {
+      uint64_t count = 0;
+      while (not done.load() or count == 0) {
+        for (uint32_t i = 0; i < 100; ++i) {
+          if (symbols.lookup(known[i]->view()) != known[i]) { ++misses; }
+        }
+        ++count;
+      }
+      reads += count;
+    });
+  }
+
+  // Writers race to intern the same names, in different orders.
+  std::vector<std::vector<Symbol const *>> results(4);
+  std::vector<std::thread> writers;
+  for (uint32_t t = 0; t < 4; ++t) {
+    writers.emplace_back([&, t] {
+      std::vector<Symbol const *> &result = results[t];
+      result.resize(names.size());
+      for (uint32_t n = 0; n < names.size(); ++n) {
+        uint32_t i = t % 2 == 0 ? n : uint32_t(names.size()) - 1 - n;
+        result[i] = symbols.intern(view(names[i]));
+      }
+    });
+  }
+  for (std::thread &writer : writers) { writer.join(); }
+  done = true;
+  for (std::thread &reader : readers) { reader.join(); }
+
+  assert_equal(misses.load(), uint32_t(0));
+  assert_true(reads.load() >= 3);
+  assert_equal(symbols.get_count(), uint32_t(40100));
+  uint32_t agreed = 0;
+  for (uint32_t i = 0; i < names.size(); ++i) {
+    Symbol const *symbol = results[0][i];
+    if (symbol != nullptr and symbol->view().equals(view(names[i])) and
+        results[1][i] == symbol and results[2][i] == symbol and
+        results[3][i] == symbol and
+        symbols.lookup(view(names[i])) == symbol) {
+      ++agreed;
+    }
+  }
+  assert_equal(agreed, uint32_t(names.size()));
+}
+
+test_group ("symbol table: interned strings are weak roots") {
+  SymbolTable symbols;
+  uint64_t storage[4] {};
+  Symbol const *hello = symbols.intern(view("hello"));
+  assert_true(symbols.find_string(hello) == nullptr);
+  assert_true(symbols.set_string(hello, fake_string(&storage[0])) ==
+              fake_string(&storage[0]));
+  assert_true(symbols.set_string(hello, fake_string(&storage[1])) ==
+              fake_string(&storage[0]), "the first string stays interned");
+  assert_true(symbols.find_string(hello) == fake_string(&storage[0]));
+
+  PodVector<Object **> roots;
+  symbols.add_weak_roots(roots);
+  assert_equal(roots.get_size(), size_t(1));
+  assert_true(*roots[0] == fake_string(&storage[0]));
+
+  // As the collector does: move it, then free it.
+  *roots[0] = fake_string(&storage[2]);
+  assert_true(symbols.find_string(hello) == fake_string(&storage[2]));
+  *roots[0] = nullptr;
+  assert_true(symbols.find_string(hello) == nullptr);
+  assert_true(symbols.set_string(hello, fake_string(&storage[3])) ==
+              fake_string(&storage[3]));
+
+  // Strings set while the table grows are found, and reported once each
+  // table is migrated.
+  std::vector<Symbol const *> interned;
+  for (uint32_t i = 0; i < 3000; ++i) {
+    interned.push_back(symbols.intern(view(name_of(i))));
+    if (i % 3 == 0) {
+      (void)symbols.set_string(interned[i / 2], fake_string(&storage[1]));
+    }
+  }
+  uint32_t strings = 0;
+  for (Symbol const *symbol : interned) {
+    if (symbols.find_string(symbol) != nullptr) { ++strings; }
+  }
+  assert_equal(strings, uint32_t(1000));
+  assert_true(symbols.find_string(hello) == fake_string(&storage[3]));
+
+  symbols.clear_strings();
+  assert_true(symbols.find_string(hello) == nullptr);
+  roots.clear();
+  symbols.add_weak_roots(roots);
+  assert_true(roots.is_empty());
+}
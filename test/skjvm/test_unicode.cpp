@@ -0,0 +1,302 @@
+#include <sktest/test.hpp>
+
+#include <skjvm/unicode.hpp>
+
+#include <cstdint>
+#include <vector>
+
+using namespace skjvm;
+
+namespace {
+  /// The instruction sets this CPU supports, the scalar reference first.
+  auto supported_isas() -> std::vector<UnicodeIsa> {
+    std::vector<UnicodeIsa> isas;
+    for (UnicodeIsa isa : {UnicodeIsa::scalar, UnicodeIsa::sse2,
+                           UnicodeIsa::avx2}) {
+      if (isa <= detect_unicode_isa()) { isas.push_back(isa); }
+    }
+    return isas;
+  }
+
+  /// Past the end of every output, to catch a kernel storing a whole block
+  /// beyond what it converted.
+  constexpr uint32_t guard_size = 64;
+  constexpr uint8_t guard_byte = 0xa5;
+
+  struct Decoded {
+    int64_t count;
+    std::vector<uint16_t> chars;
+    bool guarded;
+  };
+
+  auto decode(std::vector<uint8_t> const &bytes, bool modified) -> Decoded {
+    auto length = uint32_t(bytes.size());
+    auto convert = modified ? &decode_modified_utf8 : &decode_utf8;
+    Decoded result {convert(bytes.data(), length, nullptr), {}, true};
+    if (result.count < 0) { return result; }
+    result.chars.assign(size_t(result.count) + guard_size,
+                        uint16_t(guard_byte << 8 | guard_byte));
+    if (convert(bytes.data(), length, result.chars.data()) != result.count) {
+      result.count = -2;
+    }
+    for (size_t i = size_t(result.count); i < result.chars.size(); ++i) {
+      if (result.chars[i] != uint16_t(guard_byte << 8 | guard_byte)) {
+        result.guarded = false;
+      }
+    }
+    result.chars.resize(size_t(result.count));
+    return result;
+  }
+
+  struct Encoded {
+    std::vector<uint8_t> bytes;
+    bool consistent;
+  };
+
+  auto encode(std::vector<uint16_t> const &chars, bool modified)
+      -> Encoded {
+    auto length = uint32_t(chars.size());
+    auto convert = modified ? &encode_modified_utf8 : &encode_utf8;
+    size_t size = convert(chars.data(), length, nullptr);
+    Encoded result {std::vector<uint8_t>(size + guard_size, guard_byte),
+                    true};
+    result.consistent = convert(chars.data(), length,
+                                result.bytes.data()) == size;
+    for (size_t i = size; i < result.bytes.size(); ++i) {
+      if (result.bytes[i] != guard_byte) { result.consistent = false; }
+    }
+    result.bytes.resize(size);
+    return result;
+  }
+
+  auto bytes_of(std::initializer_list<uint8_t> bytes)
+      -> std::vector<uint8_t> {
+    return bytes;
+  }
+
+  /// Every code point, surrogates only with \p surrogates, with runs of
+  /// ASCII of all lengths between some of them so that the kernels start
+  /// and stop everywhere in a block.
+  auto every_code_point(bool surrogates) -> std::vector<uint16_t> {
+    std::vector<uint16_t> chars;
+    for (uint32_t code = 0; code <= 0x10ffff; ++code) {
+      if (code >= 0xd800 and code < 0xe000 and not surrogates) { continue; }
+      if (code < 0x10000) {
+        chars.push_back(uint16_t(code));
+      } else {
+        chars.push_back(uint16_t(0xd800 + ((code - 0x10000) >> 10)));
+        chars.push_back(uint16_t(0xdc00 + (code & 0x3ff)));
+      }
+      if (code % 61 == 0) {
+        for (uint32_t i = 0; i < code / 61 % 70; ++i) {
+          chars.push_back(uint16_t('a' + i % 26));
+        }
+      }
+    }
+    return chars;
+  }
+} // namespace
+
+test_group ("unicode: the transcoders agree with known answers") {
+  for (UnicodeIsa isa : supported_isas()) {
+    assert_true(set_unicode_isa(isa));
+    assert_true(get_unicode_isa() == isa);
+
+    // "a", U+0000 and U+1F600 as a surrogate pair.
+    auto sample = bytes_of({'a', 0xc0, 0x80, 0xed, 0xa0, 0xbd, 0xed, 0xb8,
+                            0x80});
+    Decoded decoded = decode(sample, true);
+    assert_equal(decoded.count, int64_t(4));
+    assert_true(decoded.chars ==
+                std::vector<uint16_t>({'a', 0, 0xd83d, 0xde00}));
+    assert_true(encode(decoded.chars, true).bytes == sample);
+    assert_equal(decode(sample, false).count, int64_t(-1),
+                 "overlong NUL and surrogates are not UTF-8");
+
+    auto smiley = bytes_of({'a', 0x00, 0xf0, 0x9f, 0x98, 0x80});
+    decoded = decode(smiley, false);
+    assert_true(decoded.chars ==
+                std::vector<uint16_t>({'a', 0, 0xd83d, 0xde00}));
+    assert_true(encode(decoded.chars, false).bytes == smiley);
+    assert_equal(decode(smiley, true).count, int64_t(-1),
+                 "NUL and 4-byte forms are not modified UTF-8");
+
+    for (auto const &malformed : {
+           bytes_of({0x80}), bytes_of({0xc1, 0xbf}), bytes_of({0xc2}),
+           bytes_of({0xe0, 0x9f, 0xbf}), bytes_of({0xed, 0xa0, 0x80}),
+           bytes_of({0xef, 0xbf}), bytes_of({0xf0, 0x8f, 0xbf, 0xbf}),
+           bytes_of({0xf4, 0x90, 0x80, 0x80}), bytes_of({0xf5, 0x80, 0x80,
+                                                        0x80}),
+           bytes_of({0xe2, 0x82, 0x41}), bytes_of({0xff})}) {
+      assert_equal(decode(malformed, false).count, int64_t(-1));
+    }
+    assert_equal(decode(bytes_of({0xef, 0xbf, 0xbf}), false).count,
+                 int64_t(1));
+    assert_equal(decode(bytes_of({0xf4, 0x8f, 0xbf, 0xbf}), false).count,
+                 int64_t(2));
+    assert_equal(decode({}, false).count, int64_t(0));
+
+    // Unpaired surrogates, alone or in the wrong order.
+    std::vector<uint16_t> unpaired {'x', 0xd800, 'y', 0xdc00, 0xdbff};
+    assert_true(encode(unpaired, false).bytes ==
+                bytes_of({'x', '?', 'y', '?', '?'}));
+    assert_equal(encode(unpaired, true).bytes.size(), size_t(11));
+  }
+  assert_true(set_unicode_isa(detect_unicode_isa()));
+}
+
+test_group ("unicode: every code point round-trips") {
+  std::vector<uint16_t> scalars = every_code_point(false);
+  std::vector<uint16_t> units = every_code_point(true);
+  assert_true(set_unicode_isa(UnicodeIsa::scalar));
+  Encoded utf8 = encode(scalars, false);
+  Encoded modified = encode(units, true);
+  assert_true(utf8.consistent and modified.consistent);
+
+  for (UnicodeIsa isa : supported_isas()) {
+    assert_true(set_unicode_isa(isa));
+    Encoded encoded = encode(scalars, false);
+    assert_true(encoded.consistent);
+    assert_true(encoded.bytes == utf8.bytes, describe(isa));
+    Decoded decoded = decode(utf8.bytes, false);
+    assert_true(decoded.guarded);
+    assert_true(decoded.chars == scalars, describe(isa));
+
+    encoded = encode(units, true);
+    assert_true(encoded.consistent);
+    assert_true(encoded.bytes == modified.bytes, describe(isa));
+    decoded = decode(modified.bytes, true);
+    assert_true(decoded.guarded);
+    assert_true(decoded.chars == units, describe(isa));
+
+    // From every offset in a block.
+    uint32_t cut = 4096;
+    while ((utf8.bytes[cut] & 0xc0) == 0x80) { ++cut; }
+    uint32_t matched = 0;
+    for (uint32_t offset = 0; offset < 40; ++offset) {
+      std::vector<uint8_t> shifted(offset, 'z');
+      shifted.insert(shifted.end(), utf8.bytes.begin(),
+                     utf8.bytes.begin() + cut);
+      std::vector<uint16_t> expected(offset, 'z');
+      int64_t prefix = decode_utf8(utf8.bytes.data(), cut, nullptr);
+      expected.insert(expected.end(), scalars.begin(),
+                      scalars.begin() + prefix);
+      if (decode(shifted, false).chars == expected) { ++matched; }
+    }
+    assert_equal(matched, uint32_t(40));
+  }
+  assert_true(set_unicode_isa(detect_unicode_isa()));
+}
+
+test_group ("unicode: the kernels reject what the scalar reference does") {
+  // Both bytes of every pair, then sequences built from the bytes where
+  // the rules change, with ASCII around them.
+  std::vector<std::vector<uint8_t>> inputs;
+  for (uint32_t pair = 0; pair < 0x10000; ++pair) {
+    inputs.push_back(bytes_of({uint8_t(pair >> 8), uint8_t(pair)}));
+  }
+  uint8_t const edges[] {0x00, 0x41, 0x7f, 0x80, 0x8f, 0x90, 0x9f, 0xa0,
+                         0xbf, 0xc0, 0xff};
+  for (uint32_t lead = 0xc0; lead <= 0xff; ++lead) {
+    for (uint32_t second = 0; second < 0x100; ++second) {
+      for (uint8_t third : edges) {
+        inputs.push_back(bytes_of({uint8_t(lead), uint8_t(second), third}));
+        if (lead < 0xf0) { continue; }
+        for (uint8_t fourth : edges) {
+          inputs.push_back(bytes_of({uint8_t(lead), uint8_t(second), third,
+                                     fourth}));
+        }
+      }
+    }
+  }
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    std::vector<uint8_t> padded(i % 40, 'p');
+    padded.insert(padded.end(), inputs[i].begin(), inputs[i].end());
+    padded.insert(padded.end(), 36, 's');
+    inputs[i] = padded;
+  }
+
+  assert_true(set_unicode_isa(UnicodeIsa::scalar));
+  std::vector<Decoded> utf8;
+  std::vector<Decoded> modified;
+  uint32_t valid_utf8 = 0;
+  uint32_t valid_modified = 0;
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    utf8.push_back(decode(inputs[i], false));
+    modified.push_back(decode(inputs[i], true));
+    if (i < 0x10000) {
+      valid_utf8 += utf8.back().count >= 0;
+      valid_modified += modified.back().count >= 0;
+    }
+  }
+  // Two ASCII bytes, or one 2-byte sequence: from 0xc2 in UTF-8, with the
+  // overlong ones in modified UTF-8, and no NUL byte there.
+  assert_equal(valid_utf8, uint32_t(128 * 128 + 30 * 64));
+  assert_equal(valid_modified, uint32_t(127 * 127 + 32 * 64));
+
+  for (UnicodeIsa isa : supported_isas()) {
+    assert_true(set_unicode_isa(isa));
+    uint32_t agreed = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      Decoded standard = decode(inputs[i], false);
+      Decoded java = decode(inputs[i], true);
+      if (standard.count == utf8[i].count and
+          standard.chars == utf8[i].chars and standard.guarded and
+          java.count == modified[i].count and
+          java.chars == modified[i].chars and java.guarded) {
+        ++agreed;
+      }
+    }
+    assert_equal(agreed, uint32_t(inputs.size()), describe(isa));
+  }
+  assert_true(set_unicode_isa(detect_unicode_isa()));
+}
+
+test_group ("unicode: Latin-1 strings compress and inflate") {
+  std::vector<uint8_t> latin1;
+  for (uint32_t round = 0; round < 3; ++round) {
+    for (uint32_t byte = 0; byte < 0x100; ++byte) {
+      latin1.push_back(uint8_t(byte));
+    }
+    latin1.insert(latin1.end(), 50 + round, 'q');
+  }
+  std::vector<uint16_t> widened(latin1.begin(), latin1.end());
+
+  for (UnicodeIsa isa : supported_isas()) {
+    assert_true(set_unicode_isa(isa));
+    std::vector<uint16_t> inflated(latin1.size() + guard_size, 0xffff);
+    inflate_latin1(latin1.data(), uint32_t(latin1.size()), inflated.data());
+    assert_true(std::vector<uint16_t>(inflated.begin(),
+                                      inflated.begin() +
+                                        int64_t(latin1.size())) == widened);
+    assert_equal(inflated[latin1.size()], uint16_t(0xffff));
+
+    std::vector<uint8_t> compressed(latin1.size());
+    assert_true(compress_latin1(widened.data(), uint32_t(widened.size()),
+                                compressed.data()));
+    assert_true(compressed == latin1);
+
+    std::vector<uint8_t> utf8(2 * latin1.size());
+    size_t size = encode_latin1_utf8(latin1.data(), uint32_t(latin1.size()),
+                                     utf8.data());
+    assert_equal(encode_latin1_utf8(latin1.data(), uint32_t(latin1.size()),
+                                    nullptr), size);
+    utf8.resize(size);
+    assert_true(utf8 == encode(widened, false).bytes);
+
+    // A wider unit anywhere in strings of any length.
+    uint32_t rejected = 0;
+    uint32_t cases = 0;
+    for (uint32_t length = 1; length <= 80; ++length) {
+      for (uint32_t at = 0; at < length; ++at) {
+        std::vector<uint16_t> chars(widened.begin(),
+                                    widened.begin() + length);
+        chars[at] = uint16_t(0x100 + at);
+        rejected += not compress_latin1(chars.data(), length, nullptr);
+        ++cases;
+      }
+    }
+    assert_equal(rejected, cases);
+  }
+  assert_true(set_unicode_isa(detect_unicode_isa()));
+}
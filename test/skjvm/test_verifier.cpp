@@ -0,0 +1,242 @@
+#include <sktest/test.hpp>
+
+#include "temporary_directory.hpp"
+#include "test_vm.hpp"
+
+#include <skjvm/verifier.hpp>
+
+#include <cstdint>
+#include <string>
+
+using namespace skjvm;
+
+namespace {
+  /// `app/Good`, whose methods type check, with frames where control flow
+  /// joins, as of class file \p version.
+  auto write_good(TemporaryDirectory const &directory, uint16_t version)
+      -> bool {
+    ClassWriter good("app/Good");
+    good.set_major_version(version);
+
+    CodeWriter init(good);
+    init.set_max(1, 1)
+        .local(Opcode::aload, 0)
+        .invoke(Opcode::invokespecial, "java/lang/Object", "<init>", "()V")
+        .op(Opcode::return_);
+    good.add_method(access::public_, "<init>", "()V", &init);
+
+    // int sum(int n): 0 + 1 + ... + n - 1, in a long.
+    CodeWriter sum(good);
+    Label loop = sum.new_label();
+    Label done = sum.new_label();
+    sum.set_max(4, 4)
+       .lconst(0).local(Opcode::lstore, 2)
+       .iconst(0).local(Opcode::istore, 1)
+       .bind(loop)
+       .local(Opcode::iload, 1).local(Opcode::iload, 0)
+       .jump(Opcode::if_icmpge, done)
+       .local(Opcode::lload, 2).local(Opcode::iload, 1).op(Opcode::i2l)
+       .op(Opcode::ladd).local(Opcode::lstore, 2)
+       .iinc(1, 1)
+       .jump(Opcode::goto_, loop)
+       .bind(done)
+       .local(Opcode::lload, 2).op(Opcode::l2i).op(Opcode::ireturn);
+    static_method(good, "sum", "(I)I", sum);
+
+    // int guarded(int a, int b): a / b, or -1 on division by zero.
+    CodeWriter guarded(good);
+    Label start = guarded.new_label();
+    Label end = guarded.new_label();
+    Label handler = guarded.new_label();
+    guarded.set_max(2, 2)
+           .bind(start)
+           .local(Opcode::iload, 0).local(Opcode::iload, 1)
+           .op(Opcode::idiv).op(Opcode::ireturn)
+           .bind(end)
+           .bind(handler)
+           .op(Opcode::pop).iconst(-1).op(Opcode::ireturn)
+           .handler(start, end, handler, "java/lang/ArithmeticException");
+    static_method(good, "guarded", "(II)I", guarded);
+
+    // int pick(int a): (a == 0 ? null : new Good()) == null ? 1 : 2, so a
+    // reference and null meet.
+    CodeWriter pick(good);
+    Label create = pick.new_label();
+    Label picked = pick.new_label();
+    Label found = pick.new_label();
+    pick.set_max(2, 1)
+        .local(Opcode::iload, 0)
+        .jump(Opcode::ifne, create)
+        .op(Opcode::aconst_null)
+        .jump(Opcode::goto_, picked)
+        .bind(create)
+        .type(Opcode::new_, "app/Good").op(Opcode::dup)
+        .invoke(Opcode::invokespecial, "app/Good", "<init>", "()V")
+        .bind(picked)
+        .jump(Opcode::ifnonnull, found)
+        .iconst(1).op(Opcode::ireturn)
+        .bind(found)
+        .iconst(2).op(Opcode::ireturn);
+    static_method(good, "pick", "(I)I", pick);
+
+    return directory.write_class(good, "app/Good");
+  }
+
+  /// `app/Bad`, each of whose methods fails to type check in its own way.
+  auto write_bad(TemporaryDirectory const &directory) -> bool {
+    ClassWriter bad("app/Bad");
+
+    // float bits(): an int returned as a float.
+    CodeWriter bits(bad);
+    bits.set_max(1, 0).iconst(5).op(Opcode::freturn);
+    static_method(bad, "bits", "()F", bits);
+
+    // int length(int s): an int used as an array.
+    CodeWriter length(bad);
+    length.set_max(1, 1)
+          .local(Opcode::iload, 0).op(Opcode::arraylength)
+          .op(Opcode::ireturn);
+    static_method(bad, "length", "(I)I", length);
+
+    // Object raw(): an object returned before its constructor ran.
+    CodeWriter raw(bad);
+    raw.set_max(1, 0).type(Opcode::new_, "app/Bad").op(Opcode::areturn);
+    static_method(bad, "raw", "()Ljava/lang/Object;", raw);
+
+    // int mixed(int a): an int on one path to the join and a float on the
+    // other, so no frame can describe it.
+    CodeWriter mixed(bad);
+    Label other = mixed.new_label();
+    Label join = mixed.new_label();
+    mixed.set_max(1, 1)
+         .local(Opcode::iload, 0)
+         .jump(Opcode::ifeq, other)
+         .iconst(1)
+         .jump(Opcode::goto_, join)
+         .bind(other)
+         .fconst(1)
+         .bind(join)
+         .op(Opcode::ireturn);
+    static_method(bad, "mixed", "(I)I", mixed);
+
+    return directory.write_class(bad, "app/Bad");
+  }
+
+  struct Runtime : TestVM {
+    explicit Runtime(std::string const &path,
+                     VerifyMode mode = VerifyMode::remote) : TestVM(path) {
+      vm.set_verify_mode(mode);
+    }
+
+    /// Call the static method \p name of \p class_name with int
+    /// \p arguments.
+    auto call(char const *class_name, char const *name,
+              char const *descriptor, int32_t first = 0, int32_t second = 0)
+        -> Value {
+      return TestVM::call(klass(class_name), name, descriptor,
+                          {first, second});
+    }
+  };
+
+  auto has_stack_map(Klass const &klass, char const *name,
+                     char const *descriptor) -> bool {
+    Method const *method = klass.find_method(view(name), view(descriptor));
+    return method != nullptr and
+           klass.class_file->find_attribute(method->code.attributes,
+                                            "StackMapTable").is_present();
+  }
+} // namespace
+
+test_group ("verifier: well typed code runs, verified once per method") {
+  TemporaryDirectory classes;
+  assert_true(write_good(classes, 52));
+  Runtime runtime(classes.get_path());
+  Klass *good = runtime.klass("app/Good");
+  assert_true(good != nullptr);
+  assert_true(has_stack_map(*good, "sum", "(I)I"),
+              "the class writer adds frames to code with branches");
+  assert_true(has_stack_map(*good, "guarded", "(II)I"));
+  assert_true(not has_stack_map(*good, "<init>", "()V"),
+              "straight line code needs no frames");
+
+  assert_equal(runtime.call("app/Good", "sum", "(I)I", 100).i, 4950);
+  assert_equal(runtime.call("app/Good", "guarded", "(II)I", 7, 2).i, 3);
+  assert_equal(runtime.call("app/Good", "guarded", "(II)I", 7, 0).i, -1);
+  assert_equal(runtime.call("app/Good", "pick", "(I)I", 0).i, 1);
+  assert_equal(runtime.call("app/Good", "pick", "(I)I", 1).i, 2);
+  assert_true(runtime.thread.exception == nullptr);
+  assert_equal(good->verified_methods, 4u,
+               "sum, guarded, pick and the constructor pick calls");
+
+  (void)runtime.call("app/Good", "sum", "(I)I", 10);
+  (void)runtime.call("app/Good", "pick", "(I)I", 1);
+  assert_equal(good->verified_methods, 4u, "the result is kept");
+  assert_true(good->verify_time > 0);
+
+  Method *sum = good->find_method(view("sum"), view("(I)I"));
+  assert_true(sum->verification == VerifyState::verified);
+}
+
+test_group ("verifier: old class files are checked by inference") {
+  TemporaryDirectory classes;
+  assert_true(write_good(classes, 49));
+  Runtime runtime(classes.get_path());
+  Klass *good = runtime.klass("app/Good");
+  assert_true(good != nullptr);
+  assert_true(not has_stack_map(*good, "sum", "(I)I"),
+              "frames came with version 50");
+  assert_equal(runtime.call("app/Good", "sum", "(I)I", 100).i, 4950);
+  assert_equal(runtime.call("app/Good", "pick", "(I)I", 1).i, 2);
+  assert_equal(good->verified_methods, 3u);
+}
+
+test_group ("verifier: ill typed code throws VerifyError on every call") {
+  TemporaryDirectory classes;
+  assert_true(write_bad(classes));
+  Runtime runtime(classes.get_path());
+  Klass *bad = runtime.klass("app/Bad");
+  assert_true(bad != nullptr);
+
+  (void)runtime.call("app/Bad", "bits", "()F");
+  assert_true(runtime.thrown("java/lang/VerifyError"));
+  assert_equal(runtime.message(),
+               "Bad type on operand stack in app/Bad.bits()F at offset 1");
+  (void)runtime.call("app/Bad", "bits", "()F");
+  assert_true(runtime.thrown("java/lang/VerifyError"), "the failure is kept");
+  assert_equal(runtime.message(),
+               "Bad type on operand stack in app/Bad.bits()F at offset 1");
+  assert_equal(bad->verified_methods, 1u, "and not checked again");
+
+  (void)runtime.call("app/Bad", "length", "(I)I");
+  assert_true(runtime.thrown("java/lang/VerifyError"));
+  (void)runtime.call("app/Bad", "raw", "()Ljava/lang/Object;");
+  assert_true(runtime.thrown("java/lang/VerifyError"),
+              "uninitialized objects may not escape");
+  (void)runtime.call("app/Bad", "mixed", "(I)I", 1);
+  assert_true(runtime.thrown("java/lang/VerifyError"));
+  assert_true(not has_stack_map(*bad, "mixed", "(I)I"),
+              "the class writer found no frames to write");
+  assert_equal(runtime.message(),
+               "Expecting a stack map frame at branch target in "
+               "app/Bad.mixed(I)I at offset 2");
+  assert_equal(bad->verified_methods, 4u);
+}
+
+test_group ("verifier: the verify mode picks the classes checked") {
+  TemporaryDirectory classes;
+  assert_true(write_bad(classes));
+  Runtime runtime(classes.get_path(), VerifyMode::none);
+  assert_equal(runtime.call("app/Bad", "bits", "()F").i, 5,
+               "-Xverify:none runs what it is given");
+  assert_true(runtime.thread.exception == nullptr);
+  assert_equal(runtime.klass("app/Bad")->verified_methods, 0u);
+
+  Klass *object = runtime.klass("java/lang/Object");
+  assert_true(object != nullptr);
+  Klass *bad = runtime.klass("app/Bad");
+  assert_true(not needs_verification(VerifyMode::remote, *object));
+  assert_true(needs_verification(VerifyMode::remote, *bad));
+  assert_true(needs_verification(VerifyMode::all, *object));
+  assert_true(not needs_verification(VerifyMode::none, *bad));
+  assert_equal(std::string(describe(VerifyMode::remote)), "remote");
+}
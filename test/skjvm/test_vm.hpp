@@ -0,0 +1,110 @@
+#ifndef skjvm_test_test_vm_hpp
+#define skjvm_test_test_vm_hpp
+
+#include <skjvm/class_loader.hpp>
+#include <skjvm/class_path.hpp>
+#include <skjvm/class_registry.hpp>
+#include <skjvm/class_writer.hpp>
+#include <skjvm/descriptor.hpp>
+#include <skjvm/symbol_table.hpp>
+#include <skjvm/vm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+inline auto view(char const *name) -> skjvm::Utf8View {
+  return skjvm::make_view(name);
+}
+
+/// Add the public static method \p name to \p writer, with extra \p flags.
+inline auto static_method(skjvm::ClassWriter &writer, char const *name,
+                          char const *descriptor, skjvm::CodeWriter &code,
+                          uint16_t flags = 0) -> void {
+  writer.add_method(skjvm::access::public_ | skjvm::access::static_ | flags,
+                    name, descriptor, &code);
+}
+
+/// \brief A VM over a class path, with one thread, for tests that run
+/// bytecode. Each test file derives its own \c Runtime from it.
+struct TestVM {
+  skjvm::ClassPath class_path;
+  skjvm::ClassLoader loader {class_path};
+  skjvm::SymbolTable symbols;
+  skjvm::ClassRegistry registry {loader, symbols};
+  skjvm::VM vm;
+  skjvm::Thread thread {vm};
+
+  explicit TestVM(std::string const &path,
+                  size_t heap_size = skjvm::VM::default_heap_size,
+                  size_t young_size = 0)
+    : vm(registry, heap_size, young_size) {
+    class_path.open(path.c_str(), nullptr);
+  }
+
+  TestVM(TestVM const&) = delete;
+  auto operator=(TestVM const&) -> TestVM & = delete;
+
+  /// Compile methods after \p threshold calls, or never if it is 0.
+  auto set_compile_threshold(uint32_t threshold) -> void {
+    skjvm::Compiler &compiler = vm.get_compiler();
+    compiler.set_enabled(threshold != 0);
+    compiler.set_compile_threshold(threshold);
+  }
+
+  auto klass(char const *name) -> skjvm::Klass * {
+    skjvm::LinkError error = skjvm::LinkError::none;
+    return registry.link(view(name), error);
+  }
+
+  /// Call the static method \p name of \p holder with int \p arguments,
+  /// initializing \p holder first.
+  auto call(skjvm::Klass *holder, char const *name, char const *descriptor,
+            std::vector<int32_t> const &arguments = {}) -> skjvm::Value {
+    thread.exception = nullptr;
+    skjvm::Method *method = holder == nullptr
+      ? nullptr
+      : holder->find_method(view(name), view(descriptor));
+    if (method == nullptr or not vm.initialize(thread, *holder)) {
+      return {};
+    }
+    skjvm::Value *locals = thread.get_stack_base();
+    for (size_t i = 0; i < arguments.size(); ++i) {
+      locals[i].i = arguments[i];
+    }
+    return vm.invoke(thread, *method, locals);
+  }
+
+  [[nodiscard]]
+  auto thrown(char const *class_name) const -> bool {
+    return thread.exception != nullptr and
+           thread.exception->get_klass()->name.equals(class_name);
+  }
+
+  /// The message of the exception thrown, as ASCII.
+  [[nodiscard]]
+  auto message() const -> std::string {
+    skjvm::Object *string = thread.exception != nullptr
+      ? vm.exception_message(thread.exception)
+      : nullptr;
+    if (string == nullptr) { return {}; }
+    skjvm::ArrayObject *chars = vm.string_chars(string);
+    std::string result;
+    for (int32_t i = 0; i < chars->length; ++i) {
+      result += char(chars->elements<uint16_t>()[i]);
+    }
+    return result;
+  }
+
+  /// A new instance of \p class_name, linked and initialized first.
+  [[nodiscard]]
+  auto new_object(char const *class_name) -> skjvm::Object * {
+    skjvm::Klass *created = klass(class_name);
+    if (created == nullptr or not vm.initialize(thread, *created)) {
+      return nullptr;
+    }
+    return vm.new_object(thread, *created);
+  }
+};
+
+#endif /* skjvm_test_test_vm_hpp */
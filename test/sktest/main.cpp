@@ -0,0 +1,5 @@
+// Tests of SkTest's own machinery that the example cannot show, such as the
+// state file behind --incremental.
+
+#define USE_SKTEST_DEFAULT_MAIN_FUNCTION
+#include <sktest/test.hpp>
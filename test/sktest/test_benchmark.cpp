@@ -0,0 +1,67 @@
+#include <sktest/test.hpp>
+#include <sktest/benchmark.hpp>
+#include <sktest/options.hpp>
+#include <sktest/perf_counters.hpp>
+
+#include <chrono>
+#include <string>
+
+using namespace sktest;
+
+namespace {
+  auto empty_loop(size_t) -> void {}
+} // namespace
+
+test_group ("benchmark: calibration of an empty body finishes") {
+  Benchmark empty("empty", &empty_loop, __FILE__, __LINE__);
+  auto start = std::chrono::steady_clock::now();
+  BenchmarkResult result = measure(empty, false);
+  auto seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  assert_true(seconds < 10, "calibration gives up on bodies it cannot time");
+  assert_equal(result.sample_count, size_t(100));
+  assert_true(result.iterations_per_sample <= size_t(1) << 40);
+  assert_true(result.min <= result.median and result.median <= result.p99);
+}
+
+test_group ("benchmark: --threshold takes a fractional percent") {
+  char program[] = "sktest";
+  char threshold[] = "--threshold=2.5";
+  char *argv[] = {program, threshold, nullptr};
+  Options options;
+  assert_true(Options::parse(2, argv, options));
+  assert_equal(options.regression_threshold, 0.025);
+
+  char negative[] = "--threshold=-1";
+  char *rejected[] = {program, negative, nullptr};
+  Options unchanged;
+  assert_true(not Options::parse(2, rejected, unchanged));
+}
+
+test_group ("benchmark: miss rates are n/a without their totals") {
+  PerfCounts perf;
+  perf.values[size_t(PerfEvent::branch_misses)] = 5;
+  perf.values[size_t(PerfEvent::branches)] = 200;
+  perf.values[size_t(PerfEvent::cache_misses)] = 3;
+  perf.valid_mask = uint8_t(1U << unsigned(PerfEvent::branch_misses) |
+                            1U << unsigned(PerfEvent::branches) |
+                            1U << unsigned(PerfEvent::cache_misses) |
+                            1U << unsigned(PerfEvent::cache_references));
+
+  char buffer[16];
+  assert_equal(std::string(format_rate(
+                 buffer, sizeof(buffer),
+                 perf.rate(PerfEvent::branch_misses, PerfEvent::branches))),
+               std::string("2.50%"));
+  assert_equal(std::string(format_rate(
+                 buffer, sizeof(buffer),
+                 perf.rate(PerfEvent::cache_misses,
+                           PerfEvent::cache_references))),
+               std::string("n/a"), "no cache references counted");
+
+  perf.valid_mask = uint8_t(1U << unsigned(PerfEvent::branch_misses));
+  assert_equal(std::string(format_rate(
+                 buffer, sizeof(buffer),
+                 perf.rate(PerfEvent::branch_misses, PerfEvent::branches))),
+               std::string("n/a"), "no branch counter");
+}
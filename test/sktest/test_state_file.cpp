@@ -0,0 +1,135 @@
+#include <sktest/test.hpp>
+#include <sktest/state_file.hpp>
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+using namespace sktest;
+
+namespace {
+  auto nothing() -> void {}
+
+  /// A file under /tmp, removed on destruction.
+  class TemporaryFile {
+    std::string path;
+
+   public:
+    TemporaryFile() {
+      char pattern[] = "/tmp/sktest-state-XXXXXX";
+      int fd = mkstemp(pattern);
+      if (fd >= 0) {
+        close(fd);
+        path = pattern;
+      }
+    }
+
+    TemporaryFile(TemporaryFile const&) = delete;
+    auto operator=(TemporaryFile const&) -> TemporaryFile & = delete;
+
+    ~TemporaryFile() {
+      if (not path.empty()) { remove(path.c_str()); }
+    }
+
+    [[nodiscard]]
+    auto get_path() const -> char const * {
+      return path.c_str();
+    }
+
+    auto write(char const *contents) const -> bool {
+      FILE *file = fopen(path.c_str(), "wb");
+      if (file == nullptr) { return false; }
+      bool written = fputs(contents, file) >= 0;
+      return fclose(file) == 0 and written;
+    }
+  };
+
+  auto passed_result() -> GroupResult {
+    GroupResult result;
+    result.total_assertion_count = 1;
+    result.passed_assertion_count = 1;
+    result.finished = true;
+    return result;
+  }
+} // namespace
+
+test_group ("state file: a group whose source is unreadable is always rerun") {
+  TestGroup group("unreadable", &nothing, "/nonexistent/sktest/t.cpp", 1);
+  StateFile state;
+  state.update(group, passed_result());
+  assert_true(state.find(group) != nullptr);
+  assert_equal(state.find(group)->source_hash, uint64_t(0));
+  assert_true(not state.is_unchanged(group), "a hash of 0 never matches");
+
+  TemporaryFile saved;
+  assert_true(state.save(saved.get_path()));
+  StateFile loaded;
+  loaded.load(saved.get_path());
+  assert_true(loaded.find(group) != nullptr);
+  assert_true(not loaded.is_unchanged(group), "nor after a reload");
+}
+
+test_group ("state file: a source recorded unreadable is rerun once readable") {
+  TemporaryFile source;
+  assert_true(source.write("int main() {}\n"));
+  TestGroup group("recorded as 0", &nothing, source.get_path(), 3);
+
+  TemporaryFile saved;
+  std::string line = "P 0 0 1 1 3\t" + std::string(source.get_path()) +
+                     "\trecorded as 0\n";
+  assert_true(saved.write(line.c_str()));
+  StateFile state;
+  state.load(saved.get_path());
+  assert_true(state.find(group) != nullptr);
+  assert_true(not state.is_unchanged(group));
+}
+
+test_group ("state file: a passed group is reused until its source changes") {
+  TemporaryFile source;
+  assert_true(source.write("int main() {}\n"));
+  TestGroup group("edited", &nothing, source.get_path(), 7);
+  TemporaryFile saved;
+  {
+    StateFile state;
+    state.update(group, passed_result());
+    assert_true(state.is_unchanged(group));
+    assert_true(state.save(saved.get_path()));
+  }
+
+  StateFile unchanged;
+  unchanged.load(saved.get_path());
+  assert_true(unchanged.is_unchanged(group));
+
+  assert_true(source.write("int main() { return 1; }\n"));
+  StateFile edited;
+  edited.load(saved.get_path());
+  assert_true(not edited.is_unchanged(group));
+}
+
+test_group ("state file: results of another build of the binary are rerun") {
+  TemporaryFile source;
+  assert_true(source.write("int main() {}\n"));
+  TestGroup group("rebuilt", &nothing, source.get_path(), 5);
+  StateFile current;
+  assert_true(current.get_binary_identity() != 0,
+              "the running binary is identified");
+
+  char prefix[64];
+  snprintf(prefix, sizeof(prefix), "P %" PRIx64 " %" PRIx64 " 1 1 5\t",
+           current.hash_source(source.get_path()),
+           current.get_binary_identity() + 1);
+  TemporaryFile saved;
+  assert_true(saved.write((prefix + std::string(source.get_path()) +
+                           "\trebuilt\n").c_str()));
+  StateFile rebuilt;
+  rebuilt.load(saved.get_path());
+  assert_true(rebuilt.find(group) != nullptr);
+  assert_true(not rebuilt.is_unchanged(group),
+              "an unchanged source does not make up for a new binary");
+
+  rebuilt.update(group, passed_result());
+  assert_true(rebuilt.is_unchanged(group), "the rerun records this build");
+}